@@ -167,9 +167,9 @@ WsResponseObject *logout(WebService *webService,
 /// @brief Array of WsFunctionDescrirptors with the names and function
 /// pointers of the functions tha make up the web service.
 WsFunctionDescriptor exampleServiceFunctions[] = {
-  {"login", login},
-  {"logout", logout},
-  {NULL, NULL}
+  {"login", login, NULL},
+  {"logout", logout, NULL},
+  {NULL, NULL, NULL}
 };
 
 /// @var exampleServiceFunctionDescriptors
@@ -200,21 +200,23 @@ WebService webService = {
   NULL,                                    // cookiesHandler
   NULL,                                    // requestObjectHandler
   wcSerialize,                             // serializeToXml
-  xmlToDictionary,                         // deserializeFromXml
+  xmlToRedBlackTree,                       // deserializeFromXml
+  rbTreeCreate_,                           // wsRequestObjectCreate
   (WsSerializeToJson) listToJson,          // serializeToJson
-  jsonToDictionary,                        // deserializeFromJson
-  dictionaryDestroy,                       // requestObjectDestroy
+  jsonToRedBlackTree,                      // deserializeFromJson
+  rbTreeDestroy,                           // requestObjectDestroy
   rbTreeDestroy,                           // responseObjectDestroy
   rbTreeGetValue,                          // getRequestValue
   rbTreeGetValue,                          // getResponseValue
   NULL,                                    // registerThread
   NULL,                                    // unregisterThread
-  (WsAddRequestValue) dictionaryAddEntry_, // addRequestValue_
+  rbTreeAddEntry_,                         // addRequestValue_
   wcAddResponseValue_,                     // addResponseValue_
   rbTreeRemove,                            // removeResponseValue
-  dictionaryToString,                      // requestObjectToString
+  (WsRequestObjectToString) listToString,  // requestObjectToString
   (WsResponseObjectToString) listToString, // responseObjectToString
   NULL,                                    // context
+  wsSerializeToJsonInArena,                // serializeToJsonInArena
 };
 
 /// @fn int main(int argc, char **argv)
@@ -223,24 +225,45 @@ WebService webService = {
 ///
 /// @param argc The number of command line arguments as an integer.
 /// @param argv A one-dimensional array of C strings with the values of the
-///   command line arguments.
+///   command line arguments.  If provided, argv[1] is the name of the
+///   WsServerMode to run the server in ("WS_THREADED", "WS_EVENT_LOOP", or
+///   "WS_COROUTINES").  If provided, argv[2] is the number of listening
+///   sockets to accept connections on.
 ///
 /// @return Returns 0 on success.  Any other value is an error.
 int main(int argc, char **argv) {
-  (void) argc;
-  (void) argv;
+  WsServerMode serverMode = WS_THREADED;
+  if (argc > 1) {
+    for (serverMode = (WsServerMode) 0; serverMode < NUM_WS_SERVER_MODES;
+      serverMode = (WsServerMode) (serverMode + 1)
+    ) {
+      if (strcmp(argv[1], WsServerModeNames[serverMode]) == 0) {
+        break;
+      }
+    }
+    if (serverMode == NUM_WS_SERVER_MODES) {
+      printLog(ERR, "Unknown server mode \"%s\".\n", argv[1]);
+      return 1;
+    }
+  }
+  int numListeners = 0;
+  if (argc > 2) {
+    numListeners = atoi(argv[2]);
+  }
   
   ExampleService exampleService;
   exampleService.currentSessionTokens = rbTreeCreate(typeI64);
   webService.context = &exampleService;
   
-  WebServer* webServer = webServerCreate(
-    /*interfacePath=*/ ".", /*portNumber=*/ 9000,
-    /*serverName=*/ "ExampleServer/1.0", /*timeout=*/ 15,
-    /*socketMode=*/ PLAIN, /*certificate=*/ NULL,
-    /*key=*/ NULL, /*redirectProtocol=*/ NULL, /*redirectPort=*/ 0,
-    /*redirectFunction=*/ NULL, /*webService=*/ &webService
-  );
+  WebServerCreateOptions webServerCreateOptions = {};
+  webServerCreateOptions.interfacePath = ".";
+  webServerCreateOptions.serverName = "ExampleServer/1.0";
+  webServerCreateOptions.timeout = 15;
+  webServerCreateOptions.socketMode = PLAIN;
+  webServerCreateOptions.webService = &webService;
+  webServerCreateOptions.serverMode = serverMode;
+  webServerCreateOptions.numListeners = numListeners;
+  WebServer* webServer = webServerCreate(9000, &webServerCreateOptions);
   if (webServer == NULL) {
     printLog(ERR, "webServerCreate returned NULL.\n");
     return 1;
@@ -259,4 +282,3 @@ int main(int argc, char **argv) {
   
   return 0;
 }
-
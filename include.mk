@@ -38,10 +38,12 @@ CNEXT_OBJ_FILES := \
     $(CNEXT_OBJ_DIR)/miniz.o \
 
 OBJ_FILES := \
+    $(OBJ_DIR)/AccessLogLib.o \
     $(OBJ_DIR)/DbClientLib.o \
     $(OBJ_DIR)/MariaDbLib.o \
     $(OBJ_DIR)/SqlClientLib.o \
     $(OBJ_DIR)/SqliteLib.o \
+    $(OBJ_DIR)/TraceLib.o \
     $(OBJ_DIR)/WebClientLib.o \
     $(OBJ_DIR)/WebServerLib.o \
 
@@ -96,7 +98,8 @@ WARNINGS := \
 
 include defines.mk
 
-all: $(OBJ_DIR)/RestServer.a $(EXE_DIR)/sqlite-client
+all: $(OBJ_DIR)/RestServer.a $(EXE_DIR)/sqlite-client \
+    $(EXE_DIR)/access-log-decoder
 
 $(OBJ_DIR)/RestServer.a: $(CNEXT_OBJ_DIR)/Cnext.a $(OBJ_FILES) $(MAKEFILE) include.mk $(OBJ_DIR)/sqlite3.o
 	$(ARCHIVE) $(OBJ_DIR)/RestServer.a $(OBJ_FILES) $(OBJ_DIR)/sqlite3.o $(CNEXT_OBJ_FILES)
@@ -105,6 +108,10 @@ $(EXE_DIR)/sqlite-client: $(SRC_DIR)/SqliteClient.c $(OBJ_DIR)/RestServer.a
 	$(MKDIR) $(EXE_DIR)
 	$(CXX) $(FLAGS) $(INCLUDES) $(DEFINES) $(WARNINGS) $< $(LINKS) -o $@
 
+$(EXE_DIR)/access-log-decoder: $(SRC_DIR)/AccessLogDecoder.c $(OBJ_DIR)/RestServer.a
+	$(MKDIR) $(EXE_DIR)
+	$(CXX) $(FLAGS) $(INCLUDES) $(DEFINES) $(WARNINGS) $< $(LINKS) -o $@
+
 $(OBJ_DIR)/%.o: $(SRC_DIR)/%.c $(INCLUDE_DIR)/%.h $(MAKEFILE) include.mk
 	$(MKDIR) $(OBJ_DIR)
 	$(CXX) $(FLAGS) $(INCLUDES) $(DEFINES) $(WARNINGS) -c $< -o $@
@@ -0,0 +1,174 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Created:           10.16.2026
+///
+/// @file              AccessLogLib.h
+///
+/// @brief             This is the library of functions for recording one
+///                    fixed-size binary record per request and decoding the
+///                    files they're written to.
+///
+/// @details
+///
+/// @copyright
+///                    Copyright (c) 2012-2025 Skymond, LLC.
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included
+/// in all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+/// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+///
+///                                Skymond, LLC
+///                             https://skymond.io
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef ACCESS_LOG_LIB_H
+#define ACCESS_LOG_LIB_H
+
+#include "CThreads.h"
+#include "StringLib.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// @def ACCESS_LOG_MAGIC
+///
+/// @brief The eight bytes that start the header of an access log file.
+#define ACCESS_LOG_MAGIC "WSACCLOG"
+
+/// @def ACCESS_LOG_VERSION
+///
+/// @brief The version of the AccessLogRecord layout written to access log
+/// files.
+#define ACCESS_LOG_VERSION 1
+
+/// @def ACCESS_LOG_NUM_PHASES
+///
+/// @brief The number of durations in an AccessLogRecord.
+#define ACCESS_LOG_NUM_PHASES 6
+
+/// @def ACCESS_LOG_NO_ROUTE
+///
+/// @brief The routeId of a request that didn't call a named route.
+#define ACCESS_LOG_NO_ROUTE 0xffffffff
+
+/// @def ACCESS_LOG_RING_RECORDS
+///
+/// @brief The number of records each thread's ring holds before they're
+/// written out.  Records that arrive while a ring is full are dropped.  Must
+/// be a power of two.
+#define ACCESS_LOG_RING_RECORDS 4096
+
+/// @def ACCESS_LOG_DRAIN_INTERVAL_MILLISECONDS
+///
+/// @brief The number of milliseconds between writes of the rings of an
+/// AccessLog to its file.
+#define ACCESS_LOG_DRAIN_INTERVAL_MILLISECONDS 100
+
+/// @enum AccessLogMethod
+///
+/// @brief The HTTP request methods an AccessLogRecord can hold.
+typedef enum AccessLogMethod {
+  ACCESS_LOG_METHOD_OTHER,
+  ACCESS_LOG_METHOD_GET,
+  ACCESS_LOG_METHOD_POST,
+  ACCESS_LOG_METHOD_HEAD,
+  ACCESS_LOG_METHOD_PUT,
+  ACCESS_LOG_METHOD_DELETE,
+  ACCESS_LOG_METHOD_OPTIONS,
+  ACCESS_LOG_METHOD_PATCH,
+  NUM_ACCESS_LOG_METHODS
+} AccessLogMethod;
+
+/// @struct AccessLogRecord
+///
+/// @brief One completed request as it's written to an access log file.  The
+/// fields are in host byte order except for clientAddress.
+///
+/// @param timestampUs The time the request completed in microseconds since
+///   the epoch.
+/// @param bytesIn The number of bytes of the request.
+/// @param bytesOut The number of bytes of the response that were sent.
+/// @param phaseUs The number of microseconds the request spent in each phase.
+///   The names of the phases are in the header of the file.
+/// @param clientAddress The IPv6 address of the client in network byte order.
+///   IPv4 addresses are stored IPv4-mapped.
+/// @param routeId The index of the route that was called in the route names
+///   in the header of the file.  ACCESS_LOG_NO_ROUTE if none was.
+/// @param statusCode The HTTP status code of the response.  Zero if no
+///   response was started.
+/// @param clientPort The port of the client.
+/// @param method The AccessLogMethod of the request.
+/// @param reserved Padding.  Always zero.
+typedef struct AccessLogRecord {
+  u64 timestampUs;
+  u64 bytesIn;
+  u64 bytesOut;
+  u32 phaseUs[ACCESS_LOG_NUM_PHASES];
+  u8  clientAddress[16];
+  u32 routeId;
+  u16 statusCode;
+  u16 clientPort;
+  u8  method;
+  u8  reserved[7];
+} AccessLogRecord;
+
+/// @struct AccessLogFileHeader
+///
+/// @brief The header that starts each access log file.  It's followed by
+/// namesLength bytes of NUL-terminated names: numPhases phase names and then
+/// numRoutes route names.  A file that's reopened gets another header, so a
+/// header may follow any record.
+///
+/// @param magic ACCESS_LOG_MAGIC without its NUL terminator.
+/// @param version ACCESS_LOG_VERSION.
+/// @param recordSize The size of an AccessLogRecord.
+/// @param numPhases The number of phase names that follow.
+/// @param numRoutes The number of route names that follow.
+/// @param namesLength The number of bytes of names that follow.
+/// @param reserved Padding.  Always zero.
+typedef struct AccessLogFileHeader {
+  char magic[8];
+  u32  version;
+  u32  recordSize;
+  u32  numPhases;
+  u32  numRoutes;
+  u32  namesLength;
+  u32  reserved;
+} AccessLogFileHeader;
+
+// Forward declaration.  The rings and the writer are private to AccessLogLib.
+typedef struct AccessLog AccessLog;
+
+AccessLog* accessLogCreate(const char *filePath, int rotateSeconds);
+AccessLog* accessLogDestroy(AccessLog *accessLog);
+int accessLogSetNames(AccessLog *accessLog, const char *const *phaseNames,
+  const char *const *routeNames, u32 numRoutes);
+void accessLogAdd(AccessLog *accessLog, const AccessLogRecord *record);
+int accessLogFlush(AccessLog *accessLog);
+u64 accessLogNumDropped(AccessLog *accessLog);
+AccessLogMethod accessLogMethodFromString(const char *method);
+i64 accessLogDecode(FILE *input, FILE *output, bool csv,
+  bool columnNames);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // ACCESS_LOG_LIB_H
@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Created:           10.16.2026
+///
+/// @file              TraceLib.h
+///
+/// @brief             This is the library of functions for tracing requests
+///                    through the server and the clients they use.
+///
+/// @details
+///
+/// @copyright
+///                    Copyright (c) 2012-2025 Skymond, LLC.
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a
+/// copy of this software and associated documentation files (the "Software"),
+/// to deal in the Software without restriction, including without limitation
+/// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+/// and/or sell copies of the Software, and to permit persons to whom the
+/// Software is furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included
+/// in all copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+/// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+/// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+/// DEALINGS IN THE SOFTWARE.
+///
+///                                Skymond, LLC
+///                             https://skymond.io
+///
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef TRACE_LIB_H
+#define TRACE_LIB_H
+
+#include "CThreads.h"
+#include "StringLib.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/// @def TRACE_THREAD_LOCAL
+///
+/// @brief Storage class for variables that each thread gets its own copy of.
+#ifdef __cplusplus
+#define TRACE_THREAD_LOCAL thread_local
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#endif // __cplusplus
+
+/// @def TRACE_NAME_LENGTH
+///
+/// @brief The size of the name field of a TraceRecord.  Longer names are
+/// truncated.
+#define TRACE_NAME_LENGTH 32
+
+/// @def TRACE_DETAIL_LENGTH
+///
+/// @brief The size of the detail field of a TraceRecord.  Longer details are
+/// truncated.
+#define TRACE_DETAIL_LENGTH 128
+
+/// @def TRACEPARENT_LENGTH
+///
+/// @brief The size of a buffer that holds a traceparent header value and its
+/// NULL terminator.
+#define TRACEPARENT_LENGTH 56
+
+/// @def TRACE_DEFAULT_NUM_RECORDS
+///
+/// @brief The default number of spans a TraceBuffer holds before they're
+/// written out.  Spans that arrive while it's full are dropped.
+#define TRACE_DEFAULT_NUM_RECORDS 8192
+
+/// @def TRACE_DRAIN_INTERVAL_MILLISECONDS
+///
+/// @brief The number of milliseconds between writes of a TraceBuffer to its
+/// file.
+#define TRACE_DRAIN_INTERVAL_MILLISECONDS 100
+
+// Forward declaration.  The ring buffer is private to TraceLib.
+typedef struct TraceBuffer TraceBuffer;
+
+/// @struct TraceContext
+///
+/// @brief The trace that a request belongs to.
+///
+/// @param traceBuffer The TraceBuffer the request's spans are added to.  NULL
+///   if the request isn't being traced, which is the only thing that has to be
+///   checked before recording a span.
+/// @param traceId The W3C trace ID shared by all of the spans of the trace.
+/// @param spanId The ID of the request's own span.  The spans recorded for
+///   the request are its children.
+/// @param parentSpanId The ID of the caller's span from the request's
+///   traceparent header.  Zero if the request started the trace.
+typedef struct TraceContext {
+  TraceBuffer *traceBuffer;
+  u8           traceId[16];
+  u64          spanId;
+  u64          parentSpanId;
+} TraceContext;
+
+/// @struct TraceSpan
+///
+/// @brief A span that's in progress, such as a call to another server, whose
+/// ID has to be known before it ends.
+///
+/// @param traceContext The TraceContext the span is part of.
+/// @param spanId The ID of the span.
+/// @param startNs The time the span started from traceNowNanoseconds.
+typedef struct TraceSpan {
+  const TraceContext *traceContext;
+  u64                 spanId;
+  u64                 startNs;
+} TraceSpan;
+
+/// @var traceCurrentContext
+///
+/// @brief The TraceContext of the traced request that the calling thread is
+/// working on.  NULL if the thread isn't working on a traced request, so
+/// clients only have to check this before recording a span.
+extern TRACE_THREAD_LOCAL TraceContext *traceCurrentContext;
+
+u64 traceNowNanoseconds(void);
+TraceBuffer* traceBufferCreate(const char *filePath, u32 numRecords);
+TraceBuffer* traceBufferDestroy(TraceBuffer *traceBuffer);
+int traceBufferFlush(TraceBuffer *traceBuffer);
+u64 traceBufferNumDropped(TraceBuffer *traceBuffer);
+bool traceContextStart(TraceContext *traceContext, TraceBuffer *traceBuffer,
+  const char *traceparent, int sampleRate);
+void traceContextAddSpan(const TraceContext *traceContext, const char *name,
+  const char *detail, u64 startNs, u64 endNs);
+void traceContextFinish(TraceContext *traceContext, const char *name,
+  const char *detail, u64 startNs, u64 endNs);
+void traceSpanStart(TraceSpan *span, const TraceContext *traceContext);
+void traceSpanEnd(TraceSpan *span, const char *name, const char *detail);
+void traceSpanGetTraceparent(const TraceSpan *span, char *buffer);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // TRACE_LIB_H
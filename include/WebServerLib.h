@@ -47,6 +47,8 @@
 #include "StringLib.h"
 #include "Dictionary.h"
 #include "List.h"
+#include "TraceLib.h"
+#include "AccessLogLib.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -69,12 +71,229 @@ extern "C"
 #error Type for WsRequestNode *MUST* be defined.
 #endif
 
+/// @def WS_DEFAULT_NUM_REACTOR_THREADS
+///
+/// @brief The number of reactor threads to start in WS_EVENT_LOOP mode if the
+/// caller does not specify a number.
+#define WS_DEFAULT_NUM_REACTOR_THREADS 2
+
+/// @def WS_DEFAULT_NUM_SCHEDULER_THREADS
+///
+/// @brief The number of scheduler threads to start in WS_COROUTINES mode if
+/// the caller does not specify a number.
+#define WS_DEFAULT_NUM_SCHEDULER_THREADS 4
+
+/// @def WS_DEFAULT_COROUTINE_STACK_SIZE
+///
+/// @brief The size, in bytes, of the stack of each connection's coroutine in
+/// WS_COROUTINES mode if the caller does not specify a size.  The server's own
+/// deepest paths (a TLS handshake, a compressed file, a compressed streamed
+/// response) were measured at a little over 9 KB on x86-64, with or without
+/// optimization.  The rest is left for the web service's handlers.  There is
+/// no guard page between coroutine stacks, so handlers that keep large
+/// buffers on the stack need a larger size.
+#define WS_DEFAULT_COROUTINE_STACK_SIZE (32 * 1024)
+
+/// @def WS_DEFAULT_MAX_COROUTINES_PER_THREAD
+///
+/// @brief The number of connections each scheduler thread can service at once
+/// in WS_COROUTINES mode if the caller does not specify a number.
+///
+/// @details Each scheduler thread's stack is created large enough for all of
+/// its coroutines:  the coroutine stack size times (this number + 2), plus
+/// 1 MB for the scheduler itself.  At the defaults, that's about 33 MB of
+/// address space per scheduler thread and 132 MB for the default
+/// WS_DEFAULT_NUM_SCHEDULER_THREADS.  Pages are only committed as coroutines
+/// first use them, so resident memory follows the peak number of
+/// simultaneous connections rather than this limit.
+#define WS_DEFAULT_MAX_COROUTINES_PER_THREAD 1024
+
+/// @def WS_DEFAULT_NUM_WORKER_THREADS
+///
+/// @brief The number of threads to start in a server's worker pool if the
+/// caller does not specify a number.
+#define WS_DEFAULT_NUM_WORKER_THREADS 64
+
+/// @def WS_DEFAULT_KEEP_ALIVE_TIMEOUT_SECONDS
+///
+/// @brief The number of seconds a persistent connection may sit idle between
+/// requests before the server closes it if the caller does not specify a value.
+#define WS_DEFAULT_KEEP_ALIVE_TIMEOUT_SECONDS 5
+
+/// @def WS_DEFAULT_MAX_REQUESTS_PER_CONNECTION
+///
+/// @brief The number of requests the server will process on one persistent
+/// connection before closing it if the caller does not specify a value.
+#define WS_DEFAULT_MAX_REQUESTS_PER_CONNECTION 100
+
+/// @def WS_MAX_HTTP_HEADERS
+///
+/// @brief The maximum number of header fields the server will accept in one
+/// request.  Requests with more fields than this are treated as malformed.
+#define WS_MAX_HTTP_HEADERS 64
+
+/// @def WS_DEFAULT_MAX_QUEUED_REQUESTS
+///
+/// @brief The number of requests that may wait for a worker thread before the
+/// server's WsOverloadPolicy is applied if the caller does not specify a
+/// number.
+#define WS_DEFAULT_MAX_QUEUED_REQUESTS 1024
+
+/// @def WS_DEFAULT_RETRY_AFTER_SECONDS
+///
+/// @brief The value of the Retry-After header sent with a 503 response when
+/// the server is overloaded if the caller does not specify a value.
+#define WS_DEFAULT_RETRY_AFTER_SECONDS 1
+
+/// @def WS_DEFAULT_FILE_CACHE_MAX_BYTES
+///
+/// @brief The maximum number of bytes of static file content a server will
+/// keep in memory if the caller does not specify a value.
+#define WS_DEFAULT_FILE_CACHE_MAX_BYTES (32 * 1024 * 1024)
+
+/// @def WS_DEFAULT_COMPRESSION_LEVEL
+///
+/// @brief The deflate compression level (1-9) to use for responses if the
+/// caller does not specify a value.
+#define WS_DEFAULT_COMPRESSION_LEVEL 6
+
+/// @def WS_DEFAULT_COMPRESSION_MIN_BYTES
+///
+/// @brief The size, in bytes, below which response bodies are sent
+/// uncompressed if the caller does not specify a value.  Below about one
+/// network packet, compression saves nothing on the wire.
+#define WS_DEFAULT_COMPRESSION_MIN_BYTES 1024
+
+/// @def WS_DEFAULT_MAX_REQUEST_BODY_BYTES
+///
+/// @brief The largest request body, in bytes, a server will accept if the
+/// caller does not specify a value.
+#define WS_DEFAULT_MAX_REQUEST_BODY_BYTES (256 * 1024 * 1024)
+
+/// @def WS_DEFAULT_REQUEST_BODY_MEMORY_BYTES
+///
+/// @brief The size, in bytes, above which a request body is spooled to a
+/// temporary file instead of being held in memory if the caller does not
+/// specify a value.
+#define WS_DEFAULT_REQUEST_BODY_MEMORY_BYTES (1024 * 1024)
+
+/// @def WS_DEFAULT_NUM_LISTENERS
+///
+/// @brief The number of listening sockets (and accept threads) to open on the
+/// server's port if the caller does not specify a number.
+#define WS_DEFAULT_NUM_LISTENERS 1
+
+/// @def WS_DEFAULT_METRICS_PATH
+///
+/// @brief The path the server's metrics are served on in the Prometheus text
+/// format if the caller does not specify one.
+#define WS_DEFAULT_METRICS_PATH "/_metrics"
+
+/// @def WS_DEFAULT_DRAIN_TIMEOUT_SECONDS
+///
+/// @brief The number of seconds requests that are in progress when a server is
+/// destroyed are given to complete if the caller does not specify a value.
+#define WS_DEFAULT_DRAIN_TIMEOUT_SECONDS 5
+
+/// @def WS_DEFAULT_RESPONSE_CACHE_TTL_SECONDS
+///
+/// @brief The number of seconds a cached response is served for if a
+/// WsCachePolicy does not specify a value.
+#define WS_DEFAULT_RESPONSE_CACHE_TTL_SECONDS 60
+
+/// @def WS_DEFAULT_RESPONSE_CACHE_MAX_ENTRIES
+///
+/// @brief The number of responses that are cached for a function if a
+/// WsCachePolicy does not specify a value.
+#define WS_DEFAULT_RESPONSE_CACHE_MAX_ENTRIES 1024
+
+/// @def WS_DEFAULT_TLS_SESSION_CACHE_SIZE
+///
+/// @brief The number of TLS sessions kept for resumption by a TLS server if
+/// the caller does not specify a number.
+#define WS_DEFAULT_TLS_SESSION_CACHE_SIZE 20480
+
+/// @def WS_DEFAULT_TLS_SESSION_TIMEOUT_SECONDS
+///
+/// @brief The number of seconds a TLS session may be resumed for if the caller
+/// does not specify a value.
+#define WS_DEFAULT_TLS_SESSION_TIMEOUT_SECONDS 300
+
+/// @def WS_DEFAULT_TLS_TICKET_KEY_LIFETIME_SECONDS
+///
+/// @brief The number of seconds a TLS session ticket key issues tickets for
+/// before it's rotated if the caller does not specify a value.
+#define WS_DEFAULT_TLS_TICKET_KEY_LIFETIME_SECONDS 3600
+
+/// @def WS_DEFAULT_DEFERRED_RESPONSE_TIMEOUT_SECONDS
+///
+/// @brief The number of seconds the server waits for a deferred response to be
+/// completed before answering the request with a 504 if the caller of
+/// wsResponseDefer does not specify a value.
+#define WS_DEFAULT_DEFERRED_RESPONSE_TIMEOUT_SECONDS 30
+
+/// @def WS_DEFAULT_BATCH_PATH
+///
+/// @brief The path batches of web service calls are POSTed to if the caller
+/// does not specify one.
+#define WS_DEFAULT_BATCH_PATH "/_batch"
+
+/// @def WS_DEFAULT_MAX_BATCH_CALLS
+///
+/// @brief The number of calls one batch may contain if the caller does not
+/// specify a number.
+#define WS_DEFAULT_MAX_BATCH_CALLS 64
+
+/// @def WS_DEFAULT_TRACE_SAMPLE_RATE
+///
+/// @brief One in this many requests is traced when tracing is enabled if the
+/// caller does not specify a rate.
+#define WS_DEFAULT_TRACE_SAMPLE_RATE 100
+
+/// @def WS_DEFAULT_ACCESS_LOG_ROTATE_SECONDS
+///
+/// @brief The number of seconds each access log file covers if the caller
+/// does not specify a number.
+#define WS_DEFAULT_ACCESS_LOG_ROTATE_SECONDS 3600
+
 // Forward declaration to avoid circular dependency.
 typedef struct WebService WebService;
 typedef struct WsConnectionInfo WsConnectionInfo;
+typedef struct WsResponseWriter WsResponseWriter;
+typedef struct WsBodyReader WsBodyReader;
+// Deferred responses are private to WebServerLib.
+typedef struct WsPendingResponse WsPendingResponse;
+// The request arena is private to WebServerLib.
+typedef struct WsArena WsArena;
 
 typedef WsResponseObject* (*WsFunction)(WebService*, WsConnectionInfo*);
 
+/// @struct WsCachePolicy
+///
+/// @brief How the responses of a web service function may be reused.  Only
+/// functions whose responses depend on nothing but their parameters (and that
+/// change nothing when they're called) should have one.  Serialized responses
+/// are cached by their parameters and served to later calls with the same
+/// parameters without calling the function until they expire or are removed
+/// with wsResponseCacheInvalidate.  Streamed responses and responses that
+/// define their own body are never cached.
+///
+/// @param ttlSeconds The number of seconds a cached response is served for.
+///   Zero to use WS_DEFAULT_RESPONSE_CACHE_TTL_SECONDS.  Negative to disable
+///   caching.
+/// @param maxEntries The number of responses that are cached for the function.
+///   When it's full, the least-recently used response is evicted.  Zero to use
+///   WS_DEFAULT_RESPONSE_CACHE_MAX_ENTRIES.  Negative to disable caching.
+/// @param keys A NULL-terminated array of the names of the parameters that
+///   identify a response, as the function looks them up (e.g. "GET:id" for a
+///   query string parameter).  Other parameters are ignored.  NULL if every
+///   parameter identifies the response.
+typedef struct WsCachePolicy {
+  int          ttlSeconds;
+  int          maxEntries;
+  const char **keys;
+} WsCachePolicy;
+
 /// @struct WsFunctionDescriptor
 ///
 /// @brief Node to associate a web-service function with a specified name
@@ -82,9 +301,12 @@ typedef WsResponseObject* (*WsFunction)(WebService*, WsConnectionInfo*);
 ///
 /// @param name is the C-string name of the function.
 /// @param pointer is the pointer to the function.
+/// @param cachePolicy is the WsCachePolicy for the responses of the function.
+///   NULL if the function's responses are never cached.
 typedef struct WsFunctionDescriptor {
   const char *name;
   WsFunction pointer;
+  const WsCachePolicy *cachePolicy;
 } WsFunctionDescriptor;
 
 /// @struct WsNamespace
@@ -122,6 +344,7 @@ typedef WsResponseNode* (*WsAddResponseValue)(WsResponseObject **response,
 typedef int (*WsRemoveResponseValue)(WsResponseObject *response, const volatile void *key);
 typedef char* (*WsRequestObjectToString)(const WsRequestObject*);
 typedef char* (*WsResponseObjectToString)(const WsResponseObject*);
+typedef char* (*WsSerializeToJsonInArena)(WsArena *arena, WsResponseObject *responseObject);
 
 /// @struct WebService
 ///
@@ -175,6 +398,10 @@ typedef char* (*WsResponseObjectToString)(const WsResponseObject*);
 /// @param responseObjectToString A WsResponseObjectToString function pointer
 ///   that converts a WsResponseObject to a string.
 /// @param context Any web service-specific information to be provided to calls.
+/// @param serializeToJsonInArena An optional WsSerializeToJsonInArena function
+///   pointer to call to convert a WsResponseObject into a JSON string that's
+///   allocated from the arena of the request.  If it's NULL or returns NULL,
+///   serializeToJson is used instead.
 typedef struct WebService {
   WsNamespace              *namespaces;
   WsCookiesHandler          cookiesHandler;
@@ -202,8 +429,203 @@ typedef struct WebService {
   WsRequestObjectToString   requestObjectToString;
   WsResponseObjectToString  responseObjectToString;
   void                     *context;
+  WsSerializeToJsonInArena  serializeToJsonInArena;
 } WebService;
 
+/// @enum WsServerMode
+///
+/// @brief The strategy a WebServer uses to service its client connections.
+///
+/// @param WS_THREADED Every accepted connection is serviced start to finish
+///   by one of the server's worker threads using blocking I/O.  This is the
+///   default mode of the server.
+/// @param WS_EVENT_LOOP A small, fixed set of reactor threads own all of the
+///   client sockets, run their TLS handshakes, and read requests without
+///   blocking.  Only complete requests are handed off to worker threads for
+///   processing.  Only available on Linux.  Other platforms fall back to
+///   WS_THREADED.
+/// @param WS_COROUTINES Every accepted connection is serviced start to finish
+///   by its own coroutine.  The coroutines are spread across a small, fixed
+///   set of scheduler threads.  When a coroutine's socket isn't ready, the
+///   coroutine yields to its scheduler, which resumes it once the socket is
+///   ready, so handlers keep their straight-line style without holding a
+///   thread while they wait on the client.  A handler that blocks on anything
+///   else (a database, for instance) blocks every connection on its scheduler
+///   thread.  Only available on Linux.  Other platforms fall back to
+///   WS_THREADED.
+/// @param NUM_WS_SERVER_MODES The number of valid WsServerMode values.
+typedef enum WsServerMode {
+  WS_THREADED,
+  WS_EVENT_LOOP,
+  WS_COROUTINES,
+  NUM_WS_SERVER_MODES
+} WsServerMode;
+extern const char *WsServerModeNames[];
+
+/// @enum WsOverloadPolicy
+///
+/// @brief What a WebServer does when its worker pool's request queue is full.
+///
+/// @param WS_OVERLOAD_REJECT Immediately answer new requests with a 503
+///   (Service Unavailable) response and a Retry-After header.  TLS
+///   connections are closed without a response since answering would require
+///   the (expensive) handshake the server is trying to shed.
+/// @param WS_OVERLOAD_STOP_ACCEPTING Stop accepting new connections until
+///   there is room in the queue.  Pending connections wait in the kernel's
+///   listen backlog.
+/// @param NUM_WS_OVERLOAD_POLICIES The number of valid WsOverloadPolicy values.
+typedef enum WsOverloadPolicy {
+  WS_OVERLOAD_REJECT,
+  WS_OVERLOAD_STOP_ACCEPTING,
+  NUM_WS_OVERLOAD_POLICIES
+} WsOverloadPolicy;
+extern const char *WsOverloadPolicyNames[];
+
+/// @enum WsHttpParserState
+///
+/// @brief The states of the incremental HTTP request header parser.
+///
+/// @param WS_HTTP_PARSING_REQUEST_LINE The request line (method, location, and
+///   protocol) has not been fully received yet.
+/// @param WS_HTTP_PARSING_HEADERS The request line has been parsed and the
+///   parser is working through the header fields.
+/// @param WS_HTTP_HEADER_COMPLETE The full header has been parsed.  The body
+///   (if any) starts at bodyOffset.
+/// @param WS_HTTP_PARSE_ERROR The header is malformed or too large.
+typedef enum WsHttpParserState {
+  WS_HTTP_PARSING_REQUEST_LINE,
+  WS_HTTP_PARSING_HEADERS,
+  WS_HTTP_HEADER_COMPLETE,
+  WS_HTTP_PARSE_ERROR,
+} WsHttpParserState;
+
+/// @struct WsHttpHeader
+///
+/// @brief The location of one header field within a request buffer.  The
+/// parser NUL-terminates the name and the value in place, so both can be used
+/// as C strings directly from the buffer.
+///
+/// @param nameOffset The offset of the field name within the buffer.
+/// @param valueOffset The offset of the field value within the buffer.
+/// @param valueLength The length of the field value, not counting the NUL
+///   terminator.
+typedef struct WsHttpHeader {
+  u64 nameOffset;
+  u64 valueOffset;
+  u64 valueLength;
+} WsHttpHeader;
+
+/// @struct WsHttpRequest
+///
+/// @brief The parsed form of a request header.  Nothing is copied out of the
+/// buffer the request was received into; the parser only records offsets.
+/// Parsing is resumable:  Each call to wsHttpRequestParse examines only the
+/// data that has arrived since the previous call.
+///
+/// @param state The current WsHttpParserState of the parser.
+/// @param buffer The buffer the request was parsed from.
+/// @param scanOffset The offset of the first byte not yet examined.
+/// @param lineStart The offset of the start of the line being parsed.
+/// @param methodOffset The offset of the request method (e.g. "GET").
+/// @param locationOffset The offset of the requested location, if any.
+/// @param protocolOffset The offset of the protocol (e.g. "HTTP/1.1"), if any.
+/// @param bodyOffset The offset of the body of the request.  Only valid once
+///   the header is complete.
+/// @param contentLength The value of the Content-Length header field, if any.
+/// @param chunked Whether or not the body uses the chunked transfer coding.
+///   contentLength is ignored if it does.
+/// @param numHeaders The number of valid elements in headers.
+/// @param headers The locations of the header fields.
+/// @param httpParams A Dictionary of the header, built on the first call to
+///   wsHttpRequestGetParams.
+typedef struct WsHttpRequest {
+  WsHttpParserState    state;
+  const unsigned char *buffer;
+  u64                  scanOffset;
+  u64                  lineStart;
+  u64                  methodOffset;
+  u64                  locationOffset;
+  u64                  protocolOffset;
+  u64                  bodyOffset;
+  u64                  contentLength;
+  bool                 chunked;
+  u32                  numHeaders;
+  WsHttpHeader         headers[WS_MAX_HTTP_HEADERS];
+  Dictionary          *httpParams;
+} WsHttpRequest;
+
+/// @struct WebServerStats
+///
+/// @brief Snapshot of the load on a WebServer's worker pool and the state of its
+/// file cache.  Populated by webServerGetStats.
+///
+/// @param numWorkerThreads The number of threads in the worker pool.
+/// @param numBusyWorkers The number of worker threads currently processing a
+///   request.
+/// @param queueDepth The number of requests currently waiting for a worker.
+/// @param maxQueueDepth The largest value queueDepth has reached.
+/// @param numQueued The total number of requests that have been queued.
+/// @param numRejected The total number of requests that were rejected
+///   because the queue was full.
+/// @param numAcceptPauses The number of times the server stopped accepting
+///   connections because the queue was full.
+/// @param totalQueueWaitUs The total number of microseconds that dequeued
+///   requests spent waiting for a worker.
+/// @param maxQueueWaitUs The longest time, in microseconds, that any request
+///   spent waiting for a worker.
+/// @param numFileCacheHits The number of static file requests that were served
+///   from the file cache.
+/// @param numFileCacheMisses The number of static file requests that had to be
+///   read from disk.
+/// @param fileCacheBytes The number of bytes of file content currently held in
+///   the file cache.
+typedef struct WebServerStats {
+  u64 numWorkerThreads;
+  u64 numBusyWorkers;
+  u64 queueDepth;
+  u64 maxQueueDepth;
+  u64 numQueued;
+  u64 numRejected;
+  u64 numAcceptPauses;
+  u64 totalQueueWaitUs;
+  u64 maxQueueWaitUs;
+  u64 numFileCacheHits;
+  u64 numFileCacheMisses;
+  u64 fileCacheBytes;
+} WebServerStats;
+
+// Forward declarations.  The worker pool, file cache, listeners, route table,
+// metrics, and client table are private to WebServerLib.
+typedef struct WsWorkerPool WsWorkerPool;
+typedef struct WsFileCache WsFileCache;
+typedef struct WsListener WsListener;
+typedef struct WsRouteTable WsRouteTable;
+typedef struct WsMetrics WsMetrics;
+typedef struct WsClientTable WsClientTable;
+
+/// @struct WsRateLimit
+///
+/// @brief A limit on the rate at which each client (source IP address) may
+/// make requests.  Each client gets a token bucket per limit that holds up to
+/// burst tokens and refills at requestsPerSecond.  A request that finds its
+/// bucket empty gets a 429 (Too Many Requests) response.
+///
+/// @param namespaceName The web service namespace the limit applies to.  A
+///   request counts against the namespace of the function it's dispatched to,
+///   however that was named.  "*" applies the limit to every request that
+///   isn't for a namespace with its own limit, including requests for static
+///   files.  A NULL namespaceName
+///   terminates an array of WsRateLimits.
+/// @param requestsPerSecond The rate at which a client's bucket refills.
+///   Limits that aren't positive are ignored.
+/// @param burst The number of requests a client that has been idle may make
+///   at once.  A value of 0 or less allows one second's worth of requests.
+typedef struct WsRateLimit {
+  const char *namespaceName;
+  double      requestsPerSecond;
+  int         burst;
+} WsRateLimit;
+
 typedef Dictionary* (*RedirectFunction)(Socket *clientSocket,
   const char *interfacePath, Dictionary *httpParams, const unsigned char *body,
   Dictionary *cookiesDict);
@@ -234,7 +656,77 @@ typedef Dictionary* (*RedirectFunction)(Socket *clientSocket,
 ///   redirectPort if present.
 /// @param webService A populated WebService object that defines the web service
 ///   that is to run on this server, if any.
-/// @param socket The Socket that is constructed by wsInit for this listener.
+/// @param serverMode The WsServerMode to use to service client connections.
+/// @param numReactorThreads The number of reactor threads to use when
+///   serverMode is WS_EVENT_LOOP.
+/// @param numSchedulerThreads The number of scheduler threads to use when
+///   serverMode is WS_COROUTINES.
+/// @param coroutineStackSize The size, in bytes, of the stack of each
+///   connection's coroutine when serverMode is WS_COROUTINES.
+/// @param maxCoroutinesPerThread The number of connections each scheduler
+///   thread can service at once when serverMode is WS_COROUTINES.
+/// @param batchPath The path batches of web service calls are POSTed to.  NULL
+///   if the batch endpoint is disabled.
+/// @param maxBatchCalls The number of calls one batch may contain.  Negative
+///   if there is no limit.
+/// @param parallelBatchCalls Whether or not the calls in a batch are spread
+///   across the worker pool.
+/// @param traceBuffer The TraceBuffer the spans of traced requests are written
+///   to.  NULL if tracing is disabled.
+/// @param traceSampleRate One in this many requests without a sampled
+///   traceparent header is traced.  Zero or less if only those with one are.
+/// @param accessLog The AccessLog each completed request is recorded in.
+///   NULL if the access log is disabled.
+/// @param accessLogRotateSeconds The number of seconds each access log file
+///   covers.  Negative if the file is never rotated.
+/// @param numWorkerThreads The number of threads in the worker pool that
+///   processes requests.
+/// @param maxQueuedRequests The number of requests that may wait for a worker
+///   thread before overloadPolicy is applied.
+/// @param overloadPolicy The WsOverloadPolicy to apply when the request queue
+///   is full.
+/// @param retryAfterSeconds The value of the Retry-After header to send with
+///   503 responses when overloadPolicy is WS_OVERLOAD_REJECT.
+/// @param keepAliveTimeoutSeconds The number of seconds a persistent connection
+///   may sit idle between requests.
+/// @param maxRequestsPerConnection The number of requests that will be
+///   processed on one persistent connection before it's closed.
+/// @param fileCacheMaxBytes The maximum number of bytes of static file content
+///   to keep in memory.  Zero if the file cache is disabled.
+/// @param compressionLevel The deflate compression level (1-9) to use for
+///   responses.  Zero if response compression is disabled.
+/// @param compressionMinBytes The size, in bytes, below which response bodies
+///   are sent uncompressed.
+/// @param maxRequestBodyBytes The largest request body, in bytes, that will be
+///   accepted.  Zero if there is no limit.
+/// @param requestBodyMemoryBytes The size, in bytes, above which request bodies
+///   are spooled to a temporary file.  Zero if bodies are always held in
+///   memory.
+/// @param numListeners The number of listening sockets, each with its own
+///   accept thread, that are bound to portNumber.
+/// @param pinListeners Whether or not each accept thread is pinned to its own
+///   CPU.
+/// @param metricsPath The path the server's metrics are served on.  NULL if
+///   the metrics endpoint is disabled.
+/// @param tlsSessionCacheSize The number of TLS sessions kept for resumption.
+///   Negative if the session cache is disabled.
+/// @param tlsSessionTimeoutSeconds The number of seconds a TLS session may be
+///   resumed for.
+/// @param tlsTicketKeyLifetimeSeconds The number of seconds a TLS session
+///   ticket key issues tickets for before it's rotated.  Negative if session
+///   tickets are disabled.
+/// @param metrics The WsMetrics that the server's requests are counted and
+///   timed in.
+/// @param drainTimeoutSeconds The number of seconds in-progress requests are
+///   given to complete when the server is destroyed.  Negative if connections
+///   are closed without waiting.
+/// @param clientTable The WsClientTable that tracks the connections and
+///   request rates of each client.  NULL if there are no per-client limits.
+/// @param workerPool The WsWorkerPool that processes requests for the server.
+/// @param fileCache The WsFileCache that holds recently-served static files.
+/// @param listeners The array of numListeners WsListeners for the server.
+/// @param socket The Socket that is constructed by wsInit for the first
+///   listener.
 /// @param threadId The ID of the thread that's started for the server.
 /// @param isRunning A Boolean to communicate from the web server thread to the
 ///   parent whether or not it is currently running.
@@ -252,6 +744,41 @@ typedef struct WebServer {
   int               redirectPort;
   RedirectFunction redirectFunction;
   WebService       *webService;
+  WsServerMode      serverMode;
+  int               numReactorThreads;
+  int               numSchedulerThreads;
+  int               coroutineStackSize;
+  int               maxCoroutinesPerThread;
+  char             *batchPath;
+  int               maxBatchCalls;
+  bool              parallelBatchCalls;
+  TraceBuffer      *traceBuffer;
+  int               traceSampleRate;
+  AccessLog        *accessLog;
+  int               accessLogRotateSeconds;
+  int               numWorkerThreads;
+  int               maxQueuedRequests;
+  WsOverloadPolicy  overloadPolicy;
+  int               retryAfterSeconds;
+  int               keepAliveTimeoutSeconds;
+  int               maxRequestsPerConnection;
+  i64               fileCacheMaxBytes;
+  int               compressionLevel;
+  int               compressionMinBytes;
+  i64               maxRequestBodyBytes;
+  i64               requestBodyMemoryBytes;
+  int               numListeners;
+  bool              pinListeners;
+  char             *metricsPath;
+  int               tlsSessionCacheSize;
+  int               tlsSessionTimeoutSeconds;
+  int               tlsTicketKeyLifetimeSeconds;
+  WsMetrics        *metrics;
+  int               drainTimeoutSeconds;
+  WsClientTable    *clientTable;
+  WsWorkerPool     *workerPool;
+  WsFileCache      *fileCache;
+  WsListener       *listeners;
   Socket           *socket;
   thrd_t            threadId;
   bool              isRunning;
@@ -265,17 +792,41 @@ typedef struct WebServer {
 ///
 /// @param clientSocket The Socket to use to communicate with the client.
 /// @param interfacePath The path to the root of the static content.
-/// @param httpParams A Dictionary of the HTTP parameters parsed from the header
-///   received.
-/// @param body A pointer to the body of the request received.
+/// @param httpRequest The parsed header of the request received.  Use
+///   wsHttpRequestGetHeader to look up individual fields or
+///   wsHttpRequestGetParams to get a Dictionary of all of them.
+/// @param body A pointer to the body of the request received.  The body is
+///   always followed by a NUL byte.  Large bodies are mapped from a temporary
+///   file rather than held on the heap.
+/// @param bodyLength The number of bytes at body.  The transfer coding (if
+///   any) has already been removed.
 /// @param functionParams A pointer to a WsRequestObject that contains the
 ///   parsed parameters for the function call (if any).
+/// @param responseWriter The WsResponseWriter a function can use to stream its
+///   response to the client instead of returning a WsResponseObject.  A
+///   function that starts a streamed response must return NULL.
+/// @param bodyReader The WsBodyReader a function can use to consume the body
+///   of the request a piece at a time with wsBodyReaderRead.
+/// @param arena The WsArena of the request.  Memory allocated from it with the
+///   wsArena functions is released all at once when the request is complete.
+/// @param routeTable The WsRouteTable of the server's web service functions.
+///   Pass wsConnectionInfo to wsResponseCacheInvalidate to remove cached
+///   responses from it.
+/// @param pendingResponse The WsPendingResponse returned by wsResponseDefer if
+///   the function deferred its response, NULL otherwise.  A function that
+///   defers its response must return NULL.
 typedef struct WsConnectionInfo {
   Socket              *clientSocket;
   const char          *interfacePath;
-  Dictionary          *httpParams;
+  WsHttpRequest       *httpRequest;
   const unsigned char *body;
+  u64                  bodyLength;
   WsRequestObject     *functionParams;
+  WsResponseWriter    *responseWriter;
+  WsBodyReader        *bodyReader;
+  WsArena             *arena;
+  const WsRouteTable  *routeTable;
+  WsPendingResponse   *pendingResponse;
 } WsConnectionInfo;
 
 /// @struct WebServerCreateOptions
@@ -304,6 +855,129 @@ typedef struct WsConnectionInfo {
 /// @param webService A pointer to a populated WebService instance.  This
 ///   instance is expected to be persistent across the lifetime of the
 ///   WebServer.
+/// @param serverMode The WsServerMode to use to service client connections.
+///   Defaults to WS_THREADED.
+/// @param numReactorThreads The number of reactor threads that own client
+///   sockets when serverMode is WS_EVENT_LOOP.  A value of 0 selects
+///   WS_DEFAULT_NUM_REACTOR_THREADS.
+/// @param numWorkerThreads The number of pre-started threads that process
+///   requests in either serverMode.  A value of 0 selects
+///   WS_DEFAULT_NUM_WORKER_THREADS.
+/// @param maxQueuedRequests The number of requests that may wait for a worker
+///   thread before overloadPolicy is applied.  A value of 0 selects
+///   WS_DEFAULT_MAX_QUEUED_REQUESTS.
+/// @param overloadPolicy The WsOverloadPolicy to apply when the request queue
+///   is full.  Defaults to WS_OVERLOAD_REJECT.
+/// @param retryAfterSeconds The value of the Retry-After header to send with
+///   503 responses.  A value of 0 selects WS_DEFAULT_RETRY_AFTER_SECONDS.
+/// @param keepAliveTimeoutSeconds The number of seconds a persistent (HTTP
+///   keep-alive) connection may sit idle between requests before it's closed.
+///   A value of 0 selects WS_DEFAULT_KEEP_ALIVE_TIMEOUT_SECONDS.
+/// @param maxRequestsPerConnection The number of requests that will be
+///   processed on one persistent connection before it's closed.  A value of 0
+///   selects WS_DEFAULT_MAX_REQUESTS_PER_CONNECTION.  A value of 1 disables
+///   persistent connections.
+/// @param fileCacheMaxBytes The maximum number of bytes of static file content
+///   to keep in memory.  A value of 0 selects WS_DEFAULT_FILE_CACHE_MAX_BYTES.
+///   A negative value disables the file cache.
+/// @param compressionLevel The deflate compression level (1-9) to use for
+///   responses to clients that accept gzip or deflate.  A value of 0 selects
+///   WS_DEFAULT_COMPRESSION_LEVEL.  A negative value disables compression.
+/// @param compressionMinBytes The size, in bytes, below which response bodies
+///   are sent uncompressed.  A value of 0 selects
+///   WS_DEFAULT_COMPRESSION_MIN_BYTES.
+/// @param maxRequestBodyBytes The largest request body, in bytes, that will be
+///   accepted.  Larger requests get a 413 (Content Too Large) response.  A
+///   value of 0 selects WS_DEFAULT_MAX_REQUEST_BODY_BYTES.  A negative value
+///   disables the limit.
+/// @param requestBodyMemoryBytes The size, in bytes, above which a request
+///   body is spooled to a temporary file while it's received.  A value of 0
+///   selects WS_DEFAULT_REQUEST_BODY_MEMORY_BYTES.  A negative value keeps all
+///   bodies in memory.
+/// @param numListeners The number of listening sockets to bind to the port
+///   with SO_REUSEPORT.  Each one has its own accept thread and the kernel
+///   spreads new connections across them.  A value of 0 selects
+///   WS_DEFAULT_NUM_LISTENERS.  Only one listener is used on systems without
+///   SO_REUSEPORT.
+/// @param pinListeners Whether or not to pin each listener's accept thread to
+///   its own CPU.  Only supported on Linux.
+/// @param metricsPath The path to serve the server's metrics on.  A GET for
+///   this path returns request counts, byte counts, and per-function latency
+///   histograms in the Prometheus text format.  It takes precedence over web
+///   service functions and static files.  NULL selects
+///   WS_DEFAULT_METRICS_PATH.  An empty string disables the endpoint.
+/// @param drainTimeoutSeconds The number of seconds webServerDestroy gives
+///   requests that are in progress to complete after it stops accepting
+///   connections.  Connections that are still open at the deadline are forced
+///   closed.  A value of 0 selects WS_DEFAULT_DRAIN_TIMEOUT_SECONDS.  A
+///   negative value closes them without waiting.
+/// @param maxConnectionsPerClient The number of connections one client (source
+///   IP address) may have open at once.  Further connections get a 429 (Too
+///   Many Requests) response before anything is read from them.  A value of 0
+///   or less means there is no limit.
+/// @param rateLimits An array of WsRateLimits on the rate at which each client
+///   may make requests, terminated by one with a NULL namespaceName.  The
+///   array is copied.  NULL means requests are not rate limited.
+/// @param tlsSessionCacheSize The number of TLS sessions to keep so that
+///   reconnecting clients can resume them instead of doing a full handshake.
+///   A value of 0 selects WS_DEFAULT_TLS_SESSION_CACHE_SIZE.  A negative value
+///   disables the session cache.  Only used when socketMode is TLS.
+/// @param tlsSessionTimeoutSeconds The number of seconds a TLS session may be
+///   resumed for, either from the session cache or from a session ticket.  A
+///   value of 0 or less selects WS_DEFAULT_TLS_SESSION_TIMEOUT_SECONDS.
+/// @param tlsTicketKeyLifetimeSeconds The number of seconds each TLS session
+///   ticket key issues tickets for before it's rotated.  Tickets issued with
+///   the previous key are still accepted.  A value of 0 selects
+///   WS_DEFAULT_TLS_TICKET_KEY_LIFETIME_SECONDS.  A negative value disables
+///   session tickets.
+/// @param numSchedulerThreads The number of scheduler threads that run the
+///   connections' coroutines when serverMode is WS_COROUTINES.  A value of 0
+///   selects WS_DEFAULT_NUM_SCHEDULER_THREADS.
+/// @param coroutineStackSize The size, in bytes, of the stack of each
+///   connection's coroutine when serverMode is WS_COROUTINES.  Passed to
+///   coroutinesConfig on each scheduler thread.  A value of 0 selects
+///   WS_DEFAULT_COROUTINE_STACK_SIZE.
+/// @param maxCoroutinesPerThread The number of connections each scheduler
+///   thread can service at once when serverMode is WS_COROUTINES.  The stacks
+///   of a thread's coroutines are carved out of the thread's own stack, which
+///   is sized to hold this many of them (see
+///   WS_DEFAULT_MAX_COROUTINES_PER_THREAD for the cost in address space).
+///   Connections beyond what all of the threads can hold get a 503 (Service
+///   Unavailable) response.  A value of 0 selects
+///   WS_DEFAULT_MAX_COROUTINES_PER_THREAD.
+/// @param batchPath The path to accept batches of web service calls on.  A
+///   POST of a JSON array of {"namespace", "function", "params"} objects to
+///   this path calls each function with its params and returns a JSON array
+///   of {"status", "response"} objects in the same order.  NULL selects
+///   WS_DEFAULT_BATCH_PATH.  An empty string disables the endpoint.
+/// @param maxBatchCalls The number of calls one batch may contain.  Larger
+///   batches get a 413 (Content Too Large) response.  A value of 0 selects
+///   WS_DEFAULT_MAX_BATCH_CALLS.  A negative value disables the limit.
+/// @param parallelBatchCalls Whether or not to spread the calls in a batch
+///   across the worker pool instead of making them one after another.  The
+///   results are returned in the order of the calls either way.  Calls are
+///   always made one after another when serverMode is WS_COROUTINES.
+/// @param traceFilePath The path of the file to write the spans of traced
+///   requests to, one JSON object per line.  Each traced request gets a span
+///   for the whole request, one for the time it waited in a queue, one for
+///   each phase it went through, and one for each database query and web
+///   client request made by the function it called.  The trace ID and the
+///   parent span of a request are taken from its W3C traceparent header if it
+///   has one.  NULL or an empty string disables tracing.
+/// @param traceSampleRate One in this many requests is traced when tracing is
+///   enabled.  Requests with a traceparent header whose sampled flag is set
+///   are always traced.  A value of 0 selects WS_DEFAULT_TRACE_SAMPLE_RATE.  A
+///   negative value traces only the requests that were sampled upstream.
+/// @param accessLogPath The path of the binary access log.  Each completed
+///   request adds a fixed-size AccessLogRecord to a ring of the thread that
+///   processed it, and a background thread writes the rings to the file.
+///   Records are dropped rather than slowing requests down if the writer
+///   falls behind.  The access-log-decoder tool converts the files to text or
+///   CSV.  NULL or an empty string disables the access log.
+/// @param accessLogRotateSeconds The number of seconds each access log file
+///   covers.  The UTC start time of its period is appended to accessLogPath.
+///   A value of 0 selects WS_DEFAULT_ACCESS_LOG_ROTATE_SECONDS.  A negative
+///   value writes to accessLogPath itself and never rotates.
 typedef struct WebServerCreateOptions {
   const char *interfacePath;
   const char *serverName;
@@ -315,11 +989,79 @@ typedef struct WebServerCreateOptions {
   int redirectPort;
   RedirectFunction redirectFunction;
   WebService *webService;
+  WsServerMode serverMode;
+  int numReactorThreads;
+  int numWorkerThreads;
+  int maxQueuedRequests;
+  WsOverloadPolicy overloadPolicy;
+  int retryAfterSeconds;
+  int keepAliveTimeoutSeconds;
+  int maxRequestsPerConnection;
+  i64 fileCacheMaxBytes;
+  int compressionLevel;
+  int compressionMinBytes;
+  i64 maxRequestBodyBytes;
+  i64 requestBodyMemoryBytes;
+  int numListeners;
+  bool pinListeners;
+  const char *metricsPath;
+  int drainTimeoutSeconds;
+  int maxConnectionsPerClient;
+  const WsRateLimit *rateLimits;
+  int tlsSessionCacheSize;
+  int tlsSessionTimeoutSeconds;
+  int tlsTicketKeyLifetimeSeconds;
+  int numSchedulerThreads;
+  int coroutineStackSize;
+  int maxCoroutinesPerThread;
+  const char *batchPath;
+  int maxBatchCalls;
+  bool parallelBatchCalls;
+  const char *traceFilePath;
+  int traceSampleRate;
+  const char *accessLogPath;
+  int accessLogRotateSeconds;
 } WebServerCreateOptions;
 
 WebServer* webServerCreate(int portNumber, WebServerCreateOptions *options);
 WebServer* webServerDestroy(WebServer *webServer);
+int webServerGetStats(WebServer *webServer, WebServerStats *stats);
+void wsHttpRequestReset(WsHttpRequest *httpRequest);
+WsHttpParserState wsHttpRequestParse(WsHttpRequest *httpRequest, Bytes buffer);
+const char* wsHttpRequestGetHeader(
+  const WsHttpRequest *httpRequest, const char *name);
+Dictionary* wsHttpRequestGetParams(WsHttpRequest *httpRequest);
 const char *getMimeType(const char *fileExtension);
+int wsResponseWriterStart(WsResponseWriter *responseWriter,
+  const char *status, const char *contentType);
+int wsResponseWriterWrite(WsResponseWriter *responseWriter,
+  const void *data, u64 length);
+int wsResponseWriterWriteString(WsResponseWriter *responseWriter,
+  const char *string);
+int wsResponseWriterFlush(WsResponseWriter *responseWriter);
+int wsResponseWriterFinish(WsResponseWriter *responseWriter);
+i64 wsBodyReaderRead(WsBodyReader *bodyReader, void *buffer, u64 bufferSize);
+WsRouteTable* wsRouteTableCreate(const WsNamespace *namespaces);
+WsRouteTable* wsRouteTableDestroy(WsRouteTable *routeTable);
+WsFunction wsRouteTableGetFunction(const WsRouteTable *routeTable,
+  const char *key, size_t keyLength);
+int wsResponseCacheInvalidate(WsConnectionInfo *wsConnectionInfo,
+  const char *namespaceName, const char *functionName,
+  const WsRequestObject *params);
+WsArena* wsArenaCreate(void);
+WsArena* wsArenaDestroy(WsArena *arena);
+void wsArenaReset(WsArena *arena);
+void* wsArenaAlloc(WsArena *arena, size_t size);
+char* wsArenaStrdup(WsArena *arena, const char *string);
+char* wsArenaPrintf(WsArena *arena, const char *format, ...);
+char* wsArenaAddStr(WsArena *arena, char **buffer, const char *input);
+char* wsSerializeToJsonInArena(WsArena *arena,
+  WsResponseObject *responseObject);
+WsPendingResponse* wsResponseDefer(WebService *webService,
+  WsConnectionInfo *wsConnectionInfo, int timeoutSeconds);
+int wsResponseComplete(WsPendingResponse *pendingResponse,
+  WsResponseObject *responseObject);
+bool wsResponseCancelled(WsPendingResponse *pendingResponse);
 
 
 #ifdef __cplusplus
@@ -47,6 +47,7 @@
 #include <signal.h>
 
 #include "StringLib.h"
+#include "CAtomic.h"
 
 #ifdef TLS_SOCKETS_ENABLED
 #include <openssl/ssl.h>
@@ -119,6 +120,19 @@ extern "C"
 // Value definitions
 #define JUMBO_FRAME_SIZE 9000
 
+/// @def SOCKET_REUSE_PORT
+///
+/// @brief socketCreate option that lets several SERVER sockets bind the same
+/// address and port (SO_REUSEPORT).  The kernel spreads new connections
+/// across them.  Ignored on systems that don't support it.
+#define SOCKET_REUSE_PORT 0x1
+
+/// @def SOCKET_TLS_HANDSHAKE_TIMEOUT_MILLISECONDS
+///
+/// @brief Deadline for the TLS handshake of an accepted connection.  This is
+/// larger than practical so that the library still works under valgrind.
+#define SOCKET_TLS_HANDSHAKE_TIMEOUT_MILLISECONDS 15000
+
 // Type definitions
 typedef enum SocketType {
   SERVER,
@@ -141,6 +155,20 @@ typedef enum SocketProtocol {
 } SocketProtocol;
 extern const char *SocketProtocolNames[];
 
+// Forward declaration.
+typedef struct Socket Socket;
+
+/// @typedef SocketWaitFunction
+///
+/// @brief Function signature that socketSend, socketReceive, and the TLS
+/// handshake call instead of blocking when a socket with a wait function
+/// isn't ready.  The function waits on sock->sockfd for the POLLIN or POLLOUT
+/// events given and returns a positive value when the socket is ready, 0 if
+/// timeoutMilliseconds passed first (-1 waits indefinitely), and a negative
+/// value on error.
+typedef int (*SocketWaitFunction)(Socket *sock, short events,
+  int timeoutMilliseconds);
+  
 typedef struct Socket {
   int sockfd;
   SocketType socketType;
@@ -157,14 +185,51 @@ typedef struct Socket {
   BIO *sslBio;
   bool sslAccepted;
 #endif // TLS_SOCKETS_ENABLED
+  SocketWaitFunction waitFunction;
+  void *waitContext;
   char *_str;
 } Socket;
 
+#ifdef TLS_SOCKETS_ENABLED
+/// @enum TlsHandshakeState
+///
+/// @brief Result of advancing a non-blocking TLS handshake one step.
+///
+/// @param TLS_HANDSHAKE_COMPLETE The handshake has finished successfully.
+/// @param TLS_HANDSHAKE_WANT_READ The handshake is waiting for the socket to
+///   become readable.
+/// @param TLS_HANDSHAKE_WANT_WRITE The handshake is waiting for the socket to
+///   become writable.
+/// @param TLS_HANDSHAKE_FAILED The handshake failed and cannot be resumed.
+typedef enum TlsHandshakeState {
+  TLS_HANDSHAKE_COMPLETE,
+  TLS_HANDSHAKE_WANT_READ,
+  TLS_HANDSHAKE_WANT_WRITE,
+  TLS_HANDSHAKE_FAILED,
+  NUM_TLS_HANDSHAKE_STATES
+} TlsHandshakeState;
+
+/// @struct TlsSessionCounters
+///
+/// @brief Counts of the TLS handshakes completed on the connections accepted
+/// from a SERVER socket.  Updated with relaxed atomic increments.
+///
+/// @param numHandshakes The number of handshakes that completed.
+/// @param numResumed The number of completed handshakes that resumed an
+///   earlier session from the session cache or a session ticket instead of
+///   doing a full handshake.
+typedef struct TlsSessionCounters {
+  _Atomic(u64) numHandshakes;
+  _Atomic(u64) numResumed;
+} TlsSessionCounters;
+#endif // TLS_SOCKETS_ENABLED
+
 // Raw sockets functions.  Provided in case a user wants to make use of the
 // low-level functionality.
 int rawSocketsInit();
 int rawSocketConnect(int sockfd, const struct sockaddr *address,
   int addressLength, int timeoutMilliseconds);
+int rawSocketSetNonblocking(int sockfd, bool nonblocking);
 
 // Sockets functions
 int socketSetNonblocking(Socket *sock);
@@ -175,7 +240,8 @@ Socket* socketCreate_(SocketType socketType, SocketProtocol socketProtocol,
   int socketMode, const char *certificate, const char *key,
   int timeoutMilliseconds, ...);
 #define socketCreate(socketType, socketProtocol, address, ...) \
-  socketCreate_(socketType, socketProtocol, address, ##__VA_ARGS__, 0, 0, 0, 0)
+  socketCreate_(socketType, socketProtocol, address, ##__VA_ARGS__, \
+    0, 0, 0, 0, 0)
 void getIpAddress(char **address);
 size_t getAddressSize(const char *address);
 char *getNetworkAddress(const char *address, size_t numFixedBits);
@@ -185,14 +251,23 @@ int socketReceive_(Socket *sock, volatile void *buf, int len, int timeoutMillise
   ...);
 #define socketReceive(sock, buf, len, ...) \
   socketReceive_(sock, buf, len, ##__VA_ARGS__, -1)
+int socketReceiveAvailable(Socket *sock, volatile void *buf, int len,
+  short *waitEvents);
 Socket* socketAccept_(Socket *serverSocket, void *buf, int len, ...);
 #define socketAccept(serverSocket, ...) \
   socketAccept_(serverSocket, ##__VA_ARGS__, 0, 0)
 const char* socketAddress(Socket *sock);
 const char* socketToString(Socket *sock);
+int socketSetWaitFunction(Socket *sock, SocketWaitFunction waitFunction,
+  void *waitContext);
+int socketWait(Socket *sock, short events, int timeoutMilliseconds);
 #ifdef TLS_SOCKETS_ENABLED
 int configureTlsClientSocket(Socket *sock, int timeoutMilliseconds);
 bool tlsKeyAndCertificateValid(const char *certificate, const char *key);
+TlsHandshakeState socketTlsHandshakeStep(Socket *sock);
+int socketTlsHandshake(Socket *sock, int timeoutMilliseconds);
+int socketTlsSetSessionCache(Socket *sock, int cacheSize, int timeoutSeconds,
+  int ticketKeyLifetimeSeconds, TlsSessionCounters *counters);
 #endif // TLS_SOCKETS_ENABLED
 
 #ifdef __cplusplus
@@ -408,6 +408,10 @@ void coroutineSetupThreadMetadata(void) {
   if (status != thrd_success) {
     fprintf(stderr, "Could not initialize _tssStateData.\n");
   }
+  status = tss_create(&_tssCoroutineResumeCallback, free);
+  if (status != thrd_success) {
+    fprintf(stderr, "Could not initialize _tssCoroutineResumeCallback.\n");
+  }
   status = tss_create(&_tssCoroutineYieldCallback, free);
   if (status != thrd_success) {
     fprintf(stderr, "Could not initialize _tssCoroutineYieldCallback.\n");
@@ -478,6 +482,16 @@ bool coroutineInitializeThreadMetadata(Coroutine *first) {
       "coroutineInitializeThreadMetadata.\n", _globalStateData);
     return false;
   }
+  status = tss_set(
+    _tssCoroutineResumeCallback,
+    NULL
+  );
+  if (status != thrd_success) {
+    fprintf(stderr,
+      "Could not set _tssCoroutineResumeCallback to NULL in "
+      "coroutineInitializeThreadMetadata.\n");
+    return false;
+  }
   status = tss_set(
     _tssCoroutineYieldCallback,
     NULL
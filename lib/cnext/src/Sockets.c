@@ -41,6 +41,8 @@
 #include "Sockets.h"
 #ifdef TLS_SOCKETS_ENABLED
 #include "RsaLib.h"
+#include <openssl/core_names.h>
+#include <openssl/rand.h>
 #endif
 
 const char *SocketTypeNames[NUM_SOCKET_TYPES] = {
@@ -131,6 +133,25 @@ int socketsMsleep(int milliseconds) {
   return returnValue;
 }
 
+/// @fn i64 socketsMilliseconds(void)
+///
+/// @brief Get the current time in milliseconds from a monotonic clock.
+/// Deadlines are measured with this so that changes to the time of day can't
+/// stretch or cut them short.
+///
+/// @return Returns the number of milliseconds since an arbitrary point in the
+/// past.
+i64 socketsMilliseconds(void) {
+#ifdef _WIN32
+  return (i64) GetTickCount64();
+#else // POSIX
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  
+  return (((i64) now.tv_sec) * 1000) + (now.tv_nsec / 1000000);
+#endif
+}
+
 /// @fn int rawSocketsInit()
 ///
 /// @brief Initialize sockets mechanisms.  This is a no-op on POSIX systems.
@@ -389,6 +410,30 @@ int rawSocketConnect(int sockfd, const struct sockaddr *address,
   return returnValue;
 }
 
+/// @fn int rawSocketSetNonblocking(int sockfd, bool nonblocking)
+///
+/// @brief Put a raw socket file descriptor into or out of non-blocking mode
+/// without touching any Socket state.
+///
+/// @param sockfd The socket file descriptor to change.
+/// @param nonblocking Whether the file descriptor is to be non-blocking (true)
+///   or blocking (false).
+///
+/// @return Returns NO_ERROR on success, error code on failure.
+int rawSocketSetNonblocking(int sockfd, bool nonblocking) {
+#ifdef _WIN32
+  u_long mode = (nonblocking == true) ? 1 : 0;
+  return ioctlsocket(sockfd, FIONBIO, &mode);
+#else // POSIX
+  int flags = fcntl(sockfd, F_GETFL);
+  if (flags < 0) {
+    return flags;
+  }
+  flags = (nonblocking == true) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+  return fcntl(sockfd, F_SETFL, flags);
+#endif // _WIN32
+}
+
 #ifdef TLS_SOCKETS_ENABLED
 /// @var _tlsSocketsEnabled
 ///
@@ -432,74 +477,175 @@ bool tlsSocketsEnabled() {
 
 #ifdef TLS_SOCKETS_ENABLED
 
-/// @struct SslBioHandshakeWatchArgs
-/// @brief Arguments for the sslBioHandshakeWatch thread.
-/// @param sockfd The socket file descriptor to close if a connection isn't
-///   established in a suitable amount of time.
-/// @param connected A boolean to indicate whether or not the socket has been
-///   connected on the main thread.
-/// @param timeoutMilliseconds The number of seconds to wait before forcibly
-///   closing the socket if it's not connected.
-typedef struct SslBioHandshakeWatchArgs {
-  BIO *bio;
-  bool connected;
-  int timeoutMilliseconds;
-} SslBioHandshakeWatchArgs;
+/// @fn TlsHandshakeState socketTlsHandshakeStep(Socket *sock)
+///
+/// @brief Advance the TLS handshake of a socket as far as it can go without
+/// blocking.  Accepted (server-side) connections run SSL_accept and client
+/// sockets run the handshake on their SSL BIO.  The underlying file
+/// descriptor is expected to be in non-blocking mode.
+///
+/// @param sock The Socket whose handshake is to be advanced.
+///
+/// @return Returns TLS_HANDSHAKE_COMPLETE when the handshake is done,
+/// TLS_HANDSHAKE_WANT_READ or TLS_HANDSHAKE_WANT_WRITE when the caller needs
+/// to wait for the file descriptor to become readable or writable before
+/// calling again, and TLS_HANDSHAKE_FAILED on error.
+TlsHandshakeState socketTlsHandshakeStep(Socket *sock) {
+  if (sock == NULL) {
+    return TLS_HANDSHAKE_FAILED;
+  } else if (sock->sslAccepted == true) {
+    return TLS_HANDSHAKE_COMPLETE;
+  }
+  
+  TlsHandshakeState returnValue = TLS_HANDSHAKE_FAILED;
+  if (sock->ssl != NULL) {
+    ERR_clear_error();
+    int status = SSL_accept(sock->ssl);
+    if (status > 0) {
+      sock->sslAccepted = true;
+      updateSocketString(sock);
+      returnValue = TLS_HANDSHAKE_COMPLETE;
+      TlsSessionCounters *counters = (TlsSessionCounters*)
+        SSL_CTX_get_app_data(SSL_get_SSL_CTX(sock->ssl));
+      if (counters != NULL) {
+        atomic_fetch_add_explicit(&counters->numHandshakes, (u64) 1,
+          memory_order_relaxed);
+        if (SSL_session_reused(sock->ssl)) {
+          atomic_fetch_add_explicit(&counters->numResumed, (u64) 1,
+            memory_order_relaxed);
+        }
+      }
+    } else {
+      int sslError = SSL_get_error(sock->ssl, status);
+      if (sslError == SSL_ERROR_WANT_READ) {
+        returnValue = TLS_HANDSHAKE_WANT_READ;
+      } else if (sslError == SSL_ERROR_WANT_WRITE) {
+        returnValue = TLS_HANDSHAKE_WANT_WRITE;
+      }
+    }
+  } else if (sock->sslBio != NULL) {
+    ERR_clear_error();
+    if (BIO_do_handshake(sock->sslBio) > 0) {
+      sock->tcpConnected = true;
+      sock->sslAccepted = true;
+      updateSocketString(sock);
+      returnValue = TLS_HANDSHAKE_COMPLETE;
+    } else if (BIO_should_retry(sock->sslBio)) {
+      // A pending TCP connect is reported as a special retry.  Completion of
+      // the connect is signaled by the descriptor becoming writable.
+      returnValue = (BIO_should_read(sock->sslBio))
+        ? TLS_HANDSHAKE_WANT_READ : TLS_HANDSHAKE_WANT_WRITE;
+    }
+  }
+  
+  return returnValue;
+}
 
-/// @fn int sslBioHandshakeWatch(void *args)
+/// @fn int socketTlsHandshakeSockfd(Socket *sock)
 ///
-/// @brief Thread that watches for a connection to be established.  Forcibly
-/// closes the SSL BIO for the connection if it doesn't connect by the specified
-/// timeout.
+/// @brief Get the file descriptor that a TLS handshake is running over.
 ///
-/// @param args A pointer to a SslBioHandshakeWatchArgs structure with the
-///   parameters for this function.  The structure and any dynamic memory
-///   associated with its parameters must be freed by this function (the thread
-///   owns it).
+/// @param sock The Socket whose handshake is in progress.
 ///
-/// @return Returns 0 on success, negative error code on failure.
-int sslBioHandshakeWatch(void *args) {
-  SslBioHandshakeWatchArgs *sslBioSslBioHandshakeWatchArgs
-    = (SslBioHandshakeWatchArgs*) args;
-  bool *connected = &sslBioSslBioHandshakeWatchArgs->connected;
-  int timeoutMilliseconds = sslBioSslBioHandshakeWatchArgs->timeoutMilliseconds;
-  printLog(TRACE,
-    "ENTER sslBioHandshakeWatch(bio=%p, connected=%s, timeoutMilliseconds=%d)\n",
-    (void*) sslBioSslBioHandshakeWatchArgs->bio,
-    (*connected == true) ? "true" : "false", timeoutMilliseconds);
+/// @return Returns the file descriptor on success, -1 if the descriptor has
+/// not been created yet.
+int socketTlsHandshakeSockfd(Socket *sock) {
+  if (sock->sslBio != NULL) {
+    return (int) BIO_get_fd(sock->sslBio, NULL);
+  }
   
-  int returnValue = 0;
-  if (timeoutMilliseconds < 0) {
-    // Infinite timeout.  Just exit the thread gracefully.
+  return sock->sockfd;
+}
+
+/// @fn int socketTlsHandshake(Socket *sock, int timeoutMilliseconds)
+///
+/// @brief Run the TLS handshake of a socket to completion on the calling
+/// thread.  The file descriptor is switched to non-blocking mode for the
+/// duration of the handshake and the thread waits in poll between steps, so
+/// the deadline is enforced without a separate watchdog thread.  A socket
+/// with a wait function waits in that function instead.
+///
+/// @param sock The Socket whose handshake is to be run.
+/// @param timeoutMilliseconds The maximum number of milliseconds the handshake
+///   may take.  A value less than or equal to zero means no timeout.
+///
+/// @return Returns 0 on success, -1 on failure or timeout.
+int socketTlsHandshake(Socket *sock, int timeoutMilliseconds) {
+  printLog(TRACE, "ENTER socketTlsHandshake(sock=%s, timeoutMilliseconds=%d)\n",
+    socketToString(sock), timeoutMilliseconds);
+  
+  if (sock == NULL) {
+    printLog(ERR, "Socket provided is NULL.\n");
     printLog(TRACE,
-      "EXIT sslBioHandshakeWatch(bio=%p, connected=%s, timeoutMilliseconds=%d) "
-        "= {%d}\n",
-      (void*) sslBioSslBioHandshakeWatchArgs->bio,
-      (*connected == true) ? "true" : "false",
-      timeoutMilliseconds, returnValue);
-    return returnValue;
+      "EXIT socketTlsHandshake(sock=NULL, timeoutMilliseconds=%d) = {-1}\n",
+      timeoutMilliseconds);
+    return -1;
   }
   
-  for (int i = 0; (i < timeoutMilliseconds) && (*connected == false); i++) {
-    socketsMsleep(1);
+  i64 deadlineMs = socketsMilliseconds() + timeoutMilliseconds;
+  
+  int returnValue = -1;
+  int sockfd = socketTlsHandshakeSockfd(sock);
+  if (sockfd > -1) {
+    rawSocketSetNonblocking(sockfd, true);
   }
   
-  if (*connected == false) {
-    printLog(WARN, "Connection timed out after %d milliseconds.\n",
-      timeoutMilliseconds);
-    if (sslBioSslBioHandshakeWatchArgs->bio != NULL) {
-      int sockfd = BIO_get_fd(sslBioSslBioHandshakeWatchArgs->bio, NULL);
-      rawSocketClose(sockfd);
+  TlsHandshakeState state = socketTlsHandshakeStep(sock);
+  while ((state == TLS_HANDSHAKE_WANT_READ)
+    || (state == TLS_HANDSHAKE_WANT_WRITE)
+  ) {
+    int waitMs = -1;
+    if (timeoutMilliseconds > 0) {
+      waitMs = (int) (deadlineMs - socketsMilliseconds());
+      if (waitMs <= 0) {
+        printLog(WARN, "TLS handshake timed out after %d milliseconds.\n",
+          timeoutMilliseconds);
+        break;
+      }
     }
-    returnValue = -1;
+    
+    if (sockfd < 0) {
+      // A connect BIO doesn't create its descriptor until the first step.
+      sockfd = socketTlsHandshakeSockfd(sock);
+      if (sockfd > -1) {
+        rawSocketSetNonblocking(sockfd, true);
+      } else {
+        socketsMsleep(1);
+      }
+    } else if (sock->waitFunction != NULL) {
+      if (sock->waitFunction(sock,
+        (state == TLS_HANDSHAKE_WANT_READ) ? POLLIN : POLLOUT, waitMs) < 0
+      ) {
+        printLog(ERR, "Wait failed during TLS handshake.\n");
+        break;
+      }
+    } else {
+      ZEROINIT(struct pollfd pollDescriptor);
+      pollDescriptor.fd = sockfd;
+      pollDescriptor.events
+        = (state == TLS_HANDSHAKE_WANT_READ) ? POLLIN : POLLOUT;
+      if ((poll(&pollDescriptor, 1, waitMs) < 0) && (errno != EINTR)) {
+        printLog(ERR, "poll failed during TLS handshake.\n");
+        break;
+      }
+    }
+    
+    state = socketTlsHandshakeStep(sock);
+  }
+  if (state == TLS_HANDSHAKE_COMPLETE) {
+    returnValue = 0;
+  }
+  
+  sockfd = socketTlsHandshakeSockfd(sock);
+  if ((sockfd > -1) && (sock->blocking == true)
+    && (sock->waitFunction == NULL)
+  ) {
+    rawSocketSetNonblocking(sockfd, false);
   }
   
   printLog(TRACE,
-    "EXIT sslBioHandshakeWatch(bio=%p, connected=%s, timeoutMilliseconds=%d) = "
-      "{%d}\n",
-    (void*) sslBioSslBioHandshakeWatchArgs->bio,
-    (*connected == true) ? "true" : "false",
-    timeoutMilliseconds, returnValue);
+    "EXIT socketTlsHandshake(sock=%s, timeoutMilliseconds=%d) = {%d}\n",
+    socketToString(sock), timeoutMilliseconds, returnValue);
   return returnValue;
 }
 
@@ -636,6 +782,233 @@ int configureTlsServerSocket(Socket *sock,
   return 0;
 }
 
+/// @struct TlsTicketKey
+///
+/// @brief One of the keys that session tickets are encrypted and
+/// authenticated with.
+///
+/// @param name The name that identifies the key in the tickets it issued.
+/// @param aesKey The AES-256 key the ticket contents are encrypted with.
+/// @param hmacKey The HMAC-SHA256 key the tickets are authenticated with.
+/// @param created The time the key was generated.  Zero if the key hasn't been
+///   generated yet.
+typedef struct TlsTicketKey {
+  unsigned char name[16];
+  unsigned char aesKey[32];
+  unsigned char hmacKey[32];
+  time_t        created;
+} TlsTicketKey;
+
+/// @var _tlsTicketKeys
+///
+/// @brief The session ticket keys shared by all the SERVER sockets in the
+/// process so that a ticket issued by one listener can be redeemed at
+/// another.  Element 0 is the current key that new tickets are issued with.
+/// Element 1 is the key it replaced, which is still accepted for one more
+/// lifetime so that rotation doesn't force clients into full handshakes.
+static TlsTicketKey _tlsTicketKeys[2];
+
+/// @var _tlsTicketKeyLifetimeSeconds
+///
+/// @brief The number of seconds a ticket key issues new tickets for before it's
+/// rotated out.  Set by the most recent call to socketTlsSetSessionCache.
+static int _tlsTicketKeyLifetimeSeconds = 0;
+
+/// @var _tlsTicketKeysLock
+///
+/// @brief Mutex that guards _tlsTicketKeys and _tlsTicketKeyLifetimeSeconds.
+static mtx_t _tlsTicketKeysLock;
+
+/// @var _tlsTicketKeysInitRun
+///
+/// @brief once_flag variable to keep track of whether or not
+/// tlsTicketKeysInit has run yet.
+static once_flag _tlsTicketKeysInitRun = ONCE_FLAG_INIT;
+
+/// @fn void tlsTicketKeysInit(void)
+///
+/// @brief Initialize the lock that guards the session ticket keys.
+///
+/// @return This function returns no value.
+void tlsTicketKeysInit(void) {
+  mtx_init(&_tlsTicketKeysLock, mtx_plain);
+}
+
+/// @fn int tlsTicketKeyCallback(SSL *ssl, unsigned char *keyName, unsigned char *iv, EVP_CIPHER_CTX *cipherContext, EVP_MAC_CTX *macContext, int encrypt)
+///
+/// @brief OpenSSL callback that sets up the cipher and MAC used to issue or
+/// redeem a session ticket.  The current key is rotated out when its lifetime
+/// has passed.
+///
+/// @param ssl The SSL connection the ticket is for.  Unused.
+/// @param keyName The 16-byte name of the key.  Filled in when encrypting and
+///   looked up when decrypting.
+/// @param iv The initialization vector.  Filled in when encrypting.
+/// @param cipherContext The cipher context to initialize.
+/// @param macContext The MAC context to initialize.
+/// @param encrypt Non-zero if a ticket is being issued, zero if one is being
+///   redeemed.
+///
+/// @return Returns 1 on success, 2 if the ticket was accepted but a new one
+/// should be issued because its key has been rotated out, 0 if the ticket's
+/// key is unknown or expired, and -1 on error.
+int tlsTicketKeyCallback(SSL *ssl, unsigned char *keyName, unsigned char *iv,
+  EVP_CIPHER_CTX *cipherContext, EVP_MAC_CTX *macContext, int encrypt
+) {
+  (void) ssl;
+  
+  int returnValue = 0;
+  TlsTicketKey key;
+  mtx_lock(&_tlsTicketKeysLock);
+  time_t now = time(NULL);
+  if ((_tlsTicketKeys[0].created == 0)
+    || ((now - _tlsTicketKeys[0].created) >= _tlsTicketKeyLifetimeSeconds)
+  ) {
+    TlsTicketKey newKey;
+    if ((RAND_bytes(newKey.name, sizeof(newKey.name)) == 1)
+      && (RAND_bytes(newKey.aesKey, sizeof(newKey.aesKey)) == 1)
+      && (RAND_bytes(newKey.hmacKey, sizeof(newKey.hmacKey)) == 1)
+    ) {
+      newKey.created = now;
+      _tlsTicketKeys[1] = _tlsTicketKeys[0];
+      _tlsTicketKeys[0] = newKey;
+      printLog(DEBUG, "Rotated TLS session ticket key.\n");
+    } else {
+      printLog(ERR, "Could not generate TLS session ticket key.\n");
+    }
+  }
+  if (_tlsTicketKeys[0].created == 0) {
+    // No key could ever be generated.
+    returnValue = -1;
+  } else if (encrypt) {
+    key = _tlsTicketKeys[0];
+    returnValue = 1;
+  } else if (memcmp(keyName, _tlsTicketKeys[0].name, 16) == 0) {
+    key = _tlsTicketKeys[0];
+    returnValue = 1;
+  } else if ((_tlsTicketKeys[1].created != 0)
+    && ((now - _tlsTicketKeys[1].created)
+      < (2 * (time_t) _tlsTicketKeyLifetimeSeconds))
+    && (memcmp(keyName, _tlsTicketKeys[1].name, 16) == 0)
+  ) {
+    key = _tlsTicketKeys[1];
+    returnValue = 2;
+  }
+  mtx_unlock(&_tlsTicketKeysLock);
+  if (returnValue <= 0) {
+    return returnValue;
+  }
+  
+  const EVP_CIPHER *cipher = EVP_aes_256_cbc();
+  if (encrypt) {
+    memcpy(keyName, key.name, 16);
+    if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(cipher)) != 1) {
+      return -1;
+    }
+  }
+  OSSL_PARAM macParams[] = {
+    OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+      key.hmacKey, sizeof(key.hmacKey)),
+    OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+      (char*) "SHA256", 0),
+    OSSL_PARAM_construct_end()
+  };
+  if ((EVP_MAC_CTX_set_params(macContext, macParams) != 1)
+    || (EVP_CipherInit_ex(cipherContext, cipher, NULL, key.aesKey, iv,
+      encrypt) != 1)
+  ) {
+    returnValue = -1;
+  }
+  OPENSSL_cleanse(&key, sizeof(key));
+  
+  return returnValue;
+}
+
+/// @fn int socketTlsSetSessionCache(Socket *sock, int cacheSize, int timeoutSeconds, int ticketKeyLifetimeSeconds, TlsSessionCounters *counters)
+///
+/// @brief Configure TLS session resumption for the connections accepted from a
+/// SERVER socket so that reconnecting clients can skip the private key
+/// operation of a full handshake.
+///
+/// @param sock The TLS SERVER Socket to configure.
+/// @param cacheSize The maximum number of sessions to keep in the server-side
+///   session cache.  A value of 0 keeps OpenSSL's default.  A negative value
+///   disables the cache.
+/// @param timeoutSeconds The number of seconds a session may be resumed for.
+///   A value of 0 or less keeps OpenSSL's default.
+/// @param ticketKeyLifetimeSeconds The number of seconds each session ticket
+///   key issues tickets for before it's rotated out.  Tickets issued with the
+///   previous key are accepted for one more lifetime.  The keys are shared by
+///   all the SERVER sockets in the process.  A value of 0 keeps OpenSSL's
+///   built-in key, which is never rotated.  A negative value disables session
+///   tickets.
+/// @param counters A pointer to the TlsSessionCounters to count completed
+///   handshakes in.  Must outlive every connection accepted from the socket.
+///   May be NULL.
+///
+/// @return Returns 0 on success, -1 on failure.
+int socketTlsSetSessionCache(Socket *sock, int cacheSize, int timeoutSeconds,
+  int ticketKeyLifetimeSeconds, TlsSessionCounters *counters
+) {
+  printLog(TRACE,
+    "ENTER socketTlsSetSessionCache(sock=%s, cacheSize=%d, timeoutSeconds=%d, "
+    "ticketKeyLifetimeSeconds=%d, counters=%p)\n",
+    socketToString(sock), cacheSize, timeoutSeconds,
+    ticketKeyLifetimeSeconds, (void*) counters);
+  
+  if ((sock == NULL) || (sock->sslContext == NULL)) {
+    printLog(ERR, "Socket provided is not a TLS server socket.\n");
+    printLog(TRACE,
+      "EXIT socketTlsSetSessionCache(sock=%s, cacheSize=%d, "
+      "timeoutSeconds=%d, ticketKeyLifetimeSeconds=%d, counters=%p) = {-1}\n",
+      socketToString(sock), cacheSize, timeoutSeconds,
+      ticketKeyLifetimeSeconds, (void*) counters);
+    return -1;
+  }
+  
+  SSL_CTX *sslContext = sock->sslContext;
+  int returnValue = 0;
+  if (cacheSize < 0) {
+    SSL_CTX_set_session_cache_mode(sslContext, SSL_SESS_CACHE_OFF);
+  } else {
+    SSL_CTX_set_session_cache_mode(sslContext, SSL_SESS_CACHE_SERVER);
+    if (cacheSize > 0) {
+      SSL_CTX_sess_set_cache_size(sslContext, cacheSize);
+    }
+    // Sessions are only looked up in the cache of a context with an ID.
+    static const unsigned char sessionIdContext[] = "cnext";
+    SSL_CTX_set_session_id_context(sslContext,
+      sessionIdContext, sizeof(sessionIdContext) - 1);
+  }
+  if (timeoutSeconds > 0) {
+    SSL_CTX_set_timeout(sslContext, timeoutSeconds);
+  }
+  
+  if (ticketKeyLifetimeSeconds < 0) {
+    SSL_CTX_set_options(sslContext, SSL_OP_NO_TICKET);
+  } else if (ticketKeyLifetimeSeconds > 0) {
+    call_once(&_tlsTicketKeysInitRun, tlsTicketKeysInit);
+    mtx_lock(&_tlsTicketKeysLock);
+    _tlsTicketKeyLifetimeSeconds = ticketKeyLifetimeSeconds;
+    mtx_unlock(&_tlsTicketKeysLock);
+    if (SSL_CTX_set_tlsext_ticket_key_evp_cb(sslContext,
+      tlsTicketKeyCallback) != 1
+    ) {
+      printLog(ERR, "Could not set TLS session ticket key callback.\n");
+      returnValue = -1;
+    }
+  }
+  
+  SSL_CTX_set_app_data(sslContext, counters);
+  
+  printLog(TRACE,
+    "EXIT socketTlsSetSessionCache(sock=%s, cacheSize=%d, timeoutSeconds=%d, "
+    "ticketKeyLifetimeSeconds=%d, counters=%p) = {%d}\n",
+    socketToString(sock), cacheSize, timeoutSeconds,
+    ticketKeyLifetimeSeconds, (void*) counters, returnValue);
+  return returnValue;
+}
+
 /// @fn bool tlsKeyAndCertificateValid(const char *certificate, const char *key)
 ///
 /// @brief Determine if a certificate and key pair are valid.
@@ -749,7 +1122,7 @@ bool tlsKeyAndCertificateValid(const char *certificate, const char *key) {
 
 // SocketType helper functions.
 
-/// @fn Socket* createServerSocket(SocketProtocol socketProtocol, const char *address, SocketMode socketMode, const char *certificate, const char *key)
+/// @fn Socket* createServerSocket(SocketProtocol socketProtocol, const char *address, SocketMode socketMode, const char *certificate, const char *key, int socketOptions)
 ///
 /// @brief Create a server socket with the specified mode.
 ///
@@ -760,11 +1133,13 @@ bool tlsKeyAndCertificateValid(const char *certificate, const char *key) {
 ///   socketMode is SECURE, NULL otherwise.
 /// @param key The content of a PEM file for an RSA private key if socketMode
 ///   is SECURE, NULL otherwise.
+/// @param socketOptions A bitmask of SOCKET_* options.
 ///
 /// @return Returns a newly allocated and opened socket on success,
 /// NULL on failure.
 Socket* createServerSocket(SocketProtocol socketProtocol, const char *address,
-  SocketMode socketMode, const char *certificate, const char *key
+  SocketMode socketMode, const char *certificate, const char *key,
+  int socketOptions
 ) {
   (void) certificate; // In case logging isn't enabled.
   (void) key; // In case logging isn't enabled.
@@ -859,6 +1234,16 @@ Socket* createServerSocket(SocketProtocol socketProtocol, const char *address,
     ) {
       printLog(WARN, "Could not set socket to allow for reusing address.\n");
     }
+#ifdef SO_REUSEPORT
+    if (((socketOptions & SOCKET_REUSE_PORT) != 0)
+      && (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (char*) &optionValue,
+        sizeof(optionValue)) < 0)
+    ) {
+      printLog(WARN, "Could not set socket to allow for reusing port.\n");
+    }
+#else
+    (void) socketOptions;
+#endif // SO_REUSEPORT
   } else if (socketProtocol == UDP) {
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
   }
@@ -1114,26 +1499,14 @@ int configureTlsClientSocket(Socket *sock, int timeoutMilliseconds) {
   SSL_CTX_free(sslContext);
   
   if (sock->socketProtocol == TCP) {
-    SslBioHandshakeWatchArgs *sslBioHandshakeWatchArgs
-      = (SslBioHandshakeWatchArgs*) malloc(sizeof(SslBioHandshakeWatchArgs));
-    if (sslBioHandshakeWatchArgs == NULL) {
-      // Out of memory.  Don't try to log our exit.
-      return -6;
+    if (sock->sockfd < 0) {
+      // Let the connect BIO create its descriptor in non-blocking mode so that
+      // the TCP connect is bounded by the handshake deadline too.
+      BIO_set_nbio(bio, 1);
     }
-    sslBioHandshakeWatchArgs->bio = bio;
-    sslBioHandshakeWatchArgs->connected = false;
-    sslBioHandshakeWatchArgs->timeoutMilliseconds = timeoutMilliseconds;
-    
-    ZEROINIT(thrd_t sslBioHandshakeWatchThread);
-    thrd_create(&sslBioHandshakeWatchThread, sslBioHandshakeWatch,
-      (void*) sslBioHandshakeWatchArgs);
-    int threadReturnValue = 0;
-    if (BIO_do_handshake(bio) <= 0) {
-      sslBioHandshakeWatchArgs->bio = NULL;
-      // This next line is so that we exit the loop in sslBioHandshakeWatch.
-      sslBioHandshakeWatchArgs->connected = true;
-      thrd_join(sslBioHandshakeWatchThread, &threadReturnValue);
-      free(sslBioHandshakeWatchArgs); sslBioHandshakeWatchArgs = NULL;
+    sock->sslBio = bio;
+    if (socketTlsHandshake(sock, timeoutMilliseconds) != 0) {
+      sock->sslBio = NULL;
       if (sock->ssl != NULL) {
         SSL_shutdown(sock->ssl);
         SSL_free(sock->ssl); sock->ssl = NULL;
@@ -1151,14 +1524,7 @@ int configureTlsClientSocket(Socket *sock, int timeoutMilliseconds) {
         "= {-7}\n", (void*) sock, timeoutMilliseconds);
       return -7;
     }
-    if (sslBioHandshakeWatchArgs != NULL) {
-      sslBioHandshakeWatchArgs->connected = true;
-      thrd_join(sslBioHandshakeWatchThread, &threadReturnValue);
-      free(sslBioHandshakeWatchArgs); sslBioHandshakeWatchArgs = NULL;
-    }
     
-    sock->tcpConnected = true;
-    sock->sslAccepted = true;
     printLog(DEBUG, "Successfully performed SSL handshake with the server.\n");
   }
   
@@ -1375,8 +1741,8 @@ Socket* createClientSocket(SocketProtocol socketProtocol, const char *address,
 /// @param timeoutMilliseconds The number of milliseconds to wait before timing
 ///   out waiting for a client connection to be established.  A value of <= 0
 ///   will default to a 30 second timeout.
-/// @param ... Any addtional parameters (provided by the wrapper macro) are
-///   ignored.
+/// @param ... An optional bitmask of SOCKET_* options for a SERVER socket.
+///   Any further parameters (provided by the wrapper macro) are ignored.
 ///
 /// @note This function is wrapped by the socketCreate macro which automatically
 /// provides NULLs for the certificate ane key so that it is not necessary to
@@ -1492,10 +1858,15 @@ Socket* socketCreate_(SocketType socketType, SocketProtocol socketProtocol,
     return NULL;
   }
   
+  va_list args;
+  va_start(args, timeoutMilliseconds);
+  int socketOptions = va_arg(args, int);
+  va_end(args);
+  
   Socket *socket = NULL;
   if (socketType == SERVER) {
     socket = createServerSocket(socketProtocol, address,
-      (SocketMode) socketMode, certificate, key);
+      (SocketMode) socketMode, certificate, key, socketOptions);
   } else if (socketType == CLIENT) {
     socket = createClientSocket(socketProtocol, address,
       (SocketMode) socketMode,
@@ -1785,6 +2156,117 @@ Socket* socketDestroy(Socket *sock) {
   return NULL;
 }
 
+/// @fn int socketSetWaitFunction(Socket *sock, SocketWaitFunction waitFunction, void *waitContext)
+///
+/// @brief Make a blocking socket wait by calling a function instead of
+/// blocking in the kernel.  This lets a scheduler run something else, such as
+/// another coroutine, while the socket isn't ready.  The socket's descriptor
+/// is put in non-blocking mode, but the socket still behaves as a blocking
+/// socket to its callers:  socketSend sends everything it's given and
+/// socketReceive waits for up to its timeout.
+///
+/// @param sock The Socket to configure.  Must be in blocking mode.
+/// @param waitFunction The SocketWaitFunction to call when the socket isn't
+///   ready.  NULL restores ordinary blocking behavior.
+/// @param waitContext Data for waitFunction.  Stored in sock->waitContext.
+///
+/// @return Returns 0 on success, -1 on failure.
+int socketSetWaitFunction(Socket *sock, SocketWaitFunction waitFunction,
+  void *waitContext
+) {
+  if (sock == NULL) {
+    printLog(ERR, "Socket provided is NULL.\n");
+    return -1;
+  } else if (sock->blocking == false) {
+    printLog(ERR, "Socket must be in blocking mode.\n");
+    return -1;
+  }
+  
+  mtx_lock(&sock->lock);
+  int returnValue = 0;
+  if (rawSocketSetNonblocking(sock->sockfd, waitFunction != NULL)
+    != NO_ERROR
+  ) {
+    printLog(ERR, "Could not change the blocking mode of the socket.\n");
+    returnValue = -1;
+  } else {
+    sock->waitFunction = waitFunction;
+    sock->waitContext = waitContext;
+  }
+  mtx_unlock(&sock->lock);
+  
+  return returnValue;
+}
+
+/// @fn int socketWait(Socket *sock, short events, int timeoutMilliseconds)
+///
+/// @brief Wait for a socket to become ready.  Sockets with a wait function
+/// wait in it.  Others wait in poll.
+///
+/// @param sock The Socket to wait on.
+/// @param events The events to wait for (POLLIN, POLLOUT, or both).
+/// @param timeoutMilliseconds The maximum number of milliseconds to wait.  -1
+///   waits indefinitely.
+///
+/// @return Returns a positive value when the socket is ready, 0 if the timeout
+/// passed first, and a negative value on error.
+int socketWait(Socket *sock, short events, int timeoutMilliseconds) {
+  if ((sock == NULL) || (sock->sockfd < 0)) {
+    return -1;
+  } else if (sock->waitFunction != NULL) {
+    return sock->waitFunction(sock, events, timeoutMilliseconds);
+  }
+  
+  ZEROINIT(struct pollfd pollDescriptor);
+  pollDescriptor.fd = sock->sockfd;
+  pollDescriptor.events = events;
+  return poll(&pollDescriptor, 1, timeoutMilliseconds);
+}
+
+/// @fn short socketRetryEvents(Socket *sock, int status, short events)
+///
+/// @brief Determine whether a send or receive on a socket with a wait function
+/// failed only because the socket wasn't ready and, if so, what to wait for
+/// before trying again.
+///
+/// @param sock The Socket the call was made on.
+/// @param status The value the send or receive call returned.
+/// @param events The event the call waits for on a plain socket (POLLIN or
+///   POLLOUT).  A TLS socket may need the other one to make progress.
+///
+/// @return Returns the events to wait for, 0 if the call must not be retried.
+short socketRetryEvents(Socket *sock, int status, short events) {
+  if (sock->socketMode == PLAIN) {
+    if (status >= 0) {
+      return 0;
+    }
+#ifdef _WIN32
+    return (WSAGetLastError() == WSAEWOULDBLOCK) ? events : 0;
+#else // POSIX
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      ? events : 0;
+#endif // _WIN32
+  }
+  
+  short retryEvents = 0;
+#ifdef TLS_SOCKETS_ENABLED
+  if (status > 0) {
+    return 0;
+  } else if (sock->ssl != NULL) {
+    int sslError = SSL_get_error(sock->ssl, status);
+    if (sslError == SSL_ERROR_WANT_READ) {
+      retryEvents = POLLIN;
+    } else if (sslError == SSL_ERROR_WANT_WRITE) {
+      retryEvents = POLLOUT;
+    }
+  } else if ((sock->sslBio != NULL) && (BIO_should_retry(sock->sslBio))) {
+    retryEvents = (BIO_should_read(sock->sslBio)) ? POLLIN : POLLOUT;
+  }
+#endif // TLS_SOCKETS_ENABLED
+  
+  return retryEvents;
+}
+
 /// @fn int socketSend(Socket *sock, const volatile void *buf, int len)
 ///
 /// @brief Send the provided data to the specified socket.
@@ -1852,7 +2334,20 @@ int socketSend(Socket *sock, const volatile void *buf, int len) {
           bytesSent = -1;
         }
         if (bytesSent <= 0) {
-          break;
+          short events = (sock->waitFunction != NULL)
+            ? socketRetryEvents(sock, (int) bytesSent, POLLOUT) : 0;
+          if (events == 0) {
+            break;
+          }
+          // Let the wait function run something else until the socket can
+          // take more data.  Don't hold the lock while doing so.
+          mtx_unlock(&sock->lock);
+          int status = socketWait(sock, events, -1);
+          mtx_lock(&sock->lock);
+          if (status <= 0) {
+            break;
+          }
+          continue;
         }
         totalBytesSent += bytesSent;
         bufferPointer += bytesSent;
@@ -1913,65 +2408,6 @@ int socketSend(Socket *sock, const volatile void *buf, int len) {
   return returnValue;
 }
 
-/// @struct SslAcceptWatchArgs
-/// @brief Arguments for the sslAcceptWatch thread.
-/// @param sockfd The socket file descriptor to close if a connection isn't
-///   established in a suitable amount of time.
-/// @param accepted A boolean to indicate whether or not the socket has been
-///   accepted on the main thread.
-/// @param timeoutMilliseconds The number of milliseconds to wait before
-///   forcibly closing the socket if it's not accepted.
-typedef struct SslAcceptWatchArgs {
-  int sockfd;
-  bool accepted;
-  int timeoutMilliseconds;
-} SslAcceptWatchArgs;
-
-/// @fn int sslAcceptWatch(void *args)
-///
-/// @brief Thread that watches for a connection to be established.  Forcibly
-/// closes the socket for the connection if it doesn't connect by the specified
-/// timeout.
-///
-/// @param args A pointer to a SslAcceptWatchArgs structure with the
-///   parameters for this function.  The structure and any dynamic memory
-///   associated with its parameters must be freed by this function (the thread
-///   owns it).
-///
-/// @return Returns 0 on success, negative error code on failure.
-int sslAcceptWatch(void *args) {
-  SslAcceptWatchArgs *sslAcceptWatchArgs = (SslAcceptWatchArgs*) args;
-  bool *accepted = &sslAcceptWatchArgs->accepted;
-  int timeoutMilliseconds = sslAcceptWatchArgs->timeoutMilliseconds;
-  int sockfd = sslAcceptWatchArgs->sockfd;
-  printLog(TRACE,
-    "ENTER sslAcceptWatch(sockfd=%d, accepted=%s, timeoutMilliseconds=%d)\n",
-    sockfd, (*accepted == true) ? "true" : "false", timeoutMilliseconds);
-  
-  for (int i = 0; (i < timeoutMilliseconds) && (*accepted == false); i++) {
-    socketsMsleep(1);
-  }
-  
-  int returnValue = 0;
-  if (*accepted == false) {
-    printLog(WARN, "Connection timed out after %d milliseconds.\n",
-      timeoutMilliseconds);
-    rawSocketClose(sockfd);
-    returnValue = -1;
-  }
-  
-  bool acceptedCopy = *accepted;
-  (void) acceptedCopy; // In case logging isn't enabled.
-  free(args); args = NULL; sslAcceptWatchArgs = NULL;
-  
-  printLog(TRACE,
-    "EXIT sslAcceptWatch(sockfd=%d, accepted=%s, timeoutMilliseconds=%d) "
-      "= {%d}\n",
-    sockfd, (acceptedCopy == true) ? "true" : "false", timeoutMilliseconds,
-    returnValue);
-  return returnValue;
-}
-
 /// @fn int socketReceive_(Socket *sock, volatile void *buf, int len, int timeout, ...)
 ///
 /// @brief Send the provided data to the specified socket.
@@ -2018,66 +2454,11 @@ int socketReceive_(Socket *sock, volatile void *buf, int len,
     && (sock->ssl != NULL)
   ) {
     // We haven't gone through the TLS accept and handshake.  Complete the
-    // process.
-    if (socketWasBlocking == false) {
-      socketSetBlocking(sock);
-    }
-#ifdef _WIN32
-    DWORD timeout = 0;
-#else // POSIX
-    ZEROINIT(struct timeval timeout);
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 0;
-#endif // _WIN32
-    // Set our timeout to infinite
-    if (setsockopt(sock->sockfd, SOL_SOCKET, SO_RCVTIMEO, (char*) &timeout,
-      sizeof(timeout)) < 0
-    ) {
-      printLog(WARN,
-        "Could not set timeout for blocking socket to infinite.\n");
-    }
-    
-    SslAcceptWatchArgs *sslAcceptWatchArgs
-      = (SslAcceptWatchArgs*) malloc(sizeof(SslAcceptWatchArgs));
-    if (sslAcceptWatchArgs == NULL) {
-      // Out of memory.
-      SSL_shutdown(sock->ssl);
-      SSL_free(sock->ssl); sock->ssl = NULL;
-      rawSocketClose(sock->sockfd); sock->sockfd = -1;
-      if (socketWasBlocking == false) {
-        socketSetNonblocking(sock);
-      }
-      updateSocketString(sock);
-      printLog(FLOOD,
-        "EXIT socketReceive(sock=%s, buf=%p, len=%d, "
-        "timeoutMilliseconds=%d) = {-1}\n",
-        socketToString(sock), (void*) buf, len, timeoutMilliseconds);
-      return -1;
-    }
-    sslAcceptWatchArgs->sockfd = sock->sockfd;
-    sslAcceptWatchArgs->accepted = false;
-    // This value is too large to be practical.  It's set like this to allow
-    // for this library to work when valgrind is in use.
-    // WARNING: This is a magic number.  I really need to come up with a
-    // better way to set this.
-    // JBC 2021-06-02
-    sslAcceptWatchArgs->timeoutMilliseconds = 15000;
-    
-    ZEROINIT(thrd_t sslAcceptThread);
-    if (thrd_create(&sslAcceptThread, sslAcceptWatch,
-      (void*) sslAcceptWatchArgs) == thrd_success
+    // process.  socketTlsHandshake enforces the deadline itself, so no
+    // watchdog thread is needed.
+    if (socketTlsHandshake(sock, SOCKET_TLS_HANDSHAKE_TIMEOUT_MILLISECONDS)
+      != 0
     ) {
-      // We don't actually need the return value of sslAccept.  If
-      // it forcibly closes the socket, the return value of SSL_accept will be
-      // -1. We can therefore skip the thrd_join and save ourselves time in the
-      // success case, which is the expected normal case.
-      thrd_detach(sslAcceptThread);
-    } else {
-      // Starting the thread failed.  Free the memory it was supposed to free.
-      printLog(WARN, "Could not start sslAcceptWatch thread.\n");
-      free(sslAcceptWatchArgs); sslAcceptWatchArgs = NULL;
-    }
-    if (SSL_accept(sock->ssl) <= 0) {
       printLog(ERR, "Could not accept from SSL.\n");
       char* error = sslGetLastError();
       if (error != NULL) {
@@ -2087,9 +2468,6 @@ int socketReceive_(Socket *sock, volatile void *buf, int len,
       SSL_shutdown(sock->ssl);
       SSL_free(sock->ssl); sock->ssl = NULL;
       rawSocketClose(sock->sockfd); sock->sockfd = -1;
-      if (socketWasBlocking == false) {
-        socketSetNonblocking(sock);
-      }
       updateSocketString(sock);
       printLog(FLOOD,
         "EXIT socketReceive(sock=%s, buf=%p, len=%d, "
@@ -2097,18 +2475,14 @@ int socketReceive_(Socket *sock, volatile void *buf, int len,
         socketToString(sock), (void*) buf, len, timeoutMilliseconds);
       return -1;
     }
-    if (sslAcceptWatchArgs != NULL) {
-      sslAcceptWatchArgs->accepted = true;
-    }
-    sock->sslAccepted = true;
-    if (socketWasBlocking == false) {
-      socketSetNonblocking(sock);
-    }
-    updateSocketString(sock);
   }
 #endif // TLS_SOCKETS_ENABLED
   
-  if ((sock->blocking == true) && (timeoutMilliseconds != 0)) {
+  i64 deadlineMs = socketsMilliseconds() + timeoutMilliseconds;
+  if (sock->waitFunction != NULL) {
+    // The descriptor is already non-blocking.  The timeout is honored by
+    // waiting in sock->waitFunction below.
+  } else if ((sock->blocking == true) && (timeoutMilliseconds != 0)) {
     // Honor the timeout.
     if (timeoutMilliseconds < 0) {
       // Assume indefinitie timeout is desired (consistent with poll).
@@ -2167,6 +2541,25 @@ int socketReceive_(Socket *sock, volatile void *buf, int len,
   }
   mtx_unlock(&sock->lock);
   
+  short events = ((sock->waitFunction != NULL) && (timeoutMilliseconds != 0))
+    ? socketRetryEvents(sock, bytesReceived, POLLIN) : 0;
+  if (events != 0) {
+    // Let the wait function run something else until the socket is ready,
+    // then try again with whatever is left of the timeout.
+    if (socketWait(sock, events, timeoutMilliseconds) > 0) {
+      if (timeoutMilliseconds > 0) {
+        timeoutMilliseconds = (int) (deadlineMs - socketsMilliseconds());
+        if (timeoutMilliseconds <= 0) {
+          // Any data is already there.  Don't wait for more.
+          timeoutMilliseconds = 1;
+        }
+      }
+      return socketReceive_(sock, buf, len, timeoutMilliseconds);
+    }
+    // Timed out.  Report it the same way an expired SO_RCVTIMEO would.
+    bytesReceived = -1;
+  }
+  
   if ((bytesReceived < 0) && (socketWasBlocking == false)) {
     // This may not actually be an error.  Correct if not.
 #ifndef _WIN32
@@ -2195,6 +2588,55 @@ int socketReceive_(Socket *sock, volatile void *buf, int len,
   return bytesReceived;
 }
 
+/// @fn int socketReceiveAvailable(Socket *sock, volatile void *buf, int len, short *waitEvents)
+///
+/// @brief Receive whatever data is available on a connected, non-blocking TCP
+/// socket without waiting.  Unlike socketReceive, a connection that has been
+/// closed is distinguished from one that has no data yet.  A TLS socket must
+/// have completed its handshake.
+///
+/// @param sock The Socket to receive from.
+/// @param buf A pointer to the buffer to receive data into.
+/// @param len The length, in bytes, of the buffer pointed to by buf.
+/// @param waitEvents A pointer to the events (POLLIN or POLLOUT) to wait for
+///   before calling again.  Set when 0 is returned.
+///
+/// @return Returns the number of bytes received, 0 if no data is available
+/// yet, and -1 if the connection was closed or had an error.
+int socketReceiveAvailable(Socket *sock, volatile void *buf, int len,
+  short *waitEvents
+) {
+  if ((sock == NULL) || (buf == NULL) || (waitEvents == NULL)
+    || (sock->socketProtocol != TCP) || (sock->tcpConnected == false)
+  ) {
+    return -1;
+  }
+  
+  int bytesReceived = -1;
+  mtx_lock(&sock->lock);
+  if (sock->socketMode == PLAIN) {
+    do {
+      bytesReceived = (int) recv(sock->sockfd, (void*) buf, len, 0);
+    } while ((bytesReceived < 0) && (errno == EINTR));
+#ifdef TLS_SOCKETS_ENABLED
+  } else if ((sock->socketType == CLIENT) && (sock->sslBio != NULL)) {
+    bytesReceived = BIO_read(sock->sslBio, (void*) buf, len);
+  } else if ((sock->socketType == SERVER) && (sock->ssl != NULL)) {
+    ERR_clear_error();
+    bytesReceived = SSL_read(sock->ssl, (void*) buf, len);
+#endif // TLS_SOCKETS_ENABLED
+  }
+  
+  if (bytesReceived <= 0) {
+    // An orderly shutdown by the peer is never retried.
+    *waitEvents = socketRetryEvents(sock, bytesReceived, POLLIN);
+    bytesReceived = (*waitEvents != 0) ? 0 : -1;
+  }
+  mtx_unlock(&sock->lock);
+  
+  return bytesReceived;
+}
+
 /// @fn Socket* socketAccept_(Socket *serverSocket, void *buf, int len, ...)
 ///
 /// @brief Accept an incoming TCP client connection on a SERVER socket.
@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//                   Copyright (c) 2012-2025 Skymond, LLC.                    //
+//                                                                            //
+// Permission is hereby granted, free of charge, to any person obtaining a    //
+// copy of this software and associated documentation files (the "Software"), //
+// to deal in the Software without restriction, including without limitation  //
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,   //
+// and/or sell copies of the Software, and to permit persons to whom the      //
+// Software is furnished to do so, subject to the following conditions:       //
+//                                                                            //
+// The above copyright notice and this permission notice shall be included    //
+// in all copies or substantial portions of the Software.                     //
+//                                                                            //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR //
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   //
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    //
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER //
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    //
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        //
+// DEALINGS IN THE SOFTWARE.                                                  //
+//                                                                            //
+//                               Skymond, LLC                                 //
+//                            https://skymond.io                              //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Doxygen marker
+/// @file
+
+#include "AccessLogLib.h"
+#include "Dictionary.h"
+#include <stdio.h>
+
+#define leaf(path) ((strrchr(path, '/')) ? (strrchr(path, '/') + 1) : path)
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("Usage: %s [--format text|csv] <access log file> [...]\n",
+      leaf(argv[0]));
+    return 1;
+  }
+  
+  // Parse the command line arguments.
+  Dictionary *argList = parseCommandLine(argc, argv);
+  const char *format = (char*) dictionaryGetValue(argList, "format");
+  bool csv = false;
+  if ((format != NULL) && (strcmp(format, "csv") == 0)) {
+    csv = true;
+  } else if ((format != NULL) && (strcmp(format, "text") != 0)) {
+    fprintf(stderr, "Unknown format \"%s\".\n", format);
+    argList = dictionaryDestroy(argList);
+    return 1;
+  }
+  
+  int returnValue = 0;
+  char name[32];
+  const char *filePath = NULL;
+  for (int i = 0; returnValue == 0; i++) {
+    snprintf(name, sizeof(name), "unnamedParameter%d", i);
+    filePath = (char*) dictionaryGetValue(argList, name);
+    if (filePath == NULL) {
+      break;
+    }
+    
+    FILE *input = fopen(filePath, "rb");
+    if (input == NULL) {
+      fprintf(stderr, "Could not open \"%s\".\n", filePath);
+      returnValue = 1;
+      break;
+    }
+    // Only the first file gets the row of CSV column names.
+    if (accessLogDecode(input, stdout, csv, i == 0) < 0) {
+      fprintf(stderr, "\"%s\" is not an access log file.\n", filePath);
+      returnValue = 1;
+    }
+    fclose(input);
+  }
+  
+  argList = dictionaryDestroy(argList);
+  return returnValue;
+}
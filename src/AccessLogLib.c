@@ -0,0 +1,761 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//                   Copyright (c) 2012-2025 Skymond, LLC.                    //
+//                                                                            //
+// Permission is hereby granted, free of charge, to any person obtaining a    //
+// copy of this software and associated documentation files (the "Software"), //
+// to deal in the Software without restriction, including without limitation  //
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,   //
+// and/or sell copies of the Software, and to permit persons to whom the      //
+// Software is furnished to do so, subject to the following conditions:       //
+//                                                                            //
+// The above copyright notice and this permission notice shall be included    //
+// in all copies or substantial portions of the Software.                     //
+//                                                                            //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR //
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   //
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    //
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER //
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    //
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        //
+// DEALINGS IN THE SOFTWARE.                                                  //
+//                                                                            //
+//                               Skymond, LLC                                 //
+//                            https://skymond.io                              //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Doxygen marker
+/// @file
+
+#include "AccessLogLib.h"
+#include "CAtomic.h"
+
+#ifdef LOGGING_ENABLED
+#include "LoggingLib.h"
+#else
+#undef printLog
+#define printLog(...) {}
+#define LOG_MALLOC_FAILURE(...) {}
+#define logFile stderr
+#endif
+
+#include "OsApi.h"
+
+/// @def ACCESS_LOG_THREAD_LOCAL
+///
+/// @brief Storage class for variables that each thread gets its own copy of.
+#ifdef __cplusplus
+#define ACCESS_LOG_THREAD_LOCAL thread_local
+#else
+#define ACCESS_LOG_THREAD_LOCAL _Thread_local
+#endif // __cplusplus
+
+/// @var AccessLogMethodNames
+///
+/// @brief The names of the AccessLogMethods.
+static const char *AccessLogMethodNames[NUM_ACCESS_LOG_METHODS] = {
+  "OTHER",
+  "GET",
+  "POST",
+  "HEAD",
+  "PUT",
+  "DELETE",
+  "OPTIONS",
+  "PATCH",
+};
+
+/// @struct AccessLogRing
+///
+/// @brief The records one thread has added to an AccessLog that haven't been
+/// written yet.  Only the owning thread adds to it and only the thread that
+/// holds the lock of the AccessLog removes from it, so neither side ever
+/// waits for the other.
+///
+/// @param writePosition The position the next record will be added at.
+/// @param padding Keeps the two positions on separate cache lines.
+/// @param readPosition The position of the next record to write to the file.
+/// @param owner The thread that adds to the ring.
+/// @param next The next ring of the AccessLog.
+/// @param records The records of the ring.
+typedef struct AccessLogRing {
+  _Atomic(u64)          writePosition;
+  u8                    padding[56];
+  _Atomic(u64)          readPosition;
+  thrd_t                owner;
+  struct AccessLogRing *next;
+  AccessLogRecord       records[ACCESS_LOG_RING_RECORDS];
+} AccessLogRing;
+
+/// @struct AccessLog
+///
+/// @brief A set of per-thread rings of AccessLogRecords that one writer thread
+/// drains to a file.
+///
+/// @param filePath The path of the file the records are written to.  When
+///   the file is rotated, the start time of its period is appended.
+/// @param rotateSeconds The number of seconds each file covers.  Zero or less
+///   if the file is never rotated.
+/// @param id The number that tells this AccessLog apart from any other that
+///   was ever created, including one at the same address.
+/// @param rings The rings of the threads that have added records.  Only
+///   changed with lock held.
+/// @param numDropped The number of records that were dropped because a ring
+///   was full.
+/// @param names The names written after each file header.
+/// @param numRoutes The number of route names in names.
+/// @param file The file that's open.  NULL until there's something to write.
+/// @param rotateTime The time the open file has to be rotated at.
+/// @param openFailed Whether or not the last attempt to open a file failed.
+/// @param lock The mutex that serializes draining and protects the rest of
+///   the members.
+/// @param drainNow The condition that wakes the writer thread.
+/// @param writerThread The thread that drains the rings periodically.
+/// @param exitNow Whether or not the writer thread should exit.
+struct AccessLog {
+  char          *filePath;
+  int            rotateSeconds;
+  u64            id;
+  AccessLogRing *rings;
+  _Atomic(u64)   numDropped;
+  Bytes          names;
+  u32            numRoutes;
+  FILE          *file;
+  i64            rotateTime;
+  bool           openFailed;
+  mtx_t          lock;
+  cnd_t          drainNow;
+  thrd_t         writerThread;
+  bool           exitNow;
+};
+
+/// @var accessLogLastId
+///
+/// @brief The id of the AccessLog that was created last.
+static _Atomic(u64) accessLogLastId;
+
+/// @var accessLogThreadLogId
+///
+/// @brief The id of the AccessLog that accessLogThreadRing belongs to.
+static ACCESS_LOG_THREAD_LOCAL u64 accessLogThreadLogId = 0;
+
+/// @var accessLogThreadRing
+///
+/// @brief The calling thread's ring in the AccessLog it added to last.
+static ACCESS_LOG_THREAD_LOCAL AccessLogRing *accessLogThreadRing = NULL;
+
+/// @fn AccessLogRing* accessLogGetRing(AccessLog *accessLog)
+///
+/// @brief Get the calling thread's ring in an AccessLog, creating it if this
+/// is the first record the thread has added.  Only the first record takes the
+/// lock.
+///
+/// @param accessLog The AccessLog to get the ring of.
+///
+/// @return Returns the thread's AccessLogRing on success, NULL on failure.
+AccessLogRing* accessLogGetRing(AccessLog *accessLog) {
+  if (accessLogThreadLogId == accessLog->id) {
+    return accessLogThreadRing;
+  }
+  
+  // A thread that alternates between logs finds the ring it already has.
+  thrd_t self = thrd_current();
+  mtx_lock(&accessLog->lock);
+  AccessLogRing *ring = accessLog->rings;
+  while ((ring != NULL) && (thrd_equal(ring->owner, self) == 0)) {
+    ring = ring->next;
+  }
+  if (ring == NULL) {
+    ring = (AccessLogRing*) calloc(1, sizeof(AccessLogRing));
+    if (ring != NULL) {
+      ring->owner = self;
+      ring->next = accessLog->rings;
+      accessLog->rings = ring;
+    } else {
+      LOG_MALLOC_FAILURE();
+    }
+  }
+  mtx_unlock(&accessLog->lock);
+  
+  if (ring != NULL) {
+    accessLogThreadLogId = accessLog->id;
+    accessLogThreadRing = ring;
+  }
+  return ring;
+}
+
+/// @fn void accessLogAdd(AccessLog *accessLog, const AccessLogRecord *record)
+///
+/// @brief Add a record to an AccessLog.  This never blocks.  If the calling
+/// thread's ring is full, the record is dropped and counted instead.  The
+/// writer thread is woken early each time half a ring has been added.
+///
+/// @param accessLog The AccessLog to add the record to.
+/// @param record The AccessLogRecord to add.
+///
+/// @return This function returns no value.
+void accessLogAdd(AccessLog *accessLog, const AccessLogRecord *record) {
+  if ((accessLog == NULL) || (record == NULL)) {
+    return;
+  }
+  
+  AccessLogRing *ring = accessLogGetRing(accessLog);
+  u64 position = 0;
+  if (ring != NULL) {
+    position
+      = atomic_load_explicit(&ring->writePosition, memory_order_relaxed);
+  }
+  if ((ring == NULL)
+    || (position - atomic_load_explicit(&ring->readPosition,
+      memory_order_acquire) >= ACCESS_LOG_RING_RECORDS)
+  ) {
+    atomic_fetch_add_explicit(&accessLog->numDropped, (u64) 1,
+      memory_order_relaxed);
+    return;
+  }
+  
+  ring->records[position & (ACCESS_LOG_RING_RECORDS - 1)] = *record;
+  atomic_store_explicit(&ring->writePosition, position + 1,
+    memory_order_release);
+  if (((position + 1) & ((ACCESS_LOG_RING_RECORDS / 2) - 1)) == 0) {
+    // Half a ring has been added.  At high rates, waiting for the next
+    // interval could let the ring fill up.
+    cnd_signal(&accessLog->drainNow);
+  }
+}
+
+/// @fn int accessLogOpenFile(AccessLog *accessLog)
+///
+/// @brief Make sure the file for the current period of an AccessLog is open,
+/// rotating to a new one if the period of the open one is over.  A header
+/// with the names is written each time a file is opened.  Must be called with
+/// the lock of the AccessLog held.
+///
+/// @param accessLog The AccessLog to open the file of.
+///
+/// @return Returns 0 on success, -1 on failure.
+int accessLogOpenFile(AccessLog *accessLog) {
+  time_t now = time(NULL);
+  if ((accessLog->file != NULL)
+    && ((accessLog->rotateSeconds <= 0) || ((i64) now < accessLog->rotateTime))
+  ) {
+    return 0;
+  }
+  if (accessLog->file != NULL) {
+    fclose(accessLog->file); accessLog->file = NULL;
+  }
+  
+  char *filePath = NULL;
+  straddstr(&filePath, accessLog->filePath);
+  if (accessLog->rotateSeconds > 0) {
+    time_t periodStart = now - (now % accessLog->rotateSeconds);
+    accessLog->rotateTime = ((i64) periodStart) + accessLog->rotateSeconds;
+    struct tm periodStartTm;
+#ifdef _WIN32
+    gmtime_s(&periodStartTm, &periodStart);
+#else // POSIX
+    gmtime_r(&periodStart, &periodStartTm);
+#endif
+    char suffix[24];
+    strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &periodStartTm);
+    straddstr(&filePath, suffix);
+  }
+  
+  accessLog->file = fopen(filePath, "ab");
+  if (accessLog->file == NULL) {
+    if (accessLog->openFailed == false) {
+      printLog(ERR, "Could not open \"%s\" for the access log: %s\n",
+        filePath, strerror(errno));
+    }
+    accessLog->openFailed = true;
+    filePath = stringDestroy(filePath);
+    return -1;
+  }
+  accessLog->openFailed = false;
+  filePath = stringDestroy(filePath);
+  
+  ZEROINIT(AccessLogFileHeader header);
+  memcpy(header.magic, ACCESS_LOG_MAGIC, sizeof(header.magic));
+  header.version = ACCESS_LOG_VERSION;
+  header.recordSize = (u32) sizeof(AccessLogRecord);
+  header.numPhases = (accessLog->names != NULL) ? ACCESS_LOG_NUM_PHASES : 0;
+  header.numRoutes = accessLog->numRoutes;
+  header.namesLength = (u32) bytesLength(accessLog->names);
+  fwrite(&header, sizeof(header), 1, accessLog->file);
+  if (header.namesLength > 0) {
+    fwrite(accessLog->names, 1, header.namesLength, accessLog->file);
+  }
+  
+  return 0;
+}
+
+/// @fn int accessLogFlush(AccessLog *accessLog)
+///
+/// @brief Write all of the records that are in the rings of an AccessLog to
+/// its file.  The writer thread does this periodically.  Each thread's
+/// records are written in order, but the records of different threads aren't
+/// merged by time.
+///
+/// @param accessLog The AccessLog to drain.
+///
+/// @return Returns the number of records that were written.
+int accessLogFlush(AccessLog *accessLog) {
+  if (accessLog == NULL) {
+    return 0;
+  }
+  
+  int numWritten = 0;
+  mtx_lock(&accessLog->lock);
+  for (AccessLogRing *ring = accessLog->rings; ring != NULL;
+    ring = ring->next
+  ) {
+    u64 readPosition
+      = atomic_load_explicit(&ring->readPosition, memory_order_relaxed);
+    u64 writePosition
+      = atomic_load_explicit(&ring->writePosition, memory_order_acquire);
+    if ((readPosition == writePosition)
+      || (accessLogOpenFile(accessLog) != 0)
+    ) {
+      // Nothing to write, or nowhere to write it.  The records wait in the
+      // ring until the file can be opened.
+      continue;
+    }
+    
+    while (readPosition < writePosition) {
+      // The records up to the end of the ring are written at once.
+      u64 index = readPosition & (ACCESS_LOG_RING_RECORDS - 1);
+      u64 numRecords = writePosition - readPosition;
+      if (numRecords > ACCESS_LOG_RING_RECORDS - index) {
+        numRecords = ACCESS_LOG_RING_RECORDS - index;
+      }
+      if (fwrite(&ring->records[index], sizeof(AccessLogRecord),
+        (size_t) numRecords, accessLog->file) != numRecords
+      ) {
+        printLog(ERR, "Could not write access log: %s\n", strerror(errno));
+      }
+      readPosition += numRecords;
+      numWritten += (int) numRecords;
+    }
+    atomic_store_explicit(&ring->readPosition, readPosition,
+      memory_order_release);
+  }
+  if (numWritten > 0) {
+    fflush(accessLog->file);
+  }
+  mtx_unlock(&accessLog->lock);
+  
+  return numWritten;
+}
+
+/// @fn int accessLogWriterThread(void *args)
+///
+/// @brief Main loop of an AccessLog's writer thread.  Drains the rings every
+/// ACCESS_LOG_DRAIN_INTERVAL_MILLISECONDS until the AccessLog is destroyed.
+///
+/// @param args The AccessLog to drain cast to a void*.
+///
+/// @return This function always returns 0.
+int accessLogWriterThread(void *args) {
+  AccessLog *accessLog = (AccessLog*) args;
+  
+  mtx_lock(&accessLog->lock);
+  while (accessLog->exitNow == false) {
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_nsec += ACCESS_LOG_DRAIN_INTERVAL_MILLISECONDS * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    cnd_timedwait(&accessLog->drainNow, &accessLog->lock, &deadline);
+    mtx_unlock(&accessLog->lock);
+    accessLogFlush(accessLog);
+    mtx_lock(&accessLog->lock);
+  }
+  mtx_unlock(&accessLog->lock);
+  
+  return 0;
+}
+
+/// @fn AccessLog* accessLogDestroy(AccessLog *accessLog)
+///
+/// @brief Stop an AccessLog's writer thread, write out the records that are
+/// left, and free the AccessLog.  Nothing may add records to it once this is
+/// called.
+///
+/// @param accessLog The AccessLog to destroy.
+///
+/// @return This function always returns NULL.
+AccessLog* accessLogDestroy(AccessLog *accessLog) {
+  if (accessLog == NULL) {
+    return NULL;
+  }
+  
+  mtx_lock(&accessLog->lock);
+  accessLog->exitNow = true;
+  cnd_signal(&accessLog->drainNow);
+  mtx_unlock(&accessLog->lock);
+  thrd_join(accessLog->writerThread, NULL);
+  
+  accessLogFlush(accessLog);
+  u64 numDropped = accessLogNumDropped(accessLog);
+  if (numDropped > 0) {
+    printLog(WARN, "%llu access log records were dropped because a ring was "
+      "full.\n", llu(numDropped));
+  }
+  if (accessLog->file != NULL) {
+    fclose(accessLog->file); accessLog->file = NULL;
+  }
+  while (accessLog->rings != NULL) {
+    AccessLogRing *ring = accessLog->rings;
+    accessLog->rings = ring->next;
+    ring = (AccessLogRing*) pointerDestroy(ring);
+  }
+  cnd_destroy(&accessLog->drainNow);
+  mtx_destroy(&accessLog->lock);
+  accessLog->names = bytesDestroy(accessLog->names);
+  accessLog->filePath = stringDestroy(accessLog->filePath);
+  accessLog = (AccessLog*) pointerDestroy(accessLog);
+  
+  return NULL;
+}
+
+/// @fn AccessLog* accessLogCreate(const char *filePath, int rotateSeconds)
+///
+/// @brief Create an AccessLog and start the thread that writes its records to
+/// a file.  Nothing is written until the first record has been added.
+///
+/// @param filePath The path of the file to append the records to.
+/// @param rotateSeconds The number of seconds each file covers.  Files start
+///   on multiples of this many seconds since the epoch and have the UTC start
+///   time of their period appended to filePath, such as
+///   ".20260101-130000".  Zero or less writes to filePath itself and never
+///   rotates.
+///
+/// @return Returns a pointer to a newly-allocated AccessLog on success, NULL
+/// on failure.
+AccessLog* accessLogCreate(const char *filePath, int rotateSeconds) {
+  if (filePath == NULL) {
+    printLog(ERR, "NULL filePath provided.\n");
+    return NULL;
+  }
+  
+  AccessLog *accessLog = (AccessLog*) calloc(1, sizeof(AccessLog));
+  if (accessLog == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  straddstr(&accessLog->filePath, filePath);
+  accessLog->rotateSeconds = rotateSeconds;
+  accessLog->id = atomic_fetch_add_explicit(&accessLogLastId, (u64) 1,
+    memory_order_relaxed) + 1;
+  
+  mtx_init(&accessLog->lock, mtx_plain);
+  cnd_init(&accessLog->drainNow);
+  if (thrd_create(&accessLog->writerThread, accessLogWriterThread,
+    accessLog) != thrd_success
+  ) {
+    printLog(ERR, "Could not start access log writer thread.\n");
+    cnd_destroy(&accessLog->drainNow);
+    mtx_destroy(&accessLog->lock);
+    accessLog->filePath = stringDestroy(accessLog->filePath);
+    accessLog = (AccessLog*) pointerDestroy(accessLog);
+    return NULL;
+  }
+  
+  return accessLog;
+}
+
+/// @fn int accessLogSetNames(AccessLog *accessLog, const char *const *phaseNames, const char *const *routeNames, u32 numRoutes)
+///
+/// @brief Set the names that the phases and routes of records are decoded
+/// with.  They're written to the header of every file opened from now on.  A
+/// file that's already open gets another header.
+///
+/// @param accessLog The AccessLog to set the names of.
+/// @param phaseNames The names of the ACCESS_LOG_NUM_PHASES durations of a
+///   record.
+/// @param routeNames The name of each routeId.  May be NULL if numRoutes is
+///   zero.
+/// @param numRoutes The number of names in routeNames.
+///
+/// @return Returns 0 on success, -1 on failure.
+int accessLogSetNames(AccessLog *accessLog, const char *const *phaseNames,
+  const char *const *routeNames, u32 numRoutes
+) {
+  if ((accessLog == NULL) || (phaseNames == NULL)
+    || ((routeNames == NULL) && (numRoutes > 0))
+  ) {
+    printLog(ERR, "Invalid parameters.\n");
+    return -1;
+  }
+  
+  Bytes names = NULL;
+  for (int i = 0; i < ACCESS_LOG_NUM_PHASES; i++) {
+    bytesAddData(&names, phaseNames[i], strlen(phaseNames[i]) + 1);
+  }
+  for (u32 i = 0; i < numRoutes; i++) {
+    bytesAddData(&names, routeNames[i], strlen(routeNames[i]) + 1);
+  }
+  if (names == NULL) {
+    LOG_MALLOC_FAILURE();
+    return -1;
+  }
+  
+  mtx_lock(&accessLog->lock);
+  accessLog->names = bytesDestroy(accessLog->names);
+  accessLog->names = names;
+  accessLog->numRoutes = numRoutes;
+  if (accessLog->file != NULL) {
+    // The records written from now on go after a header with the new names.
+    fclose(accessLog->file); accessLog->file = NULL;
+  }
+  mtx_unlock(&accessLog->lock);
+  
+  return 0;
+}
+
+/// @fn u64 accessLogNumDropped(AccessLog *accessLog)
+///
+/// @brief Get the number of records an AccessLog has dropped because a ring
+/// was full.
+///
+/// @param accessLog The AccessLog to check.
+///
+/// @return Returns the number of dropped records.
+u64 accessLogNumDropped(AccessLog *accessLog) {
+  return (accessLog != NULL)
+    ? atomic_load_explicit(&accessLog->numDropped, memory_order_relaxed)
+    : 0;
+}
+
+/// @fn AccessLogMethod accessLogMethodFromString(const char *method)
+///
+/// @brief Get the AccessLogMethod of an HTTP request method.
+///
+/// @param method The request method, such as "GET".  May be NULL.
+///
+/// @return Returns the AccessLogMethod of the method.  ACCESS_LOG_METHOD_OTHER
+/// if it's not one that a record can hold.
+AccessLogMethod accessLogMethodFromString(const char *method) {
+  if (method == NULL) {
+    return ACCESS_LOG_METHOD_OTHER;
+  }
+  
+  for (int i = ACCESS_LOG_METHOD_OTHER + 1; i < NUM_ACCESS_LOG_METHODS; i++) {
+    if (strcmp(method, AccessLogMethodNames[i]) == 0) {
+      return (AccessLogMethod) i;
+    }
+  }
+  
+  return ACCESS_LOG_METHOD_OTHER;
+}
+
+/// @fn void accessLogAddressToString(const u8 *address, char *buffer)
+///
+/// @brief Format the client address of an AccessLogRecord.
+///
+/// @param address The 16 bytes of the address.
+/// @param buffer The buffer to write the address to.  Must hold at least 40
+///   bytes.
+///
+/// @return This function returns no value.
+void accessLogAddressToString(const u8 *address, char *buffer) {
+  static const u8 ipv4Prefix[12] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff
+  };
+  if (memcmp(address, ipv4Prefix, sizeof(ipv4Prefix)) == 0) {
+    sprintf(buffer, "%u.%u.%u.%u",
+      address[12], address[13], address[14], address[15]);
+    return;
+  }
+  
+  for (int i = 0; i < 8; i++) {
+    buffer += sprintf(buffer, (i > 0) ? ":%x" : "%x",
+      (address[2 * i] << 8) | address[(2 * i) + 1]);
+  }
+}
+
+/// @fn void accessLogRecordWrite(FILE *output, const AccessLogRecord *record, const char *const *names, u32 numPhases, u32 numRoutes, bool csv)
+///
+/// @brief Write one decoded AccessLogRecord.
+///
+/// @param output The FILE to write to.
+/// @param record The AccessLogRecord to write.
+/// @param names The phase names followed by the route names from the header
+///   of the file the record came from.
+/// @param numPhases The number of phase names.
+/// @param numRoutes The number of route names.
+/// @param csv Whether to write a line of CSV instead of text.
+///
+/// @return This function returns no value.
+void accessLogRecordWrite(FILE *output, const AccessLogRecord *record,
+  const char *const *names, u32 numPhases, u32 numRoutes, bool csv
+) {
+  time_t seconds = (time_t) (record->timestampUs / 1000000);
+  struct tm timestampTm;
+#ifdef _WIN32
+  gmtime_s(&timestampTm, &seconds);
+#else // POSIX
+  gmtime_r(&seconds, &timestampTm);
+#endif
+  char timestamp[40];
+  size_t length = strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S",
+    &timestampTm);
+  snprintf(timestamp + length, sizeof(timestamp) - length, ".%06uZ",
+    (unsigned) (record->timestampUs % 1000000));
+  char address[40];
+  accessLogAddressToString(record->clientAddress, address);
+  const char *method = AccessLogMethodNames[
+    (record->method < NUM_ACCESS_LOG_METHODS) ? record->method : 0];
+  char routeId[16];
+  const char *route = routeId;
+  if (record->routeId < numRoutes) {
+    route = names[numPhases + record->routeId];
+  } else if (record->routeId == ACCESS_LOG_NO_ROUTE) {
+    route = csv ? "" : "-";
+  } else {
+    snprintf(routeId, sizeof(routeId), "%u", record->routeId);
+  }
+  
+  if (csv) {
+    fprintf(output, "%s,%s,%u,%s,\"", timestamp, address, record->clientPort,
+      method);
+    for (const char *charAt = route; *charAt != '\0'; charAt++) {
+      if (*charAt == '"') {
+        fputc('"', output);
+      }
+      fputc(*charAt, output);
+    }
+    fprintf(output, "\",%u,%llu,%llu", record->statusCode,
+      llu(record->bytesIn), llu(record->bytesOut));
+    for (int i = 0; i < ACCESS_LOG_NUM_PHASES; i++) {
+      fprintf(output, ",%u", record->phaseUs[i]);
+    }
+  } else {
+    fprintf(output, "%s %s:%u %s %s %u %llu %llu", timestamp, address,
+      record->clientPort, method, route, record->statusCode,
+      llu(record->bytesIn), llu(record->bytesOut));
+    for (int i = 0; i < ACCESS_LOG_NUM_PHASES; i++) {
+      if ((u32) i < numPhases) {
+        fprintf(output, " %s=%uus", names[i], record->phaseUs[i]);
+      } else {
+        fprintf(output, " phase%d=%uus", i, record->phaseUs[i]);
+      }
+    }
+  }
+  fputc('\n', output);
+}
+
+/// @fn i64 accessLogDecode(FILE *input, FILE *output, bool csv, bool columnNames)
+///
+/// @brief Decode an access log file into one line per record.  Lines hold the
+/// time, client, method, route, status, bytes in, bytes out, and the duration
+/// of each phase.
+///
+/// @param input The access log file, opened for binary reading.
+/// @param output The FILE to write the decoded records to.
+/// @param csv Whether to write CSV instead of text.
+/// @param columnNames Whether to start CSV with a row of column names.
+///
+/// @return Returns the number of records decoded on success, -1 if input is
+/// not an access log file.
+i64 accessLogDecode(FILE *input, FILE *output, bool csv,
+  bool columnNames
+) {
+  if ((input == NULL) || (output == NULL)) {
+    printLog(ERR, "NULL file provided.\n");
+    return -1;
+  }
+  
+  i64 numRecords = 0;
+  bool haveHeader = false;
+  Bytes names = NULL;
+  const char **nameList = NULL;
+  u32 numPhases = 0;
+  u32 numRoutes = 0;
+  AccessLogRecord record;
+  AccessLogFileHeader header;
+  // Records and headers are told apart by their first eight bytes.  The
+  // timestamp of a record can't match the magic until the year 100000.
+  while (fread(&header, 1, sizeof(header.magic), input)
+    == sizeof(header.magic)
+  ) {
+    if (memcmp(header.magic, ACCESS_LOG_MAGIC, sizeof(header.magic)) == 0) {
+      size_t rest = sizeof(header) - sizeof(header.magic);
+      if ((fread(((u8*) &header) + sizeof(header.magic), 1, rest, input)
+        != rest)
+        || (header.version != ACCESS_LOG_VERSION)
+        || (header.recordSize != sizeof(AccessLogRecord))
+      ) {
+        printLog(ERR, "Unsupported access log header.\n");
+        numRecords = -1;
+        break;
+      }
+      
+      names = bytesDestroy(names);
+      nameList = (const char**) pointerDestroy(nameList);
+      numPhases = 0;
+      numRoutes = 0;
+      if (header.namesLength > 0) {
+        bytesAllocate(&names, header.namesLength + 1);
+        nameList = (const char**) calloc(
+          (size_t) header.numPhases + header.numRoutes + 1, sizeof(char*));
+        if ((names == NULL) || (nameList == NULL)) {
+          LOG_MALLOC_FAILURE();
+          numRecords = -1;
+          break;
+        }
+        if (fread(names, 1, header.namesLength, input) != header.namesLength) {
+          printLog(ERR, "Access log names are truncated.\n");
+          numRecords = -1;
+          break;
+        }
+        names[header.namesLength] = '\0';
+        const char *name = (const char*) names;
+        const char *namesEnd = name + header.namesLength;
+        u32 numNames = 0;
+        while ((name < namesEnd)
+          && (numNames < header.numPhases + header.numRoutes)
+        ) {
+          nameList[numNames++] = name;
+          name += strlen(name) + 1;
+        }
+        numPhases = (numNames < header.numPhases) ? numNames : header.numPhases;
+        numRoutes = numNames - numPhases;
+      }
+      
+      if (csv && columnNames && (haveHeader == false)) {
+        fputs("timestamp,clientAddress,clientPort,method,route,status,"
+          "bytesIn,bytesOut", output);
+        for (int i = 0; i < ACCESS_LOG_NUM_PHASES; i++) {
+          if ((u32) i < numPhases) {
+            fprintf(output, ",%sUs", nameList[i]);
+          } else {
+            fprintf(output, ",phase%dUs", i);
+          }
+        }
+        fputc('\n', output);
+      }
+      haveHeader = true;
+      continue;
+    } else if (haveHeader == false) {
+      printLog(ERR, "Not an access log file.\n");
+      numRecords = -1;
+      break;
+    }
+    
+    memcpy(&record, header.magic, sizeof(header.magic));
+    size_t rest = sizeof(record) - sizeof(header.magic);
+    if (fread(((u8*) &record) + sizeof(header.magic), 1, rest, input) != rest) {
+      printLog(WARN, "Ignoring truncated record at the end of the file.\n");
+      break;
+    }
+    accessLogRecordWrite(output, &record, nameList, numPhases, numRoutes, csv);
+    numRecords++;
+  }
+  
+  names = bytesDestroy(names);
+  nameList = (const char**) pointerDestroy(nameList);
+  return numRecords;
+}
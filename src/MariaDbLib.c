@@ -42,6 +42,7 @@
 #define LOG_MALLOC_FAILURE(...) {}
 #endif
 #include "Scope.h"
+#include "TraceLib.h"
 #include "OsApi.h"
 
 /// @struct SocketMetadata
@@ -2862,21 +2863,18 @@ DbResult* _mariaDbExecQuery(MariaDb *database, const Bytes query) {
   return returnValue;
 }
 
-/// @fn DbResult* mariaDbExecQueryBytes(void *connection, const Bytes query)
+/// @fn DbResult* mariaDbExecQueryWithRetry(MariaDb *database, const Bytes query)
 ///
 /// @brief Send a SQL query to the server.  If the query fails, try once more
 /// in case the connection to the database had died.
 ///
-/// @param connection The MariaDb object with the database metadata cast to a
-///   void*.
+/// @param database The MariaDb object with the database metadata.
 /// @param query is the SQL query Bytes object to send.
 ///
 /// @return Returns a DbResult containing the server's results on success,
 /// an empty DbResult on failure.
-DbResult* mariaDbExecQueryBytes(void *connection, const Bytes query) {
-  printLog(TRACE, "ENTER mariaDbExecQueryBytes(query=%p)\n", query);
-
-  MariaDb *database = (MariaDb*) connection;
+DbResult* mariaDbExecQueryWithRetry(MariaDb *database, const Bytes query) {
+  printLog(TRACE, "ENTER mariaDbExecQueryWithRetry(query=%p)\n", query);
   
   call_once(&_mariaDbThreadSetup, setupMariaDbThreadMetadata);
   
@@ -2888,11 +2886,38 @@ DbResult* mariaDbExecQueryBytes(void *connection, const Bytes query) {
     queryResult = _mariaDbExecQuery(database, query);
   }
   
-  printLog(TRACE, "EXIT mariaDbExecQueryBytes(query=%p) = {successful = %s}\n", query,
+  printLog(TRACE, "EXIT mariaDbExecQueryWithRetry(query=%p) = {successful = %s}\n", query,
     (dbQuerySuccessful(queryResult) == true) ? "true" : "false");
   return queryResult;
 }
 
+/// @fn DbResult* mariaDbExecQueryBytes(void *connection, const Bytes query)
+///
+/// @brief Send a SQL query to the server.  If the calling thread is working on
+/// a traced request, the query is recorded as a span of it.
+///
+/// @param connection The MariaDb object with the database metadata cast to a
+///   void*.
+/// @param query is the SQL query Bytes object to send.
+///
+/// @return Returns a DbResult containing the server's results on success,
+/// an empty DbResult on failure.
+DbResult* mariaDbExecQueryBytes(void *connection, const Bytes query) {
+  TraceContext *traceContext = traceCurrentContext;
+  if (traceContext == NULL) {
+    // This is the expected case.
+    return mariaDbExecQueryWithRetry((MariaDb*) connection, query);
+  }
+  
+  u64 startNs = traceNowNanoseconds();
+  DbResult *queryResult
+    = mariaDbExecQueryWithRetry((MariaDb*) connection, query);
+  traceContextAddSpan(traceContext, "mariadb", (const char*) query,
+    startNs, traceNowNanoseconds());
+  
+  return queryResult;
+}
+
 /// @fn DbResult* mariaDbExecQueryString(void *connection, const Bytes query)
 ///
 /// @brief Send a SQL query string to the server.
@@ -32,6 +32,7 @@
 #include "SqlClientLib.h"
 #include "StringLib.h"
 #include "Scope.h"
+#include "TraceLib.h"
 #ifdef LOGGING_ENABLED
 #include "LoggingLib.h"
 #else
@@ -479,20 +480,19 @@ TypeDescriptor **sqliteTypes[NUM_SQLITE_DATA_TYPES] = {
   &typeBytes,   // SQLITE_NULL
 };
 
-/// @fn DbResult* sqliteExecQueryBytes(void *connection, const Bytes queryBytes)
+/// @fn DbResult* sqliteExecQuery(Sqlite *database, const Bytes queryBytes)
 ///
 /// @brief Wrapper around sqlite3_exec that runs the provided query on the
 /// SQLite database instance and provides a DbResult.
 ///
-/// @param connection A pointer to a Sqlite instance holding the metadata for
-///   the SQLite connection, cast to a void*.
+/// @param database A pointer to a Sqlite instance holding the metadata for
+///   the SQLite connection.
 /// @param queryBytes A string containing the query to run.
 ///
 /// @return Returns a standard DbResult with the results of the query.
-DbResult* sqliteExecQueryBytes(void *connection, const Bytes queryBytes) {
-  Sqlite *database = (Sqlite*) connection;
+DbResult* sqliteExecQuery(Sqlite *database, const Bytes queryBytes) {
   printLog(FLOOD,
-    "ENTER sqliteExecQueryBytes(database=%p, queryBytes=\"%s\")",
+    "ENTER sqliteExecQuery(database=%p, queryBytes=\"%s\")",
     database, queryBytes);
   
   DbResult *queryResult = (DbResult*) calloc(1, sizeof(DbResult));
@@ -545,7 +545,7 @@ DbResult* sqliteExecQueryBytes(void *connection, const Bytes queryBytes) {
     printLog(ERR, "bytesLength(queryBytes) = %llu\n", llu(bytesLength(queryBytes)));
     sqlite3_finalize(preparedStatement);
     printLog(FLOOD,
-      "EXIT sqliteExecQueryBytes(database=%p, queryBytes=\"%s\") = {NOT successful}",
+      "EXIT sqliteExecQuery(database=%p, queryBytes=\"%s\") = {NOT successful}",
       database, queryBytes);
     return queryResult; // dbQuerySuccessful(queryResult) is false
   }
@@ -688,7 +688,7 @@ DbResult* sqliteExecQueryBytes(void *connection, const Bytes queryBytes) {
   }
   
   printLog(FLOOD,
-    "EXIT sqliteExecQueryBytes(database=%p, queryBytes=\"%s\") = {%llu results}",
+    "EXIT sqliteExecQuery(database=%p, queryBytes=\"%s\") = {%llu results}",
     database, queryBytes, llu(dbGetNumResults(queryResult)));
   return queryResult;
   
@@ -723,11 +723,37 @@ fieldTypesMallocFailure:
   // dbQuerySuccessful(queryResult) is false.
   
   printLog(FLOOD,
-    "EXIT sqliteExecQueryBytes(database=%p, queryBytes=\"%s\") = {%llu results}",
+    "EXIT sqliteExecQuery(database=%p, queryBytes=\"%s\") = {%llu results}",
     database, queryBytes, llu(dbGetNumResults(queryResult)));
   return queryResult;
 }
 
+/// @fn DbResult* sqliteExecQueryBytes(void *connection, const Bytes queryBytes)
+///
+/// @brief Run the provided query on the SQLite database instance and provide
+/// a DbResult.  If the calling thread is working on a traced request, the
+/// query is recorded as a span of it.
+///
+/// @param connection A pointer to a Sqlite instance holding the metadata for
+///   the SQLite connection, cast to a void*.
+/// @param queryBytes A string containing the query to run.
+///
+/// @return Returns a standard DbResult with the results of the query.
+DbResult* sqliteExecQueryBytes(void *connection, const Bytes queryBytes) {
+  TraceContext *traceContext = traceCurrentContext;
+  if (traceContext == NULL) {
+    // This is the expected case.
+    return sqliteExecQuery((Sqlite*) connection, queryBytes);
+  }
+  
+  u64 startNs = traceNowNanoseconds();
+  DbResult *queryResult = sqliteExecQuery((Sqlite*) connection, queryBytes);
+  traceContextAddSpan(traceContext, "sqlite", (const char*) queryBytes,
+    startNs, traceNowNanoseconds());
+  
+  return queryResult;
+}
+
 /// @fn DbResult* sqliteGetDatabaseNames(void *db)
 ///
 /// @brief Get the names of the databases managed by the SQL system.
@@ -0,0 +1,643 @@
+////////////////////////////////////////////////////////////////////////////////
+//                                                                            //
+//                   Copyright (c) 2012-2025 Skymond, LLC.                    //
+//                                                                            //
+// Permission is hereby granted, free of charge, to any person obtaining a    //
+// copy of this software and associated documentation files (the "Software"), //
+// to deal in the Software without restriction, including without limitation  //
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,   //
+// and/or sell copies of the Software, and to permit persons to whom the      //
+// Software is furnished to do so, subject to the following conditions:       //
+//                                                                            //
+// The above copyright notice and this permission notice shall be included    //
+// in all copies or substantial portions of the Software.                     //
+//                                                                            //
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR //
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   //
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    //
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER //
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    //
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        //
+// DEALINGS IN THE SOFTWARE.                                                  //
+//                                                                            //
+//                               Skymond, LLC                                 //
+//                            https://skymond.io                              //
+//                                                                            //
+////////////////////////////////////////////////////////////////////////////////
+
+// Doxygen marker
+/// @file
+
+#include "TraceLib.h"
+#include "CAtomic.h"
+
+#ifdef LOGGING_ENABLED
+#include "LoggingLib.h"
+#else
+#undef printLog
+#define printLog(...) {}
+#define LOG_MALLOC_FAILURE(...) {}
+#define logFile stderr
+#endif
+
+#include "OsApi.h"
+
+TRACE_THREAD_LOCAL TraceContext *traceCurrentContext = NULL;
+
+/// @struct TraceRecord
+///
+/// @brief One finished span as it's held in a TraceBuffer.  Fixed-size so that
+/// recording a span never allocates.
+///
+/// @param traceId The ID of the trace the span is part of.
+/// @param spanId The ID of the span.
+/// @param parentSpanId The ID of the span's parent.  Zero if it has none.
+/// @param startNs The time the span started from traceNowNanoseconds.
+/// @param endNs The time the span ended from traceNowNanoseconds.
+/// @param name What the span timed, such as a phase of a request.
+/// @param detail More about what the span timed, such as the query that was
+///   run.  May be empty.
+typedef struct TraceRecord {
+  u8   traceId[16];
+  u64  spanId;
+  u64  parentSpanId;
+  u64  startNs;
+  u64  endNs;
+  char name[TRACE_NAME_LENGTH];
+  char detail[TRACE_DETAIL_LENGTH];
+} TraceRecord;
+
+/// @struct TraceSlot
+///
+/// @brief One slot of a TraceBuffer's ring.
+///
+/// @param sequence The position in the ring that the slot is ready to be
+///   written at, or that position plus one once its record has been written
+///   and is ready to be read.
+/// @param record The TraceRecord held in the slot.
+typedef struct TraceSlot {
+  _Atomic(u64) sequence;
+  TraceRecord  record;
+} TraceSlot;
+
+/// @struct TraceBuffer
+///
+/// @brief A bounded ring of finished spans that any number of threads add to
+/// without taking a lock and that one writer thread drains to a file.
+///
+/// @param slots The slots of the ring.
+/// @param mask The number of slots minus one.  The number of slots is a power
+///   of two.
+/// @param writePosition The position the next span will be added at.
+/// @param readPosition The position of the next span to write to the file.
+///   Only used by the thread that holds lock.
+/// @param numDropped The number of spans that were dropped because the ring
+///   was full.
+/// @param file The file the spans are written to.
+/// @param lock The mutex that serializes draining and protects exitNow.
+/// @param drainNow The condition that wakes the writer thread.
+/// @param writerThread The thread that drains the ring periodically.
+/// @param exitNow Whether or not the writer thread should exit.
+struct TraceBuffer {
+  TraceSlot    *slots;
+  u64           mask;
+  _Atomic(u64)  writePosition;
+  u64           readPosition;
+  _Atomic(u64)  numDropped;
+  FILE         *file;
+  mtx_t         lock;
+  cnd_t         drainNow;
+  thrd_t        writerThread;
+  bool          exitNow;
+};
+
+/// @fn u64 traceNowNanoseconds(void)
+///
+/// @brief Get the current time from a monotonic clock.  The times of spans
+/// are only meaningful relative to each other, but they're never distorted by
+/// changes to the time of day.
+///
+/// @return Returns the number of nanoseconds since an arbitrary point in the
+/// past.
+u64 traceNowNanoseconds(void) {
+#ifdef _WIN32
+  static LARGE_INTEGER frequency = {0};
+  if (frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (u64) (counter.QuadPart / frequency.QuadPart) * 1000000000
+    + (u64) ((counter.QuadPart % frequency.QuadPart) * 1000000000
+      / frequency.QuadPart);
+#else // POSIX
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (((u64) now.tv_sec) * 1000000000) + ((u64) now.tv_nsec);
+#endif
+}
+
+/// @fn u64 traceRandom(void)
+///
+/// @brief Get a random number for an ID or a sampling decision.  Each thread
+/// has its own xorshift64* generator, so this never takes a lock.  The
+/// numbers only have to be unlikely to collide, not unpredictable.
+///
+/// @return Returns a random number that is never zero.
+u64 traceRandom(void) {
+  static TRACE_THREAD_LOCAL u64 state = 0;
+  if (state == 0) {
+    // Seed from the time and the address of this thread's state so that
+    // threads that start together don't share a sequence.
+    state = (traceNowNanoseconds() ^ (u64) (uintptr_t) &state)
+      * 0x9e3779b97f4a7c15ULL;
+    if (state == 0) {
+      state = 1;
+    }
+  }
+  
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  u64 value = state * 0x2545f4914f6cdd1dULL;
+  return (value != 0) ? value : 1;
+}
+
+/// @fn void traceJsonAddString(FILE *file, const char *string)
+///
+/// @brief Write a string to a file as the contents of a JSON string.
+///
+/// @param file The FILE to write to.
+/// @param string The string to write.
+///
+/// @return This function returns no value.
+void traceJsonAddString(FILE *file, const char *string) {
+  for (const char *charAt = string; *charAt != '\0'; charAt++) {
+    unsigned char character = (unsigned char) *charAt;
+    if ((character == '"') || (character == '\\')) {
+      fputc('\\', file);
+      fputc(character, file);
+    } else if (character < 0x20) {
+      fprintf(file, "\\u%04x", character);
+    } else {
+      fputc(character, file);
+    }
+  }
+}
+
+/// @fn void traceRecordWrite(FILE *file, const TraceRecord *record)
+///
+/// @brief Write a TraceRecord to a file as one line of JSON.
+///
+/// @param file The FILE to write to.
+/// @param record The TraceRecord to write.
+///
+/// @return This function returns no value.
+void traceRecordWrite(FILE *file, const TraceRecord *record) {
+  fputs("{\"traceId\": \"", file);
+  for (int i = 0; i < 16; i++) {
+    fprintf(file, "%02x", record->traceId[i]);
+  }
+  fprintf(file, "\", \"spanId\": \"%016llx\", \"parentSpanId\": \"",
+    llu(record->spanId));
+  if (record->parentSpanId != 0) {
+    fprintf(file, "%016llx", llu(record->parentSpanId));
+  }
+  fputs("\", \"name\": \"", file);
+  traceJsonAddString(file, record->name);
+  fprintf(file, "\", \"startNs\": %llu, \"durationNs\": %llu, \"detail\": \"",
+    llu(record->startNs),
+    llu((record->endNs > record->startNs)
+      ? record->endNs - record->startNs : 0));
+  traceJsonAddString(file, record->detail);
+  fputs("\"}\n", file);
+}
+
+/// @fn int traceBufferFlush(TraceBuffer *traceBuffer)
+///
+/// @brief Write all of the spans that are in a TraceBuffer to its file.  The
+/// writer thread does this periodically.
+///
+/// @param traceBuffer The TraceBuffer to drain.
+///
+/// @return Returns the number of spans that were written.
+int traceBufferFlush(TraceBuffer *traceBuffer) {
+  if (traceBuffer == NULL) {
+    return 0;
+  }
+  
+  int numWritten = 0;
+  mtx_lock(&traceBuffer->lock);
+  while (true) {
+    u64 position = traceBuffer->readPosition;
+    TraceSlot *slot = &traceBuffer->slots[position & traceBuffer->mask];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire)
+      != position + 1
+    ) {
+      // Empty, or the span at this position is still being written.
+      break;
+    }
+    traceRecordWrite(traceBuffer->file, &slot->record);
+    // Hand the slot back to the writers for the next trip around the ring.
+    atomic_store_explicit(&slot->sequence, position + traceBuffer->mask + 1,
+      memory_order_release);
+    traceBuffer->readPosition = position + 1;
+    numWritten++;
+  }
+  if (numWritten > 0) {
+    fflush(traceBuffer->file);
+  }
+  mtx_unlock(&traceBuffer->lock);
+  
+  return numWritten;
+}
+
+/// @fn int traceBufferWriterThread(void *args)
+///
+/// @brief Main loop of a TraceBuffer's writer thread.  Drains the ring every
+/// TRACE_DRAIN_INTERVAL_MILLISECONDS until the TraceBuffer is destroyed.
+///
+/// @param args The TraceBuffer to drain cast to a void*.
+///
+/// @return This function always returns 0.
+int traceBufferWriterThread(void *args) {
+  TraceBuffer *traceBuffer = (TraceBuffer*) args;
+  
+  mtx_lock(&traceBuffer->lock);
+  while (traceBuffer->exitNow == false) {
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_nsec += TRACE_DRAIN_INTERVAL_MILLISECONDS * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    cnd_timedwait(&traceBuffer->drainNow, &traceBuffer->lock, &deadline);
+    mtx_unlock(&traceBuffer->lock);
+    traceBufferFlush(traceBuffer);
+    mtx_lock(&traceBuffer->lock);
+  }
+  mtx_unlock(&traceBuffer->lock);
+  
+  return 0;
+}
+
+/// @fn TraceBuffer* traceBufferDestroy(TraceBuffer *traceBuffer)
+///
+/// @brief Stop a TraceBuffer's writer thread, write out the spans that are
+/// left, and free the TraceBuffer.  Nothing may add spans to it once this is
+/// called.
+///
+/// @param traceBuffer The TraceBuffer to destroy.
+///
+/// @return This function always returns NULL.
+TraceBuffer* traceBufferDestroy(TraceBuffer *traceBuffer) {
+  if (traceBuffer == NULL) {
+    return NULL;
+  }
+  
+  mtx_lock(&traceBuffer->lock);
+  traceBuffer->exitNow = true;
+  cnd_signal(&traceBuffer->drainNow);
+  mtx_unlock(&traceBuffer->lock);
+  thrd_join(traceBuffer->writerThread, NULL);
+  
+  traceBufferFlush(traceBuffer);
+  u64 numDropped = traceBufferNumDropped(traceBuffer);
+  if (numDropped > 0) {
+    printLog(WARN, "%llu spans were dropped because the trace buffer was "
+      "full.\n", llu(numDropped));
+  }
+  fclose(traceBuffer->file);
+  cnd_destroy(&traceBuffer->drainNow);
+  mtx_destroy(&traceBuffer->lock);
+  traceBuffer->slots = (TraceSlot*) pointerDestroy(traceBuffer->slots);
+  traceBuffer = (TraceBuffer*) pointerDestroy(traceBuffer);
+  
+  return NULL;
+}
+
+/// @fn TraceBuffer* traceBufferCreate(const char *filePath, u32 numRecords)
+///
+/// @brief Create a TraceBuffer and start the thread that writes its spans to
+/// a file.
+///
+/// @param filePath The path of the file to append the spans to, one JSON
+///   object per line.
+/// @param numRecords The number of spans the ring holds.  Rounded up to a
+///   power of two.  A value of 0 selects TRACE_DEFAULT_NUM_RECORDS.
+///
+/// @return Returns a pointer to a newly-allocated TraceBuffer on success,
+/// NULL on failure.
+TraceBuffer* traceBufferCreate(const char *filePath, u32 numRecords) {
+  if (filePath == NULL) {
+    printLog(ERR, "NULL filePath provided.\n");
+    return NULL;
+  }
+  
+  if (numRecords == 0) {
+    numRecords = TRACE_DEFAULT_NUM_RECORDS;
+  }
+  u64 numSlots = 1;
+  while (numSlots < numRecords) {
+    numSlots <<= 1;
+  }
+  
+  TraceBuffer *traceBuffer = (TraceBuffer*) calloc(1, sizeof(TraceBuffer));
+  if (traceBuffer == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  traceBuffer->slots = (TraceSlot*) calloc(numSlots, sizeof(TraceSlot));
+  if (traceBuffer->slots == NULL) {
+    LOG_MALLOC_FAILURE();
+    traceBuffer = (TraceBuffer*) pointerDestroy(traceBuffer);
+    return NULL;
+  }
+  traceBuffer->mask = numSlots - 1;
+  for (u64 i = 0; i < numSlots; i++) {
+    atomic_init(&traceBuffer->slots[i].sequence, i);
+  }
+  
+  traceBuffer->file = fopen(filePath, "a");
+  if (traceBuffer->file == NULL) {
+    printLog(ERR, "Could not open \"%s\" for tracing: %s\n",
+      filePath, strerror(errno));
+    traceBuffer->slots = (TraceSlot*) pointerDestroy(traceBuffer->slots);
+    traceBuffer = (TraceBuffer*) pointerDestroy(traceBuffer);
+    return NULL;
+  }
+  mtx_init(&traceBuffer->lock, mtx_plain);
+  cnd_init(&traceBuffer->drainNow);
+  if (thrd_create(&traceBuffer->writerThread, traceBufferWriterThread,
+    traceBuffer) != thrd_success
+  ) {
+    printLog(ERR, "Could not start trace writer thread.\n");
+    cnd_destroy(&traceBuffer->drainNow);
+    mtx_destroy(&traceBuffer->lock);
+    fclose(traceBuffer->file);
+    traceBuffer->slots = (TraceSlot*) pointerDestroy(traceBuffer->slots);
+    traceBuffer = (TraceBuffer*) pointerDestroy(traceBuffer);
+    return NULL;
+  }
+  
+  return traceBuffer;
+}
+
+/// @fn u64 traceBufferNumDropped(TraceBuffer *traceBuffer)
+///
+/// @brief Get the number of spans a TraceBuffer has dropped because it was
+/// full.
+///
+/// @param traceBuffer The TraceBuffer to check.
+///
+/// @return Returns the number of dropped spans.
+u64 traceBufferNumDropped(TraceBuffer *traceBuffer) {
+  return (traceBuffer != NULL)
+    ? atomic_load_explicit(&traceBuffer->numDropped, memory_order_relaxed)
+    : 0;
+}
+
+/// @fn void traceBufferAdd(TraceBuffer *traceBuffer, const u8 *traceId, u64 spanId, u64 parentSpanId, const char *name, const char *detail, u64 startNs, u64 endNs)
+///
+/// @brief Add a finished span to a TraceBuffer.  A slot is claimed with a
+/// compare-and-swap on the write position, so adding never takes a lock and
+/// never waits on the writer thread.  The span is dropped if the ring is full.
+///
+/// @param traceBuffer The TraceBuffer to add the span to.
+/// @param traceId The 16-byte ID of the trace the span is part of.
+/// @param spanId The ID of the span.
+/// @param parentSpanId The ID of the span's parent.  Zero if it has none.
+/// @param name What the span timed.
+/// @param detail More about what the span timed.  May be NULL.
+/// @param startNs The time the span started from traceNowNanoseconds.
+/// @param endNs The time the span ended from traceNowNanoseconds.
+///
+/// @return This function returns no value.
+void traceBufferAdd(TraceBuffer *traceBuffer, const u8 *traceId, u64 spanId,
+  u64 parentSpanId, const char *name, const char *detail,
+  u64 startNs, u64 endNs
+) {
+  u64 position = atomic_load_explicit(&traceBuffer->writePosition,
+    memory_order_relaxed);
+  TraceSlot *slot = NULL;
+  while (true) {
+    slot = &traceBuffer->slots[position & traceBuffer->mask];
+    i64 lag = (i64) (atomic_load_explicit(&slot->sequence,
+      memory_order_acquire) - position);
+    if (lag == 0) {
+      // The slot is free.  Claim it unless another thread got it first, in
+      // which case position is updated to the current write position.
+      if (atomic_compare_exchange_weak_explicit(&traceBuffer->writePosition,
+        &position, position + 1, memory_order_relaxed, memory_order_relaxed)
+      ) {
+        break;
+      }
+    } else if (lag < 0) {
+      // The writer thread hasn't drained the slot from the last trip around
+      // the ring.
+      atomic_fetch_add_explicit(&traceBuffer->numDropped, (u64) 1,
+        memory_order_relaxed);
+      return;
+    } else {
+      position = atomic_load_explicit(&traceBuffer->writePosition,
+        memory_order_relaxed);
+    }
+  }
+  
+  TraceRecord *record = &slot->record;
+  memcpy(record->traceId, traceId, sizeof(record->traceId));
+  record->spanId = spanId;
+  record->parentSpanId = parentSpanId;
+  record->startNs = startNs;
+  record->endNs = endNs;
+  snprintf(record->name, sizeof(record->name), "%s", name);
+  snprintf(record->detail, sizeof(record->detail), "%s",
+    (detail != NULL) ? detail : "");
+  atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+}
+
+/// @fn bool traceParseHex(const char *hex, int numDigits, u8 *bytes)
+///
+/// @brief Parse a fixed number of lowercase hexadecimal digits.
+///
+/// @param hex The digits to parse.
+/// @param numDigits The number of digits to parse.  Must be even.
+/// @param bytes The buffer to write the numDigits / 2 parsed bytes to.
+///
+/// @return Returns true if all of the digits were valid and at least one of
+/// them wasn't zero, false otherwise.
+bool traceParseHex(const char *hex, int numDigits, u8 *bytes) {
+  bool nonZero = false;
+  for (int i = 0; i < numDigits; i++) {
+    char digit = hex[i];
+    u8 value = 0;
+    if ((digit >= '0') && (digit <= '9')) {
+      value = (u8) (digit - '0');
+    } else if ((digit >= 'a') && (digit <= 'f')) {
+      value = (u8) (digit - 'a' + 10);
+    } else {
+      return false;
+    }
+    if ((i & 1) == 0) {
+      bytes[i / 2] = (u8) (value << 4);
+    } else {
+      bytes[i / 2] |= value;
+    }
+    nonZero = nonZero || (value != 0);
+  }
+  
+  return nonZero;
+}
+
+/// @fn bool traceContextStart(TraceContext *traceContext, TraceBuffer *traceBuffer, const char *traceparent, int sampleRate)
+///
+/// @brief Decide whether or not a request is traced and, if it is, set up the
+/// TraceContext its spans are recorded with.  A request whose W3C traceparent
+/// header says its caller is tracing it is always traced and joins the
+/// caller's trace.  Other requests are sampled.
+///
+/// @param traceContext The TraceContext to set up.  Its traceBuffer is set to
+///   NULL if the request isn't traced.
+/// @param traceBuffer The TraceBuffer to record the request's spans in.
+/// @param traceparent The value of the request's traceparent header.  May be
+///   NULL.
+/// @param sampleRate One in this many requests that their callers aren't
+///   tracing is traced.  A value of 0 or less only traces requests that their
+///   callers are tracing.
+///
+/// @return Returns true if the request is traced, false if it isn't.
+bool traceContextStart(TraceContext *traceContext, TraceBuffer *traceBuffer,
+  const char *traceparent, int sampleRate
+) {
+  traceContext->traceBuffer = NULL;
+  traceContext->parentSpanId = 0;
+  
+  // version "-" trace-id "-" parent-id "-" trace-flags
+  // (https://www.w3.org/TR/trace-context/#traceparent-header)
+  bool sampled = false;
+  u8 parentSpanId[8];
+  if ((traceparent != NULL) && (strlen(traceparent) >= 55)
+    && (strncmp(traceparent, "ff", 2) != 0) && (traceparent[2] == '-')
+    && (traceparent[35] == '-') && (traceparent[52] == '-')
+    && (traceParseHex(&traceparent[3], 32, traceContext->traceId))
+    && (traceParseHex(&traceparent[36], 16, parentSpanId))
+  ) {
+    u8 flags = 0;
+    traceParseHex(&traceparent[53], 2, &flags);
+    sampled = ((flags & 0x01) != 0);
+    for (int i = 0; i < 8; i++) {
+      traceContext->parentSpanId
+        = (traceContext->parentSpanId << 8) | parentSpanId[i];
+    }
+  } else {
+    u64 traceIdHigh = traceRandom();
+    u64 traceIdLow = traceRandom();
+    memcpy(&traceContext->traceId[0], &traceIdHigh, sizeof(traceIdHigh));
+    memcpy(&traceContext->traceId[8], &traceIdLow, sizeof(traceIdLow));
+  }
+  
+  if ((sampled == false)
+    && ((sampleRate <= 0) || ((traceRandom() % (u64) sampleRate) != 0))
+  ) {
+    return false;
+  }
+  
+  traceContext->spanId = traceRandom();
+  traceContext->traceBuffer = traceBuffer;
+  return true;
+}
+
+/// @fn void traceContextAddSpan(const TraceContext *traceContext, const char *name, const char *detail, u64 startNs, u64 endNs)
+///
+/// @brief Record a finished child span of a traced request.
+///
+/// @param traceContext The TraceContext of the request.
+/// @param name What the span timed.
+/// @param detail More about what the span timed.  May be NULL.
+/// @param startNs The time the span started from traceNowNanoseconds.
+/// @param endNs The time the span ended from traceNowNanoseconds.
+///
+/// @return This function returns no value.
+void traceContextAddSpan(const TraceContext *traceContext, const char *name,
+  const char *detail, u64 startNs, u64 endNs
+) {
+  if ((traceContext != NULL) && (traceContext->traceBuffer != NULL)) {
+    traceBufferAdd(traceContext->traceBuffer, traceContext->traceId,
+      traceRandom(), traceContext->spanId, name, detail, startNs, endNs);
+  }
+}
+
+/// @fn void traceContextFinish(TraceContext *traceContext, const char *name, const char *detail, u64 startNs, u64 endNs)
+///
+/// @brief Record the span of a traced request itself.  No more spans are
+/// recorded with the TraceContext after this.
+///
+/// @param traceContext The TraceContext of the request.
+/// @param name What the request was.
+/// @param detail More about the request.  May be NULL.
+/// @param startNs The time the request started from traceNowNanoseconds.
+/// @param endNs The time the request ended from traceNowNanoseconds.
+///
+/// @return This function returns no value.
+void traceContextFinish(TraceContext *traceContext, const char *name,
+  const char *detail, u64 startNs, u64 endNs
+) {
+  if ((traceContext != NULL) && (traceContext->traceBuffer != NULL)) {
+    traceBufferAdd(traceContext->traceBuffer, traceContext->traceId,
+      traceContext->spanId, traceContext->parentSpanId, name, detail,
+      startNs, endNs);
+    traceContext->traceBuffer = NULL;
+  }
+}
+
+/// @fn void traceSpanStart(TraceSpan *span, const TraceContext *traceContext)
+///
+/// @brief Start a child span of a traced request whose ID is needed before
+/// it ends, such as one that's passed on to another server.
+///
+/// @param span The TraceSpan to start.
+/// @param traceContext The TraceContext of the request.
+///
+/// @return This function returns no value.
+void traceSpanStart(TraceSpan *span, const TraceContext *traceContext) {
+  span->traceContext = traceContext;
+  span->spanId = traceRandom();
+  span->startNs = traceNowNanoseconds();
+}
+
+/// @fn void traceSpanEnd(TraceSpan *span, const char *name, const char *detail)
+///
+/// @brief Record a span that was started with traceSpanStart.
+///
+/// @param span The TraceSpan to end.
+/// @param name What the span timed.
+/// @param detail More about what the span timed.  May be NULL.
+///
+/// @return This function returns no value.
+void traceSpanEnd(TraceSpan *span, const char *name, const char *detail) {
+  const TraceContext *traceContext = span->traceContext;
+  if ((traceContext != NULL) && (traceContext->traceBuffer != NULL)) {
+    traceBufferAdd(traceContext->traceBuffer, traceContext->traceId,
+      span->spanId, traceContext->spanId, name, detail, span->startNs,
+      traceNowNanoseconds());
+  }
+}
+
+/// @fn void traceSpanGetTraceparent(const TraceSpan *span, char *buffer)
+///
+/// @brief Format the traceparent header value that passes a span on to
+/// another server so that the server's spans become its children.
+///
+/// @param span The TraceSpan to pass on.
+/// @param buffer A buffer of at least TRACEPARENT_LENGTH bytes to format the
+///   value into.
+///
+/// @return This function returns no value.
+void traceSpanGetTraceparent(const TraceSpan *span, char *buffer) {
+  char *charAt = buffer + sprintf(buffer, "00-");
+  for (int i = 0; i < 16; i++) {
+    charAt += sprintf(charAt, "%02x", span->traceContext->traceId[i]);
+  }
+  sprintf(charAt, "-%016llx-01", llu(span->spanId));
+}
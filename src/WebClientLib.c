@@ -36,6 +36,7 @@
 #endif
 
 #include "Scope.h"
+#include "TraceLib.h"
 #include "Vector.h"
 
 #ifdef LOGGING_ENABLED
@@ -811,7 +812,7 @@ void initRedirects(void) {
   _redirects = rbTreeCreate(typeBytes);
 }
 
-/// @fn Bytes wcSendRequest(const char *method, const char *remoteHostAddress, const char *location, int timeoutMilliseconds, Bytes request)
+/// @fn Bytes wcSendHttpRequest(const char *method, const char *remoteHostAddress, const char *location, int timeoutMilliseconds, Bytes request, const char *traceparent)
 ///
 /// @brief Send a request from this web client to a remote server at the
 /// specified address and, port, and location via the specified HTTP method.
@@ -824,10 +825,13 @@ void initRedirects(void) {
 ///   out on a send or receive.
 /// @param request The full set of headers and body to send, minus the first
 /// HTTP command line.
+/// @param traceparent The value of the traceparent header to send, or NULL if
+///   the request isn't being traced.
 ///
 /// @return Returns the body of the response on success, NULL on failure.
-Bytes wcSendRequest(const char *method, const char *remoteHostAddress,
-  const char *location, int timeoutMilliseconds, Bytes request
+Bytes wcSendHttpRequest(const char *method, const char *remoteHostAddress,
+  const char *location, int timeoutMilliseconds, Bytes request,
+  const char *traceparent
 ) {
   SCOPE_ENTER("method=%s, remoteHostAddress=%s, location=%s, "
     "timeoutMilliseconds=%d, request=%p", strOrNull(method),
@@ -889,6 +893,11 @@ Bytes wcSendRequest(const char *method, const char *remoteHostAddress,
     bytesAddStr(&fullRequest, "Host: ");
     bytesAddStr(&fullRequest, remoteHostAddressToUse);
     bytesAddStr(&fullRequest, "\r\n");
+    if (traceparent != NULL) {
+      bytesAddStr(&fullRequest, "traceparent: ");
+      bytesAddStr(&fullRequest, traceparent);
+      bytesAddStr(&fullRequest, "\r\n");
+    }
     if (bytesLength(request) > 0) {
       // This is the expected case.
       bytesAddBytes(&fullRequest, request);
@@ -1179,3 +1188,45 @@ Bytes wcSendRequest(const char *method, const char *remoteHostAddress,
   return response;
 }
 
+/// @fn Bytes wcSendRequest(const char *method, const char *remoteHostAddress, const char *location, int timeoutMilliseconds, Bytes request)
+///
+/// @brief Send a request from this web client to a remote server at the
+/// specified address and, port, and location via the specified HTTP method.
+/// If the calling thread is working on a traced request, the call is recorded
+/// as a span of it and the span is passed on to the remote server in a
+/// traceparent header.
+///
+/// @param *method The HTTP method to use for the request.
+/// @param remoteHostAddress The URL of the protocol, address or host name,
+///   and port to connect to.
+/// @param location The path to get at the remote host.
+/// @param timeoutMilliseconds The number of milliseconds to wait before timing
+///   out on a send or receive.
+/// @param request The full set of headers and body to send, minus the first
+/// HTTP command line.
+///
+/// @return Returns the body of the response on success, NULL on failure.
+Bytes wcSendRequest(const char *method, const char *remoteHostAddress,
+  const char *location, int timeoutMilliseconds, Bytes request
+) {
+  TraceContext *traceContext = traceCurrentContext;
+  if (traceContext == NULL) {
+    // This is the expected case.
+    return wcSendHttpRequest(method, remoteHostAddress, location,
+      timeoutMilliseconds, request, NULL);
+  }
+  
+  TraceSpan span;
+  traceSpanStart(&span, traceContext);
+  char traceparent[TRACEPARENT_LENGTH];
+  traceSpanGetTraceparent(&span, traceparent);
+  Bytes response = wcSendHttpRequest(method, remoteHostAddress, location,
+    timeoutMilliseconds, request, traceparent);
+  char detail[TRACE_DETAIL_LENGTH];
+  snprintf(detail, sizeof(detail), "%s %s%s", strOrNull(method),
+    strOrNull(remoteHostAddress), strOrNull(location));
+  traceSpanEnd(&span, "web_client", detail);
+  
+  return response;
+}
+
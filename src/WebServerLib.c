@@ -33,6 +33,392 @@
 #include "LoggingLib.h"
 #include "HashTable.h"
 #include "OsApi.h"
+#include "CAtomic.h"
+#include "miniz.h"
+#include <limits.h>
+#include <openssl/rand.h>
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif // _WIN32
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sched.h>
+#include <pthread.h>
+#include "Coroutines.h"
+#endif // __linux__
+
+const char *WsServerModeNames[NUM_WS_SERVER_MODES] = {
+  "WS_THREADED",
+  "WS_EVENT_LOOP",
+  "WS_COROUTINES"
+};
+
+const char *WsOverloadPolicyNames[NUM_WS_OVERLOAD_POLICIES] = {
+  "WS_OVERLOAD_REJECT",
+  "WS_OVERLOAD_STOP_ACCEPTING"
+};
+
+/// @def WS_REQUEST_TIMEOUT_SECONDS
+///
+/// @brief The number of seconds a client has to deliver the header of a request.
+/// This is also the longest a client may go without sending any data while
+/// delivering the body of a request.
+#define WS_REQUEST_TIMEOUT_SECONDS 3
+
+/// @def WS_FORCE_CLOSE_GRACE_SECONDS
+///
+/// @brief The number of seconds a server's threads are given to exit after the
+/// connections that were still open at the end of a drain are forced closed.
+#define WS_FORCE_CLOSE_GRACE_SECONDS 2
+
+/// @struct WsBodyReader
+///
+/// @brief The body of the request being processed and the position of the
+/// next byte to return from wsBodyReaderRead.
+///
+/// @param data A pointer to the body.  It's always followed by a NUL byte.
+/// @param length The number of bytes at data.
+/// @param offset The offset of the next byte to return from wsBodyReaderRead.
+/// @param spool The buffer a body that can't be left in the receive buffer is
+///   assembled in while it's small enough to be held in memory.
+/// @param file The unlinked temporary file a large body is spooled to, if
+///   any.
+/// @param mapping The memory mapping of file once the body is complete.
+/// @param mappingLength The length of mapping in bytes.
+struct WsBodyReader {
+  const unsigned char *data;
+  u64                  length;
+  u64                  offset;
+  Bytes                spool;
+  FILE                *file;
+  void                *mapping;
+  u64                  mappingLength;
+};
+
+/// @def WS_ARENA_CHUNK_BYTES
+///
+/// @brief The number of bytes in the chunks a WsArena hands out memory from.
+/// An allocation larger than this gets a chunk of its own.
+#define WS_ARENA_CHUNK_BYTES 8192
+
+/// @def WS_ARENA_MAX_FREE_CHUNKS
+///
+/// @brief The number of released chunks each thread keeps for the next request
+/// to use.  Chunks released beyond this are freed.
+#define WS_ARENA_MAX_FREE_CHUNKS 16
+
+/// @struct WsArenaChunk
+///
+/// @brief A block of memory that a WsArena hands out pieces of.  The memory
+/// follows the structure, starting at WS_ARENA_CHUNK_HEADER_BYTES.
+///
+/// @param next The next chunk in the arena or in the free list of the thread.
+/// @param size The number of bytes of memory in the chunk.
+/// @param used The number of bytes of the memory that have been handed out.
+typedef struct WsArenaChunk {
+  struct WsArenaChunk *next;
+  size_t               size;
+  size_t               used;
+} WsArenaChunk;
+
+/// @def WS_ARENA_CHUNK_HEADER_BYTES
+///
+/// @brief The offset of the memory of a WsArenaChunk from the start of the
+/// chunk.  This keeps the memory aligned for any type.
+#define WS_ARENA_CHUNK_HEADER_BYTES \
+  ((sizeof(WsArenaChunk) + 15) & ~((size_t) 15))
+  
+/// @struct WsArena
+///
+/// @brief Memory that lives exactly as long as one request.  Allocations are
+/// carved out of chunks by bumping an offset and are never freed
+/// individually.  Resetting the arena releases everything at once and puts
+/// the chunks on a free list that belongs to the thread, so a steady stream of
+/// requests doesn't call malloc at all.
+///
+/// @param chunks The chunks of the arena.  The first one is the one that new
+///   allocations are made from.
+/// @param lastChunk The chunk that the most recent allocation was made from.
+/// @param lastString The string built by the most recent allocation, which can
+///   be grown in place.  NULL if the most recent allocation wasn't made for a
+///   string.
+/// @param lastStringLength The length of lastString, not counting its
+///   terminating NUL.
+struct WsArena {
+  WsArenaChunk *chunks;
+  WsArenaChunk *lastChunk;
+  char         *lastString;
+  size_t        lastStringLength;
+};
+
+/// @enum WsMetricsPhase
+///
+/// @brief The phases of a request that are timed separately.
+///
+/// @param WS_PHASE_HEADER_RECEIVE From the first byte of the request to the
+///   end of its header.
+/// @param WS_PHASE_BODY_RECEIVE From the end of the header to the end of the
+///   body.  Only timed for requests that have a body.
+/// @param WS_PHASE_DESERIALIZE Parsing the body into a WsRequestObject.
+/// @param WS_PHASE_CALL The call to the WsFunction.  This includes sending a
+///   streamed response.
+/// @param WS_PHASE_SERIALIZE Serializing the returned WsResponseObject.
+/// @param WS_PHASE_SEND Sending the response.
+typedef enum WsMetricsPhase {
+  WS_PHASE_HEADER_RECEIVE,
+  WS_PHASE_BODY_RECEIVE,
+  WS_PHASE_DESERIALIZE,
+  WS_PHASE_CALL,
+  WS_PHASE_SERIALIZE,
+  WS_PHASE_SEND,
+  NUM_WS_METRICS_PHASES
+} WsMetricsPhase;
+
+/// @var WsMetricsPhaseNames
+///
+/// @brief The values of the phase label for each WsMetricsPhase.
+static const char *WsMetricsPhaseNames[NUM_WS_METRICS_PHASES] = {
+  "header_receive",
+  "body_receive",
+  "deserialize",
+  "call",
+  "serialize",
+  "send"
+};
+
+/// @def WS_METRICS_SUB_BUCKETS
+///
+/// @brief The number of buckets each power of two of microseconds is divided
+/// into in a WsHistogram.  Four keeps the error of any bucket under 25%.
+/// wsHistogramBucket depends on this value.
+#define WS_METRICS_SUB_BUCKETS 4
+
+/// @def WS_METRICS_NUM_BUCKETS
+///
+/// @brief The number of buckets in a WsHistogram.  This covers durations of
+/// up to 2^32 microseconds (a little over an hour).  Anything longer is
+/// counted in the last bucket.
+#define WS_METRICS_NUM_BUCKETS (WS_METRICS_SUB_BUCKETS * 31)
+
+/// @def WS_METRICS_MAX_STATUS_CODE
+///
+/// @brief The largest HTTP status code that's counted separately.
+#define WS_METRICS_MAX_STATUS_CODE 599
+
+/// @struct WsHistogram
+///
+/// @brief A log-linear histogram of durations in microseconds.  Each power of
+/// two is split into WS_METRICS_SUB_BUCKETS equal buckets, so recording a
+/// value is a couple of shifts and two atomic increments.
+///
+/// @param buckets The number of values recorded in each bucket.
+/// @param sumUs The sum of all the values recorded, in microseconds.
+typedef struct WsHistogram {
+  _Atomic(u64) buckets[WS_METRICS_NUM_BUCKETS];
+  _Atomic(u64) sumUs;
+} WsHistogram;
+
+/// @struct WsRouteMetrics
+///
+/// @brief The timings of the requests for one web service function.
+///
+/// @param phases A WsHistogram for each WsMetricsPhase.
+typedef struct WsRouteMetrics {
+  WsHistogram phases[NUM_WS_METRICS_PHASES];
+} WsRouteMetrics;
+
+/// @struct WsMetrics
+///
+/// @brief The counters of a WebServer.  They're only ever updated with
+/// relaxed atomic increments, so recording never takes a lock.
+///
+/// @param activeConnections The number of client connections currently open.
+/// @param bytesIn The number of bytes of requests received.
+/// @param bytesOut The number of bytes of responses sent.
+/// @param statusCounts The number of responses sent with each status code.
+///   Codes above WS_METRICS_MAX_STATUS_CODE are counted as zero.
+/// @param other The timings of requests that weren't for a web service
+///   function (static files and unknown functions).
+/// @param tlsSessions The counts of the TLS handshakes completed on the
+///   server's connections and of how many of them resumed a session.
+struct WsMetrics {
+  _Atomic(u64)       activeConnections;
+  _Atomic(u64)       bytesIn;
+  _Atomic(u64)       bytesOut;
+  _Atomic(u64)       statusCounts[WS_METRICS_MAX_STATUS_CODE + 1];
+  WsRouteMetrics     other;
+#ifdef TLS_SOCKETS_ENABLED
+  TlsSessionCounters tlsSessions;
+#endif // TLS_SOCKETS_ENABLED
+};
+
+/// @def WS_CLIENT_TABLE_NUM_SHARDS
+///
+/// @brief The number of independently-locked shards a WsClientTable is split
+/// into.  Must be a power of two.
+#define WS_CLIENT_TABLE_NUM_SHARDS 16
+
+/// @def WS_CLIENT_SHARD_NUM_CHAINS
+///
+/// @brief The number of hash chains in each shard of a WsClientTable.  Must be
+/// a power of two.
+#define WS_CLIENT_SHARD_NUM_CHAINS 256
+
+/// @def WS_CLIENT_EXPIRY_SECONDS
+///
+/// @brief The shortest time a client with no open connections is remembered.
+/// It's extended if a rate limit's bucket would take longer to refill.
+#define WS_CLIENT_EXPIRY_SECONDS 60
+
+/// @def WS_CLIENT_MAX_ADDRESS_LENGTH
+///
+/// @brief The size of the buffer that holds a client's address, including its
+/// NUL terminator.
+#define WS_CLIENT_MAX_ADDRESS_LENGTH 64
+
+/// @struct WsTokenBucket
+///
+/// @brief The state of one client's bucket for one WsRateLimit.
+///
+/// @param tokens The number of requests the client may make right now.
+/// @param lastRefillUs The time, in microseconds, tokens was last brought up
+///   to date.
+typedef struct WsTokenBucket {
+  double tokens;
+  u64    lastRefillUs;
+} WsTokenBucket;
+
+/// @struct WsClient
+///
+/// @brief The connections and request rates of one client address.
+///
+/// @param next The next WsClient in the same hash chain.
+/// @param hash The hash of address.
+/// @param numConnections The number of connections the client has open.
+/// @param lastSeenUs The time, in microseconds, the client last connected,
+///   disconnected, or made a request.
+/// @param tokenBuckets The client's WsTokenBucket for each rate limit.  Part
+///   of the same allocation as the WsClient.
+/// @param address The client's address without its port.
+typedef struct WsClient {
+  struct WsClient *next;
+  u32              hash;
+  int              numConnections;
+  u64              lastSeenUs;
+  WsTokenBucket   *tokenBuckets;
+  char             address[WS_CLIENT_MAX_ADDRESS_LENGTH];
+} WsClient;
+
+/// @struct WsClientShard
+///
+/// @brief One independently-locked part of a WsClientTable.
+///
+/// @param lock The mutex that protects the rest of the structure and the
+///   WsClients in it.
+/// @param chains The hash chains of WsClients.
+/// @param lastSweepUs The time, in microseconds, expired clients were last
+///   removed from the shard.
+typedef struct WsClientShard {
+  mtx_t     lock;
+  WsClient *chains[WS_CLIENT_SHARD_NUM_CHAINS];
+  u64       lastSweepUs;
+} WsClientShard;
+
+/// @struct WsRateLimitRule
+///
+/// @brief A WsRateLimit that's been copied into a WsClientTable.
+///
+/// @param namespaceName The namespace the rule applies to.
+/// @param namespaceLength The length of namespaceName.
+/// @param tokensPerUs The number of tokens a bucket gains per microsecond.
+/// @param burst The number of tokens a bucket can hold.
+typedef struct WsRateLimitRule {
+  char   *namespaceName;
+  size_t  namespaceLength;
+  double  tokensPerUs;
+  double  burst;
+} WsRateLimitRule;
+
+/// @struct WsClientTable
+///
+/// @brief The per-client admission limits of a server and the state needed to
+/// enforce them.  Clients are spread across shards by the hash of their
+/// address so that connections from different clients rarely contend for the
+/// same lock.
+///
+/// @param maxConnectionsPerClient The number of connections one client may
+///   have open.  Zero if there is no limit.
+/// @param rules The array of numRules WsRateLimitRules.
+/// @param numRules The number of elements in rules.
+/// @param defaultRule The index of the rule for requests that aren't for a
+///   namespace with its own rule, or -1 if there isn't one.
+/// @param expiryUs The number of microseconds after which a client with no
+///   open connections is forgotten.
+/// @param shards The WsClientShards of the table.
+struct WsClientTable {
+  int              maxConnectionsPerClient;
+  WsRateLimitRule *rules;
+  int              numRules;
+  int              defaultRule;
+  u64              expiryUs;
+  WsClientShard    shards[WS_CLIENT_TABLE_NUM_SHARDS];
+};
+
+/// @struct WsPendingResponse
+///
+/// @brief A response that a web service function deferred with
+/// wsResponseDefer.  The request waits for it until the function's code
+/// completes it from whatever thread it likes with wsResponseComplete or the
+/// server gives up on it.  It's freed once everyone holding it is done with
+/// it.
+///
+/// @param lock The mutex that protects the rest of the structure.
+/// @param finishedCondition The condition that's signalled when the response
+///   is finished.  Only used when the request is waiting on a thread.
+/// @param referenceCount The number of holders of the structure:  The request,
+///   the function's code until it calls wsResponseComplete, and any scheduler
+///   that's been told to resume the request.
+/// @param finished Whether or not the response has been completed or given up
+///   on.
+/// @param cancelled Whether or not the server gave up on the response because
+///   it timed out or the connection was forced closed.
+/// @param responseObject The WsResponseObject the response was completed
+///   with, if any.  Owned by the structure until the request takes it.
+/// @param responseObjectDestroy The function to destroy responseObject with if
+///   the request never takes it.
+/// @param deadline The absolute deadline in milliseconds on the monotonic
+///   clock of wsNowMicroseconds at which the request stops waiting, or -1 if
+///   it waits indefinitely.
+/// @param waitContext The WsCoroutineConnection whose coroutine is parked on
+///   the response, or NULL if the request isn't waiting in a coroutine.
+/// @param nextReady The next WsPendingResponse in the list of finished
+///   responses whose coroutines a scheduler is to resume.
+struct WsPendingResponse {
+  mtx_t                     lock;
+  cnd_t                     finishedCondition;
+  int                       referenceCount;
+  bool                      finished;
+  bool                      cancelled;
+  WsResponseObject         *responseObject;
+  WsResponseObjectDestroy   responseObjectDestroy;
+  i64                       deadline;
+  void                     *waitContext;
+  struct WsPendingResponse *nextReady;
+};
+
+// Forward declaration so that WsThreadInfo can refer to the list it's in.
+typedef struct WsConnections WsConnections;
+// Forward declaration so that WsThreadInfo can refer to the response cache of
+// the function it's calling.
+typedef struct WsResponseCache WsResponseCache;
+// Forward declarations so that WsThreadInfo can refer to the batch and the
+// call of a batch it's making.
+typedef struct WsBatch WsBatch;
+typedef struct WsBatchCall WsBatchCall;
 
 /// @struct WsThreadInfo
 ///
@@ -43,45 +429,193 @@
 /// @param interfacePath The path to the root of the static content.
 /// @param serverName The name of the web server as defined in the WebServer
 ///   object.
-/// @param numRunningConnectionThreads A pointer to the number of currently
-///   running connection threads for this server.
-/// @param numRunningConnectionThreadsMutex A mutex to protect access to
-///   numRunningConnectionThreads.
+/// @param connections The WsConnections of the server that accepted the
+///   connection.  The connection is in its list until it's destroyed.
+/// @param prevConnection The previous connection in connections' list.
+/// @param nextConnection The next connection in connections' list.
+/// @param clientTable The WsClientTable of the server that accepted the
+///   connection.  NULL if the server has no per-client limits.
+/// @param client The WsClient of the connection's source address in
+///   clientTable.  NULL if the client isn't being tracked.
 /// @param webService A copy of the WebService provided to wsCreate (if any).
 ///   Note that this is a complete copy instead of a copy of the pointer because
 ///   the expectation is that all memebers of the WebService will be needed.
 ///   Having the pointer here would force two levels of indirection any time one
 ///   of the members is needed instead of just one.
-/// @param webServiceFunctions A HashTable of HashTables of web service
-///   functions created from webService.functionDescriptors when wsInit is
-///   called.
+/// @param routeTable The WsRouteTable of web service functions compiled from
+///   webService.namespaces when wsInit is called.
 /// @param redirectProtocol The protocol that should be redirected to from this
 ///   connection (if any).
 /// @param redirectPort The port that should be redirected to from this
 ///   connection (if any).
 /// @param redirectFunction The RedirectFunction that should be used to
 ///   dynamically redirect from this connection (if any).
-/// @param httpParams A Dictionary of the HTTP parameters parsed from the header
-///   received.
+/// @param httpRequest The WsHttpRequest the header of the current request is
+///   parsed into.
 /// @param cookiesDict A Dictionary of the parsed and adjusted cookies from the
 ///   HTTP header (if any).
 /// @param body A pointer to the body of the request received.
+/// @param bodyReader The WsBodyReader that holds the body of the request.
+/// @param requestLength The number of bytes at the front of the receive buffer
+///   that belong to the current request.  A body that was moved out of the
+///   receive buffer is not included.
+/// @param keepAlive Whether or not the connection should be kept open for
+///   another request once the current one has been answered.
+/// @param responseStarted Whether or not the header of a response has been
+///   sent for the current request.
+/// @param responseSent Whether or not a complete response has been sent for
+///   the current request.
+/// @param numRequests The number of requests that have been processed on this
+///   connection so far.
+/// @param keepAliveTimeoutSeconds The number of seconds the connection may sit
+///   idle between requests.
+/// @param maxRequestsPerConnection The number of requests that may be
+///   processed on this connection before it's closed.
+/// @param exitNow A pointer to the exitNow flag of the server that accepted
+///   the connection.
+/// @param fileCache The WsFileCache of the server that accepted the connection.
+///   NULL if file caching is disabled.
+/// @param compressionLevel The deflate compression level to use for responses.
+///   Zero if compression is disabled.
+/// @param compressionMinBytes The size below which response bodies are sent
+///   uncompressed.
+/// @param maxRequestBodyBytes The largest request body that will be accepted.
+///   Zero if there is no limit.
+/// @param requestBodyMemoryBytes The size above which request bodies are
+///   spooled to a temporary file.  Zero if bodies are always held in memory.
+/// @param arena The WsArena that memory for the current request is allocated
+///   from.  It's reset when the request is complete.
+/// @param metrics The WsMetrics of the server that accepted the connection.
+/// @param metricsPath The path the server's metrics are served on.  NULL if
+///   the metrics endpoint is disabled.
+/// @param routeMetrics The WsRouteMetrics of the function the current request
+///   called.  NULL if it didn't call one.
+/// @param phaseStart The time the part of the current request that's being
+///   received started to arrive.  Zero until the first byte of the request
+///   arrives.
+/// @param phaseUs The number of microseconds the current request spent in
+///   each WsMetricsPhase.
+/// @param phasesTimed A bit for each WsMetricsPhase the current request went
+///   through.
+/// @param responseCache The WsResponseCache that the response to the current
+///   request is to be added to.  NULL if the response isn't to be cached.
+/// @param responseCacheKey The key to add the response to responseCache
+///   under.  Allocated from arena.
+/// @param responseCacheGeneration The generation of responseCache when the
+///   function was called.
+/// @param pendingResponse The WsPendingResponse the current request is waiting
+///   on, if any.  Only changed with the lock of connections held so that
+///   wsConnectionsShutdown can cancel it.
+/// @param batchPath The path batches of web service calls are POSTed to.
+///   NULL if the batch endpoint is disabled.
+/// @param maxBatchCalls The number of calls one batch may contain.  Zero if
+///   there is no limit.
+/// @param batchWorkerPool The WsWorkerPool to spread the calls of a batch
+///   across.  NULL if they're made one after another.
+/// @param batchCall The WsBatchCall being made if the current request is a
+///   batch, NULL otherwise.
+/// @param batch The WsBatch the connection is making the calls of, if any.
+///   Only changed with the lock of connections held so that
+///   wsConnectionsShutdown can cancel the responses its calls deferred.
+/// @param traceBuffer The TraceBuffer of the server that accepted the
+///   connection.  NULL if tracing is disabled.
+/// @param traceSampleRate One in this many requests without a sampled
+///   traceparent header is traced.
+/// @param traceContext The TraceContext of the current request.  Its
+///   traceBuffer is NULL if the request isn't being traced.
+/// @param statusCode The HTTP status code of the response to the current
+///   request.  Zero until a response is started.
+/// @param queuedNs The monotonic time, in nanoseconds, the connection was
+///   queued to be processed.  Zero if it wasn't queued.
+/// @param dequeuedNs The monotonic time, in nanoseconds, processing of the
+///   queued connection started.
+/// @param tracePhaseStartNs The monotonic time, in nanoseconds, each
+///   WsMetricsPhase of the current request first started.  Only kept when
+///   traceBuffer is set.
+/// @param tracePhaseEndNs The monotonic time, in nanoseconds, each
+///   WsMetricsPhase of the current request last ended.
+/// @param accessLog The AccessLog of the server that accepted the connection.
+///   NULL if the access log is disabled.
+/// @param bytesOut The number of bytes of the response to the current request
+///   that have been sent.
 typedef struct WsThreadInfo {
   Socket              *clientSocket;
   const char          *interfacePath;
   const char          *serverName;
-  int                 *numRunningConnectionThreads;
-  mtx_t               *numRunningConnectionThreadsMutex;
+  WsConnections       *connections;
+  struct WsThreadInfo *prevConnection;
+  struct WsThreadInfo *nextConnection;
+  WsClientTable       *clientTable;
+  WsClient            *client;
   WebService           webService;
-  HashTable           *webServiceFunctions;
+  const WsRouteTable  *routeTable;
   char                *redirectProtocol;
   int                  redirectPort;
   RedirectFunction     redirectFunction;
-  Dictionary          *httpParams;
+  WsHttpRequest        httpRequest;
   Dictionary          *cookiesDict;
   const unsigned char *body;
+  WsBodyReader         bodyReader;
+  u64                  requestLength;
+  bool                 keepAlive;
+  bool                 responseStarted;
+  bool                 responseSent;
+  int                  numRequests;
+  int                  keepAliveTimeoutSeconds;
+  int                  maxRequestsPerConnection;
+  volatile bool       *exitNow;
+  WsFileCache         *fileCache;
+  int                  compressionLevel;
+  int                  compressionMinBytes;
+  i64                  maxRequestBodyBytes;
+  i64                  requestBodyMemoryBytes;
+  WsArena              arena;
+  WsMetrics           *metrics;
+  const char          *metricsPath;
+  WsRouteMetrics      *routeMetrics;
+  struct timespec      phaseStart;
+  u64                  phaseUs[NUM_WS_METRICS_PHASES];
+  u32                  phasesTimed;
+  WsResponseCache     *responseCache;
+  char                *responseCacheKey;
+  u64                  responseCacheGeneration;
+  WsPendingResponse   *pendingResponse;
+  const char          *batchPath;
+  int                  maxBatchCalls;
+  WsWorkerPool        *batchWorkerPool;
+  WsBatchCall         *batchCall;
+  WsBatch             *batch;
+  TraceBuffer         *traceBuffer;
+  int                  traceSampleRate;
+  TraceContext         traceContext;
+  int                  statusCode;
+  u64                  queuedNs;
+  u64                  dequeuedNs;
+  u64                  tracePhaseStartNs[NUM_WS_METRICS_PHASES];
+  u64                  tracePhaseEndNs[NUM_WS_METRICS_PHASES];
+  AccessLog           *accessLog;
+  u64                  bytesOut;
 } WsThreadInfo;
 
+/// @struct WsConnections
+///
+/// @brief The client connections a server has open.  A connection is in the
+/// list from the time it's accepted until its WsThreadInfo is destroyed so
+/// that the ones that are still open when a drain runs out of time can be
+/// forced closed.
+///
+/// @param lock The mutex that protects the rest of the structure.
+/// @param head The most-recently-accepted connection.
+/// @param numConnections The number of connections in the list.
+/// @param shutDown Whether or not wsConnectionsShutdown has been called.
+///   Responses deferred after that are cancelled right away.
+struct WsConnections {
+  mtx_t         lock;
+  WsThreadInfo *head;
+  int           numConnections;
+  bool          shutDown;
+};
+
 /// @fn int wsMsleep(int milliseconds)
 ///
 /// @brief Sleep for the specified number of milliseconds.
@@ -102,1571 +636,10406 @@ int wsMsleep(int milliseconds) {
   return returnValue;
 }
 
-/// @fn Bytes getServerDateHeader()
+/// @fn void wsFormatHttpDate(i64 seconds, char *buffer, size_t bufferSize)
 ///
-/// @brief Generate a proper Date header for an HTTP response.
+/// @brief Format a time as an HTTP date (e.g. "Sun, 06 Nov 1994 08:49:37 GMT").
 ///
-/// @return Returns a newly-allocated Bytes object with the header on success,
-/// NULL on failure (malloc failure).
-Bytes getServerDateHeader() {
-  printLog(TRACE, "ENTER getServerDateHeader()");
-  
-  tzset();
-  time_t now = time(NULL);
-  ZEROINIT(struct tm nowTm);
-  gmtime_r(&now, &nowTm);
-
-  const char *dateWeekdays[] = {
-    "Sun",
-    "Mon",
-    "Tue",
-    "Wed",
-    "Thu",
-    "Fri",
-    "Sat"
+/// @param seconds The number of seconds since the epoch.
+/// @param buffer The buffer to write the date into.
+/// @param bufferSize The size of buffer in bytes.  30 bytes is enough.
+void wsFormatHttpDate(i64 seconds, char *buffer, size_t bufferSize) {
+  static const char *weekdays[] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
   };
-  const char *dateMonths[] = {
-    "Jan",
-    "Feb",
-    "Mar",
-    "Apr",
-    "May",
-    "Jun",
-    "Jul",
-    "Aug",
-    "Sep",
-    "Oct",
-    "Nov",
-    "Dec"
+  static const char *months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
   };
-  Bytes dateHeader = NULL;
-  abprintf(&dateHeader, "%s, %d %s %d %d:%d:%d GMT\r\n",
-    dateWeekdays[nowTm.tm_wday],
-    nowTm.tm_mday,
-    dateMonths[nowTm.tm_mon],
-    nowTm.tm_year + 1900,
-    nowTm.tm_hour,
-    nowTm.tm_min,
-    nowTm.tm_sec);
-
-  printLog(TRACE, "EXIT getServerDateHeader() = {%s}", str(dateHeader));
-  return dateHeader;
+  
+  time_t timeValue = (time_t) seconds;
+  ZEROINIT(struct tm timeTm);
+  gmtime_r(&timeValue, &timeTm);
+  snprintf(buffer, bufferSize, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+    weekdays[timeTm.tm_wday], timeTm.tm_mday, months[timeTm.tm_mon],
+    timeTm.tm_year + 1900, timeTm.tm_hour, timeTm.tm_min, timeTm.tm_sec);
 }
 
-/// @fn bool redirectClient(WsThreadInfo *wsThreadInfo)
+/// @def WS_THREAD_LOCAL
 ///
-/// @brief Use the information in the wsThreadInfo to determine if we should
-/// redirect the user to a page by the same name on a different port or
-/// protocol.
+/// @brief Storage class for variables that each thread gets its own copy of.
+#ifdef __cplusplus
+#define WS_THREAD_LOCAL thread_local
+#else
+#define WS_THREAD_LOCAL _Thread_local
+#endif // __cplusplus
+
+/// @fn const char* getServerDate(void)
 ///
-/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @brief Get the current time formatted for the Date header of an HTTP
+/// response.  The formatted value only changes once a second, so each thread
+/// keeps the last value it formatted and reuses it until the clock moves on.
 ///
-/// @return Returns true if the user was redirected, false if not.
-bool redirectClient(WsThreadInfo *wsThreadInfo) {
-  printLog(TRACE, "ENTER redirectClient(wsThreadInfo=%p)\n", wsThreadInfo);
+/// @return Returns a pointer to the formatted date.  The pointer is only valid
+/// in the calling thread and only until its next call to this function.
+const char* getServerDate(void) {
+  static WS_THREAD_LOCAL i64 cachedSeconds = -1;
+  static WS_THREAD_LOCAL char cachedDate[32];
   
-  char *redirectProtocol = wsThreadInfo->redirectProtocol;
-  int redirectPort = wsThreadInfo->redirectPort;
-  RedirectFunction redirectFunction = wsThreadInfo->redirectFunction;
-  if ((redirectProtocol == NULL) && (redirectPort == 0)
-    && (redirectFunction == NULL)
-  ) {
-    // We're not supposed to be redirecting traffic on this protocol and port
-    // elsewhere.
-    printLog(TRACE,
-      "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "false");
-    return false;
+  i64 now = (i64) time(NULL);
+  if (now != cachedSeconds) {
+    wsFormatHttpDate(now, cachedDate, sizeof(cachedDate));
+    cachedSeconds = now;
   }
   
-  // redirectFunction takes precedence over the other data.
-  if (redirectFunction != NULL) {
-    Dictionary *response = redirectFunction(wsThreadInfo->clientSocket,
-      wsThreadInfo->interfacePath, wsThreadInfo->httpParams, wsThreadInfo->body,
-      wsThreadInfo->cookiesDict);
-    char *redirectUrl = (char*) dictionaryGetValue(response, "redirectUrl");
-    if (redirectUrl == NULL) {
-      printLog(DEBUG, "Supplied redirection function did not provide a "
-        "redirectUrl return parameter.");
-      response = dictionaryDestroy(response);
-      printLog(TRACE,
-        "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "false");
-      return false;
-    }
-    
-    Bytes location = NULL;
-    abprintf(&location, "Location: %s\n\n", redirectUrl);
-    
-    if (location != NULL) {
-      Bytes sendbuf = NULL;
-      bytesAddStr(&sendbuf, "HTTP/1.1 301 Moved Permanently\n");
-      bytesAddBytes(&sendbuf, location);
-      
-      Socket *clientSocket = wsThreadInfo->clientSocket;
-      socketSend(clientSocket, sendbuf, bytesLength(sendbuf));
-      sendbuf = bytesDestroy(sendbuf);
-    }
-    location = bytesDestroy(location);
-    
-    response = dictionaryDestroy(response);
-    return true;
+  return cachedDate;
+}
+
+/// @def WS_ARENA_CHUNK_DATA
+///
+/// @brief Get a pointer to the memory of a WsArenaChunk.
+#define WS_ARENA_CHUNK_DATA(chunk) \
+  (((char*) (chunk)) + WS_ARENA_CHUNK_HEADER_BYTES)
+  
+/// @var _wsArenaFreeChunks
+///
+/// @brief Chunks released by the arenas of requests this thread has processed.
+/// They're handed to the next arena that needs a chunk on this thread.
+static WS_THREAD_LOCAL WsArenaChunk *_wsArenaFreeChunks = NULL;
+
+/// @var _wsArenaNumFreeChunks
+///
+/// @brief The number of chunks in _wsArenaFreeChunks.
+static WS_THREAD_LOCAL int _wsArenaNumFreeChunks = 0;
+
+/// @fn WsArena* wsArenaCreate(void)
+///
+/// @brief Create a WsArena that isn't tied to a request.  Web service functions
+/// should use the arena of the request in their WsConnectionInfo instead.
+///
+/// @return Returns a new, empty WsArena on success, NULL on failure.
+WsArena* wsArenaCreate(void) {
+  WsArena *arena = (WsArena*) calloc(1, sizeof(WsArena));
+  if (arena == NULL) {
+    LOG_MALLOC_FAILURE();
   }
   
-  Dictionary *parameters = wsThreadInfo->httpParams;
-  Bytes headerHost = NULL;
-  bytesAddBytes(&headerHost, (Bytes) dictionaryGetValue(parameters, "Host"));
-  if (headerHost == NULL) {
-    // There's no Host in the header.  We can't proceed.
-    printLog(TRACE,
-      "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "false");
-    return false;
+  return arena;
+}
+
+/// @fn WsArena* wsArenaDestroy(WsArena *arena)
+///
+/// @brief Release all of the memory of a WsArena from wsArenaCreate along with
+/// the arena itself.
+///
+/// @param arena The WsArena to destroy.
+///
+/// @return This function always returns NULL.
+WsArena* wsArenaDestroy(WsArena *arena) {
+  if (arena == NULL) {
+    return NULL;
   }
   
-  if (redirectPort != 0) {
-    // We're going to change the port.
-    // We don't want the part of the host header after the colon.
-    // Termiante the string there.
-    char *portAt = strchr((char*) headerHost, ':');
-    if (portAt != NULL) {
-      *portAt = '\0';
-    }
+  wsArenaReset(arena);
+  arena = (WsArena*) pointerDestroy(arena);
+  
+  return NULL;
+}
+
+/// @fn void wsArenaReset(WsArena *arena)
+///
+/// @brief Release all of the memory allocated from a WsArena in one operation.
+/// Chunks of the standard size are kept on the free list of the calling thread
+/// for the next request to use.
+///
+/// @param arena The WsArena to reset.
+///
+/// @return This function returns no value.
+void wsArenaReset(WsArena *arena) {
+  if (arena == NULL) {
+    return;
   }
   
-  // Construct the host to redirect to.
-  char *host = NULL;
-  if ((redirectProtocol == NULL) && (redirectPort != 0)) {
-    if (asprintf(&host, "%s:%d", (char*) headerHost, redirectPort) < 0) {
-      host = NULL;
-    }
-  } else if ((redirectProtocol != NULL) && (redirectPort == 0)) {
-    if (asprintf(&host, "%s://%s", redirectProtocol, (char*) headerHost) < 0) {
-      host = NULL;
-    }
-  } else { // redirectProtocol != NULL && redirectPort != 0
-    if (asprintf(&host, "%s://%s:%d", redirectProtocol, (char*) headerHost,
-      redirectPort) < 0
+  WsArenaChunk *chunk = arena->chunks;
+  while (chunk != NULL) {
+    WsArenaChunk *next = chunk->next;
+    if ((chunk->size == WS_ARENA_CHUNK_BYTES)
+      && (_wsArenaNumFreeChunks < WS_ARENA_MAX_FREE_CHUNKS)
     ) {
-      host = NULL;
+      chunk->next = _wsArenaFreeChunks;
+      _wsArenaFreeChunks = chunk;
+      _wsArenaNumFreeChunks++;
+    } else {
+      free(chunk);
     }
+    chunk = next;
   }
-  headerHost = bytesDestroy(headerHost);
-  
-  char *httpLocation = (char*) dictionaryGetValue(parameters, "_httpLocation");
-  if (httpLocation == NULL) {
-    printLog(ERR, "Request to redirect to NULL location.\n");
-    host = stringDestroy(host);
-    // We have to return true here because the EXPECTED behavior is for us to
-    // redirect, even though we don't have the ability to actually redirect.
-    printLog(TRACE,
-      "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "true");
-    return true;
-  }
-  Bytes location = NULL;
-  abprintf(&location, "Location: %s%s\n\n", host, httpLocation);
-  host = stringDestroy(host);
   
-  if (location != NULL) {
-    Bytes sendbuf = NULL;
-    bytesAddStr(&sendbuf, "HTTP/1.1 301 Moved Permanently\n");
-    bytesAddBytes(&sendbuf, location);
-    
-    Socket *clientSocket = wsThreadInfo->clientSocket;
-    socketSend(clientSocket, sendbuf, bytesLength(sendbuf));
-    sendbuf = bytesDestroy(sendbuf);
+  arena->chunks = NULL;
+  arena->lastChunk = NULL;
+  arena->lastString = NULL;
+  arena->lastStringLength = 0;
+}
+
+/// @fn void wsArenaReleaseThreadChunks(void)
+///
+/// @brief Free the chunks on the free list of the calling thread.  The threads
+/// of the server call this before they exit.
+///
+/// @return This function returns no value.
+void wsArenaReleaseThreadChunks(void) {
+  while (_wsArenaFreeChunks != NULL) {
+    WsArenaChunk *chunk = _wsArenaFreeChunks;
+    _wsArenaFreeChunks = chunk->next;
+    free(chunk);
   }
-  location = bytesDestroy(location);
-  
-  printLog(TRACE,
-    "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "true");
-  return true;
+  _wsArenaNumFreeChunks = 0;
 }
 
-/// @fn WsResponseObject* webServiceCall(WsThreadInfo *wsThreadInfo, const char *wsNamespace, const char *functionName, Dictionary *inputParams)
+/// @fn void* wsArenaAlloc(WsArena *arena, size_t size)
 ///
-/// Go through the provided web services and if there's a match with the
-/// provided wsNamespace and function name, call the function with the provided
-/// arguments.
+/// @brief Allocate memory that's released when the WsArena is reset.  The
+/// memory is aligned for any type but is not zeroed.
 ///
-/// @param wsThreadInfo A pointer to the WsThreadInfo
-///   structure provided to this thread.
-/// @param wsNamespace A string representing the wsNamespace of the web service.
-///   This corresponds to the key of the webServices list.
-/// @param functionName A string representing the name of the function.  This
-///   corresponds to the name in the FunctionDescriptors for the web service.
-/// @param inputParams A Dictionary of arguments parsed from the client's
-///   request.
+/// @param arena The WsArena to allocate from.
+/// @param size The number of bytes to allocate.
 ///
-/// @return Returns an allocated WsResponseObject if the wsNamespace and
-/// functionName match the name of a registered web serivce function, NULL
-/// otherwise.
-WsResponseObject* webServiceCall(WsThreadInfo *wsThreadInfo,
-  const char *wsNamespace, const char *functionName, Dictionary *inputParams
-) {
-  printLog(TRACE,
-    "ENTER webServiceCall(wsThreadInfo=%p, wsNamespace=\"%s\", "
-    "functionName=\"%s\", inputParams=%p)\n",
-    wsThreadInfo, wsNamespace, functionName, inputParams);
-  
-  if ((wsThreadInfo == NULL) || (wsNamespace == NULL)
-    || (functionName == NULL)
-  ) {
-    printLog(ERR, "One or more NULL parameters.  Cannot execute.\n");
-    printLog(TRACE,
-      "EXIT webServiceCall(wsThreadInfo=%p, wsNamespace=\"%s\", "
-      "functionName=\"%s\", inputParams=%p) = {NULL}\n",
-      wsThreadInfo, wsNamespace, functionName, inputParams);
+/// @return Returns a pointer to the memory on success, NULL on failure.
+void* wsArenaAlloc(WsArena *arena, size_t size) {
+  if (arena == NULL) {
     return NULL;
   }
   
-  // Return value.  Needs to be declared here.
-  WsResponseObject *outputParams = NULL;
-  
-  // Set the environment for the web service call.
-  if (wsThreadInfo->webService.requestObjectHandler != NULL) {
-    wsThreadInfo->webService.requestObjectHandler(inputParams);
+  WsArenaChunk *chunk = arena->chunks;
+  size_t offset = 0;
+  if (chunk != NULL) {
+    offset = (chunk->used + 15) & ~((size_t) 15);
   }
-  
-  if (wsThreadInfo->webServiceFunctions != NULL) {
-    // Find the right set of function descriptors.
-    HashTable *namespaceFunctions
-      = (HashTable*) htGetValue(
-        wsThreadInfo->webServiceFunctions, wsNamespace);
-    if (namespaceFunctions != NULL) {
-      // Find the right function.
-      WsFunction wsFunction
-        = (WsFunction) htGetValue(namespaceFunctions, functionName);
-      if (wsFunction != NULL) {
-        // Setup the parameters.
-        WsConnectionInfo wsConnectionInfo;
-        wsConnectionInfo.clientSocket   = wsThreadInfo->clientSocket;
-        wsConnectionInfo.interfacePath  = wsThreadInfo->interfacePath;
-        wsConnectionInfo.httpParams     = wsThreadInfo->httpParams;
-        wsConnectionInfo.body           = wsThreadInfo->body;
-        wsConnectionInfo.functionParams = inputParams;
-
-        // Call the function.
-        outputParams = wsFunction(&wsThreadInfo->webService, &wsConnectionInfo);
+  if ((chunk == NULL) || (offset > chunk->size)
+    || (size > chunk->size - offset)
+  ) {
+    if ((size <= WS_ARENA_CHUNK_BYTES) && (_wsArenaFreeChunks != NULL)) {
+      chunk = _wsArenaFreeChunks;
+      _wsArenaFreeChunks = chunk->next;
+      _wsArenaNumFreeChunks--;
+    } else {
+      size_t chunkSize
+        = (size > WS_ARENA_CHUNK_BYTES) ? size : WS_ARENA_CHUNK_BYTES;
+      chunk = (WsArenaChunk*) malloc(WS_ARENA_CHUNK_HEADER_BYTES + chunkSize);
+      if (chunk == NULL) {
+        LOG_MALLOC_FAILURE();
+        return NULL;
       }
+      chunk->size = chunkSize;
+    }
+    chunk->used = 0;
+    offset = 0;
+    
+    if ((chunk->size > WS_ARENA_CHUNK_BYTES) && (arena->chunks != NULL)) {
+      // This chunk is full already.  Keep allocating from the current one.
+      chunk->next = arena->chunks->next;
+      arena->chunks->next = chunk;
+    } else {
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
     }
   }
   
-  printLog(TRACE,
-    "EXIT webServiceCall(wsThreadInfo=%p, wsNamespace=\"%s\", "
-    "functionName=\"%s\", inputParams=%p) = {%p}\n",
-    wsThreadInfo, wsNamespace, functionName, inputParams, outputParams);
-  return outputParams;
+  chunk->used = offset + size;
+  arena->lastChunk = chunk;
+  // Whatever the caller puts here, it's now what's at the end of the chunk.
+  arena->lastString = NULL;
+  arena->lastStringLength = 0;
+  
+  return WS_ARENA_CHUNK_DATA(chunk) + offset;
 }
 
-/// @fn u64 sendBuffer(const Bytes buffer, Socket *clientSocket)
+/// @fn void wsArenaSetLastString(WsArena *arena, char *string, size_t length)
 ///
-/// @brief Send a buffer to a client on a socket.
+/// @brief Note that the most recent allocation from a WsArena holds a string
+/// so that wsArenaAddStr can grow it in place.
 ///
-/// @param buffer A Bytes object containing the data to send.
-/// @param clientSocket A pointer to a Socket to send the data on.
+/// @param arena The WsArena that string was just allocated from.
+/// @param string The string, which must end at the end of the arena's current
+///   allocation.
+/// @param length The length of the string, not counting its terminating NUL.
 ///
-/// @returns the number of bytes remaining to be sent, so 0 on success and
-/// a positive value on failure.
-u64 sendBuffer(const Bytes buffer, Socket *clientSocket) {
-  u64 bufferLength = bytesLength(buffer);
-  int chunkSize = 0x7fffffff;
-  int numBytesToSend = chunkSize;
-  if (bufferLength < (u64) chunkSize) {
-    numBytesToSend = (int) bufferLength;
+/// @return This function returns no value.
+void wsArenaSetLastString(WsArena *arena, char *string, size_t length) {
+  arena->lastString = string;
+  arena->lastStringLength = length;
+}
+
+/// @fn char* wsArenaStrdup(WsArena *arena, const char *string)
+///
+/// @brief Copy a string into memory allocated from a WsArena.
+///
+/// @param arena The WsArena to allocate from.
+/// @param string The string to copy.
+///
+/// @return Returns the copy on success, NULL on failure.
+char* wsArenaStrdup(WsArena *arena, const char *string) {
+  if (string == NULL) {
+    return NULL;
   }
-  Bytes bytesToSend = buffer;
-  while (bufferLength > llu(0)) {
-    int bytesSent = socketSend(clientSocket, bytesToSend, numBytesToSend);
-    if (bytesSent <= 0) {
-      printLog(ERR, "Client prematurely closed connection.\n");
-      printLog(DEBUG, "clientSocket = %s\n", socketToString(clientSocket));
-      printLog(DEBUG, "buffer = %p\n", buffer);
-      printLog(DEBUG, "bufferLength = %llu\n", llu(bufferLength));
-      break;
-    }
-    bufferLength -= (u64) bytesSent;
-    numBytesToSend = chunkSize;
-    if (bufferLength < (u64) chunkSize) {
-      numBytesToSend = (int) bufferLength;
-    }
-    bytesToSend += bytesSent;
+  
+  size_t size = strlen(string) + 1;
+  char *copy = (char*) wsArenaAlloc(arena, size);
+  if (copy != NULL) {
+    memcpy(copy, string, size);
+    wsArenaSetLastString(arena, copy, size - 1);
   }
   
-  return bufferLength;
+  return copy;
 }
 
-/// @fn int sendResponseToClient(const Bytes header, const Bytes body, Socket *clientSocket)
+/// @fn char* wsArenaPrintf(WsArena *arena, const char *format, ...)
 ///
-/// @brief Send a full response to the client.
+/// @brief Format a string into memory allocated from a WsArena.
 ///
-/// @param header The HTTP header that has been generated up to this point.
-///   Content-Type and Content-Length headers are expected to be part of this.
-/// @param body The body to send.
-/// @param clientSocket The Socket the client is connected at and the location
-///   to send the full reponse to.
+/// @param arena The WsArena to allocate from.
+/// @param format The printf-style format of the string.
+/// @param ... The values for the format.
 ///
-/// @return Returns 0 on success, any other value is failure.
-int sendResponseToClient(const Bytes header, const Bytes body, Socket *clientSocket) {
-  printLog(TRACE,
-    "ENTER sendResponseToClient(header=%p, body=%p, clientSocket=%s)\n",
-    header, body, socketToString(clientSocket));
-  
-  // Send the HTTP OK portion
-  Bytes buffer = NULL;
-  bytesAddStr(&buffer, "HTTP/1.1 200 OK\r\n");
-  Bytes date = getServerDateHeader();
-  bytesAddStr(&buffer, "Date: ");
-  bytesAddBytes(&buffer, date);
-  bytesAddStr(&buffer, "Vary: Accept-Encoding\r\n");
-  /* TODO?: bytesAddStr(&buffer, "Content-Encoding: deflate\r\n"); */
-  bytesAddStr(&buffer, "Connection: close\r\n");
-  bytesAddStr(&buffer, "Cache-Control: no-store\r\n");
-  // We don't intend to allow the client to cache these pages, so mark the
-  // expiration time the current time.
-  bytesAddStr(&buffer, "Expires: ");
-  bytesAddBytes(&buffer, date);
-  date = bytesDestroy(date);
-  /* bytesAddStr(&buffer, "Content-Security-Policy: default-src 'self' "
-   *   "'unsafe-eval' 'unsafe-inline' 'unsafe-hashes' http://www.w3.org;\r\n");
-   */
-  if (sendBuffer(buffer, clientSocket) > 0) {
-    printLog(ERR, "Could not send OK buffer to client.\n");
-    buffer = bytesDestroy(buffer);
-    return -1;
+/// @return Returns the formatted string on success, NULL on failure.
+char* wsArenaPrintf(WsArena *arena, const char *format, ...) {
+  if ((arena == NULL) || (format == NULL)) {
+    return NULL;
   }
-  buffer = bytesDestroy(buffer);
   
-  if (sendBuffer(header, clientSocket) > 0) {
-    printLog(ERR, "Could not send header buffer to client.\n");
-    return -1;
+  // Format straight into whatever is left of the current chunk.  Most strings
+  // fit, in which case that's where wsArenaAlloc puts them anyway.
+  char *available = NULL;
+  size_t availableSize = 0;
+  WsArenaChunk *chunk = arena->chunks;
+  if (chunk != NULL) {
+    size_t offset = (chunk->used + 15) & ~((size_t) 15);
+    if (offset < chunk->size) {
+      available = WS_ARENA_CHUNK_DATA(chunk) + offset;
+      availableSize = chunk->size - offset;
+    }
   }
   
-  bytesAddStr(&buffer, "\r\n");
-  if (sendBuffer(buffer, clientSocket) > 0) {
-    printLog(ERR, "Could not send header terminator buffer to client.\n");
-    buffer = bytesDestroy(buffer);
-    return -1;
-  }
-  buffer = bytesDestroy(buffer);
+  va_list args;
+  va_start(args, format);
+  va_list argsCopy;
+  va_copy(argsCopy, args);
+  int length = vsnprintf(available, availableSize, format, args);
+  va_end(args);
   
-  if (sendBuffer(body, clientSocket) > 0) {
-    printLog(ERR, "Could not send body buffer to client.\n");
-    return -1;
+  char *string = NULL;
+  if (length >= 0) {
+    string = (char*) wsArenaAlloc(arena, ((size_t) length) + 1);
+    if ((string != NULL) && (string != available)) {
+      vsnprintf(string, ((size_t) length) + 1, format, argsCopy);
+    }
+    if (string != NULL) {
+      wsArenaSetLastString(arena, string, (size_t) length);
+    }
   }
+  va_end(argsCopy);
   
-  printLog(TRACE,
-    "EXIT sendResponseToClient(header=%p, body=%p, clientSocket=%s) = {%d}\n",
-    header, body, socketToString(clientSocket), 0);
-  return 0;
+  return string;
 }
 
-/// @fn int sendResponseObjectToClient(WsThreadInfo *wsThreadInfo, const char *functionName, WsResponseObject *outputParams)
+/// @fn char* wsArenaAddStr(WsArena *arena, char **buffer, const char *input)
 ///
-/// @brief Send the contents of the provided WsResponseObject to the client.
+/// @brief Append a string to a string allocated from a WsArena.  If the string
+/// was built by the most recent allocation from the arena and still ends where
+/// the arena's used memory does, it's grown in place.  Otherwise it's copied.
 ///
-/// @param wsThreadInfo A pointer to the WsThreadInfo
-///   structure passed to this thread.
-/// @param functionName The name of the function that generated the response
-///   object.
-/// @param outputParams The WsResponseObject generated by a call to a web
-///   service function.
+/// @param arena The WsArena that *buffer was allocated from.
+/// @param buffer A pointer to the string to append to.  If *buffer is NULL, a
+///   copy of input is allocated.
+/// @param input The string to append.
 ///
-/// @return Returns 0 on success, any other value is failure.
-int sendResponseObjectToClient(WsThreadInfo *wsThreadInfo,
-  const char *functionName, WsResponseObject *outputParams
-) {
-  printLog(TRACE,
-    "ENTER sendResponseObjectToClient(wsThreadInfo=%p, "
-    "functionName=\"%s\", outputParams=%p)\n", wsThreadInfo,
-    functionName, outputParams);
-  
-  Bytes header = NULL;
-  Bytes body = NULL;
+/// @return Returns the updated *buffer on success, NULL on failure.
+char* wsArenaAddStr(WsArena *arena, char **buffer, const char *input) {
+  if ((arena == NULL) || (buffer == NULL)) {
+    return NULL;
+  } else if (input == NULL) {
+    return *buffer;
+  } else if (*buffer == NULL) {
+    *buffer = wsArenaStrdup(arena, input);
+    return *buffer;
+  }
   
-  if (wsThreadInfo->webService.getResponseValue(
-    outputParams, "Content-Type") == NULL
+  size_t inputLength = strlen(input);
+  size_t length = 0;
+  WsArenaChunk *chunk = arena->lastChunk;
+  if ((*buffer == arena->lastString) && (chunk != NULL)
+    && (*buffer + arena->lastStringLength + 1
+      == WS_ARENA_CHUNK_DATA(chunk) + chunk->used)
   ) {
-    // need to serialize outputParams for the response
-    Bytes contentType
-      = (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "Content-Type");
-    const char *responseContentType = NULL;
-    if ((contentType == NULL) || (strstr(str(contentType), "application/json"))) {
-      body = wsThreadInfo->webService.serializeToJson(outputParams);
-      responseContentType
-        = "Content-Type: application/json; charset=utf-8\r\n";
-    } else if (strstr(str(contentType), "text/xml")) {
-      body = wsThreadInfo->webService.serializeToXml(
-        functionName, outputParams, "Response");
-      responseContentType
-        = "Content-Type: application/soap+xml; charset=utf-8\r\n";
-    } // else we have no parser for this body
-    
-    abprintf(&header, "Content-Length: %llu\r\n", llu(bytesLength(body)));
-    bytesAddStr(&header, responseContentType);
-  } else {
-    // response is fully-defined in outputParams
-    body = (Bytes) wsThreadInfo->webService.getResponseValue(
-      outputParams, "body");
-    abprintf(&header, "Content-Length: %llu\r\n", llu(bytesLength(body)));
-    u32 bodyU32 = *((u32*) "body");
-    
-    // Fill the rest of the header parameters provided.
-    for (
-      WsResponseNode *node = outputParams->head;
-      node != NULL;
-      node = node->next
-    ) {
-      if (*((u32*) node->key) == bodyU32) {
-        // This is the body node.  We've already accounted for that.  Skip it.
-        // We do need to mark the value pointer to NULL, though, so that we
-        // don't try to free it twice.
-        node->value = NULL;
-        continue;
-      }
-      
-      bytesAddStr(&header, (char*) node->key);
-      bytesAddStr(&header, ": ");
-      bytesAddStr(&header, (char*) node->value);
-      bytesAddStr(&header, "\r\n");
+    length = arena->lastStringLength;
+    if (inputLength <= chunk->size - chunk->used) {
+      memcpy(*buffer + length, input, inputLength + 1);
+      chunk->used += inputLength;
+      arena->lastStringLength += inputLength;
+      return *buffer;
     }
+  } else {
+    length = strlen(*buffer);
   }
   
-  bytesAddStr(&header, "Server: ");
-  bytesAddStr(&header, wsThreadInfo->serverName);
-  bytesAddStr(&header, "\r\n");
-  int returnValue
-    = sendResponseToClient(header, body, wsThreadInfo->clientSocket);
-  header = bytesDestroy(header);
-  body = bytesDestroy(body);
+  // Leave room to grow so that a string built up a piece at a time isn't
+  // copied on every addition.
+  size_t size = length + inputLength + 1;
+  char *grown = (char*) wsArenaAlloc(arena, size * 2);
+  if (grown == NULL) {
+    return NULL;
+  }
+  memcpy(grown, *buffer, length);
+  memcpy(grown + length, input, inputLength + 1);
+  arena->lastChunk->used -= size;
+  wsArenaSetLastString(arena, grown, size - 1);
+  *buffer = grown;
   
-  printLog(TRACE,
-    "EXIT sendResponseObjectToClient(wsThreadInfo=%p, "
-    "functionName=\"%s\", outputParams=%p) = {%d}\n", wsThreadInfo,
-    functionName, outputParams, returnValue);
-  return returnValue;
+  return *buffer;
 }
 
-/// @fn int handlePostRequest(WsThreadInfo *wsThreadInfo)
+/// @fn void wsMonotonicTime(struct timespec *now)
 ///
-/// @brief Handle a POST request from a client.
+/// @brief Get the current time from a monotonic clock.  Durations are measured
+/// with this so that changes to the time of day can't distort them.  It's the
+/// same clock trace spans use.
+///
+/// @param now The timespec to fill in with the time since an arbitrary point
+///   in the past.
+///
+/// @return This function returns no value.
+void wsMonotonicTime(struct timespec *now) {
+  u64 nowNs = traceNowNanoseconds();
+  now->tv_sec = (time_t) (nowNs / 1000000000);
+  now->tv_nsec = (long) (nowNs % 1000000000);
+}
+
+/// @fn void wsMetricsBeginRequest(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Note that data for a new request has arrived, which starts the
+/// timing of its header.  Calls after the first one for the same request do
+/// nothing.
 ///
 /// @param wsThreadInfo The WsThreadInfo structure for the connection.
 ///
-/// @return Returns 0 on success.  Any other value is an error.
-int handlePostRequest(WsThreadInfo *wsThreadInfo) {
-  printLog(TRACE, "ENTER handlePostRequest(wsThreadInfo=%p)\n", wsThreadInfo);
-  
-  int returnValue = 0;
-  if (wsThreadInfo == NULL) {
-    printLog(ERR, "NULL wsThreadInfo parameter provided.  Cannot continue.\n");
-    returnValue = 1;
-    printLog(TRACE,
-      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
-      wsThreadInfo, returnValue);
-    return returnValue;
+/// @return This function returns no value.
+void wsMetricsBeginRequest(WsThreadInfo *wsThreadInfo) {
+  if (wsThreadInfo->phaseStart.tv_sec == 0) {
+    wsMonotonicTime(&wsThreadInfo->phaseStart);
   }
-  
-  // We won't redirect a POST request if redirectPort or redirectProtocol are
-  // set, however if redirectFunction is specified, we have to do as we're
-  // told.
-  if ((wsThreadInfo->redirectFunction) && (redirectClient(wsThreadInfo))) {
-    // Nothing else for us to do.
-    printLog(TRACE,
-      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
-      wsThreadInfo, 0);
-    return returnValue; // 0
+}
+
+/// @fn void wsMetricsEndPhase(WsThreadInfo *wsThreadInfo, WsMetricsPhase phase, struct timespec *startTime)
+///
+/// @brief Add the time since a phase of the current request started to the
+/// request's timings.  startTime is set to the current time so that it can be
+/// used to time the phase that follows.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param phase The WsMetricsPhase that just ended.
+/// @param startTime The time the phase started.  Nothing is recorded if it's
+///   zero.
+///
+/// @return This function returns no value.
+void wsMetricsEndPhase(WsThreadInfo *wsThreadInfo, WsMetricsPhase phase,
+  struct timespec *startTime
+) {
+  if (startTime->tv_sec == 0) {
+    // The phase was never started.
+    return;
   }
   
-  // There are a few possibilities for how the client could communicate the
-  // desired operation.  It may provide the information in one of the header
-  // fields or it may only provide it in the path (or it may provide both).
-  // We will let the information in the header override the information in the
-  // path if it's available.
-  Bytes hostName = NULL;
-  bytesAddBytes(&hostName,
-    (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "Host"));
-  if (hostName != NULL) {
-    bytesAddStr(&hostName, "/"); // Trailing / we'll look for in the SOAPAction.
-  }
-  
-  Bytes wsNamespace = NULL;
-  Bytes functionName = NULL;
-  Bytes soapAction
-    = (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "SoapAction");
-  if ((soapAction != NULL) && (hostName != NULL)) {
-    printLog(DEBUG, "SOAP action detected.\n");
-    // SoapAction was specified.  Use that to get the function name.
-    // Depending on the client, this may come all on one line or it may come
-    // with the wsNamespace on the top line and the function on the second.  Look
-    // for the newline first.  If that fails, get the function name from the
-    // last slash.
-    printLog(DEBUG, "Getting part of \"%s\" between \"%s\" and \"%s\".\n",
-      (char*) soapAction, (char*) hostName, "/");
-    wsNamespace = getBytesBetweenBytes(soapAction, (char*) hostName, "/");
-    if (wsNamespace != NULL) { // The expected case
-      printLog(DEBUG, "wsNamespace = \"%s\".\n", wsNamespace);
-      Bytes namespacePlusSlash = NULL;
-      bytesAddBytes(&namespacePlusSlash, wsNamespace);
-      bytesAddStr(&namespacePlusSlash, "/");
-      if (soapAction[0] == '"') {
-        // SOAP actions are supposed to be in double quotes, so this is the
-        // expected case.
-        functionName
-          = getBytesBetweenBytes(soapAction, (char*) namespacePlusSlash, "\"");
-      } else {
-        // Copy to the end of the line.
-        functionName
-          = getBytesBetweenBytes(soapAction, (char*) namespacePlusSlash, "");
-      }
-      namespacePlusSlash = bytesDestroy(namespacePlusSlash);
-    }
-  }
-  hostName = bytesDestroy(hostName);
+  struct timespec now;
+  wsMonotonicTime(&now);
+  i64 elapsedUs = (((i64) now.tv_sec - (i64) startTime->tv_sec) * 1000000)
+    + (((i64) now.tv_nsec - (i64) startTime->tv_nsec) / 1000);
+  wsThreadInfo->phaseUs[phase] += (u64) elapsedUs;
   
-  if ((wsNamespace == NULL) || (functionName == NULL)) {
-    if (wsNamespace == NULL) {
-      printLog(DEBUG, "wsNamespace is NULL.\n");
-    }
-    if (functionName == NULL) {
-      printLog(DEBUG, "functionName is NULL.\n");
-    }
-    
-    Bytes path
-      = (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "_httpLocation");
-    if (path == NULL) {
-      // No SoapAction and no path.  Can't proceed.
-      printLog(ERR, "Malformed HTTP header.\n");
-      functionName = bytesDestroy(functionName);
-      wsNamespace = bytesDestroy(wsNamespace);
-      returnValue = 1;
-      
-      // Caller will do necessary cleanup.
-      printLog(TRACE,
-        "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, 1);
-      return returnValue;
-    }
-    
-    // There is a bug in Internet Explorer which prevents reposting from
-    // behaving correctly--the browser only sends the header on subsoquent
-    // calls.  See http://support.microsoft.com/kb/895954 for more details.
-    // As a work-around, the client will send a URL-encoded timestamp as a
-    // "GET-style" parameter with each call.  This will force Internet Explorer
-    // to treat each call as a new call but we need to make sure we ignore the
-    // rest of the URL in this case.  Clients that handle things properly (like
-    // Firefox and Python) won't send the extra data but that's OK.
-    //
-    // JBC 2012-06-09
-    char *charAt = strchr((char*) path, '?');
-    if (charAt != NULL) {
-      *charAt = '\0';
-    }
-    
-    char *lastSlashAt = strrchr((char*) path, '/');
-    if (lastSlashAt != NULL) {
-      if (functionName == NULL) {
-      // Pull it from the path.  Should be from last / to end of path.
-        bytesAddStr(&functionName, lastSlashAt + 1);
-      }
-      
-      if (wsNamespace == NULL) {
-        char *firstSlashAt = strchr((char*) path, '/');
-        if (firstSlashAt != NULL) {
-          size_t wsNamespaceLength
-            = ((size_t) lastSlashAt) - ((size_t) firstSlashAt);
-          if (wsNamespaceLength > 1) {
-            bytesAddData(&wsNamespace, firstSlashAt + 1, wsNamespaceLength - 1);
-          }
-        }
-      }
+  if (wsThreadInfo->traceBuffer != NULL) {
+    // Whether or not the request is traced isn't known until its header has
+    // been parsed, so the phases are kept for every request.
+    if (wsThreadInfo->tracePhaseStartNs[phase] == 0) {
+      wsThreadInfo->tracePhaseStartNs[phase]
+        = (((u64) startTime->tv_sec) * 1000000000) + ((u64) startTime->tv_nsec);
     }
+    wsThreadInfo->tracePhaseEndNs[phase]
+      = (((u64) now.tv_sec) * 1000000000) + ((u64) now.tv_nsec);
   }
   
-  // Get the function parameters from the body of the request.
-  // body will be guaranteed to be non-NULL because we succeeded at getting
-  // httpHeader earlier.
-  WsRequestObject *inputParams = NULL;
-  Bytes contentType
-    = (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "Content-Type");
-  if (contentType == NULL) {
-    printLog(ERR, "No Content-Type header provided.  Cannot parse input.\n");
-    returnValue = -1;
-    functionName = bytesDestroy(functionName);
-    wsNamespace = bytesDestroy(wsNamespace);
-    
-    printLog(TRACE,
-      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
-      wsThreadInfo, returnValue);
-    return returnValue;
+  wsThreadInfo->phasesTimed |= ((u32) 1) << phase;
+  *startTime = now;
+}
+
+/// @fn u32 wsHistogramBucket(u64 valueUs)
+///
+/// @brief Get the index of the WsHistogram bucket a duration is counted in.
+///
+/// @param valueUs The duration in microseconds.
+///
+/// @return Returns the index of the bucket.
+u32 wsHistogramBucket(u64 valueUs) {
+  if (valueUs < WS_METRICS_SUB_BUCKETS) {
+    return (u32) valueUs;
   }
-  if ((strstr(str(contentType), "text/xml") || strstr(str(contentType), "soap"))
-    && (wsThreadInfo->webService.deserializeFromXml != NULL)
-  ) {
-    inputParams = wsThreadInfo->webService.deserializeFromXml(
-      (const char*) wsThreadInfo->body);
-  } else if ((strstr(str(contentType), "application/json"))
-    && (wsThreadInfo->webService.deserializeFromJson != NULL)
-  ) {
-    long long int startPosition = 0;
-    inputParams = wsThreadInfo->webService.deserializeFromJson(
-      (const char*) wsThreadInfo->body, &startPosition);
-  } // else we have no parser for this body
   
-  // webServiceCall will handle NULL parameters, so no need to double-check.
-  WsResponseObject *outputParams = NULL;
-  outputParams = webServiceCall(
-    wsThreadInfo, (char*) wsNamespace, (char*) functionName, inputParams);
-  if (inputParams != NULL) {
-    // We have to guard this because inputParams may be NULL because no
-    // serialization/deserialization functions were specified.
-    inputParams = wsThreadInfo->webService.requestObjectDestroy(inputParams);
+  // The power of two selects the group of buckets and the bits below the top
+  // one select the bucket within the group.
+  u32 exponent = 0;
+  for (u64 value = valueUs >> 1; value > 0; value >>= 1) {
+    exponent++;
   }
+  u32 shift = exponent - 2;
+  u32 bucket = ((shift + 1) * WS_METRICS_SUB_BUCKETS)
+    + (u32) ((valueUs >> shift) & (WS_METRICS_SUB_BUCKETS - 1));
   
-  if (outputParams != NULL) {
-    // A return value of 0 from sendResponseObjectToClient is good status.
-    // The same is true for this function.  However, this being a top-level
-    // handler, we can only return zero or positive values to our caller.
-    // We need to restrict our return value to reflect this.
-    returnValue = (sendResponseObjectToClient(wsThreadInfo,
-      (char*) functionName, outputParams) != 0);
-    outputParams = wsThreadInfo->webService.responseObjectDestroy(outputParams);
+  return (bucket < WS_METRICS_NUM_BUCKETS)
+    ? bucket : WS_METRICS_NUM_BUCKETS - 1;
+}
+
+/// @fn u64 wsHistogramBucketLimit(u32 bucket)
+///
+/// @brief Get the largest duration that's counted in a WsHistogram bucket.
+///
+/// @param bucket The index of the bucket.
+///
+/// @return Returns the largest duration, in microseconds, that
+/// wsHistogramBucket maps to the bucket.
+u64 wsHistogramBucketLimit(u32 bucket) {
+  if (bucket < WS_METRICS_SUB_BUCKETS) {
+    return bucket;
   }
   
-  functionName = bytesDestroy(functionName);
-  wsNamespace = bytesDestroy(wsNamespace);
-  
-  printLog(TRACE,
-    "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
-    wsThreadInfo, returnValue);
-  return returnValue;
+  u32 shift = (bucket / WS_METRICS_SUB_BUCKETS) - 1;
+  u64 lowest = ((u64) (WS_METRICS_SUB_BUCKETS
+    + (bucket % WS_METRICS_SUB_BUCKETS))) << shift;
+  return lowest + (((u64) 1) << shift) - 1;
 }
 
-// Defined at the bottom of the library.
-extern const char *_mimeTypes[][2];
-extern const i64 NUM_MIME_TYPES;
-
-/// @var _mimeHashTable
+/// @fn void wsHistogramRecord(WsHistogram *histogram, u64 valueUs)
 ///
-/// @brief File-local variable to hold the file extension-to-MIME type
-/// information used for returning HTTP data.
-static HashTable *_mimeHashTable = NULL;
+/// @brief Count a duration in a WsHistogram.
+///
+/// @param histogram The WsHistogram to update.
+/// @param valueUs The duration in microseconds.
+///
+/// @return This function returns no value.
+void wsHistogramRecord(WsHistogram *histogram, u64 valueUs) {
+  atomic_fetch_add_explicit(&histogram->buckets[wsHistogramBucket(valueUs)],
+    (u64) 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->sumUs, valueUs, memory_order_relaxed);
+}
 
-/// @fn const char *getMimeType(const char *fileExtension)
+/// @fn void wsMetricsCountResponse(WsMetrics *metrics, int statusCode, u64 numBytes)
 ///
-/// @brief Get the appropriate MIME type for a file based on its file extension.
+/// @brief Count a response that was sent to a client.
 ///
-/// @prarm fileExtension The last '.' character of the file name and everything
-///   after it.
+/// @param metrics The WsMetrics of the server.  May be NULL.
+/// @param statusCode The HTTP status code of the response.
+/// @param numBytes The number of bytes that were sent.
 ///
-/// @return Returns the appropriate MIME type.  If the file extension is not
-/// found then the default of "text/plain" is returned.
-const char *getMimeType(const char *fileExtension) {
-  printLog(TRACE, "ENTER getMimeType(fileExtension=\"%s\")", fileExtension);
+/// @return This function returns no value.
+void wsMetricsCountResponse(WsMetrics *metrics, int statusCode, u64 numBytes) {
+  if (metrics == NULL) {
+    return;
+  }
   
-  const char *mimeType = NULL;
-  if (fileExtension != NULL) {
-    if (_mimeHashTable != NULL) {
-      // The hash table is set up and we have a file extension.
-      // This is the expected case.
-      mimeType = (const char*) htGetValue(_mimeHashTable, fileExtension);
-    } else {
-      // Setting up the hash table failed for some reason.  Perform a
-      // binary search.
-      i64 searchIndex = NUM_MIME_TYPES >> 1; // divide by two
-      for (i64 i = 0, j = NUM_MIME_TYPES; i <= j;) {
-        int difference = strcmpci(fileExtension, _mimeTypes[searchIndex][0]);
-        if (difference == 0) {
-          mimeType = _mimeTypes[searchIndex][1];
-          break;
-        } else if (difference < 0) {
-          // move left
-          j = searchIndex - 1;
-          if (j < 0) {
-            // searchIndex is 0
-            break;
-          }
-        } else {
-          // move right
-          i = searchIndex + 1;
-          if (i == NUM_MIME_TYPES) {
-            // searchIndex is NUM_MIME_TYPES - 1
-            break;
-          }
+  if ((statusCode < 0) || (statusCode > WS_METRICS_MAX_STATUS_CODE)) {
+    statusCode = 0;
+  }
+  atomic_fetch_add_explicit(&metrics->statusCounts[statusCode],
+    (u64) 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&metrics->bytesOut, numBytes,
+    memory_order_relaxed);
+}
+
+/// @fn void wsMetricsCountBytesOut(WsMetrics *metrics, u64 numBytes)
+///
+/// @brief Count more of a response that was sent to a client.
+///
+/// @param metrics The WsMetrics of the server.  May be NULL.
+/// @param numBytes The number of bytes that were sent.
+///
+/// @return This function returns no value.
+void wsMetricsCountBytesOut(WsMetrics *metrics, u64 numBytes) {
+  if (metrics != NULL) {
+    atomic_fetch_add_explicit(&metrics->bytesOut, numBytes,
+      memory_order_relaxed);
+  }
+}
+
+/// @fn void wsTraceFinishRequest(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Record the spans of the request that was just processed if it's
+/// being traced and get ready to trace the next one.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return This function returns no value.
+void wsTraceFinishRequest(WsThreadInfo *wsThreadInfo) {
+  TraceContext *traceContext = &wsThreadInfo->traceContext;
+  if (traceContext->traceBuffer != NULL) {
+    u64 endNs = traceNowNanoseconds();
+    u64 startNs = endNs;
+    if ((wsThreadInfo->queuedNs != 0) && (wsThreadInfo->dequeuedNs != 0)) {
+      traceContextAddSpan(traceContext, "queue", NULL,
+        wsThreadInfo->queuedNs, wsThreadInfo->dequeuedNs);
+      startNs = wsThreadInfo->queuedNs;
+    }
+    for (int phase = 0; phase < NUM_WS_METRICS_PHASES; phase++) {
+      u64 phaseStartNs = wsThreadInfo->tracePhaseStartNs[phase];
+      if (phaseStartNs != 0) {
+        traceContextAddSpan(traceContext, WsMetricsPhaseNames[phase], NULL,
+          phaseStartNs, wsThreadInfo->tracePhaseEndNs[phase]);
+        if (phaseStartNs < startNs) {
+          startNs = phaseStartNs;
         }
-        searchIndex = (i + j) >> 1; // divide by two
       }
     }
+    
+    const char *method
+      = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "_httpCommand");
+    const char *location
+      = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "_httpLocation");
+    char detail[TRACE_DETAIL_LENGTH];
+    snprintf(detail, sizeof(detail), "%s %s %d",
+      (method != NULL) ? method : "-", (location != NULL) ? location : "-",
+      wsThreadInfo->statusCode);
+    traceContextFinish(traceContext, "request", detail, startNs, endNs);
   }
-  if (mimeType == NULL) {
-    // Unknown file extension.  Default to text/plain.
-    mimeType = "text/plain";
+  
+  for (int phase = 0; phase < NUM_WS_METRICS_PHASES; phase++) {
+    wsThreadInfo->tracePhaseStartNs[phase] = 0;
+    wsThreadInfo->tracePhaseEndNs[phase] = 0;
+  }
+  wsThreadInfo->queuedNs = 0;
+  wsThreadInfo->dequeuedNs = 0;
+}
+
+/// @fn void wsMetricsFinishRequest(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Record the timings of the request that was just processed and get
+/// ready to time the next one.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return This function returns no value.
+void wsMetricsFinishRequest(WsThreadInfo *wsThreadInfo) {
+  if (wsThreadInfo->traceBuffer != NULL) {
+    wsTraceFinishRequest(wsThreadInfo);
+  }
+  
+  WsMetrics *metrics = wsThreadInfo->metrics;
+  WsRouteMetrics *routeMetrics = wsThreadInfo->routeMetrics;
+  if ((routeMetrics == NULL) && (metrics != NULL)) {
+    routeMetrics = &metrics->other;
+  }
+  
+  for (int phase = 0; phase < NUM_WS_METRICS_PHASES; phase++) {
+    if ((routeMetrics != NULL)
+      && ((wsThreadInfo->phasesTimed & (((u32) 1) << phase)) != 0)
+    ) {
+      wsHistogramRecord(&routeMetrics->phases[phase],
+        wsThreadInfo->phaseUs[phase]);
+    }
+    wsThreadInfo->phaseUs[phase] = 0;
+  }
+  
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  if ((metrics != NULL) && (httpRequest->state == WS_HTTP_HEADER_COMPLETE)) {
+    atomic_fetch_add_explicit(&metrics->bytesIn,
+      httpRequest->bodyOffset + wsThreadInfo->bodyReader.length,
+      memory_order_relaxed);
+  }
+  
+  wsThreadInfo->routeMetrics = NULL;
+  wsThreadInfo->phasesTimed = 0;
+  wsThreadInfo->phaseStart.tv_sec = 0;
+  wsThreadInfo->phaseStart.tv_nsec = 0;
+}
+
+/// @fn bool redirectClient(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Use the information in the wsThreadInfo to determine if we should
+/// redirect the user to a page by the same name on a different port or
+/// protocol.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return Returns true if the user was redirected, false if not.
+bool redirectClient(WsThreadInfo *wsThreadInfo) {
+  printLog(TRACE, "ENTER redirectClient(wsThreadInfo=%p)\n", wsThreadInfo);
+  
+  char *redirectProtocol = wsThreadInfo->redirectProtocol;
+  int redirectPort = wsThreadInfo->redirectPort;
+  RedirectFunction redirectFunction = wsThreadInfo->redirectFunction;
+  if ((redirectProtocol == NULL) && (redirectPort == 0)
+    && (redirectFunction == NULL)
+  ) {
+    // We're not supposed to be redirecting traffic on this protocol and port
+    // elsewhere.
+    printLog(TRACE,
+      "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "false");
+    return false;
+  }
+  
+  // redirectFunction takes precedence over the other data.
+  if (redirectFunction != NULL) {
+    Dictionary *response = redirectFunction(wsThreadInfo->clientSocket,
+      wsThreadInfo->interfacePath,
+      wsHttpRequestGetParams(&wsThreadInfo->httpRequest), wsThreadInfo->body,
+      wsThreadInfo->cookiesDict);
+    char *redirectUrl = (char*) dictionaryGetValue(response, "redirectUrl");
+    if (redirectUrl == NULL) {
+      printLog(DEBUG, "Supplied redirection function did not provide a "
+        "redirectUrl return parameter.");
+      response = dictionaryDestroy(response);
+      printLog(TRACE,
+        "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "false");
+      return false;
+    }
+    
+    Bytes location = NULL;
+    abprintf(&location, "Location: %s\n\n", redirectUrl);
+    
+    if (location != NULL) {
+      Bytes sendbuf = NULL;
+      bytesAddStr(&sendbuf, "HTTP/1.1 301 Moved Permanently\n");
+      bytesAddBytes(&sendbuf, location);
+      
+      Socket *clientSocket = wsThreadInfo->clientSocket;
+      socketSend(clientSocket, sendbuf, bytesLength(sendbuf));
+      wsThreadInfo->statusCode = 301;
+      wsMetricsCountResponse(wsThreadInfo->metrics, 301,
+        bytesLength(sendbuf));
+      wsThreadInfo->bytesOut += bytesLength(sendbuf);
+      sendbuf = bytesDestroy(sendbuf);
+    }
+    location = bytesDestroy(location);
+    
+    response = dictionaryDestroy(response);
+    return true;
+  }
+  
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  Bytes headerHost = NULL;
+  bytesAddStr(&headerHost, wsHttpRequestGetHeader(httpRequest, "Host"));
+  if (headerHost == NULL) {
+    // There's no Host in the header.  We can't proceed.
+    printLog(TRACE,
+      "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "false");
+    return false;
+  }
+  
+  if (redirectPort != 0) {
+    // We're going to change the port.
+    // We don't want the part of the host header after the colon.
+    // Termiante the string there.
+    char *portAt = strchr((char*) headerHost, ':');
+    if (portAt != NULL) {
+      *portAt = '\0';
+    }
+  }
+  
+  // Construct the host to redirect to.
+  char *host = NULL;
+  if ((redirectProtocol == NULL) && (redirectPort != 0)) {
+    if (asprintf(&host, "%s:%d", (char*) headerHost, redirectPort) < 0) {
+      host = NULL;
+    }
+  } else if ((redirectProtocol != NULL) && (redirectPort == 0)) {
+    if (asprintf(&host, "%s://%s", redirectProtocol, (char*) headerHost) < 0) {
+      host = NULL;
+    }
+  } else { // redirectProtocol != NULL && redirectPort != 0
+    if (asprintf(&host, "%s://%s:%d", redirectProtocol, (char*) headerHost,
+      redirectPort) < 0
+    ) {
+      host = NULL;
+    }
+  }
+  headerHost = bytesDestroy(headerHost);
+  
+  const char *httpLocation
+    = wsHttpRequestGetHeader(httpRequest, "_httpLocation");
+  if (httpLocation == NULL) {
+    printLog(ERR, "Request to redirect to NULL location.\n");
+    host = stringDestroy(host);
+    // We have to return true here because the EXPECTED behavior is for us to
+    // redirect, even though we don't have the ability to actually redirect.
+    printLog(TRACE,
+      "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "true");
+    return true;
+  }
+  Bytes location = NULL;
+  abprintf(&location, "Location: %s%s\n\n", host, httpLocation);
+  host = stringDestroy(host);
+  
+  if (location != NULL) {
+    Bytes sendbuf = NULL;
+    bytesAddStr(&sendbuf, "HTTP/1.1 301 Moved Permanently\n");
+    bytesAddBytes(&sendbuf, location);
+    
+    Socket *clientSocket = wsThreadInfo->clientSocket;
+    socketSend(clientSocket, sendbuf, bytesLength(sendbuf));
+    wsThreadInfo->statusCode = 301;
+    wsMetricsCountResponse(wsThreadInfo->metrics, 301, bytesLength(sendbuf));
+    wsThreadInfo->bytesOut += bytesLength(sendbuf);
+    sendbuf = bytesDestroy(sendbuf);
+  }
+  location = bytesDestroy(location);
+  
+  printLog(TRACE,
+    "EXIT redirectClient(wsThreadInfo=%p) = {%s}\n", wsThreadInfo, "true");
+  return true;
+}
+
+#ifndef _WIN32
+/// @fn bool wsSocketWaitToSend(Socket *clientSocket, ssize_t status)
+///
+/// @brief Wait for a socket with a wait function to be able to take more data
+/// after a send made directly on its descriptor came up short.  Such a
+/// socket's descriptor is non-blocking even though the socket is not.  Must
+/// be called with the socket's lock held.  The lock is released while waiting.
+///
+/// @param clientSocket The Socket that was sent on.
+/// @param status The value returned by the send call.
+///
+/// @return Returns true if the send should be retried, false if it failed.
+bool wsSocketWaitToSend(Socket *clientSocket, ssize_t status) {
+  if ((status >= 0) || (clientSocket->waitFunction == NULL)
+    || ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+  ) {
+    return false;
+  }
+  
+  mtx_unlock(&clientSocket->lock);
+  int waitStatus = socketWait(clientSocket, POLLOUT, -1);
+  mtx_lock(&clientSocket->lock);
+  
+  return (waitStatus > 0);
+}
+#endif // _WIN32
+
+/// @fn u64 sendData(const void *data, u64 length, Socket *clientSocket)
+///
+/// @brief Send a block of memory to a client on a socket.
+///
+/// @param data A pointer to the data to send.
+/// @param length The number of bytes at data.
+/// @param clientSocket A pointer to a Socket to send the data on.
+///
+/// @returns the number of bytes remaining to be sent, so 0 on success and
+/// a positive value on failure.
+u64 sendData(const void *data, u64 length, Socket *clientSocket) {
+  int chunkSize = 0x7fffffff;
+  int numBytesToSend = chunkSize;
+  if (length < (u64) chunkSize) {
+    numBytesToSend = (int) length;
+  }
+  const char *bytesToSend = (const char*) data;
+  while (length > llu(0)) {
+    int bytesSent = socketSend(clientSocket, bytesToSend, numBytesToSend);
+    if (bytesSent <= 0) {
+      printLog(ERR, "Client prematurely closed connection.\n");
+      printLog(DEBUG, "clientSocket = %s\n", socketToString(clientSocket));
+      printLog(DEBUG, "data = %p\n", data);
+      printLog(DEBUG, "length = %llu\n", llu(length));
+      break;
+    }
+    length -= (u64) bytesSent;
+    numBytesToSend = chunkSize;
+    if (length < (u64) chunkSize) {
+      numBytesToSend = (int) length;
+    }
+    bytesToSend += bytesSent;
+  }
+  
+  return length;
+}
+
+/// @fn u64 sendBuffer(const Bytes buffer, Socket *clientSocket)
+///
+/// @brief Send a buffer to a client on a socket.
+///
+/// @param buffer A Bytes object containing the data to send.
+/// @param clientSocket A pointer to a Socket to send the data on.
+///
+/// @returns the number of bytes remaining to be sent, so 0 on success and
+/// a positive value on failure.
+u64 sendBuffer(const Bytes buffer, Socket *clientSocket) {
+  return sendData(buffer, bytesLength(buffer), clientSocket);
+}
+
+/// @struct WsIoBuffer
+///
+/// @brief One piece of a message that's sent with sendBuffers.
+///
+/// @param data A pointer to the data to send.  May be NULL if length is 0.
+/// @param length The number of bytes at data.
+typedef struct WsIoBuffer {
+  const void *data;
+  u64         length;
+} WsIoBuffer;
+
+/// @def WS_MAX_IO_BUFFERS
+///
+/// @brief The largest number of WsIoBuffers sendBuffers accepts at once.
+#define WS_MAX_IO_BUFFERS 8
+
+/// @def WS_COALESCE_MAX_BYTES
+///
+/// @brief The largest number of bytes sendBuffers copies together when it
+/// can't hand the pieces of a message to the kernel separately.  This is a
+/// few TLS records' worth, so headers and small bodies go out in one write
+/// while large bodies are sent from where they already are.
+#define WS_COALESCE_MAX_BYTES (64 * 1024)
+
+/// @fn u64 sendBuffers(const WsIoBuffer *buffers, int numBuffers, Socket *clientSocket)
+///
+/// @brief Send several pieces of a message to a client in as few system calls
+/// as possible.  Plaintext sockets use a single gather write (sendmsg), so the
+/// message isn't split into one small TCP segment per piece.  TLS sockets
+/// copy the smaller pieces together so that they're encrypted into one record
+/// instead of one record per piece.
+///
+/// @param buffers The array of WsIoBuffers to send, in order.
+/// @param numBuffers The number of elements in buffers.  At most
+///   WS_MAX_IO_BUFFERS.
+/// @param clientSocket A pointer to a Socket to send the data on.
+///
+/// @returns the number of bytes remaining to be sent, so 0 on success and
+/// a positive value on failure.
+u64 sendBuffers(const WsIoBuffer *buffers, int numBuffers,
+  Socket *clientSocket
+) {
+  u64 remaining = 0;
+  for (int ii = 0; ii < numBuffers; ii++) {
+    remaining += buffers[ii].length;
+  }
+  if ((numBuffers <= 0) || (numBuffers > WS_MAX_IO_BUFFERS)) {
+    printLog(ERR, "Invalid number of buffers: %d\n", numBuffers);
+    return remaining;
+  }
+  
+#ifndef _WIN32
+  if ((clientSocket->socketMode == PLAIN)
+    && (clientSocket->socketProtocol == TCP)
+  ) {
+    struct iovec ioVectors[WS_MAX_IO_BUFFERS];
+    int numIoVectors = 0;
+    for (int ii = 0; ii < numBuffers; ii++) {
+      if (buffers[ii].length > 0) {
+        ioVectors[numIoVectors].iov_base = (void*) buffers[ii].data;
+        ioVectors[numIoVectors].iov_len = (size_t) buffers[ii].length;
+        numIoVectors++;
+      }
+    }
+    
+    // Connections in WS_EVENT_LOOP mode are nonblocking and must stay that
+    // way for their reactor once the response is out.
+    bool socketWasBlocking = clientSocket->blocking;
+    if (socketWasBlocking == false) {
+      socketSetBlocking(clientSocket);
+    }
+    mtx_lock(&clientSocket->lock);
+    int firstIoVector = 0;
+    while (remaining > 0) {
+      ZEROINIT(struct msghdr message);
+      message.msg_iov = &ioVectors[firstIoVector];
+      message.msg_iovlen = numIoVectors - firstIoVector;
+      ssize_t bytesSent
+        = sendmsg(clientSocket->sockfd, &message, MSG_NOSIGNAL);
+      if (bytesSent <= 0) {
+        if ((bytesSent < 0) && (errno == EINTR)) {
+          continue;
+        } else if (wsSocketWaitToSend(clientSocket, bytesSent) == true) {
+          continue;
+        }
+        printLog(ERR, "Client prematurely closed connection.\n");
+        printLog(DEBUG, "clientSocket = %s\n", socketToString(clientSocket));
+        break;
+      }
+      remaining -= (u64) bytesSent;
+      
+      // Skip past whatever was fully sent and trim what was partially sent.
+      size_t unaccounted = (size_t) bytesSent;
+      while ((firstIoVector < numIoVectors)
+        && (unaccounted >= ioVectors[firstIoVector].iov_len)
+      ) {
+        unaccounted -= ioVectors[firstIoVector].iov_len;
+        firstIoVector++;
+      }
+      if (firstIoVector < numIoVectors) {
+        ioVectors[firstIoVector].iov_base
+          = (char*) ioVectors[firstIoVector].iov_base + unaccounted;
+        ioVectors[firstIoVector].iov_len -= unaccounted;
+      }
+    }
+    mtx_unlock(&clientSocket->lock);
+    if (socketWasBlocking == false) {
+      socketSetNonblocking(clientSocket);
+    }
+    
+    return remaining;
+  }
+#endif // _WIN32
+  
+  // Copy runs of pieces together and send each run with one write.  A piece
+  // that's too large to be worth copying is sent in place.
+  Bytes coalesced = NULL;
+  for (int ii = 0; ii < numBuffers; ii++) {
+    const WsIoBuffer *buffer = &buffers[ii];
+    if (bytesLength(coalesced) + buffer->length <= WS_COALESCE_MAX_BYTES) {
+      bytesAddData(&coalesced, buffer->data, buffer->length);
+      continue;
+    }
+    
+    if (bytesLength(coalesced) > 0) {
+      u64 coalescedLength = bytesLength(coalesced);
+      u64 unsent = sendBuffer(coalesced, clientSocket);
+      remaining -= coalescedLength - unsent;
+      bytesSetLength(coalesced, 0);
+      if (unsent > 0) {
+        coalesced = bytesDestroy(coalesced);
+        return remaining;
+      }
+    }
+    if (buffer->length > WS_COALESCE_MAX_BYTES) {
+      u64 unsent = sendData(buffer->data, buffer->length, clientSocket);
+      remaining -= buffer->length - unsent;
+      if (unsent > 0) {
+        coalesced = bytesDestroy(coalesced);
+        return remaining;
+      }
+    } else {
+      bytesAddData(&coalesced, buffer->data, buffer->length);
+    }
+  }
+  if (bytesLength(coalesced) > 0) {
+    u64 coalescedLength = bytesLength(coalesced);
+    remaining -= coalescedLength - sendBuffer(coalesced, clientSocket);
+  }
+  coalesced = bytesDestroy(coalesced);
+  
+  return remaining;
+}
+
+/// @fn int wsSendChunk(Socket *clientSocket, const void *data, size_t length)
+///
+/// @brief Send one chunk of a body that uses the chunked transfer coding.
+///
+/// @param clientSocket The Socket to send the chunk on.
+/// @param data The content of the chunk.  May be NULL if length is 0.
+/// @param length The number of bytes at data.  A length of 0 sends the last
+///   chunk, which terminates the body.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsSendChunk(Socket *clientSocket, const void *data, size_t length) {
+  char chunkHeader[24];
+  int chunkHeaderLength = snprintf(chunkHeader, sizeof(chunkHeader),
+    "%llx\r\n", llu(length));
+  WsIoBuffer chunk[] = {
+    { chunkHeader, (u64) chunkHeaderLength },
+    { data,        length },
+    { "\r\n",      2 },
+  };
+  if (sendBuffers(chunk, (int) (sizeof(chunk) / sizeof(chunk[0])),
+    clientSocket) > 0
+  ) {
+    return -1;
+  }
+  
+  return 0;
+}
+
+/// @enum WsContentEncoding
+///
+/// @brief The content codings the server can apply to a response body.
+///
+/// @param WS_ENCODING_IDENTITY The body is sent as-is.
+/// @param WS_ENCODING_GZIP The body is sent in gzip format (RFC 1952).
+/// @param WS_ENCODING_DEFLATE The body is sent in zlib format (RFC 1950),
+///   which is what HTTP calls "deflate".
+/// @param NUM_WS_CONTENT_ENCODINGS The number of valid WsContentEncoding values.
+typedef enum WsContentEncoding {
+  WS_ENCODING_IDENTITY,
+  WS_ENCODING_GZIP,
+  WS_ENCODING_DEFLATE,
+  NUM_WS_CONTENT_ENCODINGS
+} WsContentEncoding;
+
+/// @var wsContentEncodingNames
+///
+/// @brief The HTTP names of the WsContentEncoding values.
+const char *wsContentEncodingNames[NUM_WS_CONTENT_ENCODINGS] = {
+  "identity",
+  "gzip",
+  "deflate"
+};
+
+/// @def WS_COMPRESSOR_CHUNK_SIZE
+///
+/// @brief The size of the buffer compressed output is collected in before it's
+/// appended to the caller's output.  The buffer is allocated with the
+/// compressor since it's too large for a coroutine's stack.
+#define WS_COMPRESSOR_CHUNK_SIZE 65536
+
+/// @fn WsContentEncoding wsNegotiateContentEncoding(const char *acceptEncoding)
+///
+/// @brief Choose the content coding for a response from the value of the
+/// request's Accept-Encoding header.  gzip is preferred over deflate when the
+/// client weights them equally since some clients have historically gotten
+/// "deflate" wrong.
+///
+/// @param acceptEncoding The value of the Accept-Encoding header.  May be NULL.
+///
+/// @return Returns the WsContentEncoding to use.
+WsContentEncoding wsNegotiateContentEncoding(const char *acceptEncoding) {
+  if (acceptEncoding == NULL) {
+    return WS_ENCODING_IDENTITY;
+  }
+  
+  // qValues[encoding] is the weight, in thousandths, the client gave the
+  // encoding.  -1 means the client didn't mention it.
+  int qValues[NUM_WS_CONTENT_ENCODINGS] = { -1, -1, -1 };
+  int wildcardQValue = -1;
+  const char *cursor = acceptEncoding;
+  while (*cursor != '\0') {
+    while ((*cursor == ' ') || (*cursor == '\t') || (*cursor == ',')) {
+      cursor++;
+    }
+    const char *name = cursor;
+    while ((*cursor != '\0') && (*cursor != ',') && (*cursor != ';')
+      && (*cursor != ' ') && (*cursor != '\t')
+    ) {
+      cursor++;
+    }
+    size_t nameLength = cursor - name;
+    if (nameLength == 0) {
+      // An element with no coding name (e.g. ";q=1").  Skip to the next one
+      // so that the cursor always advances.
+      while ((*cursor != '\0') && (*cursor != ',')) {
+        cursor++;
+      }
+      continue;
+    }
+    
+    int qValue = 1000;
+    while ((*cursor != '\0') && (*cursor != ',')) {
+      if ((*cursor == 'q') && (cursor[1] == '=')) {
+        qValue = (int) (strtod(cursor + 2, NULL) * 1000);
+      }
+      cursor++;
+    }
+    
+    if ((nameLength == 1) && (*name == '*')) {
+      wildcardQValue = qValue;
+      continue;
+    }
+    for (int ii = 0; ii < NUM_WS_CONTENT_ENCODINGS; ii++) {
+      if ((strlen(wsContentEncodingNames[ii]) == nameLength)
+        && (strncmpci(name, wsContentEncodingNames[ii], nameLength) == 0)
+      ) {
+        qValues[ii] = qValue;
+      }
+    }
+  }
+  
+  WsContentEncoding encoding = WS_ENCODING_IDENTITY;
+  int bestQValue = 0;
+  for (int ii = WS_ENCODING_GZIP; ii < NUM_WS_CONTENT_ENCODINGS; ii++) {
+    int qValue = (qValues[ii] >= 0) ? qValues[ii] : wildcardQValue;
+    if (qValue > bestQValue) {
+      bestQValue = qValue;
+      encoding = (WsContentEncoding) ii;
+    }
+  }
+  
+  return encoding;
+}
+
+/// @fn bool wsIsCompressible(const char *contentType)
+///
+/// @brief Determine whether a body of the given type is worth compressing.
+/// Formats that are already compressed (images, archives, etc.) are not.
+///
+/// @param contentType The value of the Content-Type of the body.
+///
+/// @return Returns true if the body should be compressed, false if not.
+bool wsIsCompressible(const char *contentType) {
+  if (contentType == NULL) {
+    return false;
+  }
+  
+  return (strncmp(contentType, "text/", 5) == 0)
+    || (strstr(contentType, "json") != NULL)
+    || (strstr(contentType, "xml") != NULL)
+    || (strstr(contentType, "javascript") != NULL)
+    || (strstr(contentType, "ecmascript") != NULL);
+}
+
+/// @struct WsCompressor
+///
+/// @brief State for compressing a body a piece at a time.
+///
+/// @param stream The miniz deflate stream.
+/// @param encoding The WsContentEncoding being produced.
+/// @param crc32 The running CRC-32 of the uncompressed data (gzip only).
+/// @param inputLength The number of uncompressed bytes consumed so far.
+/// @param headerWritten Whether or not the gzip header has been written.
+/// @param chunk The WS_COMPRESSOR_CHUNK_SIZE-byte buffer that compressed
+///   output is collected in.
+typedef struct WsCompressor {
+  mz_stream         stream;
+  WsContentEncoding encoding;
+  mz_ulong          crc32;
+  u64               inputLength;
+  bool              headerWritten;
+  unsigned char    *chunk;
+} WsCompressor;
+
+/// @fn int wsCompressorInit(WsCompressor *compressor, WsContentEncoding encoding, int level)
+///
+/// @brief Initialize a WsCompressor.  wsCompressorEnd must be called when the
+/// compressor is no longer needed.
+///
+/// @param compressor A pointer to the WsCompressor to initialize.
+/// @param encoding The WsContentEncoding to produce.  Must be gzip or deflate.
+/// @param level The compression level to use.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsCompressorInit(WsCompressor *compressor,
+  WsContentEncoding encoding, int level
+) {
+  memset(compressor, 0, sizeof(*compressor));
+  compressor->encoding = encoding;
+  compressor->crc32 = MZ_CRC32_INIT;
+  
+  compressor->chunk = (unsigned char*) malloc(WS_COMPRESSOR_CHUNK_SIZE);
+  if (compressor->chunk == NULL) {
+    LOG_MALLOC_FAILURE();
+    return -1;
+  }
+  
+  // miniz can only produce raw deflate data or zlib-wrapped data.  gzip is raw
+  // deflate data with a header and trailer that we add ourselves.
+  int windowBits = (encoding == WS_ENCODING_GZIP)
+    ? -MZ_DEFAULT_WINDOW_BITS : MZ_DEFAULT_WINDOW_BITS;
+  if (mz_deflateInit2(&compressor->stream, level, MZ_DEFLATED, windowBits,
+    /*mem_level=*/ 8, MZ_DEFAULT_STRATEGY) != MZ_OK
+  ) {
+    printLog(ERR, "Could not initialize deflate stream.\n");
+    compressor->chunk = (unsigned char*) pointerDestroy(compressor->chunk);
+    return -1;
+  }
+  
+  return 0;
+}
+
+/// @fn int wsCompressorWrite(WsCompressor *compressor, const void *data, size_t length, bool finish, Bytes *output)
+///
+/// @brief Compress the next piece of a body.
+///
+/// @param compressor A pointer to a WsCompressor initialized by
+///   wsCompressorInit.
+/// @param data The uncompressed data to add.  May be NULL if length is 0.
+/// @param length The number of bytes at data.
+/// @param finish Whether or not this is the last piece of the body.  All
+///   remaining compressed data is flushed when this is true.
+/// @param output A pointer to the Bytes object to append the compressed data
+///   to.  Nothing may be appended if the compressor is still buffering.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsCompressorWrite(WsCompressor *compressor,
+  const void *data, size_t length, bool finish, Bytes *output
+) {
+  if ((compressor->encoding == WS_ENCODING_GZIP)
+    && (compressor->headerWritten == false)
+  ) {
+    // Magic number, deflate method, no flags, no timestamp, no extra flags,
+    // unknown OS.
+    static const unsigned char gzipHeader[10] = {
+      0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff
+    };
+    bytesAddData(output, gzipHeader, sizeof(gzipHeader));
+    compressor->headerWritten = true;
+  }
+  if ((compressor->encoding == WS_ENCODING_GZIP) && (length > 0)) {
+    compressor->crc32 = mz_crc32(compressor->crc32,
+      (const unsigned char*) data, length);
+  }
+  compressor->inputLength += length;
+  
+  unsigned char *chunk = compressor->chunk;
+  const unsigned char *next = (const unsigned char*) data;
+  size_t remaining = length;
+  compressor->stream.avail_in = 0;
+  int status = MZ_OK;
+  do {
+    if (compressor->stream.avail_in == 0) {
+      // avail_in is only an unsigned int, so larger inputs are fed to the
+      // stream a piece at a time.
+      size_t pieceLength = (remaining > UINT_MAX) ? UINT_MAX : remaining;
+      compressor->stream.next_in = next;
+      compressor->stream.avail_in = (unsigned int) pieceLength;
+      next += pieceLength;
+      remaining -= pieceLength;
+    }
+    compressor->stream.next_out = chunk;
+    compressor->stream.avail_out = WS_COMPRESSOR_CHUNK_SIZE;
+    status = mz_deflate(&compressor->stream,
+      ((finish) && (remaining == 0)) ? MZ_FINISH : MZ_NO_FLUSH);
+    if ((status != MZ_OK) && (status != MZ_STREAM_END)
+      && (status != MZ_BUF_ERROR)
+    ) {
+      printLog(ERR, "mz_deflate returned %d.\n", status);
+      return -1;
+    }
+    size_t chunkLength
+      = WS_COMPRESSOR_CHUNK_SIZE - compressor->stream.avail_out;
+    if (chunkLength > 0) {
+      bytesAddData(output, chunk, chunkLength);
+    }
+  } while ((compressor->stream.avail_out == 0) || (remaining > 0)
+    || ((finish) && (status != MZ_STREAM_END))
+  );
+  
+  if ((finish) && (compressor->encoding == WS_ENCODING_GZIP)) {
+    // CRC-32 and length of the uncompressed data, both little-endian.
+    unsigned char gzipTrailer[8];
+    for (int ii = 0; ii < 4; ii++) {
+      gzipTrailer[ii] = (unsigned char) (compressor->crc32 >> (8 * ii));
+      gzipTrailer[ii + 4]
+        = (unsigned char) (compressor->inputLength >> (8 * ii));
+    }
+    bytesAddData(output, gzipTrailer, sizeof(gzipTrailer));
+  }
+  
+  return 0;
+}
+
+/// @fn void wsCompressorEnd(WsCompressor *compressor)
+///
+/// @brief Release the resources held by a WsCompressor.
+///
+/// @param compressor A pointer to the WsCompressor to release.
+void wsCompressorEnd(WsCompressor *compressor) {
+  mz_deflateEnd(&compressor->stream);
+  compressor->chunk = (unsigned char*) pointerDestroy(compressor->chunk);
+}
+
+/// @fn Bytes wsCompressBytes(const void *data, size_t length, WsContentEncoding encoding, int level)
+///
+/// @brief Compress a complete body that's already in memory.
+///
+/// @param data The data to compress.
+/// @param length The number of bytes at data.
+/// @param encoding The WsContentEncoding to produce.  Must be gzip or deflate.
+/// @param level The compression level to use.
+///
+/// @return Returns a newly-allocated Bytes object with the compressed data on
+/// success, NULL on failure.
+Bytes wsCompressBytes(const void *data, size_t length,
+  WsContentEncoding encoding, int level
+) {
+  WsCompressor compressor;
+  if (wsCompressorInit(&compressor, encoding, level) != 0) {
+    return NULL;
+  }
+  
+  // Most text compresses to well under half its size.  Start there so that
+  // the output usually only needs one allocation.
+  Bytes compressed = NULL;
+  bytesAllocate(&compressed, (length / 2) + 64);
+  if (wsCompressorWrite(&compressor, data, length, true, &compressed) != 0) {
+    compressed = bytesDestroy(compressed);
+  }
+  wsCompressorEnd(&compressor);
+  
+  return compressed;
+}
+
+/// @fn WsContentEncoding wsResponseEncoding(WsThreadInfo *wsThreadInfo, const char *contentType, u64 bodyLength)
+///
+/// @brief Decide how the body of a response should be encoded based on the
+/// server's compression settings, the body, and what the client accepts.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param contentType The Content-Type of the body.
+/// @param bodyLength The length of the uncompressed body.
+///
+/// @return Returns the WsContentEncoding to use for the response.
+WsContentEncoding wsResponseEncoding(WsThreadInfo *wsThreadInfo,
+  const char *contentType, u64 bodyLength
+) {
+  if ((wsThreadInfo->compressionLevel <= 0)
+    || (bodyLength < (u64) wsThreadInfo->compressionMinBytes)
+    || (wsIsCompressible(contentType) == false)
+  ) {
+    return WS_ENCODING_IDENTITY;
+  }
+  
+  return wsNegotiateContentEncoding(
+    wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Accept-Encoding"));
+}
+
+/// @fn const char* wsCompressBody(WsThreadInfo *wsThreadInfo, const char *contentType, Bytes *body)
+///
+/// @brief Compress a response body in place if the client accepts it and it's
+/// worth doing.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param contentType The Content-Type of the body.
+/// @param body A pointer to the body.  On success, the body is replaced with
+///   its compressed form.
+///
+/// @return Returns the name of the content coding that was applied, or NULL if
+/// the body was left as-is.
+const char* wsCompressBody(WsThreadInfo *wsThreadInfo,
+  const char *contentType, Bytes *body
+) {
+  u64 bodyLength = bytesLength(*body);
+  WsContentEncoding encoding
+    = wsResponseEncoding(wsThreadInfo, contentType, bodyLength);
+  if (encoding == WS_ENCODING_IDENTITY) {
+    return NULL;
+  }
+  
+  Bytes compressed = wsCompressBytes(*body, (size_t) bodyLength,
+    encoding, wsThreadInfo->compressionLevel);
+  if ((compressed == NULL) || (bytesLength(compressed) >= bodyLength)) {
+    // Not worth it.
+    compressed = bytesDestroy(compressed);
+    return NULL;
+  }
+  
+  *body = bytesDestroy(*body);
+  *body = compressed;
+  return wsContentEncodingNames[encoding];
+}
+
+/// @fn int sendResponseToClient(WsThreadInfo *wsThreadInfo, const char *status, const char *header, const void *body, u64 bodyLength)
+///
+/// @brief Send a full response to the client.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.  The
+///   response is sent on its clientSocket and its keepAlive member determines
+///   the Connection header that's sent.
+/// @param status The status code and reason phrase of the response (e.g.
+///   "200 OK").
+/// @param header The HTTP header that has been generated up to this point.
+///   Content-Type and Content-Length headers are expected to be part of this.
+///   If it includes a Cache-Control header, the default (no-store) caching
+///   headers are omitted.
+/// @param body The body to send.
+/// @param bodyLength The number of bytes at body.
+///
+/// @return Returns 0 on success, any other value is failure.
+int sendResponseToClient(WsThreadInfo *wsThreadInfo,
+  const char *status, const char *header, const void *body, u64 bodyLength
+) {
+  Socket *clientSocket = wsThreadInfo->clientSocket;
+  printLog(TRACE,
+    "ENTER sendResponseToClient(status=\"%s\", header=%p, body=%p, "
+    "clientSocket=%s)\n", status, header, body, socketToString(clientSocket));
+  
+  // Build the status line and the headers common to all responses.
+  const char *date = getServerDate();
+  char connection[80];
+  if (wsThreadInfo->keepAlive == true) {
+    snprintf(connection, sizeof(connection),
+      "Connection: keep-alive\r\nKeep-Alive: timeout=%d, max=%d\r\n",
+      wsThreadInfo->keepAliveTimeoutSeconds,
+      wsThreadInfo->maxRequestsPerConnection - wsThreadInfo->numRequests - 1);
+  } else {
+    snprintf(connection, sizeof(connection), "Connection: close\r\n");
+  }
+  // We don't intend to allow the client to cache these pages unless the
+  // header says otherwise, so mark the expiration time the current time.
+  bool noStore
+    = ((header == NULL) || (strstr(header, "Cache-Control:") == NULL));
+  /* "Content-Security-Policy: default-src 'self' 'unsafe-eval' "
+   *   "'unsafe-inline' 'unsafe-hashes' http://www.w3.org;\r\n"
+   */
+  char *buffer = wsArenaPrintf(&wsThreadInfo->arena,
+    "HTTP/1.1 %s\r\nDate: %s\r\nVary: Accept-Encoding\r\n%s%s%s%s",
+    status, date, connection,
+    noStore ? "Cache-Control: no-store\r\nExpires: " : "",
+    noStore ? date : "", noStore ? "\r\n" : "");
+  if (buffer == NULL) {
+    printLog(ERR, "Could not build response header.\n");
+    return -1;
+  }
+  
+  // Send the whole response with one write instead of one per piece.
+  wsThreadInfo->responseStarted = true;
+  wsThreadInfo->statusCode = atoi(status);
+  WsIoBuffer response[] = {
+    { buffer, strlen(buffer) },
+    { header, (header != NULL) ? strlen(header) : 0 },
+    { "\r\n", 2 },
+    { body,   (body != NULL) ? bodyLength : 0 },
+  };
+  int numBuffers = (int) (sizeof(response) / sizeof(response[0]));
+  u64 responseLength = 0;
+  for (int i = 0; i < numBuffers; i++) {
+    responseLength += response[i].length;
+  }
+  struct timespec sendStart;
+  wsMonotonicTime(&sendStart);
+  u64 unsent = sendBuffers(response, numBuffers, clientSocket);
+  wsMetricsEndPhase(wsThreadInfo, WS_PHASE_SEND, &sendStart);
+  wsMetricsCountResponse(wsThreadInfo->metrics, atoi(status),
+    responseLength - unsent);
+  wsThreadInfo->bytesOut += responseLength - unsent;
+  if (unsent > 0) {
+    printLog(ERR, "Could not send response to client.\n");
+    return -1;
+  }
+  wsThreadInfo->responseSent = true;
+  
+  printLog(TRACE,
+    "EXIT sendResponseToClient(status=\"%s\", header=%p, body=%p, "
+    "clientSocket=%s) = {%d}\n",
+    status, header, body, socketToString(clientSocket), 0);
+  return 0;
+}
+
+/// @fn char* wsArenaAddEscaped(WsArena *arena, char **buffer, const char *data, u64 length)
+///
+/// @brief Append data to a string allocated from a WsArena, escaped exactly
+/// the way escapeData escapes it.
+///
+/// @param arena The WsArena that *buffer was allocated from.
+/// @param buffer A pointer to the string to append to.
+/// @param data The data to escape.
+/// @param length The number of bytes at data.
+///
+/// @return Returns the updated *buffer on success, NULL on failure.
+char* wsArenaAddEscaped(WsArena *arena, char **buffer,
+  const char *data, u64 length
+) {
+  static const char hexDigits[] = "0123456789ABCDEF";
+  char escaped[256];
+  size_t escapedLength = 0;
+  for (u64 i = 0; i < length; i++) {
+    if (escapedLength > sizeof(escaped) - 4) {
+      escaped[escapedLength] = '\0';
+      if (wsArenaAddStr(arena, buffer, escaped) == NULL) {
+        return NULL;
+      }
+      escapedLength = 0;
+    }
+    
+    unsigned char character = (unsigned char) data[i];
+    if ((character < 32) || (character > 126)
+      || (strchr("%`()\\&\"<>+ ", character) != NULL)
+    ) {
+      escaped[escapedLength++] = '%';
+      escaped[escapedLength++] = hexDigits[character >> 4];
+      escaped[escapedLength++] = hexDigits[character & 0xf];
+    } else {
+      escaped[escapedLength++] = (char) character;
+    }
+  }
+  escaped[escapedLength] = '\0';
+  
+  return wsArenaAddStr(arena, buffer, escaped);
+}
+
+/// @fn char* wsSerializeToJsonInArena(WsArena *arena, WsResponseObject *responseObject)
+///
+/// @brief Serialize a WsResponseObject to the same JSON that listToJson
+/// produces, allocating the string from a WsArena.  A web service can use
+/// this as its serializeToJsonInArena function.
+///
+/// @param arena The WsArena to allocate the JSON from.
+/// @param responseObject The WsResponseObject to serialize.  Its keys must be
+///   strings.
+///
+/// @return Returns the JSON on success.  Returns NULL if the object holds a
+/// value this function doesn't serialize (a nested data structure or a
+/// floating-point number), in which case serializeToJson must be used.
+char* wsSerializeToJsonInArena(WsArena *arena,
+  WsResponseObject *responseObject
+) {
+  if ((arena == NULL) || (responseObject == NULL)) {
+    return NULL;
+  }
+  TypeDescriptor *keyType = responseObject->keyType;
+  if ((keyType != typeString) && (keyType != typeStringNoCopy)
+    && (keyType != typeStringCi) && (keyType != typeStringCiNoCopy)
+  ) {
+    return NULL;
+  }
+  
+  char *json = NULL;
+  wsArenaAddStr(arena, &json, "{\n");
+  for (
+    WsResponseNode *node = responseObject->head;
+    node != NULL;
+    node = node->next
+  ) {
+    wsArenaAddStr(arena, &json, "  \"");
+    wsArenaAddStr(arena, &json, (char*) node->key);
+    wsArenaAddStr(arena, &json, "\": ");
+    
+    TypeDescriptor *type = node->type;
+    const volatile void *value = node->value;
+    char number[32];
+    number[0] = '\0';
+    if ((type == typeString) || (type == typeStringNoCopy)
+      || (type == typeStringCi) || (type == typeStringCiNoCopy)
+    ) {
+      if (value == NULL) {
+        return NULL;
+      }
+      wsArenaAddStr(arena, &json, "\"");
+      wsArenaAddEscaped(arena, &json, (char*) value, strlen((char*) value));
+      wsArenaAddStr(arena, &json, "\"");
+    } else if ((type == typeBytes) || (type == typeBytesNoCopy)) {
+      if (value == NULL) {
+        return NULL;
+      }
+      wsArenaAddStr(arena, &json, "\"");
+      wsArenaAddEscaped(arena, &json,
+        (char*) value, bytesLength((Bytes) value));
+      wsArenaAddStr(arena, &json, "\"");
+    } else if ((type == typePointer) || (type == typePointerNoCopy)) {
+      if (value != NULL) {
+        return NULL;
+      }
+      wsArenaAddStr(arena, &json, "null");
+    } else if (value == NULL) {
+      return NULL;
+    } else if ((type == typeI64) || (type == typeI64NoCopy)) {
+      snprintf(number, sizeof(number), "%lld", lld(*((i64*) value)));
+    } else if ((type == typeI32) || (type == typeI32NoCopy)) {
+      snprintf(number, sizeof(number), "%d", (int) *((i32*) value));
+    } else if ((type == typeI16) || (type == typeI16NoCopy)) {
+      snprintf(number, sizeof(number), "%d", (int) *((i16*) value));
+    } else if ((type == typeI8) || (type == typeI8NoCopy)) {
+      snprintf(number, sizeof(number), "%d", (int) *((i8*) value));
+    } else if ((type == typeU64) || (type == typeU64NoCopy)) {
+      snprintf(number, sizeof(number), "%llu", llu(*((u64*) value)));
+    } else if ((type == typeU32) || (type == typeU32NoCopy)) {
+      snprintf(number, sizeof(number), "%u", (unsigned) *((u32*) value));
+    } else if ((type == typeU16) || (type == typeU16NoCopy)) {
+      snprintf(number, sizeof(number), "%u", (unsigned) *((u16*) value));
+    } else if ((type == typeU8) || (type == typeU8NoCopy)) {
+      snprintf(number, sizeof(number), "%u", (unsigned) *((u8*) value));
+    } else if ((type == typeBool) || (type == typeBoolNoCopy)) {
+      wsArenaAddStr(arena, &json, (*((bool*) value)) ? "true" : "false");
+    } else {
+      // Nested data structures and floating-point numbers are left to the
+      // serializeToJson function.
+      return NULL;
+    }
+    wsArenaAddStr(arena, &json, number);
+    
+    if (node->next != NULL) {
+      wsArenaAddStr(arena, &json, ",\n");
+    }
+  }
+  wsArenaAddStr(arena, &json, "\n}");
+  
+  return json;
+}
+
+/// @fn u64 wsNowMicroseconds(void)
+///
+/// @brief Get the current time in microseconds from a monotonic clock.  Rate
+/// limits, cache lifetimes, and timeouts are measured with this so that
+/// changes to the time of day can't distort them.
+///
+/// @return Returns the number of microseconds since an arbitrary point in the
+/// past.
+u64 wsNowMicroseconds(void) {
+  return traceNowNanoseconds() / 1000;
+}
+
+/// @struct WsResponseCacheEntry
+///
+/// @brief One serialized response of a web service function.
+///
+/// @param key The key of the entry in the cache.  This is the format of the
+///   response followed by the names and values of the parameters that
+///   identify it.
+/// @param body The serialized response.
+/// @param encodedBody The compressed form of body.  NULL if the response isn't
+///   worth compressing.
+/// @param encoding The WsContentEncoding of encodedBody.
+/// @param contentType The Content-Type of the response.
+/// @param expiresUs The wsNowMicroseconds time after which the response may no
+///   longer be served.
+/// @param prev The next more-recently used entry in the cache.
+/// @param next The next less-recently used entry in the cache.
+typedef struct WsResponseCacheEntry {
+  char                        *key;
+  Bytes                        body;
+  Bytes                        encodedBody;
+  WsContentEncoding            encoding;
+  const char                  *contentType;
+  u64                          expiresUs;
+  struct WsResponseCacheEntry *prev;
+  struct WsResponseCacheEntry *next;
+} WsResponseCacheEntry;
+
+/// @struct WsResponseCache
+///
+/// @brief A least-recently-used cache of the serialized responses of one web
+/// service function that's bounded by the number of responses held.
+///
+/// @param lock The mutex that protects the rest of the structure.
+/// @param entries A HashTable of the WsResponseCacheEntry pointers in the
+///   cache keyed by their key strings.
+/// @param head The most-recently used entry in the cache.
+/// @param tail The least-recently used entry in the cache.  This is the next
+///   entry to be evicted.
+/// @param keys The WsCachePolicy's array of the names of the parameters that
+///   identify a response.  NULL if all of them do.
+/// @param ttlUs The number of microseconds a response is served for.
+/// @param maxEntries The maximum number of responses the cache may hold.
+/// @param numEntries The number of responses currently held.
+/// @param generation The number of times the cache has been invalidated.  A
+///   response is only added if no invalidation happened while the function
+///   was producing it.
+/// @param numHits The number of lookups that found a valid entry.
+/// @param numMisses The number of lookups that did not find a valid entry.
+struct WsResponseCache {
+  mtx_t                 lock;
+  HashTable            *entries;
+  WsResponseCacheEntry *head;
+  WsResponseCacheEntry *tail;
+  const char          **keys;
+  u64                   ttlUs;
+  u64                   maxEntries;
+  u64                   numEntries;
+  u64                   generation;
+  u64                   numHits;
+  u64                   numMisses;
+};
+
+/// @fn WsResponseCache* wsResponseCacheCreate(const WsCachePolicy *policy)
+///
+/// @brief Create an empty WsResponseCache.
+///
+/// @param policy The WsCachePolicy of the function whose responses are to be
+///   cached.
+///
+/// @return Returns a pointer to a newly-allocated WsResponseCache on success,
+/// NULL on failure.
+WsResponseCache* wsResponseCacheCreate(const WsCachePolicy *policy) {
+  WsResponseCache *cache
+    = (WsResponseCache*) calloc(1, sizeof(WsResponseCache));
+  if (cache == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  cache->keys = policy->keys;
+  cache->ttlUs = ((u64) ((policy->ttlSeconds > 0)
+    ? policy->ttlSeconds : WS_DEFAULT_RESPONSE_CACHE_TTL_SECONDS)) * 1000000;
+  cache->maxEntries = (u64) ((policy->maxEntries > 0)
+    ? policy->maxEntries : WS_DEFAULT_RESPONSE_CACHE_MAX_ENTRIES);
+  
+  // The cache's lock protects the table, so the table doesn't need its own.
+  cache->entries = htCreate(typeString, /*disableThreadSafety=*/ true);
+  if (cache->entries == NULL) {
+    LOG_MALLOC_FAILURE();
+    cache = (WsResponseCache*) pointerDestroy(cache);
+    return NULL;
+  }
+  if (mtx_init(&cache->lock, mtx_plain) != thrd_success) {
+    printLog(ERR, "Could not initialize response cache mutex.\n");
+    cache->entries = htDestroy(cache->entries);
+    cache = (WsResponseCache*) pointerDestroy(cache);
+    return NULL;
+  }
+  
+  return cache;
+}
+
+/// @fn WsResponseCacheEntry* wsResponseCacheEntryDestroy(WsResponseCacheEntry *entry)
+///
+/// @brief Free a WsResponseCacheEntry and its content.
+///
+/// @param entry A pointer to the WsResponseCacheEntry to free.
+///
+/// @return This function always returns NULL.
+WsResponseCacheEntry* wsResponseCacheEntryDestroy(
+  WsResponseCacheEntry *entry
+) {
+  if (entry != NULL) {
+    entry->key = stringDestroy(entry->key);
+    entry->body = bytesDestroy(entry->body);
+    entry->encodedBody = bytesDestroy(entry->encodedBody);
+    entry = (WsResponseCacheEntry*) pointerDestroy(entry);
+  }
+  
+  return NULL;
+}
+
+/// @fn void wsResponseCacheRemove(WsResponseCache *cache, WsResponseCacheEntry *entry)
+///
+/// @brief Remove an entry from a response cache and free it.  The cache's lock
+/// must be held by the caller.
+///
+/// @param cache A pointer to the WsResponseCache that holds the entry.
+/// @param entry A pointer to the WsResponseCacheEntry to remove.
+void wsResponseCacheRemove(WsResponseCache *cache,
+  WsResponseCacheEntry *entry
+) {
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+  
+  htRemoveEntry(cache->entries, entry->key);
+  cache->numEntries--;
+  entry = wsResponseCacheEntryDestroy(entry);
+}
+
+/// @fn WsResponseCache* wsResponseCacheDestroy(WsResponseCache *cache)
+///
+/// @brief Free a WsResponseCache and all of the entries in it.  No requests may
+/// be using the cache when this is called.
+///
+/// @param cache A pointer to the WsResponseCache to destroy.
+///
+/// @return This function always returns NULL.
+WsResponseCache* wsResponseCacheDestroy(WsResponseCache *cache) {
+  if (cache == NULL) {
+    // Nothing to do.
+    return NULL;
+  }
+  
+  while (cache->head != NULL) {
+    wsResponseCacheRemove(cache, cache->head);
+  }
+  cache->entries = htDestroy(cache->entries);
+  mtx_destroy(&cache->lock);
+  cache = (WsResponseCache*) pointerDestroy(cache);
+  
+  return NULL;
+}
+
+/// @fn char* wsResponseCacheKey(const WsResponseCache *cache, const char *format, const WsRequestObject *params)
+///
+/// @brief Build the key a response is cached under.  The parameters of a
+/// WsRequestObject are kept in sorted order, so the same parameters give the
+/// same key no matter what order the client sent them in.
+///
+/// @param cache A pointer to the WsResponseCache the key is for.
+/// @param format The name of the format the response is serialized in.
+/// @param params The parameters of the call.  May be NULL.
+///
+/// @return Returns a newly-allocated key on success, NULL if one of the
+/// parameters can't be converted to a string or memory allocation fails.
+char* wsResponseCacheKey(const WsResponseCache *cache, const char *format,
+  const WsRequestObject *params
+) {
+  char *key = NULL;
+  straddstr(&key, format);
+  for (const WsRequestNode *node = (params != NULL) ? params->head : NULL;
+    (node != NULL) && (key != NULL);
+    node = node->next
+  ) {
+    const char *name = (const char*) node->key;
+    if (cache->keys != NULL) {
+      const char **keyName = cache->keys;
+      while ((*keyName != NULL) && (strcmp(*keyName, name) != 0)) {
+        keyName++;
+      }
+      if (*keyName == NULL) {
+        // This parameter doesn't identify the response.
+        continue;
+      }
+    }
+    
+    char *value = NULL;
+    if ((node->type != NULL) && (node->type->toString != NULL)) {
+      value = node->type->toString(node->value);
+    }
+    if (value == NULL) {
+      key = stringDestroy(key);
+      break;
+    }
+    // Prefix the name and the value with their lengths so that no two sets of
+    // parameters give the same key.
+    char length[32];
+    snprintf(length, sizeof(length), "\n%llu:", llu(strlen(name)));
+    straddstr(&key, length);
+    straddstr(&key, name);
+    snprintf(length, sizeof(length), "\n%llu:", llu(strlen(value)));
+    straddstr(&key, length);
+    straddstr(&key, value);
+    value = stringDestroy(value);
+  }
+  
+  return key;
+}
+
+/// @fn void wsResponseCacheAdd(WsThreadInfo *wsThreadInfo, const char *contentType, const void *body, u64 bodyLength)
+///
+/// @brief Add the serialized response to the current request to the response
+/// cache of the function that produced it, evicting the least-recently used
+/// response if the cache is full.  Does nothing if the response isn't to be
+/// cached.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param contentType The Content-Type of the response.
+/// @param body The serialized response.
+/// @param bodyLength The number of bytes at body.
+void wsResponseCacheAdd(WsThreadInfo *wsThreadInfo, const char *contentType,
+  const void *body, u64 bodyLength
+) {
+  WsResponseCache *cache = wsThreadInfo->responseCache;
+  const char *key = wsThreadInfo->responseCacheKey;
+  wsThreadInfo->responseCache = NULL;
+  wsThreadInfo->responseCacheKey = NULL;
+  if ((cache == NULL) || (key == NULL) || (contentType == NULL)
+    || (body == NULL) || (bodyLength == 0)
+  ) {
+    // Nothing to do.
+    return;
+  }
+  
+  WsResponseCacheEntry *entry
+    = (WsResponseCacheEntry*) calloc(1, sizeof(WsResponseCacheEntry));
+  if (entry != NULL) {
+    straddstr(&entry->key, key);
+    bytesAddData(&entry->body, body, bodyLength);
+  }
+  if ((entry == NULL) || (entry->key == NULL) || (entry->body == NULL)) {
+    LOG_MALLOC_FAILURE();
+    entry = wsResponseCacheEntryDestroy(entry);
+    return;
+  }
+  entry->contentType = contentType;
+  
+  // Compress the response once now so that hits don't have to.  Use the
+  // coding this client asked for, or gzip if it didn't ask for one.
+  if ((wsThreadInfo->compressionLevel > 0)
+    && (bodyLength >= (u64) wsThreadInfo->compressionMinBytes)
+    && (wsIsCompressible(contentType))
+  ) {
+    entry->encoding = wsNegotiateContentEncoding(wsHttpRequestGetHeader(
+      &wsThreadInfo->httpRequest, "Accept-Encoding"));
+    if (entry->encoding == WS_ENCODING_IDENTITY) {
+      entry->encoding = WS_ENCODING_GZIP;
+    }
+    entry->encodedBody = wsCompressBytes(body, (size_t) bodyLength,
+      entry->encoding, wsThreadInfo->compressionLevel);
+    if ((entry->encodedBody != NULL)
+      && (bytesLength(entry->encodedBody) >= bodyLength)
+    ) {
+      // Not worth it.
+      entry->encodedBody = bytesDestroy(entry->encodedBody);
+    }
+  }
+  entry->expiresUs = wsNowMicroseconds() + cache->ttlUs;
+  
+  mtx_lock(&cache->lock);
+  if (cache->generation != wsThreadInfo->responseCacheGeneration) {
+    // The cache was invalidated while the function was running, so the
+    // response may already be out of date.
+    entry = wsResponseCacheEntryDestroy(entry);
+    mtx_unlock(&cache->lock);
+    return;
+  }
+  WsResponseCacheEntry *existing
+    = (WsResponseCacheEntry*) htGetValue(cache->entries, entry->key);
+  if (existing != NULL) {
+    // Another thread made the same call at the same time.  The newer response
+    // wins.
+    wsResponseCacheRemove(cache, existing);
+  }
+  while ((cache->tail != NULL) && (cache->numEntries >= cache->maxEntries)) {
+    wsResponseCacheRemove(cache, cache->tail);
+  }
+  
+  if (htAddEntry(cache->entries, entry->key, entry, typePointerNoCopy)
+    != NULL
+  ) {
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+      cache->head->prev = entry;
+    } else {
+      cache->tail = entry;
+    }
+    cache->head = entry;
+    cache->numEntries++;
+  } else {
+    LOG_MALLOC_FAILURE();
+    entry = wsResponseCacheEntryDestroy(entry);
+  }
+  mtx_unlock(&cache->lock);
+}
+
+/// @fn int sendResponseObjectToClient(WsThreadInfo *wsThreadInfo, const char *functionName, WsResponseObject *outputParams)
+///
+/// @brief Send the contents of the provided WsResponseObject to the client.
+///
+/// @param wsThreadInfo A pointer to the WsThreadInfo
+///   structure passed to this thread.
+/// @param functionName The name of the function that generated the response
+///   object.
+/// @param outputParams The WsResponseObject generated by a call to a web
+///   service function.
+///
+/// @return Returns 0 on success, any other value is failure.
+int sendResponseObjectToClient(WsThreadInfo *wsThreadInfo,
+  const char *functionName, WsResponseObject *outputParams
+) {
+  printLog(TRACE,
+    "ENTER sendResponseObjectToClient(wsThreadInfo=%p, "
+    "functionName=\"%s\", outputParams=%p)\n", wsThreadInfo,
+    functionName, outputParams);
+  
+  WsArena *arena = &wsThreadInfo->arena;
+  char *header = NULL;
+  Bytes body = NULL;
+  const char *arenaBody = NULL;
+  u64 bodyLength = 0;
+  struct timespec serializeStart;
+  wsMonotonicTime(&serializeStart);
+  
+  if (wsThreadInfo->webService.getResponseValue(
+    outputParams, "Content-Type") == NULL
+  ) {
+    // need to serialize outputParams for the response
+    const char *contentType
+      = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Content-Type");
+    const char *responseContentType = NULL;
+    if ((contentType == NULL) || (strstr(contentType, "application/json"))) {
+      responseContentType = "application/json; charset=utf-8";
+      if (wsThreadInfo->webService.serializeToJsonInArena != NULL) {
+        arenaBody = wsThreadInfo->webService.serializeToJsonInArena(
+          arena, outputParams);
+      }
+      if (arenaBody != NULL) {
+        bodyLength = strlen(arenaBody);
+        if (wsResponseEncoding(wsThreadInfo, responseContentType, bodyLength)
+          != WS_ENCODING_IDENTITY
+        ) {
+          // Compression works on Bytes.
+          bytesAddData(&body, arenaBody, bodyLength);
+          arenaBody = NULL;
+        }
+      } else {
+        body = wsThreadInfo->webService.serializeToJson(outputParams);
+      }
+    } else if (strstr(contentType, "text/xml")) {
+      body = wsThreadInfo->webService.serializeToXml(
+        functionName, outputParams, "Response");
+      responseContentType = "application/soap+xml; charset=utf-8";
+    } // else we have no parser for this body
+    
+    // Cache the response (if it's to be cached) before it's compressed for
+    // this client.
+    if (wsThreadInfo->responseCache != NULL) {
+      wsResponseCacheAdd(wsThreadInfo, responseContentType,
+        (arenaBody != NULL) ? (const void*) arenaBody : (const void*) body,
+        (arenaBody != NULL) ? bodyLength : bytesLength(body));
+    }
+    
+    const char *contentEncoding = NULL;
+    if (arenaBody == NULL) {
+      contentEncoding = wsCompressBody(wsThreadInfo, responseContentType, &body);
+      bodyLength = bytesLength(body);
+    }
+    header = wsArenaPrintf(arena, "Content-Length: %llu\r\n", llu(bodyLength));
+    if (responseContentType != NULL) {
+      wsArenaAddStr(arena, &header, "Content-Type: ");
+      wsArenaAddStr(arena, &header, responseContentType);
+      wsArenaAddStr(arena, &header, "\r\n");
+    }
+    if (contentEncoding != NULL) {
+      wsArenaAddStr(arena, &header, "Content-Encoding: ");
+      wsArenaAddStr(arena, &header, contentEncoding);
+      wsArenaAddStr(arena, &header, "\r\n");
+    }
+  } else {
+    // response is fully-defined in outputParams
+    body = (Bytes) wsThreadInfo->webService.getResponseValue(
+      outputParams, "body");
+    const char *contentEncoding = NULL;
+    if (wsThreadInfo->webService.getResponseValue(
+      outputParams, "Content-Encoding") == NULL
+    ) {
+      contentEncoding = wsCompressBody(wsThreadInfo,
+        (char*) wsThreadInfo->webService.getResponseValue(
+          outputParams, "Content-Type"),
+        &body);
+    } // else the function already encoded the body itself
+    bodyLength = bytesLength(body);
+    header = wsArenaPrintf(arena, "Content-Length: %llu\r\n", llu(bodyLength));
+    if (contentEncoding != NULL) {
+      wsArenaAddStr(arena, &header, "Content-Encoding: ");
+      wsArenaAddStr(arena, &header, contentEncoding);
+      wsArenaAddStr(arena, &header, "\r\n");
+    }
+    u32 bodyU32 = *((u32*) "body");
+    
+    // Fill the rest of the header parameters provided.
+    for (
+      WsResponseNode *node = outputParams->head;
+      node != NULL;
+      node = node->next
+    ) {
+      if (*((u32*) node->key) == bodyU32) {
+        // This is the body node.  We've already accounted for that.  Skip it.
+        // We do need to mark the value pointer to NULL, though, so that we
+        // don't try to free it twice.
+        node->value = NULL;
+        continue;
+      }
+      
+      wsArenaAddStr(arena, &header, (char*) node->key);
+      wsArenaAddStr(arena, &header, ": ");
+      wsArenaAddStr(arena, &header, (char*) node->value);
+      wsArenaAddStr(arena, &header, "\r\n");
+    }
+  }
+  
+  wsArenaAddStr(arena, &header, "Server: ");
+  wsArenaAddStr(arena, &header, wsThreadInfo->serverName);
+  wsArenaAddStr(arena, &header, "\r\n");
+  wsMetricsEndPhase(wsThreadInfo, WS_PHASE_SERIALIZE, &serializeStart);
+  int returnValue = sendResponseToClient(wsThreadInfo, "200 OK", header,
+    (arenaBody != NULL) ? (const void*) arenaBody : (const void*) body,
+    bodyLength);
+  body = bytesDestroy(body);
+  
+  printLog(TRACE,
+    "EXIT sendResponseObjectToClient(wsThreadInfo=%p, "
+    "functionName=\"%s\", outputParams=%p) = {%d}\n", wsThreadInfo,
+    functionName, outputParams, returnValue);
+  return returnValue;
+}
+
+/// @def WS_RESPONSE_WRITER_FLUSH_BYTES
+///
+/// @brief The number of bytes a WsResponseWriter collects before it sends them
+/// as one chunk.  Functions that stream row by row would otherwise put a few
+/// dozen bytes in each chunk and pay the framing and system call for each.
+#define WS_RESPONSE_WRITER_FLUSH_BYTES (16 * 1024)
+
+/// @struct WsResponseWriter
+///
+/// @brief The state of a response that a WsFunction streams to the client
+/// piece by piece instead of returning as a WsResponseObject.
+///
+/// @param wsThreadInfo The WsThreadInfo of the connection the response is
+///   being sent on.  NULL for a call of a batch made on a worker thread.
+/// @param batchCall The WsBatchCall the function was called for, NULL if it
+///   wasn't called for a batch.  Such responses can't be streamed.
+/// @param pending The body bytes (compressed, if compressing is set) that
+///   have not been sent yet.
+/// @param compressor The WsCompressor for the body if compressing is set.
+/// @param compressing Whether or not the body is being compressed.
+/// @param chunked Whether or not the body is being sent with the chunked
+///   transfer coding.  HTTP/1.0 clients get the body delimited by the close of
+///   the connection instead.
+/// @param started Whether or not wsResponseWriterStart has sent the header.
+/// @param finished Whether or not wsResponseWriterFinish has been called.
+/// @param failed Whether or not sending some part of the response failed.
+struct WsResponseWriter {
+  WsThreadInfo *wsThreadInfo;
+  WsBatchCall  *batchCall;
+  Bytes         pending;
+  WsCompressor  compressor;
+  bool          compressing;
+  bool          chunked;
+  bool          started;
+  bool          finished;
+  bool          failed;
+};
+
+/// @fn void wsResponseWriterInit(WsResponseWriter *responseWriter, WsThreadInfo *wsThreadInfo, WsBatchCall *batchCall)
+///
+/// @brief Prepare a WsResponseWriter for a call to a WsFunction.
+///
+/// @param responseWriter A pointer to the WsResponseWriter to initialize.
+/// @param wsThreadInfo The WsThreadInfo of the connection the function is
+///   being called for.  NULL for a call of a batch made on a worker thread.
+/// @param batchCall The WsBatchCall the function is being called for, NULL if
+///   it isn't being called for a batch.
+void wsResponseWriterInit(WsResponseWriter *responseWriter,
+  WsThreadInfo *wsThreadInfo, WsBatchCall *batchCall
+) {
+  memset(responseWriter, 0, sizeof(*responseWriter));
+  responseWriter->wsThreadInfo = wsThreadInfo;
+  responseWriter->batchCall = batchCall;
+}
+
+/// @fn int wsResponseWriterStart(WsResponseWriter *responseWriter, const char *status, const char *contentType)
+///
+/// @brief Send the header of a streamed response.  The body follows with
+/// calls to wsResponseWriterWrite and is completed by wsResponseWriterFinish.
+/// The body is compressed if the client accepts it and the content type is
+/// worth compressing.
+///
+/// @param responseWriter The WsResponseWriter from the WsConnectionInfo
+///   passed to the WsFunction.
+/// @param status The status code and reason phrase of the response (e.g.
+///   "200 OK").
+/// @param contentType The value of the Content-Type header of the response.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsResponseWriterStart(WsResponseWriter *responseWriter,
+  const char *status, const char *contentType
+) {
+  if ((responseWriter == NULL) || (status == NULL) || (contentType == NULL)) {
+    printLog(ERR, "One or more NULL parameters.\n");
+    return -1;
+  } else if (responseWriter->started) {
+    printLog(ERR, "Response has already been started.\n");
+    return -1;
+  }
+  if (responseWriter->batchCall != NULL) {
+    printLog(ERR, "Responses to the calls of a batch can't be streamed.\n");
+    return -1;
+  }
+  WsThreadInfo *wsThreadInfo = responseWriter->wsThreadInfo;
+  printLog(TRACE, "ENTER wsResponseWriterStart(status=\"%s\", "
+    "contentType=\"%s\")\n", status, contentType);
+  
+  const char *protocol
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "_httpProtocol");
+  responseWriter->chunked
+    = ((protocol != NULL) && (strcmp(protocol, "HTTP/1.1") == 0));
+  if (responseWriter->chunked == false) {
+    // The end of the body will be marked by closing the connection.
+    wsThreadInfo->keepAlive = false;
+  }
+  
+  // The length of the body isn't known yet.  Anything being streamed is
+  // presumably large, so only the type and the client decide.
+  WsContentEncoding encoding = wsResponseEncoding(wsThreadInfo, contentType,
+    (u64) wsThreadInfo->compressionMinBytes);
+  if ((encoding != WS_ENCODING_IDENTITY)
+    && (wsCompressorInit(&responseWriter->compressor, encoding,
+      wsThreadInfo->compressionLevel) == 0)
+  ) {
+    responseWriter->compressing = true;
+  }
+  
+  WsArena *arena = &wsThreadInfo->arena;
+  char *header = NULL;
+  wsArenaAddStr(arena, &header, "Content-Type: ");
+  wsArenaAddStr(arena, &header, contentType);
+  wsArenaAddStr(arena, &header, "\r\n");
+  if (responseWriter->compressing) {
+    wsArenaAddStr(arena, &header, "Content-Encoding: ");
+    wsArenaAddStr(arena, &header, wsContentEncodingNames[encoding]);
+    wsArenaAddStr(arena, &header, "\r\n");
+  }
+  if (responseWriter->chunked) {
+    wsArenaAddStr(arena, &header, "Transfer-Encoding: chunked\r\n");
+  }
+  wsArenaAddStr(arena, &header, "Server: ");
+  wsArenaAddStr(arena, &header, wsThreadInfo->serverName);
+  wsArenaAddStr(arena, &header, "\r\n");
+  
+  responseWriter->started = true;
+  int returnValue = 0;
+  if (sendResponseToClient(wsThreadInfo, status, header, NULL, 0) != 0) {
+    responseWriter->failed = true;
+    returnValue = -1;
+  }
+  // Only the header is out.  The response isn't complete until
+  // wsResponseWriterFinish succeeds.
+  wsThreadInfo->responseSent = false;
+  
+  printLog(TRACE, "EXIT wsResponseWriterStart(status=\"%s\", "
+    "contentType=\"%s\") = {%d}\n", status, contentType, returnValue);
+  return returnValue;
+}
+
+/// @fn int wsResponseWriterFlush(WsResponseWriter *responseWriter)
+///
+/// @brief Send the body bytes a WsResponseWriter has collected so far.  When
+/// the body is compressed, data the compressor is still holding is sent on a
+/// later flush.
+///
+/// @param responseWriter The WsResponseWriter passed to the WsFunction.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsResponseWriterFlush(WsResponseWriter *responseWriter) {
+  if ((responseWriter == NULL) || (responseWriter->started == false)
+    || (responseWriter->failed)
+  ) {
+    return -1;
+  }
+  
+  u64 pendingLength = bytesLength(responseWriter->pending);
+  if (pendingLength == 0) {
+    // Nothing to do.
+    return 0;
+  }
+  
+  Socket *clientSocket = responseWriter->wsThreadInfo->clientSocket;
+  int returnValue = 0;
+  if (responseWriter->chunked) {
+    returnValue = wsSendChunk(clientSocket,
+      responseWriter->pending, pendingLength);
+  } else if (sendBuffer(responseWriter->pending, clientSocket) > 0) {
+    returnValue = -1;
+  }
+  if (returnValue != 0) {
+    printLog(ERR, "Could not send response body to client.\n");
+    responseWriter->failed = true;
+  } else {
+    wsMetricsCountBytesOut(responseWriter->wsThreadInfo->metrics,
+      pendingLength);
+    responseWriter->wsThreadInfo->bytesOut += pendingLength;
+  }
+  bytesSetLength(responseWriter->pending, 0);
+  
+  return returnValue;
+}
+
+/// @fn int wsResponseWriterWrite(WsResponseWriter *responseWriter, const void *data, u64 length)
+///
+/// @brief Add data to the body of a streamed response.  Data is sent to the
+/// client in pieces of about WS_RESPONSE_WRITER_FLUSH_BYTES, so memory use
+/// doesn't depend on the size of the body.
+///
+/// @param responseWriter The WsResponseWriter passed to the WsFunction.
+/// @param data The data to add.
+/// @param length The number of bytes at data.
+///
+/// @return Returns 0 on success, -1 on failure.  Once a write fails the client
+/// is gone and the function should stop producing data.
+int wsResponseWriterWrite(WsResponseWriter *responseWriter,
+  const void *data, u64 length
+) {
+  if ((responseWriter == NULL) || (responseWriter->started == false)
+    || (responseWriter->finished) || (responseWriter->failed)
+  ) {
+    return -1;
+  } else if ((data == NULL) || (length == 0)) {
+    // Nothing to do.
+    return 0;
+  }
+  
+  if (responseWriter->compressing) {
+    if (wsCompressorWrite(&responseWriter->compressor, data, (size_t) length,
+      false, &responseWriter->pending) != 0
+    ) {
+      responseWriter->failed = true;
+      return -1;
+    }
+  } else {
+    bytesAddData(&responseWriter->pending, data, length);
+  }
+  
+  if (bytesLength(responseWriter->pending) >= WS_RESPONSE_WRITER_FLUSH_BYTES) {
+    return wsResponseWriterFlush(responseWriter);
+  }
+  
+  return 0;
+}
+
+/// @fn int wsResponseWriterWriteString(WsResponseWriter *responseWriter, const char *string)
+///
+/// @brief Add a string to the body of a streamed response.
+///
+/// @param responseWriter The WsResponseWriter passed to the WsFunction.
+/// @param string The NUL-terminated string to add.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsResponseWriterWriteString(WsResponseWriter *responseWriter,
+  const char *string
+) {
+  return wsResponseWriterWrite(responseWriter,
+    string, strlen(strOrEmpty(string)));
+}
+
+/// @fn int wsResponseWriterFinish(WsResponseWriter *responseWriter)
+///
+/// @brief Complete a streamed response.  This is called automatically when
+/// the WsFunction returns if the function didn't call it.
+///
+/// @param responseWriter The WsResponseWriter passed to the WsFunction.
+///
+/// @return Returns 0 if the complete response was sent, -1 on failure.
+int wsResponseWriterFinish(WsResponseWriter *responseWriter) {
+  if ((responseWriter == NULL) || (responseWriter->started == false)) {
+    return -1;
+  } else if (responseWriter->finished) {
+    return (responseWriter->failed) ? -1 : 0;
+  }
+  responseWriter->finished = true;
+  
+  if (responseWriter->compressing) {
+    if ((responseWriter->failed == false)
+      && (wsCompressorWrite(&responseWriter->compressor, NULL, 0,
+        true, &responseWriter->pending) != 0)
+    ) {
+      responseWriter->failed = true;
+    }
+    wsCompressorEnd(&responseWriter->compressor);
+  }
+  wsResponseWriterFlush(responseWriter);
+  if ((responseWriter->chunked) && (responseWriter->failed == false)
+    && (wsSendChunk(responseWriter->wsThreadInfo->clientSocket, NULL, 0) != 0)
+  ) {
+    responseWriter->failed = true;
+  }
+  responseWriter->pending = bytesDestroy(responseWriter->pending);
+  responseWriter->wsThreadInfo->responseSent
+    = (responseWriter->failed == false);
+  
+  return (responseWriter->failed) ? -1 : 0;
+}
+
+/// @struct WsRoute
+///
+/// @brief One web service function in a WsRouteTable.
+///
+/// @param key The "namespace/function" string the function is called by.
+///   NULL if the slot in the table is empty.
+/// @param keyLength The number of bytes in key.
+/// @param hash The hash of key.
+/// @param functionName The function name part of key.
+/// @param function The WsFunction to call.
+/// @param metrics The WsRouteMetrics that the function's requests are timed
+///   in.
+/// @param cache The WsResponseCache of the function's responses.  NULL if the
+///   function's responses aren't cached.
+typedef struct WsRoute {
+  const char      *key;
+  u32              keyLength;
+  u32              hash;
+  const char      *functionName;
+  WsFunction       function;
+  WsRouteMetrics  *metrics;
+  WsResponseCache *cache;
+} WsRoute;
+
+/// @struct WsRouteTable
+///
+/// @brief Every function of a WebService in one open-addressed hash table
+/// keyed by "namespace/function".  The table is built once by wsInit and is
+/// never modified afterward, so any number of threads may search it without
+/// locking.  The response caches of the routes have their own locks.
+///
+/// @param slots The array of mask + 1 WsRoutes.  At most half of them are
+///   used so that probe sequences stay short.
+/// @param mask The number of slots minus one.  The number of slots is a power
+///   of two.
+/// @param numRoutes The number of slots that are in use.
+/// @param keys The storage for the keys of all the routes.
+/// @param metrics The storage for the WsRouteMetrics of all the routes.
+struct WsRouteTable {
+  WsRoute        *slots;
+  u32             mask;
+  u32             numRoutes;
+  char           *keys;
+  WsRouteMetrics *metrics;
+};
+
+/// @fn u32 wsRouteHash(const char *key, size_t keyLength)
+///
+/// @brief Compute the 32-bit FNV-1a hash of a route key.
+///
+/// @param key The bytes of the key.  Does not need to be NUL-terminated.
+/// @param keyLength The number of bytes in key.
+///
+/// @return Returns the hash of the key.
+u32 wsRouteHash(const char *key, size_t keyLength) {
+  u32 hash = 2166136261U;
+  for (size_t i = 0; i < keyLength; i++) {
+    hash ^= (u8) key[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+/// @fn WsRouteTable* wsRouteTableDestroy(WsRouteTable *routeTable)
+///
+/// @brief Free a WsRouteTable and everything it holds.
+///
+/// @param routeTable The WsRouteTable to destroy.
+///
+/// @return This function always returns NULL.
+WsRouteTable* wsRouteTableDestroy(WsRouteTable *routeTable) {
+  if (routeTable == NULL) {
+    return NULL;
+  }
+  
+  for (u32 slot = 0; (routeTable->slots != NULL) && (slot <= routeTable->mask);
+    slot++
+  ) {
+    routeTable->slots[slot].cache
+      = wsResponseCacheDestroy(routeTable->slots[slot].cache);
+  }
+  routeTable->keys = stringDestroy(routeTable->keys);
+  routeTable->metrics = (WsRouteMetrics*) pointerDestroy(routeTable->metrics);
+  routeTable->slots = (WsRoute*) pointerDestroy(routeTable->slots);
+  routeTable = (WsRouteTable*) pointerDestroy(routeTable);
+  return NULL;
+}
+
+/// @fn WsRouteTable* wsRouteTableCreate(const WsNamespace *namespaces)
+///
+/// @brief Compile the functions of a WebService into a WsRouteTable.  If the
+/// same function is defined more than once in a namespace, the first
+/// definition is used.
+///
+/// @param namespaces The WebService's array of WsNamespaces, terminated by a
+///   WsNamespace with a NULL name.
+///
+/// @return Returns a newly-allocated WsRouteTable on success, NULL on failure.
+WsRouteTable* wsRouteTableCreate(const WsNamespace *namespaces) {
+  if (namespaces == NULL) {
+    return NULL;
+  }
+  
+  // Size everything up front so that the table is built in three
+  // allocations.
+  u32 numFunctions = 0;
+  size_t keysSize = 0;
+  for (const WsNamespace *wsNamespace = namespaces;
+    wsNamespace->name != NULL;
+    wsNamespace++
+  ) {
+    for (WsFunctionDescriptor **wsFdList = wsNamespace->functionDescriptors;
+      *wsFdList != NULL;
+      wsFdList++
+    ) {
+      for (WsFunctionDescriptor *wsFdCommand = *wsFdList;
+        wsFdCommand->name != NULL;
+        wsFdCommand++
+      ) {
+        numFunctions++;
+        keysSize
+          += strlen(wsNamespace->name) + 1 + strlen(wsFdCommand->name) + 1;
+      }
+    }
+  }
+  u32 numSlots = 16;
+  while (numSlots < 2 * numFunctions) {
+    numSlots <<= 1;
+  }
+  
+  WsRouteTable *routeTable
+    = (WsRouteTable*) calloc(1, sizeof(WsRouteTable));
+  if (routeTable == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  routeTable->slots = (WsRoute*) calloc(numSlots, sizeof(WsRoute));
+  routeTable->keys = (char*) malloc(keysSize + 1);
+  routeTable->metrics = (WsRouteMetrics*) calloc(
+    (numFunctions > 0) ? numFunctions : 1, sizeof(WsRouteMetrics));
+  if ((routeTable->slots == NULL) || (routeTable->keys == NULL)
+    || (routeTable->metrics == NULL)
+  ) {
+    LOG_MALLOC_FAILURE();
+    routeTable = wsRouteTableDestroy(routeTable);
+    return NULL;
+  }
+  routeTable->mask = numSlots - 1;
+  
+  char *key = routeTable->keys;
+  for (const WsNamespace *wsNamespace = namespaces;
+    wsNamespace->name != NULL;
+    wsNamespace++
+  ) {
+    size_t namespaceLength = strlen(wsNamespace->name);
+    for (WsFunctionDescriptor **wsFdList = wsNamespace->functionDescriptors;
+      *wsFdList != NULL;
+      wsFdList++
+    ) {
+      for (WsFunctionDescriptor *wsFdCommand = *wsFdList;
+        wsFdCommand->name != NULL;
+        wsFdCommand++
+      ) {
+        size_t keyLength
+          = namespaceLength + 1 + strlen(wsFdCommand->name);
+        sprintf(key, "%s/%s", wsNamespace->name, wsFdCommand->name);
+        u32 hash = wsRouteHash(key, keyLength);
+        
+        u32 slot = hash & routeTable->mask;
+        while ((routeTable->slots[slot].key != NULL)
+          && ((routeTable->slots[slot].keyLength != keyLength)
+            || (memcmp(routeTable->slots[slot].key, key, keyLength) != 0))
+        ) {
+          slot = (slot + 1) & routeTable->mask;
+        }
+        WsRoute *route = &routeTable->slots[slot];
+        if (route->key != NULL) {
+          printLog(WARN, "Function \"%s\" is defined more than once.  "
+            "Using the first definition.\n", key);
+          continue;
+        }
+        route->key = key;
+        route->keyLength = (u32) keyLength;
+        route->hash = hash;
+        route->functionName = key + namespaceLength + 1;
+        route->function = wsFdCommand->pointer;
+        route->metrics = &routeTable->metrics[routeTable->numRoutes];
+        routeTable->numRoutes++;
+        key += keyLength + 1;
+        
+        const WsCachePolicy *cachePolicy = wsFdCommand->cachePolicy;
+        if ((cachePolicy != NULL) && (cachePolicy->ttlSeconds >= 0)
+          && (cachePolicy->maxEntries >= 0)
+        ) {
+          route->cache = wsResponseCacheCreate(cachePolicy);
+          if (route->cache == NULL) {
+            routeTable = wsRouteTableDestroy(routeTable);
+            return NULL;
+          }
+        }
+      }
+    }
+  }
+  
+  return routeTable;
+}
+
+/// @fn const WsRoute* wsRouteTableFind(const WsRouteTable *routeTable, const char *key, size_t keyLength)
+///
+/// @brief Find the route for a "namespace/function" string.  Nothing is
+/// allocated, so key can point directly into a received request.
+///
+/// @param routeTable The WsRouteTable to search.
+/// @param key The bytes of the key.  Does not need to be NUL-terminated.
+/// @param keyLength The number of bytes in key.
+///
+/// @return Returns the matching WsRoute on success, NULL if there is no such
+/// function.
+const WsRoute* wsRouteTableFind(const WsRouteTable *routeTable,
+  const char *key, size_t keyLength
+) {
+  if ((routeTable == NULL) || (key == NULL)) {
+    return NULL;
+  }
+  
+  u32 hash = wsRouteHash(key, keyLength);
+  for (u32 slot = hash & routeTable->mask;
+    routeTable->slots[slot].key != NULL;
+    slot = (slot + 1) & routeTable->mask
+  ) {
+    const WsRoute *route = &routeTable->slots[slot];
+    if ((route->hash == hash) && (route->keyLength == keyLength)
+      && (memcmp(route->key, key, keyLength) == 0)
+    ) {
+      return route;
+    }
+  }
+  
+  return NULL;
+}
+
+/// @fn const WsRoute* wsRouteTableFindPath(const WsRouteTable *routeTable, const char *path)
+///
+/// @brief Find the route for the path of a request.  The route key is the part
+/// of the path between its first slash and its query string (if any).
+///
+/// @param routeTable The WsRouteTable to search.
+/// @param path The path from the request line.
+///
+/// @return Returns the matching WsRoute on success, NULL if the path does not
+/// name a function.
+const WsRoute* wsRouteTableFindPath(const WsRouteTable *routeTable,
+  const char *path
+) {
+  const char *routeKey = strchr(path, '/');
+  const char *queryString = strchr(path, '?');
+  if ((routeKey == NULL)
+    || ((queryString != NULL) && (routeKey > queryString))
+  ) {
+    return NULL;
+  }
+  routeKey++;
+  if (routeKey[0] == '/') {
+    // The namespace is empty.
+    return NULL;
+  }
+  
+  size_t keyLength = (queryString != NULL)
+    ? (size_t) (queryString - routeKey) : strlen(routeKey);
+  return wsRouteTableFind(routeTable, routeKey, keyLength);
+}
+
+/// @fn WsFunction wsRouteTableGetFunction(const WsRouteTable *routeTable, const char *key, size_t keyLength)
+///
+/// @brief Get the function for a "namespace/function" string.
+///
+/// @param routeTable The WsRouteTable to search.
+/// @param key The bytes of the key.  Does not need to be NUL-terminated.
+/// @param keyLength The number of bytes in key.
+///
+/// @return Returns the matching WsFunction on success, NULL if there is no
+/// such function.
+WsFunction wsRouteTableGetFunction(const WsRouteTable *routeTable,
+  const char *key, size_t keyLength
+) {
+  const WsRoute *route = wsRouteTableFind(routeTable, key, keyLength);
+  return (route != NULL) ? route->function : NULL;
+}
+
+/// @fn bool wsResponseCacheServe(WsThreadInfo *wsThreadInfo, const WsRoute *route, const WsRequestObject *inputParams)
+///
+/// @brief Send the cached response to a call to a web service function if
+/// there is one.  If there isn't, wsThreadInfo is set up so that
+/// sendResponseObjectToClient adds the response the function returns to the
+/// cache.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param route The WsRoute found for the request, or NULL if no function
+///   matched.
+/// @param inputParams The parameters of the call.  May be NULL.
+///
+/// @return Returns true if a cached response was sent (or sending it failed),
+/// false if the function needs to be called.
+bool wsResponseCacheServe(WsThreadInfo *wsThreadInfo, const WsRoute *route,
+  const WsRequestObject *inputParams
+) {
+  wsThreadInfo->responseCache = NULL;
+  wsThreadInfo->responseCacheKey = NULL;
+  WsResponseCache *cache = (route != NULL) ? route->cache : NULL;
+  if (cache == NULL) {
+    // Nothing to do.
+    return false;
+  }
+  
+  // Responses are serialized in the format of the request, so the format is
+  // part of the key.
+  const char *contentType
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Content-Type");
+  const char *format = NULL;
+  if ((contentType == NULL) || (strstr(contentType, "application/json"))) {
+    format = "json";
+  } else if (strstr(contentType, "text/xml")) {
+    format = "xml";
+  } else {
+    // There's no serialized response to cache.
+    return false;
+  }
+  char *key = wsResponseCacheKey(cache, format, inputParams);
+  if (key == NULL) {
+    // The call can't be identified.  Make it.
+    return false;
+  }
+  
+  WsArena *arena = &wsThreadInfo->arena;
+  void *body = NULL;
+  u64 bodyLength = 0;
+  const char *responseContentType = NULL;
+  const char *contentEncoding = NULL;
+  mtx_lock(&cache->lock);
+  WsResponseCacheEntry *entry
+    = (WsResponseCacheEntry*) htGetValue(cache->entries, key);
+  if ((entry != NULL) && (entry->expiresUs <= wsNowMicroseconds())) {
+    wsResponseCacheRemove(cache, entry);
+    entry = NULL;
+  }
+  if (entry != NULL) {
+    // Move the entry to the front of the list.
+    if (entry != cache->head) {
+      entry->prev->next = entry->next;
+      if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+      } else {
+        cache->tail = entry->prev;
+      }
+      entry->prev = NULL;
+      entry->next = cache->head;
+      cache->head->prev = entry;
+      cache->head = entry;
+    }
+    
+    Bytes content = entry->body;
+    if ((entry->encodedBody != NULL)
+      && (wsResponseEncoding(wsThreadInfo, entry->contentType,
+        bytesLength(entry->body)) == entry->encoding)
+    ) {
+      content = entry->encodedBody;
+      contentEncoding = wsContentEncodingNames[entry->encoding];
+    }
+    // Copy the response so that the lock isn't held while it's sent.
+    bodyLength = bytesLength(content);
+    body = wsArenaAlloc(arena, (size_t) bodyLength);
+    if (body != NULL) {
+      memcpy(body, content, (size_t) bodyLength);
+      responseContentType = entry->contentType;
+    }
+  }
+  if (body != NULL) {
+    cache->numHits++;
+  } else {
+    cache->numMisses++;
+    wsThreadInfo->responseCacheGeneration = cache->generation;
+  }
+  mtx_unlock(&cache->lock);
+  
+  if (body == NULL) {
+    // Have sendResponseObjectToClient add the response the function returns.
+    wsThreadInfo->responseCacheKey = wsArenaStrdup(arena, key);
+    if (wsThreadInfo->responseCacheKey != NULL) {
+      wsThreadInfo->responseCache = cache;
+    }
+    key = stringDestroy(key);
+    return false;
+  }
+  key = stringDestroy(key);
+  
+  wsThreadInfo->routeMetrics = route->metrics;
+  char *header = wsArenaPrintf(arena,
+    "Content-Length: %llu\r\nContent-Type: %s\r\n",
+    llu(bodyLength), responseContentType);
+  if (contentEncoding != NULL) {
+    wsArenaAddStr(arena, &header, "Content-Encoding: ");
+    wsArenaAddStr(arena, &header, contentEncoding);
+    wsArenaAddStr(arena, &header, "\r\n");
+  }
+  wsArenaAddStr(arena, &header, "Server: ");
+  wsArenaAddStr(arena, &header, wsThreadInfo->serverName);
+  wsArenaAddStr(arena, &header, "\r\n");
+  sendResponseToClient(wsThreadInfo, "200 OK", header, body, bodyLength);
+  
+  return true;
+}
+
+/// @fn int wsResponseCacheInvalidate(WsConnectionInfo *wsConnectionInfo, const char *namespaceName, const char *functionName, const WsRequestObject *params)
+///
+/// @brief Remove cached responses of a web service function so that the next
+/// calls with the same parameters call the function again.  Functions that
+/// change what a cached function returns should call this.
+///
+/// @param wsConnectionInfo The WsConnectionInfo passed to the calling
+///   function.
+/// @param namespaceName The namespace of the function whose responses are to
+///   be removed.
+/// @param functionName The name of the function whose responses are to be
+///   removed.
+/// @param params The parameters of the call whose response is to be removed,
+///   named the same way as in the function's WsCachePolicy.  Only the ones
+///   that identify the response are considered.  NULL to remove all of the
+///   function's responses.
+///
+/// @return Returns the number of responses removed on success, -1 if there is
+/// no such function.
+int wsResponseCacheInvalidate(WsConnectionInfo *wsConnectionInfo,
+  const char *namespaceName, const char *functionName,
+  const WsRequestObject *params
+) {
+  if ((wsConnectionInfo == NULL) || (namespaceName == NULL)
+    || (functionName == NULL)
+  ) {
+    printLog(ERR, "One or more NULL parameters.\n");
+    return -1;
+  }
+  
+  char *routeKey = NULL;
+  straddstr(&routeKey, namespaceName);
+  straddstr(&routeKey, "/");
+  straddstr(&routeKey, functionName);
+  const WsRoute *route = NULL;
+  if (routeKey != NULL) {
+    route = wsRouteTableFind(wsConnectionInfo->routeTable,
+      routeKey, strlen(routeKey));
+  }
+  routeKey = stringDestroy(routeKey);
+  if (route == NULL) {
+    printLog(ERR, "No function \"%s/%s\".\n", namespaceName, functionName);
+    return -1;
+  }
+  WsResponseCache *cache = route->cache;
+  if (cache == NULL) {
+    // The function's responses aren't cached.
+    return 0;
+  }
+  
+  // The response may be cached in either format.
+  static const char *formats[] = { "json", "xml" };
+  char *keys[] = { NULL, NULL };
+  if (params != NULL) {
+    for (int ii = 0; ii < 2; ii++) {
+      keys[ii] = wsResponseCacheKey(cache, formats[ii], params);
+    }
+  }
+  
+  int numRemoved = 0;
+  mtx_lock(&cache->lock);
+  cache->generation++;
+  if (params == NULL) {
+    while (cache->head != NULL) {
+      wsResponseCacheRemove(cache, cache->head);
+      numRemoved++;
+    }
+  }
+  for (int ii = 0; ii < 2; ii++) {
+    WsResponseCacheEntry *entry = (keys[ii] != NULL)
+      ? (WsResponseCacheEntry*) htGetValue(cache->entries, keys[ii]) : NULL;
+    if (entry != NULL) {
+      wsResponseCacheRemove(cache, entry);
+      numRemoved++;
+    }
+  }
+  mtx_unlock(&cache->lock);
+  for (int ii = 0; ii < 2; ii++) {
+    keys[ii] = stringDestroy(keys[ii]);
+  }
+  
+  return numRemoved;
+}
+
+// Forward declarations.
+bool wsPendingResponseFinish(WsPendingResponse *pendingResponse,
+  WsResponseObject *responseObject, bool cancelled);
+WsPendingResponse* wsPendingResponseRelease(
+  WsPendingResponse *pendingResponse);
+WsResponseObject* wsPendingResponseAwait(WsConnections *connections,
+  WsPendingResponse **waitingOn, Socket *clientSocket,
+  WsPendingResponse *pendingResponse, bool *timedOut);
+WsResponseObject* wsPendingResponseWait(WsThreadInfo *wsThreadInfo,
+  WsPendingResponse *pendingResponse);
+  
+/// @fn WsResponseObject* webServiceCall(WsThreadInfo *wsThreadInfo, const WsRoute *route, Dictionary *inputParams)
+///
+/// Call the web service function for a route with the provided arguments.
+///
+/// @param wsThreadInfo A pointer to the WsThreadInfo
+///   structure provided to this thread.
+/// @param route The WsRoute found for the request in the server's
+///   WsRouteTable, or NULL if no function matched.
+/// @param inputParams A Dictionary of arguments parsed from the client's
+///   request.
+///
+/// @return Returns an allocated WsResponseObject if route is a registered web
+/// serivce function, NULL otherwise.  NULL is also returned if the function
+/// streamed its response with a WsResponseWriter, in which case
+/// wsThreadInfo->responseStarted is set.  If the function deferred its
+/// response, this waits for it to be completed and returns what it was
+/// completed with.  If it times out, a 504 is sent (or recorded as the status
+/// of the batch call being made) and NULL is returned.
+WsResponseObject* webServiceCall(WsThreadInfo *wsThreadInfo,
+  const WsRoute *route, Dictionary *inputParams
+) {
+  printLog(TRACE,
+    "ENTER webServiceCall(wsThreadInfo=%p, route=\"%s\", inputParams=%p)\n",
+    wsThreadInfo, (route != NULL) ? route->key : "NULL", inputParams);
+  
+  if (wsThreadInfo == NULL) {
+    printLog(ERR, "One or more NULL parameters.  Cannot execute.\n");
+    printLog(TRACE,
+      "EXIT webServiceCall(wsThreadInfo=%p, route=\"%s\", inputParams=%p) = "
+      "{NULL}\n",
+      wsThreadInfo, (route != NULL) ? route->key : "NULL", inputParams);
+    return NULL;
+  }
+  
+  // Return value.  Needs to be declared here.
+  WsResponseObject *outputParams = NULL;
+  
+  // Set the environment for the web service call.
+  if (wsThreadInfo->webService.requestObjectHandler != NULL) {
+    wsThreadInfo->webService.requestObjectHandler(inputParams);
+  }
+  
+  if (route != NULL) {
+    // Setup the parameters.
+    WsConnectionInfo wsConnectionInfo;
+    wsConnectionInfo.clientSocket   = wsThreadInfo->clientSocket;
+    wsConnectionInfo.interfacePath  = wsThreadInfo->interfacePath;
+    wsConnectionInfo.httpRequest    = &wsThreadInfo->httpRequest;
+    wsConnectionInfo.body           = wsThreadInfo->body;
+    wsConnectionInfo.bodyLength     = wsThreadInfo->bodyReader.length;
+    wsConnectionInfo.bodyReader     = &wsThreadInfo->bodyReader;
+    if (wsThreadInfo->batchCall != NULL) {
+      // The body of the request is the batch, not anything of this call's.
+      wsConnectionInfo.body         = NULL;
+      wsConnectionInfo.bodyLength   = 0;
+      wsConnectionInfo.bodyReader   = NULL;
+    }
+    wsConnectionInfo.arena          = &wsThreadInfo->arena;
+    wsConnectionInfo.routeTable     = wsThreadInfo->routeTable;
+    wsConnectionInfo.functionParams = inputParams;
+    wsConnectionInfo.pendingResponse = NULL;
+    WsResponseWriter responseWriter;
+    wsResponseWriterInit(&responseWriter, wsThreadInfo,
+      wsThreadInfo->batchCall);
+    wsConnectionInfo.responseWriter = &responseWriter;
+    
+    // Call the function.
+    wsThreadInfo->routeMetrics = route->metrics;
+    struct timespec callStart;
+    wsMonotonicTime(&callStart);
+    // Database queries and web client requests made by the function are
+    // recorded as spans of the request.
+    traceCurrentContext = (wsThreadInfo->traceContext.traceBuffer != NULL)
+      ? &wsThreadInfo->traceContext : NULL;
+    outputParams = route->function(&wsThreadInfo->webService, &wsConnectionInfo);
+    traceCurrentContext = NULL;
+    if (responseWriter.started) {
+      if (outputParams != NULL) {
+        printLog(ERR, "%s streamed a response and also returned one.  "
+          "Discarding the returned one.\n", route->functionName);
+        outputParams
+          = wsThreadInfo->webService.responseObjectDestroy(outputParams);
+      }
+      // Complete the response if the function didn't.
+      wsResponseWriterFinish(&responseWriter);
+    }
+    WsPendingResponse *pendingResponse = wsConnectionInfo.pendingResponse;
+    if ((pendingResponse != NULL)
+      && ((outputParams != NULL) || (responseWriter.started))
+    ) {
+      printLog(ERR, "%s deferred its response and also provided one.  "
+        "Cancelling the deferred one.\n", route->functionName);
+      wsPendingResponseFinish(pendingResponse, NULL, true);
+      pendingResponse = wsPendingResponseRelease(pendingResponse);
+    } else if (pendingResponse != NULL) {
+      outputParams = wsPendingResponseWait(wsThreadInfo, pendingResponse);
+    }
+    wsMetricsEndPhase(wsThreadInfo, WS_PHASE_CALL, &callStart);
+  }
+  
+  printLog(TRACE,
+    "EXIT webServiceCall(wsThreadInfo=%p, route=\"%s\", inputParams=%p) = "
+    "{%p}\n",
+    wsThreadInfo, (route != NULL) ? route->key : "NULL", inputParams,
+    outputParams);
+  return outputParams;
+}
+
+/// @struct WsBatchCall
+///
+/// @brief One call of a batch POSTed to the batch endpoint.
+///
+/// @param batch The WsBatch the call is part of.
+/// @param callObject The {"namespace", "function", "params"} object of the
+///   call as deserialized by the WebService's JSON deserializer.
+/// @param status The HTTP status code of the call.  Zero until the call has
+///   been made.
+/// @param response The response of the call serialized by the WebService's
+///   JSON serializer.  NULL if the call didn't succeed.
+/// @param claimed Whether or not a thread has taken the call to make it.  Only
+///   accessed with the lock of the batch held.
+/// @param pendingResponse The WsPendingResponse the call is waiting on, if
+///   any.  Only changed with the lock of the connection's WsConnections held
+///   so that wsConnectionsShutdown can cancel it.
+/// @param route The WsRoute the call's namespace and function were found at
+///   in the server's function table.  NULL if the call was rejected before it
+///   could be made.
+/// @param params The params of callObject to call the function with.
+struct WsBatchCall {
+  struct WsBatch    *batch;
+  WsRequestObject   *callObject;
+  int                status;
+  Bytes              response;
+  bool               claimed;
+  WsPendingResponse *pendingResponse;
+  const WsRoute     *route;
+  WsRequestObject   *params;
+};
+
+/// @struct WsBatchContext
+///
+/// @brief What the calls of a batch made on worker threads need from the
+/// connection.  It's filled in before any call is queued and only read after
+/// that, so the worker threads share it.
+///
+/// @param webService The WebService the calls are made to.
+/// @param routeTable The function table the calls were routed in.  Passed on
+///   to the functions.
+/// @param connections The WsConnections of the server that accepted the
+///   connection.  NULL if it doesn't keep track of its connections.
+/// @param clientSocket The Socket of the connection.
+/// @param interfacePath The path to the static pages of the server.
+/// @param httpRequest The header of the request that POSTed the batch.  Its
+///   header fields are looked up before any call is queued so that the
+///   functions only ever read it.
+/// @param traceContext The TraceContext of the request that POSTed the batch.
+typedef struct WsBatchContext {
+  WebService         *webService;
+  const WsRouteTable *routeTable;
+  WsConnections      *connections;
+  Socket             *clientSocket;
+  const char         *interfacePath;
+  WsHttpRequest      *httpRequest;
+  TraceContext       *traceContext;
+} WsBatchContext;
+
+/// @struct WsBatch
+///
+/// @brief The calls of a batch and what's needed to spread them across the
+/// worker pool.  A worker thread that finds the call it was queued for already
+/// made may get to it after the request is complete, so the batch is freed by
+/// whichever of them releases it last.
+///
+/// @param calls The array of numCalls WsBatchCalls in the order they were
+///   POSTed.
+/// @param numCalls The number of calls in the batch.
+/// @param context What the calls made on worker threads need from the
+///   connection.  Only filled in if any calls are queued.
+/// @param lock The lock that protects the claimed flags of the calls,
+///   numRunning, and referenceCount.
+/// @param callFinished Signalled when a worker thread finishes a call.
+/// @param numRunning The number of calls being made on worker threads.
+/// @param referenceCount One for the request plus one for each job queued on
+///   the worker pool.
+struct WsBatch {
+  WsBatchCall    *calls;
+  int             numCalls;
+  WsBatchContext  context;
+  mtx_t           lock;
+  cnd_t           callFinished;
+  int             numRunning;
+  int             referenceCount;
+};
+
+// Forward declarations.
+int wsClientTableCheckRate(WsClientTable *clientTable, WsClient *client,
+  const WsRoute *route);
+int wsCheckRequestRate(WsThreadInfo *wsThreadInfo, const WsRoute *route);
+int wsWorkerPoolSubmit(WsWorkerPool *pool, thrd_start_t function,
+  thrd_start_t cancel, void *arg, bool force);
+int wsWorkerPoolNumIdle(WsWorkerPool *pool);
+
+/// @fn WsBatch* wsBatchCreate(void)
+///
+/// @brief Create an empty WsBatch with one reference for the request.
+///
+/// @return Returns a pointer to a newly-allocated WsBatch on success, NULL on
+/// failure.
+WsBatch* wsBatchCreate(void) {
+  WsBatch *batch = (WsBatch*) calloc(1, sizeof(WsBatch));
+  if (batch == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  if (mtx_init(&batch->lock, mtx_plain) != thrd_success) {
+    printLog(ERR, "Could not initialize batch lock.\n");
+    batch = (WsBatch*) pointerDestroy(batch);
+    return NULL;
+  }
+  if (cnd_init(&batch->callFinished) != thrd_success) {
+    printLog(ERR, "Could not initialize batch condition.\n");
+    mtx_destroy(&batch->lock);
+    batch = (WsBatch*) pointerDestroy(batch);
+    return NULL;
+  }
+  batch->referenceCount = 1;
+  
+  return batch;
+}
+
+/// @fn WsBatch* wsBatchRelease(WsBatch *batch)
+///
+/// @brief Release a reference to a WsBatch and free it if it was the last one.
+/// The request's reference must only be released once the call objects and
+/// responses have been destroyed.
+///
+/// @param batch The WsBatch to release.
+///
+/// @return This function always returns NULL.
+WsBatch* wsBatchRelease(WsBatch *batch) {
+  mtx_lock(&batch->lock);
+  batch->referenceCount--;
+  bool lastReference = (batch->referenceCount == 0);
+  mtx_unlock(&batch->lock);
+  
+  if (lastReference == true) {
+    cnd_destroy(&batch->callFinished);
+    mtx_destroy(&batch->lock);
+    batch->calls = (WsBatchCall*) pointerDestroy(batch->calls);
+    batch = (WsBatch*) pointerDestroy(batch);
+  }
+  
+  return NULL;
+}
+
+/// @fn bool wsBatchCallClaim(WsBatchCall *batchCall, bool onWorker)
+///
+/// @brief Take a call of a batch to make it unless another thread already has.
+///
+/// @param batchCall The WsBatchCall to take.
+/// @param onWorker Whether or not the call is being taken by a worker thread
+///   that the connection will have to wait for.
+///
+/// @return Returns true if the caller is to make the call, false if another
+/// thread already took it.
+bool wsBatchCallClaim(WsBatchCall *batchCall, bool onWorker) {
+  WsBatch *batch = batchCall->batch;
+  mtx_lock(&batch->lock);
+  bool claimed = (batchCall->claimed == false);
+  batchCall->claimed = true;
+  if ((claimed == true) && (onWorker == true)) {
+    batch->numRunning++;
+  }
+  mtx_unlock(&batch->lock);
+  
+  return claimed;
+}
+
+/// @def WS_TYPE_OF
+///
+/// @brief The TypeDescriptor of a data structure type, e.g. typeRedBlackTree
+/// for RedBlackTree.  Two levels so that a type given by a macro such as
+/// WsRequestObject is expanded before it's pasted.
+#define WS_TYPE_OF_(Type) type##Type
+#define WS_TYPE_OF(Type) WS_TYPE_OF_(Type)
+
+/// @fn const WsRequestNode* wsRequestObjectGetNode(const WsRequestObject *requestObject, const char *key)
+///
+/// @brief Find the node of a WsRequestObject with string keys.  Unlike
+/// getRequestValue, this gives the type of the value along with it so that
+/// values that came from the client can be checked before they're used.
+///
+/// @param requestObject The WsRequestObject to search.
+/// @param key The key of the node to find.
+///
+/// @return Returns the first node with the key, NULL if there isn't one or
+/// requestObject doesn't have string keys.
+const WsRequestNode* wsRequestObjectGetNode(
+  const WsRequestObject *requestObject, const char *key
+) {
+  TypeDescriptor *keyType = requestObject->keyType;
+  if ((keyType != typeString) && (keyType != typeStringNoCopy)
+    && (keyType != typeStringCi) && (keyType != typeStringCiNoCopy)
+  ) {
+    return NULL;
+  }
+  
+  for (const WsRequestNode *node = requestObject->head; node != NULL;
+    node = node->next
+  ) {
+    if (strcmp((const char*) node->key, key) == 0) {
+      return node;
+    }
+  }
+  
+  return NULL;
+}
+
+/// @fn const char* wsRequestNodeString(const WsRequestNode *node)
+///
+/// @brief Get the value of a node of a WsRequestObject as a C string if it
+/// holds a string.
+///
+/// @param node The WsRequestNode to get the value of.  May be NULL.
+///
+/// @return Returns the string on success, NULL if node is NULL or its value
+/// isn't a string.
+const char* wsRequestNodeString(const WsRequestNode *node) {
+  if (node == NULL) {
+    return NULL;
+  }
+  TypeDescriptor *type = node->type;
+  if ((type != typeString) && (type != typeStringNoCopy)
+    && (type != typeStringCi) && (type != typeStringCiNoCopy)
+    && (type != typeBytes) && (type != typeBytesNoCopy)
+  ) {
+    return NULL;
+  }
+  
+  return (const char*) node->value;
+}
+
+/// @fn void wsBatchCallRoute(WsThreadInfo *wsThreadInfo, WsBatchCall *batchCall)
+///
+/// @brief Find the function a call of a batch is for and rate limit the call
+/// exactly as if it had been POSTed to its own path.  Every call is routed on
+/// the connection's thread before any of them are made.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param batchCall The WsBatchCall to route.  Its route and params are set
+///   if it may be made, its status otherwise.  A call whose namespace or
+///   function isn't a string or whose params isn't an object gets a 400.
+///
+/// @return This function returns no value.
+void wsBatchCallRoute(WsThreadInfo *wsThreadInfo, WsBatchCall *batchCall) {
+  // The call object came from the client, so the types of its values are
+  // checked before anything is done with them.
+  const WsRequestObject *callObject = batchCall->callObject;
+  const char *namespaceName
+    = wsRequestNodeString(wsRequestObjectGetNode(callObject, "namespace"));
+  const char *functionName
+    = wsRequestNodeString(wsRequestObjectGetNode(callObject, "function"));
+  const WsRequestNode *paramsNode
+    = wsRequestObjectGetNode(callObject, "params");
+  if ((namespaceName == NULL) || (functionName == NULL)
+    || ((paramsNode != NULL)
+      && (paramsNode->type != WS_TYPE_OF(WsRequestObject)))
+  ) {
+    batchCall->status = 400;
+    return;
+  }
+  
+  char *path = wsArenaPrintf(&wsThreadInfo->arena, "/%s/%s",
+    namespaceName, functionName);
+  const WsRoute *route = (path != NULL)
+    ? wsRouteTableFindPath(wsThreadInfo->routeTable, path) : NULL;
+  if (route == NULL) {
+    batchCall->status = 404;
+    return;
+  } else if ((wsThreadInfo->client != NULL)
+    && (wsClientTableCheckRate(wsThreadInfo->clientTable,
+      wsThreadInfo->client, route) > 0)
+  ) {
+    batchCall->status = 429;
+    return;
+  }
+  
+  // The params belong to callObject.
+  batchCall->params = (paramsNode != NULL)
+    ? (WsRequestObject*) paramsNode->value : NULL;
+  batchCall->route = route;
+}
+
+/// @fn void wsBatchCallFinish(WebService *webService, WsBatchCall *batchCall, WsResponseObject *outputParams)
+///
+/// @brief Serialize the response of a call of a batch that has been made.
+///
+/// @param webService The WebService the call was made to.
+/// @param batchCall The WsBatchCall that was made.  Its status and response
+///   are set.
+/// @param outputParams The WsResponseObject the call returned, if any.  It's
+///   destroyed.
+///
+/// @return This function returns no value.
+void wsBatchCallFinish(WebService *webService, WsBatchCall *batchCall,
+  WsResponseObject *outputParams
+) {
+  if (batchCall->status != 0) {
+    // The call's deferred response timed out.
+  } else if (outputParams == NULL) {
+    batchCall->status = 500;
+  } else if (webService->getResponseValue(outputParams, "Content-Type")
+    != NULL
+  ) {
+    printLog(ERR, "%s returned a complete HTTP response, which can't be part "
+      "of a batch.\n", batchCall->route->functionName);
+    batchCall->status = 500;
+  } else {
+    batchCall->response = webService->serializeToJson(outputParams);
+    batchCall->status = (batchCall->response != NULL) ? 200 : 500;
+  }
+  if (outputParams != NULL) {
+    outputParams = webService->responseObjectDestroy(outputParams);
+  }
+}
+
+/// @fn void wsBatchCallMake(WsThreadInfo *wsThreadInfo, WsBatchCall *batchCall)
+///
+/// @brief Make one call of a batch on the connection's own thread and
+/// serialize its response.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param batchCall The WsBatchCall to make.  Its status and response are set.
+///
+/// @return This function returns no value.
+void wsBatchCallMake(WsThreadInfo *wsThreadInfo, WsBatchCall *batchCall) {
+  const WsRoute *route = batchCall->route;
+  if (route == NULL) {
+    // The call was rejected when it was routed.
+    return;
+  }
+  
+  u64 callUs = wsThreadInfo->phaseUs[WS_PHASE_CALL];
+  wsThreadInfo->batchCall = batchCall;
+  WsResponseObject *outputParams
+    = webServiceCall(wsThreadInfo, route, batchCall->params);
+  wsThreadInfo->batchCall = NULL;
+  // Time the call with the other calls of its function.  The request as a
+  // whole didn't call any one function.
+  wsHistogramRecord(&route->metrics->phases[WS_PHASE_CALL],
+    wsThreadInfo->phaseUs[WS_PHASE_CALL] - callUs);
+  wsThreadInfo->routeMetrics = NULL;
+  
+  wsBatchCallFinish(&wsThreadInfo->webService, batchCall, outputParams);
+}
+
+/// @fn WsResponseObject* wsBatchCallInvoke(WsBatchCall *batchCall, WsArena *arena)
+///
+/// @brief Call the function of a call of a batch on a worker thread.  Only
+/// the WsBatchCall and the context of its WsBatch are used, never the
+/// connection's WsThreadInfo.  If the function defers its response, this
+/// waits for it.
+///
+/// @param batchCall The WsBatchCall to make.  Its status is set to 504 if its
+///   deferred response times out.
+/// @param arena The WsArena for the function to allocate from.
+///
+/// @return Returns the WsResponseObject the function returned or completed
+/// its deferred response with, NULL if there wasn't one.
+WsResponseObject* wsBatchCallInvoke(WsBatchCall *batchCall, WsArena *arena) {
+  WsBatchContext *context = &batchCall->batch->context;
+  WebService *webService = context->webService;
+  const WsRoute *route = batchCall->route;
+  if (webService->requestObjectHandler != NULL) {
+    webService->requestObjectHandler(batchCall->params);
+  }
+  
+  // The body of the request is the batch, not anything of this call's.
+  WsConnectionInfo wsConnectionInfo;
+  wsConnectionInfo.clientSocket    = context->clientSocket;
+  wsConnectionInfo.interfacePath   = context->interfacePath;
+  wsConnectionInfo.httpRequest     = context->httpRequest;
+  wsConnectionInfo.body            = NULL;
+  wsConnectionInfo.bodyLength      = 0;
+  wsConnectionInfo.bodyReader      = NULL;
+  wsConnectionInfo.arena           = arena;
+  wsConnectionInfo.routeTable      = context->routeTable;
+  wsConnectionInfo.functionParams  = batchCall->params;
+  wsConnectionInfo.pendingResponse = NULL;
+  WsResponseWriter responseWriter;
+  wsResponseWriterInit(&responseWriter, NULL, batchCall);
+  wsConnectionInfo.responseWriter  = &responseWriter;
+  
+  struct timespec callStart;
+  wsMonotonicTime(&callStart);
+  traceCurrentContext = (context->traceContext->traceBuffer != NULL)
+    ? context->traceContext : NULL;
+  WsResponseObject *outputParams
+    = route->function(webService, &wsConnectionInfo);
+  traceCurrentContext = NULL;
+  // The responseWriter refuses to start for a call of a batch, so there's no
+  // streamed response to finish.
+  WsPendingResponse *pendingResponse = wsConnectionInfo.pendingResponse;
+  if ((pendingResponse != NULL) && (outputParams != NULL)) {
+    printLog(ERR, "%s deferred its response and also provided one.  "
+      "Cancelling the deferred one.\n", route->functionName);
+    wsPendingResponseFinish(pendingResponse, NULL, true);
+    pendingResponse = wsPendingResponseRelease(pendingResponse);
+  } else if (pendingResponse != NULL) {
+    bool timedOut = false;
+    outputParams = wsPendingResponseAwait(context->connections,
+      &batchCall->pendingResponse, context->clientSocket, pendingResponse,
+      &timedOut);
+    if (timedOut == true) {
+      // The rest of the batch still gets its results.
+      printLog(WARN, "Deferred response to a call of a batch from %s timed "
+        "out.\n", socketAddress(context->clientSocket));
+      batchCall->status = 504;
+    }
+  }
+  
+  struct timespec now;
+  wsMonotonicTime(&now);
+  i64 elapsedUs = (((i64) now.tv_sec - (i64) callStart.tv_sec) * 1000000)
+    + (((i64) now.tv_nsec - (i64) callStart.tv_nsec) / 1000);
+  wsHistogramRecord(&route->metrics->phases[WS_PHASE_CALL], (u64) elapsedUs);
+  
+  return outputParams;
+}
+
+/// @fn int wsBatchCallThread(void *args)
+///
+/// @brief Make a call of a batch on a worker thread if the connection hasn't
+/// already made it itself.
+///
+/// @param args The WsBatchCall to make, cast to a void*.
+///
+/// @return This function always returns 0.
+int wsBatchCallThread(void *args) {
+  WsBatchCall *batchCall = (WsBatchCall*) args;
+  WsBatch *batch = batchCall->batch;
+  
+  if (wsBatchCallClaim(batchCall, true) == true) {
+    if (batchCall->route != NULL) {
+      WsArena arena;
+      memset(&arena, 0, sizeof(arena));
+      WsResponseObject *outputParams = wsBatchCallInvoke(batchCall, &arena);
+      wsBatchCallFinish(batch->context.webService, batchCall, outputParams);
+      wsArenaReset(&arena);
+    }
+    
+    mtx_lock(&batch->lock);
+    batch->numRunning--;
+    cnd_signal(&batch->callFinished);
+    mtx_unlock(&batch->lock);
+  }
+  
+  batch = wsBatchRelease(batch);
+  return 0;
+}
+
+/// @fn int wsBatchCallCancel(void *args)
+///
+/// @brief Release the reference of a job that was queued for a call of a batch
+/// but will never run because the worker pool was stopped.
+///
+/// @param args The WsBatchCall the job was for, cast to a void*.
+///
+/// @return This function always returns 0.
+int wsBatchCallCancel(void *args) {
+  WsBatchCall *batchCall = (WsBatchCall*) args;
+  wsBatchRelease(batchCall->batch);
+  return 0;
+}
+
+/// @fn const char* wsBatchParse(WsThreadInfo *wsThreadInfo, WsBatch *batch)
+///
+/// @brief Deserialize the calls of a batch from the body of the request.  Each
+/// element of the JSON array in the body is deserialized by the WebService's
+/// own JSON deserializer.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param batch The WsBatch to add the calls to.
+///
+/// @return Returns NULL on success, otherwise the status to reject the request
+/// with.
+const char* wsBatchParse(WsThreadInfo *wsThreadInfo, WsBatch *batch) {
+  const char *body = (const char*) wsThreadInfo->body;
+  if (body == NULL) {
+    return "400 Bad Request";
+  }
+  
+  long long int position = (long long int) strspn(body, " \t\r\n");
+  if (body[position] != '[') {
+    return "400 Bad Request";
+  }
+  position++;
+  position += (long long int) strspn(&body[position], " \t\r\n");
+  if (body[position] == ']') {
+    // Nothing to call.
+    return NULL;
+  }
+  
+  int maxCalls = 0;
+  while (true) {
+    if ((wsThreadInfo->maxBatchCalls > 0)
+      && (batch->numCalls == wsThreadInfo->maxBatchCalls)
+    ) {
+      return "413 Content Too Large";
+    }
+    if (batch->numCalls == maxCalls) {
+      maxCalls = (maxCalls > 0) ? (maxCalls * 2) : 8;
+      WsBatchCall *calls = (WsBatchCall*) realloc(batch->calls,
+        ((size_t) maxCalls) * sizeof(WsBatchCall));
+      if (calls == NULL) {
+        LOG_MALLOC_FAILURE();
+        return "500 Internal Server Error";
+      }
+      batch->calls = calls;
+    }
+    
+    WsRequestObject *callObject
+      = wsThreadInfo->webService.deserializeFromJson(body, &position);
+    if (callObject == NULL) {
+      return "400 Bad Request";
+    }
+    WsBatchCall *batchCall = &batch->calls[batch->numCalls];
+    memset(batchCall, 0, sizeof(WsBatchCall));
+    batchCall->batch = batch;
+    batchCall->callObject = callObject;
+    batch->numCalls++;
+    
+    position += (long long int) strspn(&body[position], " \t\r\n");
+    if (body[position] == ']') {
+      break;
+    } else if (body[position] != ',') {
+      return "400 Bad Request";
+    }
+    position++;
+  }
+  
+  return NULL;
+}
+
+/// @fn int handleBatchRequest(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Make the calls of a batch POSTed to the batch endpoint and send
+/// their results to the client as a JSON array in the same order.  If the
+/// server has a batchWorkerPool, the calls are spread across whatever worker
+/// threads are idle and the connection makes the rest itself.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int handleBatchRequest(WsThreadInfo *wsThreadInfo) {
+  WebService *webService = &wsThreadInfo->webService;
+  const char *contentType
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Content-Type");
+  if ((contentType == NULL) || (strstr(contentType, "application/json") == NULL)
+    || (webService->deserializeFromJson == NULL)
+    || (webService->serializeToJson == NULL)
+  ) {
+    return (sendResponseToClient(wsThreadInfo, "415 Unsupported Media Type",
+      "Content-Length: 0\r\n", NULL, 0) != 0);
+  }
+  
+  WsBatch *batch = wsBatchCreate();
+  if (batch == NULL) {
+    return 1;
+  }
+  struct timespec deserializeStart;
+  wsMonotonicTime(&deserializeStart);
+  const char *errorStatus = wsBatchParse(wsThreadInfo, batch);
+  wsMetricsEndPhase(wsThreadInfo, WS_PHASE_DESERIALIZE, &deserializeStart);
+  
+  WsConnections *connections = wsThreadInfo->connections;
+  if ((errorStatus == NULL) && (connections != NULL)) {
+    // The calls may defer their responses on any thread.  Let
+    // wsConnectionsShutdown find them.
+    mtx_lock(&connections->lock);
+    wsThreadInfo->batch = batch;
+    mtx_unlock(&connections->lock);
+  }
+  
+  if (errorStatus == NULL) {
+    // Queue no more calls than there are idle workers to make them.  Queued
+    // calls would otherwise wait behind requests and this thread would end up
+    // making them anyway.
+    WsWorkerPool *workerPool = wsThreadInfo->batchWorkerPool;
+    int numQueued = (workerPool != NULL) ? wsWorkerPoolNumIdle(workerPool) : 0;
+    if (numQueued > batch->numCalls - 1) {
+      // This thread makes the first call.
+      numQueued = batch->numCalls - 1;
+    }
+    // Route every call here so that the worker threads only have to make
+    // them.
+    for (int ii = 0; ii < batch->numCalls; ii++) {
+      wsBatchCallRoute(wsThreadInfo, &batch->calls[ii]);
+    }
+    if (numQueued > 0) {
+      WsBatchContext *context = &batch->context;
+      context->webService = &wsThreadInfo->webService;
+      context->routeTable = wsThreadInfo->routeTable;
+      context->connections = connections;
+      context->clientSocket = wsThreadInfo->clientSocket;
+      context->interfacePath = wsThreadInfo->interfacePath;
+      context->httpRequest = &wsThreadInfo->httpRequest;
+      context->traceContext = &wsThreadInfo->traceContext;
+      // Build the header fields now so that no call builds them while the
+      // others read them.
+      wsHttpRequestGetParams(&wsThreadInfo->httpRequest);
+    }
+    for (int ii = 0; ii < numQueued; ii++) {
+      mtx_lock(&batch->lock);
+      batch->referenceCount++;
+      mtx_unlock(&batch->lock);
+      WsBatchCall *batchCall = &batch->calls[batch->numCalls - 1 - ii];
+      if (wsWorkerPoolSubmit(workerPool, wsBatchCallThread, wsBatchCallCancel,
+        batchCall, false) != 0
+      ) {
+        // This thread makes the rest of the calls.
+        mtx_lock(&batch->lock);
+        batch->referenceCount--;
+        mtx_unlock(&batch->lock);
+        break;
+      }
+    }
+    
+    for (int ii = 0; ii < batch->numCalls; ii++) {
+      if (wsBatchCallClaim(&batch->calls[ii], false) == true) {
+        wsBatchCallMake(wsThreadInfo, &batch->calls[ii]);
+      }
+    }
+    mtx_lock(&batch->lock);
+    while (batch->numRunning > 0) {
+      cnd_wait(&batch->callFinished, &batch->lock);
+    }
+    mtx_unlock(&batch->lock);
+  }
+  if (connections != NULL) {
+    mtx_lock(&connections->lock);
+    wsThreadInfo->batch = NULL;
+    mtx_unlock(&connections->lock);
+  }
+  
+  WsArena *arena = &wsThreadInfo->arena;
+  char *text = NULL;
+  if (errorStatus == NULL) {
+    struct timespec serializeStart;
+    wsMonotonicTime(&serializeStart);
+    text = wsArenaStrdup(arena, "[");
+    for (int ii = 0; ii < batch->numCalls; ii++) {
+      WsBatchCall *batchCall = &batch->calls[ii];
+      wsArenaAddStr(arena, &text, wsArenaPrintf(arena, "%s{\"status\": %d",
+        (ii > 0) ? ", " : "", batchCall->status));
+      if (batchCall->response != NULL) {
+        wsArenaAddStr(arena, &text, ", \"response\": ");
+        wsArenaAddStr(arena, &text, (char*) batchCall->response);
+      }
+      wsArenaAddStr(arena, &text, "}");
+    }
+    wsArenaAddStr(arena, &text, "]");
+    wsMetricsEndPhase(wsThreadInfo, WS_PHASE_SERIALIZE, &serializeStart);
+    if (text == NULL) {
+      LOG_MALLOC_FAILURE();
+      errorStatus = "500 Internal Server Error";
+    }
+  }
+  
+  for (int ii = 0; ii < batch->numCalls; ii++) {
+    WsBatchCall *batchCall = &batch->calls[ii];
+    batchCall->callObject
+      = webService->requestObjectDestroy(batchCall->callObject);
+    batchCall->response = bytesDestroy(batchCall->response);
+  }
+  batch = wsBatchRelease(batch);
+  
+  if (errorStatus != NULL) {
+    return (sendResponseToClient(wsThreadInfo, errorStatus,
+      "Content-Length: 0\r\n", NULL, 0) != 0);
+  }
+  
+  const char *responseContentType = "application/json; charset=utf-8";
+  u64 bodyLength = strlen(text);
+  Bytes body = NULL;
+  const char *contentEncoding = NULL;
+  if (wsResponseEncoding(wsThreadInfo, responseContentType, bodyLength)
+    != WS_ENCODING_IDENTITY
+  ) {
+    // Compression works on Bytes.
+    bytesAddData(&body, text, bodyLength);
+    contentEncoding = wsCompressBody(wsThreadInfo, responseContentType, &body);
+    bodyLength = bytesLength(body);
+  }
+  
+  char *header = wsArenaPrintf(arena,
+    "Content-Length: %llu\r\nContent-Type: %s\r\n",
+    llu(bodyLength), responseContentType);
+  if (contentEncoding != NULL) {
+    wsArenaAddStr(arena, &header, "Content-Encoding: ");
+    wsArenaAddStr(arena, &header, contentEncoding);
+    wsArenaAddStr(arena, &header, "\r\n");
+  }
+  wsArenaAddStr(arena, &header, "Server: ");
+  wsArenaAddStr(arena, &header, wsThreadInfo->serverName);
+  wsArenaAddStr(arena, &header, "\r\n");
+  int returnValue = (sendResponseToClient(wsThreadInfo, "200 OK", header,
+    (body != NULL) ? (const void*) body : (const void*) text,
+    bodyLength) != 0);
+  body = bytesDestroy(body);
+  
+  return returnValue;
+}
+
+/// @fn int handlePostRequest(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Handle a POST request from a client.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int handlePostRequest(WsThreadInfo *wsThreadInfo) {
+  printLog(TRACE, "ENTER handlePostRequest(wsThreadInfo=%p)\n", wsThreadInfo);
+  
+  int returnValue = 0;
+  if (wsThreadInfo == NULL) {
+    printLog(ERR, "NULL wsThreadInfo parameter provided.  Cannot continue.\n");
+    returnValue = 1;
+    printLog(TRACE,
+      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, returnValue);
+    return returnValue;
+  }
+  
+  // We won't redirect a POST request if redirectPort or redirectProtocol are
+  // set, however if redirectFunction is specified, we have to do as we're
+  // told.
+  if ((wsThreadInfo->redirectFunction) && (redirectClient(wsThreadInfo))) {
+    // Nothing else for us to do.
+    printLog(TRACE,
+      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, 0);
+    return returnValue; // 0
+  }
+  
+  // The batch endpoint takes precedence over web service functions.
+  const char *batchPath = wsThreadInfo->batchPath;
+  const char *location
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "_httpLocation");
+  if ((batchPath != NULL) && (location != NULL)) {
+    size_t batchPathLength = strlen(batchPath);
+    if ((strncmp(location, batchPath, batchPathLength) == 0)
+      && ((location[batchPathLength] == '\0')
+        || (location[batchPathLength] == '?'))
+    ) {
+      // The batch as a whole falls under the "*" limit.  Each of its calls is
+      // limited by its own namespace.
+      returnValue = (wsCheckRequestRate(wsThreadInfo, NULL) == 0)
+        ? handleBatchRequest(wsThreadInfo)
+        : (wsThreadInfo->responseSent == false);
+      printLog(TRACE,
+        "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
+        wsThreadInfo, returnValue);
+      return returnValue;
+    }
+  }
+  
+  // There are a few possibilities for how the client could communicate the
+  // desired operation.  It may provide the information in one of the header
+  // fields or it may only provide it in the path (or it may provide both).
+  // We will let the information in the header override the information in the
+  // path if it's available.  Either way, the "namespace/function" key is
+  // matched in place against the route table.
+  const WsRouteTable *routeTable = wsThreadInfo->routeTable;
+  const WsRoute *route = NULL;
+  bool routeFound = false;
+  const char *hostName
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Host");
+  const char *soapAction
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "SoapAction");
+  if ((soapAction != NULL) && (hostName != NULL)) {
+    printLog(DEBUG, "SOAP action detected.\n");
+    // SoapAction was specified.  Use that to get the function name.  The
+    // namespace runs from the slash after the host name to the next slash and
+    // the function runs from there to the closing quote or, if the action
+    // isn't quoted, to the end of the line.
+    size_t hostNameLength = strlen(hostName);
+    const char *routeKey = strstr(soapAction, hostName);
+    if ((routeKey != NULL) && (routeKey[hostNameLength] == '/')) {
+      routeKey += hostNameLength + 1;
+      const char *slashAt = strchr(routeKey, '/');
+      const char *routeEnd = NULL;
+      if (slashAt != NULL) {
+        routeEnd = (soapAction[0] == '"')
+          ? strchr(slashAt + 1, '"')
+          : slashAt + 1 + strlen(slashAt + 1);
+      }
+      if (routeEnd != NULL) {
+        printLog(DEBUG, "SOAP route = \"%.*s\".\n",
+          (int) (routeEnd - routeKey), routeKey);
+        route = wsRouteTableFind(routeTable,
+          routeKey, (size_t) (routeEnd - routeKey));
+        routeFound = true;
+      }
+    }
+  }
+  
+  if (routeFound == false) {
+    const char *path = wsHttpRequestGetHeader(
+      &wsThreadInfo->httpRequest, "_httpLocation");
+    if (path == NULL) {
+      // No SoapAction and no path.  Can't proceed.
+      printLog(ERR, "Malformed HTTP header.\n");
+      returnValue = 1;
+      
+      // Caller will do necessary cleanup.
+      printLog(TRACE,
+        "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, 1);
+      return returnValue;
+    }
+    
+    // There is a bug in Internet Explorer which prevents reposting from
+    // behaving correctly--the browser only sends the header on subsoquent
+    // calls.  See http://support.microsoft.com/kb/895954 for more details.
+    // As a work-around, the client will send a URL-encoded timestamp as a
+    // "GET-style" parameter with each call.  This will force Internet Explorer
+    // to treat each call as a new call but we need to make sure we ignore the
+    // rest of the URL in this case.  Clients that handle things properly (like
+    // Firefox and Python) won't send the extra data but that's OK.
+    //
+    // JBC 2012-06-09
+    route = wsRouteTableFindPath(routeTable, path);
+  }
+  
+  // The request is limited by the namespace of the function it's actually
+  // dispatched to, whether that came from the path or the SOAPAction.
+  if (wsCheckRequestRate(wsThreadInfo, route) != 0) {
+    returnValue = (wsThreadInfo->responseSent == false);
+    printLog(TRACE,
+      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, returnValue);
+    return returnValue;
+  }
+  
+  // Get the function parameters from the body of the request.
+  // body will be guaranteed to be non-NULL because we succeeded at getting
+  // httpHeader earlier.
+  WsRequestObject *inputParams = NULL;
+  const char *contentType
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Content-Type");
+  if (contentType == NULL) {
+    printLog(ERR, "No Content-Type header provided.  Cannot parse input.\n");
+    returnValue = -1;
+    
+    printLog(TRACE,
+      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, returnValue);
+    return returnValue;
+  }
+  struct timespec deserializeStart;
+  wsMonotonicTime(&deserializeStart);
+  if ((strstr(contentType, "text/xml") || strstr(contentType, "soap"))
+    && (wsThreadInfo->webService.deserializeFromXml != NULL)
+  ) {
+    inputParams = wsThreadInfo->webService.deserializeFromXml(
+      (const char*) wsThreadInfo->body);
+    wsMetricsEndPhase(wsThreadInfo, WS_PHASE_DESERIALIZE, &deserializeStart);
+  } else if ((strstr(contentType, "application/json"))
+    && (wsThreadInfo->webService.deserializeFromJson != NULL)
+  ) {
+    long long int startPosition = 0;
+    inputParams = wsThreadInfo->webService.deserializeFromJson(
+      (const char*) wsThreadInfo->body, &startPosition);
+    wsMetricsEndPhase(wsThreadInfo, WS_PHASE_DESERIALIZE, &deserializeStart);
+  } // else we have no parser for this body
+  
+  if (wsResponseCacheServe(wsThreadInfo, route, inputParams)) {
+    if (inputParams != NULL) {
+      inputParams = wsThreadInfo->webService.requestObjectDestroy(inputParams);
+    }
+    returnValue = (wsThreadInfo->responseSent == false);
+    printLog(TRACE,
+      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, returnValue);
+    return returnValue;
+  }
+  
+  // webServiceCall will handle NULL parameters, so no need to double-check.
+  WsResponseObject *outputParams = NULL;
+  outputParams = webServiceCall(wsThreadInfo, route, inputParams);
+  if (inputParams != NULL) {
+    // We have to guard this because inputParams may be NULL because no
+    // serialization/deserialization functions were specified.
+    inputParams = wsThreadInfo->webService.requestObjectDestroy(inputParams);
+  }
+  
+  if (outputParams != NULL) {
+    // A return value of 0 from sendResponseObjectToClient is good status.
+    // The same is true for this function.  However, this being a top-level
+    // handler, we can only return zero or positive values to our caller.
+    // We need to restrict our return value to reflect this.
+    returnValue = (sendResponseObjectToClient(wsThreadInfo,
+      route->functionName, outputParams) != 0);
+    outputParams = wsThreadInfo->webService.responseObjectDestroy(outputParams);
+  } else if (wsThreadInfo->responseStarted) {
+    // The function streamed its response.
+    returnValue = (wsThreadInfo->responseSent == false);
+  }
+  
+  printLog(TRACE,
+    "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
+    wsThreadInfo, returnValue);
+  return returnValue;
+}
+
+// Defined at the bottom of the library.
+extern const char *_mimeTypes[][2];
+extern const i64 NUM_MIME_TYPES;
+
+/// @var _mimeHashTable
+///
+/// @brief File-local variable to hold the file extension-to-MIME type
+/// information used for returning HTTP data.
+static HashTable *_mimeHashTable = NULL;
+
+/// @fn const char *getMimeType(const char *fileExtension)
+///
+/// @brief Get the appropriate MIME type for a file based on its file extension.
+///
+/// @prarm fileExtension The last '.' character of the file name and everything
+///   after it.
+///
+/// @return Returns the appropriate MIME type.  If the file extension is not
+/// found then the default of "text/plain" is returned.
+const char *getMimeType(const char *fileExtension) {
+  printLog(TRACE, "ENTER getMimeType(fileExtension=\"%s\")", fileExtension);
+  
+  const char *mimeType = NULL;
+  if (fileExtension != NULL) {
+    if (_mimeHashTable != NULL) {
+      // The hash table is set up and we have a file extension.
+      // This is the expected case.
+      mimeType = (const char*) htGetValue(_mimeHashTable, fileExtension);
+    } else {
+      // Setting up the hash table failed for some reason.  Perform a
+      // binary search.
+      i64 searchIndex = NUM_MIME_TYPES >> 1; // divide by two
+      for (i64 i = 0, j = NUM_MIME_TYPES; i <= j;) {
+        int difference = strcmpci(fileExtension, _mimeTypes[searchIndex][0]);
+        if (difference == 0) {
+          mimeType = _mimeTypes[searchIndex][1];
+          break;
+        } else if (difference < 0) {
+          // move left
+          j = searchIndex - 1;
+          if (j < 0) {
+            // searchIndex is 0
+            break;
+          }
+        } else {
+          // move right
+          i = searchIndex + 1;
+          if (i == NUM_MIME_TYPES) {
+            // searchIndex is NUM_MIME_TYPES - 1
+            break;
+          }
+        }
+        searchIndex = (i + j) >> 1; // divide by two
+      }
+    }
+  }
+  if (mimeType == NULL) {
+    // Unknown file extension.  Default to text/plain.
+    mimeType = "text/plain";
+  }
+  
+  printLog(TRACE, "EXIT getMimeType(fileExtension=\"%s\") = {%s}",
+    fileExtension, mimeType);
+  return mimeType;
+}
+
+/// @struct WsFileCacheEntry
+///
+/// @brief The content of one static file as it's sent to clients, along with
+/// the information needed to revalidate it against the file on disk.
+///
+/// @param key The key of the entry in the cache.  This is the full path to the
+///   file plus the target namespace for files that have it substituted in.
+/// @param content The content of the file as it's sent to the client.  NULL
+///   if zeroCopy is set.
+/// @param mimeType The MIME type of the file.
+/// @param fileSize The size of the file on disk when content was read.
+/// @param mtimeSeconds The seconds portion of the file's modification time
+///   when content was read.
+/// @param mtimeNanoseconds The nanoseconds portion of the file's modification
+///   time when content was read.
+/// @param eTag The value of the ETag header to send with the file.  Empty if
+///   the content was generated rather than read from a file.
+/// @param lastModified The value of the Last-Modified header to send with the
+///   file.  Empty if the content was generated rather than read from a file.
+/// @param zeroCopy Whether the file is too large to hold in memory and has to
+///   be sent directly from disk by wsSendFile.  The key of such an entry is
+///   the full path to the file.  These entries are never cached.
+/// @param contentEncoding The WsContentEncoding of content.  Compressed
+///   variants of a file are cached alongside the identity entry under the
+///   identity key plus a newline and the encoding name.
+/// @param refCount The number of requests currently using the entry.
+/// @param inCache Whether or not the entry is still held by the cache.  An
+///   entry that's not in the cache is freed when its refCount drops to zero.
+/// @param prev The next more-recently used entry in the cache.
+/// @param next The next less-recently used entry in the cache.
+typedef struct WsFileCacheEntry {
+  char                    *key;
+  Bytes                    content;
+  const char              *mimeType;
+  u64                      fileSize;
+  i64                      mtimeSeconds;
+  i64                      mtimeNanoseconds;
+  char                     eTag[80];
+  char                     lastModified[32];
+  bool                     zeroCopy;
+  WsContentEncoding        contentEncoding;
+  int                      refCount;
+  bool                     inCache;
+  struct WsFileCacheEntry *prev;
+  struct WsFileCacheEntry *next;
+} WsFileCacheEntry;
+
+/// @struct WsFileCache
+///
+/// @brief A least-recently-used cache of static file content that's bounded
+/// by the total number of bytes held.
+///
+/// @param lock The mutex that protects the rest of the structure and the
+///   refCount and inCache members of its entries.
+/// @param entries A HashTable of the WsFileCacheEntry pointers in the cache
+///   keyed by their key strings.
+/// @param head The most-recently used entry in the cache.
+/// @param tail The least-recently used entry in the cache.  This is the next
+///   entry to be evicted.
+/// @param maxBytes The maximum number of content bytes the cache may hold.
+/// @param maxEntryBytes The largest file the cache will hold.  Larger files
+///   are read from disk on every request so that one of them can't flush the
+///   rest of the cache.
+/// @param numBytes The number of content bytes currently held.
+/// @param numHits The number of lookups that found a valid entry.
+/// @param numMisses The number of lookups that did not find a valid entry.
+struct WsFileCache {
+  mtx_t             lock;
+  HashTable        *entries;
+  WsFileCacheEntry *head;
+  WsFileCacheEntry *tail;
+  u64               maxBytes;
+  u64               maxEntryBytes;
+  u64               numBytes;
+  u64               numHits;
+  u64               numMisses;
+};
+
+/// @fn i64 wsFileMtimeNanoseconds(const struct stat *fileStat)
+///
+/// @brief Get the sub-second portion of a file's modification time.  Checking
+/// it in addition to the seconds catches files that are rewritten more than
+/// once per second.
+///
+/// @param fileStat The status of the file as returned by stat.
+///
+/// @return Returns the nanoseconds portion of the modification time, or 0 on
+/// platforms that don't provide it.
+i64 wsFileMtimeNanoseconds(const struct stat *fileStat) {
+#if defined(_WIN32)
+  (void) fileStat;
+  return 0;
+#elif defined(__APPLE__)
+  return (i64) fileStat->st_mtimespec.tv_nsec;
+#else // POSIX
+  return (i64) fileStat->st_mtim.tv_nsec;
+#endif // _WIN32
+}
+
+/// @fn WsFileCache* wsFileCacheCreate(u64 maxBytes)
+///
+/// @brief Create an empty WsFileCache.
+///
+/// @param maxBytes The maximum number of bytes of file content the cache may
+///   hold.
+///
+/// @return Returns a pointer to a newly-allocated WsFileCache on success, NULL
+/// on failure.
+WsFileCache* wsFileCacheCreate(u64 maxBytes) {
+  WsFileCache *cache = (WsFileCache*) calloc(1, sizeof(WsFileCache));
+  if (cache == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  cache->maxBytes = maxBytes;
+  cache->maxEntryBytes = maxBytes / 4;
+  
+  // The cache's lock protects the table, so the table doesn't need its own.
+  cache->entries = htCreate(typeString, /*disableThreadSafety=*/ true);
+  if (cache->entries == NULL) {
+    LOG_MALLOC_FAILURE();
+    cache = (WsFileCache*) pointerDestroy(cache);
+    return NULL;
+  }
+  if (mtx_init(&cache->lock, mtx_plain) != thrd_success) {
+    printLog(ERR, "Could not initialize file cache mutex.\n");
+    cache->entries = htDestroy(cache->entries);
+    cache = (WsFileCache*) pointerDestroy(cache);
+    return NULL;
+  }
+  
+  return cache;
+}
+
+/// @fn WsFileCacheEntry* wsFileCacheEntryDestroy(WsFileCacheEntry *entry)
+///
+/// @brief Free a WsFileCacheEntry and its content.
+///
+/// @param entry A pointer to the WsFileCacheEntry to free.
+///
+/// @return This function always returns NULL.
+WsFileCacheEntry* wsFileCacheEntryDestroy(WsFileCacheEntry *entry) {
+  if (entry != NULL) {
+    entry->key = stringDestroy(entry->key);
+    entry->content = bytesDestroy(entry->content);
+    entry = (WsFileCacheEntry*) pointerDestroy(entry);
+  }
+  
+  return NULL;
+}
+
+/// @fn void wsFileCacheRemove(WsFileCache *cache, WsFileCacheEntry *entry)
+///
+/// @brief Remove an entry from a file cache.  The entry is freed immediately
+/// if no request is using it.  Otherwise it's freed by the last call to
+/// wsFileCacheRelease.  The cache's lock must be held by the caller.
+///
+/// @param cache A pointer to the WsFileCache that holds the entry.
+/// @param entry A pointer to the WsFileCacheEntry to remove.
+void wsFileCacheRemove(WsFileCache *cache, WsFileCacheEntry *entry) {
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+  entry->prev = NULL;
+  entry->next = NULL;
+  
+  htRemoveEntry(cache->entries, entry->key);
+  cache->numBytes -= bytesLength(entry->content);
+  entry->inCache = false;
+  if (entry->refCount == 0) {
+    entry = wsFileCacheEntryDestroy(entry);
+  }
+}
+
+/// @fn WsFileCache* wsFileCacheDestroy(WsFileCache *cache)
+///
+/// @brief Free a WsFileCache and all of the entries in it.  No requests may be
+/// using the cache when this is called.
+///
+/// @param cache A pointer to the WsFileCache to destroy.
+///
+/// @return This function always returns NULL.
+WsFileCache* wsFileCacheDestroy(WsFileCache *cache) {
+  if (cache == NULL) {
+    // Nothing to do.
+    return NULL;
+  }
+  
+  while (cache->head != NULL) {
+    wsFileCacheRemove(cache, cache->head);
+  }
+  cache->entries = htDestroy(cache->entries);
+  mtx_destroy(&cache->lock);
+  cache = (WsFileCache*) pointerDestroy(cache);
+  
+  return NULL;
+}
+
+/// @fn WsFileCacheEntry* wsFileCacheGet(WsFileCache *cache, const char *key, u64 fileSize, i64 mtimeSeconds, i64 mtimeNanoseconds)
+///
+/// @brief Look up an entry in a file cache and verify that it still matches the
+/// file on disk.  An entry that no longer matches is removed from the cache.
+///
+/// @param cache A pointer to the WsFileCache to search.
+/// @param key The key of the entry to find.
+/// @param fileSize The current size of the file on disk.
+/// @param mtimeSeconds The seconds portion of the file's current modification
+///   time.
+/// @param mtimeNanoseconds The nanoseconds portion of the file's current
+///   modification time.
+///
+/// @return Returns a pointer to the matching entry on success, NULL if there is
+/// no valid entry.  A returned entry must be released with wsFileCacheRelease.
+WsFileCacheEntry* wsFileCacheGet(WsFileCache *cache, const char *key,
+  u64 fileSize, i64 mtimeSeconds, i64 mtimeNanoseconds
+) {
+  if (cache == NULL) {
+    // Caching is disabled.
+    return NULL;
+  }
+  
+  mtx_lock(&cache->lock);
+  WsFileCacheEntry *entry
+    = (WsFileCacheEntry*) htGetValue(cache->entries, key);
+  if ((entry != NULL)
+    && ((entry->fileSize != fileSize)
+      || (entry->mtimeSeconds != mtimeSeconds)
+      || (entry->mtimeNanoseconds != mtimeNanoseconds)
+    )
+  ) {
+    // The file has changed since it was cached.
+    wsFileCacheRemove(cache, entry);
+    entry = NULL;
+  }
+  
+  if (entry != NULL) {
+    // Move the entry to the front of the list.
+    if (entry != cache->head) {
+      entry->prev->next = entry->next;
+      if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+      } else {
+        cache->tail = entry->prev;
+      }
+      entry->prev = NULL;
+      entry->next = cache->head;
+      cache->head->prev = entry;
+      cache->head = entry;
+    }
+    entry->refCount++;
+    cache->numHits++;
+  } else {
+    cache->numMisses++;
+  }
+  mtx_unlock(&cache->lock);
+  
+  return entry;
+}
+
+/// @fn void wsFileCacheAdd(WsFileCache *cache, WsFileCacheEntry *entry)
+///
+/// @brief Add a newly-read entry to a file cache, evicting the least-recently
+/// used entries as necessary to make room for it.  Entries that are too large
+/// to cache are left out of the cache.  Either way, the caller must release the
+/// entry with wsFileCacheRelease when it's done with it.
+///
+/// @param cache A pointer to the WsFileCache to add the entry to.  May be NULL
+///   if caching is disabled.
+/// @param entry A pointer to the WsFileCacheEntry to add.  Its refCount must be
+///   1.
+void wsFileCacheAdd(WsFileCache *cache, WsFileCacheEntry *entry) {
+  u64 entryBytes = bytesLength(entry->content);
+  if ((cache == NULL) || (entryBytes > cache->maxEntryBytes)) {
+    // Nothing to do.
+    return;
+  }
+  
+  mtx_lock(&cache->lock);
+  WsFileCacheEntry *existing
+    = (WsFileCacheEntry*) htGetValue(cache->entries, entry->key);
+  if (existing != NULL) {
+    // Another thread read the same file at the same time.  The newer read
+    // wins.
+    wsFileCacheRemove(cache, existing);
+  }
+  while ((cache->tail != NULL)
+    && (cache->numBytes + entryBytes > cache->maxBytes)
+  ) {
+    wsFileCacheRemove(cache, cache->tail);
+  }
+  
+  if (htAddEntry(cache->entries, entry->key, entry, typePointerNoCopy)
+    != NULL
+  ) {
+    entry->inCache = true;
+    entry->next = cache->head;
+    if (cache->head != NULL) {
+      cache->head->prev = entry;
+    } else {
+      cache->tail = entry;
+    }
+    cache->head = entry;
+    cache->numBytes += entryBytes;
+  } else {
+    LOG_MALLOC_FAILURE();
+  }
+  mtx_unlock(&cache->lock);
+}
+
+/// @fn WsFileCacheEntry* wsFileCacheRelease(WsFileCache *cache, WsFileCacheEntry *entry)
+///
+/// @brief Release a reference to an entry returned by wsGetFile.
+///
+/// @param cache A pointer to the WsFileCache the entry came from.  May be NULL
+///   if caching is disabled.
+/// @param entry A pointer to the WsFileCacheEntry to release.  May be NULL.
+///
+/// @return This function always returns NULL.
+WsFileCacheEntry* wsFileCacheRelease(WsFileCache *cache,
+  WsFileCacheEntry *entry
+) {
+  if (entry == NULL) {
+    // Nothing to do.
+    return NULL;
+  }
+  
+  if (cache != NULL) {
+    mtx_lock(&cache->lock);
+  }
+  entry->refCount--;
+  if ((entry->refCount == 0) && (entry->inCache == false)) {
+    entry = wsFileCacheEntryDestroy(entry);
+  }
+  if (cache != NULL) {
+    mtx_unlock(&cache->lock);
+  }
+  
+  return NULL;
+}
+
+/// @fn i64 wsParseHttpDate(const char *httpDate)
+///
+/// @brief Parse an HTTP date in the preferred (IMF-fixdate) format.  This is
+/// the format of the Last-Modified header this server sends, which is what
+/// clients echo back in If-Modified-Since.
+///
+/// @param httpDate The date string to parse.
+///
+/// @return Returns the number of seconds since the epoch on success, -1 if the
+/// date could not be parsed.
+i64 wsParseHttpDate(const char *httpDate) {
+  static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  
+  char monthName[4] = {0};
+  int day = 0, year = 0, hour = 0, minute = 0, second = 0;
+  if ((httpDate == NULL)
+    || (sscanf(httpDate, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT",
+      &day, monthName, &year, &hour, &minute, &second) != 6)
+  ) {
+    return -1;
+  }
+  const char *monthAt = strstr(months, monthName);
+  if ((strlen(monthName) != 3) || (monthAt == NULL)
+    || (((monthAt - months) % 3) != 0)
+  ) {
+    return -1;
+  }
+  int month = (int) ((monthAt - months) / 3) + 1;
+  
+  // Convert the civil date to days since the epoch.  This is the algorithm
+  // from Howard Hinnant's chrono date library.  It avoids timegm, which isn't
+  // portable.
+  year -= (month <= 2);
+  i64 era = ((year >= 0) ? year : year - 399) / 400;
+  i64 yearOfEra = year - (era * 400);
+  i64 dayOfYear = ((153 * (month + ((month > 2) ? -3 : 9))) + 2) / 5 + day - 1;
+  i64 dayOfEra
+    = (yearOfEra * 365) + (yearOfEra / 4) - (yearOfEra / 100) + dayOfYear;
+  i64 days = (era * 146097) + dayOfEra - 719468;
+  
+  return (days * 86400) + (hour * 3600) + (minute * 60) + second;
+}
+
+/// @fn bool wsETagListMatches(const char *eTagList, const char *eTag)
+///
+/// @brief Determine whether an entity tag appears in the value of an
+/// If-None-Match header.  The weak comparison function is used, so weakness
+/// indicators are ignored.
+///
+/// @param eTagList The value of the If-None-Match header.
+/// @param eTag The current entity tag of the resource.
+///
+/// @return Returns true if eTag matches one of the tags in eTagList, false if
+/// not.
+bool wsETagListMatches(const char *eTagList, const char *eTag) {
+  if (strncmp(eTag, "W/", 2) == 0) {
+    eTag += 2;
+  }
+  size_t eTagLength = strlen(eTag);
+  
+  const char *cursor = eTagList;
+  while (*cursor != '\0') {
+    while ((*cursor == ' ') || (*cursor == '\t') || (*cursor == ',')) {
+      cursor++;
+    }
+    if (*cursor == '*') {
+      return true;
+    }
+    if (strncmp(cursor, "W/", 2) == 0) {
+      cursor += 2;
+    }
+    if ((strncmp(cursor, eTag, eTagLength) == 0)
+      && ((cursor[eTagLength] == '\0') || (cursor[eTagLength] == ',')
+        || (cursor[eTagLength] == ' ') || (cursor[eTagLength] == '\t')
+      )
+    ) {
+      return true;
+    }
+    while ((*cursor != '\0') && (*cursor != ',')) {
+      cursor++;
+    }
+  }
+  
+  return false;
+}
+
+/// @fn bool wsFileNotModified(const WsHttpRequest *httpRequest, const WsFileCacheEntry *file)
+///
+/// @brief Evaluate the conditional headers of a GET request against the
+/// current version of the requested file.
+///
+/// @param httpRequest The parsed header of the request.
+/// @param file The WsFileCacheEntry for the current version of the file.
+///
+/// @return Returns true if the client's copy is current and a 304 (Not
+/// Modified) response should be sent, false if the full file should be sent.
+bool wsFileNotModified(const WsHttpRequest *httpRequest,
+  const WsFileCacheEntry *file
+) {
+  if (file->eTag[0] == '\0') {
+    // Generated content.  There's nothing to compare against.
+    return false;
+  }
+  
+  // If-None-Match takes precedence over If-Modified-Since when both are
+  // present.  (RFC 9110 section 13.2.2)
+  const char *ifNoneMatch
+    = wsHttpRequestGetHeader(httpRequest, "If-None-Match");
+  if (ifNoneMatch != NULL) {
+    return wsETagListMatches(ifNoneMatch, file->eTag);
+  }
+  
+  i64 ifModifiedSince = wsParseHttpDate(
+    wsHttpRequestGetHeader(httpRequest, "If-Modified-Since"));
+  
+  return (ifModifiedSince >= 0) && (file->mtimeSeconds <= ifModifiedSince);
+}
+
+/// @def WS_MAX_BYTE_RANGES
+///
+/// @brief The number of ranges one request may ask for.  Requests for more are
+/// answered with the whole file so that a client can't make the server send
+/// a file as a flood of tiny parts.
+#define WS_MAX_BYTE_RANGES 16
+
+/// @struct WsByteRange
+///
+/// @brief One satisfiable range of a Range header, resolved against the size of
+/// the file.
+///
+/// @param first The offset of the first byte of the range.
+/// @param last The offset of the last byte of the range.
+typedef struct WsByteRange {
+  u64 first;
+  u64 last;
+} WsByteRange;
+
+/// @fn bool wsIfRangeMatches(const WsHttpRequest *httpRequest, const WsFileCacheEntry *file)
+///
+/// @brief Evaluate the If-Range header of a request against the current version
+/// of the requested file.
+///
+/// @param httpRequest The parsed header of the request.
+/// @param file The WsFileCacheEntry for the current version of the file.
+///
+/// @return Returns true if the request has no If-Range header or if the
+/// client's partial copy is of the current version, false if the client has to
+/// get the whole file instead.
+bool wsIfRangeMatches(const WsHttpRequest *httpRequest,
+  const WsFileCacheEntry *file
+) {
+  const char *ifRange = wsHttpRequestGetHeader(httpRequest, "If-Range");
+  if (ifRange == NULL) {
+    return true;
+  } else if (ifRange[0] == '"') {
+    // Only a strong comparison will do.  (RFC 9110 section 13.1.5)
+    return (strcmp(ifRange, file->eTag) == 0);
+  } else if (strncmp(ifRange, "W/", 2) == 0) {
+    // A weak validator can never match.
+    return false;
+  }
+  
+  return (wsParseHttpDate(ifRange) == file->mtimeSeconds);
+}
+
+/// @fn int wsParseRange(const char *range, u64 size, WsByteRange *ranges)
+///
+/// @brief Parse the value of a Range header against the size of a file.
+///
+/// @param range The value of the Range header.
+/// @param size The size of the file.
+/// @param ranges An array of WS_MAX_BYTE_RANGES WsByteRanges to fill in with
+///   the satisfiable ranges in the order they were requested.
+///
+/// @return Returns the number of satisfiable ranges, 0 if none of them are
+/// satisfiable, and -1 if the header has to be ignored because it's malformed,
+/// isn't in bytes, asks for too many ranges, or asks for more than the whole
+/// file in total.
+int wsParseRange(const char *range, u64 size, WsByteRange *ranges) {
+  if (strncmp(range, "bytes=", 6) != 0) {
+    return -1;
+  }
+  
+  const char *charAt = range + 6;
+  int numSpecs = 0;
+  int numRanges = 0;
+  u64 totalLength = 0;
+  while (true) {
+    charAt += strspn(charAt, " \t");
+    if (++numSpecs > WS_MAX_BYTE_RANGES) {
+      return -1;
+    }
+    
+    char *endAt = NULL;
+    u64 first = 0;
+    u64 last = 0;
+    bool suffix = (*charAt == '-');
+    if (suffix) {
+      // The last N bytes of the file.
+      charAt++;
+      if (isdigit((unsigned char) *charAt) == 0) {
+        return -1;
+      }
+      u64 suffixLength = (u64) strtoull(charAt, &endAt, 10);
+      first = (suffixLength < size) ? size - suffixLength : 0;
+      last = size - 1;
+      if (suffixLength == 0) {
+        // Unsatisfiable.
+        first = size;
+      }
+    } else {
+      if (isdigit((unsigned char) *charAt) == 0) {
+        return -1;
+      }
+      first = (u64) strtoull(charAt, &endAt, 10);
+      if (*endAt != '-') {
+        return -1;
+      }
+      charAt = endAt + 1;
+      endAt = (char*) charAt;
+      last = size - 1;
+      if (isdigit((unsigned char) *charAt) != 0) {
+        last = (u64) strtoull(charAt, &endAt, 10);
+        if (last < first) {
+          return -1;
+        } else if (last >= size) {
+          last = size - 1;
+        }
+      }
+    }
+    
+    if ((size > 0) && (first < size)) {
+      ranges[numRanges].first = first;
+      ranges[numRanges].last = last;
+      totalLength += last - first + 1;
+      numRanges++;
+    } // else the range is unsatisfiable and is left out
+    
+    charAt = endAt + strspn(endAt, " \t");
+    if (*charAt == '\0') {
+      break;
+    } else if (*charAt != ',') {
+      return -1;
+    }
+    charAt++;
+  }
+  
+  return (totalLength <= size) ? numRanges : -1;
+}
+
+/// @fn char* wsRangePartHeader(WsArena *arena, bool firstPart, const char *boundary, const char *mimeType, const WsByteRange *range, u64 size)
+///
+/// @brief Format the delimiter and header of one part of a
+/// multipart/byteranges response.
+///
+/// @param arena The WsArena of the request.
+/// @param firstPart Whether or not this is the first part of the response.
+///   The delimiters of the other parts start with the end of the line that the
+///   previous part's content ends on.
+/// @param boundary The boundary string that separates the parts.
+/// @param mimeType The MIME type of the file the ranges are of.
+/// @param range The WsByteRange the part holds.
+/// @param size The size of the file the ranges are of.
+///
+/// @return Returns the header allocated from arena on success, NULL on
+/// failure.
+char* wsRangePartHeader(WsArena *arena, bool firstPart, const char *boundary,
+  const char *mimeType, const WsByteRange *range, u64 size
+) {
+  return wsArenaPrintf(arena,
+    "%s--%s\r\nContent-Type: %s\r\n"
+    "Content-Range: bytes %llu-%llu/%llu\r\n\r\n",
+    firstPart ? "" : "\r\n", boundary, mimeType,
+    llu(range->first), llu(range->last), llu(size));
+}
+
+/// @fn void wsFileSetValidators(WsFileCacheEntry *file, const char *targetNamespace)
+///
+/// @brief Compute the ETag and Last-Modified values for a file from its size
+/// and modification time.
+///
+/// @param file The WsFileCacheEntry to set the validators of.  Its fileSize,
+///   mtimeSeconds, and mtimeNanoseconds must already be set.
+/// @param targetNamespace The namespace substituted into the file's content, if
+///   any.  NULL if the content is the unmodified file.
+void wsFileSetValidators(WsFileCacheEntry *file, const char *targetNamespace) {
+  // The ETag identifies this exact representation of the file, so it has to
+  // change with the substituted namespace as well as with the file itself.
+  if (targetNamespace != NULL) {
+    // 64-bit FNV-1a hash of the namespace.
+    u64 namespaceHash = 0xcbf29ce484222325ULL;
+    for (const char *c = targetNamespace; *c != '\0'; c++) {
+      namespaceHash = (namespaceHash ^ (u8) *c) * 0x100000001b3ULL;
+    }
+    snprintf(file->eTag, sizeof(file->eTag), "\"%llx-%llx.%llx-%llx\"",
+      llu(file->fileSize), llu(file->mtimeSeconds),
+      llu(file->mtimeNanoseconds), llu(namespaceHash));
+  } else {
+    snprintf(file->eTag, sizeof(file->eTag), "\"%llx-%llx.%llx\"",
+      llu(file->fileSize), llu(file->mtimeSeconds),
+      llu(file->mtimeNanoseconds));
+  }
+  wsFormatHttpDate(file->mtimeSeconds,
+    file->lastModified, sizeof(file->lastModified));
+}
+
+/// @fn void wsFileSetEncoding(WsFileCacheEntry *file, WsContentEncoding encoding)
+///
+/// @brief Mark a file entry as holding an encoded representation of the file.
+/// The encoding name is added to the ETag so that the identity and encoded
+/// representations never validate each other.
+///
+/// @param file The WsFileCacheEntry to update.  Its ETag must already be set.
+/// @param encoding The WsContentEncoding of the entry's content.
+void wsFileSetEncoding(WsFileCacheEntry *file, WsContentEncoding encoding) {
+  file->contentEncoding = encoding;
+  size_t eTagLength = strlen(file->eTag);
+  if ((encoding == WS_ENCODING_IDENTITY) || (eTagLength < 2)) {
+    // Nothing to add.
+    return;
+  }
+  
+  // Insert the encoding name before the closing quote.
+  char *closingQuote = &file->eTag[eTagLength - 1];
+  size_t available = sizeof(file->eTag) - (eTagLength - 1);
+  int written = snprintf(closingQuote, available, "-%s\"",
+    wsContentEncodingNames[encoding]);
+  if ((written < 0) || ((size_t) written >= available)) {
+    printLog(ERR, "ETag \"%s\" has no room for the encoding.\n", file->eTag);
+  }
+}
+
+/// @fn WsFileCacheEntry* wsGetFileVariant(WsThreadInfo *wsThreadInfo, WsFileCacheEntry *file, WsContentEncoding encoding)
+///
+/// @brief Get a compressed variant of a file whose content is held in memory.
+/// Variants are cached alongside the identity entry so that each file is only
+/// compressed once per modification rather than once per request.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param file The identity WsFileCacheEntry returned by wsGetFile.  This
+///   reference is consumed if a variant is returned.
+/// @param encoding The WsContentEncoding the client negotiated.
+///
+/// @return Returns the variant on success.  If the file can't be usefully
+/// compressed, file itself is returned.  Either way, the returned entry must be
+/// released with wsFileCacheRelease.
+WsFileCacheEntry* wsGetFileVariant(WsThreadInfo *wsThreadInfo,
+  WsFileCacheEntry *file, WsContentEncoding encoding
+) {
+  WsFileCache *fileCache = wsThreadInfo->fileCache;
+  if ((encoding == WS_ENCODING_IDENTITY) || (file->zeroCopy)
+    || (file->eTag[0] == '\0')
+  ) {
+    // Nothing to look up.
+    return file;
+  }
+  
+  char *key = NULL;
+  straddstr(&key, file->key);
+  straddstr(&key, "\n");
+  straddstr(&key, wsContentEncodingNames[encoding]);
+  WsFileCacheEntry *variant = wsFileCacheGet(fileCache, key,
+    file->fileSize, file->mtimeSeconds, file->mtimeNanoseconds);
+  if (variant != NULL) {
+    key = stringDestroy(key);
+    file = wsFileCacheRelease(fileCache, file);
+    return variant;
+  }
+  
+  Bytes content = wsCompressBytes(file->content, bytesLength(file->content),
+    encoding, wsThreadInfo->compressionLevel);
+  if ((content == NULL)
+    || (bytesLength(content) >= bytesLength(file->content))
+  ) {
+    // Compression doesn't help this file.
+    content = bytesDestroy(content);
+    key = stringDestroy(key);
+    return file;
+  }
+  
+  variant = (WsFileCacheEntry*) calloc(1, sizeof(WsFileCacheEntry));
+  if (variant == NULL) {
+    LOG_MALLOC_FAILURE();
+    content = bytesDestroy(content);
+    key = stringDestroy(key);
+    return file;
+  }
+  variant->key = key;
+  key = NULL;
+  variant->content = content;
+  variant->refCount = 1;
+  variant->mimeType = file->mimeType;
+  variant->fileSize = file->fileSize;
+  variant->mtimeSeconds = file->mtimeSeconds;
+  variant->mtimeNanoseconds = file->mtimeNanoseconds;
+  strcpy(variant->eTag, file->eTag);
+  strcpy(variant->lastModified, file->lastModified);
+  wsFileSetEncoding(variant, encoding);
+  bool cacheVariant = false;
+  if (fileCache != NULL) {
+    mtx_lock(&fileCache->lock);
+    cacheVariant = file->inCache;
+    mtx_unlock(&fileCache->lock);
+  }
+  if (cacheVariant) {
+    // Only cache variants of content that's current.
+    wsFileCacheAdd(fileCache, variant);
+  }
+  file = wsFileCacheRelease(fileCache, file);
+  
+  return variant;
+}
+
+/// @def WS_FILE_WINDOW_BYTES
+///
+/// @brief The number of bytes of a file that are mapped (or read) at a time
+/// when a file is streamed to a client without sendfile.  This bounds the
+/// memory a download can pin regardless of the size of the file.
+#define WS_FILE_WINDOW_BYTES (4 * 1024 * 1024)
+
+/// @fn int wsSendFileWindow(Socket *clientSocket, WsCompressor *compressor, const void *window, size_t windowLength, bool last)
+///
+/// @brief Send one window of a file to a client, compressing it first if the
+/// file is being sent with a content coding.  Support function for wsSendFile.
+///
+/// @param clientSocket The Socket to send the window on.
+/// @param compressor The WsCompressor for the response, or NULL if the file is
+///   being sent as-is.
+/// @param window The window of file content to send.
+/// @param windowLength The number of bytes at window.
+/// @param last Whether or not this is the last window of the file.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsSendFileWindow(Socket *clientSocket, WsCompressor *compressor,
+  const void *window, size_t windowLength, bool last
+) {
+  if (compressor == NULL) {
+    return (socketSend(clientSocket, window, (int) windowLength)
+      == (int) windowLength) ? 0 : -1;
+  }
+  
+  // Compressed output is sent with the chunked transfer coding because its
+  // length isn't known until the whole file has been compressed.
+  Bytes compressed = NULL;
+  int returnValue = wsCompressorWrite(compressor, window, windowLength, last,
+    &compressed);
+  if ((returnValue == 0) && (bytesLength(compressed) > 0)) {
+    returnValue = wsSendChunk(clientSocket,
+      compressed, bytesLength(compressed));
+  }
+  if ((returnValue == 0) && (last)) {
+    returnValue = wsSendChunk(clientSocket, NULL, 0);
+  }
+  compressed = bytesDestroy(compressed);
+  
+  return returnValue;
+}
+
+/// @fn int wsSendFile(Socket *clientSocket, const char *fullPath, u64 fileSize, u64 offset, u64 length, WsCompressor *compressor)
+///
+/// @brief Send the content of a file to a client without reading it into a
+/// heap buffer.  Plaintext sockets on Linux use sendfile so the data never
+/// leaves the kernel.  TLS sockets have to encrypt in user space, so the file
+/// is mapped one WS_FILE_WINDOW_BYTES window at a time and each window is
+/// handed to the TLS layer directly.  Compressed responses are produced the
+/// same way, one window at a time, so memory use stays bounded.  Only the
+/// bytes being sent are ever read from disk.
+///
+/// @param clientSocket The Socket to send the file on.
+/// @param fullPath The full path to the file to send.
+/// @param fileSize The size of the file when the header was sent.  If the
+///   file no longer has this size, nothing is sent and an error is returned so
+///   that the connection gets closed.
+/// @param offset The offset in the file of the first byte to send.
+/// @param length The number of bytes to send.
+/// @param compressor A WsCompressor initialized for the response's content
+///   coding, or NULL to send the file as-is.  Compressed output is sent with
+///   the chunked transfer coding.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsSendFile(Socket *clientSocket, const char *fullPath, u64 fileSize,
+  u64 offset, u64 length, WsCompressor *compressor
+) {
+  printLog(TRACE, "ENTER wsSendFile(fullPath=\"%s\", fileSize=%llu)\n",
+    fullPath, llu(fileSize));
+  
+  int returnValue = 0;
+#ifdef _WIN32
+  // No zero-copy primitive that works with our Socket abstraction here.  Read
+  // the file one window at a time instead of all at once.
+  FILE *file = fopen(fullPath, "rb");
+  if (file == NULL) {
+    printLog(ERR, "Could not open \"%s\".\n", fullPath);
+    printLog(TRACE, "EXIT wsSendFile(fullPath=\"%s\", fileSize=%llu) = {-1}\n",
+      fullPath, llu(fileSize));
+    return -1;
+  }
+  char *window = (char*) malloc(WS_FILE_WINDOW_BYTES);
+  if ((window == NULL)
+    || (_fseeki64(file, (__int64) offset, SEEK_SET) != 0)
+  ) {
+    printLog(ERR, "Could not read \"%s\".\n", fullPath);
+    window = (char*) pointerDestroy(window);
+    fclose(file);
+    printLog(TRACE, "EXIT wsSendFile(fullPath=\"%s\", fileSize=%llu) = {-1}\n",
+      fullPath, llu(fileSize));
+    return -1;
+  }
+  u64 remaining = length;
+  while (remaining > 0) {
+    size_t windowLength = (remaining < WS_FILE_WINDOW_BYTES)
+      ? (size_t) remaining : WS_FILE_WINDOW_BYTES;
+    remaining -= windowLength;
+    if ((fread(window, 1, windowLength, file) != windowLength)
+      || (wsSendFileWindow(clientSocket, compressor,
+        window, windowLength, remaining == 0) != 0)
+    ) {
+      returnValue = -1;
+      break;
+    }
+  }
+  if ((compressor != NULL) && (length == 0)) {
+    returnValue = wsSendFileWindow(clientSocket, compressor, NULL, 0, true);
+  }
+  window = (char*) pointerDestroy(window);
+  fclose(file);
+#else // POSIX
+  int fd = open(fullPath, O_RDONLY);
+  struct stat fileStat;
+  if ((fd < 0) || (fstat(fd, &fileStat) != 0)
+    || ((u64) fileStat.st_size != fileSize)
+  ) {
+    // Either the file is gone or it changed after the header went out.
+    printLog(ERR, "\"%s\" changed before it could be sent.\n", fullPath);
+    if (fd >= 0) {
+      close(fd);
+    }
+    printLog(TRACE, "EXIT wsSendFile(fullPath=\"%s\", fileSize=%llu) = {-1}\n",
+      fullPath, llu(fileSize));
+    return -1;
+  }
+  
+  u64 end = offset + length;
+#ifdef __linux__
+  if ((clientSocket->socketMode == PLAIN) && (compressor == NULL)) {
+    bool socketWasBlocking = clientSocket->blocking;
+    if (socketWasBlocking == false) {
+      socketSetBlocking(clientSocket);
+    }
+    mtx_lock(&clientSocket->lock);
+    while (offset < end) {
+      off_t fileOffset = (off_t) offset;
+      ssize_t bytesSent = sendfile(clientSocket->sockfd, fd, &fileOffset,
+        (size_t) (end - offset));
+      if (bytesSent <= 0) {
+        if ((bytesSent < 0) && (errno == EINTR)) {
+          continue;
+        } else if (wsSocketWaitToSend(clientSocket, bytesSent) == true) {
+          continue;
+        }
+        printLog(ERR, "Client prematurely closed connection.\n");
+        returnValue = -1;
+        break;
+      }
+      offset += (u64) bytesSent;
+    }
+    mtx_unlock(&clientSocket->lock);
+    if (socketWasBlocking == false) {
+      socketSetNonblocking(clientSocket);
+    }
+  }
+#endif // __linux__
+  
+  // Anything left (TLS sockets, compressed responses, or platforms without
+  // sendfile) is streamed from a sliding mapping of the file.  Mappings have
+  // to start on a page boundary, which a range of the file may not.
+  u64 pageMask = ((u64) sysconf(_SC_PAGESIZE)) - 1;
+  while ((returnValue == 0) && (offset < end)) {
+    size_t windowLength = ((end - offset) < WS_FILE_WINDOW_BYTES)
+      ? (size_t) (end - offset) : WS_FILE_WINDOW_BYTES;
+    size_t pageOffset = (size_t) (offset & pageMask);
+    void *mapping = mmap(NULL, pageOffset + windowLength, PROT_READ,
+      MAP_PRIVATE, fd, (off_t) (offset - pageOffset));
+    if (mapping == MAP_FAILED) {
+      printLog(ERR, "Could not map \"%s\": %s\n", fullPath, strerror(errno));
+      returnValue = -1;
+      break;
+    }
+    madvise(mapping, pageOffset + windowLength, MADV_SEQUENTIAL);
+    offset += windowLength;
+    if (wsSendFileWindow(clientSocket, compressor,
+      ((char*) mapping) + pageOffset, windowLength, offset == end) != 0
+    ) {
+      printLog(ERR, "Client prematurely closed connection.\n");
+      returnValue = -1;
+    }
+    munmap(mapping, pageOffset + windowLength);
+  }
+  if ((compressor != NULL) && (length == 0)) {
+    returnValue = wsSendFileWindow(clientSocket, compressor, NULL, 0, true);
+  }
+  close(fd);
+#endif // _WIN32
+  
+  printLog(TRACE, "EXIT wsSendFile(fullPath=\"%s\", fileSize=%llu) = {%d}\n",
+    fullPath, llu(fileSize), returnValue);
+  return returnValue;
+}
+
+/// @fn WsFileCacheEntry* wsGetFile(WsThreadInfo *wsThreadInfo, const char *path, const char *targetNamespace)
+///
+/// @brief Get the contents of a file requested by the client.  Support function
+/// for handleGetRequest.  The file is served from the server's file cache if
+/// the cached copy is still current.  Otherwise it's read from disk and added
+/// to the cache.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the
+///   connection.
+/// @param path The path of the file (relative to
+///   wsThreadInfo->interfacePath) to return.
+/// @param targetNamespace The wsNamespace to use if the client is requesting
+///   a WSDL or XSD.
+///
+/// @return Returns a WsFileCacheEntry for the file on success, NULL if the file
+/// does not exist.  The returned entry must be released with
+/// wsFileCacheRelease.
+WsFileCacheEntry* wsGetFile(WsThreadInfo *wsThreadInfo,
+  const char *path, const char *targetNamespace
+) {
+  WsArena *arena = &wsThreadInfo->arena;
+  char *fullPath = NULL;
+  
+  WsFileCacheEntry *file = NULL;
+  
+  printLog(TRACE, "ENTER wsGetFile(path=\"%s\")\n", path);
+  printLog(DETAIL, "Processing request to GET \"%s\".\n", path);
+  
+  if (strstr(path, "../")) {
+    printLog(ERR, "Attempt to get relative path.\n");
+    printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, file);
+    return file;
+  }
+  
+  // Correct the path so that we get the correct file.
+  printLog(DEBUG, "interfacePath = \"%s\"\n",
+    wsThreadInfo->interfacePath);
+  wsArenaAddStr(arena, &fullPath, wsThreadInfo->interfacePath);
+  printLog(DEBUG, "path = \"%s\"\n", path);
+  wsArenaAddStr(arena, &fullPath, path);
+  // See if we should really be returning index.html.
+  size_t pathLength = strlen(path);
+  bool directoryRequested
+    = ((pathLength > 0) && (path[pathLength - 1] == '/'));
+  if (directoryRequested) {
+    // Request was for a directory.
+    wsArenaAddStr(arena, &fullPath, "index.html");
+  }
+  printLog(DEBUG, "fullPath = \"%s\"\n", fullPath);
+  
+  struct stat fileStat;
+  if (stat(fullPath, &fileStat) != 0) {
+    // File not found on disk.  Return nothing.
+    printLog(ERR, "File not found.\n");
+    printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, file);
+    return file;
+  }
+  
+  if (S_ISDIR(fileStat.st_mode)) {
+    // Adjust for directory get
+    printLog(DEBUG, "Checking to see if %s is a directory.", path);
+    wsArenaAddStr(arena, &fullPath, "/index.html");
+    if ((directoryRequested == false) && (stat(fullPath, &fileStat) == 0)) {
+      // Requested file is actually a directory.  Tell the client to request
+      // this properly by adding a trailing '/' to the request.  This content
+      // is specific to the path, so it's never cached.
+      file = (WsFileCacheEntry*) calloc(1, sizeof(WsFileCacheEntry));
+      if (file != NULL) {
+        file->mimeType = "text/html";
+        file->refCount = 1;
+        bytesAddStr(&file->content,
+          " <html> <head> <meta http-equiv=\"refresh\" content=\"0;URL='");
+        bytesAddStr(&file->content, path);
+        bytesAddStr(&file->content, "/"); // Trailing '/' character on path
+        bytesAddStr(&file->content, "'\" /> </head> </html> ");
+      } else {
+        LOG_MALLOC_FAILURE();
+      }
+    } else {
+      printLog(ERR, "File not found.\n");
+    }
+    printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, file);
+    return file;
+  }
+  printLog(DEBUG, "File check complete.\n");
+  
+  // WSDL and XSD files have the target namespace substituted into them, so
+  // the namespace is part of what identifies the cached content.
+  char *fileExtension = strrchr(fullPath, '.');
+  bool substituteNamespace = ((fileExtension != NULL)
+    && ((strcmp(fileExtension, ".xsd") == 0)
+      || (strcmp(fileExtension, ".wsdl") == 0)
+    )
+  );
+  char *key = NULL;
+  wsArenaAddStr(arena, &key, fullPath);
+  if (substituteNamespace) {
+    wsArenaAddStr(arena, &key, "\n");
+    wsArenaAddStr(arena, &key, targetNamespace);
+  }
+  
+  // Files the cache won't hold are sent straight from disk, so there's no point
+  // in looking for them in the cache.
+  WsFileCache *fileCache = wsThreadInfo->fileCache;
+  bool zeroCopy = ((substituteNamespace == false)
+    && ((fileCache == NULL)
+      || ((u64) fileStat.st_size > fileCache->maxEntryBytes)
+    )
+  );
+  if (zeroCopy == false) {
+    file = wsFileCacheGet(fileCache, key, (u64) fileStat.st_size,
+      (i64) fileStat.st_mtime, wsFileMtimeNanoseconds(&fileStat));
+  }
+  if (file != NULL) {
+    printLog(DEBUG, "Serving \"%s\" from the file cache.\n", fullPath);
+    printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, file);
+    return file;
+  }
+  
+  file = (WsFileCacheEntry*) calloc(1, sizeof(WsFileCacheEntry));
+  if (file == NULL) {
+    LOG_MALLOC_FAILURE();
+    printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, file);
+    return file;
+  }
+  // The key outlives the request if the entry is cached.
+  straddstr(&file->key, key);
+  file->refCount = 1;
+  file->fileSize = (u64) fileStat.st_size;
+  file->mtimeSeconds = (i64) fileStat.st_mtime;
+  file->mtimeNanoseconds = wsFileMtimeNanoseconds(&fileStat);
+  
+  // Determine content type.
+  file->mimeType = getMimeType(fileExtension);
+  printLog(DEBUG, "Determined Content-type: %s\n", file->mimeType);
+  
+  if (zeroCopy) {
+    file->zeroCopy = true;
+    wsFileSetValidators(file, NULL);
+    printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, file);
+    return file;
+  }
+  
+  // Get the file content.
+  file->content = getFileContent(fullPath);
+  if ((file->content == NULL) && (file->fileSize > 0)) {
+    printLog(ERR, "Could not read \"%s\".\n", fullPath);
+    file = wsFileCacheRelease(fileCache, file);
+    printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, file);
+    return file;
+  }
+  printLog(DEBUG, "Got file content for \"%s\".\n", fullPath);
+  bool contentMatchesStat = (bytesLength(file->content) == file->fileSize);
+  
+  // Adjust for WSDL material
+  if (substituteNamespace) {
+    // bytesReplaceStr needs a NUL-terminated string.
+    bytesAddData(&file->content, "", 1);
+    Bytes newContent = bytesReplaceStr(file->content, "<<TARGET_NAMESPACE>>",
+      strOrEmpty(targetNamespace));
+    file->content = bytesDestroy(file->content);
+    file->content = newContent;
+  }
+  
+  wsFileSetValidators(file,
+    substituteNamespace ? strOrEmpty(targetNamespace) : NULL);
+  
+  if (contentMatchesStat) {
+    wsFileCacheAdd(fileCache, file);
+  } // else the file changed while we were reading it; don't cache this copy
+  
+  printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, file);
+  
+  return file;
+}
+
+/// @fn char* wsArenaAddHistogram(WsArena *arena, char **buffer, const char *labels, WsHistogram *histogram)
+///
+/// @brief Append one phase of a function's timings to metrics in the
+/// Prometheus text format.  Buckets above the highest one that holds a value
+/// are left out since they would all have the same count as the +Inf bucket.
+///
+/// @param arena The WsArena that *buffer was allocated from.
+/// @param buffer A pointer to the metrics to append to.
+/// @param labels The labels that identify the function and phase.
+/// @param histogram The WsHistogram of the phase.
+///
+/// @return Returns the updated *buffer on success, NULL on failure.
+char* wsArenaAddHistogram(WsArena *arena, char **buffer, const char *labels,
+  WsHistogram *histogram
+) {
+  // Work from a snapshot so that the cumulative counts agree with each other
+  // while requests are being recorded.
+  u64 counts[WS_METRICS_NUM_BUCKETS];
+  int numBuckets = 0;
+  for (int i = 0; i < WS_METRICS_NUM_BUCKETS; i++) {
+    counts[i] = atomic_load_explicit(&histogram->buckets[i],
+      memory_order_relaxed);
+    if (counts[i] > 0) {
+      numBuckets = i + 1;
+    }
+  }
+  if (numBuckets == 0) {
+    // Nothing has been recorded.
+    return *buffer;
+  }
+  u64 sumUs = atomic_load_explicit(&histogram->sumUs, memory_order_relaxed);
+  
+  char line[512];
+  u64 count = 0;
+  for (int i = 0; i < numBuckets; i++) {
+    count += counts[i];
+    u64 limitUs = wsHistogramBucketLimit((u32) i);
+    snprintf(line, sizeof(line),
+      "ws_request_phase_seconds_bucket{%s,le=\"%llu.%06llu\"} %llu\n",
+      labels, llu(limitUs / 1000000), llu(limitUs % 1000000), llu(count));
+    if (wsArenaAddStr(arena, buffer, line) == NULL) {
+      return NULL;
+    }
+  }
+  snprintf(line, sizeof(line),
+    "ws_request_phase_seconds_bucket{%s,le=\"+Inf\"} %llu\n"
+    "ws_request_phase_seconds_sum{%s} %llu.%06llu\n"
+    "ws_request_phase_seconds_count{%s} %llu\n",
+    labels, llu(count),
+    labels, llu(sumUs / 1000000), llu(sumUs % 1000000),
+    labels, llu(count));
+  
+  return wsArenaAddStr(arena, buffer, line);
+}
+
+/// @fn char* wsMetricsToPrometheus(WsArena *arena, WsMetrics *metrics, const WsRouteTable *routeTable)
+///
+/// @brief Format a server's metrics in the Prometheus text exposition format.
+/// Phases of functions that have never been called are left out.
+///
+/// @param arena The WsArena to allocate the metrics from.
+/// @param metrics The WsMetrics of the server.
+/// @param routeTable The WsRouteTable of the server's web service functions.
+///   May be NULL.
+///
+/// @return Returns the formatted metrics on success, NULL on failure.
+char* wsMetricsToPrometheus(WsArena *arena, WsMetrics *metrics,
+  const WsRouteTable *routeTable
+) {
+  if ((arena == NULL) || (metrics == NULL)) {
+    return NULL;
+  }
+  
+  char *text = wsArenaPrintf(arena,
+    "# HELP ws_active_connections Client connections that are open.\n"
+    "# TYPE ws_active_connections gauge\n"
+    "ws_active_connections %llu\n"
+    "# HELP ws_received_bytes_total Bytes of requests received.\n"
+    "# TYPE ws_received_bytes_total counter\n"
+    "ws_received_bytes_total %llu\n"
+    "# HELP ws_sent_bytes_total Bytes of responses sent.\n"
+    "# TYPE ws_sent_bytes_total counter\n"
+    "ws_sent_bytes_total %llu\n"
+    "# HELP ws_responses_total Responses sent by status code.\n"
+    "# TYPE ws_responses_total counter\n",
+    llu(atomic_load_explicit(&metrics->activeConnections,
+      memory_order_relaxed)),
+    llu(atomic_load_explicit(&metrics->bytesIn, memory_order_relaxed)),
+    llu(atomic_load_explicit(&metrics->bytesOut, memory_order_relaxed)));
+  
+  char line[512];
+  for (int code = 0; code <= WS_METRICS_MAX_STATUS_CODE; code++) {
+    u64 count = atomic_load_explicit(&metrics->statusCounts[code],
+      memory_order_relaxed);
+    if (count > 0) {
+      snprintf(line, sizeof(line), "ws_responses_total{code=\"%d\"} %llu\n",
+        code, llu(count));
+      wsArenaAddStr(arena, &text, line);
+    }
+  }
+  
+  wsArenaAddStr(arena, &text,
+    "# HELP ws_request_phase_seconds Time requests spent in each phase.\n"
+    "# TYPE ws_request_phase_seconds histogram\n");
+  u32 numSlots = (routeTable != NULL) ? routeTable->mask + 1 : 0;
+  for (u32 slot = 0; slot <= numSlots; slot++) {
+    // The slot after the last one stands for everything that wasn't a call
+    // to a web service function.
+    const char *key = "/";
+    const char *functionName = key + 1;
+    WsRouteMetrics *routeMetrics = &metrics->other;
+    if (slot < numSlots) {
+      const WsRoute *route = &routeTable->slots[slot];
+      if (route->key == NULL) {
+        continue;
+      }
+      key = route->key;
+      functionName = route->functionName;
+      routeMetrics = route->metrics;
+    }
+    
+    for (int phase = 0; phase < NUM_WS_METRICS_PHASES; phase++) {
+      char labels[256];
+      snprintf(labels, sizeof(labels),
+        "namespace=\"%.*s\",function=\"%s\",phase=\"%s\"",
+        (int) (functionName - key - 1), key, functionName,
+        WsMetricsPhaseNames[phase]);
+      wsArenaAddHistogram(arena, &text, labels,
+        &routeMetrics->phases[phase]);
+    }
+  }
+  
+  wsArenaAddStr(arena, &text,
+    "# HELP ws_response_cache_lookups_total Calls to functions with cached "
+    "responses by whether a cached response was sent.\n"
+    "# TYPE ws_response_cache_lookups_total counter\n");
+  for (u32 slot = 0; slot < numSlots; slot++) {
+    const WsRoute *route = &routeTable->slots[slot];
+    if (route->cache == NULL) {
+      continue;
+    }
+    mtx_lock(&route->cache->lock);
+    u64 numHits = route->cache->numHits;
+    u64 numMisses = route->cache->numMisses;
+    mtx_unlock(&route->cache->lock);
+    snprintf(line, sizeof(line),
+      "ws_response_cache_lookups_total{namespace=\"%.*s\",function=\"%s\","
+      "result=\"hit\"} %llu\n"
+      "ws_response_cache_lookups_total{namespace=\"%.*s\",function=\"%s\","
+      "result=\"miss\"} %llu\n",
+      (int) (route->functionName - route->key - 1), route->key,
+      route->functionName, llu(numHits),
+      (int) (route->functionName - route->key - 1), route->key,
+      route->functionName, llu(numMisses));
+    wsArenaAddStr(arena, &text, line);
+  }
+  
+#ifdef TLS_SOCKETS_ENABLED
+  // A resumed handshake is counted in numHandshakes before numResumed, so
+  // load numResumed first.  The loads are still separate, so clamp too.
+  u64 numResumed = atomic_load_explicit(&metrics->tlsSessions.numResumed,
+    memory_order_relaxed);
+  u64 numHandshakes = atomic_load_explicit(&metrics->tlsSessions.numHandshakes,
+    memory_order_relaxed);
+  if (numHandshakes < numResumed) {
+    numHandshakes = numResumed;
+  }
+  snprintf(line, sizeof(line),
+    "# HELP ws_tls_handshakes_total TLS handshakes completed by whether an "
+    "earlier session was resumed.\n"
+    "# TYPE ws_tls_handshakes_total counter\n"
+    "ws_tls_handshakes_total{resumed=\"false\"} %llu\n"
+    "ws_tls_handshakes_total{resumed=\"true\"} %llu\n",
+    llu(numHandshakes - numResumed), llu(numResumed));
+  wsArenaAddStr(arena, &text, line);
+#endif // TLS_SOCKETS_ENABLED
+  
+  return text;
+}
+
+/// @fn int handleMetricsRequest(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Send the server's metrics to the client.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int handleMetricsRequest(WsThreadInfo *wsThreadInfo) {
+  WsArena *arena = &wsThreadInfo->arena;
+  char *text = wsMetricsToPrometheus(arena,
+    wsThreadInfo->metrics, wsThreadInfo->routeTable);
+  if (text == NULL) {
+    LOG_MALLOC_FAILURE();
+    return 1;
+  }
+  
+  const char *contentType = "text/plain; version=0.0.4; charset=utf-8";
+  u64 bodyLength = strlen(text);
+  Bytes body = NULL;
+  const char *contentEncoding = NULL;
+  if (wsResponseEncoding(wsThreadInfo, contentType, bodyLength)
+    != WS_ENCODING_IDENTITY
+  ) {
+    // Compression works on Bytes.
+    bytesAddData(&body, text, bodyLength);
+    contentEncoding = wsCompressBody(wsThreadInfo, contentType, &body);
+    bodyLength = bytesLength(body);
+  }
+  
+  char *header = wsArenaPrintf(arena,
+    "Content-Length: %llu\r\nContent-Type: %s\r\n",
+    llu(bodyLength), contentType);
+  if (contentEncoding != NULL) {
+    wsArenaAddStr(arena, &header, "Content-Encoding: ");
+    wsArenaAddStr(arena, &header, contentEncoding);
+    wsArenaAddStr(arena, &header, "\r\n");
+  }
+  wsArenaAddStr(arena, &header, "Server: ");
+  wsArenaAddStr(arena, &header, wsThreadInfo->serverName);
+  wsArenaAddStr(arena, &header, "\r\n");
+  int returnValue = (sendResponseToClient(wsThreadInfo, "200 OK", header,
+    (body != NULL) ? (const void*) body : (const void*) text,
+    bodyLength) != 0);
+  body = bytesDestroy(body);
+  
+  return returnValue;
+}
+
+/// @fn int handleGetRequest(WsThreadInfo *wsThreadInfo, Bytes receiveBuffer)
+///
+/// @brief Handle a GET request from a client.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int handleGetRequest(WsThreadInfo *wsThreadInfo) {
+  printLog(TRACE,
+    "ENTER handleGetRequest(wsThreadInfo=%p)\n", wsThreadInfo);
+  
+  int returnValue = 0;
+  if (wsThreadInfo == NULL) {
+    printLog(ERR, "NULL wsThreadInfo parameter provided.  Cannot continue.\n");
+    returnValue = 1;
+    printLog(TRACE,
+      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, returnValue);
+    return returnValue;
+  }
+  
+  // POST requests may be handled on any port they come in on, but GET requests
+  // need to be redirected if we've been instructed to redirect.  See if we
+  // should redirect the client.
+  if (redirectClient(wsThreadInfo)) {
+    // Nothing else for us to do.
+    printLog(TRACE,
+      "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, 0);
+    return returnValue; // 0
+  }
+  
+  // There are two possibilities for a GET request:  The client may be
+  // requesting a web service function or may be requesting a static file.
+  // Web service functions will take precedence over static files of the same
+  // name, so check for a web service first and then fall back to looking for
+  // a static file if the web service lookup fails.  The lookup is done in
+  // place so that requests for static files don't allocate anything for it.
+  const char *location
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "_httpLocation");
+  if (location == NULL) {
+    printLog(ERR, "No _httpLocation provided in handleGetRequest.\n");
+    returnValue = 1;
+    printLog(TRACE,
+      "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, 1);
+    return returnValue;
+  }
+  
+  // The metrics endpoint takes precedence over both.
+  const char *metricsPath = wsThreadInfo->metricsPath;
+  if (metricsPath != NULL) {
+    size_t metricsPathLength = strlen(metricsPath);
+    if ((strncmp(location, metricsPath, metricsPathLength) == 0)
+      && ((location[metricsPathLength] == '\0')
+        || (location[metricsPathLength] == '?'))
+    ) {
+      returnValue = (wsCheckRequestRate(wsThreadInfo, NULL) == 0)
+        ? handleMetricsRequest(wsThreadInfo)
+        : (wsThreadInfo->responseSent == false);
+      printLog(TRACE,
+        "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+        wsThreadInfo, returnValue);
+      return returnValue;
+    }
+  }
+  
+  const WsRoute *route = wsRouteTableFindPath(wsThreadInfo->routeTable,
+    location);
+  // Requests for static files fall under the "*" limit.
+  if (wsCheckRequestRate(wsThreadInfo, route) != 0) {
+    returnValue = (wsThreadInfo->responseSent == false);
+    printLog(TRACE,
+      "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, returnValue);
+    return returnValue;
+  }
+  if (route != NULL) {
+    // kvStringToDictionary handles a NULL input.
+    const char *queryString = strchr(location, '?');
+    Dictionary *args = kvStringToDictionary(
+      (queryString != NULL) ? queryString + 1 : NULL, "&");
+    if (args == NULL) {
+      // Memory allocation failed.
+      returnValue = 1;
+      LOG_MALLOC_FAILURE();
+      printLog(TRACE,
+        "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+        wsThreadInfo, 1);
+      return returnValue;
+    }
+    Dictionary *tempDict = dictionaryCreate(typeString);
+    // Prepend "GET:" to all parameter names.  This is to distinguish them from
+    // POST parameters.  GET parameters can be faked by cross-site request
+    // forgery while POST parameters cannot.  This will force the called method
+    // to prepend "GET:" to the parameter names it requests so that the
+    // developer is reminded about this (and hopefully, doesn't do any data
+    // modifications while in a GET method).
+    for (DictionaryEntry *node = args->head; node != NULL; node = node->next) {
+      char *parameterName = NULL;
+      straddstr(&parameterName, "GET:");
+      straddstr(&parameterName, (char*) node->key);
+      dictionaryAddEntry(tempDict, parameterName, node->value);
+      parameterName = stringDestroy(parameterName);
+    }
+    args = dictionaryDestroy(args);
+    args = tempDict;
+    
+    if (wsResponseCacheServe(wsThreadInfo, route, args)) {
+      args = dictionaryDestroy(args);
+      returnValue = (wsThreadInfo->responseSent == false);
+      printLog(TRACE,
+        "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+        wsThreadInfo, returnValue);
+      return returnValue;
+    }
+    
+    WsResponseObject *outputParams
+      = webServiceCall(wsThreadInfo, route, args);
+    args = dictionaryDestroy(args);
+    
+    if ((outputParams != NULL) || (wsThreadInfo->responseStarted)) {
+      // We had a web service match.  Return the parameters to the client and
+      // exit.
+      // A return value of 0 from sendResponseObjectToClient is good status.
+      // The same is true for this function.  However, this being a top-level
+      // handler, we can only return zero or positive values to our caller.
+      // We need to restrict our return value to reflect this.
+      if (outputParams != NULL) {
+        returnValue = (sendResponseObjectToClient(wsThreadInfo,
+          route->functionName, outputParams) != 0);
+      } else {
+        // The function streamed its response.
+        returnValue = (wsThreadInfo->responseSent == false);
+      }
+      outputParams = wsThreadInfo->webService.responseObjectDestroy(outputParams);
+      
+      printLog(TRACE,
+        "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+        wsThreadInfo, returnValue);
+      return returnValue;
+    }
+  } // else this is a request for a static file
+  
+  // We need a copy of the path because we'll be unescaping it later, which
+  // modifies the buffer in place.
+  WsArena *arena = &wsThreadInfo->arena;
+  char *path = wsArenaStrdup(arena, location);
+  if (path == NULL) {
+    // Memory allocation failed.
+    returnValue = 1;
+    LOG_MALLOC_FAILURE();
+    printLog(TRACE,
+      "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, 1);
+    return returnValue;
+  }
+  
+  char *wsNamespace = NULL;
+  char *firstSlashAt = strchr(path, '/');
+  char *questionMarkAt = strchr(path, '?');
+  char *lastSlashAt = strrchr(path, '/');
+  if ((lastSlashAt != NULL) && (questionMarkAt != NULL)) {
+    if (((size_t) lastSlashAt) > ((size_t) questionMarkAt)) {
+      // This is not the right place for lastSlashAt.  Terminate the string
+      // where the question mark is and find the real one.
+      *questionMarkAt = '\0';
+      lastSlashAt = strrchr(path, '/');
+      // Now put the question mark back so that the rest of the parsing works.
+      *questionMarkAt = '?';
+    }
+  }
+  if ((firstSlashAt != NULL) && (lastSlashAt != NULL)) {
+    size_t wsNamespaceLength = ((size_t) lastSlashAt) - ((size_t) firstSlashAt);
+    if (wsNamespaceLength > 1) {
+      wsNamespace = (char*) wsArenaAlloc(arena, wsNamespaceLength);
+      if (wsNamespace != NULL) {
+        memcpy(wsNamespace, firstSlashAt + 1, wsNamespaceLength - 1);
+        wsNamespace[wsNamespaceLength - 1] = '\0';
+      }
+    }
+  }
+  
+  // If we made it this far then we need to see if there's a static file to get.
+  char *charAt = strchr(path, '?');
+  if (charAt != NULL) {
+    // We don't care about the rest of the URL.  Terminate the string.
+    *charAt = '\0';
+  }
+  
+  // Construct the target wsNamespace to use in the event the client is
+  // requesting a WSDL or XSD.
+  char *targetNamespace = NULL;
+  if (wsNamespace != NULL) {
+    Socket *clientSocket = wsThreadInfo->clientSocket;
+    const char *hostName
+      = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Host");
+    if (hostName != NULL) {
+      Bytes *hostArray = stringToBytesArray((char*) hostName, ":");
+      // hostArray[0] is guaranteed to be non-NULL
+      // hostArray[1] is guaranteed to be allocated
+      Bytes portString = hostArray[1];
+      if (portString != NULL) {
+        targetNamespace = wsArenaPrintf(arena, "%s://%s:%s/%s",
+          // clientSocket->socketMode can only be TLS if tlsSocketsEnabled() is
+          // true, so no need to check that here.
+          (clientSocket->socketMode == TLS) ? "https" :
+          "http",
+          (char*) hostArray[0], (char*) portString, wsNamespace);
+      } else {
+        targetNamespace = wsArenaPrintf(arena, "%s://%s/%s",
+          // clientSocket->socketMode can only be TLS if tlsSocketsEnabled() is
+          // true, so no need to check that here.
+          (clientSocket->socketMode == TLS)
+          ? "https" :
+          "http",
+          (char*) hostName, wsNamespace);
+      }
+      hostArray = freeBytesArray(hostArray);
+    }
+  }
+  
+  unescapeString(path);
+  printLog(DEBUG, "Getting file \"%s\".\n", path);
+  WsFileCacheEntry *file = wsGetFile(wsThreadInfo, path, targetNamespace);
+  
+  const char *status = "200 OK";
+  char *header = NULL;
+  const void *body = NULL;
+  u64 bodyLength = 0;
+  bool sendFromDisk = false;
+  WsCompressor compressor;
+  bool compressFromDisk = false;
+  const char *range = NULL;
+  WsByteRange ranges[WS_MAX_BYTE_RANGES];
+  int numRanges = -1;
+  char *partHeaders[WS_MAX_BYTE_RANGES];
+  char *closingDelimiter = NULL;
+  if (file == NULL) {
+    status = "404 Not Found";
+    wsArenaAddStr(arena, &header, "Content-Length: 0\r\n");
+  } else {
+    // Parts of generated content aren't served.
+    if (file->eTag[0] != '\0') {
+      range = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Range");
+    }
+    if ((range != NULL)
+      && (wsIfRangeMatches(&wsThreadInfo->httpRequest, file) == false)
+    ) {
+      // The client's partial copy is out of date, so it gets the whole file.
+      range = NULL;
+    }
+    // Ranges are of the identity representation, so a request for part of the
+    // file isn't compressed.
+    if ((range == NULL) && (file->eTag[0] != '\0')
+      && (wsThreadInfo->compressionLevel > 0)
+      && (wsIsCompressible(file->mimeType))
+    ) {
+      WsContentEncoding encoding = wsResponseEncoding(wsThreadInfo,
+        file->mimeType,
+        file->zeroCopy ? file->fileSize : bytesLength(file->content));
+      if (file->zeroCopy == false) {
+        file = wsGetFileVariant(wsThreadInfo, file, encoding);
+      } else if (encoding != WS_ENCODING_IDENTITY) {
+        // Too large to compress in memory.  Compress it as it's sent, which
+        // needs the chunked transfer coding and therefore HTTP/1.1.  The entry
+        // is private to this request, so it can be relabeled.
+        const char *protocol = wsHttpRequestGetHeader(
+          &wsThreadInfo->httpRequest, "_httpProtocol");
+        if ((protocol != NULL) && (strcmp(protocol, "HTTP/1.1") == 0)
+          && (wsCompressorInit(&compressor, encoding,
+            wsThreadInfo->compressionLevel) == 0)
+        ) {
+          wsFileSetEncoding(file, encoding);
+          compressFromDisk = true;
+        }
+      }
+    }
+    if (file->eTag[0] != '\0') {
+      // Let the client keep a copy, but make it check with us before using it.
+      // Revalidation is cheap since we only have to compare validators.
+      wsArenaAddStr(arena, &header, "Cache-Control: no-cache\r\n");
+      wsArenaAddStr(arena, &header, "ETag: ");
+      wsArenaAddStr(arena, &header, file->eTag);
+      wsArenaAddStr(arena, &header, "\r\nLast-Modified: ");
+      wsArenaAddStr(arena, &header, file->lastModified);
+      wsArenaAddStr(arena, &header, "\r\nAccept-Ranges: bytes\r\n");
+    }
+    u64 size = file->zeroCopy ? file->fileSize : bytesLength(file->content);
+    if (range != NULL) {
+      numRanges = wsParseRange(range, size, ranges);
+    }
+    // The multipart boundary must not be predictable or a file could contain
+    // it and break the framing of its own parts.
+    u8 boundaryBytes[16];
+    if ((numRanges > 1)
+      && (RAND_bytes(boundaryBytes, sizeof(boundaryBytes)) != 1)
+    ) {
+      // Ignoring the Range header is always allowed.
+      printLog(ERR, "Could not generate a multipart boundary.\n");
+      numRanges = -1;
+    }
+    if (wsFileNotModified(&wsThreadInfo->httpRequest, file)) {
+      status = "304 Not Modified";
+    } else if (numRanges == 0) {
+      status = "416 Range Not Satisfiable";
+      wsArenaAddStr(arena, &header, wsArenaPrintf(arena,
+        "Content-Range: bytes */%llu\r\nContent-Length: 0\r\n", llu(size)));
+    } else if (numRanges == 1) {
+      status = "206 Partial Content";
+      bodyLength = ranges[0].last - ranges[0].first + 1;
+      wsArenaAddStr(arena, &header, wsArenaPrintf(arena,
+        "Content-type: %s\r\nContent-Range: bytes %llu-%llu/%llu\r\n"
+        "Content-Length: %llu\r\n", file->mimeType, llu(ranges[0].first),
+        llu(ranges[0].last), llu(size), llu(bodyLength)));
+      if (file->zeroCopy == false) {
+        body = file->content + ranges[0].first;
+      }
+      sendFromDisk = file->zeroCopy;
+    } else if (numRanges > 1) {
+      status = "206 Partial Content";
+      char boundary[(sizeof(boundaryBytes) * 2) + 1];
+      for (size_t ii = 0; ii < sizeof(boundaryBytes); ii++) {
+        snprintf(&boundary[ii * 2], 3, "%02x", boundaryBytes[ii]);
+      }
+      closingDelimiter = wsArenaPrintf(arena, "\r\n--%s--\r\n", boundary);
+      bodyLength = strlen(closingDelimiter);
+      for (int ii = 0; ii < numRanges; ii++) {
+        partHeaders[ii] = wsRangePartHeader(arena, ii == 0, boundary,
+          file->mimeType, &ranges[ii], size);
+        bodyLength += strlen(partHeaders[ii])
+          + (ranges[ii].last - ranges[ii].first + 1);
+      }
+      wsArenaAddStr(arena, &header, wsArenaPrintf(arena,
+        "Content-type: multipart/byteranges; boundary=%s\r\n"
+        "Content-Length: %llu\r\n", boundary, llu(bodyLength)));
+      if (file->zeroCopy == false) {
+        // Assemble the parts so that they go out with the header.
+        char *multipart = (char*) wsArenaAlloc(arena, (size_t) bodyLength);
+        if (multipart != NULL) {
+          char *partAt = multipart;
+          for (int ii = 0; ii < numRanges; ii++) {
+            size_t partHeaderLength = strlen(partHeaders[ii]);
+            size_t rangeLength
+              = (size_t) (ranges[ii].last - ranges[ii].first + 1);
+            memcpy(partAt, partHeaders[ii], partHeaderLength);
+            partAt += partHeaderLength;
+            memcpy(partAt, file->content + ranges[ii].first, rangeLength);
+            partAt += rangeLength;
+          }
+          memcpy(partAt, closingDelimiter, strlen(closingDelimiter));
+        }
+        body = multipart;
+      }
+      sendFromDisk = file->zeroCopy;
+    } else {
+      wsArenaAddStr(arena, &header, "Content-type: ");
+      wsArenaAddStr(arena, &header, file->mimeType);
+      wsArenaAddStr(arena, &header, "\r\n");
+      if (file->contentEncoding != WS_ENCODING_IDENTITY) {
+        wsArenaAddStr(arena, &header, "Content-Encoding: ");
+        wsArenaAddStr(arena, &header, wsContentEncodingNames[file->contentEncoding]);
+        wsArenaAddStr(arena, &header, "\r\n");
+      }
+      if (compressFromDisk) {
+        wsArenaAddStr(arena, &header, "Transfer-Encoding: chunked\r\n");
+      } else {
+        char contentLength[48];
+        snprintf(contentLength, sizeof(contentLength),
+          "Content-Length: %llu\r\n",
+          llu(file->zeroCopy ? file->fileSize : bytesLength(file->content)));
+        wsArenaAddStr(arena, &header, contentLength);
+      }
+      body = file->content;
+      bodyLength = bytesLength(file->content);
+      sendFromDisk = file->zeroCopy;
+    }
+  }
+  wsArenaAddStr(arena, &header, "Server: ");
+  wsArenaAddStr(arena, &header, wsThreadInfo->serverName);
+  wsArenaAddStr(arena, &header, "\r\n");
+  // A return value of 0 from sendResponseObjectToClient is good status.
+  // The same is true for this function.  However, this being a top-level
+  // handler, we can only return zero or positive values to our caller.
+  // We need to restrict our return value to reflect this.
+  if ((body == NULL) && (bodyLength > 0) && (sendFromDisk == false)) {
+    LOG_MALLOC_FAILURE();
+    file = wsFileCacheRelease(wsThreadInfo->fileCache, file);
+    printLog(TRACE,
+      "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+      wsThreadInfo, 1);
+    return 1;
+  }
+  returnValue = (sendResponseToClient(wsThreadInfo, status, header,
+    sendFromDisk ? NULL : body, sendFromDisk ? 0 : bodyLength) != 0);
+  if ((returnValue == 0) && (sendFromDisk)) {
+    // Only the header has been sent so far.
+    struct timespec sendStart;
+    wsMonotonicTime(&sendStart);
+    Socket *clientSocket = wsThreadInfo->clientSocket;
+    if (numRanges > 1) {
+      for (int ii = 0; (returnValue == 0) && (ii < numRanges); ii++) {
+        int partHeaderLength = (int) strlen(partHeaders[ii]);
+        returnValue = ((socketSend(clientSocket, partHeaders[ii],
+            partHeaderLength) != partHeaderLength)
+          || (wsSendFile(clientSocket, file->key, file->fileSize,
+            ranges[ii].first, ranges[ii].last - ranges[ii].first + 1,
+            NULL) != 0));
+      }
+      int closingDelimiterLength = (int) strlen(closingDelimiter);
+      if ((returnValue == 0) && (socketSend(clientSocket, closingDelimiter,
+        closingDelimiterLength) != closingDelimiterLength)
+      ) {
+        returnValue = 1;
+      }
+    } else if (numRanges == 1) {
+      returnValue = (wsSendFile(clientSocket, file->key, file->fileSize,
+        ranges[0].first, bodyLength, NULL) != 0);
+    } else {
+      bodyLength = file->fileSize;
+      returnValue = (wsSendFile(clientSocket, file->key, file->fileSize,
+        0, file->fileSize, compressFromDisk ? &compressor : NULL) != 0);
+    }
+    wsMetricsEndPhase(wsThreadInfo, WS_PHASE_SEND, &sendStart);
+    if ((returnValue == 0) && (compressFromDisk == false)) {
+      // The compressed size of a file that's compressed as it's sent isn't
+      // tracked.
+      wsMetricsCountBytesOut(wsThreadInfo->metrics, bodyLength);
+      wsThreadInfo->bytesOut += bodyLength;
+    }
+  }
+  if (compressFromDisk) {
+    wsCompressorEnd(&compressor);
+  }
+  // body belongs to file.
+  file = wsFileCacheRelease(wsThreadInfo->fileCache, file);
+  
+  printLog(TRACE,
+    "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
+    wsThreadInfo, returnValue);
+  return returnValue;
+}
+
+/// @fn int parseCookies(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Set the thread for this session if it's in the header's cookies.
+///
+/// @param wsThreadInfo The connection context for this thread.
+///
+/// @return Returns 0 on success, negative error code on failure.
+int parseCookies(WsThreadInfo *wsThreadInfo) {
+  printLog(TRACE, "ENTER parseCookies(wsThreadInfo=%p)\n", wsThreadInfo);
+  
+  if ((wsThreadInfo == NULL)
+    || (wsThreadInfo->webService.cookiesHandler == NULL)
+    || (wsThreadInfo->httpRequest.buffer == NULL)
+  ) {
+    printLog(ERR, "One or more NULL parameters.  Cannot parse cookies.\n");
+    printLog(TRACE,
+      "EXIT parseCookies(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, -1);
+    return -1;
+  }
+  
+  const char *cookiesString
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Cookie");
+  if (cookiesString == NULL) {
+    // No cookies.  Can't get cookies.
+    // Nothing to free.
+    printLog(TRACE,
+      "EXIT parseCookies(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, -2);
+    return -2;
+  }
+  
+  const char *host
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Host");
+  const char *protocol = 
+    // wsThreadInfo->clientSocket->socketMode can only be TLS if
+    // tlsSocketsEnabled() is true, so no need to check that here.
+    (wsThreadInfo->clientSocket->socketMode == TLS) ? "https" :
+    "http";
+  
+  // The cookies are split and unescaped in a copy in the arena of the request
+  // so that the only memory allocated from the heap is the Dictionary that's
+  // handed to the cookies handler.
+  WsArena *arena = &wsThreadInfo->arena;
+  char *cookies = wsArenaStrdup(arena, cookiesString);
+  char *protocolAndDomain = wsArenaPrintf(arena, "%s://%s.",
+    protocol, strOrNull(host));
+  Dictionary *cookiesDict = dictionaryCreate(typeString);
+  if ((cookies == NULL) || (protocolAndDomain == NULL)
+    || (cookiesDict == NULL)
+  ) {
+    // Memory allocation failed.  Can't get sessionToken.
+    cookiesDict = dictionaryDestroy(cookiesDict);
+    printLog(TRACE,
+      "EXIT parseCookies(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, -3);
+    return -3;
+  }
+  
+  size_t prefixLength = strlen(protocolAndDomain);
+  char *cookie = cookies;
+  while (cookie != NULL) {
+    char *separatorAt = strstr(cookie, "; ");
+    if (separatorAt != NULL) {
+      *separatorAt = '\0';
+    }
+    char *equalAt = strchr(cookie, '=');
+    if (equalAt != NULL) {
+      *equalAt = '\0';
+      char *cookieName = cookie;
+      char *cookieValue = equalAt + 1;
+      unescapeString(cookieName);
+      unescapeString(cookieValue);
+      // Strip the host namespace from the cookie name.
+      for (char *prefixAt = strstr(cookieName, protocolAndDomain);
+        prefixAt != NULL;
+        prefixAt = strstr(prefixAt, protocolAndDomain)
+      ) {
+        memmove(prefixAt, prefixAt + prefixLength,
+          strlen(prefixAt + prefixLength) + 1);
+      }
+      dictionaryAddEntry(cookiesDict, cookieName, cookieValue);
+    }
+    cookie = (separatorAt != NULL) ? separatorAt + 2 : NULL;
+  }
+  
+  int returnValue = wsThreadInfo->webService.cookiesHandler(cookiesDict);
+  wsThreadInfo->cookiesDict = cookiesDict;
+  
+  printLog(TRACE,
+    "EXIT parseCookies(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, returnValue);
+  return returnValue;
+}
+
+/// @def WS_HTTP_NO_OFFSET
+///
+/// @brief Marker for an optional part of the request line that was not
+/// provided by the client.
+#define WS_HTTP_NO_OFFSET ((u64) -1)
+
+/// @fn void wsHttpRequestReset(WsHttpRequest *httpRequest)
+///
+/// @brief Prepare a WsHttpRequest to parse a new request that starts at the
+/// beginning of a buffer.  Releases the Dictionary built by
+/// wsHttpRequestGetParams, if any.
+///
+/// @param httpRequest The WsHttpRequest to reset.
+///
+/// @return This function returns no value.
+void wsHttpRequestReset(WsHttpRequest *httpRequest) {
+  if (httpRequest == NULL) {
+    return;
+  }
+  
+  httpRequest->httpParams = dictionaryDestroy(httpRequest->httpParams);
+  httpRequest->state = WS_HTTP_PARSING_REQUEST_LINE;
+  httpRequest->buffer = NULL;
+  httpRequest->scanOffset = 0;
+  httpRequest->lineStart = 0;
+  httpRequest->methodOffset = WS_HTTP_NO_OFFSET;
+  httpRequest->locationOffset = WS_HTTP_NO_OFFSET;
+  httpRequest->protocolOffset = WS_HTTP_NO_OFFSET;
+  httpRequest->bodyOffset = 0;
+  httpRequest->contentLength = 0;
+  httpRequest->chunked = false;
+  httpRequest->numHeaders = 0;
+}
+
+/// @fn void wsHttpParseRequestLine(WsHttpRequest *httpRequest, char *line, u64 lineLength)
+///
+/// @brief Split the request line into its method, location, and protocol.
+/// The spaces between them are replaced with NUL bytes.
+///
+/// @param httpRequest The WsHttpRequest being parsed.
+/// @param line A pointer to the NUL-terminated request line within the buffer.
+/// @param lineLength The length of the request line.
+///
+/// @return This function returns no value.
+void wsHttpParseRequestLine(WsHttpRequest *httpRequest,
+  char *line, u64 lineLength
+) {
+  char *lineEnd = line + lineLength;
+  u64 lineOffset = (u64) (((unsigned char*) line) - httpRequest->buffer);
+  
+  httpRequest->methodOffset = lineOffset;
+  char *cursor = (char*) memchr(line, ' ', lineLength);
+  if (cursor == NULL) {
+    // Method only.
+    return;
+  }
+  *cursor++ = '\0';
+  while ((cursor < lineEnd) && (*cursor == ' ')) {
+    cursor++;
+  }
+  if (cursor == lineEnd) {
+    return;
+  }
+  
+  httpRequest->locationOffset = lineOffset + (u64) (cursor - line);
+  cursor = (char*) memchr(cursor, ' ', (size_t) (lineEnd - cursor));
+  if (cursor == NULL) {
+    // Missing protocol.
+    return;
+  }
+  *cursor++ = '\0';
+  while ((cursor < lineEnd) && (*cursor == ' ')) {
+    cursor++;
+  }
+  if (cursor < lineEnd) {
+    httpRequest->protocolOffset = lineOffset + (u64) (cursor - line);
+  }
+}
+
+/// @fn bool wsHttpParseHeaderLine(WsHttpRequest *httpRequest, char *line, u64 lineLength)
+///
+/// @brief Record the location of one "Name: value" header field.  The colon
+/// and any whitespace that trails the value are replaced with NUL bytes.
+///
+/// @param httpRequest The WsHttpRequest being parsed.
+/// @param line A pointer to the NUL-terminated header line within the buffer.
+/// @param lineLength The length of the header line.
+///
+/// @return Returns true on success, false if there are too many header
+/// fields.
+bool wsHttpParseHeaderLine(WsHttpRequest *httpRequest,
+  char *line, u64 lineLength
+) {
+  char *colon = (char*) memchr(line, ':', lineLength);
+  if ((colon == NULL) || (colon == line)) {
+    // Anonymous parameter, which is a malformed field.  Skip it.
+    return true;
+  }
+  if (httpRequest->numHeaders >= WS_MAX_HTTP_HEADERS) {
+    printLog(ERR, "Too many header fields in request.\n");
+    return false;
+  }
+  
+  *colon = '\0';
+  char *value = colon + 1;
+  char *valueEnd = line + lineLength;
+  while ((value < valueEnd) && ((*value == ' ') || (*value == '\t'))) {
+    value++;
+  }
+  while ((valueEnd > value)
+    && ((valueEnd[-1] == ' ') || (valueEnd[-1] == '\t'))
+  ) {
+    valueEnd--;
+  }
+  *valueEnd = '\0';
+  
+  WsHttpHeader *header = &httpRequest->headers[httpRequest->numHeaders];
+  header->nameOffset = (u64) (((unsigned char*) line) - httpRequest->buffer);
+  header->valueOffset = (u64) (((unsigned char*) value) - httpRequest->buffer);
+  header->valueLength = (u64) (valueEnd - value);
+  httpRequest->numHeaders++;
+  
+  if (strcmpci(line, "Content-Length") == 0) {
+    httpRequest->contentLength = (u64) strtoull(value, NULL, 10);
+  } else if ((strcmpci(line, "Transfer-Encoding") == 0)
+    && (strstrci(value, "chunked") != NULL)
+  ) {
+    httpRequest->chunked = true;
+  }
+  
+  return true;
+}
+
+/// @fn bool wsHttpHeaderContinues(WsHttpRequest *httpRequest, const char *line)
+///
+/// @brief Determine whether or not a header line continues the value of the
+/// previous header field.  This is the case for folded lines (which start with
+/// whitespace) and for quoted values whose closing quote is on a later line,
+/// which some SOAP clients send for the SOAPAction.
+///
+/// @param httpRequest The WsHttpRequest being parsed.
+/// @param line The header line to examine.
+///
+/// @return Returns true if the line continues the previous field, false if not.
+bool wsHttpHeaderContinues(WsHttpRequest *httpRequest, const char *line) {
+  if (httpRequest->numHeaders == 0) {
+    return false;
+  } else if ((*line == ' ') || (*line == '\t')) {
+    return true;
+  }
+  
+  WsHttpHeader *header = &httpRequest->headers[httpRequest->numHeaders - 1];
+  const unsigned char *value = httpRequest->buffer + header->valueOffset;
+  return ((value[0] == '"')
+    && ((header->valueLength == 1) || (value[header->valueLength - 1] != '"')));
+}
+
+/// @fn WsHttpParserState wsHttpRequestParse(WsHttpRequest *httpRequest, Bytes buffer)
+///
+/// @brief Continue parsing a request header.  Only the bytes that have been
+/// added to the buffer since the previous call are examined.  Header field
+/// names and values are NUL-terminated in place and recorded as offsets, so
+/// nothing is allocated.  Lines may be terminated by "\r\n" or "\n" and blank
+/// lines before the request line are ignored.
+///
+/// @param httpRequest The WsHttpRequest to update.  Must have been reset with
+///   wsHttpRequestReset before the first call for a request.
+/// @param buffer The buffer the request is being received into.  The request
+///   must start at the beginning of the buffer.  The buffer may be reallocated
+///   between calls.
+///
+/// @return Returns the new WsHttpParserState of the parser.
+WsHttpParserState wsHttpRequestParse(WsHttpRequest *httpRequest, Bytes buffer) {
+  httpRequest->buffer = buffer;
+  u64 bufferLength = bytesLength(buffer);
+  
+  while (((httpRequest->state == WS_HTTP_PARSING_REQUEST_LINE)
+      || (httpRequest->state == WS_HTTP_PARSING_HEADERS))
+    && (httpRequest->scanOffset < bufferLength)
+  ) {
+    unsigned char *newline = (unsigned char*) memchr(
+      buffer + httpRequest->scanOffset, '\n',
+      bufferLength - httpRequest->scanOffset);
+    if (newline == NULL) {
+      // Incomplete line.  Nothing we've seen needs to be looked at again.
+      httpRequest->scanOffset = bufferLength;
+      break;
+    }
+    
+    u64 lineEndOffset = (u64) (newline - buffer);
+    u64 lineLength = lineEndOffset - httpRequest->lineStart;
+    if ((lineLength > 0) && (buffer[lineEndOffset - 1] == '\r')) {
+      lineLength--;
+    }
+    char *line = (char*) buffer + httpRequest->lineStart;
+    httpRequest->scanOffset = lineEndOffset + 1;
+    
+    if ((httpRequest->state == WS_HTTP_PARSING_HEADERS) && (lineLength > 0)
+      && (wsHttpHeaderContinues(httpRequest, line) == true)
+    ) {
+      // Join this line to the previous value by closing the gap left by the
+      // previous line's terminator.  This moves everything after it, but
+      // continuation lines are rare.
+      WsHttpHeader *header
+        = &httpRequest->headers[httpRequest->numHeaders - 1];
+      u64 valueEnd = header->valueOffset + header->valueLength;
+      u64 gap = httpRequest->lineStart - valueEnd;
+      memmove(buffer + valueEnd, line, bufferLength - httpRequest->lineStart);
+      bufferLength -= gap;
+      bytesSetLength(buffer, bufferLength);
+      buffer[bufferLength] = '\0';
+      header->valueLength += lineLength;
+      buffer[valueEnd + lineLength] = '\0';
+      httpRequest->scanOffset -= gap;
+      httpRequest->lineStart = httpRequest->scanOffset;
+      continue;
+    }
+    line[lineLength] = '\0';
+    
+    if (httpRequest->state == WS_HTTP_PARSING_REQUEST_LINE) {
+      if (lineLength > 0) {
+        wsHttpParseRequestLine(httpRequest, line, lineLength);
+        httpRequest->state = WS_HTTP_PARSING_HEADERS;
+      } // else ignore leading blank lines.
+    } else if (lineLength == 0) {
+      httpRequest->bodyOffset = httpRequest->scanOffset;
+      httpRequest->state = WS_HTTP_HEADER_COMPLETE;
+    } else if (wsHttpParseHeaderLine(httpRequest, line, lineLength) == false) {
+      httpRequest->state = WS_HTTP_PARSE_ERROR;
+    }
+    httpRequest->lineStart = httpRequest->scanOffset;
+  }
+  
+  return httpRequest->state;
+}
+
+/// @fn const char* wsHttpRequestGetHeader(const WsHttpRequest *httpRequest, const char *name)
+///
+/// @brief Look up a header field of a parsed request.  The pseudo-fields
+/// "_httpCommand", "_httpLocation", and "_httpProtocol" return the parts of
+/// the request line.
+///
+/// @param httpRequest The parsed WsHttpRequest.
+/// @param name The case-insensitive name of the field to look up.
+///
+/// @return Returns a pointer to the NUL-terminated value within the request
+/// buffer on success, NULL if the field is not present.
+const char* wsHttpRequestGetHeader(
+  const WsHttpRequest *httpRequest, const char *name
+) {
+  if ((httpRequest == NULL) || (httpRequest->buffer == NULL)
+    || (name == NULL)
+  ) {
+    return NULL;
+  }
+  
+  const char *buffer = (const char*) httpRequest->buffer;
+  if (name[0] == '_') {
+    u64 offset = WS_HTTP_NO_OFFSET;
+    if (strcmp(name, "_httpCommand") == 0) {
+      offset = httpRequest->methodOffset;
+    } else if (strcmp(name, "_httpLocation") == 0) {
+      offset = httpRequest->locationOffset;
+    } else if (strcmp(name, "_httpProtocol") == 0) {
+      offset = httpRequest->protocolOffset;
+    }
+    return (offset != WS_HTTP_NO_OFFSET) ? buffer + offset : NULL;
+  }
+  
+  for (u32 i = 0; i < httpRequest->numHeaders; i++) {
+    const WsHttpHeader *header = &httpRequest->headers[i];
+    if (strcmpci(buffer + header->nameOffset, name) == 0) {
+      return buffer + header->valueOffset;
+    }
+  }
+  
+  return NULL;
+}
+
+/// @fn bool wsHttpParamsAdd(Dictionary *httpParams, const char *name, const char *value)
+///
+/// @brief Add a copy of one header field to an httpParams Dictionary.
+///
+/// @param httpParams The Dictionary to add to.
+/// @param name The name of the field.
+/// @param value The value of the field.
+///
+/// @return Returns true on success, false on failure.
+bool wsHttpParamsAdd(Dictionary *httpParams,
+  const char *name, const char *value
+) {
+  Bytes parameterValue = NULL;
+  if (*value != '\0') {
+    bytesAddStr(&parameterValue, value);
+  } else {
+    // We can't have a named parameter with a NULL value as this would
+    // prevent it from being found later.  Supply an empty string.
+    bytesAddData(&parameterValue, "", 1);
+  }
+  
+  DictionaryEntry *entry = dictionaryAddEntry(httpParams, name,
+    parameterValue, typeBytesNoCopy);
+  if (entry == NULL) {
+    LOG_MALLOC_FAILURE();
+    parameterValue = bytesDestroy(parameterValue);
+    return false;
+  }
+  // Convert the value type to typeBytes now so that the destructor works
+  // properly.
+  entry->type = typeBytes;
+  
+  return true;
+}
+
+/// @fn Dictionary* wsHttpRequestGetParams(WsHttpRequest *httpRequest)
+///
+/// @brief Get the header of a parsed request as a Dictionary of Bytes values.
+/// The parts of the request line are stored as "_httpCommand",
+/// "_httpLocation", and "_httpProtocol".  The Dictionary is only built the
+/// first time it's asked for and is owned by the WsHttpRequest.
+///
+/// @param httpRequest The parsed WsHttpRequest.
+///
+/// @return Returns a pointer to the Dictionary on success, NULL on failure.
+Dictionary* wsHttpRequestGetParams(WsHttpRequest *httpRequest) {
+  if ((httpRequest == NULL) || (httpRequest->buffer == NULL)) {
+    return NULL;
+  } else if (httpRequest->httpParams != NULL) {
+    return httpRequest->httpParams;
+  }
+  
+  Dictionary *httpParams = dictionaryCreate(typeStringCi);
+  if (httpParams == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  
+  const char *requestLineNames[] = {
+    "_httpCommand", "_httpLocation", "_httpProtocol"
+  };
+  for (size_t i = 0; i < sizeof(requestLineNames) / sizeof(char*); i++) {
+    const char *value
+      = wsHttpRequestGetHeader(httpRequest, requestLineNames[i]);
+    if ((value != NULL)
+      && (wsHttpParamsAdd(httpParams, requestLineNames[i], value) == false)
+    ) {
+      httpParams = dictionaryDestroy(httpParams);
+      return NULL;
+    }
+  }
+  
+  const char *buffer = (const char*) httpRequest->buffer;
+  for (u32 i = 0; i < httpRequest->numHeaders; i++) {
+    const WsHttpHeader *header = &httpRequest->headers[i];
+    if (wsHttpParamsAdd(httpParams, buffer + header->nameOffset,
+      buffer + header->valueOffset) == false
+    ) {
+      httpParams = dictionaryDestroy(httpParams);
+      return NULL;
+    }
+  }
+  
+  httpRequest->httpParams = httpParams;
+  return httpParams;
+}
+
+/// @fn bool wsRequestWantsKeepAlive(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Determine whether or not the connection should be kept open after the
+/// current request has been answered.  HTTP/1.1 connections are persistent
+/// unless the client asks for "Connection: close".  HTTP/1.0 connections are
+/// only persistent if the client asks for "Connection: keep-alive".
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.  Its
+///   httpRequest must hold the parsed header of the current request.
+///
+/// @return Returns true if the connection should be kept open, false if not.
+bool wsRequestWantsKeepAlive(WsThreadInfo *wsThreadInfo) {
+  if ((wsThreadInfo->numRequests + 1 >= wsThreadInfo->maxRequestsPerConnection)
+    || ((wsThreadInfo->exitNow != NULL) && (*wsThreadInfo->exitNow == true))
+  ) {
+    return false;
+  }
+  
+  const char *protocol
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "_httpProtocol");
+  const char *connection
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "Connection");
+  bool keepAlive = false;
+  if ((protocol != NULL) && (strcmp(protocol, "HTTP/1.1") == 0)) {
+    keepAlive
+      = ((connection == NULL) || (strstrci(connection, "close") == NULL));
+  } else if (connection != NULL) {
+    keepAlive = (strstrci(connection, "keep-alive") != NULL);
+  }
+  
+  return keepAlive;
+}
+
+/// @fn void wsBodyReaderReset(WsBodyReader *bodyReader)
+///
+/// @brief Release the body held by a WsBodyReader, including any temporary
+/// file it was spooled to, and prepare the reader for the next request.
+///
+/// @param bodyReader The WsBodyReader to reset.
+///
+/// @return This function returns no value.
+void wsBodyReaderReset(WsBodyReader *bodyReader) {
+#ifndef _WIN32
+  if (bodyReader->mapping != NULL) {
+    munmap(bodyReader->mapping, bodyReader->mappingLength);
+  }
+#endif // _WIN32
+  bodyReader->mapping = NULL;
+  bodyReader->mappingLength = 0;
+  if (bodyReader->file != NULL) {
+    fclose(bodyReader->file);
+    bodyReader->file = NULL;
+  }
+  bodyReader->spool = bytesDestroy(bodyReader->spool);
+  bodyReader->data = NULL;
+  bodyReader->length = 0;
+  bodyReader->offset = 0;
+}
+
+/// @fn int wsBodyReaderAppend(WsBodyReader *bodyReader, i64 memoryBytes, const unsigned char *data, u64 length)
+///
+/// @brief Add data to a body that's being assembled outside of the receive
+/// buffer.  The body is moved to an unlinked temporary file once it grows
+/// larger than memoryBytes.
+///
+/// @param bodyReader The WsBodyReader the body is being assembled in.
+/// @param memoryBytes The size above which the body is spooled to a temporary
+///   file.  Zero if the body is always held in memory.
+/// @param data The data to add.
+/// @param length The number of bytes at data.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsBodyReaderAppend(WsBodyReader *bodyReader, i64 memoryBytes,
+  const unsigned char *data, u64 length
+) {
+#ifndef _WIN32
+  if ((bodyReader->file == NULL) && (memoryBytes > 0)
+    && (bodyReader->length + length > (u64) memoryBytes)
+  ) {
+    bodyReader->file = tmpfile();
+    if (bodyReader->file == NULL) {
+      printLog(ERR, "Could not create temporary file for request body: %s\n",
+        strerror(errno));
+      return -1;
+    }
+    u64 spoolLength = bytesLength(bodyReader->spool);
+    if ((spoolLength > 0) && (fwrite(bodyReader->spool, 1, spoolLength,
+      bodyReader->file) != spoolLength)
+    ) {
+      printLog(ERR, "Could not write request body to temporary file: %s\n",
+        strerror(errno));
+      return -1;
+    }
+    bodyReader->spool = bytesDestroy(bodyReader->spool);
+  }
+  if (bodyReader->file != NULL) {
+    if (fwrite(data, 1, length, bodyReader->file) != length) {
+      printLog(ERR, "Could not write request body to temporary file: %s\n",
+        strerror(errno));
+      return -1;
+    }
+    bodyReader->length += length;
+    return 0;
+  }
+#else
+  // Windows has no mmap, so bodies are always held in memory.
+  (void) memoryBytes;
+#endif // _WIN32
+  
+  if (bytesAddData(&bodyReader->spool, data, length) == NULL) {
+    LOG_MALLOC_FAILURE();
+    return -1;
+  }
+  bodyReader->length += length;
+  
+  return 0;
+}
+
+/// @fn int wsBodyReaderFinish(WsBodyReader *bodyReader)
+///
+/// @brief Make a body that was assembled with wsBodyReaderAppend available at
+/// bodyReader->data.  A body in a temporary file is memory mapped so that it
+/// can be used without being read back onto the heap.
+///
+/// @param bodyReader The WsBodyReader the body was assembled in.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsBodyReaderFinish(WsBodyReader *bodyReader) {
+#ifndef _WIN32
+  if (bodyReader->file != NULL) {
+    // Write a NUL byte after the body so that it can be used as a string.
+    if ((fputc('\0', bodyReader->file) == EOF)
+      || (fflush(bodyReader->file) != 0)
+    ) {
+      printLog(ERR, "Could not write request body to temporary file: %s\n",
+        strerror(errno));
+      return -1;
+    }
+    bodyReader->mappingLength = bodyReader->length + 1;
+    bodyReader->mapping = mmap(NULL, bodyReader->mappingLength, PROT_READ,
+      MAP_PRIVATE, fileno(bodyReader->file), 0);
+    if (bodyReader->mapping == MAP_FAILED) {
+      printLog(ERR, "Could not map request body: %s\n", strerror(errno));
+      bodyReader->mapping = NULL;
+      return -1;
+    }
+    bodyReader->data = (const unsigned char*) bodyReader->mapping;
+    return 0;
+  }
+#endif // _WIN32
+  
+  if (bodyReader->spool != NULL) {
+    bodyReader->data = bodyReader->spool;
+  } else {
+    bodyReader->data = (const unsigned char*) "";
+  }
+  
+  return 0;
+}
+
+/// @fn i64 wsBodyReaderRead(WsBodyReader *bodyReader, void *buffer, u64 bufferSize)
+///
+/// @brief Read the next piece of the body of a request.  This allows a web
+/// service function to consume a large body without building another copy of
+/// it.
+///
+/// @param bodyReader The WsBodyReader from the function's WsConnectionInfo.
+/// @param buffer The buffer to copy the data into.
+/// @param bufferSize The number of bytes available at buffer.
+///
+/// @return Returns the number of bytes copied into buffer, 0 at the end of the
+/// body, or -1 on error.
+i64 wsBodyReaderRead(WsBodyReader *bodyReader, void *buffer, u64 bufferSize) {
+  if ((bodyReader == NULL) || ((buffer == NULL) && (bufferSize > 0))) {
+    return -1;
+  } else if (bodyReader->data == NULL) {
+    return 0;
+  }
+  
+  u64 numBytes = bodyReader->length - bodyReader->offset;
+  if (numBytes > bufferSize) {
+    numBytes = bufferSize;
+  }
+  memcpy(buffer, bodyReader->data + bodyReader->offset, numBytes);
+  bodyReader->offset += numBytes;
+  
+  return (i64) numBytes;
+}
+
+/// @fn void wsAccessLogAddRequest(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Add a record of the request that was just processed to the access
+/// log.  This is a copy into the thread's ring, so it never blocks.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return This function returns no value.
+void wsAccessLogAddRequest(WsThreadInfo *wsThreadInfo) {
+  ZEROINIT(AccessLogRecord record);
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  record.timestampUs
+    = (((u64) now.tv_sec) * 1000000) + (((u64) now.tv_nsec) / 1000);
+  
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  if (httpRequest->state == WS_HTTP_HEADER_COMPLETE) {
+    record.bytesIn = httpRequest->bodyOffset + wsThreadInfo->bodyReader.length;
+  }
+  record.bytesOut = wsThreadInfo->bytesOut;
+  for (int phase = 0;
+    (phase < NUM_WS_METRICS_PHASES) && (phase < ACCESS_LOG_NUM_PHASES);
+    phase++
+  ) {
+    u64 phaseUs = wsThreadInfo->phaseUs[phase];
+    record.phaseUs[phase] = (phaseUs < 0xffffffff) ? (u32) phaseUs : 0xffffffff;
+  }
+  
+  // Sockets are IPv4, so the address is stored IPv4-mapped.
+  const struct sockaddr_in *sockaddr = &wsThreadInfo->clientSocket->sockaddr;
+  record.clientAddress[10] = 0xff;
+  record.clientAddress[11] = 0xff;
+  memcpy(&record.clientAddress[12], &sockaddr->sin_addr, 4);
+  record.clientPort = ntohs(sockaddr->sin_port);
+  
+  // Routes are numbered in the order their metrics are stored.
+  const WsRouteTable *routeTable = wsThreadInfo->routeTable;
+  record.routeId = ACCESS_LOG_NO_ROUTE;
+  if ((wsThreadInfo->routeMetrics != NULL) && (routeTable != NULL)) {
+    record.routeId = (u32) (wsThreadInfo->routeMetrics - routeTable->metrics);
+  }
+  record.statusCode = (u16) wsThreadInfo->statusCode;
+  record.method = (u8) accessLogMethodFromString(
+    wsHttpRequestGetHeader(httpRequest, "_httpCommand"));
+  
+  accessLogAdd(wsThreadInfo->accessLog, &record);
+}
+
+/// @fn int wsAccessLogSetNames(AccessLog *accessLog, const WsRouteTable *routeTable)
+///
+/// @brief Give an AccessLog the names of the phases and of the routes of a
+/// WsRouteTable so that its files can be decoded.
+///
+/// @param accessLog The AccessLog of the server.
+/// @param routeTable The WsRouteTable of the server.  May be NULL.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsAccessLogSetNames(AccessLog *accessLog, const WsRouteTable *routeTable) {
+  u32 numRoutes = (routeTable != NULL) ? routeTable->numRoutes : 0;
+  const char **routeNames
+    = (const char**) calloc(numRoutes + 1, sizeof(const char*));
+  if (routeNames == NULL) {
+    LOG_MALLOC_FAILURE();
+    return -1;
+  }
+  
+  // The keys are stored one after another in the order the routes' metrics
+  // are.
+  const char *key = (routeTable != NULL) ? routeTable->keys : NULL;
+  for (u32 i = 0; i < numRoutes; i++) {
+    routeNames[i] = key;
+    key += strlen(key) + 1;
+  }
+  int returnValue
+    = accessLogSetNames(accessLog, WsMetricsPhaseNames, routeNames, numRoutes);
+  
+  routeNames = (const char**) pointerDestroy(routeNames);
+  return returnValue;
+}
+
+/// @fn int wsProcessRequest(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Process a fully-received request from a client.  The header must
+/// already have been parsed into wsThreadInfo->httpRequest and
+/// wsThreadInfo->body must point to the body of the request (if any).  This
+/// function releases the parsed cookies and everything allocated from the
+/// arena of the request when it's done.  The caller is responsible for
+/// resetting wsThreadInfo->httpRequest.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int wsProcessRequest(WsThreadInfo *wsThreadInfo) {
+  printLog(TRACE, "ENTER wsProcessRequest(wsThreadInfo=%p)\n", wsThreadInfo);
+  
+  // Handle the cookies for this connection.
+  if (wsThreadInfo->webService.cookiesHandler != NULL) {
+    parseCookies(wsThreadInfo);
+  }
+  
+  wsThreadInfo->keepAlive = wsRequestWantsKeepAlive(wsThreadInfo);
+  wsThreadInfo->responseStarted = false;
+  wsThreadInfo->responseSent = false;
+  wsThreadInfo->responseCache = NULL;
+  wsThreadInfo->responseCacheKey = NULL;
+  wsThreadInfo->statusCode = 0;
+  wsThreadInfo->bytesOut = 0;
+  if (wsThreadInfo->traceBuffer != NULL) {
+    traceContextStart(&wsThreadInfo->traceContext, wsThreadInfo->traceBuffer,
+      wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "traceparent"),
+      wsThreadInfo->traceSampleRate);
+  }
+  
+  // Get the request method (POST or GET).
+  int returnValue = 0;
+  const char *method
+    = wsHttpRequestGetHeader(&wsThreadInfo->httpRequest, "_httpCommand");
+  if ((method == NULL)
+    || (wsThreadInfo->httpRequest.state != WS_HTTP_HEADER_COMPLETE)
+  ) {
+    printLog(ERR, "Malformed HTTP header.\n");
+    returnValue = 1;
+  } else if (strcmp(method, "GET") == 0) {
+    // Most requests will be GET requests, so check for that first.
+    returnValue = handleGetRequest(wsThreadInfo);
+  } else if (strcmp(method, "POST") == 0) {
+    returnValue = handlePostRequest(wsThreadInfo);
+  } else {
+    printLog(WARN, "Received unsupported HTTP request method \"%s\".\n",
+      method);
+    returnValue = 1;
+  }
+  
+  // If no complete response went out, the client has no way of knowing where
+  // the next response would start, so the connection can't be reused.
+  if ((returnValue != 0) || (wsThreadInfo->responseSent == false)) {
+    wsThreadInfo->keepAlive = false;
+  }
+  wsThreadInfo->numRequests++;
+  if (wsThreadInfo->accessLog != NULL) {
+    wsAccessLogAddRequest(wsThreadInfo);
+  }
+  wsMetricsFinishRequest(wsThreadInfo);
+  
+  wsThreadInfo->body = NULL;
+  wsBodyReaderReset(&wsThreadInfo->bodyReader);
+  wsThreadInfo->cookiesDict = dictionaryDestroy(wsThreadInfo->cookiesDict);
+  wsArenaReset(&wsThreadInfo->arena);
+  
+  printLog(TRACE, "EXIT wsProcessRequest(wsThreadInfo=%p) = {%d}\n",
+    wsThreadInfo, returnValue);
+  return returnValue;
+}
+
+/// @fn WsClientTable* wsClientTableDestroy(WsClientTable *clientTable)
+///
+/// @brief Free a WsClientTable and all of the WsClients in it.
+///
+/// @param clientTable The WsClientTable to destroy.
+///
+/// @return This function always returns NULL.
+WsClientTable* wsClientTableDestroy(WsClientTable *clientTable) {
+  if (clientTable == NULL) {
+    return NULL;
+  }
+  
+  for (int i = 0; i < WS_CLIENT_TABLE_NUM_SHARDS; i++) {
+    WsClientShard *shard = &clientTable->shards[i];
+    for (int j = 0; j < WS_CLIENT_SHARD_NUM_CHAINS; j++) {
+      while (shard->chains[j] != NULL) {
+        WsClient *client = shard->chains[j];
+        shard->chains[j] = client->next;
+        client = (WsClient*) pointerDestroy(client);
+      }
+    }
+    mtx_destroy(&shard->lock);
+  }
+  for (int i = 0; i < clientTable->numRules; i++) {
+    clientTable->rules[i].namespaceName
+      = stringDestroy(clientTable->rules[i].namespaceName);
+  }
+  clientTable->rules = (WsRateLimitRule*) pointerDestroy(clientTable->rules);
+  clientTable = (WsClientTable*) pointerDestroy(clientTable);
+  
+  return NULL;
+}
+
+/// @fn WsClientTable* wsClientTableCreate(int maxConnectionsPerClient, const WsRateLimit *rateLimits)
+///
+/// @brief Create the WsClientTable that enforces a server's per-client limits.
+///
+/// @param maxConnectionsPerClient The number of connections one client may
+///   have open.  Zero or less if there is no limit.
+/// @param rateLimits The WsRateLimits from the server's options, terminated by
+///   one with a NULL namespaceName.  May be NULL.
+///
+/// @return Returns a pointer to a newly-allocated WsClientTable on success,
+/// NULL on failure.
+WsClientTable* wsClientTableCreate(int maxConnectionsPerClient,
+  const WsRateLimit *rateLimits
+) {
+  WsClientTable *clientTable
+    = (WsClientTable*) calloc(1, sizeof(WsClientTable));
+  if (clientTable == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  clientTable->maxConnectionsPerClient
+    = (maxConnectionsPerClient > 0) ? maxConnectionsPerClient : 0;
+  clientTable->defaultRule = -1;
+  
+  // The shards have to be initialized before wsClientTableDestroy can be
+  // used.
+  for (int i = 0; i < WS_CLIENT_TABLE_NUM_SHARDS; i++) {
+    if (mtx_init(&clientTable->shards[i].lock, mtx_plain) != thrd_success) {
+      printLog(ERR, "Could not initialize client table mutex.\n");
+      for (int j = 0; j < i; j++) {
+        mtx_destroy(&clientTable->shards[j].lock);
+      }
+      clientTable = (WsClientTable*) pointerDestroy(clientTable);
+      return NULL;
+    }
+  }
+  
+  int numRateLimits = 0;
+  while ((rateLimits != NULL)
+    && (rateLimits[numRateLimits].namespaceName != NULL)
+  ) {
+    numRateLimits++;
+  }
+  if (numRateLimits > 0) {
+    clientTable->rules
+      = (WsRateLimitRule*) calloc(numRateLimits, sizeof(WsRateLimitRule));
+    if (clientTable->rules == NULL) {
+      LOG_MALLOC_FAILURE();
+      clientTable = wsClientTableDestroy(clientTable);
+      return NULL;
+    }
+  }
+  
+  // A client has to be remembered until all of its buckets would have
+  // refilled or forgetting it would reset its limits early.
+  u64 expirySeconds = WS_CLIENT_EXPIRY_SECONDS;
+  for (int i = 0; i < numRateLimits; i++) {
+    const WsRateLimit *rateLimit = &rateLimits[i];
+    double requestsPerSecond = rateLimit->requestsPerSecond;
+    if (requestsPerSecond <= 0) {
+      printLog(WARN, "Ignoring rate limit of %f requests per second for "
+        "\"%s\".\n", requestsPerSecond, rateLimit->namespaceName);
+      continue;
+    }
+    
+    WsRateLimitRule *rule = &clientTable->rules[clientTable->numRules];
+    straddstr(&rule->namespaceName, rateLimit->namespaceName);
+    if (rule->namespaceName == NULL) {
+      LOG_MALLOC_FAILURE();
+      clientTable = wsClientTableDestroy(clientTable);
+      return NULL;
+    }
+    rule->namespaceLength = strlen(rule->namespaceName);
+    rule->tokensPerUs = requestsPerSecond / 1000000.0;
+    if (rateLimit->burst > 0) {
+      rule->burst = (double) rateLimit->burst;
+    } else {
+      rule->burst = (requestsPerSecond >= 1.0)
+        ? (double) ((i64) requestsPerSecond) : 1.0;
+    }
+    if ((clientTable->defaultRule < 0)
+      && (strcmp(rule->namespaceName, "*") == 0)
+    ) {
+      clientTable->defaultRule = clientTable->numRules;
+    }
+    u64 refillSeconds = ((u64) (rule->burst / requestsPerSecond)) + 1;
+    if (refillSeconds > expirySeconds) {
+      expirySeconds = refillSeconds;
+    }
+    clientTable->numRules++;
+  }
+  clientTable->expiryUs = expirySeconds * 1000000;
+  
+  return clientTable;
+}
+
+/// @fn void wsClientShardSweep(WsClientShard *shard, u64 now, u64 expiryUs)
+///
+/// @brief Remove the clients that have had no open connections for expiryUs
+/// from a shard.  The shard's lock must be held.
+///
+/// @param shard The WsClientShard to sweep.
+/// @param now The current time in microseconds.
+/// @param expiryUs The number of idle microseconds after which a client is
+///   removed.
+///
+/// @return This function returns no value.
+void wsClientShardSweep(WsClientShard *shard, u64 now, u64 expiryUs) {
+  for (int i = 0; i < WS_CLIENT_SHARD_NUM_CHAINS; i++) {
+    WsClient **link = &shard->chains[i];
+    while (*link != NULL) {
+      WsClient *client = *link;
+      if ((client->numConnections == 0)
+        && (now - client->lastSeenUs >= expiryUs)
+      ) {
+        *link = client->next;
+        client = (WsClient*) pointerDestroy(client);
+      } else {
+        link = &client->next;
+      }
+    }
+  }
+  shard->lastSweepUs = now;
+}
+
+/// @fn int wsClientTableAddConnection(WsClientTable *clientTable, const char *address, WsClient **client)
+///
+/// @brief Count a new connection against the client it's from.  This is done
+/// as soon as the connection is accepted, before anything is read from it.
+///
+/// @param clientTable The WsClientTable of the server.
+/// @param address The address of the connection as returned by socketAddress.
+///   The port, if any, is ignored.
+/// @param client A pointer to the WsClient to set to the client of the
+///   connection.  It's set to NULL if the connection isn't counted.
+///
+/// @return Returns 0 if the connection may proceed, -1 if the client already
+/// has as many connections open as it's allowed.
+int wsClientTableAddConnection(WsClientTable *clientTable,
+  const char *address, WsClient **client
+) {
+  *client = NULL;
+  const char *portAt = strrchr(address, ':');
+  size_t addressLength
+    = (portAt != NULL) ? (size_t) (portAt - address) : strlen(address);
+  if (addressLength >= WS_CLIENT_MAX_ADDRESS_LENGTH) {
+    addressLength = WS_CLIENT_MAX_ADDRESS_LENGTH - 1;
+  }
+  u32 hash = wsRouteHash(address, addressLength);
+  WsClientShard *shard
+    = &clientTable->shards[hash & (WS_CLIENT_TABLE_NUM_SHARDS - 1)];
+  WsClient **chain = &shard->chains[
+    (hash / WS_CLIENT_TABLE_NUM_SHARDS) & (WS_CLIENT_SHARD_NUM_CHAINS - 1)];
+  u64 now = wsNowMicroseconds();
+  int returnValue = 0;
+  
+  mtx_lock(&shard->lock);
+  if (now - shard->lastSweepUs >= clientTable->expiryUs) {
+    wsClientShardSweep(shard, now, clientTable->expiryUs);
+  }
+  WsClient *wsClient = *chain;
+  while ((wsClient != NULL)
+    && ((wsClient->hash != hash)
+      || (strncmp(wsClient->address, address, addressLength) != 0)
+      || (wsClient->address[addressLength] != '\0'))
+  ) {
+    wsClient = wsClient->next;
+  }
+  if (wsClient == NULL) {
+    // The token buckets are allocated along with the client.
+    wsClient = (WsClient*) calloc(1,
+      sizeof(WsClient) + (clientTable->numRules * sizeof(WsTokenBucket)));
+    if (wsClient == NULL) {
+      // Let the connection through untracked rather than refuse it.
+      LOG_MALLOC_FAILURE();
+      mtx_unlock(&shard->lock);
+      return 0;
+    }
+    wsClient->hash = hash;
+    memcpy(wsClient->address, address, addressLength);
+    wsClient->tokenBuckets = (WsTokenBucket*) (wsClient + 1);
+    for (int i = 0; i < clientTable->numRules; i++) {
+      wsClient->tokenBuckets[i].tokens = clientTable->rules[i].burst;
+      wsClient->tokenBuckets[i].lastRefillUs = now;
+    }
+    wsClient->next = *chain;
+    *chain = wsClient;
+  }
+  wsClient->lastSeenUs = now;
+  if ((clientTable->maxConnectionsPerClient > 0)
+    && (wsClient->numConnections >= clientTable->maxConnectionsPerClient)
+  ) {
+    returnValue = -1;
+  } else {
+    wsClient->numConnections++;
+    *client = wsClient;
+  }
+  mtx_unlock(&shard->lock);
+  
+  return returnValue;
+}
+
+/// @fn void wsClientTableRemoveConnection(WsClientTable *clientTable, WsClient *client)
+///
+/// @brief Release a connection that was counted by wsClientTableAddConnection.
+///
+/// @param clientTable The WsClientTable of the server.
+/// @param client The WsClient the connection was counted against.
+///
+/// @return This function returns no value.
+void wsClientTableRemoveConnection(WsClientTable *clientTable,
+  WsClient *client
+) {
+  WsClientShard *shard
+    = &clientTable->shards[client->hash & (WS_CLIENT_TABLE_NUM_SHARDS - 1)];
+  mtx_lock(&shard->lock);
+  client->numConnections--;
+  client->lastSeenUs = wsNowMicroseconds();
+  mtx_unlock(&shard->lock);
+}
+
+/// @fn int wsClientTableCheckRate(WsClientTable *clientTable, WsClient *client, const WsRoute *route)
+///
+/// @brief Take a token from a client's bucket for the rate limit that applies
+/// to a request.  The limit is chosen by the namespace of the function the
+/// request is dispatched to, falling back to the "*" limit (if any).
+///
+/// @param clientTable The WsClientTable of the server.
+/// @param client The WsClient the request is from.  May be NULL, in which
+///   case the request is not limited.
+/// @param route The WsRoute of the function the request is dispatched to.
+///   NULL if it isn't for a web service function.
+///
+/// @return Returns 0 if the request may proceed, otherwise the number of
+/// seconds until the client may make another request.
+int wsClientTableCheckRate(WsClientTable *clientTable, WsClient *client,
+  const WsRoute *route
+) {
+  if ((client == NULL) || (clientTable->numRules == 0)) {
+    return 0;
+  }
+  
+  int ruleIndex = clientTable->defaultRule;
+  const char *wsNamespace = (route != NULL) ? route->key : NULL;
+  const char *slashAt = (route != NULL)
+    ? (const char*) memchr(route->key, '/', route->keyLength) : NULL;
+  if (slashAt != NULL) {
+    size_t namespaceLength = (size_t) (slashAt - wsNamespace);
+    for (int i = 0; i < clientTable->numRules; i++) {
+      const WsRateLimitRule *rule = &clientTable->rules[i];
+      if ((rule->namespaceLength == namespaceLength)
+        && (memcmp(rule->namespaceName, wsNamespace, namespaceLength) == 0)
+      ) {
+        ruleIndex = i;
+        break;
+      }
+    }
+  }
+  if (ruleIndex < 0) {
+    return 0;
+  }
+  
+  const WsRateLimitRule *rule = &clientTable->rules[ruleIndex];
+  WsClientShard *shard
+    = &clientTable->shards[client->hash & (WS_CLIENT_TABLE_NUM_SHARDS - 1)];
+  u64 now = wsNowMicroseconds();
+  int retryAfterSeconds = 0;
+  
+  mtx_lock(&shard->lock);
+  WsTokenBucket *tokenBucket = &client->tokenBuckets[ruleIndex];
+  if (now > tokenBucket->lastRefillUs) {
+    tokenBucket->tokens
+      += ((double) (now - tokenBucket->lastRefillUs)) * rule->tokensPerUs;
+    if (tokenBucket->tokens > rule->burst) {
+      tokenBucket->tokens = rule->burst;
+    }
+    tokenBucket->lastRefillUs = now;
+  }
+  if (tokenBucket->tokens >= 1.0) {
+    tokenBucket->tokens -= 1.0;
+  } else {
+    retryAfterSeconds = ((int) ((1.0 - tokenBucket->tokens)
+      / (rule->tokensPerUs * 1000000.0))) + 1;
+  }
+  client->lastSeenUs = now;
+  mtx_unlock(&shard->lock);
+  
+  return retryAfterSeconds;
+}
+
+/// @fn int wsCheckRequestRate(WsThreadInfo *wsThreadInfo, const WsRoute *route)
+///
+/// @brief Check a request against its client's rate limit once it's known
+/// what the request is dispatched to and reject it if it's over the limit.
+/// Rejections are logged at DEBUG so that a client that's over its limit
+/// can't flood the log.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param route The WsRoute of the function the request is dispatched to.
+///   NULL if it isn't for a web service function.
+///
+/// @return Returns 0 if the request may proceed, -1 if it was rejected, in
+/// which case the response has already been sent.
+int wsCheckRequestRate(WsThreadInfo *wsThreadInfo, const WsRoute *route) {
+  if (wsThreadInfo->client == NULL) {
+    return 0;
+  }
+  
+  int retryAfterSeconds = wsClientTableCheckRate(wsThreadInfo->clientTable,
+    wsThreadInfo->client, route);
+  if (retryAfterSeconds > 0) {
+    printLog(DEBUG, "Rate limit exceeded.  Rejecting request from %s.\n",
+      socketAddress(wsThreadInfo->clientSocket));
+    char header[64];
+    snprintf(header, sizeof(header),
+      "Retry-After: %d\r\nContent-Length: 0\r\n", retryAfterSeconds);
+    sendResponseToClient(wsThreadInfo, "429 Too Many Requests", header,
+      NULL, 0);
+    return -1;
+  }
+  
+  return 0;
+}
+
+/// @fn WsConnections* wsConnectionsCreate(void)
+///
+/// @brief Create an empty WsConnections list.
+///
+/// @return Returns a pointer to a newly-allocated WsConnections on success,
+/// NULL on failure.
+WsConnections* wsConnectionsCreate(void) {
+  WsConnections *connections
+    = (WsConnections*) calloc(1, sizeof(WsConnections));
+  if (connections == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  
+  if (mtx_init(&connections->lock, mtx_plain) != thrd_success) {
+    printLog(ERR, "Could not initialize connections mutex.\n");
+    connections = (WsConnections*) pointerDestroy(connections);
+    return NULL;
+  }
+  
+  return connections;
+}
+
+/// @fn WsConnections* wsConnectionsDestroy(WsConnections *connections)
+///
+/// @brief Free a WsConnections list.  The list must be empty.
+///
+/// @param connections The WsConnections to destroy.
+///
+/// @return This function always returns NULL.
+WsConnections* wsConnectionsDestroy(WsConnections *connections) {
+  if (connections == NULL) {
+    return NULL;
+  }
+  
+  mtx_destroy(&connections->lock);
+  connections = (WsConnections*) pointerDestroy(connections);
+  return NULL;
+}
+
+/// @fn void wsConnectionsAdd(WsConnections *connections, WsThreadInfo *wsThreadInfo)
+///
+/// @brief Add a newly-accepted connection to a server's WsConnections.  It's
+/// removed again by wsThreadInfoDestroy.
+///
+/// @param connections The WsConnections of the server.
+/// @param wsThreadInfo The WsThreadInfo of the connection to add.
+///
+/// @return This function returns no value.
+void wsConnectionsAdd(WsConnections *connections, WsThreadInfo *wsThreadInfo) {
+  wsThreadInfo->connections = connections;
+  mtx_lock(&connections->lock);
+  wsThreadInfo->prevConnection = NULL;
+  wsThreadInfo->nextConnection = connections->head;
+  if (connections->head != NULL) {
+    connections->head->prevConnection = wsThreadInfo;
+  }
+  connections->head = wsThreadInfo;
+  connections->numConnections++;
+  mtx_unlock(&connections->lock);
+}
+
+/// @fn int wsConnectionsShutdown(WsConnections *connections)
+///
+/// @brief Shut down both directions of every connection in a WsConnections
+/// list.  This makes any thread that's blocked sending to or receiving from
+/// one of them fail right away so that the connection gets destroyed.  Any
+/// deferred responses they're waiting on are cancelled for the same reason.
+/// The sockets themselves are left for their owners to close so that their
+/// descriptors can't be reused out from under them.
+///
+/// @param connections The WsConnections of the server.
+///
+/// @return Returns the number of connections that were shut down.
+int wsConnectionsShutdown(WsConnections *connections) {
+  mtx_lock(&connections->lock);
+  connections->shutDown = true;
+  int numConnections = connections->numConnections;
+  for (WsThreadInfo *wsThreadInfo = connections->head; wsThreadInfo != NULL;
+    wsThreadInfo = wsThreadInfo->nextConnection
+  ) {
+    Socket *clientSocket = wsThreadInfo->clientSocket;
+    if ((clientSocket != NULL) && (clientSocket->sockfd >= 0)) {
+#ifdef _WIN32
+      shutdown(clientSocket->sockfd, SD_BOTH);
+#else // POSIX
+      shutdown(clientSocket->sockfd, SHUT_RDWR);
+#endif // _WIN32
+    }
+    if (wsThreadInfo->pendingResponse != NULL) {
+      // Nothing is going to be sent on the connection anyway.
+      wsPendingResponseFinish(wsThreadInfo->pendingResponse, NULL, true);
+    }
+    WsBatch *batch = wsThreadInfo->batch;
+    for (int ii = 0; (batch != NULL) && (ii < batch->numCalls); ii++) {
+      if (batch->calls[ii].pendingResponse != NULL) {
+        wsPendingResponseFinish(batch->calls[ii].pendingResponse, NULL, true);
+      }
+    }
+  }
+  mtx_unlock(&connections->lock);
+  
+  return numConnections;
+}
+
+/// @fn void wsThreadInfoDestroy(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Release a WsThreadInfo and the client connection it describes.  This
+/// also removes the connection from the server's WsConnections.
+///
+/// @param wsThreadInfo The WsThreadInfo to destroy.
+///
+/// @return This function always returns NULL.
+WsThreadInfo* wsThreadInfoDestroy(WsThreadInfo *wsThreadInfo) {
+  if (wsThreadInfo == NULL) {
+    return NULL;
+  }
+  
+  WsConnections *connections = wsThreadInfo->connections;
+  if (connections != NULL) {
+    mtx_lock(&connections->lock);
+    if (wsThreadInfo->prevConnection != NULL) {
+      wsThreadInfo->prevConnection->nextConnection
+        = wsThreadInfo->nextConnection;
+    } else {
+      connections->head = wsThreadInfo->nextConnection;
+    }
+    if (wsThreadInfo->nextConnection != NULL) {
+      wsThreadInfo->nextConnection->prevConnection
+        = wsThreadInfo->prevConnection;
+    }
+    connections->numConnections--;
+    mtx_unlock(&connections->lock);
+  }
+  if (wsThreadInfo->client != NULL) {
+    wsClientTableRemoveConnection(wsThreadInfo->clientTable,
+      wsThreadInfo->client);
+  }
+  if (wsThreadInfo->metrics != NULL) {
+    atomic_fetch_sub_explicit(&wsThreadInfo->metrics->activeConnections,
+      (u64) 1, memory_order_relaxed);
+  }
+  wsThreadInfo->clientSocket = socketDestroy(wsThreadInfo->clientSocket);
+  wsThreadInfo->redirectProtocol
+     = stringDestroy(wsThreadInfo->redirectProtocol);
+  wsHttpRequestReset(&wsThreadInfo->httpRequest);
+  wsBodyReaderReset(&wsThreadInfo->bodyReader);
+  wsThreadInfo->cookiesDict = dictionaryDestroy(wsThreadInfo->cookiesDict);
+  wsArenaReset(&wsThreadInfo->arena);
+  wsThreadInfo = (WsThreadInfo*) pointerDestroy(wsThreadInfo);
+  
+  return NULL;
+}
+
+/// @struct WsJob
+///
+/// @brief A unit of work waiting in a WsWorkerPool's queue.
+///
+/// @param function The function to run on a worker thread.
+/// @param cancel The function to call instead of function if the pool is
+///   stopped before the job runs.  May be NULL.
+/// @param arg The argument to pass to function or cancel.
+/// @param queuedTime The time the job was added to the queue.
+/// @param next The next WsJob in the queue.
+typedef struct WsJob {
+  thrd_start_t     function;
+  thrd_start_t     cancel;
+  void            *arg;
+  struct timespec  queuedTime;
+  struct WsJob    *next;
+} WsJob;
+
+/// @struct WsWorkerPool
+///
+/// @brief A fixed-size set of pre-started threads that run the jobs from a
+/// bounded queue.
+///
+/// @param threads The array of worker thread IDs.
+/// @param numThreads The number of elements in threads.
+/// @param maxQueuedJobs The maximum number of jobs that may be waiting in the
+///   queue.
+/// @param lock The mutex that protects the rest of the structure.
+/// @param workAvailable The condition the worker threads wait on for work.
+/// @param spaceAvailable The condition signalled when a job is removed from
+///   the queue.
+/// @param idle The condition signalled when the queue is empty and no worker
+///   is running a job.
+/// @param head The first WsJob in the queue.
+/// @param tail The last WsJob in the queue.
+/// @param webService The WebService being served, if any.
+/// @param exitNow Whether or not the worker threads should exit.
+/// @param stats The WebServerStats for the pool.
+struct WsWorkerPool {
+  thrd_t         *threads;
+  int             numThreads;
+  int             maxQueuedJobs;
+  mtx_t           lock;
+  cnd_t           workAvailable;
+  cnd_t           spaceAvailable;
+  cnd_t           idle;
+  WsJob          *head;
+  WsJob          *tail;
+  WebService     *webService;
+  bool            exitNow;
+  WebServerStats  stats;
+};
+
+/// @fn WsWorkerPool* wsWorkerPoolCreate(int maxQueuedJobs)
+///
+/// @brief Create a WsWorkerPool.  No threads are started until
+/// wsWorkerPoolStart is called.
+///
+/// @param maxQueuedJobs The maximum number of jobs that may be waiting in the
+///   pool's queue.
+///
+/// @return Returns a pointer to a newly-allocated WsWorkerPool on success,
+/// NULL on failure.
+WsWorkerPool* wsWorkerPoolCreate(int maxQueuedJobs) {
+  WsWorkerPool *pool = (WsWorkerPool*) calloc(1, sizeof(WsWorkerPool));
+  if (pool == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  pool->maxQueuedJobs = maxQueuedJobs;
+  
+  if (mtx_init(&pool->lock, mtx_plain) != thrd_success) {
+    printLog(ERR, "Could not initialize worker pool mutex.\n");
+    pool = (WsWorkerPool*) pointerDestroy(pool);
+    return NULL;
+  }
+  if (cnd_init(&pool->workAvailable) != thrd_success) {
+    printLog(ERR, "Could not initialize worker pool condition.\n");
+    mtx_destroy(&pool->lock);
+    pool = (WsWorkerPool*) pointerDestroy(pool);
+    return NULL;
+  }
+  if (cnd_init(&pool->spaceAvailable) != thrd_success) {
+    printLog(ERR, "Could not initialize worker pool condition.\n");
+    cnd_destroy(&pool->workAvailable);
+    mtx_destroy(&pool->lock);
+    pool = (WsWorkerPool*) pointerDestroy(pool);
+    return NULL;
+  }
+  if (cnd_init(&pool->idle) != thrd_success) {
+    printLog(ERR, "Could not initialize worker pool condition.\n");
+    cnd_destroy(&pool->spaceAvailable);
+    cnd_destroy(&pool->workAvailable);
+    mtx_destroy(&pool->lock);
+    pool = (WsWorkerPool*) pointerDestroy(pool);
+    return NULL;
+  }
+  
+  return pool;
+}
+
+/// @fn u64 wsElapsedMicroseconds(const struct timespec *startTime)
+///
+/// @brief Compute the number of microseconds that have elapsed since a time
+/// returned by wsMonotonicTime.
+///
+/// @param startTime A pointer to the starting time.
+///
+/// @return Returns the number of elapsed microseconds.
+u64 wsElapsedMicroseconds(const struct timespec *startTime) {
+  struct timespec now;
+  wsMonotonicTime(&now);
+  i64 elapsed = (((i64) now.tv_sec) - ((i64) startTime->tv_sec)) * 1000000
+    + (((i64) now.tv_nsec) - ((i64) startTime->tv_nsec)) / 1000;
+  
+  return (elapsed > 0) ? (u64) elapsed : 0;
+}
+
+/// @fn int wsWorkerThread(void *args)
+///
+/// @brief Main loop of a worker thread.  Waits for jobs to be queued and runs
+/// them until the pool is stopped.
+///
+/// @param args A pointer to the WsWorkerPool for this thread cast to a void*.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int wsWorkerThread(void *args) {
+  WsWorkerPool *pool = (WsWorkerPool*) args;
+  WebService *webService = pool->webService;
+  // In this case, this function appears prior to the printLog to ensure that
+  // the printLog uses the proper threadId.
+  if ((webService != NULL) && (webService->registerThread != NULL)) {
+    webService->registerThread();
+  }
+  printLog(TRACE, "ENTER wsWorkerThread(args=%p)\n", args);
+  
+  mtx_lock(&pool->lock);
+  while (1) {
+    while ((pool->head == NULL) && (pool->exitNow == false)) {
+      cnd_wait(&pool->workAvailable, &pool->lock);
+    }
+    if (pool->exitNow == true) {
+      // Anything left in the queue is cancelled by wsWorkerPoolStop.
+      break;
+    }
+    
+    WsJob *job = pool->head;
+    pool->head = job->next;
+    if (pool->head == NULL) {
+      pool->tail = NULL;
+    }
+    u64 queueWaitUs = wsElapsedMicroseconds(&job->queuedTime);
+    pool->stats.queueDepth--;
+    pool->stats.totalQueueWaitUs += queueWaitUs;
+    if (queueWaitUs > pool->stats.maxQueueWaitUs) {
+      pool->stats.maxQueueWaitUs = queueWaitUs;
+    }
+    pool->stats.numBusyWorkers++;
+    cnd_signal(&pool->spaceAvailable);
+    mtx_unlock(&pool->lock);
+    
+    job->function(job->arg);
+    job = (WsJob*) pointerDestroy(job);
+    
+    mtx_lock(&pool->lock);
+    pool->stats.numBusyWorkers--;
+    if ((pool->stats.numBusyWorkers == 0) && (pool->head == NULL)) {
+      cnd_broadcast(&pool->idle);
+    }
+  }
+  mtx_unlock(&pool->lock);
+  wsArenaReleaseThreadChunks();
+  
+  printLog(TRACE, "EXIT wsWorkerThread(args=%p) = {0}\n", args);
+  if ((webService != NULL) && (webService->unregisterThread != NULL)) {
+    webService->unregisterThread(NULL);
+  }
+  return 0;
+}
+
+/// @fn int wsWorkerPoolStop(WsWorkerPool *pool)
+///
+/// @brief Stop the threads of a WsWorkerPool.  Jobs that are running are
+/// allowed to complete.  Jobs that are still queued are cancelled.  Calling
+/// this function on a pool that's already stopped has no effect.
+///
+/// @param pool The WsWorkerPool to stop.
+///
+/// @return Returns 0 on success, -1 if pool is NULL.
+int wsWorkerPoolStop(WsWorkerPool *pool) {
+  if (pool == NULL) {
+    return -1;
+  }
+  
+  mtx_lock(&pool->lock);
+  pool->exitNow = true;
+  cnd_broadcast(&pool->workAvailable);
+  cnd_broadcast(&pool->spaceAvailable);
+  mtx_unlock(&pool->lock);
+  for (int i = 0; i < pool->numThreads; i++) {
+    thrd_join(pool->threads[i], NULL);
+  }
+  pool->threads = (thrd_t*) pointerDestroy(pool->threads);
+  pool->numThreads = 0;
+  
+  // No worker threads are running, so the lock is no longer needed.
+  while (pool->head != NULL) {
+    WsJob *job = pool->head;
+    pool->head = job->next;
+    if (job->cancel != NULL) {
+      job->cancel(job->arg);
+    }
+    job = (WsJob*) pointerDestroy(job);
+  }
+  pool->tail = NULL;
+  pool->stats.queueDepth = 0;
+  pool->stats.numWorkerThreads = 0;
+  
+  return 0;
+}
+
+/// @fn int wsWorkerPoolStart(WsWorkerPool *pool, int numThreads, WebService *webService)
+///
+/// @brief Start the threads of a WsWorkerPool.
+///
+/// @param pool The WsWorkerPool to start.
+/// @param numThreads The number of worker threads to start.
+/// @param webService The WebService being served, if any.  Used to register
+///   and unregister the worker threads.
+///
+/// @return Returns 0 on success, negative value on failure.  On failure, no
+/// threads are left running.
+int wsWorkerPoolStart(WsWorkerPool *pool, int numThreads,
+  WebService *webService
+) {
+  if ((pool == NULL) || (numThreads <= 0)) {
+    return -1;
+  }
+  
+  pool->threads = (thrd_t*) calloc(numThreads, sizeof(thrd_t));
+  if (pool->threads == NULL) {
+    LOG_MALLOC_FAILURE();
+    return -2;
+  }
+  pool->webService = webService;
+  pool->exitNow = false;
+  
+  for (int i = 0; i < numThreads; i++) {
+    if (thrd_create(&pool->threads[i], wsWorkerThread, pool) != thrd_success) {
+      printLog(ERR, "Could not start worker thread %d.\n", i);
+      wsWorkerPoolStop(pool);
+      return -3;
+    }
+    pool->numThreads++;
+  }
+  mtx_lock(&pool->lock);
+  pool->stats.numWorkerThreads = (u64) numThreads;
+  mtx_unlock(&pool->lock);
+  
+  return 0;
+}
+
+/// @fn WsWorkerPool* wsWorkerPoolDestroy(WsWorkerPool *pool)
+///
+/// @brief Stop a WsWorkerPool (if it's running) and free its resources.
+///
+/// @param pool The WsWorkerPool to destroy.
+///
+/// @return This function always returns NULL.
+WsWorkerPool* wsWorkerPoolDestroy(WsWorkerPool *pool) {
+  if (pool == NULL) {
+    return NULL;
+  }
+  
+  wsWorkerPoolStop(pool);
+  cnd_destroy(&pool->idle);
+  cnd_destroy(&pool->spaceAvailable);
+  cnd_destroy(&pool->workAvailable);
+  mtx_destroy(&pool->lock);
+  pool = (WsWorkerPool*) pointerDestroy(pool);
+  
+  return NULL;
+}
+
+/// @fn int wsWorkerPoolSubmit(WsWorkerPool *pool, thrd_start_t function, thrd_start_t cancel, void *arg, bool force)
+///
+/// @brief Add a job to a WsWorkerPool's queue.
+///
+/// @param pool The WsWorkerPool to add the job to.
+/// @param function The function to run on a worker thread.
+/// @param cancel The function to call with arg instead if the pool is stopped
+///   before the job runs.  May be NULL.
+/// @param arg The argument to pass to function or cancel.
+/// @param force Whether or not to queue the job even if the queue is full.
+///
+/// @return Returns 0 on success, -1 if the queue is full (the job is counted
+/// as rejected), and any other negative value on failure.  The caller retains
+/// ownership of arg if this function fails.
+int wsWorkerPoolSubmit(WsWorkerPool *pool, thrd_start_t function,
+  thrd_start_t cancel, void *arg, bool force
+) {
+  WsJob *job = (WsJob*) malloc(sizeof(WsJob));
+  if (job == NULL) {
+    LOG_MALLOC_FAILURE();
+    return -2;
+  }
+  job->function = function;
+  job->cancel = cancel;
+  job->arg = arg;
+  job->next = NULL;
+  wsMonotonicTime(&job->queuedTime);
+  
+  mtx_lock(&pool->lock);
+  if (pool->exitNow == true) {
+    mtx_unlock(&pool->lock);
+    job = (WsJob*) pointerDestroy(job);
+    return -3;
+  } else if ((force == false)
+    && (pool->stats.queueDepth >= (u64) pool->maxQueuedJobs)
+  ) {
+    pool->stats.numRejected++;
+    mtx_unlock(&pool->lock);
+    job = (WsJob*) pointerDestroy(job);
+    return -1;
+  }
+  
+  if (pool->tail != NULL) {
+    pool->tail->next = job;
+  } else {
+    pool->head = job;
+  }
+  pool->tail = job;
+  pool->stats.queueDepth++;
+  pool->stats.numQueued++;
+  if (pool->stats.queueDepth > pool->stats.maxQueueDepth) {
+    pool->stats.maxQueueDepth = pool->stats.queueDepth;
+  }
+  cnd_signal(&pool->workAvailable);
+  mtx_unlock(&pool->lock);
+  
+  return 0;
+}
+
+/// @fn int wsWorkerPoolNumIdle(WsWorkerPool *pool)
+///
+/// @brief Get the number of a WsWorkerPool's threads that would start on a new
+/// job right away.
+///
+/// @param pool The WsWorkerPool to check.
+///
+/// @return Returns the number of idle worker threads that aren't already
+/// spoken for by jobs in the queue.
+int wsWorkerPoolNumIdle(WsWorkerPool *pool) {
+  mtx_lock(&pool->lock);
+  i64 numIdle = ((i64) pool->numThreads)
+    - ((i64) pool->stats.numBusyWorkers) - ((i64) pool->stats.queueDepth);
+  mtx_unlock(&pool->lock);
+  
+  return (numIdle > 0) ? (int) numIdle : 0;
+}
+
+/// @fn void wsWorkerPoolWaitForSpace(WsWorkerPool *pool, volatile bool *exitNow)
+///
+/// @brief Block until there's room in a WsWorkerPool's queue.  Used to stop
+/// accepting connections when the WsOverloadPolicy is
+/// WS_OVERLOAD_STOP_ACCEPTING.
+///
+/// @param pool The WsWorkerPool to wait on.
+/// @param exitNow A pointer to the server's exitNow flag.  The wait is
+///   abandoned if this becomes true.
+///
+/// @return This function returns no value.
+void wsWorkerPoolWaitForSpace(WsWorkerPool *pool, volatile bool *exitNow) {
+  mtx_lock(&pool->lock);
+  if (pool->stats.queueDepth >= (u64) pool->maxQueuedJobs) {
+    pool->stats.numAcceptPauses++;
+  }
+  while ((pool->stats.queueDepth >= (u64) pool->maxQueuedJobs)
+    && (pool->exitNow == false) && (*exitNow == false)
+  ) {
+    // Wake up periodically to check exitNow, which is not protected by our
+    // lock.
+    struct timespec deadline;
+    timespec_get(&deadline, TIME_UTC);
+    deadline.tv_nsec += 100000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    cnd_timedwait(&pool->spaceAvailable, &pool->lock, &deadline);
+  }
+  mtx_unlock(&pool->lock);
+}
+
+/// @fn int wsWorkerPoolDrain(WsWorkerPool *pool, const struct timespec *deadline)
+///
+/// @brief Block until a WsWorkerPool has no queued or running jobs or until a
+/// deadline passes, whichever comes first.  Jobs keep being run while waiting.
+///
+/// @param pool The WsWorkerPool to wait on.
+/// @param deadline The wsMonotonicTime time to give up at.
+///
+/// @return Returns 0 if the pool became idle, -1 if the deadline passed first.
+int wsWorkerPoolDrain(WsWorkerPool *pool, const struct timespec *deadline) {
+  int returnValue = 0;
+  
+  mtx_lock(&pool->lock);
+  while ((pool->stats.queueDepth > 0) || (pool->stats.numBusyWorkers > 0)) {
+    struct timespec now;
+    wsMonotonicTime(&now);
+    i64 remainingNs = (((i64) deadline->tv_sec - (i64) now.tv_sec) * 1000000000)
+      + ((i64) deadline->tv_nsec - (i64) now.tv_nsec);
+    if (remainingNs <= 0) {
+      returnValue = -1;
+      break;
+    }
+    
+    // cnd_timedwait only takes a TIME_UTC time, so wait in short slices to
+    // keep a change to the time of day from stretching the wait.
+    if (remainingNs > 100000000) {
+      remainingNs = 100000000;
+    }
+    struct timespec until;
+    timespec_get(&until, TIME_UTC);
+    until.tv_nsec += (long) remainingNs;
+    if (until.tv_nsec >= 1000000000) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000;
+    }
+    cnd_timedwait(&pool->idle, &pool->lock, &until);
+  }
+  mtx_unlock(&pool->lock);
+  
+  return returnValue;
+}
+
+/// @fn int wsRejectConnection(Socket *clientSocket, const char *status, int retryAfterSeconds, WsMetrics *metrics)
+///
+/// @brief Tell a client that its request can't be processed right now and
+/// close the connection.  Any part of the request that has already arrived
+/// is read and discarded first so that closing the socket doesn't reset the
+/// connection before the client has read the response.
+///
+/// @param clientSocket The Socket the client is connected on.
+/// @param status The status line to send, e.g. "503 Service Unavailable".
+/// @param retryAfterSeconds The value to send in the Retry-After header.
+/// @param metrics The WsMetrics of the server to count the response in.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsRejectConnection(Socket *clientSocket, const char *status,
+  int retryAfterSeconds, WsMetrics *metrics
+) {
+  if (clientSocket->socketMode != PLAIN) {
+    // Responding would require completing the handshake.  Just close.
+    return 0;
+  }
+  
+  char discard[1024];
+  while (socketReceive(clientSocket, discard, sizeof(discard), 0) > 0);
+  
+  Bytes response = NULL;
+  abprintf(&response,
+    "HTTP/1.1 %s\r\n"
+    "Date: %s\r\n"
+    "Retry-After: %d\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+    status, getServerDate(), retryAfterSeconds);
+  u64 unsent = sendBuffer(response, clientSocket);
+  wsMetricsCountResponse(metrics, atoi(status), bytesLength(response) - unsent);
+  response = bytesDestroy(response);
+  
+  return (unsent == 0) ? 0 : -1;
+}
+
+/// @fn int wsThreadInfoCancel(void *args)
+///
+/// @brief Close a connection that was queued for a worker thread but never
+/// processed.
+///
+/// @param args The WsThreadInfo for the connection cast to a void*.
+///
+/// @return This function always returns 0.
+int wsThreadInfoCancel(void *args) {
+  WsThreadInfo *wsThreadInfo = (WsThreadInfo*) args;
+  wsThreadInfo = wsThreadInfoDestroy(wsThreadInfo);
+  
+  return 0;
+}
+
+/// @def WS_RECEIVE_SLICE_MILLISECONDS
+///
+/// @brief The longest a connection thread blocks in a single receive while
+/// waiting for a request.  Keeping this short lets idle persistent connections
+/// notice that the server is shutting down.
+#define WS_RECEIVE_SLICE_MILLISECONDS 250
+
+/// @def WS_RECEIVE_CHUNK_SIZE
+///
+/// @brief The amount of space made available at the end of a connection's
+/// receive buffer for each read from the client.
+#define WS_RECEIVE_CHUNK_SIZE 16384
+
+/// @fn int wsReceiveIntoBuffer(Socket *clientSocket, Bytes *receiveBuffer, int timeoutMilliseconds)
+///
+/// @brief Receive data from a client directly onto the end of a receive
+/// buffer, without an intermediate copy.
+///
+/// @param clientSocket The Socket to receive from.
+/// @param receiveBuffer A pointer to the Bytes buffer to append to.
+/// @param timeoutMilliseconds The number of milliseconds to wait for data.
+///
+/// @return Returns the number of bytes received on success, 0 if the client
+/// closed the connection, and -1 on timeout or error.
+int wsReceiveIntoBuffer(Socket *clientSocket, Bytes *receiveBuffer,
+  int timeoutMilliseconds
+) {
+  u64 bufferLength = bytesLength(*receiveBuffer);
+  if (bytesAllocate(receiveBuffer, bufferLength + WS_RECEIVE_CHUNK_SIZE)
+    == NULL
+  ) {
+    LOG_MALLOC_FAILURE();
+    return -1;
+  }
+  
+  int numBytesReceived = socketReceive(clientSocket,
+    *receiveBuffer + bufferLength, WS_RECEIVE_CHUNK_SIZE, timeoutMilliseconds);
+  if (numBytesReceived > 0) {
+    bufferLength += (u64) numBytesReceived;
+    bytesSetLength(*receiveBuffer, bufferLength);
+  }
+  (*receiveBuffer)[bufferLength] = '\0';
+  
+  return numBytesReceived;
+}
+
+/// @def WS_MAX_CHUNK_LINE_BYTES
+///
+/// @brief The longest chunk-size or trailer line that will be accepted in a
+/// chunked request body.
+#define WS_MAX_CHUNK_LINE_BYTES 4096
+
+/// @enum WsChunkState
+///
+/// @brief The states of the decoder for a request body that's moved out of the
+/// receive buffer.
+///
+/// @param WS_CHUNK_SIZE Expecting the chunk-size line of the next chunk.
+/// @param WS_CHUNK_DATA Copying the data of the current chunk.
+/// @param WS_CHUNK_DATA_END Expecting the CRLF that follows the data of a chunk.
+/// @param WS_CHUNK_TRAILERS Skipping the trailer fields after the last chunk.
+/// @param WS_CHUNK_DONE The whole body has been received.
+typedef enum WsChunkState {
+  WS_CHUNK_SIZE,
+  WS_CHUNK_DATA,
+  WS_CHUNK_DATA_END,
+  WS_CHUNK_TRAILERS,
+  WS_CHUNK_DONE
+} WsChunkState;
+
+/// @fn bool wsRequestBodyInPlace(WsThreadInfo *wsThreadInfo)
+///
+/// @brief Determine whether or not the body of the request whose header was
+/// just parsed is received directly into the receive buffer.  Bodies that use
+/// the chunked transfer coding, bodies that are too large to be held in memory,
+/// and bodies that are going to be rejected are handled by
+/// wsReceiveSpooledBody instead.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+///
+/// @return Returns true if the body is received in place, false if not.
+bool wsRequestBodyInPlace(WsThreadInfo *wsThreadInfo) {
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  if (httpRequest->chunked == true) {
+    return false;
+  } else if ((wsThreadInfo->maxRequestBodyBytes > 0)
+    && (httpRequest->contentLength > (u64) wsThreadInfo->maxRequestBodyBytes)
+  ) {
+    return false;
+  }
+  
+  return (wsThreadInfo->requestBodyMemoryBytes == 0)
+    || (httpRequest->contentLength
+      <= (u64) wsThreadInfo->requestBodyMemoryBytes);
+}
+
+/// @fn void wsRejectRequestBody(WsThreadInfo *wsThreadInfo, const char *status)
+///
+/// @brief Send an error response for a request whose body can't be accepted.
+/// The rest of the body is never read, so the connection is closed afterward.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param status The status line to send, e.g. "413 Content Too Large".
+///
+/// @return This function returns no value.
+void wsRejectRequestBody(WsThreadInfo *wsThreadInfo, const char *status) {
+  printLog(WARN, "Rejecting request body from %s:  %s\n",
+    socketAddress(wsThreadInfo->clientSocket), status);
+  wsThreadInfo->keepAlive = false;
+  sendResponseToClient(wsThreadInfo, status, "Content-Length: 0\r\n",
+    NULL, 0);
+}
+
+/// @fn int wsReceiveBodyData(WsThreadInfo *wsThreadInfo, Bytes *receiveBuffer, i64 *lastProgress)
+///
+/// @brief Receive more of the body of a request onto the end of the receive
+/// buffer.  The client may take as long as it needs to deliver the whole body
+/// as long as it never goes WS_REQUEST_TIMEOUT_SECONDS without sending
+/// anything.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param receiveBuffer A pointer to the Bytes buffer that holds the data
+///   received from the client.
+/// @param lastProgress A pointer to the time data was last received from the
+///   client.  Updated when more data arrives.
+///
+/// @return Returns the number of bytes received on success, -1 if the client
+/// closed the connection or stopped sending.
+int wsReceiveBodyData(WsThreadInfo *wsThreadInfo, Bytes *receiveBuffer,
+  i64 *lastProgress
+) {
+  Socket *clientSocket = wsThreadInfo->clientSocket;
+  
+  while (((i64) time(NULL)) < *lastProgress + WS_REQUEST_TIMEOUT_SECONDS) {
+    int recvbufLen = wsReceiveIntoBuffer(clientSocket, receiveBuffer,
+      WS_RECEIVE_SLICE_MILLISECONDS);
+    if (recvbufLen > 0) {
+      *lastProgress = (i64) time(NULL);
+      // *receiveBuffer may have been reallocated.
+      wsThreadInfo->httpRequest.buffer = *receiveBuffer;
+      return recvbufLen;
+    } else if ((recvbufLen == 0) || (clientSocket->sockfd < 0)) {
+      // Client has closed the connection.
+      break;
+    }
+  }
+  
+  return -1;
+}
+
+/// @fn int wsReceiveSpooledBody(WsThreadInfo *wsThreadInfo, Bytes *receiveBuffer)
+///
+/// @brief Receive a request body into wsThreadInfo->bodyReader instead of the
+/// receive buffer, removing the chunked transfer coding if it's used.  Each
+/// piece of the body is moved out of the receive buffer as it arrives, so the
+/// receive buffer never holds more than the header and one read's worth of
+/// data.  Anything the client pipelines after the body is left in the receive
+/// buffer right after the header.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param receiveBuffer A pointer to the Bytes buffer that holds the data
+///   received from the client.
+///
+/// @return Returns 1 if the body was received, -1 if it was not.  If a body
+/// was rejected, the response has already been sent.
+int wsReceiveSpooledBody(WsThreadInfo *wsThreadInfo, Bytes *receiveBuffer) {
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  WsBodyReader *bodyReader = &wsThreadInfo->bodyReader;
+  Socket *clientSocket = wsThreadInfo->clientSocket;
+  u64 bodyOffset = httpRequest->bodyOffset;
+  u64 maxBodyBytes = (u64) wsThreadInfo->maxRequestBodyBytes;
+  
+  // A body with a Content-Length is a single chunk with no framing.
+  WsChunkState state = WS_CHUNK_DATA;
+  u64 chunkRemaining = httpRequest->contentLength;
+  if (httpRequest->chunked == true) {
+    state = WS_CHUNK_SIZE;
+    chunkRemaining = 0;
+  }
+  
+  // Workers in WS_EVENT_LOOP mode are handed nonblocking sockets.  The rest
+  // of the body is received here, so wait for it.
+  bool socketWasBlocking = clientSocket->blocking;
+  if (socketWasBlocking == false) {
+    socketSetBlocking(clientSocket);
+  }
+  
+  const char *errorStatus = NULL;
+  i64 lastProgress = (i64) time(NULL);
+  while ((state != WS_CHUNK_DONE) && (errorStatus == NULL)) {
+    char *buffer = (char*) *receiveBuffer;
+    u64 bufferLength = bytesLength(*receiveBuffer);
+    u64 scanOffset = bodyOffset;
+    bool needMore = false;
+    while ((needMore == false) && (state != WS_CHUNK_DONE)
+      && (errorStatus == NULL)
+    ) {
+      u64 available = bufferLength - scanOffset;
+      char *lineEnd = NULL;
+      if ((state == WS_CHUNK_SIZE) || (state == WS_CHUNK_TRAILERS)) {
+        lineEnd = (char*) memchr(buffer + scanOffset, '\n', available);
+        if (lineEnd == NULL) {
+          if (available > WS_MAX_CHUNK_LINE_BYTES) {
+            errorStatus = "400 Bad Request";
+          }
+          needMore = true;
+          continue;
+        }
+      }
+      
+      if (state == WS_CHUNK_SIZE) {
+        // The receive buffer is NUL-terminated, so strtoull stops at the end
+        // of the line at the latest.
+        char *sizeEnd = NULL;
+        errno = 0;
+        u64 chunkSize = (u64) strtoull(buffer + scanOffset, &sizeEnd, 16);
+        if ((isxdigit((unsigned char) buffer[scanOffset]) == 0)
+          || (errno != 0) || ((*sizeEnd != ';') && (*sizeEnd != ' ')
+            && (*sizeEnd != '\t') && (*sizeEnd != '\r') && (*sizeEnd != '\n'))
+        ) {
+          errorStatus = "400 Bad Request";
+        } else if ((maxBodyBytes > 0)
+          && (chunkSize > maxBodyBytes - bodyReader->length)
+        ) {
+          errorStatus = "413 Content Too Large";
+        } else if (chunkSize == 0) {
+          state = WS_CHUNK_TRAILERS;
+        } else {
+          chunkRemaining = chunkSize;
+          state = WS_CHUNK_DATA;
+        }
+        scanOffset = (u64) (lineEnd - buffer) + 1;
+      } else if (state == WS_CHUNK_DATA) {
+        u64 numBytes = (available < chunkRemaining) ? available : chunkRemaining;
+        if ((numBytes > 0) && (wsBodyReaderAppend(bodyReader,
+          wsThreadInfo->requestBodyMemoryBytes,
+          (unsigned char*) buffer + scanOffset, numBytes) != 0)
+        ) {
+          errorStatus = "500 Internal Server Error";
+        }
+        scanOffset += numBytes;
+        chunkRemaining -= numBytes;
+        if (chunkRemaining > 0) {
+          needMore = true;
+        } else if (httpRequest->chunked == true) {
+          state = WS_CHUNK_DATA_END;
+        } else {
+          state = WS_CHUNK_DONE;
+        }
+      } else if (state == WS_CHUNK_DATA_END) {
+        if ((available == 0)
+          || ((available == 1) && (buffer[scanOffset] == '\r'))
+        ) {
+          needMore = true;
+        } else if (buffer[scanOffset] == '\n') {
+          scanOffset++;
+          state = WS_CHUNK_SIZE;
+        } else if ((buffer[scanOffset] == '\r')
+          && (buffer[scanOffset + 1] == '\n')
+        ) {
+          scanOffset += 2;
+          state = WS_CHUNK_SIZE;
+        } else {
+          errorStatus = "400 Bad Request";
+        }
+      } else if (state == WS_CHUNK_TRAILERS) {
+        // Trailer fields are not used.  An empty line ends the body.
+        u64 lineLength = (u64) (lineEnd - (buffer + scanOffset));
+        if ((lineLength == 0)
+          || ((lineLength == 1) && (buffer[scanOffset] == '\r'))
+        ) {
+          state = WS_CHUNK_DONE;
+        }
+        scanOffset = (u64) (lineEnd - buffer) + 1;
+      }
+    }
+    
+    // Drop what's been consumed so the receive buffer doesn't grow with the
+    // body.
+    u64 remainingLength = bufferLength - scanOffset;
+    memmove(buffer + bodyOffset, buffer + scanOffset, remainingLength);
+    bytesSetLength(*receiveBuffer, bodyOffset + remainingLength);
+    (*receiveBuffer)[bodyOffset + remainingLength] = '\0';
+    
+    if ((state != WS_CHUNK_DONE) && (errorStatus == NULL)
+      && (wsReceiveBodyData(wsThreadInfo, receiveBuffer, &lastProgress) < 0)
+    ) {
+      break;
+    }
+  }
+  
+  if (socketWasBlocking == false) {
+    socketSetNonblocking(clientSocket);
+  }
+  if ((state == WS_CHUNK_DONE) && (errorStatus == NULL)
+    && (wsBodyReaderFinish(bodyReader) != 0)
+  ) {
+    errorStatus = "500 Internal Server Error";
+  }
+  if (errorStatus != NULL) {
+    wsBodyReaderReset(bodyReader);
+    wsRejectRequestBody(wsThreadInfo, errorStatus);
+    return -1;
+  } else if (state != WS_CHUNK_DONE) {
+    printLog(WARN, "Incomplete request body from %s.\n",
+      socketAddress(clientSocket));
+    wsBodyReaderReset(bodyReader);
+    return -1;
+  }
+  
+  return 1;
+}
+
+/// @fn int wsReceiveBody(WsThreadInfo *wsThreadInfo, Bytes *receiveBuffer)
+///
+/// @brief Receive the body of the request whose header has been parsed into
+/// wsThreadInfo->httpRequest and make it available through
+/// wsThreadInfo->bodyReader and wsThreadInfo->body.  Small bodies are left in
+/// the receive buffer.  Chunked and large bodies are moved out of it by
+/// wsReceiveSpooledBody.  Sets wsThreadInfo->requestLength.  A request whose
+/// body is too large is rejected before any of the body is read.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param receiveBuffer A pointer to the Bytes buffer that holds the data
+///   received from the client.  The request starts at the beginning of the
+///   buffer.
+///
+/// @return Returns 1 if the complete body was received, 0 if a body that was
+/// being received in place is incomplete, and -1 if the request has to be
+/// abandoned.  If the request was rejected, the response has already been
+/// sent.
+int wsReceiveBody(WsThreadInfo *wsThreadInfo, Bytes *receiveBuffer) {
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  WsBodyReader *bodyReader = &wsThreadInfo->bodyReader;
+  u64 bodyOffset = httpRequest->bodyOffset;
+  
+  if ((httpRequest->chunked == false) && (wsThreadInfo->maxRequestBodyBytes > 0)
+    && (httpRequest->contentLength > (u64) wsThreadInfo->maxRequestBodyBytes)
+  ) {
+    // Don't make the client send a body that's going to be thrown away.
+    wsRejectRequestBody(wsThreadInfo, "413 Content Too Large");
+    return -1;
+  }
+  
+  // In WS_EVENT_LOOP mode, a body that's received in place has already been
+  // timed by the reactor.
+  bool bodyTimed = ((wsThreadInfo->phasesTimed
+    & (((u32) 1) << WS_PHASE_BODY_RECEIVE)) != 0);
+  int returnValue = 1;
+  if (wsRequestBodyInPlace(wsThreadInfo) == true) {
+    u64 requestLength = bodyOffset + httpRequest->contentLength;
+    i64 lastProgress = (i64) time(NULL);
+    while (bytesLength(*receiveBuffer) < requestLength) {
+      if (wsReceiveBodyData(wsThreadInfo, receiveBuffer, &lastProgress) < 0) {
+        break;
+      }
+    }
+    if (bytesLength(*receiveBuffer) < requestLength) {
+      requestLength = bytesLength(*receiveBuffer);
+      returnValue = 0;
+    }
+    bodyReader->data = *receiveBuffer + bodyOffset;
+    bodyReader->length = requestLength - bodyOffset;
+    wsThreadInfo->requestLength = requestLength;
+  } else {
+    // Don't count the time the request may have spent waiting for a worker.
+    wsMonotonicTime(&wsThreadInfo->phaseStart);
+    returnValue = wsReceiveSpooledBody(wsThreadInfo, receiveBuffer);
+    wsThreadInfo->requestLength = bodyOffset;
+  }
+  httpRequest->buffer = *receiveBuffer;
+  wsThreadInfo->body = bodyReader->data;
+  if (((httpRequest->chunked) || (httpRequest->contentLength > 0))
+    && (bodyTimed == false)
+  ) {
+    wsMetricsEndPhase(wsThreadInfo, WS_PHASE_BODY_RECEIVE,
+      &wsThreadInfo->phaseStart);
+  }
+  
+  return returnValue;
+}
+
+/// @fn int wsReceiveRequest(WsThreadInfo *wsThreadInfo, Bytes *receiveBuffer, int headerTimeoutSeconds)
+///
+/// @brief Receive the next request on a connection into
+/// wsThreadInfo->httpRequest.  Any data already in receiveBuffer (left over
+/// from a pipelined request) is parsed before anything more is read from the
+/// socket, and each read only parses the newly-received data.
+///
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param receiveBuffer A pointer to the Bytes buffer that holds the data
+///   received from the client.  The request starts at the beginning of the
+///   buffer.
+/// @param headerTimeoutSeconds The number of seconds to wait for the header of
+///   the request to arrive.
+///
+/// @return Returns 1 if the complete request was received, 0 if not, and -1 if
+/// the request has to be abandoned.
+int wsReceiveRequest(WsThreadInfo *wsThreadInfo, Bytes *receiveBuffer,
+  int headerTimeoutSeconds
+) {
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  Socket *clientSocket = wsThreadInfo->clientSocket;
+  bool idle = (wsThreadInfo->numRequests > 0);
+  
+  // There will be a timeout on receive enforced by the while below.  A
+  // pipelining client may have already sent the whole request.
+  if (bytesLength(*receiveBuffer) > 0) {
+    wsMetricsBeginRequest(wsThreadInfo);
+  }
+  WsHttpParserState state = wsHttpRequestParse(httpRequest, *receiveBuffer);
+  i64 startTime = (i64) time(NULL);
+  while (((state == WS_HTTP_PARSING_REQUEST_LINE)
+      || (state == WS_HTTP_PARSING_HEADERS))
+    && (((i64) time(NULL)) < startTime + headerTimeoutSeconds)
+  ) {
+    if ((idle == true) && (bytesLength(*receiveBuffer) == 0)
+      && (*wsThreadInfo->exitNow == true)
+    ) {
+      // Idle persistent connection and the server is shutting down.
+      break;
+    }
+    int receiveMilliseconds = WS_RECEIVE_SLICE_MILLISECONDS;
+    if (clientSocket->waitFunction != NULL) {
+      // The wait is cut short when the server starts shutting down, so wait
+      // for the rest of the timeout at once instead of waking up repeatedly.
+      receiveMilliseconds = (int) (1000
+        * (startTime + headerTimeoutSeconds - ((i64) time(NULL))));
+    }
+    int recvbufLen = wsReceiveIntoBuffer(clientSocket, receiveBuffer,
+      receiveMilliseconds);
+    if (recvbufLen > 0) {
+      wsMetricsBeginRequest(wsThreadInfo);
+      printLog(DEBUG, "receiveBuffer: %s\n", (char*) *receiveBuffer);
+      state = wsHttpRequestParse(httpRequest, *receiveBuffer);
+    } else if ((recvbufLen == 0) || (clientSocket->sockfd < 0)) {
+      // Client has closed the connection.  Exit the loop.
+      break;
+    }
+  }
+  if (state != WS_HTTP_HEADER_COMPLETE) {
+    return 0;
+  }
+  wsMetricsEndPhase(wsThreadInfo, WS_PHASE_HEADER_RECEIVE,
+    &wsThreadInfo->phaseStart);
+  
+  return wsReceiveBody(wsThreadInfo, receiveBuffer);
+}
+
+/// @fn int wsConnectionThread(void *args)
+///
+/// @brief Handle an individual client connection.  The connection is kept
+/// open for further requests for as long as the client and the server's
+/// keep-alive settings allow.
+///
+/// @param args is the WsThreadInfo structure for the connection to
+/// the client cast to a void*.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int wsConnectionThread(void *args) {
+  Bytes fullReceiveBuffer = NULL;
+  WsThreadInfo *wsThreadInfo = (WsThreadInfo*) args;
+  
+  printLog(TRACE, "ENTER wsConnectionThread(args=%p)\n", args);
+  
+  if (wsThreadInfo == NULL) {
+    printLog(ERR, "wsThreadInfo is NULL.  Cannot process connection.\n");
+    
+    printLog(TRACE, "EXIT wsConnectionThread(args=%p) = {1}\n", args);
+    return 1;
+  }
+  
+  Socket *clientSocket = wsThreadInfo->clientSocket;
+  printLog(DETAIL, "Processing connection for %s\n",
+    socketAddress(clientSocket));
+  if (wsThreadInfo->queuedNs != 0) {
+    wsThreadInfo->dequeuedNs = traceNowNanoseconds();
+  }
+  
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  int returnValue = 0;
+  int headerTimeoutSeconds = WS_REQUEST_TIMEOUT_SECONDS;
+  do {
+    int status = wsReceiveRequest(wsThreadInfo, &fullReceiveBuffer,
+      headerTimeoutSeconds);
+    bool requestComplete = (status > 0);
+    if (status < 0) {
+      // The request was rejected or its body never arrived.
+      break;
+    } else if (bytesLength(fullReceiveBuffer) == 0) {
+      if (wsThreadInfo->numRequests == 0) {
+        printLog(WARN, "Nothing received from client.\n");
+      }
+      break;
+    } else if ((requestComplete == false) && (wsThreadInfo->numRequests > 0)) {
+      // Partial request on an idle persistent connection.  Just close it.
+      break;
+    }
+    
+    // Terminate the request so that handlers that treat the body as a string
+    // don't run into a pipelined request that follows it.
+    u64 requestLength = bytesLength(fullReceiveBuffer);
+    if (httpRequest->state == WS_HTTP_HEADER_COMPLETE) {
+      requestLength = wsThreadInfo->requestLength;
+    }
+    unsigned char nextByte = fullReceiveBuffer[requestLength];
+    fullReceiveBuffer[requestLength] = '\0';
+    
+    returnValue = wsProcessRequest(wsThreadInfo);
+    fullReceiveBuffer[requestLength] = nextByte;
+    wsHttpRequestReset(httpRequest);
+    if (requestComplete == false) {
+      // We don't know where the next request would start.
+      wsThreadInfo->keepAlive = false;
+    }
+    
+    // Keep anything the client has pipelined after this request.
+    u64 remainingLength = bytesLength(fullReceiveBuffer) - requestLength;
+    memmove(fullReceiveBuffer, fullReceiveBuffer + requestLength,
+      remainingLength);
+    bytesSetLength(fullReceiveBuffer, remainingLength);
+    fullReceiveBuffer[remainingLength] = '\0';
+    headerTimeoutSeconds = wsThreadInfo->keepAliveTimeoutSeconds;
+  } while (wsThreadInfo->keepAlive == true);
+  fullReceiveBuffer = bytesDestroy(fullReceiveBuffer);
+  
+  printLog(TRACE, "EXIT wsConnectionThread(args=%p) = {%d}\n", args, returnValue);
+  wsThreadInfo = wsThreadInfoDestroy(wsThreadInfo);
+  args = NULL;
+  return returnValue;
+}
+
+#ifdef __linux__
+
+/// @def WS_EVENT_LOOP_MAX_EVENTS
+///
+/// @brief The maximum number of epoll events a reactor thread will process per
+/// call to epoll_wait.
+#define WS_EVENT_LOOP_MAX_EVENTS 64
+
+/// @enum WsConnectionState
+///
+/// @brief The states of a client connection in WS_EVENT_LOOP mode.
+///
+/// @param WS_CONNECTION_HANDSHAKING The connection is owned by its reactor
+///   thread, which is running the TLS handshake as the client's messages
+///   arrive.
+/// @param WS_CONNECTION_READING The connection is owned by its reactor thread,
+///   which is waiting for the rest of a request.
+/// @param WS_CONNECTION_PROCESSING A complete request has been handed off to a
+///   worker thread, which owns the connection until it's done.
+typedef enum WsConnectionState {
+  WS_CONNECTION_HANDSHAKING,
+  WS_CONNECTION_READING,
+  WS_CONNECTION_PROCESSING,
+} WsConnectionState;
+
+// Forward declarations.
+typedef struct WsReactor WsReactor;
+typedef struct WsEventLoop WsEventLoop;
+
+/// @struct WsConnection
+///
+/// @brief Information about a client connection that's being serviced in
+/// WS_EVENT_LOOP mode.
+///
+/// @param wsThreadInfo The WsThreadInfo that's used to process requests from
+///   the connection.  The connection owns this structure.
+/// @param reactor The WsReactor that owns the client socket.
+/// @param state The current WsConnectionState of the connection.
+/// @param waitEvents The events (POLLIN or POLLOUT) the reactor waits for
+///   before reading from the connection again.  A TLS socket may need to
+///   write before it can read.
+/// @param receiveBuffer The data received for the current request so far.
+///   The request is parsed into wsThreadInfo->httpRequest as it arrives.
+/// @param deadline The time (in seconds since the epoch) by which the next
+///   part of the request must be received.
+/// @param bodyBytesSeen The length of receiveBuffer the last time the
+///   deadline was extended for progress on the body of a request.
+/// @param prev The previous WsConnection in the reactor's list.
+/// @param next The next WsConnection in the reactor's list.
+typedef struct WsConnection {
+  WsThreadInfo        *wsThreadInfo;
+  WsReactor           *reactor;
+  WsConnectionState    state;
+  short                waitEvents;
+  Bytes                receiveBuffer;
+  i64                  deadline;
+  u64                  bodyBytesSeen;
+  struct WsConnection *prev;
+  struct WsConnection *next;
+} WsConnection;
+
+/// @struct WsReactor
+///
+/// @brief A thread that owns a set of client sockets and reads requests from
+/// them as data becomes available.
+///
+/// @param epollFd The epoll file descriptor for the reactor's sockets.
+/// @param wakeFd An eventfd used to interrupt epoll_wait when the reactor needs
+///   to exit.
+/// @param threadId The ID of the reactor's thread.
+/// @param lock A mutex to protect the list of connections.
+/// @param connections The head of the list of connections owned by the
+///   reactor.
+/// @param eventLoop The WsEventLoop the reactor belongs to.
+/// @param exitNow Whether or not the reactor thread should exit.
+typedef struct WsReactor {
+  int           epollFd;
+  int           wakeFd;
+  thrd_t        threadId;
+  mtx_t         lock;
+  WsConnection *connections;
+  WsEventLoop  *eventLoop;
+  bool          exitNow;
+} WsReactor;
+
+/// @struct WsEventLoop
+///
+/// @brief The reactor threads for a server running in WS_EVENT_LOOP mode.
+///
+/// @param reactors The array of WsReactors.
+/// @param numReactors The number of elements in reactors.
+/// @param workerPool The server's WsWorkerPool that processes complete
+///   requests.
+/// @param overloadPolicy The server's WsOverloadPolicy.
+/// @param retryAfterSeconds The value of the Retry-After header to send when
+///   rejecting requests.
+/// @param webService The WebService being served, if any.
+typedef struct WsEventLoop {
+  WsReactor        *reactors;
+  int               numReactors;
+  WsWorkerPool     *workerPool;
+  WsOverloadPolicy  overloadPolicy;
+  int               retryAfterSeconds;
+  WebService       *webService;
+} WsEventLoop;
+
+/// @fn WsConnection* wsConnectionDestroy(WsConnection *wsConnection)
+///
+/// @brief Remove a connection from its reactor, close it, and free its
+/// resources.
+///
+/// @param wsConnection The WsConnection to destroy.
+///
+/// @return This function always returns NULL.
+WsConnection* wsConnectionDestroy(WsConnection *wsConnection) {
+  if (wsConnection == NULL) {
+    return NULL;
+  }
+  
+  WsReactor *reactor = wsConnection->reactor;
+  mtx_lock(&reactor->lock);
+  if (wsConnection->prev != NULL) {
+    wsConnection->prev->next = wsConnection->next;
+  } else {
+    reactor->connections = wsConnection->next;
+  }
+  if (wsConnection->next != NULL) {
+    wsConnection->next->prev = wsConnection->prev;
+  }
+  mtx_unlock(&reactor->lock);
+  
+  // Closing the socket removes it from the reactor's epoll set.
+  wsConnection->wsThreadInfo
+    = wsThreadInfoDestroy(wsConnection->wsThreadInfo);
+  wsConnection->receiveBuffer = bytesDestroy(wsConnection->receiveBuffer);
+  wsConnection = (WsConnection*) pointerDestroy(wsConnection);
+  
+  return NULL;
+}
+
+/// @fn int wsReactorArm(WsConnection *wsConnection, int operation)
+///
+/// @brief (Re-)register a connection's socket with its reactor so that the
+/// reactor will be notified the next time the connection's waitEvents occur.
+///
+/// @param wsConnection The WsConnection to arm.
+/// @param operation EPOLL_CTL_ADD for new connections, EPOLL_CTL_MOD for
+///   connections that have already been registered.
+///
+/// @return Returns 0 on success, -1 on failure.
+int wsReactorArm(WsConnection *wsConnection, int operation) {
+  ZEROINIT(struct epoll_event event);
+  event.events = EPOLLRDHUP | EPOLLONESHOT
+    | ((wsConnection->waitEvents == POLLOUT) ? EPOLLOUT : EPOLLIN);
+  event.data.ptr = wsConnection;
+  return epoll_ctl(wsConnection->reactor->epollFd, operation,
+    wsConnection->wsThreadInfo->clientSocket->sockfd, &event);
+}
+
+/// @fn int wsConnectionCheckRequest(WsConnection *wsConnection)
+///
+/// @brief Parse whatever has been added to a connection's receive buffer
+/// since the last call and determine whether or not a complete request is at
+/// the front of it.
+///
+/// @param wsConnection The WsConnection to examine.
+///
+/// @return Returns 1 if a complete request has been received, 0 if more data
+/// is needed, and -1 if the request is malformed.
+int wsConnectionCheckRequest(WsConnection *wsConnection) {
+  WsThreadInfo *wsThreadInfo = wsConnection->wsThreadInfo;
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  if (bytesLength(wsConnection->receiveBuffer) > 0) {
+    wsMetricsBeginRequest(wsThreadInfo);
+  }
+  WsHttpParserState previousState = httpRequest->state;
+  WsHttpParserState state
+    = wsHttpRequestParse(httpRequest, wsConnection->receiveBuffer);
+  if (state == WS_HTTP_PARSE_ERROR) {
+    return -1;
+  } else if (state != WS_HTTP_HEADER_COMPLETE) {
+    return 0;
+  } else if (previousState != WS_HTTP_HEADER_COMPLETE) {
+    wsMetricsEndPhase(wsThreadInfo, WS_PHASE_HEADER_RECEIVE,
+      &wsThreadInfo->phaseStart);
+  }
+  
+  if (wsRequestBodyInPlace(wsThreadInfo) == false) {
+    // A worker receives the body so that it never has to be held in the
+    // receive buffer.
+    return 1;
+  }
+  
+  u64 bufferLength = bytesLength(wsConnection->receiveBuffer);
+  if ((previousState != WS_HTTP_HEADER_COMPLETE)
+    || (bufferLength > wsConnection->bodyBytesSeen)
+  ) {
+    // The client has until WS_REQUEST_TIMEOUT_SECONDS after the last data it
+    // sent to deliver more of the body.
+    wsConnection->deadline
+      = ((i64) time(NULL)) + WS_REQUEST_TIMEOUT_SECONDS;
+    wsConnection->bodyBytesSeen = bufferLength;
+  }
+  
+  if (bufferLength < httpRequest->bodyOffset + httpRequest->contentLength) {
+    return 0;
+  } else if (httpRequest->contentLength > 0) {
+    wsMetricsEndPhase(wsThreadInfo, WS_PHASE_BODY_RECEIVE,
+      &wsThreadInfo->phaseStart);
+  }
+  
+  return 1;
+}
+
+// Forward declaration.
+int wsReactorRead(WsConnection *wsConnection);
+
+/// @fn int wsEventLoopProcessConnection(void *args)
+///
+/// @brief Process the complete request that's been received on a connection.
+/// Any further requests the client has already pipelined are processed in
+/// order.  If the connection is to be kept alive, it's handed back to its
+/// reactor to wait for the next request, otherwise it's closed.  Run by the
+/// server's worker pool.
+///
+/// @param args The WsConnection with the complete request cast to a void*.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int wsEventLoopProcessConnection(void *args) {
+  WsConnection *wsConnection = (WsConnection*) args;
+  WsThreadInfo *wsThreadInfo = wsConnection->wsThreadInfo;
+  printLog(DETAIL, "Processing request from %s\n",
+    socketAddress(wsThreadInfo->clientSocket));
+  if (wsThreadInfo->queuedNs != 0) {
+    wsThreadInfo->dequeuedNs = traceNowNanoseconds();
+  }
+  
+  WsHttpRequest *httpRequest = &wsThreadInfo->httpRequest;
+  int returnValue = 0;
+  int status = 0;
+  do {
+    if (wsReceiveBody(wsThreadInfo, &wsConnection->receiveBuffer) <= 0) {
+      // The request was rejected or its body never arrived.
+      wsConnection = wsConnectionDestroy(wsConnection);
+      return returnValue;
+    }
+    
+    // Terminate the request so that handlers that treat the body as a string
+    // don't run into a pipelined request that follows it.
+    Bytes receiveBuffer = wsConnection->receiveBuffer;
+    u64 requestLength = wsThreadInfo->requestLength;
+    unsigned char nextByte = receiveBuffer[requestLength];
+    receiveBuffer[requestLength] = '\0';
+    
+    returnValue = wsProcessRequest(wsThreadInfo);
+    receiveBuffer[requestLength] = nextByte;
+    wsHttpRequestReset(httpRequest);
+    if (wsThreadInfo->keepAlive == false) {
+      wsConnection = wsConnectionDestroy(wsConnection);
+      return returnValue;
+    }
+    
+    // Keep anything the client has pipelined after this request.
+    u64 remainingLength = bytesLength(receiveBuffer) - requestLength;
+    memmove(receiveBuffer, receiveBuffer + requestLength, remainingLength);
+    bytesSetLength(receiveBuffer, remainingLength);
+    receiveBuffer[remainingLength] = '\0';
+    status = wsConnectionCheckRequest(wsConnection);
+    if ((status == 0)
+      && (wsThreadInfo->clientSocket->socketMode != PLAIN)
+    ) {
+      // Records the worker received may hold more than it read.  epoll can't
+      // report data that's already been decrypted, so read it now.
+      status = wsReactorRead(wsConnection);
+    }
+  } while (status > 0);
+  if (status < 0) {
+    if (httpRequest->state == WS_HTTP_PARSE_ERROR) {
+      printLog(ERR, "Malformed HTTP header.\n");
+    }
+    wsConnection = wsConnectionDestroy(wsConnection);
+    return returnValue;
+  }
+  
+  // Wait for the rest of the next request.  The reactor may pick the
+  // connection up as soon as it's armed, so it must not be touched after that.
+  WsReactor *reactor = wsConnection->reactor;
+  mtx_lock(&reactor->lock);
+  if (httpRequest->state != WS_HTTP_HEADER_COMPLETE) {
+    wsConnection->deadline
+      = ((i64) time(NULL)) + wsThreadInfo->keepAliveTimeoutSeconds;
+  }
+  wsConnection->state = WS_CONNECTION_READING;
+  status = wsReactorArm(wsConnection, EPOLL_CTL_MOD);
+  mtx_unlock(&reactor->lock);
+  if (status < 0) {
+    printLog(ERR, "Could not rearm client socket: %s\n", strerror(errno));
+    wsConnection = wsConnectionDestroy(wsConnection);
+  }
+  
+  return returnValue;
+}
+
+/// @fn int wsEventLoopCancelConnection(void *args)
+///
+/// @brief Close a connection whose request was queued but never processed.
+///
+/// @param args The WsConnection to close cast to a void*.
+///
+/// @return This function always returns 0.
+int wsEventLoopCancelConnection(void *args) {
+  WsConnection *wsConnection = (WsConnection*) args;
+  wsConnection = wsConnectionDestroy(wsConnection);
+  
+  return 0;
+}
+
+/// @fn void wsEventLoopQueueWork(WsEventLoop *eventLoop, WsConnection *wsConnection)
+///
+/// @brief Hand a connection with a complete request off to the worker pool.
+/// If the pool's queue is full and the overload policy is WS_OVERLOAD_REJECT,
+/// the client is sent a 503 response instead.  Reactors never block, so with
+/// WS_OVERLOAD_STOP_ACCEPTING the request is queued anyway and the acceptor
+/// stops taking new connections until the queue drains.
+///
+/// @param eventLoop The WsEventLoop the connection belongs to.
+/// @param wsConnection The WsConnection with the complete request.
+///
+/// @return This function returns no value.
+void wsEventLoopQueueWork(WsEventLoop *eventLoop, WsConnection *wsConnection) {
+  wsConnection->state = WS_CONNECTION_PROCESSING;
+  if (wsConnection->wsThreadInfo->traceBuffer != NULL) {
+    wsConnection->wsThreadInfo->queuedNs = traceNowNanoseconds();
+  }
+  
+  int status = wsWorkerPoolSubmit(eventLoop->workerPool,
+    wsEventLoopProcessConnection, wsEventLoopCancelConnection, wsConnection,
+    eventLoop->overloadPolicy == WS_OVERLOAD_STOP_ACCEPTING);
+  if (status != 0) {
+    if (status == -1) {
+      printLog(WARN, "Request queue full.  Rejecting request from %s.\n",
+        socketAddress(wsConnection->wsThreadInfo->clientSocket));
+      wsRejectConnection(wsConnection->wsThreadInfo->clientSocket,
+        "503 Service Unavailable", eventLoop->retryAfterSeconds,
+        wsConnection->wsThreadInfo->metrics);
+    }
+    wsConnection = wsConnectionDestroy(wsConnection);
+  }
+}
+
+/// @fn int wsReactorRead(WsConnection *wsConnection)
+///
+/// @brief Read all of the data that's currently available on a connection and
+/// determine whether or not a complete request has been received.  Data is
+/// read directly into the connection's receive buffer and only the
+/// newly-received data is parsed.  The connection's waitEvents are updated
+/// for the next read.
+///
+/// @param wsConnection The WsConnection to read from.
+///
+/// @return Returns 1 if a complete request has been received, 0 if more data
+/// is needed, and -1 if the connection was closed, had an error, or sent a
+/// malformed request.
+int wsReactorRead(WsConnection *wsConnection) {
+  Socket *clientSocket = wsConnection->wsThreadInfo->clientSocket;
+  
+  while (1) {
+    u64 bufferLength = bytesLength(wsConnection->receiveBuffer);
+    if (bytesAllocate(&wsConnection->receiveBuffer,
+      bufferLength + WS_RECEIVE_CHUNK_SIZE) == NULL
+    ) {
+      LOG_MALLOC_FAILURE();
+      return -1;
+    }
+    Bytes receiveBuffer = wsConnection->receiveBuffer;
+    int recvbufLen = socketReceiveAvailable(clientSocket,
+      receiveBuffer + bufferLength, WS_RECEIVE_CHUNK_SIZE,
+      &wsConnection->waitEvents);
+    if (recvbufLen < 0) {
+      // Orderly shutdown by the client or an error.
+      return -1;
+    } else if (recvbufLen == 0) {
+      // Everything that's available has been read.
+      break;
+    }
+    
+    bufferLength += (u64) recvbufLen;
+    bytesSetLength(receiveBuffer, bufferLength);
+    receiveBuffer[bufferLength] = '\0';
+  }
+  
+  return wsConnectionCheckRequest(wsConnection);
+}
+
+/// @fn int wsReactorHandshake(WsConnection *wsConnection)
+///
+/// @brief Advance the TLS handshake of a connection as far as the messages the
+/// client has sent so far allow.  Plain connections have no handshake.
+///
+/// @param wsConnection The WsConnection in WS_CONNECTION_HANDSHAKING state.
+///
+/// @return Returns 1 if the handshake is complete, 0 if the reactor must wait
+/// for the connection's waitEvents, and -1 if the handshake failed.
+int wsReactorHandshake(WsConnection *wsConnection) {
+#ifdef TLS_SOCKETS_ENABLED
+  Socket *clientSocket = wsConnection->wsThreadInfo->clientSocket;
+  TlsHandshakeState state = socketTlsHandshakeStep(clientSocket);
+  if (state == TLS_HANDSHAKE_WANT_READ) {
+    wsConnection->waitEvents = POLLIN;
+    return 0;
+  } else if (state == TLS_HANDSHAKE_WANT_WRITE) {
+    wsConnection->waitEvents = POLLOUT;
+    return 0;
+  } else if (state == TLS_HANDSHAKE_FAILED) {
+    printLog(DETAIL, "TLS handshake with %s failed.\n",
+      socketAddress(clientSocket));
+    return -1;
+  }
+#endif // TLS_SOCKETS_ENABLED
+  
+  wsConnection->state = WS_CONNECTION_READING;
+  wsConnection->waitEvents = POLLIN;
+  return 1;
+}
+
+/// @fn void wsReactorExpireConnections(WsReactor *reactor, i64 now)
+///
+/// @brief Close all of a reactor's connections that have not completed their
+/// TLS handshakes or delivered complete requests by their deadlines.
+///
+/// @param reactor The WsReactor to examine.
+/// @param now The current time in seconds since the epoch.
+///
+/// @return This function returns no value.
+void wsReactorExpireConnections(WsReactor *reactor, i64 now) {
+  WsConnection *expired = NULL;
+  
+  mtx_lock(&reactor->lock);
+  WsConnection *wsConnection = reactor->connections;
+  while (wsConnection != NULL) {
+    WsConnection *next = wsConnection->next;
+    if ((wsConnection->state != WS_CONNECTION_PROCESSING)
+      && (wsConnection->deadline < now)
+    ) {
+      // Move the connection from the reactor's list to the expired list.
+      if (wsConnection->prev != NULL) {
+        wsConnection->prev->next = next;
+      } else {
+        reactor->connections = next;
+      }
+      if (next != NULL) {
+        next->prev = wsConnection->prev;
+      }
+      wsConnection->prev = NULL;
+      wsConnection->next = expired;
+      expired = wsConnection;
+    }
+    wsConnection = next;
+  }
+  mtx_unlock(&reactor->lock);
+  
+  while (expired != NULL) {
+    WsConnection *next = expired->next;
+    printLog(DETAIL, "Request from %s timed out.\n",
+      socketAddress(expired->wsThreadInfo->clientSocket));
+    // The connection has already been unlinked, so don't use
+    // wsConnectionDestroy.
+    expired->wsThreadInfo = wsThreadInfoDestroy(expired->wsThreadInfo);
+    expired->receiveBuffer = bytesDestroy(expired->receiveBuffer);
+    expired = (WsConnection*) pointerDestroy(expired);
+    expired = next;
+  }
+}
+
+/// @fn int wsReactorThread(void *args)
+///
+/// @brief Main loop of a reactor thread.  Waits for data to become available
+/// on the reactor's connections, runs their TLS handshakes, reads requests,
+/// and hands complete requests off to the worker threads.
+///
+/// @param args A pointer to the WsReactor for this thread cast to a void*.
+///
+/// @return Returns 0 on success.  Any other value is an error.
+int wsReactorThread(void *args) {
+  WsReactor *reactor = (WsReactor*) args;
+  WsEventLoop *eventLoop = reactor->eventLoop;
+  WebService *webService = eventLoop->webService;
+  if ((webService != NULL) && (webService->registerThread != NULL)) {
+    webService->registerThread();
+  }
+  printLog(TRACE, "ENTER wsReactorThread(args=%p)\n", args);
+  
+  struct epoll_event events[WS_EVENT_LOOP_MAX_EVENTS];
+  i64 lastExpireCheck = (i64) time(NULL);
+  while (reactor->exitNow == false) {
+    int numEvents = epoll_wait(reactor->epollFd, events,
+      WS_EVENT_LOOP_MAX_EVENTS, 1000);
+    if ((numEvents < 0) && (errno != EINTR)) {
+      printLog(ERR, "epoll_wait failed: %s\n", strerror(errno));
+      break;
+    }
+  
+    for (int i = 0; i < numEvents; i++) {
+      WsConnection *wsConnection = (WsConnection*) events[i].data.ptr;
+      if (wsConnection == NULL) {
+        // This is the wakeFd.  reactor->exitNow has been set.
+        continue;
+      }
+      
+      // The client may send its first request right behind the end of the
+      // handshake, so read as soon as the handshake completes.
+      int status = 1;
+      if (wsConnection->state == WS_CONNECTION_HANDSHAKING) {
+        status = wsReactorHandshake(wsConnection);
+      }
+      if (status > 0) {
+        status = wsReactorRead(wsConnection);
+      }
+      if (status > 0) {
+        wsEventLoopQueueWork(eventLoop, wsConnection);
+      } else if ((status < 0)
+        || ((events[i].events & (EPOLLHUP | EPOLLERR)) != 0)
+      ) {
+        wsConnection = wsConnectionDestroy(wsConnection);
+      } else if (wsReactorArm(wsConnection, EPOLL_CTL_MOD) < 0) {
+        printLog(ERR, "Could not rearm client socket: %s\n", strerror(errno));
+        wsConnection = wsConnectionDestroy(wsConnection);
+      }
+    }
+    
+    i64 now = (i64) time(NULL);
+    if (now != lastExpireCheck) {
+      wsReactorExpireConnections(reactor, now);
+      lastExpireCheck = now;
+    }
+  }
+  wsArenaReleaseThreadChunks();
+  
+  printLog(TRACE, "EXIT wsReactorThread(args=%p) = {0}\n", args);
+  if ((webService != NULL) && (webService->unregisterThread != NULL)) {
+    webService->unregisterThread(NULL);
+  }
+  return 0;
+}
+
+/// @fn int wsEventLoopAddConnection(WsEventLoop *eventLoop, int *nextReactor, WsThreadInfo *wsThreadInfo)
+///
+/// @brief Give a newly-accepted client connection to one of the reactors.
+///
+/// @param eventLoop The WsEventLoop to add the connection to.
+/// @param nextReactor A pointer to the accepting listener's index of the
+///   reactor to give the next connection to.  Updated on return.
+/// @param wsThreadInfo The fully-populated WsThreadInfo for the connection.
+///   On success, ownership passes to the event loop.
+///
+/// @return Returns 0 on success, negative value on failure.  On failure, the
+/// caller retains ownership of wsThreadInfo.
+int wsEventLoopAddConnection(WsEventLoop *eventLoop, int *nextReactor,
+  WsThreadInfo *wsThreadInfo
+) {
+  WsConnection *wsConnection
+    = (WsConnection*) calloc(1, sizeof(WsConnection));
+  if (wsConnection == NULL) {
+    LOG_MALLOC_FAILURE();
+    return -1;
+  }
+  if (socketSetNonblocking(wsThreadInfo->clientSocket) != NO_ERROR) {
+    wsConnection = (WsConnection*) pointerDestroy(wsConnection);
+    return -2;
+  }
+  
+  // Each listener has its own nextReactor and only its accept thread touches
+  // it, so no lock is needed.
+  int reactorIndex = *nextReactor % eventLoop->numReactors;
+  WsReactor *reactor = &eventLoop->reactors[reactorIndex];
+  *nextReactor = (reactorIndex + 1) % eventLoop->numReactors;
+  wsConnection->wsThreadInfo = wsThreadInfo;
+  wsConnection->reactor = reactor;
+  wsConnection->state = WS_CONNECTION_READING;
+  wsConnection->waitEvents = POLLIN;
+  wsConnection->deadline = ((i64) time(NULL)) + WS_REQUEST_TIMEOUT_SECONDS;
+  if (wsThreadInfo->clientSocket->socketMode != PLAIN) {
+    // The handshake is run by the reactor so that it never ties up a worker
+    // waiting on a slow client.
+    wsConnection->state = WS_CONNECTION_HANDSHAKING;
+  }
+  
+  mtx_lock(&reactor->lock);
+  wsConnection->next = reactor->connections;
+  if (reactor->connections != NULL) {
+    reactor->connections->prev = wsConnection;
+  }
+  reactor->connections = wsConnection;
+  int returnValue = wsReactorArm(wsConnection, EPOLL_CTL_ADD);
+  if (returnValue < 0) {
+    printLog(ERR, "Could not add client socket to reactor: %s\n",
+      strerror(errno));
+    reactor->connections = wsConnection->next;
+    if (reactor->connections != NULL) {
+      reactor->connections->prev = NULL;
+    }
+  }
+  mtx_unlock(&reactor->lock);
+  
+  if (returnValue < 0) {
+    wsConnection = (WsConnection*) pointerDestroy(wsConnection);
+    return -3;
+  }
+  
+  return 0;
+}
+
+// Forward declaration.
+WsEventLoop* wsEventLoopDestroy(WsEventLoop *eventLoop);
+
+/// @fn WsEventLoop* wsEventLoopCreate(int numReactors, WsWorkerPool *workerPool, WsOverloadPolicy overloadPolicy, int retryAfterSeconds, WebService *webService)
+///
+/// @brief Create and start the reactor threads for a server running in
+/// WS_EVENT_LOOP mode.
+///
+/// @param numReactors The number of reactor threads to start.
+/// @param workerPool The server's (already started) WsWorkerPool that will
+///   process complete requests.
+/// @param overloadPolicy The WsOverloadPolicy to apply when workerPool's queue
+///   is full.
+/// @param retryAfterSeconds The value of the Retry-After header to send when
+///   rejecting requests.
+/// @param webService The WebService being served, if any.
+///
+/// @return Returns a pointer to a newly-allocated and running WsEventLoop on
+/// success, NULL on failure.
+WsEventLoop* wsEventLoopCreate(int numReactors, WsWorkerPool *workerPool,
+  WsOverloadPolicy overloadPolicy, int retryAfterSeconds,
+  WebService *webService
+) {
+  printLog(TRACE, "ENTER wsEventLoopCreate(numReactors=%d, workerPool=%p)\n",
+    numReactors, workerPool);
+  
+  WsEventLoop *eventLoop = (WsEventLoop*) calloc(1, sizeof(WsEventLoop));
+  if (eventLoop == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  eventLoop->workerPool = workerPool;
+  eventLoop->overloadPolicy = overloadPolicy;
+  eventLoop->retryAfterSeconds = retryAfterSeconds;
+  eventLoop->webService = webService;
+  
+  eventLoop->reactors = (WsReactor*) calloc(numReactors, sizeof(WsReactor));
+  if (eventLoop->reactors == NULL) {
+    LOG_MALLOC_FAILURE();
+    eventLoop = wsEventLoopDestroy(eventLoop);
+    return NULL;
+  }
+  
+  for (int i = 0; i < numReactors; i++) {
+    WsReactor *reactor = &eventLoop->reactors[i];
+    reactor->eventLoop = eventLoop;
+    reactor->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    reactor->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ZEROINIT(struct epoll_event event);
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if ((reactor->epollFd < 0) || (reactor->wakeFd < 0)
+      || (epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, reactor->wakeFd, &event)
+        < 0)
+    ) {
+      printLog(ERR, "Could not initialize reactor %d: %s\n",
+        i, strerror(errno));
+      // This reactor is not counted in numReactors, so clean it up here.
+      if (reactor->epollFd >= 0) {
+        close(reactor->epollFd);
+      }
+      if (reactor->wakeFd >= 0) {
+        close(reactor->wakeFd);
+      }
+      eventLoop = wsEventLoopDestroy(eventLoop);
+      return NULL;
+    }
+    
+    if (mtx_init(&reactor->lock, mtx_plain) != thrd_success) {
+      printLog(ERR, "Could not initialize mutex for reactor %d.\n", i);
+      close(reactor->epollFd);
+      close(reactor->wakeFd);
+      eventLoop = wsEventLoopDestroy(eventLoop);
+      return NULL;
+    }
+    
+    if (thrd_create(&reactor->threadId, wsReactorThread, reactor)
+      != thrd_success
+    ) {
+      printLog(ERR, "Could not start reactor thread %d.\n", i);
+      mtx_destroy(&reactor->lock);
+      close(reactor->epollFd);
+      close(reactor->wakeFd);
+      eventLoop = wsEventLoopDestroy(eventLoop);
+      return NULL;
+    }
+    eventLoop->numReactors++;
+  }
+  
+  printLog(TRACE,
+    "EXIT wsEventLoopCreate(numReactors=%d, workerPool=%p) = {%p}\n",
+    numReactors, workerPool, eventLoop);
+  return eventLoop;
+}
+
+/// @fn WsEventLoop* wsEventLoopDestroy(WsEventLoop *eventLoop)
+///
+/// @brief Stop the reactor threads of an event loop, close all of the
+/// connections it still owns, and free its resources.  The server's worker
+/// pool is stopped once the reactors have exited.  Requests that are being
+/// processed by worker threads are allowed to complete.
+///
+/// @param eventLoop The WsEventLoop to destroy.
+///
+/// @return This function always returns NULL.
+WsEventLoop* wsEventLoopDestroy(WsEventLoop *eventLoop) {
+  printLog(TRACE, "ENTER wsEventLoopDestroy(eventLoop=%p)\n", eventLoop);
+  
+  if (eventLoop == NULL) {
+    printLog(TRACE, "EXIT wsEventLoopDestroy(eventLoop=%p) = {NULL}\n",
+      eventLoop);
+    return NULL;
+  }
+  
+  // Stop the reactors so that no new work is generated.
+  for (int i = 0; i < eventLoop->numReactors; i++) {
+    WsReactor *reactor = &eventLoop->reactors[i];
+    reactor->exitNow = true;
+    u64 wake = 1;
+    if (write(reactor->wakeFd, &wake, sizeof(wake)) < 0) {
+      printLog(WARN, "Could not wake reactor %d.\n", i);
+    }
+    thrd_join(reactor->threadId, NULL);
+  }
+  
+  // Stop the workers.  Each one finishes the request it's processing, if any.
+  // Requests that are still queued are cancelled, which closes their
+  // connections.
+  wsWorkerPoolStop(eventLoop->workerPool);
+  
+  // Close everything that's left.  These are connections whose requests were
+  // still being read.
+  for (int i = 0; i < eventLoop->numReactors; i++) {
+    WsReactor *reactor = &eventLoop->reactors[i];
+    while (reactor->connections != NULL) {
+      wsConnectionDestroy(reactor->connections);
+    }
+    mtx_destroy(&reactor->lock);
+    close(reactor->epollFd);
+    close(reactor->wakeFd);
+  }
+  
+  eventLoop->reactors = (WsReactor*) pointerDestroy(eventLoop->reactors);
+  eventLoop = (WsEventLoop*) pointerDestroy(eventLoop);
+  
+  printLog(TRACE, "EXIT wsEventLoopDestroy(eventLoop=%p) = {NULL}\n",
+    eventLoop);
+  return NULL;
+}
+
+#else // not __linux__
+
+// WS_EVENT_LOOP mode is only supported on Linux.  Provide an opaque type and
+// stubs so that wsInit doesn't have to be littered with preprocessor
+// conditionals.  wsInit never creates an event loop on other platforms.
+typedef struct WsEventLoop WsEventLoop;
+#define wsEventLoopAddConnection(eventLoop, nextReactor, wsThreadInfo) (-1)
+#define wsEventLoopDestroy(eventLoop) ((WsEventLoop*) NULL)
+
+#endif // __linux__
+
+#ifdef __linux__
+
+/// @def WS_SCHEDULER_STACK_RESERVE_BYTES
+///
+/// @brief The part of a scheduler thread's stack that's set aside for the
+/// scheduler itself.  The rest of the stack holds the stacks of its
+/// coroutines.
+#define WS_SCHEDULER_STACK_RESERVE_BYTES (1024 * 1024)
+
+// Forward declarations.
+typedef struct WsScheduler WsScheduler;
+typedef struct WsCoroutinePool WsCoroutinePool;
+
+/// @struct WsCoroutineConnection
+///
+/// @brief A client connection that's being serviced by its own coroutine in
+/// WS_COROUTINES mode.
+///
+/// @param wsThreadInfo The WsThreadInfo of the connection.  Destroyed by the
+///   coroutine when it's done with the connection.
+/// @param scheduler The WsScheduler that runs the coroutine.
+/// @param coroutine The Coroutine that services the connection.
+/// @param registered Whether or not the client socket is in the scheduler's
+///   epoll set.
+/// @param ready Whether the coroutine was last resumed because its socket
+///   became ready (true) or because its wait timed out (false).
+/// @param deadline The absolute deadline in milliseconds on the monotonic
+///   clock of wsNowMicroseconds at which the coroutine's current wait times
+///   out, or -1 if it doesn't.
+/// @param prev The previous WsCoroutineConnection in the scheduler's list of
+///   waiting connections.
+/// @param next The next WsCoroutineConnection in the scheduler's list of
+///   waiting connections.
+typedef struct WsCoroutineConnection {
+  WsThreadInfo                 *wsThreadInfo;
+  WsScheduler                  *scheduler;
+  Coroutine                    *coroutine;
+  bool                          registered;
+  bool                          ready;
+  i64                           deadline;
+  struct WsCoroutineConnection *prev;
+  struct WsCoroutineConnection *next;
+} WsCoroutineConnection;
+
+/// @struct WsScheduler
+///
+/// @brief A thread that runs the coroutines of a set of client connections and
+/// resumes each one when its socket is ready.
+///
+/// @param epollFd The epoll file descriptor for the scheduler's sockets.
+/// @param wakeFd An eventfd used to interrupt epoll_wait when the scheduler is
+///   given new connections or the server is shutting down.
+/// @param threadId The ID of the scheduler's thread.
+/// @param lock A mutex to protect pending, numPending, and numConnections.
+/// @param idle The condition signalled when numConnections drops to zero.
+/// @param pending The WsThreadInfos of the connections that have been given to
+///   the scheduler but don't have coroutines yet.
+/// @param numPending The number of elements in pending.
+/// @param starting The scheduler thread's copy of pending while it creates
+///   the coroutines for them.
+/// @param numConnections The number of connections the scheduler owns,
+///   including the pending ones.
+/// @param waiting The head of the list of connections whose coroutines are
+///   waiting on their sockets.  Only touched by the scheduler thread.
+/// @param nextDeadline The earliest deadline of the connections in waiting,
+///   or -1 if none of them has one.
+/// @param ready The list of deferred responses that were finished while a
+///   coroutine was parked on them.  Protected by lock.
+/// @param coroutinePool The WsCoroutinePool the scheduler belongs to.
+/// @param draining Whether or not the server is shutting down.
+/// @param exitNow Whether or not the scheduler thread should exit once all of
+///   its connections are closed.
+typedef struct WsScheduler {
+  int                    epollFd;
+  int                    wakeFd;
+  pthread_t              threadId;
+  mtx_t                  lock;
+  cnd_t                  idle;
+  WsThreadInfo         **pending;
+  int                    numPending;
+  WsThreadInfo         **starting;
+  int                    numConnections;
+  WsCoroutineConnection *waiting;
+  i64                    nextDeadline;
+  WsPendingResponse     *ready;
+  WsCoroutinePool       *coroutinePool;
+  bool                   draining;
+  bool                   exitNow;
+} WsScheduler;
+
+/// @struct WsCoroutinePool
+///
+/// @brief The scheduler threads for a server running in WS_COROUTINES mode.
+///
+/// @param schedulers The array of WsSchedulers.
+/// @param numSchedulers The number of elements in schedulers.
+/// @param stackSize The size, in bytes, of each coroutine's stack.
+/// @param maxConnections The maximum number of connections each scheduler
+///   may own.
+/// @param webService The WebService being served, if any.
+typedef struct WsCoroutinePool {
+  WsScheduler *schedulers;
+  int          numSchedulers;
+  int          stackSize;
+  int          maxConnections;
+  WebService  *webService;
+} WsCoroutinePool;
+
+/// @fn void wsSchedulerAddWaiting(WsScheduler *scheduler, WsCoroutineConnection *connection)
+///
+/// @brief Add a connection to the front of a scheduler's list of waiting
+/// connections.
+///
+/// @param scheduler The WsScheduler that runs the connection's coroutine.
+/// @param connection The WsCoroutineConnection that's about to wait.
+///
+/// @return This function returns no value.
+void wsSchedulerAddWaiting(WsScheduler *scheduler,
+  WsCoroutineConnection *connection
+) {
+  connection->prev = NULL;
+  connection->next = scheduler->waiting;
+  if (scheduler->waiting != NULL) {
+    scheduler->waiting->prev = connection;
+  }
+  scheduler->waiting = connection;
+  
+  if ((connection->deadline >= 0)
+    && ((scheduler->nextDeadline < 0)
+      || (connection->deadline < scheduler->nextDeadline))
+  ) {
+    scheduler->nextDeadline = connection->deadline;
   }
-  
-  printLog(TRACE, "EXIT getMimeType(fileExtension=\"%s\") = {%s}",
-    fileExtension, mimeType);
-  return mimeType;
 }
 
-/// @fn Bytes wsGetFile(WsThreadInfo *wsThreadInfo, const char *path, const char *targetNamespace, Bytes *header)
+/// @fn void wsSchedulerRemoveWaiting(WsScheduler *scheduler, WsCoroutineConnection *connection)
 ///
-/// @brief Get the contents of a file requested by the client.  Support function
-/// for handleGetRequest.
+/// @brief Remove a connection from a scheduler's list of waiting connections.
+/// scheduler->nextDeadline is left alone.  At worst, the scheduler wakes up
+/// once for nothing.
 ///
-/// @param wsThreadInfo The WsThreadInfo structure for the
-///   connection.
-/// @param path The path of the file (relative to
-///   wsThreadInfo->interfacePath) to return.
-/// @param targetNamespace The wsNamespace to use if the client is requesting
-///   a WSDL or XSD.
-/// @param header Output parameter containing the HTTP header for the file.
+/// @param scheduler The WsScheduler that runs the connection's coroutine.
+/// @param connection The WsCoroutineConnection to remove.
 ///
-/// @return Returns a Bytes object of the contents of the file.
-Bytes wsGetFile(WsThreadInfo *wsThreadInfo,
-  const char *path, const char *targetNamespace, Bytes *header
+/// @return This function returns no value.
+void wsSchedulerRemoveWaiting(WsScheduler *scheduler,
+  WsCoroutineConnection *connection
 ) {
-  char *fullPath = NULL;
+  if (connection->prev != NULL) {
+    connection->prev->next = connection->next;
+  } else {
+    scheduler->waiting = connection->next;
+  }
+  if (connection->next != NULL) {
+    connection->next->prev = connection->prev;
+  }
+  connection->prev = NULL;
+  connection->next = NULL;
+}
+
+/// @fn int wsCoroutineWait(Socket *sock, short events, int timeoutMilliseconds)
+///
+/// @brief The SocketWaitFunction of client sockets in WS_COROUTINES mode.
+/// Registers interest in the socket with the scheduler and yields until the
+/// socket is ready or the timeout passes.  Must only be called from the
+/// connection's coroutine.
+///
+/// @param sock The client Socket to wait on.  sock->waitContext is the
+///   connection's WsCoroutineConnection.
+/// @param events The events to wait for (POLLIN, POLLOUT, or both).
+/// @param timeoutMilliseconds The maximum number of milliseconds to wait.  -1
+///   waits indefinitely.
+///
+/// @return Returns 1 when the socket is ready, 0 if the timeout passed first,
+/// and -1 on error.
+int wsCoroutineWait(Socket *sock, short events, int timeoutMilliseconds) {
+  WsCoroutineConnection *connection
+    = (WsCoroutineConnection*) sock->waitContext;
+  WsScheduler *scheduler = connection->scheduler;
+  if ((scheduler->draining == true)
+    && (timeoutMilliseconds > WS_RECEIVE_SLICE_MILLISECONDS)
+  ) {
+    // Waits with a timeout are waits for requests.  Keep them short once the
+    // server is shutting down so that idle connections notice.
+    timeoutMilliseconds = WS_RECEIVE_SLICE_MILLISECONDS;
+  }
   
-  Bytes outputBytes = NULL;
+  ZEROINIT(struct epoll_event event);
+  event.events = EPOLLONESHOT;
+  if ((events & POLLIN) != 0) {
+    event.events |= EPOLLIN | EPOLLRDHUP;
+  }
+  if ((events & POLLOUT) != 0) {
+    event.events |= EPOLLOUT;
+  }
+  event.data.ptr = connection;
+  int operation
+    = (connection->registered == true) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(scheduler->epollFd, operation, sock->sockfd, &event) < 0) {
+    printLog(ERR, "Could not wait on client socket: %s\n", strerror(errno));
+    return -1;
+  }
+  connection->registered = true;
+  connection->ready = false;
+  connection->deadline = -1;
+  if (timeoutMilliseconds >= 0) {
+    connection->deadline = ((i64) (wsNowMicroseconds() / 1000))
+      + timeoutMilliseconds;
+  }
   
-  printLog(TRACE, "ENTER wsGetFile(path=\"%s\")\n", path);
-  printLog(DETAIL, "Processing request to GET \"%s\".\n", path);
+  wsSchedulerAddWaiting(scheduler, connection);
+  // Other coroutines run on this thread in the meantime.
+  TraceContext *traceContext = traceCurrentContext;
+  coroutineYield(NULL, COROUTINE_STATE_BLOCKED);
+  traceCurrentContext = traceContext;
+  // The scheduler removed the connection from its waiting list before
+  // resuming us.
   
-  if (strstr(path, "../")) {
-    printLog(ERR, "Attempt to get relative path.\n");
-    printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n",
-      path, outputBytes);
-    return outputBytes;
+  if (connection->ready == false) {
+    // Disarm the socket so that a late event can't resume the coroutine while
+    // it's doing something else.
+    epoll_ctl(scheduler->epollFd, EPOLL_CTL_DEL, sock->sockfd, NULL);
+    connection->registered = false;
+    return 0;
   }
   
-  // Correct the path so that we get the correct file.
-  printLog(DEBUG, "interfacePath = \"%s\"\n",
-    wsThreadInfo->interfacePath);
-  straddstr(&fullPath, wsThreadInfo->interfacePath);
-  printLog(DEBUG, "path = \"%s\"\n", path);
-  printLog(DEBUG, "Got the base path.\n");
-  straddstr(&fullPath, path);
-  // See if we should really be returning index.html.
-  if (path[strlen(path) - 1] == '/') {
-    // Request was for a directory.
-    straddstr(&fullPath, "index.html");
+  return 1;
+}
+
+/// @fn void wsSchedulerWake(WsScheduler *scheduler)
+///
+/// @brief Interrupt a scheduler thread's epoll_wait.
+///
+/// @param scheduler The WsScheduler to wake.
+///
+/// @return This function returns no value.
+void wsSchedulerWake(WsScheduler *scheduler) {
+  u64 wake = 1;
+  if (write(scheduler->wakeFd, &wake, sizeof(wake)) < 0) {
+    printLog(WARN, "Could not wake scheduler: %s\n", strerror(errno));
   }
-  printLog(DEBUG, "Determined if path should be index.html.\n");
-  printLog(DEBUG, "fullPath = \"%s\"\n", fullPath);
-  FILE *fullPathFile = fopen(fullPath, "r");
-  if (fullPathFile == NULL) {
-    printLog(DEBUG, "Could not open \"%s\".\n", fullPath);
-    // Try once more with "/index.html" appended.
-    straddstr(&fullPath, "/index.html");
-    printLog(DEBUG, "Attempting to open \"%s\".", fullPath);
-    fullPathFile = fopen(fullPath, "r");
-    if (fullPathFile == NULL) {
-      // File not found on disk.  Return nothing.
-      fullPath = stringDestroy(fullPath);
-      printLog(ERR, "File not found.\n");
-      printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n",
-        path, outputBytes);
-      return outputBytes;
-    } else {
-      printLog(DEBUG, "Successfully opened \"%s\".", fullPath);
-      // Reset fullPath for the code below.
-      fullPath = stringDestroy(fullPath);
-      straddstr(&fullPath, path);
+}
+
+/// @fn int wsCoroutineWaitPending(Socket *sock, WsPendingResponse *pendingResponse)
+///
+/// @brief Park a connection's coroutine until a deferred response is finished
+/// or its deadline passes.  Nothing is registered with epoll, so the scheduler
+/// holds nothing for the connection but its place in the waiting list.  Must
+/// only be called from the connection's coroutine with the lock of
+/// pendingResponse held.  The lock is held again on return.
+///
+/// @param sock The client Socket of the connection.  sock->waitContext is the
+///   connection's WsCoroutineConnection.
+/// @param pendingResponse The WsPendingResponse to wait for.
+///
+/// @return Returns 1 if the coroutine was resumed because the response was
+/// finished, 0 if it was resumed because its deadline passed or the server
+/// started shutting down.
+int wsCoroutineWaitPending(Socket *sock, WsPendingResponse *pendingResponse) {
+  WsCoroutineConnection *connection
+    = (WsCoroutineConnection*) sock->waitContext;
+  pendingResponse->waitContext = connection;
+  mtx_unlock(&pendingResponse->lock);
+  
+  connection->ready = false;
+  connection->deadline = pendingResponse->deadline;
+  wsSchedulerAddWaiting(connection->scheduler, connection);
+  TraceContext *traceContext = traceCurrentContext;
+  coroutineYield(NULL, COROUTINE_STATE_BLOCKED);
+  traceCurrentContext = traceContext;
+  
+  mtx_lock(&pendingResponse->lock);
+  pendingResponse->waitContext = NULL;
+  return (connection->ready == true) ? 1 : 0;
+}
+
+/// @fn void wsCoroutineWakePending(WsPendingResponse *pendingResponse)
+///
+/// @brief Have the scheduler of the coroutine that's parked on a deferred
+/// response resume it.  May be called from any thread with the lock of
+/// pendingResponse held.
+///
+/// @param pendingResponse The WsPendingResponse that was just finished.
+///
+/// @return This function returns no value.
+void wsCoroutineWakePending(WsPendingResponse *pendingResponse) {
+  WsCoroutineConnection *connection
+    = (WsCoroutineConnection*) pendingResponse->waitContext;
+  WsScheduler *scheduler = connection->scheduler;
+  
+  // The scheduler holds a reference until it's done with the response.
+  pendingResponse->referenceCount++;
+  mtx_lock(&scheduler->lock);
+  pendingResponse->nextReady = scheduler->ready;
+  scheduler->ready = pendingResponse;
+  mtx_unlock(&scheduler->lock);
+  wsSchedulerWake(scheduler);
+}
+
+// Forward declaration.
+WsPendingResponse* wsPendingResponseRelease(
+  WsPendingResponse *pendingResponse);
+  
+/// @fn void wsSchedulerResumeReady(WsScheduler *scheduler)
+///
+/// @brief Resume the coroutines whose deferred responses have been finished.
+///
+/// @param scheduler The WsScheduler to check.
+///
+/// @return This function returns no value.
+void wsSchedulerResumeReady(WsScheduler *scheduler) {
+  mtx_lock(&scheduler->lock);
+  WsPendingResponse *ready = scheduler->ready;
+  scheduler->ready = NULL;
+  mtx_unlock(&scheduler->lock);
+  
+  while (ready != NULL) {
+    WsPendingResponse *pendingResponse = ready;
+    ready = ready->nextReady;
+    
+    // Only this thread resumes the coroutine, so if it's still parked here, it
+    // stays parked until it's resumed below.  If its deadline passed first,
+    // it has already moved on.
+    mtx_lock(&pendingResponse->lock);
+    WsCoroutineConnection *connection
+      = (WsCoroutineConnection*) pendingResponse->waitContext;
+    mtx_unlock(&pendingResponse->lock);
+    if (connection != NULL) {
+      wsSchedulerRemoveWaiting(scheduler, connection);
+      connection->ready = true;
+      coroutineResume(connection->coroutine, NULL);
     }
+    pendingResponse = wsPendingResponseRelease(pendingResponse);
   }
-  fclose(fullPathFile);
-  printLog(DEBUG, "File check complete.\n");
+}
+
+/// @fn void wsSchedulerConnectionClosed(WsScheduler *scheduler)
+///
+/// @brief Account for one of a scheduler's connections having been closed and
+/// wake anything draining the scheduler once the last one is gone.
+///
+/// @param scheduler The WsScheduler that owned the connection.
+///
+/// @return This function returns no value.
+void wsSchedulerConnectionClosed(WsScheduler *scheduler) {
+  mtx_lock(&scheduler->lock);
+  scheduler->numConnections--;
+  if (scheduler->numConnections == 0) {
+    cnd_broadcast(&scheduler->idle);
+  }
+  mtx_unlock(&scheduler->lock);
+}
+
+/// @fn void* wsCoroutineConnectionMain(void *args)
+///
+/// @brief Entry point of the coroutine that services a client connection.
+/// Runs the connection exactly as a connection thread would, with the client
+/// socket yielding to the scheduler whenever it would block.
+///
+/// @param args The connection's WsCoroutineConnection cast to a void*.
+///
+/// @return This function always returns NULL.
+void* wsCoroutineConnectionMain(void *args) {
+  WsCoroutineConnection *connection = (WsCoroutineConnection*) args;
+  WsScheduler *scheduler = connection->scheduler;
+  WsThreadInfo *wsThreadInfo = connection->wsThreadInfo;
   
-  // Determine content type.
-  char *fileExtension =  strrchr(fullPath, '.');
-  const char *mimeType = getMimeType(fileExtension);
-  bytesAddStr(header, "Content-type: ");
-  bytesAddStr(header, mimeType);
-  bytesAddStr(header, "\r\n");
-  printLog(DEBUG, "Determined Content-type: %s\n", mimeType);
+  if (socketSetWaitFunction(wsThreadInfo->clientSocket,
+    wsCoroutineWait, connection) == 0
+  ) {
+    wsConnectionThread(wsThreadInfo);
+  } else {
+    printLog(ERR, "Could not hand connection to %s to its coroutine.\n",
+      socketAddress(wsThreadInfo->clientSocket));
+    wsThreadInfo = wsThreadInfoDestroy(wsThreadInfo);
+  }
+  connection = (WsCoroutineConnection*) pointerDestroy(connection);
+  wsSchedulerConnectionClosed(scheduler);
   
-  // Get the file content.
-  Bytes fileContent = getFileContent(fullPath);
-  printLog(DEBUG, "Got file content for \"%s\".\n", fullPath);
-  u64 fileLength = bytesLength(fileContent);
-  printLog(DEBUG, "fileLength = %llu\n", llu(fileLength));
-  bytesAddData(&fileContent, "", 1);
-  printLog(DEBUG, "Added NUL terminator to fileContent.\n");
+  return NULL;
+}
+
+/// @fn void wsSchedulerStartConnections(WsScheduler *scheduler, bool configured)
+///
+/// @brief Create and start a coroutine for each connection that's been given
+/// to a scheduler since the last call.
+///
+/// @param scheduler The WsScheduler to start the connections on.
+/// @param configured Whether or not coroutines were successfully configured
+///   for the scheduler thread.  If not, the connections are just closed.
+///
+/// @return This function returns no value.
+void wsSchedulerStartConnections(WsScheduler *scheduler, bool configured) {
+  mtx_lock(&scheduler->lock);
+  int numStarting = scheduler->numPending;
+  memcpy(scheduler->starting, scheduler->pending,
+    numStarting * sizeof(WsThreadInfo*));
+  scheduler->numPending = 0;
+  mtx_unlock(&scheduler->lock);
   
-  // Adjust for WSDL material
-  if ((fileExtension != NULL)
-    && ((strcmp(fileExtension, ".xsd") == 0)
-      || (strcmp(fileExtension, ".wsdl") == 0)
-    )
-  ) {
-    Bytes newContent
-      = bytesReplaceStr(fileContent, "<<TARGET_NAMESPACE>>",
-      targetNamespace);
-    if (fileContent != NULL) {
-      fileContent = bytesDestroy(fileContent);
+  for (int i = 0; i < numStarting; i++) {
+    WsThreadInfo *wsThreadInfo = scheduler->starting[i];
+    WsCoroutineConnection *connection = NULL;
+    if (configured == true) {
+      connection = (WsCoroutineConnection*) calloc(1,
+        sizeof(WsCoroutineConnection));
+      if (connection == NULL) {
+        LOG_MALLOC_FAILURE();
+      }
     }
-    fileContent = newContent;
-    if (fileContent != NULL) {
-      fileLength = bytesLength(fileContent);
-    } else {
-      fileLength = 0;
+    if (connection != NULL) {
+      connection->wsThreadInfo = wsThreadInfo;
+      connection->scheduler = scheduler;
+      connection->deadline = -1;
+      if (coroutineCreate(&connection->coroutine, wsCoroutineConnectionMain,
+        connection) == coroutineSuccess
+      ) {
+        // The coroutine owns the connection now.  Run it until it first has
+        // to wait.
+        coroutineResume(connection->coroutine, NULL);
+        continue;
+      }
+      printLog(ERR, "Could not create coroutine for connection to %s.\n",
+        socketAddress(wsThreadInfo->clientSocket));
+      connection = (WsCoroutineConnection*) pointerDestroy(connection);
+    }
+    
+    wsThreadInfo = wsThreadInfoDestroy(wsThreadInfo);
+    wsSchedulerConnectionClosed(scheduler);
+  }
+}
+
+/// @fn void wsSchedulerExpireWaits(WsScheduler *scheduler, i64 now, bool all)
+///
+/// @brief Resume the coroutines whose waits have timed out.
+///
+/// @param scheduler The WsScheduler to check.
+/// @param now The current time in milliseconds on the monotonic clock of
+///   wsNowMicroseconds.
+/// @param all Whether to time out every wait that has a timeout, regardless of
+///   its deadline.  Used when the server starts shutting down.
+///
+/// @return This function returns no value.
+void wsSchedulerExpireWaits(WsScheduler *scheduler, i64 now, bool all) {
+  // Pull the expired connections off of the waiting list before resuming any
+  // of them.  A resumed coroutine may add itself back to the list.
+  WsCoroutineConnection *expired = NULL;
+  scheduler->nextDeadline = -1;
+  WsCoroutineConnection *connection = scheduler->waiting;
+  while (connection != NULL) {
+    WsCoroutineConnection *next = connection->next;
+    if ((connection->deadline >= 0)
+      && ((all == true) || (connection->deadline <= now))
+    ) {
+      wsSchedulerRemoveWaiting(scheduler, connection);
+      connection->next = expired;
+      expired = connection;
+    } else if ((connection->deadline >= 0)
+      && ((scheduler->nextDeadline < 0)
+        || (connection->deadline < scheduler->nextDeadline))
+    ) {
+      scheduler->nextDeadline = connection->deadline;
     }
+    connection = next;
   }
   
-  // Adjust for directory get
-  if ((fileLength == 0) && (path[strlen(path) - 1] != '/')) {
-    printLog(DEBUG, "Checking to see if %s is a directory.", path);
-    fullPath = stringDestroy(fullPath);
-    straddstr(&fullPath, wsThreadInfo->interfacePath);
-    straddstr(&fullPath, path);
-    straddstr(&fullPath, "/index.html");
-    fullPathFile = fopen(fullPath, "r");
-    if (fullPathFile != NULL) {
-      fclose(fullPathFile);
+  while (expired != NULL) {
+    connection = expired;
+    expired = expired->next;
+    connection->next = NULL;
+    connection->ready = false;
+    coroutineResume(connection->coroutine, NULL);
+  }
+}
+
+/// @fn void* wsSchedulerThread(void *args)
+///
+/// @brief Main loop of a scheduler thread.  Starts a coroutine for each new
+/// connection and resumes each coroutine when its socket is ready or its wait
+/// times out.  Exits once the server is shutting down and all of the
+/// scheduler's connections are closed.
+///
+/// @param args A pointer to the WsScheduler for this thread cast to a void*.
+///
+/// @return This function always returns NULL.
+void* wsSchedulerThread(void *args) {
+  WsScheduler *scheduler = (WsScheduler*) args;
+  WsCoroutinePool *coroutinePool = scheduler->coroutinePool;
+  WebService *webService = coroutinePool->webService;
+  if ((webService != NULL) && (webService->registerThread != NULL)) {
+    webService->registerThread();
+  }
+  printLog(TRACE, "ENTER wsSchedulerThread(args=%p)\n", args);
+  
+  // The coroutines' stacks are carved out of this thread's stack, below this
+  // frame.
+  ZEROINIT(Coroutine first);
+  ZEROINIT(CoroutinesConfigOptions options);
+  options.stackSize = (uintptr_t) coroutinePool->stackSize;
+  bool configured
+    = (coroutinesConfig(&first, &options) == coroutineSuccess);
+  if (configured == false) {
+    printLog(ERR, "Could not configure coroutines.  Connections given to this "
+      "scheduler will be closed.\n");
+  }
+  
+  struct epoll_event events[WS_EVENT_LOOP_MAX_EVENTS];
+  bool draining = false;
+  while (1) {
+    mtx_lock(&scheduler->lock);
+    bool done = (scheduler->exitNow == true)
+      && (scheduler->numConnections == 0);
+    mtx_unlock(&scheduler->lock);
+    if (done == true) {
+      break;
+    }
+    
+    int timeout = 1000;
+    if (scheduler->nextDeadline >= 0) {
+      i64 untilDeadline
+        = scheduler->nextDeadline - ((i64) (wsNowMicroseconds() / 1000));
+      if (untilDeadline < 0) {
+        untilDeadline = 0;
+      }
+      if (untilDeadline < timeout) {
+        timeout = (int) untilDeadline;
+      }
+    }
+    int numEvents = epoll_wait(scheduler->epollFd, events,
+      WS_EVENT_LOOP_MAX_EVENTS, timeout);
+    if ((numEvents < 0) && (errno != EINTR)) {
+      printLog(ERR, "epoll_wait failed: %s\n", strerror(errno));
+      break;
+    }
+    
+    for (int i = 0; i < numEvents; i++) {
+      WsCoroutineConnection *connection
+        = (WsCoroutineConnection*) events[i].data.ptr;
+      if (connection == NULL) {
+        // This is the wakeFd.  Reset it.
+        u64 wake = 0;
+        if (read(scheduler->wakeFd, &wake, sizeof(wake)) < 0) {
+          // Nothing to do.  Another wake-up raced this one.
+        }
+        continue;
+      }
       
-      // Requested file is actually a directory.  Tell the client to request
-      // this properly by adding a trailing '/' to the request.
-      // fileContent was never initialized in this case so we're free to use it
-      bytesAddStr(header, "Content-Type: text/html\r\n");
+      wsSchedulerRemoveWaiting(scheduler, connection);
+      connection->ready = true;
+      coroutineResume(connection->coroutine, NULL);
+    }
+    
+    wsSchedulerResumeReady(scheduler);
+    wsSchedulerStartConnections(scheduler, configured);
+    
+    if ((scheduler->draining == true) && (draining == false)) {
+      // Wake up everything that's waiting for a request so that idle
+      // connections see that the server is shutting down.
+      draining = true;
+      wsSchedulerExpireWaits(scheduler,
+        (i64) (wsNowMicroseconds() / 1000), true);
+    } else if (scheduler->nextDeadline >= 0) {
+      i64 now = (i64) (wsNowMicroseconds() / 1000);
+      if (scheduler->nextDeadline <= now) {
+        wsSchedulerExpireWaits(scheduler, now, false);
+      }
+    }
+  }
+  // Drop the references to any responses that were finished after their
+  // coroutines stopped waiting for them.
+  wsSchedulerResumeReady(scheduler);
+  wsArenaReleaseThreadChunks();
+  
+  printLog(TRACE, "EXIT wsSchedulerThread(args=%p) = {NULL}\n", args);
+  if ((webService != NULL) && (webService->unregisterThread != NULL)) {
+    webService->unregisterThread(NULL);
+  }
+  return NULL;
+}
+
+/// @fn int wsCoroutinePoolAddConnection(WsCoroutinePool *coroutinePool, int *nextScheduler, WsThreadInfo *wsThreadInfo)
+///
+/// @brief Give a newly-accepted client connection to one of the schedulers.
+/// If the next scheduler already owns its maximum number of connections, the
+/// ones after it are tried.
+///
+/// @param coroutinePool The WsCoroutinePool to add the connection to.
+/// @param nextScheduler A pointer to the accepting listener's index of the
+///   scheduler to give the next connection to.  Updated on return.
+/// @param wsThreadInfo The fully-populated WsThreadInfo for the connection.
+///   On success, ownership passes to the coroutine pool.
+///
+/// @return Returns 0 on success, -1 if every scheduler is full.  On failure,
+/// the caller retains ownership of wsThreadInfo.
+int wsCoroutinePoolAddConnection(WsCoroutinePool *coroutinePool,
+  int *nextScheduler, WsThreadInfo *wsThreadInfo
+) {
+  int numSchedulers = coroutinePool->numSchedulers;
+  for (int i = 0; i < numSchedulers; i++) {
+    // Each listener has its own nextScheduler and only its accept thread
+    // touches it, so no lock is needed.
+    int schedulerIndex = (*nextScheduler + i) % numSchedulers;
+    WsScheduler *scheduler = &coroutinePool->schedulers[schedulerIndex];
+    
+    mtx_lock(&scheduler->lock);
+    bool accepted
+      = (scheduler->numConnections < coroutinePool->maxConnections);
+    if (accepted == true) {
+      scheduler->pending[scheduler->numPending] = wsThreadInfo;
+      scheduler->numPending++;
+      scheduler->numConnections++;
+    }
+    mtx_unlock(&scheduler->lock);
+    
+    if (accepted == true) {
+      *nextScheduler = (schedulerIndex + 1) % numSchedulers;
+      wsSchedulerWake(scheduler);
+      return 0;
+    }
+  }
+  
+  return -1;
+}
+
+/// @fn int wsCoroutinePoolDrain(WsCoroutinePool *coroutinePool, const struct timespec *deadline)
+///
+/// @brief Tell the schedulers that the server is shutting down and wait for
+/// their connections to close.  Idle persistent connections close right away.
+/// Requests that are in progress get until the deadline to complete.
+///
+/// @param coroutinePool The WsCoroutinePool to drain.
+/// @param deadline The wsMonotonicTime time to wait until.
+///
+/// @return Returns 0 if every connection closed, -1 if the deadline passed
+/// first.
+int wsCoroutinePoolDrain(WsCoroutinePool *coroutinePool,
+  const struct timespec *deadline
+) {
+  for (int i = 0; i < coroutinePool->numSchedulers; i++) {
+    coroutinePool->schedulers[i].draining = true;
+    wsSchedulerWake(&coroutinePool->schedulers[i]);
+  }
+  
+  // Wait for each scheduler in turn.  The deadline is shared, so waiting on
+  // one scheduler doesn't extend the time the others get.
+  int returnValue = 0;
+  for (int i = 0; (i < coroutinePool->numSchedulers) && (returnValue == 0);
+    i++
+  ) {
+    WsScheduler *scheduler = &coroutinePool->schedulers[i];
+    mtx_lock(&scheduler->lock);
+    while (scheduler->numConnections > 0) {
+      struct timespec now;
+      wsMonotonicTime(&now);
+      i64 remainingNs
+        = (((i64) deadline->tv_sec - (i64) now.tv_sec) * 1000000000)
+        + ((i64) deadline->tv_nsec - (i64) now.tv_nsec);
+      if (remainingNs <= 0) {
+        returnValue = -1;
+        break;
+      }
       
-      bytesAddStr(&fileContent,
-        " <html> <head> <meta http-equiv=\"refresh\" content=\"0;URL='");
-      bytesAddStr(&fileContent, path);
-      bytesAddStr(&fileContent, "/"); // Trailing '/' character on path
-      bytesAddStr(&fileContent, "'\" /> </head> </html> ");
-      fileLength = bytesLength(fileContent);
+      // cnd_timedwait only takes a TIME_UTC time, so wait in short slices to
+      // keep a change to the time of day from stretching the wait.
+      if (remainingNs > 100000000) {
+        remainingNs = 100000000;
+      }
+      struct timespec until;
+      timespec_get(&until, TIME_UTC);
+      until.tv_nsec += (long) remainingNs;
+      if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+      }
+      cnd_timedwait(&scheduler->idle, &scheduler->lock, &until);
     }
+    mtx_unlock(&scheduler->lock);
+  }
+  
+  return returnValue;
+}
+
+// Forward declaration.
+WsCoroutinePool* wsCoroutinePoolDestroy(WsCoroutinePool *coroutinePool);
+
+/// @fn WsCoroutinePool* wsCoroutinePoolCreate(int numSchedulers, int stackSize, int maxConnections, WebService *webService)
+///
+/// @brief Create and start the scheduler threads for a server running in
+/// WS_COROUTINES mode.
+///
+/// @param numSchedulers The number of scheduler threads to start.
+/// @param stackSize The size, in bytes, of each coroutine's stack.
+/// @param maxConnections The maximum number of connections each scheduler
+///   may own.  Each scheduler thread's stack is made large enough to hold
+///   this many coroutine stacks.
+/// @param webService The WebService being served, if any.
+///
+/// @return Returns a pointer to a newly-allocated and running WsCoroutinePool
+/// on success, NULL on failure.
+WsCoroutinePool* wsCoroutinePoolCreate(int numSchedulers, int stackSize,
+  int maxConnections, WebService *webService
+) {
+  printLog(TRACE, "ENTER wsCoroutinePoolCreate(numSchedulers=%d, "
+    "stackSize=%d, maxConnections=%d)\n",
+    numSchedulers, stackSize, maxConnections);
+  
+  WsCoroutinePool *coroutinePool
+    = (WsCoroutinePool*) calloc(1, sizeof(WsCoroutinePool));
+  if (coroutinePool == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  coroutinePool->stackSize = stackSize;
+  coroutinePool->maxConnections = maxConnections;
+  coroutinePool->webService = webService;
+  
+  coroutinePool->schedulers
+    = (WsScheduler*) calloc(numSchedulers, sizeof(WsScheduler));
+  if (coroutinePool->schedulers == NULL) {
+    LOG_MALLOC_FAILURE();
+    coroutinePool = wsCoroutinePoolDestroy(coroutinePool);
+    return NULL;
   }
   
-  Bytes contentLength = NULL;
-  printLog(DEBUG, "Allocating contentLength.\n");
-  abprintf(&contentLength, "Content-Length: %llu\r\n", llu(fileLength));
-  printLog(DEBUG, "contentLength = \"%s\".\n", contentLength);
+  // The schedulers run on different threads.
+  coroutineSetThreadingSupportEnabled(true);
   
-  // Create the output string.
-  bytesAddBytes(header, contentLength);
-  contentLength = bytesDestroy(contentLength);
-  outputBytes = fileContent;
-  fullPath = stringDestroy(fullPath);
-  printLog(DEBUG, "outputBytes fully allocated.  Exiting.\n");
+  // Room for every coroutine, the spare one the coroutine library keeps ready,
+  // and the scheduler itself.  Rounded up to a whole number of pages.
+  size_t threadStackSize = (((size_t) stackSize) * (maxConnections + 2))
+    + WS_SCHEDULER_STACK_RESERVE_BYTES;
+  threadStackSize = (threadStackSize + 4095) & ~((size_t) 4095);
   
-  printLog(TRACE, "EXIT wsGetFile(path=\"%s\") = {%p}\n", path, outputBytes);
+  for (int i = 0; i < numSchedulers; i++) {
+    WsScheduler *scheduler = &coroutinePool->schedulers[i];
+    scheduler->coroutinePool = coroutinePool;
+    scheduler->nextDeadline = -1;
+    scheduler->pending
+      = (WsThreadInfo**) calloc(maxConnections, sizeof(WsThreadInfo*));
+    scheduler->starting
+      = (WsThreadInfo**) calloc(maxConnections, sizeof(WsThreadInfo*));
+    scheduler->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    scheduler->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ZEROINIT(struct epoll_event event);
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    bool initialized = (scheduler->pending != NULL)
+      && (scheduler->starting != NULL) && (scheduler->epollFd >= 0)
+      && (scheduler->wakeFd >= 0)
+      && (epoll_ctl(scheduler->epollFd, EPOLL_CTL_ADD, scheduler->wakeFd,
+        &event) == 0)
+      && (mtx_init(&scheduler->lock, mtx_plain) == thrd_success);
+    if ((initialized == true)
+      && (cnd_init(&scheduler->idle) != thrd_success)
+    ) {
+      mtx_destroy(&scheduler->lock);
+      initialized = false;
+    }
+    
+    pthread_attr_t attributes;
+    if ((initialized == true) && (pthread_attr_init(&attributes) == 0)) {
+      if ((pthread_attr_setstacksize(&attributes, threadStackSize) != 0)
+        || (pthread_create(&scheduler->threadId, &attributes,
+          wsSchedulerThread, scheduler) != 0)
+      ) {
+        printLog(ERR, "Could not start scheduler thread %d with a %llu-byte "
+          "stack.\n", i, llu(threadStackSize));
+        cnd_destroy(&scheduler->idle);
+        mtx_destroy(&scheduler->lock);
+        initialized = false;
+      }
+      pthread_attr_destroy(&attributes);
+    } else {
+      printLog(ERR, "Could not initialize scheduler %d: %s\n",
+        i, strerror(errno));
+      if (initialized == true) {
+        cnd_destroy(&scheduler->idle);
+        mtx_destroy(&scheduler->lock);
+      }
+      initialized = false;
+    }
+    
+    if (initialized == false) {
+      // This scheduler is not counted in numSchedulers, so clean it up here.
+      scheduler->pending = (WsThreadInfo**) pointerDestroy(scheduler->pending);
+      scheduler->starting
+        = (WsThreadInfo**) pointerDestroy(scheduler->starting);
+      if (scheduler->epollFd >= 0) {
+        close(scheduler->epollFd);
+      }
+      if (scheduler->wakeFd >= 0) {
+        close(scheduler->wakeFd);
+      }
+      coroutinePool = wsCoroutinePoolDestroy(coroutinePool);
+      return NULL;
+    }
+    coroutinePool->numSchedulers++;
+  }
   
-  return outputBytes;
+  printLog(TRACE, "EXIT wsCoroutinePoolCreate(numSchedulers=%d, "
+    "stackSize=%d, maxConnections=%d) = {%p}\n",
+    numSchedulers, stackSize, maxConnections, coroutinePool);
+  return coroutinePool;
 }
 
-/// @fn int handleGetRequest(WsThreadInfo *wsThreadInfo, Bytes receiveBuffer)
+/// @fn WsCoroutinePool* wsCoroutinePoolDestroy(WsCoroutinePool *coroutinePool)
 ///
-/// @brief Handle a GET request from a client.
+/// @brief Stop the scheduler threads of a coroutine pool and free its
+/// resources.  Each scheduler exits once all of its connections are closed,
+/// so this should only be called after the pool has been drained or its
+/// connections have been shut down.
 ///
-/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param coroutinePool The WsCoroutinePool to destroy.
 ///
-/// @return Returns 0 on success.  Any other value is an error.
-int handleGetRequest(WsThreadInfo *wsThreadInfo) {
-  printLog(TRACE,
-    "ENTER handleGetRequest(wsThreadInfo=%p)\n", wsThreadInfo);
+/// @return This function always returns NULL.
+WsCoroutinePool* wsCoroutinePoolDestroy(WsCoroutinePool *coroutinePool) {
+  printLog(TRACE, "ENTER wsCoroutinePoolDestroy(coroutinePool=%p)\n",
+    coroutinePool);
   
-  int returnValue = 0;
-  if (wsThreadInfo == NULL) {
-    printLog(ERR, "NULL wsThreadInfo parameter provided.  Cannot continue.\n");
-    returnValue = 1;
+  if (coroutinePool == NULL) {
     printLog(TRACE,
-      "EXIT handlePostRequest(wsThreadInfo=%p) = {%d}\n",
-      wsThreadInfo, returnValue);
-    return returnValue;
+      "EXIT wsCoroutinePoolDestroy(coroutinePool=%p) = {NULL}\n",
+      coroutinePool);
+    return NULL;
   }
   
-  // POST requests may be handled on any port they come in on, but GET requests
-  // need to be redirected if we've been instructed to redirect.  See if we
-  // should redirect the client.
-  if (redirectClient(wsThreadInfo)) {
-    // Nothing else for us to do.
-    printLog(TRACE,
-      "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
-      wsThreadInfo, 0);
-    return returnValue; // 0
+  for (int i = 0; i < coroutinePool->numSchedulers; i++) {
+    WsScheduler *scheduler = &coroutinePool->schedulers[i];
+    scheduler->draining = true;
+    scheduler->exitNow = true;
+    wsSchedulerWake(scheduler);
+  }
+  for (int i = 0; i < coroutinePool->numSchedulers; i++) {
+    WsScheduler *scheduler = &coroutinePool->schedulers[i];
+    pthread_join(scheduler->threadId, NULL);
+    cnd_destroy(&scheduler->idle);
+    mtx_destroy(&scheduler->lock);
+    close(scheduler->epollFd);
+    close(scheduler->wakeFd);
+    scheduler->pending = (WsThreadInfo**) pointerDestroy(scheduler->pending);
+    scheduler->starting
+      = (WsThreadInfo**) pointerDestroy(scheduler->starting);
+  }
+  
+  coroutinePool->schedulers
+    = (WsScheduler*) pointerDestroy(coroutinePool->schedulers);
+  coroutinePool = (WsCoroutinePool*) pointerDestroy(coroutinePool);
+  
+  printLog(TRACE, "EXIT wsCoroutinePoolDestroy(coroutinePool=%p) = {NULL}\n",
+    coroutinePool);
+  return NULL;
+}
+
+#else // not __linux__
+
+// WS_COROUTINES mode is only supported on Linux.  As with the event loop,
+// provide an opaque type and stubs for wsInit.  wsInit never creates a
+// coroutine pool on other platforms.
+typedef struct WsCoroutinePool WsCoroutinePool;
+#define wsCoroutinePoolAddConnection(coroutinePool, nextScheduler, \
+  wsThreadInfo) (-1)
+#define wsCoroutinePoolDrain(coroutinePool, deadline) (0)
+#define wsCoroutinePoolDestroy(coroutinePool) ((WsCoroutinePool*) NULL)
+#define wsCoroutineWaitPending(sock, pendingResponse) (0)
+#define wsCoroutineWakePending(pendingResponse) ((void) (pendingResponse))
+
+#endif // __linux__
+
+/// @fn WsPendingResponse* wsPendingResponseRelease(WsPendingResponse *pendingResponse)
+///
+/// @brief Give up one reference to a WsPendingResponse.  It's freed along with
+/// any response it still holds when the last reference is given up.
+///
+/// @param pendingResponse The WsPendingResponse to release.
+///
+/// @return This function always returns NULL.
+WsPendingResponse* wsPendingResponseRelease(
+  WsPendingResponse *pendingResponse
+) {
+  if (pendingResponse == NULL) {
+    return NULL;
   }
   
-  // There are two possibilities for a GET request:  The client may be
-  // requesting a web service function or may be requesting a static file.
-  // Web service functions will take precedence over static files of the same
-  // name, so check for a web service first and then fall back to looking for
-  // a static file if the web service lookup fails.
-  
-  // We need a copy of the path because we'll be unescaping it later, which
-  // modifies the buffer in place.
-  Bytes path = NULL;
-  bytesAddBytes(&path,
-    (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "_httpLocation"));
-  if (path == NULL) {
-    printLog(ERR, "No _httpLocation provided in handleGetRequest.\n");
-    returnValue = 1;
-    printLog(TRACE,
-      "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
-      wsThreadInfo, 1);
-    return returnValue;
+  mtx_lock(&pendingResponse->lock);
+  pendingResponse->referenceCount--;
+  bool lastReference = (pendingResponse->referenceCount == 0);
+  mtx_unlock(&pendingResponse->lock);
+  if (lastReference == false) {
+    return NULL;
   }
   
-  Bytes wsNamespace = NULL;
-  char *firstSlashAt = strchr((char*) path, '/');
-  char *questionMarkAt = strchr((char*) path, '?');
-  char *lastSlashAt = strrchr((char*) path, '/');
-  if ((lastSlashAt != NULL) && (questionMarkAt != NULL)) {
-    if (((size_t) lastSlashAt) > ((size_t) questionMarkAt)) {
-      // This is not the right place for lastSlashAt.  Terminate the string
-      // where the question mark is and find the real one.
-      *questionMarkAt = '\0';
-      lastSlashAt = strrchr((char*) path, '/');
-      // Now put the question mark back so that the rest of the parsing works.
-      *questionMarkAt = '?';
-    }
+  if (pendingResponse->responseObject != NULL) {
+    pendingResponse->responseObject = pendingResponse->responseObjectDestroy(
+      pendingResponse->responseObject);
   }
-  if ((firstSlashAt != NULL) && (lastSlashAt != NULL)) {
-    size_t wsNamespaceLength = ((size_t) lastSlashAt) - ((size_t) firstSlashAt);
-    if (wsNamespaceLength > 1) {
-      bytesAddData(&wsNamespace, firstSlashAt + 1, wsNamespaceLength - 1);
+  cnd_destroy(&pendingResponse->finishedCondition);
+  mtx_destroy(&pendingResponse->lock);
+  pendingResponse = (WsPendingResponse*) pointerDestroy(pendingResponse);
+  
+  return NULL;
+}
+
+/// @fn bool wsPendingResponseFinish(WsPendingResponse *pendingResponse, WsResponseObject *responseObject, bool cancelled)
+///
+/// @brief Finish a deferred response and wake the request that's waiting for
+/// it.  Only the first call for a response has any effect.
+///
+/// @param pendingResponse The WsPendingResponse to finish.
+/// @param responseObject The WsResponseObject to answer the request with.
+///   Ownership passes to pendingResponse if this call finishes it.
+/// @param cancelled Whether the server is giving up on the response (true) or
+///   the response is being completed (false).
+///
+/// @return Returns true if this call finished the response, false if it was
+/// already finished.
+bool wsPendingResponseFinish(WsPendingResponse *pendingResponse,
+  WsResponseObject *responseObject, bool cancelled
+) {
+  mtx_lock(&pendingResponse->lock);
+  bool finishing = (pendingResponse->finished == false);
+  if (finishing == true) {
+    pendingResponse->finished = true;
+    pendingResponse->cancelled = cancelled;
+    pendingResponse->responseObject = responseObject;
+    if (pendingResponse->waitContext != NULL) {
+      wsCoroutineWakePending(pendingResponse);
+    } else {
+      cnd_broadcast(&pendingResponse->finishedCondition);
     }
   }
+  mtx_unlock(&pendingResponse->lock);
   
-  if (wsNamespace != NULL) {
-    // Check to see if there's a matching web service call.
-    
-    Bytes wsNamespacePlusSlash = NULL;
-    bytesAddBytes(&wsNamespacePlusSlash, wsNamespace);
-    bytesAddStr(&wsNamespacePlusSlash, "/");
-    // Get everything after the wsNamespace
-    Bytes functionAndArgsString
-      = getBytesBetween((char*) path, (char*) wsNamespacePlusSlash, "");
-    wsNamespacePlusSlash = bytesDestroy(wsNamespacePlusSlash);
-    if (functionAndArgsString == NULL) {
-      // Memory allocation failed.
-      wsNamespace = bytesDestroy(wsNamespace);
-      path = bytesDestroy(path);
-      returnValue = 1;
-      printLog(TRACE,
-        "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
-        wsThreadInfo, 1);
-      return returnValue;
-    }
-    
-    // Separate the string into its function and its args
-    Bytes *functionAndArgsArray
-      = stringToBytesArray((char*) functionAndArgsString, "?");
-    functionAndArgsString = bytesDestroy(functionAndArgsString);
-    if (functionAndArgsArray == NULL) {
-      // Memory allocation failed.
-      wsNamespace = bytesDestroy(wsNamespace);
-      path = bytesDestroy(path);
-      returnValue = 1;
-      LOG_MALLOC_FAILURE();
-      printLog(TRACE,
-        "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
-        wsThreadInfo, 1);
-      return returnValue;
-    }
-    
-    // functionAndArgsArray[0] is guaranteed to be non-NULL and
-    // functionAndArgsArray[1] is guaranteed to be allocated, but that's it.
-    // kvStringToDictionary handles NULL inputs.
-    Bytes functionName = functionAndArgsArray[0];
-    Dictionary *args
-      = kvStringToDictionary((char*) functionAndArgsArray[1], "&");
-    if (args == NULL) {
-      // Memory allocation failed.
-      functionAndArgsArray = freeBytesArray(functionAndArgsArray);
-      wsNamespace = bytesDestroy(wsNamespace);
-      path = bytesDestroy(path);
-      returnValue = 1;
-      LOG_MALLOC_FAILURE();
-      printLog(TRACE,
-        "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
-        wsThreadInfo, 1);
-      return returnValue;
-    }
-    Dictionary *tempDict = dictionaryCreate(typeString);
-    // Prepend "GET:" to all parameter names.  This is to distinguish them from
-    // POST parameters.  GET parameters can be faked by cross-site request
-    // forgery while POST parameters cannot.  This will force the called method
-    // to prepend "GET:" to the parameter names it requests so that the
-    // developer is reminded about this (and hopefully, doesn't do any data
-    // modifications while in a GET method).
-    for (DictionaryEntry *node = args->head; node != NULL; node = node->next) {
-      char *parameterName = NULL;
-      straddstr(&parameterName, "GET:");
-      straddstr(&parameterName, (char*) node->key);
-      dictionaryAddEntry(tempDict, parameterName, node->value);
-      parameterName = stringDestroy(parameterName);
-    }
-    args = dictionaryDestroy(args);
-    args = tempDict;
-    
-    WsResponseObject *outputParams = webServiceCall(
-      wsThreadInfo, (char*) wsNamespace, (char*) functionName, args);
-    args = dictionaryDestroy(args);
-    
-    if (outputParams != NULL) {
-      // We had a web service match.  Return the parameters to the client and
-      // exit.
-      // A return value of 0 from sendResponseObjectToClient is good status.
-      // The same is true for this function.  However, this being a top-level
-      // handler, we can only return zero or positive values to our caller.
-      // We need to restrict our return value to reflect this.
-      returnValue = (sendResponseObjectToClient(wsThreadInfo,
-        (char*) functionName, outputParams) != 0);
-      outputParams = wsThreadInfo->webService.responseObjectDestroy(outputParams);
-      functionAndArgsArray = freeBytesArray(functionAndArgsArray);
-      functionName = NULL;
-      outputParams = wsThreadInfo->webService.responseObjectDestroy(outputParams);
-      wsNamespace = bytesDestroy(wsNamespace);
-      path = bytesDestroy(path);
-      
-      printLog(TRACE,
-        "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
-        wsThreadInfo, returnValue);
-      return returnValue;
+  return finishing;
+}
+
+/// @fn WsResponseObject* wsPendingResponseAwait(WsConnections *connections, WsPendingResponse **waitingOn, Socket *clientSocket, WsPendingResponse *pendingResponse, bool *timedOut)
+///
+/// @brief Wait for a deferred response to be finished or for its deadline to
+/// pass.  If the connection is serviced by a coroutine, the coroutine is
+/// parked so that no thread is held while waiting.  Otherwise, the calling
+/// thread waits.
+///
+/// @param connections The WsConnections of the server that accepted the
+///   connection.  NULL if it doesn't keep track of its connections.
+/// @param waitingOn Where wsConnectionsShutdown looks for the response to
+///   cancel it if the server has to force the connection closed.  Only
+///   changed with the lock of connections held.
+/// @param clientSocket The Socket of the connection the response is for.
+/// @param pendingResponse The WsPendingResponse to wait for.  The caller's
+///   reference to it is released.
+/// @param timedOut Set to true if the response was given up on because its
+///   deadline passed, false otherwise.
+///
+/// @return Returns the WsResponseObject the response was completed with, NULL
+/// if it was completed with NULL or given up on.
+WsResponseObject* wsPendingResponseAwait(WsConnections *connections,
+  WsPendingResponse **waitingOn, Socket *clientSocket,
+  WsPendingResponse *pendingResponse, bool *timedOut
+) {
+  if (connections != NULL) {
+    mtx_lock(&connections->lock);
+    *waitingOn = pendingResponse;
+    if (connections->shutDown == true) {
+      // It's already too late to wait.
+      wsPendingResponseFinish(pendingResponse, NULL, true);
     }
-    functionAndArgsArray = freeBytesArray(functionAndArgsArray);
-    functionName = NULL;
-  } // else this is a request for a file at the root level
-  
-  // If we made it this far then we need to see if there's a static file to get.
-  char *charAt = strchr((char*) path, '?');
-  if (charAt != NULL) {
-    // We don't care about the rest of the URL.  Terminate the string.
-    *charAt = '\0';
+    mtx_unlock(&connections->lock);
   }
   
-  // Construct the target wsNamespace to use in the event the client is
-  // requesting a WSDL or XSD.
-  char *targetNamespace = NULL;
-  if (wsNamespace != NULL) {
-    Socket *clientSocket = wsThreadInfo->clientSocket;
-    Bytes hostName
-      = (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "Host");
-    if (hostName != NULL) {
-      Bytes *hostArray = stringToBytesArray((char*) hostName, ":");
-      // hostArray[0] is guaranteed to be non-NULL
-      // hostArray[1] is guaranteed to be allocated
-      Bytes portString = hostArray[1];
-      if (portString != NULL) {
-        if (asprintf(&targetNamespace, "%s://%s:%s/%s",
-          // clientSocket->socketMode can only be TLS if tlsSocketsEnabled() is
-          // true, so no need to check that here.
-          (clientSocket->socketMode == TLS) ? "https" :
-          "http",
-          (char*) hostArray[0], (char*) portString, (char*) wsNamespace) < 0
-        ) {
-          targetNamespace = NULL;
-        }
-      } else {
-        if (asprintf(&targetNamespace, "%s://%s/%s",
-          // clientSocket->socketMode can only be TLS if tlsSocketsEnabled() is
-          // true, so no need to check that here.
-          (clientSocket->socketMode == TLS)
-          ? "https" :
-          "http",
-          (char*) hostName, (char*) wsNamespace) < 0
-        ) {
-          targetNamespace = NULL;
-        }
+  *timedOut = false;
+  mtx_lock(&pendingResponse->lock);
+  while (pendingResponse->finished == false) {
+    i64 deadline = pendingResponse->deadline;
+    if ((deadline >= 0)
+      && (((i64) (wsNowMicroseconds() / 1000)) >= deadline)
+    ) {
+      pendingResponse->finished = true;
+      pendingResponse->cancelled = true;
+      *timedOut = true;
+    } else if (clientSocket->waitFunction != NULL) {
+      // The connection is serviced by a coroutine.
+      wsCoroutineWaitPending(clientSocket, pendingResponse);
+    } else if (deadline >= 0) {
+      // cnd_timedwait only takes a TIME_UTC time, so wait in short slices
+      // and check the deadline, which is on wsNowMicroseconds' clock, between
+      // them.
+      i64 remainingMs = deadline - ((i64) (wsNowMicroseconds() / 1000));
+      if (remainingMs > 100) {
+        remainingMs = 100;
       }
-      hostArray = freeBytesArray(hostArray);
+      struct timespec until;
+      timespec_get(&until, TIME_UTC);
+      until.tv_nsec += (long) (remainingMs * 1000000);
+      if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+      }
+      cnd_timedwait(&pendingResponse->finishedCondition,
+        &pendingResponse->lock, &until);
+    } else {
+      cnd_wait(&pendingResponse->finishedCondition, &pendingResponse->lock);
     }
-    wsNamespace = bytesDestroy(wsNamespace);
   }
+  WsResponseObject *responseObject = pendingResponse->responseObject;
+  pendingResponse->responseObject = NULL;
+  mtx_unlock(&pendingResponse->lock);
   
-  unescapeString((char*) path);
-  printLog(DEBUG, "Getting file \"%s\".\n", (char*) path);
-  Bytes header = NULL;
-  Bytes body
-    = wsGetFile(wsThreadInfo, (char*) path, targetNamespace, &header);
-  targetNamespace = stringDestroy(targetNamespace);
-  path = bytesDestroy(path);
-  bytesAddStr(&header, "Server: ");
-  bytesAddStr(&header, wsThreadInfo->serverName);
-  bytesAddStr(&header, "\r\n");
-  // A return value of 0 from sendResponseObjectToClient is good status.
-  // The same is true for this function.  However, this being a top-level
-  // handler, we can only return zero or positive values to our caller.
-  // We need to restrict our return value to reflect this.
-  returnValue = (sendResponseToClient(header, body,
-    wsThreadInfo->clientSocket) != 0);
-  header = bytesDestroy(header);
-  body = bytesDestroy(body);
+  if (connections != NULL) {
+    mtx_lock(&connections->lock);
+    *waitingOn = NULL;
+    mtx_unlock(&connections->lock);
+  }
+  pendingResponse = wsPendingResponseRelease(pendingResponse);
   
-  printLog(TRACE,
-    "EXIT handleGetRequest(wsThreadInfo=%p) = {%d}\n",
-    wsThreadInfo, returnValue);
-  return returnValue;
+  return responseObject;
 }
 
-/// @fn int parseCookies(WsThreadInfo *wsThreadInfo)
+/// @fn WsResponseObject* wsPendingResponseWait(WsThreadInfo *wsThreadInfo, WsPendingResponse *pendingResponse)
 ///
-/// @brief Set the thread for this session if it's in the header's cookies.
+/// @brief Wait for a deferred response to be finished.  If the response's
+/// deadline passes first, the server gives up on it and sends a 504 instead,
+/// or gives the call a status of 504 if it's part of a batch.
 ///
-/// @param wsThreadInfo The connection context for this thread.
+/// @param wsThreadInfo The WsThreadInfo structure for the connection.
+/// @param pendingResponse The WsPendingResponse the function deferred.  The
+///   request's reference to it is released.
 ///
-/// @return Returns 0 on success, negative error code on failure.
-int parseCookies(WsThreadInfo *wsThreadInfo) {
-  printLog(TRACE, "ENTER parseCookies(wsThreadInfo=%p)\n", wsThreadInfo);
+/// @return Returns the WsResponseObject the response was completed with, NULL
+/// if it was completed with NULL or given up on.
+WsResponseObject* wsPendingResponseWait(WsThreadInfo *wsThreadInfo,
+  WsPendingResponse *pendingResponse
+) {
+  // The calls of a batch keep theirs with the batch, which the connection's
+  // WsThreadInfo points to.
+  WsBatchCall *batchCall = wsThreadInfo->batchCall;
+  Socket *clientSocket = wsThreadInfo->clientSocket;
+  bool timedOut = false;
+  WsResponseObject *responseObject = wsPendingResponseAwait(
+    wsThreadInfo->connections,
+    (batchCall != NULL)
+      ? &batchCall->pendingResponse : &wsThreadInfo->pendingResponse,
+    clientSocket, pendingResponse, &timedOut);
   
-  if ((wsThreadInfo == NULL)
-    || (wsThreadInfo->webService.cookiesHandler == NULL)
-    || (wsThreadInfo->httpParams == NULL)
-  ) {
-    printLog(ERR, "One or more NULL parameters.  Cannot parse cookies.\n");
-    printLog(TRACE,
-      "EXIT parseCookies(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, -1);
-    return -1;
+  if ((timedOut == true) && (batchCall != NULL)) {
+    // The rest of the batch still gets its results.
+    printLog(WARN, "Deferred response to a call of a batch from %s timed "
+      "out.\n", socketAddress(clientSocket));
+    batchCall->status = 504;
+  } else if (timedOut == true) {
+    printLog(WARN, "Deferred response to %s timed out.\n",
+      socketAddress(clientSocket));
+    sendResponseToClient(wsThreadInfo, "504 Gateway Timeout",
+      "Content-Length: 0\r\n", NULL, 0);
   }
   
-  Bytes cookiesString =
-    (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "Cookie");
-  if (cookiesString == NULL) {
-    // No cookies.  Can't get cookies.
-    // Nothing to free.
-    printLog(TRACE,
-      "EXIT parseCookies(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, -2);
-    return -2;
+  return responseObject;
+}
+
+/// @fn WsPendingResponse* wsResponseDefer(WebService *webService, WsConnectionInfo *wsConnectionInfo, int timeoutSeconds)
+///
+/// @brief Defer the response to the current call of a web service function.
+/// The function returns NULL right away and the connection waits without
+/// sending anything until the returned WsPendingResponse is completed with
+/// wsResponseComplete.  In WS_COROUTINES mode, no thread is held while the
+/// connection waits.  webService, wsConnectionInfo, and everything they point
+/// to must not be used once the function returns.  Only the WsPendingResponse
+/// may be.
+///
+/// @param webService The WebService passed to the calling function.
+/// @param wsConnectionInfo The WsConnectionInfo passed to the calling
+///   function.
+/// @param timeoutSeconds The number of seconds to wait for the response to be
+///   completed before answering the request with a 504.  Zero to use
+///   WS_DEFAULT_DEFERRED_RESPONSE_TIMEOUT_SECONDS.  Negative to wait until the
+///   response is completed or the server forces the connection closed, except
+///   in a batch, where the default is used instead.
+///
+/// @return Returns a WsPendingResponse that must be passed to
+/// wsResponseComplete exactly once on success, NULL on failure.
+WsPendingResponse* wsResponseDefer(WebService *webService,
+  WsConnectionInfo *wsConnectionInfo, int timeoutSeconds
+) {
+  if ((webService == NULL) || (wsConnectionInfo == NULL)) {
+    printLog(ERR, "One or more NULL parameters.\n");
+    return NULL;
+  } else if (wsConnectionInfo->pendingResponse != NULL) {
+    printLog(ERR, "The response has already been deferred.\n");
+    return NULL;
+  }
+  if ((timeoutSeconds == 0) || ((timeoutSeconds < 0)
+    && (wsConnectionInfo->responseWriter->batchCall != NULL))
+  ) {
+    // One call of a batch mustn't hold up the rest of it indefinitely.
+    timeoutSeconds = WS_DEFAULT_DEFERRED_RESPONSE_TIMEOUT_SECONDS;
   }
   
-  Dictionary *cookiesDict = kvStringToDictionary((char*) cookiesString, "; ");
-  if (cookiesDict == NULL) {
-    // Memory allocation failed.  Can't get sessionToken.
-    // cookiesString has already been freed.  Nothing else to free.
-    printLog(TRACE,
-      "EXIT parseCookies(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, -3);
-    return -3;
+  WsPendingResponse *pendingResponse
+    = (WsPendingResponse*) calloc(1, sizeof(WsPendingResponse));
+  if (pendingResponse == NULL) {
+    LOG_MALLOC_FAILURE();
+    return NULL;
+  }
+  if (mtx_init(&pendingResponse->lock, mtx_plain) != thrd_success) {
+    printLog(ERR, "Could not initialize deferred response lock.\n");
+    pendingResponse = (WsPendingResponse*) pointerDestroy(pendingResponse);
+    return NULL;
+  }
+  if (cnd_init(&pendingResponse->finishedCondition) != thrd_success) {
+    printLog(ERR, "Could not initialize deferred response condition.\n");
+    mtx_destroy(&pendingResponse->lock);
+    pendingResponse = (WsPendingResponse*) pointerDestroy(pendingResponse);
+    return NULL;
+  }
+  // One reference for the request and one for the caller.
+  pendingResponse->referenceCount = 2;
+  pendingResponse->responseObjectDestroy = webService->responseObjectDestroy;
+  pendingResponse->deadline = -1;
+  if (timeoutSeconds > 0) {
+    pendingResponse->deadline = ((i64) (wsNowMicroseconds() / 1000))
+      + (((i64) timeoutSeconds) * 1000);
   }
   
-  Bytes host
-    = (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "Host");
-  const char *protocol = 
-    // wsThreadInfo->clientSocket->socketMode can only be TLS if
-    // tlsSocketsEnabled() is true, so no need to check that here.
-    (wsThreadInfo->clientSocket->socketMode == TLS) ? "https" :
-    "http";
+  wsConnectionInfo->pendingResponse = pendingResponse;
+  return pendingResponse;
+}
 
-  Dictionary *tempDict = dictionaryCreate(typeString);
-  char *protocolAndDomain = NULL;
-  if (asprintf(&protocolAndDomain, "%s://%s.",
-    protocol, (char*) host) > 0
+/// @fn int wsResponseComplete(WsPendingResponse *pendingResponse, WsResponseObject *responseObject)
+///
+/// @brief Complete a response that was deferred with wsResponseDefer.  May be
+/// called from any thread.  The response is serialized and sent exactly as if
+/// the function had returned it.
+///
+/// @param pendingResponse The WsPendingResponse returned by wsResponseDefer.
+///   It must not be used after this call.
+/// @param responseObject The WsResponseObject to send.  Ownership passes to
+///   the server either way.  NULL is handled the same as a function that
+///   returns NULL.
+///
+/// @return Returns 0 if the response will be sent, -1 if the server has
+/// already given up on it because it timed out or the connection was closed.
+int wsResponseComplete(WsPendingResponse *pendingResponse,
+  WsResponseObject *responseObject
+) {
+  if (pendingResponse == NULL) {
+    printLog(ERR, "NULL pendingResponse provided.\n");
+    return -1;
+  }
+  
+  int returnValue = 0;
+  if (wsPendingResponseFinish(pendingResponse, responseObject, false)
+    == false
   ) {
-    // Strip the host namespace from all the cookie names.
-    for (DictionaryEntry *node = cookiesDict->head;
-      node != NULL;
-      node = node->next
-    ) {
-      printLog(DEBUG, "Replacing \"%s\" in \"%s\".\n", protocolAndDomain,
-        (char*) node->key);
-      char *cookieName = strReplaceStr((char*) node->key, protocolAndDomain, "");
-      printLog(DEBUG, "Replacing \"%s\" with \"%s\".\n",
-        (char*) node->key, cookieName);
-      dictionaryAddEntry(tempDict, cookieName, node->value);
-      cookieName = stringDestroy(cookieName);
+    if (responseObject != NULL) {
+      responseObject = pendingResponse->responseObjectDestroy(responseObject);
     }
+    returnValue = -1;
   }
-  protocolAndDomain = stringDestroy(protocolAndDomain);
-  if (tempDict != NULL) {
-    cookiesDict = dictionaryDestroy(cookiesDict);
-    cookiesDict = tempDict;
+  pendingResponse = wsPendingResponseRelease(pendingResponse);
+  
+  return returnValue;
+}
+
+/// @fn bool wsResponseCancelled(WsPendingResponse *pendingResponse)
+///
+/// @brief Determine whether or not the server has given up on a deferred
+/// response.  Code that's producing a response can use this to stop early.
+///
+/// @param pendingResponse The WsPendingResponse returned by wsResponseDefer.
+///
+/// @return Returns true if the request timed out or its connection was forced
+/// closed, false if the response is still wanted.
+bool wsResponseCancelled(WsPendingResponse *pendingResponse) {
+  if (pendingResponse == NULL) {
+    return true;
   }
   
-  int returnValue = wsThreadInfo->webService.cookiesHandler(cookiesDict);
-  wsThreadInfo->cookiesDict = cookiesDict;
+  mtx_lock(&pendingResponse->lock);
+  bool cancelled = pendingResponse->cancelled;
+  mtx_unlock(&pendingResponse->lock);
   
-  printLog(TRACE,
-    "EXIT parseCookies(wsThreadInfo=%p) = {%d}\n", wsThreadInfo, returnValue);
-  return returnValue;
+  return cancelled;
 }
 
-/// @fn Dictionary* parseHeader(const Bytes fullReceiveBuffer)
+/// @struct WsListener
 ///
-/// @brief Parse the received HTTP header into a Dictionary.
+/// @brief One of a WebServer's listening sockets and the state its accept
+/// thread needs.  Every listener of a server shares everything except its
+/// socket, its thread, and the reactor it gives its next connection to.
 ///
-/// @param receiveBuffer The content received that contains the HTTP header.
+/// @param webServer The WebServer the listener belongs to.
+/// @param index The index of the listener in webServer->listeners.
+/// @param socket The listening Socket.  Destroyed and set to NULL by
+///   webServerDestroy to stop the accept thread.
+/// @param socketOptions The SOCKET_* options the socket is created with.
+/// @param threadId The ID of the listener's accept thread.
+/// @param threadStarted Whether or not the accept thread was started.
+/// @param nextReactor The index of the reactor (or scheduler) to give the
+///   listener's next connection to in WS_EVENT_LOOP (or WS_COROUTINES) mode.
+/// @param interfacePath The server's path to the root of the static content.
+/// @param serverName The name of the server.
+/// @param routeTable The WsRouteTable of the functions of the web service
+///   being served, if any.
+/// @param connections The WsConnections the listener's connections are added
+///   to.
+/// @param eventLoop The WsEventLoop connections are given to, or NULL if they
+///   are given to the worker pool.
+/// @param coroutinePool The WsCoroutinePool connections are given to, or NULL
+///   if they are given to the worker pool.
+struct WsListener {
+  WebServer       *webServer;
+  int              index;
+  Socket          *socket;
+  int              socketOptions;
+  thrd_t           threadId;
+  bool             threadStarted;
+  int              nextReactor;
+  char            *interfacePath;
+  char            *serverName;
+  WsRouteTable    *routeTable;
+  WsConnections   *connections;
+  WsEventLoop     *eventLoop;
+  WsCoroutinePool *coroutinePool;
+};
+
+/// @fn Socket* wsListenerCreateSocket(WsListener *listener, bool retry)
 ///
-/// @return Returns a pointer to a new Dictionary with the HTTP parameter names
-///   as keys and their corresponding values as values on success, NULL on
-///   failure.
-Dictionary* parseHeader(const Bytes receiveBuffer) {
-  printLog(TRACE,
-    "ENTER parseHeader(receiveBuffer=%p)\n", receiveBuffer);
+/// @brief Create the listening socket for one of a WebServer's listeners.
+///
+/// @param listener A pointer to the WsListener to create the socket for.
+/// @param retry Whether or not to keep trying for up to the server's timeout
+///   if the socket can't be created right away.
+///
+/// @return Returns a newly-created Socket on success, NULL on failure.
+Socket* wsListenerCreateSocket(WsListener *listener, bool retry) {
+  WebServer *webServer = listener->webServer;
+  int timeout = webServer->timeout;
   
-  Dictionary *parameters = dictionaryCreate(typeStringCi);
-  if (parameters == NULL) {
-    LOG_MALLOC_FAILURE();
-    return NULL;
+  char *address = NULL;
+  if (asprintf(&address, "0.0.0.0:%d", webServer->portNumber) < 0) {
+    address = NULL;
   }
-  
-  const char *newline = "\r\n";
-  u64 newlineLength = 2;
-  Bytes header = getBytesBetweenBytes(receiveBuffer, "", "\r\n\r\n");
-  if (header == NULL) {
-    header = getBytesBetweenBytes(receiveBuffer, "", "\n\n");
-    if (header != NULL) {
-      newline = "\n";
-      newlineLength = 1;
+  Socket *listenerSocket = socketCreate(SERVER, TCP, address,
+    webServer->socketMode, webServer->certificate, webServer->key, 0,
+    listener->socketOptions);
+  if ((listenerSocket == NULL) && (retry == true)) {
+    printLog(WARN, "Could not create %s web server socket.\n",
+      SocketModeNames[webServer->socketMode]);
+    if (timeout > 0) {
+      printLog(WARN, "Retrying for up to %d seconds.\n", timeout);
     } else {
-      // Single-line header.  This is a command-only header and there are no
-      // parameters, so we're done.
-      parameters = dictionaryDestroy(parameters);
-      printLog(TRACE,
-        "EXIT parseHeader(receiveBuffer=%p) = {NULL}\n", receiveBuffer);
-      return NULL;
+      printLog(WARN, "Retrying until successful.\n");
     }
-  }
-  u64 headerLength = bytesLength(header);
-  if (headerLength <= newlineLength) {
-    // Empty header.  We're done.
-    header = bytesDestroy(header);
-    parameters = dictionaryDestroy(parameters);
-    printLog(TRACE,
-      "EXIT parseHeader(receiveBuffer=%p) = {NULL}\n", receiveBuffer);
-    return NULL;
-  }
-  
-  Bytes commandLine
-    = getDataBetween(header, headerLength, "", 0, newline, newlineLength);
-  if (commandLine == NULL) {
-    // If we got here then the entire header is just the command.  Just make a
-    // copy.
-    bytesAddBytes(&commandLine, header);
-  }
-  u64 commandLineLength = bytesLength(commandLine);
-  Bytes commandLinePointer = commandLine;
-  
-  // The first line is the HTTP command.  All HTTP parameters start with
-  // a letter, so we'll prefix the command portion with "_http", which should
-  // never collide with any parameter.  If, however, there ever is a collision,
-  // the faulty parameters (which would be part of a malformed header most
-  // likely from a malicious client) will never be found by the get operations
-  // since they will be added after these.
-  if (commandLineLength > 2) { // 2 characters for the space delimiters.
-    Bytes httpCommand
-      = getDataBetween(commandLinePointer, commandLineLength, "", 0, " ", 1);
-    u64 httpCommandLength = bytesLength(httpCommand);
-    DictionaryEntry *entry
-      = dictionaryAddEntry(parameters, "_httpCommand",
-        httpCommand, typeBytesNoCopy);
-    printLog(DEBUG, "httpCommand = \"%s\"\n", str(httpCommand));
-    if (entry == NULL) {
-      commandLine = bytesDestroy(commandLine);
-      header = bytesDestroy(header);
-      parameters = dictionaryDestroy(parameters);
-      LOG_MALLOC_FAILURE();
-      return NULL;
+    for (int i = 0;
+      ((i < timeout) || (timeout == 0))
+        && (listenerSocket == NULL) && (webServer->exitNow == false);
+      i++
+    ) {
+      sleep(1);
+      listenerSocket = socketCreate(SERVER, TCP, address,
+        webServer->socketMode, webServer->certificate, webServer->key, 0,
+        listener->socketOptions);
     }
-    // Change the type to typeBytes so that the destructor works properly.
-    entry->type = typeBytes;
-    commandLinePointer += httpCommandLength + 1; // 1 character for the space
-    commandLineLength -= httpCommandLength + 1;  // delimiter.
-    
-    Bytes httpLocation
-      = getDataBetween(commandLinePointer, commandLineLength, "", 0, " ", 1);
-    if (httpLocation == NULL) {
-      // Missing protocol?
-      httpLocation
-        = getDataBetween(commandLinePointer, commandLineLength, "", 0, "", 0);
-    }
-    u64 httpLocationLength = bytesLength(httpLocation);
-    entry = dictionaryAddEntry(parameters, "_httpLocation",
-      httpLocation, typeBytesNoCopy);
-    if (entry == NULL) {
-      commandLine = bytesDestroy(commandLine);
-      header = bytesDestroy(header);
-      parameters = dictionaryDestroy(parameters);
-      LOG_MALLOC_FAILURE();
-      return NULL;
+  }
+  if (listenerSocket == NULL) {
+    printLog(ERR, "Could not create %s web server socket.\n",
+      SocketModeNames[webServer->socketMode]);
+  }
+#ifdef TLS_SOCKETS_ENABLED
+  if ((listenerSocket != NULL) && (webServer->socketMode == TLS)) {
+    // Let reconnecting clients resume their sessions.  This is only a
+    // performance optimization, so the listener is still usable on failure.
+    if (socketTlsSetSessionCache(listenerSocket,
+      webServer->tlsSessionCacheSize, webServer->tlsSessionTimeoutSeconds,
+      webServer->tlsTicketKeyLifetimeSeconds,
+      &webServer->metrics->tlsSessions) != 0
+    ) {
+      printLog(WARN, "Could not configure TLS session resumption.\n");
     }
-    // Change the type to typeBytes so that the destructor works properly.
-    entry->type = typeBytes;
-    commandLinePointer += httpLocationLength;
-    commandLineLength -= httpLocationLength;
-    if (*commandLinePointer == ' ') {
-      commandLinePointer += 1;
-      commandLineLength -= 1;
-    }
-    
-    Bytes httpProtocol
-      = getDataBetween(commandLinePointer, commandLineLength, "", 0, "", 0);
-    entry = dictionaryAddEntry(parameters, "_httpProtocol",
-      httpProtocol, typeBytesNoCopy);
-    if (entry == NULL) {
-      commandLine = bytesDestroy(commandLine);
-      header = bytesDestroy(header);
-      parameters = dictionaryDestroy(parameters);
-      LOG_MALLOC_FAILURE();
-      return NULL;
+  }
+#endif // TLS_SOCKETS_ENABLED
+  address = stringDestroy(address);
+  
+  return listenerSocket;
+}
+
+/// @fn void wsListenerPin(WsListener *listener)
+///
+/// @brief Pin the calling accept thread to one of the CPUs the process may run
+/// on.  Listeners are assigned CPUs round-robin by their index.
+///
+/// @param listener A pointer to the WsListener whose thread is calling.
+///
+/// @return This function returns no value.
+void wsListenerPin(WsListener *listener) {
+#ifdef __linux__
+  cpu_set_t allowedCpus;
+  if (sched_getaffinity(0, sizeof(allowedCpus), &allowedCpus) != 0) {
+    printLog(WARN, "Could not get CPU affinity: %s\n", strerror(errno));
+    return;
+  }
+  int numCpus = CPU_COUNT(&allowedCpus);
+  if (numCpus <= 0) {
+    return;
+  }
+  
+  int cpuIndex = listener->index % numCpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowedCpus) == 0) {
+      continue;
+    } else if (cpuIndex > 0) {
+      cpuIndex--;
+      continue;
     }
-    // Change the type to typeBytes so that the destructor works properly.
-    entry->type = typeBytes;
-  } else {
-    printLog(DEBUG, "commandLine = \"%s\"\n", str(commandLine));
-    printLog(DEBUG, "header = \"%s\"\n", str(header));
-    printLog(DEBUG, "receiveBuffer = \"%s\"\n", str(receiveBuffer));
-  }
-  // Reset the commandLineLength for the code below.
-  commandLineLength = bytesLength(commandLine);
-  commandLine = bytesDestroy(commandLine);
-  
-  if (bytesLength(header) > (commandLineLength + newlineLength)) {
-    char *headerPointer = ((char*) header) + commandLineLength + newlineLength;
-    Bytes **headers = stringToBytesTable(headerPointer, newline, ": ");
-    if (headers != NULL) {
-      for (u64 i = 0; headers[i] != NULL; i++) {
-        Bytes parameterName = headers[i][0];
-        if (parameterName != NULL) {
-          Bytes parameterValue = NULL;
-          if (bytesLength(headers[i][1]) != 0) {
-            bytesAddBytes(&parameterValue, headers[i][1]);
-          } else {
-            // We can't have a named parameter with a NULL value as this would
-            // prevent it from being found later.  Supply an empty string.
-            bytesAddData(&parameterValue, "", 1);
-          }
-          
-          if ((parameterValue[0] == '"')
-            && ((parameterValue[bytesLength(parameterValue) - 1] != '"')
-              || (bytesLength(parameterValue) == 1))
-          ) {
-            // This is a quoted value and the rest of the quote is on the next
-            // line.  (Probably a soap action.)
-            i++;
-            bytesAddBytes(&parameterValue, headers[i][0]);
-          }
-          
-          DictionaryEntry *entry
-            = dictionaryAddEntry(parameters, parameterName,
-              parameterValue, typeBytesNoCopy);
-          if (entry == NULL) {
-            LOG_MALLOC_FAILURE();
-            parameterValue = bytesDestroy(parameterValue);
-            headers = freeBytesTable(headers);
-            header = bytesDestroy(header);
-            parameters = dictionaryDestroy(parameters);
-            printLog(TRACE,
-              "EXIT parseHeader(receiveBuffer=%p) = {NULL}\n", receiveBuffer);
-            return NULL;
-          }
-          // Convert the value type to typeBytes now so that the destructor works
-          // properly.
-          entry->type = typeBytes;
-        }
-        // else we have an anonymous parameter, which is a malformed header.
-        // Skip it.
-      }
+    
+    cpu_set_t listenerCpu;
+    CPU_ZERO(&listenerCpu);
+    CPU_SET(cpu, &listenerCpu);
+    if (sched_setaffinity(0, sizeof(listenerCpu), &listenerCpu) != 0) {
+      printLog(WARN, "Could not pin listener %d to CPU %d: %s\n",
+        listener->index, cpu, strerror(errno));
     }
-    headers = freeBytesTable(headers);
+    break;
   }
-  
-  // Release our copy of the header.
-  header = bytesDestroy(header);
-  
-  printLog(TRACE,
-    "EXIT parseHeader(receiveBuffer=%p) = {%p}\n", receiveBuffer, parameters);
-  return parameters;
+#else // __linux__
+  (void) listener;
+  printLog(WARN, "Pinning listeners is not supported on this platform.\n");
+#endif // __linux__
 }
 
-/// @fn int wsConnectionThread(void *args)
+/// @fn int wsListenerThread(void *args)
 ///
-/// @brief Handle an individual client connection.
+/// @brief Accept client connections on one of a WebServer's listening sockets
+/// and hand them to the event loop or the worker pool.
 ///
-/// @param args is the WsThreadInfo structure for the connection to
-/// the client cast to a void*.
+/// @param args A pointer to the WsListener to accept connections for, cast to
+///   a void*.
 ///
-/// @return Returns 0 on success.  Any other value is an error.
-int wsConnectionThread(void *args) {
-  char recvbuf[1024];
-  ssize_t recvbufLen = 0;
-  Bytes fullReceiveBuffer = NULL;
-  WsThreadInfo *wsThreadInfo = (WsThreadInfo*) args;
-  
-  printLog(TRACE, "ENTER wsConnectionThread(args=%p)\n", args);
-  
-  if (wsThreadInfo == NULL) {
-    printLog(ERR, "wsThreadInfo is NULL.  Cannot process connection.\n");
-    
-    printLog(TRACE, "EXIT wsConnectionThread(args=%p) = {1}\n", args);
-    return 1;
+/// @return Always returns 0.
+int wsListenerThread(void *args) {
+  WsListener *listener = (WsListener*) args;
+  WebServer *webServer = listener->webServer;
+  WebService *webService = webServer->webService;
+  if ((webService != NULL) && (webService->registerThread != NULL)) {
+    webService->registerThread();
   }
   
-  // In this case, this function appears prior to the printLog to ensure that
-  // the printLog uses the proper threadId.
-  if (wsThreadInfo->webService.registerThread != NULL) {
-    wsThreadInfo->webService.registerThread();
+  printLog(TRACE, "ENTER wsListenerThread(index=%d)\n", listener->index);
+  
+  if (webServer->pinListeners == true) {
+    wsListenerPin(listener);
   }
   
-  Socket *clientSocket = wsThreadInfo->clientSocket;
-  printLog(DETAIL, "Processing connection for %s\n",
-    socketAddress(clientSocket));
+  WsWorkerPool *workerPool = webServer->workerPool;
+  WsOverloadPolicy overloadPolicy = webServer->overloadPolicy;
+  int retryAfterSeconds = webServer->retryAfterSeconds;
+  Socket *clientSocket = NULL;
+  WsThreadInfo *wsThreadInfo = NULL;
   
-  // There will be a three-second timeout on receive enforced by the while below
-  i64 startTime = (i64) time(NULL);
-  do {
-    int timeout = (3 - (((i64) time(NULL)) - startTime)) * 1000;
-    if (timeout <= 0) {
+  while (webServer->exitNow == false) {
+    if (overloadPolicy == WS_OVERLOAD_STOP_ACCEPTING) {
+      // Leave new connections in the listen backlog until a worker can
+      // take them.
+      wsWorkerPoolWaitForSpace(workerPool, &webServer->exitNow);
+    }
+    
+    clientSocket = socketAccept(listener->socket);
+    if (webServer->exitNow == true) {
+      // We've been told to exit.  Do not proceed.  Socket may not be valid.
+      clientSocket = socketDestroy(clientSocket);
       break;
     }
-    recvbufLen = socketReceive(clientSocket, recvbuf, sizeof(recvbuf), timeout);
-    if (recvbufLen >= 0) {
-      bytesAddData(&fullReceiveBuffer, recvbuf, recvbufLen);
-    } else {
-      recvbuf[0] = '\0';
-      if (clientSocket->sockfd < 0) {
-        // Client has closed the connection.  Exit the loop.
+    
+    if (clientSocket == NULL) {
+      printLog(ERR, "Error connecting to client!\n");
+      if (listener->socket != NULL) {
+#ifndef _MSC_VER
+        // On POSIX, errno is either EAGAIN or EWOULDBLOCK.
+        if ((errno == EBADF) && (webServer->exitNow == false))
+#else // _MSC_VER defined
+        // On Windows, the non-blocking socket should make WSAGetLastError
+        // return WSAEWOULDBLOCK.
+        if ((WSAGetLastError() == WSAEBADF) && (webServer->exitNow == false))
+#endif
+        {
+          // Recreate this listener's socket.  The other listeners are
+          // unaffected.
+          listener->socket = socketDestroy(listener->socket);
+          listener->socket = wsListenerCreateSocket(listener, true);
+          if (listener->index == 0) {
+            webServer->socket = listener->socket;
+          }
+          if (listener->socket == NULL) {
+            break;
+          }
+        }
+        continue;
+      } else {
+        // The server socket has been destroyed and is no longer valid.
+        // Exit the while loop.
+        // This probably indicates that a non-main thread is trying to restart
+        // the server, possibly a subordinate thread.  Decrement our count
+        // of connection threads accordingly to avoid cirular dependencies.
         break;
       }
     }
-    if (recvbufLen > 0) {
-      printLog(DEBUG, "fullReceiveBuffer: %s\n", (char*) fullReceiveBuffer);
+    
+    // Responses are sent in more than one piece.  Don't let Nagle's
+    // algorithm hold the later pieces back until the client acknowledges
+    // the earlier ones, which stalls persistent connections.
+    int noDelay = 1;
+    setsockopt(clientSocket->sockfd, IPPROTO_TCP, TCP_NODELAY,
+      (char*) &noDelay, sizeof(noDelay));
+    
+    // Enforce the per-client connection limit before anything else is done
+    // with the connection.  Rejections are logged at DEBUG so that a client
+    // that's over its limit can't flood the log.
+    WsClient *client = NULL;
+    if ((webServer->clientTable != NULL)
+      && (wsClientTableAddConnection(webServer->clientTable,
+        socketAddress(clientSocket), &client) != 0)
+    ) {
+      printLog(DEBUG, "Too many connections.  Rejecting connection from %s.\n",
+        socketAddress(clientSocket));
+      wsRejectConnection(clientSocket, "429 Too Many Requests",
+        retryAfterSeconds, webServer->metrics);
+      clientSocket = socketDestroy(clientSocket);
+      continue;
     }
-  } while (
-    ((fullReceiveBuffer == NULL)
-      || ((strstr((char*) fullReceiveBuffer, "\r\n\r\n") == NULL)
-           && (strstr((char*) fullReceiveBuffer, "\n\n") == NULL)
-      )
-    )
-    && (((i64) time(NULL)) < startTime + 3)
-  );
-  printLog(DEBUG, "fullReceiveBuffer: %s\n", (char*) fullReceiveBuffer);
-  
-  if (fullReceiveBuffer == NULL) {
-    printLog(WARN, "Nothing received from client.\n");
-    mtx_lock(wsThreadInfo->numRunningConnectionThreadsMutex);
-    (*wsThreadInfo->numRunningConnectionThreads)--;
-    mtx_unlock(wsThreadInfo->numRunningConnectionThreadsMutex);
-    clientSocket = socketDestroy(clientSocket);
-    
-    printLog(TRACE, "EXIT wsConnectionThread(args=%p) = {0}\n", args);
-    if (wsThreadInfo->webService.unregisterThread != NULL) {
-      wsThreadInfo->webService.unregisterThread(NULL);
-    }
-    wsThreadInfo->redirectProtocol = stringDestroy(wsThreadInfo->redirectProtocol);
-    wsThreadInfo->redirectProtocol = NULL;
-    // wsThreadInfo->cookiesDict hasn't been populated yet.
-    wsThreadInfo = (WsThreadInfo*) pointerDestroy(wsThreadInfo);
-    args = NULL;
-    printLog(TRACE, "EXIT wsConnectionThread(args=%p) = {1}\n", args);
-    return 0;
-  }
-  
-  // We should have the header at this point.
-  wsThreadInfo->httpParams = parseHeader(fullReceiveBuffer);
-  
-  Bytes contentLengthString
-    = (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "Content-Length");
-  u64 contentLength = 0;
-  if (contentLengthString != NULL) {
-    contentLength = (u64) strtol((char*) contentLengthString, NULL, 10);
-  }
-  char *bodyStart = strstr((char*) fullReceiveBuffer, "\r\n\r\n");
-  if (bodyStart != NULL) {
-    bodyStart += 4;
-  } else {
-    // Try searching for just \n\n
-    bodyStart = strstr((char*) fullReceiveBuffer, "\n\n");
-    if (bodyStart != NULL) {
-      bodyStart += 2;
+    
+    wsThreadInfo =
+      (WsThreadInfo*) calloc(1, sizeof(WsThreadInfo));
+    if (wsThreadInfo == NULL) {
+      // Out of memory.  Continue?
+      // TODO:  Should we do something else here?
+      LOG_MALLOC_FAILURE();
+      if (client != NULL) {
+        wsClientTableRemoveConnection(webServer->clientTable, client);
+      }
+      clientSocket = socketDestroy(clientSocket);
+      continue;
     }
-  }
-  
-  // There will be a three-second timeout on receive enforced by the while below
-  startTime = time(NULL);
-  while ((bodyStart != NULL)
-    && ((bytesLength(fullReceiveBuffer)
-      - (((Bytes) bodyStart) - fullReceiveBuffer)) < contentLength
-    )
-    && (time(NULL) < startTime + 3)
-  ) {
-    int timeout = (3 - (time(NULL) - startTime)) * 1000;
-    if (timeout <= 0) {
-      break;
+    wsHttpRequestReset(&wsThreadInfo->httpRequest);
+    wsThreadInfo->clientTable = webServer->clientTable;
+    wsThreadInfo->client = client;
+    wsThreadInfo->clientSocket = clientSocket;
+    wsThreadInfo->interfacePath = listener->interfacePath;
+    wsThreadInfo->serverName = listener->serverName;
+    if (webService != NULL) {
+      wsThreadInfo->webService = *webService;
+      wsThreadInfo->routeTable = listener->routeTable;
     }
-    recvbufLen = socketReceive(clientSocket, recvbuf, sizeof(recvbuf), timeout);
-    if (recvbufLen > 0) {
-      bytesAddData(&fullReceiveBuffer, recvbuf, recvbufLen);
-    } else if (clientSocket->sockfd < 0) {
-      // Client has closed the connection.  Exit the loop.
-      break;
+    // See the note at the beginning of wsInit about why we can't use a simple
+    // pointer for redirectProtocol.
+    if (webServer->redirectProtocol != NULL) {
+      straddstr(&wsThreadInfo->redirectProtocol,
+        webServer->redirectProtocol);
+    } // else wsThreadInfo->redirectProtocol is already NULL from calloc
+    wsThreadInfo->redirectPort = webServer->redirectPort;
+    wsThreadInfo->redirectFunction = webServer->redirectFunction;
+    wsThreadInfo->keepAliveTimeoutSeconds
+      = webServer->keepAliveTimeoutSeconds;
+    wsThreadInfo->maxRequestsPerConnection
+      = webServer->maxRequestsPerConnection;
+    wsThreadInfo->exitNow = &webServer->exitNow;
+    wsThreadInfo->fileCache = webServer->fileCache;
+    wsThreadInfo->compressionLevel = webServer->compressionLevel;
+    wsThreadInfo->compressionMinBytes = webServer->compressionMinBytes;
+    wsThreadInfo->maxRequestBodyBytes = webServer->maxRequestBodyBytes;
+    wsThreadInfo->requestBodyMemoryBytes
+      = webServer->requestBodyMemoryBytes;
+    wsThreadInfo->metrics = webServer->metrics;
+    wsThreadInfo->metricsPath = webServer->metricsPath;
+    wsThreadInfo->batchPath = webServer->batchPath;
+    wsThreadInfo->maxBatchCalls = webServer->maxBatchCalls;
+    // A coroutine can't block its scheduler thread waiting for calls on other
+    // threads to finish, so batches are always made in place there.
+    if ((webServer->parallelBatchCalls == true)
+      && (listener->coroutinePool == NULL)
+    ) {
+      wsThreadInfo->batchWorkerPool = workerPool;
     }
-    bodyStart = strstr((char*) fullReceiveBuffer, "\r\n\r\n");
-    if (bodyStart != NULL) {
-      bodyStart += 4; // strlen("\r\n\r\n")
-    } else {
-      bodyStart = strstr((char*) fullReceiveBuffer, "\n\n");
-      if (bodyStart != NULL) {
-        bodyStart += 2;
-      }
+    wsThreadInfo->traceBuffer = webServer->traceBuffer;
+    wsThreadInfo->traceSampleRate = webServer->traceSampleRate;
+    wsThreadInfo->accessLog = webServer->accessLog;
+    if ((wsThreadInfo->traceBuffer != NULL) && (listener->eventLoop == NULL)) {
+      // The wait for a worker thread or a scheduler is part of the first
+      // request.  The event loop queues each request once it has arrived.
+      wsThreadInfo->queuedNs = traceNowNanoseconds();
     }
-  }
-  printLog(DEBUG, "fullReceiveBuffer: %s\n", (char*) fullReceiveBuffer);
-  wsThreadInfo->body = (unsigned char*) bodyStart;
-  
-  // Handle the cookies for this connection.
-  if (wsThreadInfo->webService.cookiesHandler != NULL) {
-    parseCookies(wsThreadInfo);
-  }
-  
-  // Get the request method (POST or GET).
-  Bytes method
-    = (Bytes) dictionaryGetValue(wsThreadInfo->httpParams, "_httpCommand");
-  if (method == NULL) {
-    printLog(ERR, "Malformed HTTP header.\n");
+    atomic_fetch_add_explicit(&webServer->metrics->activeConnections,
+      (u64) 1, memory_order_relaxed);
     
-    wsThreadInfo->body = NULL;
-    wsThreadInfo->httpParams = dictionaryDestroy(wsThreadInfo->httpParams);
-    fullReceiveBuffer = bytesDestroy(fullReceiveBuffer);
-    mtx_lock(wsThreadInfo->numRunningConnectionThreadsMutex);
-    (*wsThreadInfo->numRunningConnectionThreads)--;
-    mtx_unlock(wsThreadInfo->numRunningConnectionThreadsMutex);
-    clientSocket = socketDestroy(clientSocket);
-    
-    printLog(TRACE, "EXIT wsConnectionThread(args=%p) = {1}\n", args);
-    if (wsThreadInfo->webService.unregisterThread != NULL) {
-      wsThreadInfo->webService.unregisterThread(NULL);
-    }
-    wsThreadInfo->redirectProtocol = stringDestroy(wsThreadInfo->redirectProtocol);
-    wsThreadInfo->redirectProtocol = NULL;
-    wsThreadInfo->cookiesDict = dictionaryDestroy(wsThreadInfo->cookiesDict);
-    wsThreadInfo = (WsThreadInfo*) pointerDestroy(wsThreadInfo);
-    args = NULL;
-    printLog(TRACE, "EXIT wsConnectionThread(args=%p) = {1}\n", args);
-    return 1;
-  }
-  
-  int returnValue = 0;
-  // Most requests will be GET requests, so check for that first.
-  if (strcmp((char*) method, "GET") == 0) {
-    returnValue = handleGetRequest(wsThreadInfo);
-  } else if (strcmp((char*) method, "POST") == 0) {
-    returnValue = handlePostRequest(wsThreadInfo);
-  } else {
-    printLog(WARN, "Received unsupported HTTP request method \"%s\".\n",
-      method);
-    returnValue = 1;
+    wsConnectionsAdd(listener->connections, wsThreadInfo);
+    if (listener->eventLoop != NULL) {
+      if (wsEventLoopAddConnection(listener->eventLoop,
+        &listener->nextReactor, wsThreadInfo) != 0
+      ) {
+        printLog(ERR, "Could not add connection to %s to event loop.\n",
+          socketAddress(clientSocket));
+        wsThreadInfo = wsThreadInfoDestroy(wsThreadInfo);
+      }
+      continue;
+    } else if (listener->coroutinePool != NULL) {
+      if (wsCoroutinePoolAddConnection(listener->coroutinePool,
+        &listener->nextReactor, wsThreadInfo) != 0
+      ) {
+        printLog(WARN, "Schedulers full.  Rejecting connection from %s.\n",
+          socketAddress(clientSocket));
+        wsRejectConnection(clientSocket, "503 Service Unavailable",
+          retryAfterSeconds, wsThreadInfo->metrics);
+        wsThreadInfo = wsThreadInfoDestroy(wsThreadInfo);
+      }
+      continue;
+    }
+    int status = wsWorkerPoolSubmit(workerPool,
+      wsConnectionThread, wsThreadInfoCancel, wsThreadInfo,
+      overloadPolicy == WS_OVERLOAD_STOP_ACCEPTING);
+    if (status == -1) {
+      printLog(WARN, "Request queue full.  Rejecting connection from %s.\n",
+        socketAddress(clientSocket));
+      wsRejectConnection(clientSocket, "503 Service Unavailable",
+        retryAfterSeconds, wsThreadInfo->metrics);
+      wsThreadInfo = wsThreadInfoDestroy(wsThreadInfo);
+    } else if (status != 0) {
+      printLog(ERR, "Could not queue connection to %s.\n",
+        socketAddress(clientSocket));
+      wsThreadInfo = wsThreadInfoDestroy(wsThreadInfo);
+    }
   }
+  wsArenaReleaseThreadChunks();
   
-  wsThreadInfo->body = NULL;
-  wsThreadInfo->httpParams = dictionaryDestroy(wsThreadInfo->httpParams);
-  fullReceiveBuffer = bytesDestroy(fullReceiveBuffer);
-  mtx_lock(wsThreadInfo->numRunningConnectionThreadsMutex);
-  (*wsThreadInfo->numRunningConnectionThreads)--;
-  mtx_unlock(wsThreadInfo->numRunningConnectionThreadsMutex);
-  clientSocket = socketDestroy(clientSocket);
-  
-  printLog(TRACE, "EXIT wsConnectionThread(args=%p) = {%d}\n", args, returnValue);
-  if (wsThreadInfo->webService.unregisterThread != NULL) {
-    wsThreadInfo->webService.unregisterThread(NULL);
+  printLog(TRACE, "EXIT wsListenerThread(index=%d) = {0}\n", listener->index);
+  if ((webService != NULL) && (webService->unregisterThread != NULL)) {
+    webService->unregisterThread(NULL);
   }
-  wsThreadInfo->redirectProtocol
-     = stringDestroy(wsThreadInfo->redirectProtocol);
-  wsThreadInfo->redirectProtocol = NULL;
-  wsThreadInfo->cookiesDict = dictionaryDestroy(wsThreadInfo->cookiesDict);
-  wsThreadInfo = (WsThreadInfo*) pointerDestroy(wsThreadInfo);
-  args = NULL;
-  return returnValue;
+  return 0;
 }
 
 /// @fn int wsInit(void *args)
 ///
-/// @brief Initialize the web server and poll for incoming requests.
+/// @brief Initialize the web server and start a thread to accept connections
+/// on each of its listening sockets.  Returns when all of them have exited.
 ///
 /// @param args A pointer to a WsInitArgs structure that initializes this
 ///   function.
@@ -1687,11 +11056,6 @@ int wsInit(void *args) {
   
   printLog(TRACE, "ENTER wsInit(args=%p)\n", args);
   
-  int portNumber = wsInitArgs->portNumber;
-  SocketMode socketMode = wsInitArgs->socketMode;
-  char *certificate = wsInitArgs->certificate;
-  char *key = wsInitArgs->key;
-  int timeout = wsInitArgs->timeout;
   char *interfacePath = NULL;
   straddstr(&interfacePath, wsInitArgs->interfacePath);
   char *serverName = NULL;
@@ -1701,12 +11065,12 @@ int wsInit(void *args) {
   // We can't copy wsInitArgs->redirectProtocol, wsInitArgs->redirectPort,
   // and wsInitArgs->redirectFunction because they may be dynamically changed
   // while we're running.
-  Socket *webServerSocket = NULL;
   
-  int *numRunningConnectionThreads = (int*) calloc(1, sizeof(int));
-  if (numRunningConnectionThreads == NULL) {
-    LOG_MALLOC_FAILURE();
-    printLog(NEVER, "EXIT wsInit(args=%p) = {-1}\n", args);
+  WsConnections *connections = wsConnectionsCreate();
+  if (connections == NULL) {
+    // System error.  Bail.  The reason has already been logged.
+    printLog(ERR, "Cannot start web server.\n");
+    printLog(TRACE, "EXIT wsInit(args=%p) = {-1}\n", args);
     if ((webService != NULL) && (webService->unregisterThread != NULL)) {
       webService->unregisterThread(NULL);
     }
@@ -1714,275 +11078,197 @@ int wsInit(void *args) {
     interfacePath = stringDestroy(interfacePath);
     return -1;
   }
-  mtx_t *numRunningConnectionThreadsMutex = (mtx_t*) calloc(1, sizeof(mtx_t));
-  if (numRunningConnectionThreadsMutex == NULL) {
-    LOG_MALLOC_FAILURE();
-    printLog(NEVER, "EXIT wsInit(args=%p) = {-1}\n", args);
+  
+  // Start the workers that will process requests.
+  WsWorkerPool *workerPool = wsInitArgs->workerPool;
+  WsOverloadPolicy overloadPolicy = wsInitArgs->overloadPolicy;
+  int retryAfterSeconds = wsInitArgs->retryAfterSeconds;
+  if (wsWorkerPoolStart(workerPool, wsInitArgs->numWorkerThreads, webService)
+    != 0
+  ) {
+    printLog(ERR, "Could not start worker pool.  Cannot start web server.\n");
+    printLog(TRACE, "EXIT wsInit(args=%p) = {-2}\n", args);
     if ((webService != NULL) && (webService->unregisterThread != NULL)) {
       webService->unregisterThread(NULL);
     }
-    numRunningConnectionThreads
-      = (int*) pointerDestroy(numRunningConnectionThreads);
+    connections = wsConnectionsDestroy(connections);
     serverName = stringDestroy(serverName);
     interfacePath = stringDestroy(interfacePath);
-    return -1;
+    return -2;
   }
-  if (mtx_init(numRunningConnectionThreadsMutex, mtx_plain) != thrd_success) {
-    // System error.  Bail.
-    printLog(ERR, "Could not initialize mutex.  Cannot start web server.\n");
-    printLog(TRACE, "EXIT wsInit(args=%p) = {-1}\n", args);
+  
+  // Determine how client connections will be serviced.
+  WsServerMode serverMode = wsInitArgs->serverMode;
+  WsEventLoop *eventLoop = NULL;
+  WsCoroutinePool *coroutinePool = NULL;
+#ifndef __linux__
+  if ((serverMode == WS_EVENT_LOOP) || (serverMode == WS_COROUTINES)) {
+    printLog(WARN, "%s is not supported on this platform.  Using %s.\n",
+      WsServerModeNames[serverMode], WsServerModeNames[WS_THREADED]);
+    serverMode = WS_THREADED;
+  }
+#else // __linux__
+  if (serverMode == WS_EVENT_LOOP) {
+    eventLoop = wsEventLoopCreate(wsInitArgs->numReactorThreads, workerPool,
+      overloadPolicy, retryAfterSeconds, webService);
+    if (eventLoop == NULL) {
+      printLog(WARN, "Could not create event loop.  Using %s.\n",
+        WsServerModeNames[WS_THREADED]);
+      serverMode = WS_THREADED;
+    }
+  } else if (serverMode == WS_COROUTINES) {
+    coroutinePool = wsCoroutinePoolCreate(wsInitArgs->numSchedulerThreads,
+      wsInitArgs->coroutineStackSize, wsInitArgs->maxCoroutinesPerThread,
+      webService);
+    if (coroutinePool == NULL) {
+      printLog(WARN, "Could not create coroutine schedulers.  Using %s.\n",
+        WsServerModeNames[WS_THREADED]);
+      serverMode = WS_THREADED;
+    }
+  }
+#endif // __linux__
+  
+  // Compile the web service functions into the route table.
+  WsRouteTable *routeTable = NULL;
+  if ((webService != NULL) && (webService->namespaces != NULL)) {
+    routeTable = wsRouteTableCreate(webService->namespaces);
+    if (routeTable == NULL) {
+      // Cannot run the intended web services.  The appropriate error (malloc
+      // failure) has already been logged, so just bail.
+      printLog(NEVER, "EXIT wsInit(args=%p) = {-4}\n", args);
+      if ((webService != NULL) && (webService->unregisterThread != NULL)) {
+        webService->unregisterThread(NULL);
+      }
+      eventLoop = wsEventLoopDestroy(eventLoop);
+      coroutinePool = wsCoroutinePoolDestroy(coroutinePool);
+      wsWorkerPoolStop(workerPool);
+      connections = wsConnectionsDestroy(connections);
+      serverName = stringDestroy(serverName);
+      interfacePath = stringDestroy(interfacePath);
+      return -4;
+    }
+  }
+  
+  if (wsInitArgs->accessLog != NULL) {
+    // Not fatal.  Records without names can still be decoded.
+    wsAccessLogSetNames(wsInitArgs->accessLog, routeTable);
+  }
+  
+  // Open the listening sockets.  Only the first one waits for the port to
+  // become available.  The others share the port with it.
+  int numListeners = wsInitArgs->numListeners;
+#ifndef SO_REUSEPORT
+  if (numListeners > 1) {
+    printLog(WARN,
+      "Multiple listeners are not supported on this platform.  Using 1.\n");
+    numListeners = 1;
+  }
+#endif // SO_REUSEPORT
+  WsListener *listeners = wsInitArgs->listeners;
+  for (int i = 0; i < numListeners; i++) {
+    WsListener *listener = &listeners[i];
+    listener->webServer = wsInitArgs;
+    listener->index = i;
+    listener->socketOptions = (numListeners > 1) ? SOCKET_REUSE_PORT : 0;
+    listener->nextReactor = i;
+    listener->interfacePath = interfacePath;
+    listener->serverName = serverName;
+    listener->routeTable = routeTable;
+    listener->connections = connections;
+    listener->eventLoop = eventLoop;
+    listener->coroutinePool = coroutinePool;
+    listener->socket = wsListenerCreateSocket(listener, i == 0);
+    if (listener->socket != NULL) {
+      continue;
+    } else if (i > 0) {
+      printLog(WARN, "Using %d listeners instead of %d.\n", i, numListeners);
+      numListeners = i;
+      break;
+    }
+    
+    routeTable = wsRouteTableDestroy(routeTable);
+    connections = wsConnectionsDestroy(connections);
+    eventLoop = wsEventLoopDestroy(eventLoop);
+    coroutinePool = wsCoroutinePoolDestroy(coroutinePool);
+    wsWorkerPoolStop(workerPool);
+    printLog(TRACE, "EXIT wsInit(args=%p) = {-3}\n", args);
     if ((webService != NULL) && (webService->unregisterThread != NULL)) {
       webService->unregisterThread(NULL);
     }
-    numRunningConnectionThreadsMutex
-      = (mtx_t*) pointerDestroy(numRunningConnectionThreadsMutex);
-    numRunningConnectionThreads
-      = (int*) pointerDestroy(numRunningConnectionThreads);
     serverName = stringDestroy(serverName);
     interfacePath = stringDestroy(interfacePath);
-    return -2;
+    return -3;
   }
+  wsInitArgs->numListeners = numListeners;
   
-  Socket *clientSocket = NULL;
-  WsThreadInfo *wsThreadInfo = NULL;
-  
-  char *address = NULL;
-  HashTable *webServiceFunctions = NULL;
-  bool initNeeded = true;
-  while (initNeeded == true) {
-    initNeeded = false;
-    
-    if (asprintf(&address, "0.0.0.0:%d", portNumber) < 0) {
-      address = NULL;
-    }
-    webServerSocket = socketCreate(SERVER, TCP, address,
-      socketMode, certificate, key);
-    if (webServerSocket == NULL) {
-      printLog(WARN, "Could not create %s web server socket.\n",
-        SocketModeNames[socketMode]);
-      if (timeout > 0) {
-        printLog(WARN, "Retrying for up to %d seconds.\n", timeout);
-      } else {
-        printLog(WARN, "Retrying until successful.\n");
-      }
-      for (int i = 0;
-        ((i < timeout) || (timeout == 0)) && (wsInitArgs != NULL)
-          && (webServerSocket == NULL) && (wsInitArgs->exitNow == false);
-        i++
-      ) {
-        sleep(1);
-        webServerSocket = socketCreate(SERVER, TCP, address,
-          socketMode, certificate, key);
-      }
-      if (webServerSocket == NULL) {
-        printLog(ERR, "Could not create %s web server socket.\n",
-          SocketModeNames[socketMode]);
-        address = stringDestroy(address);
-        mtx_destroy(numRunningConnectionThreadsMutex);
-        numRunningConnectionThreadsMutex
-          = (mtx_t*) pointerDestroy(numRunningConnectionThreadsMutex);
-        numRunningConnectionThreads
-          = (int*) pointerDestroy(numRunningConnectionThreads);
-        printLog(TRACE, "EXIT wsInit(args=%p) = {-3}\n", args);
-        if ((webService != NULL) && (webService->unregisterThread != NULL)) {
-          webService->unregisterThread(NULL);
-        }
-        serverName = stringDestroy(serverName);
-        interfacePath = stringDestroy(interfacePath);
-        return -3;
-      }
-    }
-    address = stringDestroy(address);
-    
-    // Construct the web service lookup table.
-    if ((webService != NULL) && (webService->namespaces != NULL)) {
-      webServiceFunctions = htCreate(typeString);
-      for (WsNamespace *wsNamespace = webService->namespaces;
-        wsNamespace->name != NULL;
-        wsNamespace++
-      ) {
-        HashTable *namespaceFunctions = htCreate(typeString);
-        if (namespaceFunctions == NULL) {
-          LOG_MALLOC_FAILURE();
-          webServiceFunctions = htDestroy(webServiceFunctions);
-          break;
-        }
-        for (WsFunctionDescriptor **wsFdList = wsNamespace->functionDescriptors;
-          *wsFdList != NULL;
-          wsFdList++
-        ) {
-          for (WsFunctionDescriptor *wsFdCommand = *wsFdList;
-            wsFdCommand->name != NULL;
-            wsFdCommand++
-          ) {
-            if (htAddEntry(namespaceFunctions,
-              wsFdCommand->name, (void*) wsFdCommand->pointer, typePointerNoCopy) == NULL
-            ) {
-              LOG_MALLOC_FAILURE();
-              namespaceFunctions = htDestroy(namespaceFunctions);
-              webServiceFunctions = htDestroy(webServiceFunctions);
-              break;
-            }
-          }
-          if (namespaceFunctions == NULL) {
-            // malloc failure has already been logged.  Exit the loop.
-            break;
-          }
-        }
-        if (namespaceFunctions == NULL) {
-          // malloc failure has already been logged.  Exit the loop.
-          break;
-        }
-        HashNode *node = htAddEntry(webServiceFunctions,
-          wsNamespace->name, namespaceFunctions, typeHashTableNoCopy);
-        if (node == NULL) {
-          LOG_MALLOC_FAILURE();
-          namespaceFunctions = htDestroy(namespaceFunctions);
-          webServiceFunctions = htDestroy(webServiceFunctions);
-        }
-        node->type = typeHashTable;
-      }
-      if (webServiceFunctions == NULL) {
-        // Cannot run the intended web services.  The appropriate error (malloc
-        // failure) has already been logged, so just bail.
-        printLog(NEVER, "EXIT wsInit(args=%p) = {-4}\n", args);
-        if ((webService != NULL) && (webService->unregisterThread != NULL)) {
-          webService->unregisterThread(NULL);
-        }
-        webServerSocket = socketDestroy(webServerSocket);
-        mtx_destroy(numRunningConnectionThreadsMutex);
-        numRunningConnectionThreadsMutex
-          = (mtx_t*) pointerDestroy(numRunningConnectionThreadsMutex);
-        numRunningConnectionThreads
-          = (int*) pointerDestroy(numRunningConnectionThreads);
-        serverName = stringDestroy(serverName);
-        interfacePath = stringDestroy(interfacePath);
-        return -4;
-      }
+  // Start an accept thread for each listener.  A listener without a thread
+  // must not keep its socket or the kernel would keep giving it connections.
+  for (int i = 0; i < numListeners; i++) {
+    if (thrd_create(&listeners[i].threadId,
+      wsListenerThread, &listeners[i]) == thrd_success
+    ) {
+      listeners[i].threadStarted = true;
+    } else {
+      printLog(ERR, "Could not start accept thread for listener %d.\n", i);
+      listeners[i].socket = socketDestroy(listeners[i].socket);
     }
-    
-    // Signal to anyone above us that we're running.
-    wsInitArgs->socket = webServerSocket;
-    wsInitArgs->isRunning = true;
-    
-    while (wsInitArgs->exitNow == false) {
-      thrd_t myThread;
-      
-      clientSocket = socketAccept(webServerSocket);
-      if (wsInitArgs->exitNow == true) {
-        // We've been told to exit.  Do not proceed.  Socket may not be valid.
-        clientSocket = socketDestroy(clientSocket);
-        break;
-      }
-      
-      if (clientSocket == NULL) {
-        printLog(ERR, "Error connecting to client!\n");
-        if (wsInitArgs->socket != NULL) {
-#ifndef _MSC_VER
-          // On POSIX, errno is either EAGAIN or EWOULDBLOCK.
-          if ((errno == EBADF) && (wsInitArgs->exitNow == false))
-#else // _MSC_VER defined
-          // On Windows, the non-blocking socket should make WSAGetLastError
-          // return WSAEWOULDBLOCK.
-          if ((WSAGetLastError() == WSAEBADF) && (wsInitArgs->exitNow == false))
-#endif
-          {
-            webServerSocket = socketDestroy(webServerSocket);
-            webServiceFunctions = htDestroy(webServiceFunctions);
-            // This will start us back at the outer while loop
-            initNeeded = true;
-            break;
-          } else {
-            continue;
-          }
-        } else {
-          // The server socket has been destroyed and is no longer valid.
-          // Exit the while loop.
-          // This probably indicates that a non-main thread is trying to restart
-          // the server, possibly a subordinate thread.  Decrement our count
-          // of connection threads accordingly to avoid cirular dependencies.
-          break;
-        }
-      }
-      
-      wsThreadInfo =
-        (WsThreadInfo*) calloc(1, sizeof(WsThreadInfo));
-      if (wsThreadInfo == NULL) {
-        // Out of memory.  Continue?
-        // TODO:  Should we do something else here?
-        LOG_MALLOC_FAILURE();
-        clientSocket = socketDestroy(clientSocket);
-        continue;
-      }
-      wsThreadInfo->clientSocket = clientSocket;
-      wsThreadInfo->interfacePath = interfacePath;
-      wsThreadInfo->serverName = serverName;
-      if (webService != NULL) {
-        wsThreadInfo->webService = *webService;
-        wsThreadInfo->webServiceFunctions = webServiceFunctions;
-      }
-      wsThreadInfo->numRunningConnectionThreads
-        = numRunningConnectionThreads;
-      wsThreadInfo->numRunningConnectionThreadsMutex
-        = numRunningConnectionThreadsMutex;
-      // See the note at the beginning of the function about why we can't use a
-      // simple pointer for redirectProtocol.
-      if (wsInitArgs->redirectProtocol != NULL) {
-        straddstr(&wsThreadInfo->redirectProtocol,
-          wsInitArgs->redirectProtocol);
-      } // else wsThreadInfo->redirectProtocol is already NULL from calloc
-      wsThreadInfo->redirectPort = wsInitArgs->redirectPort;
-      wsThreadInfo->redirectFunction = wsInitArgs->redirectFunction;
-
-      mtx_lock(numRunningConnectionThreadsMutex);
-      (*numRunningConnectionThreads)++;
-      mtx_unlock(numRunningConnectionThreadsMutex);
-      if (thrd_create(&myThread,
-        wsConnectionThread, (void*) wsThreadInfo) == thrd_success
-      ) {
-        thrd_detach(myThread);
-      } else {
-        // Creating the thread failed.  Clean up the memory it should have freed.
-        // TODO:  This indicates a system problem.  Should we do something else?
-        printLog(ERR, "Could not create thread for connection to %s.\n",
-          socketAddress(clientSocket));
-        mtx_lock(numRunningConnectionThreadsMutex);
-        (*numRunningConnectionThreads)--;
-        mtx_unlock(numRunningConnectionThreadsMutex);
-        clientSocket = socketDestroy(clientSocket);
-        wsThreadInfo = (WsThreadInfo*) pointerDestroy(wsThreadInfo);
-      }
+  }
+  
+  // Signal to anyone above us that we're running.
+  wsInitArgs->socket = listeners[0].socket;
+  wsInitArgs->isRunning = true;
+  
+  // The accept threads exit when webServerDestroy destroys their sockets.
+  for (int i = 0; i < numListeners; i++) {
+    if (listeners[i].threadStarted == true) {
+      thrd_join(listeners[i].threadId, NULL);
     }
   }
-
-  // Block until all threads have exited.  This is to avoid segmentation faults
-  // in the threads if they attempt to access any of the variables we free.
-  while (((*numRunningConnectionThreads) > 0)
-    && (wsInitArgs->exitNow == false)
-  );
-  mtx_lock(numRunningConnectionThreadsMutex);
-  if (numRunningConnectionThreads == 0) {
+  
+  // Drain.  Now that exitNow is set, idle persistent connections close
+  // themselves and requests that are in progress get until the deadline to
+  // complete.  Connections that are still open after that are forced closed
+  // so that stopping the workers doesn't wait on a slow or stalled client.
+  struct timespec deadline;
+  wsMonotonicTime(&deadline);
+  if (wsInitArgs->drainTimeoutSeconds > 0) {
+    deadline.tv_sec += wsInitArgs->drainTimeoutSeconds;
+  }
+  int drainStatus = (coroutinePool != NULL)
+    ? wsCoroutinePoolDrain(coroutinePool, &deadline)
+    : wsWorkerPoolDrain(workerPool, &deadline);
+  if (drainStatus != 0) {
+    printLog(WARN, "Requests did not drain in time.  Forcing %d connections "
+      "closed.\n", wsConnectionsShutdown(connections));
+  }
+  
+  // Stop the event loop (if any).  This closes every connection it owns.
+  eventLoop = wsEventLoopDestroy(eventLoop);
+  // Stop the schedulers (if any).  They exit as their connections close.
+  coroutinePool = wsCoroutinePoolDestroy(coroutinePool);
+  // Stop the worker pool.  Requests in progress are completed and queued
+  // connections are closed.
+  wsWorkerPoolStop(workerPool);
+  
+  mtx_lock(&connections->lock);
+  int numConnections = connections->numConnections;
+  mtx_unlock(&connections->lock);
+  if (numConnections == 0) {
     // The server socket was destroyed and all subordinate threads have exited.
     // This is a clean exit and it's safe to destroy and free what the
     // subordinate threads depend on.
-    mtx_unlock(numRunningConnectionThreadsMutex);
-    mtx_destroy(numRunningConnectionThreadsMutex);
-    numRunningConnectionThreadsMutex
-      = (mtx_t*) pointerDestroy(numRunningConnectionThreadsMutex);
-    numRunningConnectionThreads
-      = (int*) pointerDestroy(numRunningConnectionThreads);
-    if (webServiceFunctions != NULL) {
-      webServiceFunctions = htDestroy(webServiceFunctions);
-    }
+    connections = wsConnectionsDestroy(connections);
+    routeTable = wsRouteTableDestroy(routeTable);
     serverName = stringDestroy(serverName);
     interfacePath = stringDestroy(interfacePath);
   } else {
-    mtx_unlock(numRunningConnectionThreadsMutex);
+    // We're in an emergency exit situation and there may be subordinate
+    // threads running.  In order to avoid them segfaulting and causing more
+    // (and misleading) problems, don't clean up the memory.  This will cause a
+    // memory leak but we don't care because we're about to exit the entire
+    // process.
+    printLog(ERR, "%d connections are still open.\n", numConnections);
   }
-  // else we're in an emergency exit situation and there may be subordinate
-  // threads running.  In order to avoid them segfaulting and causing more (and
-  // misleading) problems, don't clean up the memory.  This will cause a memory
-  // leak but we don't care because we're about to exit the entire process.
   wsInitArgs->isRunning = false;
 
   printLog(TRACE, "EXIT wsInit(args=%p) = {0}\n", args);
@@ -2110,6 +11396,71 @@ WebServer* webServerCreate(int portNumber, WebServerCreateOptions *options) {
     webServer->redirectPort = options->redirectPort;
     webServer->redirectFunction = options->redirectFunction;
     webServer->webService = options->webService;
+    webServer->serverMode = options->serverMode;
+    webServer->numReactorThreads = (options->numReactorThreads > 0)
+      ? options->numReactorThreads : WS_DEFAULT_NUM_REACTOR_THREADS;
+    webServer->numSchedulerThreads = (options->numSchedulerThreads > 0)
+      ? options->numSchedulerThreads : WS_DEFAULT_NUM_SCHEDULER_THREADS;
+    webServer->coroutineStackSize = (options->coroutineStackSize > 0)
+      ? options->coroutineStackSize : WS_DEFAULT_COROUTINE_STACK_SIZE;
+    webServer->maxCoroutinesPerThread = (options->maxCoroutinesPerThread > 0)
+      ? options->maxCoroutinesPerThread : WS_DEFAULT_MAX_COROUTINES_PER_THREAD;
+    webServer->numWorkerThreads = (options->numWorkerThreads > 0)
+      ? options->numWorkerThreads : WS_DEFAULT_NUM_WORKER_THREADS;
+    webServer->maxQueuedRequests = (options->maxQueuedRequests > 0)
+      ? options->maxQueuedRequests : WS_DEFAULT_MAX_QUEUED_REQUESTS;
+    webServer->overloadPolicy = options->overloadPolicy;
+    webServer->retryAfterSeconds = (options->retryAfterSeconds > 0)
+      ? options->retryAfterSeconds : WS_DEFAULT_RETRY_AFTER_SECONDS;
+    webServer->keepAliveTimeoutSeconds = (options->keepAliveTimeoutSeconds > 0)
+      ? options->keepAliveTimeoutSeconds
+      : WS_DEFAULT_KEEP_ALIVE_TIMEOUT_SECONDS;
+    webServer->maxRequestsPerConnection
+      = (options->maxRequestsPerConnection > 0)
+      ? options->maxRequestsPerConnection
+      : WS_DEFAULT_MAX_REQUESTS_PER_CONNECTION;
+    webServer->fileCacheMaxBytes = (options->fileCacheMaxBytes != 0)
+      ? options->fileCacheMaxBytes : WS_DEFAULT_FILE_CACHE_MAX_BYTES;
+    webServer->compressionLevel = (options->compressionLevel != 0)
+      ? options->compressionLevel : WS_DEFAULT_COMPRESSION_LEVEL;
+    webServer->compressionMinBytes = (options->compressionMinBytes > 0)
+      ? options->compressionMinBytes : WS_DEFAULT_COMPRESSION_MIN_BYTES;
+    webServer->maxRequestBodyBytes = (options->maxRequestBodyBytes != 0)
+      ? options->maxRequestBodyBytes : WS_DEFAULT_MAX_REQUEST_BODY_BYTES;
+    webServer->requestBodyMemoryBytes = (options->requestBodyMemoryBytes != 0)
+      ? options->requestBodyMemoryBytes : WS_DEFAULT_REQUEST_BODY_MEMORY_BYTES;
+    webServer->numListeners = (options->numListeners > 0)
+      ? options->numListeners : WS_DEFAULT_NUM_LISTENERS;
+    webServer->pinListeners = options->pinListeners;
+    if (options->metricsPath == NULL) {
+      straddstr(&webServer->metricsPath, WS_DEFAULT_METRICS_PATH);
+    } else if (options->metricsPath[0] != '\0') {
+      straddstr(&webServer->metricsPath, options->metricsPath);
+    } // else the metrics endpoint is disabled
+    if (options->batchPath == NULL) {
+      straddstr(&webServer->batchPath, WS_DEFAULT_BATCH_PATH);
+    } else if (options->batchPath[0] != '\0') {
+      straddstr(&webServer->batchPath, options->batchPath);
+    } // else the batch endpoint is disabled
+    webServer->maxBatchCalls = (options->maxBatchCalls != 0)
+      ? options->maxBatchCalls : WS_DEFAULT_MAX_BATCH_CALLS;
+    webServer->parallelBatchCalls = options->parallelBatchCalls;
+    webServer->traceSampleRate = (options->traceSampleRate != 0)
+      ? options->traceSampleRate : WS_DEFAULT_TRACE_SAMPLE_RATE;
+    webServer->accessLogRotateSeconds = (options->accessLogRotateSeconds != 0)
+      ? options->accessLogRotateSeconds : WS_DEFAULT_ACCESS_LOG_ROTATE_SECONDS;
+    webServer->drainTimeoutSeconds = (options->drainTimeoutSeconds != 0)
+      ? options->drainTimeoutSeconds : WS_DEFAULT_DRAIN_TIMEOUT_SECONDS;
+    webServer->tlsSessionCacheSize = (options->tlsSessionCacheSize != 0)
+      ? options->tlsSessionCacheSize : WS_DEFAULT_TLS_SESSION_CACHE_SIZE;
+    webServer->tlsSessionTimeoutSeconds
+      = (options->tlsSessionTimeoutSeconds > 0)
+      ? options->tlsSessionTimeoutSeconds
+      : WS_DEFAULT_TLS_SESSION_TIMEOUT_SECONDS;
+    webServer->tlsTicketKeyLifetimeSeconds
+      = (options->tlsTicketKeyLifetimeSeconds != 0)
+      ? options->tlsTicketKeyLifetimeSeconds
+      : WS_DEFAULT_TLS_TICKET_KEY_LIFETIME_SECONDS;
   } else {
     // Provide defaults for all the information.
     straddstr(&webServer->interfacePath, NULL);
@@ -2122,12 +11473,171 @@ WebServer* webServerCreate(int portNumber, WebServerCreateOptions *options) {
     webServer->redirectPort = 0;
     webServer->redirectFunction = NULL;
     webServer->webService = NULL;
+    webServer->serverMode = WS_THREADED;
+    webServer->numReactorThreads = WS_DEFAULT_NUM_REACTOR_THREADS;
+    webServer->numSchedulerThreads = WS_DEFAULT_NUM_SCHEDULER_THREADS;
+    webServer->coroutineStackSize = WS_DEFAULT_COROUTINE_STACK_SIZE;
+    webServer->maxCoroutinesPerThread = WS_DEFAULT_MAX_COROUTINES_PER_THREAD;
+    webServer->numWorkerThreads = WS_DEFAULT_NUM_WORKER_THREADS;
+    webServer->maxQueuedRequests = WS_DEFAULT_MAX_QUEUED_REQUESTS;
+    webServer->overloadPolicy = WS_OVERLOAD_REJECT;
+    webServer->retryAfterSeconds = WS_DEFAULT_RETRY_AFTER_SECONDS;
+    webServer->keepAliveTimeoutSeconds = WS_DEFAULT_KEEP_ALIVE_TIMEOUT_SECONDS;
+    webServer->maxRequestsPerConnection
+      = WS_DEFAULT_MAX_REQUESTS_PER_CONNECTION;
+    webServer->fileCacheMaxBytes = WS_DEFAULT_FILE_CACHE_MAX_BYTES;
+    webServer->compressionLevel = WS_DEFAULT_COMPRESSION_LEVEL;
+    webServer->compressionMinBytes = WS_DEFAULT_COMPRESSION_MIN_BYTES;
+    webServer->maxRequestBodyBytes = WS_DEFAULT_MAX_REQUEST_BODY_BYTES;
+    webServer->requestBodyMemoryBytes = WS_DEFAULT_REQUEST_BODY_MEMORY_BYTES;
+    webServer->numListeners = WS_DEFAULT_NUM_LISTENERS;
+    webServer->pinListeners = false;
+    straddstr(&webServer->metricsPath, WS_DEFAULT_METRICS_PATH);
+    straddstr(&webServer->batchPath, WS_DEFAULT_BATCH_PATH);
+    webServer->maxBatchCalls = WS_DEFAULT_MAX_BATCH_CALLS;
+    webServer->parallelBatchCalls = false;
+    // webServer->traceBuffer is already NULL from calloc
+    webServer->traceSampleRate = WS_DEFAULT_TRACE_SAMPLE_RATE;
+    // webServer->accessLog is already NULL from calloc
+    webServer->accessLogRotateSeconds = WS_DEFAULT_ACCESS_LOG_ROTATE_SECONDS;
+    webServer->drainTimeoutSeconds = WS_DEFAULT_DRAIN_TIMEOUT_SECONDS;
+    webServer->tlsSessionCacheSize = WS_DEFAULT_TLS_SESSION_CACHE_SIZE;
+    webServer->tlsSessionTimeoutSeconds
+      = WS_DEFAULT_TLS_SESSION_TIMEOUT_SECONDS;
+    webServer->tlsTicketKeyLifetimeSeconds
+      = WS_DEFAULT_TLS_TICKET_KEY_LIFETIME_SECONDS;
+  }
+  if (webServer->fileCacheMaxBytes < 0) {
+    // Caching is disabled.
+    webServer->fileCacheMaxBytes = 0;
+  }
+  if (webServer->compressionLevel < 0) {
+    // Compression is disabled.
+    webServer->compressionLevel = 0;
+  } else if (webServer->compressionLevel > MZ_BEST_COMPRESSION) {
+    webServer->compressionLevel = MZ_BEST_COMPRESSION;
+  }
+  if (webServer->maxRequestBodyBytes < 0) {
+    // There is no limit.
+    webServer->maxRequestBodyBytes = 0;
+  }
+  if (webServer->requestBodyMemoryBytes < 0) {
+    // Bodies are never spooled.
+    webServer->requestBodyMemoryBytes = 0;
+  }
+  if (webServer->maxBatchCalls < 0) {
+    // There is no limit.
+    webServer->maxBatchCalls = 0;
+  }
+  
+  webServer->listeners
+    = (WsListener*) calloc(webServer->numListeners, sizeof(WsListener));
+  if (webServer->listeners == NULL) {
+    LOG_MALLOC_FAILURE();
+    webServer->interfacePath = stringDestroy(webServer->interfacePath);
+    webServer->serverName = stringDestroy(webServer->serverName);
+    webServer->certificate = stringDestroy(webServer->certificate);
+    webServer->key = stringDestroy(webServer->key);
+    webServer->redirectProtocol = stringDestroy(webServer->redirectProtocol);
+    webServer->metricsPath = stringDestroy(webServer->metricsPath);
+    webServer->batchPath = stringDestroy(webServer->batchPath);
+    webServer = (WebServer*) pointerDestroy(webServer);
+    return NULL;
+  }
+  
+  webServer->metrics = (WsMetrics*) calloc(1, sizeof(WsMetrics));
+  if (webServer->metrics == NULL) {
+    LOG_MALLOC_FAILURE();
+    webServer->listeners = (WsListener*) pointerDestroy(webServer->listeners);
+    webServer->interfacePath = stringDestroy(webServer->interfacePath);
+    webServer->serverName = stringDestroy(webServer->serverName);
+    webServer->certificate = stringDestroy(webServer->certificate);
+    webServer->key = stringDestroy(webServer->key);
+    webServer->redirectProtocol = stringDestroy(webServer->redirectProtocol);
+    webServer->metricsPath = stringDestroy(webServer->metricsPath);
+    webServer->batchPath = stringDestroy(webServer->batchPath);
+    webServer = (WebServer*) pointerDestroy(webServer);
+    return NULL;
+  }
+  
+  // The client table is only needed if there are per-client limits.
+  if ((options != NULL) && ((options->maxConnectionsPerClient > 0)
+    || ((options->rateLimits != NULL)
+      && (options->rateLimits[0].namespaceName != NULL)))
+  ) {
+    webServer->clientTable = wsClientTableCreate(
+      options->maxConnectionsPerClient, options->rateLimits);
+    if (webServer->clientTable == NULL) {
+      printLog(ERR, "Cannot create client table.\n");
+      webServer->metrics = (WsMetrics*) pointerDestroy(webServer->metrics);
+      webServer->listeners
+        = (WsListener*) pointerDestroy(webServer->listeners);
+      webServer->interfacePath = stringDestroy(webServer->interfacePath);
+      webServer->serverName = stringDestroy(webServer->serverName);
+      webServer->certificate = stringDestroy(webServer->certificate);
+      webServer->key = stringDestroy(webServer->key);
+      webServer->redirectProtocol
+        = stringDestroy(webServer->redirectProtocol);
+      webServer->metricsPath = stringDestroy(webServer->metricsPath);
+      webServer->batchPath = stringDestroy(webServer->batchPath);
+      webServer = (WebServer*) pointerDestroy(webServer);
+      return NULL;
+    }
+  }
+  
+  webServer->workerPool = wsWorkerPoolCreate(webServer->maxQueuedRequests);
+  if (webServer->workerPool == NULL) {
+    printLog(ERR, "Cannot create worker pool.\n");
+    webServer->clientTable = wsClientTableDestroy(webServer->clientTable);
+    webServer->metrics = (WsMetrics*) pointerDestroy(webServer->metrics);
+    webServer->listeners = (WsListener*) pointerDestroy(webServer->listeners);
+    webServer->interfacePath = stringDestroy(webServer->interfacePath);
+    webServer->serverName = stringDestroy(webServer->serverName);
+    webServer->certificate = stringDestroy(webServer->certificate);
+    webServer->key = stringDestroy(webServer->key);
+    webServer->redirectProtocol = stringDestroy(webServer->redirectProtocol);
+    webServer->metricsPath = stringDestroy(webServer->metricsPath);
+    webServer->batchPath = stringDestroy(webServer->batchPath);
+    webServer = (WebServer*) pointerDestroy(webServer);
+    return NULL;
+  }
+  
+  if (webServer->fileCacheMaxBytes > 0) {
+    webServer->fileCache
+      = wsFileCacheCreate((u64) webServer->fileCacheMaxBytes);
+    if (webServer->fileCache == NULL) {
+      // Not fatal.  Files will just be read from disk on every request.
+      printLog(WARN, "Cannot create file cache.  File caching disabled.\n");
+      webServer->fileCacheMaxBytes = 0;
+    }
+  }
+  
+  if ((options != NULL) && (options->traceFilePath != NULL)
+    && (options->traceFilePath[0] != '\0')
+  ) {
+    webServer->traceBuffer = traceBufferCreate(options->traceFilePath, 0);
+    if (webServer->traceBuffer == NULL) {
+      // Not fatal.  Requests just won't be traced.
+      printLog(WARN, "Cannot create trace buffer.  Tracing disabled.\n");
+    }
+  }
+  
+  if ((options != NULL) && (options->accessLogPath != NULL)
+    && (options->accessLogPath[0] != '\0')
+  ) {
+    webServer->accessLog = accessLogCreate(options->accessLogPath,
+      webServer->accessLogRotateSeconds);
+    if (webServer->accessLog == NULL) {
+      // Not fatal.  Requests just won't be logged.
+      printLog(WARN, "Cannot create access log.  Access log disabled.\n");
+    }
   }
   
   // webServer->socket is initialized to NULL, webServer->threadId is
   // initialized to 0, and webServer->isRunning and webServer->exitNow are
   // initialized to false by calloc above.  webServer->socket will be set by
-  // wsInit if socket creation is successful before the specified timeout.
+  // wsInit to the first listener's socket if socket creation is successful
+  // before the specified timeout.
   // webServer->isRunning will be set to true once everything necessary for the
   // server and services is configured and running.
   if (thrd_create(&webServer->threadId,
@@ -2179,23 +11689,48 @@ WebServer* webServerDestroy(WebServer *webServer) {
     return NULL;
   }
   
-  // Attempt a graceful exit first.
+  // Attempt a graceful exit first.  Destroying the listening sockets wakes up
+  // the accept threads and the server thread then drains the connections that
+  // are open.  Give it the drain timeout plus enough time for the connections
+  // that are forced closed at the end of it to notice.
   webServer->exitNow = true;
-  webServer->socket = socketDestroy(webServer->socket);
-  int numMilliseconds = 0;
-  while ((webServer->isRunning) && (numMilliseconds < 100)) {
+  webServer->socket = NULL;
+  for (int i = 0; i < webServer->numListeners; i++) {
+    webServer->listeners[i].socket
+      = socketDestroy(webServer->listeners[i].socket);
+  }
+  u64 maxWaitUs = ((u64) WS_FORCE_CLOSE_GRACE_SECONDS) * 1000000;
+  if (webServer->drainTimeoutSeconds > 0) {
+    maxWaitUs += ((u64) webServer->drainTimeoutSeconds) * 1000000;
+  }
+  struct timespec startTime;
+  wsMonotonicTime(&startTime);
+  while ((webServer->isRunning)
+    && (wsElapsedMicroseconds(&startTime) < maxWaitUs)
+  ) {
     wsMsleep(1);
-    ++numMilliseconds;
   }
   
   int result = 0;
   if (!webServer->isRunning) {
     // This is the expected case.
     thrd_join(webServer->threadId, &result);
+    webServer->workerPool = wsWorkerPoolDestroy(webServer->workerPool);
+    webServer->fileCache = wsFileCacheDestroy(webServer->fileCache);
+    webServer->traceBuffer = traceBufferDestroy(webServer->traceBuffer);
+    webServer->accessLog = accessLogDestroy(webServer->accessLog);
+    webServer->listeners = (WsListener*) pointerDestroy(webServer->listeners);
+    webServer->metrics = (WsMetrics*) pointerDestroy(webServer->metrics);
+    webServer->metricsPath = stringDestroy(webServer->metricsPath);
+    webServer->batchPath = stringDestroy(webServer->batchPath);
+    webServer->clientTable = wsClientTableDestroy(webServer->clientTable);
   } else {
     printLog(ERR, "Web server thread did not exit.\n");
     printLog(ERR, "Freeing remaining resources.\n");
     thrd_detach(webServer->threadId);
+    // The server thread may still be using the worker pool, file cache, trace
+    // buffer, access log, listeners, metrics, and client table, so they have
+    // to be leaked.
     result = -1;
   }
   
@@ -2211,6 +11746,40 @@ WebServer* webServerDestroy(WebServer *webServer) {
   return NULL;
 }
 
+/// @fn int webServerGetStats(WebServer *webServer, WebServerStats *stats)
+///
+/// @brief Get a snapshot of the load on a web server's worker pool and the
+/// state of its file cache.
+///
+/// @param webServer A pointer to a WebServer previously returned by
+///   webServerCreate.
+/// @param stats A pointer to the WebServerStats to populate.
+///
+/// @return Returns 0 on success, -1 on failure.
+int webServerGetStats(WebServer *webServer, WebServerStats *stats) {
+  if ((webServer == NULL) || (webServer->workerPool == NULL)
+    || (stats == NULL)
+  ) {
+    return -1;
+  }
+  
+  WsWorkerPool *pool = webServer->workerPool;
+  mtx_lock(&pool->lock);
+  *stats = pool->stats;
+  mtx_unlock(&pool->lock);
+  
+  WsFileCache *fileCache = webServer->fileCache;
+  if (fileCache != NULL) {
+    mtx_lock(&fileCache->lock);
+    stats->numFileCacheHits = fileCache->numHits;
+    stats->numFileCacheMisses = fileCache->numMisses;
+    stats->fileCacheBytes = fileCache->numBytes;
+    mtx_unlock(&fileCache->lock);
+  }
+  
+  return 0;
+}
+
 /// @var _mimeTypes
 ///
 /// @brief File-extension to MIME type mapping array.
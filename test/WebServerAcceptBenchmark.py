@@ -0,0 +1,209 @@
+#!/usr/bin/env python
+################################################################################
+##                                                                            ##
+##                   (c) Copyright 2012-2024 Skymond, LLC.                    ##
+##                                                                            ##
+##                            https://skymond.io                              ##
+##                                                                            ##
+## Permission is hereby granted, free of charge, to any person obtaining a    ##
+## copy of this software and associated documentation files (the "Software"), ##
+## to deal in the Software without restriction, including without limitation  ##
+## the rights to use, copy, modify, merge, publish, distribute, sublicense,   ##
+## and#or sell copies of the Software, and to permit persons to whom the      ##
+## Software is furnished to do so, subject to the following conditions:       ##
+##                                                                            ##
+## The above copyright notice and this permission notice shall be included    ##
+## in all copies or substantial portions of the Software.                     ##
+##                                                                            ##
+## THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR ##
+## IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   ##
+## FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    ##
+## THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER ##
+## LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    ##
+## FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        ##
+## DEALINGS IN THE SOFTWARE.                                                  ##
+##                                                                            ##
+################################################################################
+
+### Sytem Imports
+import argparse
+import multiprocessing
+import shlex
+import socket
+import subprocess
+import time
+
+def parseArgs() -> argparse.Namespace: # {
+    """
+    Parse the command line arguments for the benchmark.
+
+    Parameters:
+        None.
+
+    Returns:
+        The argparse.Namespace with the parsed arguments.
+    """
+    parser = argparse.ArgumentParser(
+        description="Measure the rate at which a web server accepts new "
+        "connections.  Every request is made on a new connection.  If "
+        "--serverCommand is given, the server is started once for each "
+        "number of listeners.  Otherwise, an already-running server is "
+        "measured once.")
+    parser.add_argument("--host", default="127.0.0.1",
+        help="The host the web server is running on.")
+    parser.add_argument("--port", type=int, default=9000,
+        help="The port the web server is listening on.")
+    parser.add_argument("--path", default="/index.html",
+        help="The path to request on each connection.")
+    parser.add_argument("--serverCommand", default="",
+        help="The command to start the server with.  {listeners} is "
+        "replaced with the number of listeners to run.  e.g. "
+        "\"./ExampleService WS_EVENT_LOOP {listeners}\"")
+    parser.add_argument("--listeners", default="1,4,16,32",
+        help="Comma-separated list of listener counts to test when "
+        "--serverCommand is given.")
+    parser.add_argument("--processes", type=int,
+        default=multiprocessing.cpu_count(),
+        help="The number of client processes opening connections.")
+    parser.add_argument("--duration", type=float, default=10.0,
+        help="The number of seconds to run each test.")
+    return parser.parse_args()
+# }
+
+def connectionClient(host: str, port: int, path: str, deadline: float,
+    results: multiprocessing.Queue
+) -> None: # {
+    """
+    Open connections and make one request on each until the deadline.
+
+    Parameters:
+        host (str): The host the web server is running on.
+        port (int): The port the web server is listening on.
+        path (str): The path to request.
+        deadline (float): The time.time() value to stop at.
+        results (multiprocessing.Queue): The queue to put the number of
+            completed and failed connections on.
+
+    Returns:
+        This function returns no value.
+    """
+    request = (f"GET {path} HTTP/1.1\r\nHost: {host}\r\n"
+        "Connection: close\r\n\r\n").encode()
+    completed = 0
+    failed = 0
+    while (time.time() < deadline):
+        try:
+            with socket.create_connection((host, port), timeout=10) as sock:
+                sock.sendall(request)
+                response = b""
+                while (True):
+                    chunk = sock.recv(65536)
+                    if (not chunk):
+                        break
+                    response += chunk
+            if (response.startswith(b"HTTP/1.1 200")):
+                completed += 1
+            else:
+                failed += 1
+        except OSError:
+            failed += 1
+    results.put((completed, failed))
+# }
+
+def measure(args: argparse.Namespace) -> tuple: # {
+    """
+    Run the client processes against the server for the test duration.
+
+    Parameters:
+        args (argparse.Namespace): The parsed command line arguments.
+
+    Returns:
+        A tuple of the number of connections per second, the number of
+        completed connections, and the number of failed connections.
+    """
+    results = multiprocessing.Queue()
+    startTime = time.time()
+    deadline = startTime + args.duration
+    processes = [multiprocessing.Process(target=connectionClient,
+        args=(args.host, args.port, args.path, deadline, results))
+        for i in range(args.processes)]
+    for process in processes:
+        process.start()
+    completed = 0
+    failed = 0
+    for process in processes:
+        processCompleted, processFailed = results.get()
+        completed += processCompleted
+        failed += processFailed
+    for process in processes:
+        process.join()
+    elapsed = time.time() - startTime
+    return (completed / elapsed, completed, failed)
+# }
+
+def waitForServer(args: argparse.Namespace, timeout: float) -> bool: # {
+    """
+    Wait for the server to start accepting connections.
+
+    Parameters:
+        args (argparse.Namespace): The parsed command line arguments.
+        timeout (float): The number of seconds to wait.
+
+    Returns:
+        True if the server accepted a connection before the timeout, False
+        otherwise.
+    """
+    deadline = time.time() + timeout
+    while (time.time() < deadline):
+        try:
+            with socket.create_connection((args.host, args.port), timeout=1):
+                return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+# }
+
+def main() -> int: # {
+    """
+    Main driver for the benchmark.
+
+    Parameters:
+        None.
+
+    Returns:
+        0 on success, 1 if any connection failed or the server didn't start.
+    """
+    args = parseArgs()
+
+    print(f"{'Listeners':>9}  {'Conn/s':>10}  {'Completed':>9}  "
+        f"{'Failed':>6}")
+    if (args.serverCommand == ""):
+        connectionsPerSecond, completed, failed = measure(args)
+        print(f"{'-':>9}  {connectionsPerSecond:>10.1f}  {completed:>9}  "
+            f"{failed:>6}")
+        return 1 if (failed > 0) else 0
+
+    anyFailed = False
+    for listeners in args.listeners.split(","):
+        command = shlex.split(
+            args.serverCommand.replace("{listeners}", listeners))
+        server = subprocess.Popen(command,
+            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        try:
+            if (not waitForServer(args, 15)):
+                print(f"{listeners:>9}  Server did not start.")
+                anyFailed = True
+                continue
+            connectionsPerSecond, completed, failed = measure(args)
+            anyFailed = anyFailed or (failed > 0)
+            print(f"{listeners:>9}  {connectionsPerSecond:>10.1f}  "
+                f"{completed:>9}  {failed:>6}")
+        finally:
+            server.terminate()
+            server.wait()
+
+    return 1 if anyFailed else 0
+# }
+
+if (__name__ == "__main__"):
+    exit(main())
@@ -0,0 +1,323 @@
+#!/usr/bin/env python
+################################################################################
+##                                                                            ##
+##                   (c) Copyright 2012-2024 Skymond, LLC.                    ##
+##                                                                            ##
+##                            https://skymond.io                              ##
+##                                                                            ##
+## Permission is hereby granted, free of charge, to any person obtaining a    ##
+## copy of this software and associated documentation files (the "Software"), ##
+## to deal in the Software without restriction, including without limitation  ##
+## the rights to use, copy, modify, merge, publish, distribute, sublicense,   ##
+## and#or sell copies of the Software, and to permit persons to whom the      ##
+## Software is furnished to do so, subject to the following conditions:       ##
+##                                                                            ##
+## The above copyright notice and this permission notice shall be included    ##
+## in all copies or substantial portions of the Software.                     ##
+##                                                                            ##
+## THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR ##
+## IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   ##
+## FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    ##
+## THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER ##
+## LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    ##
+## FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        ##
+## DEALINGS IN THE SOFTWARE.                                                  ##
+##                                                                            ##
+################################################################################
+
+### Sytem Imports
+import argparse
+import socket
+import threading
+import time
+
+def parseArgs() -> argparse.Namespace: # {
+    """
+    Parse the command line arguments for the benchmark.
+
+    Parameters:
+        None.
+
+    Returns:
+        The argparse.Namespace with the parsed arguments.
+    """
+    parser = argparse.ArgumentParser(
+        description="Measure the throughput of a running web server and the "
+        "number of idle connections it can hold while doing so.")
+    parser.add_argument("--host", default="127.0.0.1",
+        help="The host the web server is running on.")
+    parser.add_argument("--port", type=int, default=9000,
+        help="The port the web server is listening on.")
+    parser.add_argument("--path", default="/",
+        help="The path to request.")
+    parser.add_argument("--method", default="GET", choices=["GET", "POST"],
+        help="The HTTP method to use.")
+    parser.add_argument("--body", default="",
+        help="The body to send with POST requests.")
+    parser.add_argument("--contentType", default="application/json",
+        help="The Content-Type to send with POST requests.")
+    parser.add_argument("--clients", type=int, default=32,
+        help="The number of concurrent client threads making requests.")
+    parser.add_argument("--idle", type=int, default=0,
+        help="The number of idle connections to hold open during the run.  "
+        "Each one sends a partial request and then stalls.")
+    parser.add_argument("--duration", type=float, default=10.0,
+        help="The number of seconds to run for.")
+    parser.add_argument("--keepAlive", action="store_true",
+        help="Reuse connections between requests when the server allows it.")
+    return parser.parse_args()
+# }
+
+class Results(object): # {
+    """
+    Accumulated results from all of the client threads.
+    """
+    def __init__(self): # {
+        """
+        Constructor for Results.
+
+        Parameters:
+            self (Results): The Results object being initialized.
+
+        Returns:
+            This method returns no value.
+        """
+        self.lock = threading.Lock()
+        self.latencies = []
+        self.statusCounts = {}
+        self.errors = 0
+    # }
+
+    def add(self, latencies: list, statusCounts: dict, errors: int) -> None: # {
+        """
+        Merge the results from one client thread.
+
+        Parameters:
+            self (Results): A previously-initialized Results object.
+            latencies (list): The request latencies in seconds.
+            statusCounts (dict): The number of responses for each status code.
+            errors (int): The number of requests that failed outright.
+
+        Returns:
+            This method returns no value.
+        """
+        with self.lock:
+            self.latencies.extend(latencies)
+            for status, count in statusCounts.items():
+                self.statusCounts[status] = \
+                    self.statusCounts.get(status, 0) + count
+            self.errors += errors
+    # }
+# }
+
+def buildRequest(args: argparse.Namespace) -> bytes: # {
+    """
+    Build the raw HTTP request that every client will send.
+
+    Parameters:
+        args (argparse.Namespace): The parsed command line arguments.
+
+    Returns:
+        The encoded request.
+    """
+    connection = "keep-alive" if args.keepAlive else "close"
+    request = f"{args.method} {args.path} HTTP/1.1\r\n" \
+        f"Host: {args.host}:{args.port}\r\n" \
+        f"Connection: {connection}\r\n"
+    body = args.body.encode()
+    if (args.method == "POST"):
+        request += f"Content-Type: {args.contentType}\r\n" \
+            f"Content-Length: {len(body)}\r\n"
+    return request.encode() + b"\r\n" + body
+# }
+
+def readResponse(sock: socket.socket, pending: bytes) -> tuple: # {
+    """
+    Read one full HTTP response from a socket.
+
+    Parameters:
+        sock (socket.socket): The connected socket to read from.
+        pending (bytes): Bytes already read from the socket that have not been
+            consumed yet.
+
+    Returns:
+        A tuple of (status, keepAlive, pending) where status is the integer
+        status code (0 if the response was incomplete), keepAlive is whether
+        the server will keep the connection open, and pending is any data
+        received past the end of the response.
+    """
+    data = pending
+    while (b"\r\n\r\n" not in data):
+        chunk = sock.recv(65536)
+        if (not chunk):
+            return (0, False, b"")
+        data += chunk
+    headerEnd = data.index(b"\r\n\r\n") + 4
+    headerLines = data[:headerEnd].decode("latin-1").split("\r\n")
+    status = int(headerLines[0].split(" ")[1])
+    headers = {}
+    for line in headerLines[1:]:
+        if (":" in line):
+            name, value = line.split(":", 1)
+            headers[name.strip().lower()] = value.strip()
+    keepAlive = headers.get("connection", "").lower() == "keep-alive"
+
+    if ("content-length" in headers):
+        bodyEnd = headerEnd + int(headers["content-length"])
+        while (len(data) < bodyEnd):
+            chunk = sock.recv(65536)
+            if (not chunk):
+                return (0, False, b"")
+            data += chunk
+        return (status, keepAlive, data[bodyEnd:])
+    elif (headers.get("transfer-encoding", "").lower() == "chunked"):
+        position = headerEnd
+        while (True):
+            while (b"\r\n" not in data[position:]):
+                chunk = sock.recv(65536)
+                if (not chunk):
+                    return (0, False, b"")
+                data += chunk
+            lineEnd = data.index(b"\r\n", position)
+            chunkLength = int(data[position:lineEnd].split(b";")[0], 16)
+            chunkEnd = lineEnd + 2 + chunkLength + 2
+            while (len(data) < chunkEnd):
+                chunk = sock.recv(65536)
+                if (not chunk):
+                    return (0, False, b"")
+                data += chunk
+            position = chunkEnd
+            if (chunkLength == 0):
+                return (status, keepAlive, data[position:])
+
+    # No framing.  The body runs until the server closes the connection.
+    while (True):
+        chunk = sock.recv(65536)
+        if (not chunk):
+            break
+    return (status, False, b"")
+# }
+
+def clientThread(args: argparse.Namespace, request: bytes, deadline: float,
+    results: Results
+) -> None: # {
+    """
+    Make requests until the deadline passes.
+
+    Parameters:
+        args (argparse.Namespace): The parsed command line arguments.
+        request (bytes): The raw request to send.
+        deadline (float): The time.monotonic() value to stop at.
+        results (Results): Where to accumulate the results.
+
+    Returns:
+        This function returns no value.
+    """
+    latencies = []
+    statusCounts = {}
+    errors = 0
+    sock = None
+    pending = b""
+    while (time.monotonic() < deadline):
+        startTime = time.monotonic()
+        try:
+            if (sock is None):
+                sock = socket.create_connection((args.host, args.port),
+                    timeout=10)
+                pending = b""
+            sock.sendall(request)
+            status, keepAlive, pending = readResponse(sock, pending)
+        except OSError:
+            status, keepAlive = 0, False
+        if (status == 0):
+            errors += 1
+        else:
+            latencies.append(time.monotonic() - startTime)
+            statusCounts[status] = statusCounts.get(status, 0) + 1
+        if ((not keepAlive) or (not args.keepAlive)) and (sock is not None):
+            sock.close()
+            sock = None
+    if (sock is not None):
+        sock.close()
+    results.add(latencies, statusCounts, errors)
+# }
+
+def openIdleConnections(args: argparse.Namespace) -> list: # {
+    """
+    Open connections that send a partial request and then stall, the way a
+    slow or idle client would.
+
+    Parameters:
+        args (argparse.Namespace): The parsed command line arguments.
+
+    Returns:
+        The list of sockets that were successfully opened.
+    """
+    idleSockets = []
+    for i in range(args.idle):
+        try:
+            sock = socket.create_connection((args.host, args.port), timeout=5)
+            sock.sendall(f"GET {args.path} HTTP/1.1\r\n".encode())
+            idleSockets.append(sock)
+        except OSError:
+            break
+    return idleSockets
+# }
+
+def main() -> int: # {
+    """
+    Main driver for the benchmark.
+
+    Parameters:
+        None.
+
+    Returns:
+        0 on success.
+    """
+    args = parseArgs()
+    request = buildRequest(args)
+    results = Results()
+
+    idleSockets = openIdleConnections(args)
+    startTime = time.monotonic()
+    deadline = startTime + args.duration
+    threads = [threading.Thread(target=clientThread,
+        args=(args, request, deadline, results)) for i in range(args.clients)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - startTime
+
+    # See how many of the idle connections the server is still holding.
+    idleHeld = 0
+    for sock in idleSockets:
+        try:
+            sock.setblocking(False)
+            if (sock.recv(1) != b""):
+                idleHeld += 1
+        except BlockingIOError:
+            idleHeld += 1
+        except OSError:
+            pass
+        sock.close()
+
+    latencies = sorted(results.latencies)
+    numRequests = len(latencies)
+    print(f"Requests completed:  {numRequests}")
+    print(f"Requests failed:     {results.errors}")
+    print(f"Status codes:        {results.statusCounts}")
+    print(f"Requests/second:     {numRequests / elapsed:.1f}")
+    if (numRequests > 0):
+        p50 = latencies[numRequests // 2] * 1000
+        p99 = latencies[min(numRequests - 1, (numRequests * 99) // 100)] * 1000
+        print(f"Latency p50/p99 ms:  {p50:.2f}/{p99:.2f}")
+    if (args.idle > 0):
+        print(f"Idle connections:    {len(idleSockets)} opened, "
+            f"{idleHeld} still held at end")
+
+    return 0
+# }
+
+if (__name__ == "__main__"):
+    exit(main())
@@ -0,0 +1,266 @@
+#!/usr/bin/env python
+################################################################################
+##                                                                            ##
+##                   (c) Copyright 2012-2024 Skymond, LLC.                    ##
+##                                                                            ##
+##                            https://skymond.io                              ##
+##                                                                            ##
+## Permission is hereby granted, free of charge, to any person obtaining a    ##
+## copy of this software and associated documentation files (the "Software"), ##
+## to deal in the Software without restriction, including without limitation  ##
+## the rights to use, copy, modify, merge, publish, distribute, sublicense,   ##
+## and#or sell copies of the Software, and to permit persons to whom the      ##
+## Software is furnished to do so, subject to the following conditions:       ##
+##                                                                            ##
+## The above copyright notice and this permission notice shall be included    ##
+## in all copies or substantial portions of the Software.                     ##
+##                                                                            ##
+## THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR ##
+## IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   ##
+## FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    ##
+## THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER ##
+## LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING    ##
+## FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER        ##
+## DEALINGS IN THE SOFTWARE.                                                  ##
+##                                                                            ##
+################################################################################
+
+### Sytem Imports
+import argparse
+import os
+import socket
+import ssl
+import threading
+import time
+
+def parseArgs() -> argparse.Namespace: # {
+    """
+    Parse the command line arguments for the benchmark.
+
+    Parameters:
+        None.
+
+    Returns:
+        The argparse.Namespace with the parsed arguments.
+    """
+    parser = argparse.ArgumentParser(
+        description="Measure the download throughput of large static files "
+        "from a running web server and the server's memory use while serving "
+        "them.")
+    parser.add_argument("--host", default="127.0.0.1",
+        help="The host the web server is running on.")
+    parser.add_argument("--port", type=int, default=9000,
+        help="The port the web server is listening on.")
+    parser.add_argument("--tls", action="store_true",
+        help="Connect with TLS.  The server's certificate is not verified.")
+    parser.add_argument("--interfacePath", required=True,
+        help="The server's static content directory.  The benchmark files "
+        "are created here if they don't already exist.")
+    parser.add_argument("--sizes", default="1M,16M,256M,1G",
+        help="Comma-separated list of file sizes to test.  K, M, and G "
+        "suffixes are supported.")
+    parser.add_argument("--clients", type=int, default=4,
+        help="The number of concurrent client threads downloading.")
+    parser.add_argument("--downloads", type=int, default=8,
+        help="The number of downloads to do for each file size.")
+    parser.add_argument("--pid", type=int, default=0,
+        help="The process ID of the server.  If provided, the server's "
+        "resident set size is sampled during each run.")
+    return parser.parse_args()
+# }
+
+def parseSize(sizeString: str) -> int: # {
+    """
+    Convert a size with an optional K, M, or G suffix to a number of bytes.
+
+    Parameters:
+        sizeString (str): The size to convert.
+
+    Returns:
+        The number of bytes.
+    """
+    multipliers = {"K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+    suffix = sizeString[-1].upper()
+    if (suffix in multipliers):
+        return int(sizeString[:-1]) * multipliers[suffix]
+    return int(sizeString)
+# }
+
+def createFile(path: str, size: int) -> None: # {
+    """
+    Create a benchmark file of the requested size if it doesn't already exist.
+
+    Parameters:
+        path (str): The full path of the file to create.
+        size (int): The size of the file in bytes.
+
+    Returns:
+        This function returns no value.
+    """
+    if (os.path.exists(path) and (os.path.getsize(path) == size)):
+        return
+    block = os.urandom(1 << 20)
+    with open(path, "wb") as outputFile:
+        remaining = size
+        while (remaining > 0):
+            outputFile.write(block[:min(remaining, len(block))])
+            remaining -= len(block)
+# }
+
+def getRssKb(pid: int) -> int: # {
+    """
+    Get the current resident set size of a process.
+
+    Parameters:
+        pid (int): The ID of the process.
+
+    Returns:
+        The resident set size in kilobytes, or 0 if it can't be determined.
+    """
+    try:
+        with open(f"/proc/{pid}/status") as statusFile:
+            for line in statusFile:
+                if (line.startswith("VmRSS:")):
+                    return int(line.split()[1])
+    except OSError:
+        pass
+    return 0
+# }
+
+def download(args: argparse.Namespace, path: str) -> int: # {
+    """
+    Download one file and discard its content.
+
+    Parameters:
+        args (argparse.Namespace): The parsed command line arguments.
+        path (str): The path to request.
+
+    Returns:
+        The number of body bytes received if the full body was received, -1
+        on failure.
+    """
+    sock = socket.create_connection((args.host, args.port), timeout=30)
+    if (args.tls):
+        context = ssl.create_default_context()
+        context.check_hostname = False
+        context.verify_mode = ssl.CERT_NONE
+        sock = context.wrap_socket(sock)
+    try:
+        sock.sendall(f"GET {path} HTTP/1.1\r\nHost: {args.host}\r\n"
+            "Connection: close\r\n\r\n".encode())
+        data = b""
+        while (b"\r\n\r\n" not in data):
+            chunk = sock.recv(65536)
+            if (not chunk):
+                return -1
+            data += chunk
+        headerEnd = data.index(b"\r\n\r\n") + 4
+        contentLength = -1
+        for line in data[:headerEnd].decode("latin-1").split("\r\n"):
+            if (line.lower().startswith("content-length:")):
+                contentLength = int(line.split(":", 1)[1])
+        received = len(data) - headerEnd
+        buffer = bytearray(1 << 20)
+        while (received < contentLength):
+            numBytes = sock.recv_into(buffer)
+            if (numBytes == 0):
+                break
+            received += numBytes
+        return received if (received == contentLength) else -1
+    except OSError:
+        return -1
+    finally:
+        sock.close()
+# }
+
+def runSize(args: argparse.Namespace, path: str, size: int) -> dict: # {
+    """
+    Download one file size the requested number of times.
+
+    Parameters:
+        args (argparse.Namespace): The parsed command line arguments.
+        path (str): The path to request.
+        size (int): The size of the file in bytes.
+
+    Returns:
+        A dictionary with the elapsed time, the number of bytes and downloads
+        completed, the number of failures, and the peak server RSS.
+    """
+    lock = threading.Lock()
+    results = {"bytes": 0, "completed": 0, "failed": 0, "peakRssKb": 0}
+    remaining = [args.downloads]
+
+    def clientThread() -> None: # {
+        while (True):
+            with lock:
+                if (remaining[0] == 0):
+                    return
+                remaining[0] -= 1
+            received = download(args, path)
+            with lock:
+                if (received == size):
+                    results["bytes"] += received
+                    results["completed"] += 1
+                else:
+                    results["failed"] += 1
+    # }
+
+    done = threading.Event()
+    def samplerThread() -> None: # {
+        while (not done.is_set()):
+            results["peakRssKb"] = max(results["peakRssKb"], getRssKb(args.pid))
+            time.sleep(0.01)
+    # }
+
+    sampler = None
+    if (args.pid > 0):
+        sampler = threading.Thread(target=samplerThread)
+        sampler.start()
+    startTime = time.monotonic()
+    threads = [threading.Thread(target=clientThread)
+        for i in range(args.clients)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    results["elapsed"] = time.monotonic() - startTime
+    done.set()
+    if (sampler is not None):
+        sampler.join()
+    return results
+# }
+
+def main() -> int: # {
+    """
+    Main driver for the benchmark.
+
+    Parameters:
+        None.
+
+    Returns:
+        0 on success, 1 if any download failed.
+    """
+    args = parseArgs()
+    baselineRssKb = getRssKb(args.pid) if (args.pid > 0) else 0
+
+    print(f"{'Size':>6}  {'MB/s':>10}  {'Downloads':>9}  {'Failed':>6}  "
+        f"{'Peak RSS MB':>11}  {'RSS growth MB':>13}")
+    anyFailed = False
+    for sizeString in args.sizes.split(","):
+        size = parseSize(sizeString)
+        fileName = f"benchmarkFile-{sizeString}.bin"
+        createFile(os.path.join(args.interfacePath, fileName), size)
+        results = runSize(args, "/" + fileName, size)
+        anyFailed = anyFailed or (results["failed"] > 0)
+        megabytesPerSecond = results["bytes"] / (1 << 20) / results["elapsed"]
+        peakRssMb = results["peakRssKb"] / 1024
+        growthMb = max(0, results["peakRssKb"] - baselineRssKb) / 1024
+        print(f"{sizeString:>6}  {megabytesPerSecond:>10.1f}  "
+            f"{results['completed']:>9}  {results['failed']:>6}  "
+            f"{peakRssMb:>11.1f}  {growthMb:>13.1f}")
+
+    return 1 if anyFailed else 0
+# }
+
+if (__name__ == "__main__"):
+    exit(main())
@@ -37,6 +37,7 @@
 #include "WebClientLib.h"
 #include "Dictionary.h"
 #include "Scope.h"
+#include "miniz.h"
 
 WsResponseObject *soapUnitTestFunction(WebService *webService,
   WsConnectionInfo *wsConnectionInfo
@@ -126,6 +127,188 @@ WsResponseObject *restUnitTestFunction(WebService *webService,
   return outputParams;
 }
 
+WsResponseObject *streamUnitTestFunction(WebService *webService,
+  WsConnectionInfo *wsConnectionInfo
+) {
+  (void) webService;
+  WsResponseWriter *responseWriter = wsConnectionInfo->responseWriter;
+  
+  if (wsResponseWriterStart(responseWriter, "200 OK", "application/json") != 0) {
+    return NULL;
+  }
+  wsResponseWriterWriteString(responseWriter, "[");
+  for (int i = 0; i < 3000; i++) {
+    char row[32];
+    snprintf(row, sizeof(row), "%s{\"row\": %d}", (i > 0) ? "," : "", i);
+    if (wsResponseWriterWriteString(responseWriter, row) != 0) {
+      return NULL;
+    }
+  }
+  wsResponseWriterWriteString(responseWriter, "]");
+  wsResponseWriterFinish(responseWriter);
+  
+  return NULL;
+}
+
+WsResponseObject *bodyUnitTestFunction(WebService *webService,
+  WsConnectionInfo *wsConnectionInfo
+) {
+  (void) webService;
+  WsResponseWriter *responseWriter = wsConnectionInfo->responseWriter;
+  
+  // Read the body a piece at a time and report its length and checksum.
+  unsigned char buffer[1000];
+  u64 bodyLength = 0;
+  u32 checksum = 0;
+  i64 numBytes = 0;
+  while ((numBytes = wsBodyReaderRead(wsConnectionInfo->bodyReader,
+    buffer, sizeof(buffer))) > 0
+  ) {
+    for (i64 i = 0; i < numBytes; i++) {
+      checksum += buffer[i];
+    }
+    bodyLength += (u64) numBytes;
+  }
+  
+  char result[64];
+  snprintf(result, sizeof(result), "%llu %llu %lu", llu(bodyLength),
+    llu(wsConnectionInfo->bodyLength), (unsigned long) checksum);
+  if (wsResponseWriterStart(responseWriter, "200 OK", "text/plain") == 0) {
+    wsResponseWriterWriteString(responseWriter, result);
+  }
+  
+  return NULL;
+}
+
+// Counts the calls so that cached responses can be told from new ones.
+int cachedUnitTestFunctionCalls = 0;
+
+WsResponseObject *cachedUnitTestFunction(WebService *webService,
+  WsConnectionInfo *wsConnectionInfo
+) {
+  const char *id = (const char*) webService->getRequestValue(
+    wsConnectionInfo->functionParams, "GET:id");
+  char result[64];
+  cachedUnitTestFunctionCalls++;
+  snprintf(result, sizeof(result), "%s-%d",
+    (id != NULL) ? id : "none", cachedUnitTestFunctionCalls);
+  
+  WsResponseObject *outputParams = NULL;
+  webService->addResponseValue(&outputParams, "result", result);
+  return outputParams;
+}
+
+WsResponseObject *invalidateUnitTestFunction(WebService *webService,
+  WsConnectionInfo *wsConnectionInfo
+) {
+  // "all" removes every response.  Otherwise, only the one for the same id.
+  WsRequestObject *params = wsConnectionInfo->functionParams;
+  if (webService->getRequestValue(params, "GET:all") != NULL) {
+    params = NULL;
+  }
+  int numRemoved = wsResponseCacheInvalidate(wsConnectionInfo,
+    "webService", "cachedUnitTestFunction", params);
+  char result[64];
+  snprintf(result, sizeof(result), "removed-%d", numRemoved);
+  
+  WsResponseObject *outputParams = NULL;
+  webService->addResponseValue(&outputParams, "result", result);
+  return outputParams;
+}
+
+// A call whose deferred response is completed from another thread.  The
+// WebService the function was called with is only valid during the call, so
+// it's copied.
+typedef struct DeferredUnitTestCall {
+  WebService         webService;
+  WsPendingResponse *pendingResponse;
+  int                delayMs;
+  char               result[64];
+} DeferredUnitTestCall;
+
+// Counts the completions that came after the server gave up on the response.
+volatile int deferredUnitTestLateCompletions = 0;
+
+int deferredUnitTestCompleter(void *args) {
+  DeferredUnitTestCall *call = (DeferredUnitTestCall*) args;
+  // msleep only handles delays of less than a second.
+  struct timespec delay
+    = { call->delayMs / 1000, (call->delayMs % 1000) * 1000000L };
+  thrd_sleep(&delay, NULL);
+  
+  WsResponseObject *outputParams = NULL;
+  call->webService.addResponseValue(&outputParams, "result", call->result);
+  if (wsResponseComplete(call->pendingResponse, outputParams) != 0) {
+    deferredUnitTestLateCompletions++;
+  }
+  free(call);
+  
+  return 0;
+}
+
+WsResponseObject *deferredUnitTestFunction(WebService *webService,
+  WsConnectionInfo *wsConnectionInfo
+) {
+  // "delayMs" is how long the response takes to complete.  "timeout" is how
+  // long the server waits for it.  They're query parameters, or just
+  // parameters in a batch.
+  WsRequestObject *params = wsConnectionInfo->functionParams;
+  const char *id = (const char*) webService->getRequestValue(params, "GET:id");
+  const char *delayMs
+    = (const char*) webService->getRequestValue(params, "GET:delayMs");
+  const char *timeout
+    = (const char*) webService->getRequestValue(params, "GET:timeout");
+  if (id == NULL) {
+    id = (const char*) webService->getRequestValue(params, "id");
+    delayMs = (const char*) webService->getRequestValue(params, "delayMs");
+    timeout = (const char*) webService->getRequestValue(params, "timeout");
+  }
+  
+  DeferredUnitTestCall *call
+    = (DeferredUnitTestCall*) calloc(1, sizeof(DeferredUnitTestCall));
+  if (call == NULL) {
+    return NULL;
+  }
+  call->webService = *webService;
+  call->delayMs = (delayMs != NULL) ? atoi(delayMs) : 0;
+  snprintf(call->result, sizeof(call->result), "deferred-%s",
+    (id != NULL) ? id : "none");
+  call->pendingResponse = wsResponseDefer(webService, wsConnectionInfo,
+    (timeout != NULL) ? atoi(timeout) : 0);
+  
+  thrd_t thread;
+  if ((call->pendingResponse == NULL)
+    || (thrd_create(&thread, deferredUnitTestCompleter, call) != thrd_success)
+  ) {
+    wsResponseComplete(call->pendingResponse, NULL);
+    free(call);
+    return NULL;
+  }
+  thrd_detach(thread);
+  
+  return NULL;
+}
+
+// Takes "delayMs" to echo "id" so that a batch can be checked for the order of
+// its results and for whether its calls were made in parallel.
+WsResponseObject *batchUnitTestFunction(WebService *webService,
+  WsConnectionInfo *wsConnectionInfo
+) {
+  WsRequestObject *params = wsConnectionInfo->functionParams;
+  const char *id = (const char*) webService->getRequestValue(params, "id");
+  const char *delayMs
+    = (const char*) webService->getRequestValue(params, "delayMs");
+  if (delayMs != NULL) {
+    msleep(atoi(delayMs));
+  }
+  
+  char result[64];
+  snprintf(result, sizeof(result), "batch-%s", (id != NULL) ? id : "none");
+  WsResponseObject *outputParams = NULL;
+  webService->addResponseValue(&outputParams, "result", result);
+  return outputParams;
+}
+
 Dictionary* redirectUnitTestFunction(Socket *clientSocket,
   const char *interfacePath, Dictionary *httpParams, const unsigned char *body,
   Dictionary *cookiesDict
@@ -196,10 +379,22 @@ Dictionary* redirectUnitTestFunction(Socket *clientSocket,
   return outputParams;
 }
 
+const char *cachedUnitTestFunctionKeys[] = { "GET:id", NULL };
+WsCachePolicy cachedUnitTestFunctionPolicy = {
+  60, 2, cachedUnitTestFunctionKeys
+};
+
 WsFunctionDescriptor webServiceFunctions[] = {
-  {"soapUnitTestFunction", soapUnitTestFunction},
-  {"restUnitTestFunction", restUnitTestFunction},
-  {NULL, NULL}
+  {"soapUnitTestFunction", soapUnitTestFunction, NULL},
+  {"restUnitTestFunction", restUnitTestFunction, NULL},
+  {"streamUnitTestFunction", streamUnitTestFunction, NULL},
+  {"bodyUnitTestFunction", bodyUnitTestFunction, NULL},
+  {"cachedUnitTestFunction", cachedUnitTestFunction,
+    &cachedUnitTestFunctionPolicy},
+  {"invalidateUnitTestFunction", invalidateUnitTestFunction, NULL},
+  {"deferredUnitTestFunction", deferredUnitTestFunction, NULL},
+  {"batchUnitTestFunction", batchUnitTestFunction, NULL},
+  {NULL, NULL, NULL}
 };
 
 WsFunctionDescriptor *webServiceFunctionDescriptors[] = {
@@ -233,105 +428,1978 @@ WebService unitTestWebService = {
   (WsRequestObjectToString) listToString,  // requestObjectToString
   (WsResponseObjectToString) listToString, // responseObjectToString
   NULL,                                    // context
+  wsSerializeToJsonInArena,                // serializeToJsonInArena
 };
 
-bool webServerUnitTest(void) {
-  const char *indexHtmlContent = "Hello world!";
-  size_t indexHtmlSize = strlen(indexHtmlContent);
+bool wsHttpRequestParseUnitTest(void) {
+  const char *request =
+    "\r\n"
+    "POST /webService/restUnitTestFunction HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8999\r\n"
+    "SOAPAction: \"\r\n"
+    "http://127.0.0.1:8999/webService/restUnitTestFunction\"\r\n"
+    "Content-Type:application/json  \r\n"
+    "Content-Length: 2\r\n"
+    "\r\n"
+    "{}GET / HTTP/1.1\r\n\r\n";
+  size_t requestLength = strlen(request);
   
-  putFileContent("/tmp/index.html", indexHtmlContent, indexHtmlSize);
-  WebServerCreateOptions webServerCreateOptions = {
-    .interfacePath = "/tmp",
-    .serverName = "UnitTestServer",
-    .timeout = 15,
-    .socketMode = PLAIN,
-    .certificate = NULL,
-    .key = NULL,
-    .redirectProtocol = NULL,
-    .redirectPort = 0,
-    .redirectFunction = 0,
-    .webService = 0,
+  // Deliver the request one byte at a time to exercise resuming the parse.
+  ZEROINIT(WsHttpRequest httpRequest);
+  wsHttpRequestReset(&httpRequest);
+  Bytes buffer = NULL;
+  WsHttpParserState state = WS_HTTP_PARSING_REQUEST_LINE;
+  size_t numBytesDelivered = 0;
+  while ((numBytesDelivered < requestLength)
+    && (state != WS_HTTP_HEADER_COMPLETE)
+  ) {
+    bytesAddData(&buffer, &request[numBytesDelivered++], 1);
+    state = wsHttpRequestParse(&httpRequest, buffer);
+  }
+  // Deliver the body and the pipelined request that follows it.
+  bytesAddStr(&buffer, &request[numBytesDelivered]);
+  state = wsHttpRequestParse(&httpRequest, buffer);
+  if (state != WS_HTTP_HEADER_COMPLETE) {
+    printLog(ERR, "Expected complete header, got state %d.\n", state);
+    buffer = bytesDestroy(buffer);
+    return false;
+  }
+  
+  const char *expected[][2] = {
+    {"_httpCommand", "POST"},
+    {"_httpLocation", "/webService/restUnitTestFunction"},
+    {"_httpProtocol", "HTTP/1.1"},
+    {"host", "127.0.0.1:8999"},
+    {"SoapAction",
+      "\"http://127.0.0.1:8999/webService/restUnitTestFunction\""},
+    {"Content-Type", "application/json"},
   };
-  WebServer* webServer = webServerCreate(8999, &webServerCreateOptions);
-  if (webServer == NULL) {
-    printLog(ERR, "webServerCreate returned NULL.\n");
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+    const char *value = wsHttpRequestGetHeader(&httpRequest, expected[i][0]);
+    if ((value == NULL) || (strcmp(value, expected[i][1]) != 0)) {
+      printLog(ERR, "Expected %s to be \"%s\", got \"%s\".\n",
+        expected[i][0], expected[i][1], strOrNull(value));
+      buffer = bytesDestroy(buffer);
+      return false;
+    }
+  }
+  if ((httpRequest.contentLength != 2)
+    || (strncmp((char*) buffer + httpRequest.bodyOffset, "{}", 2) != 0)
+  ) {
+    printLog(ERR, "Body not located correctly.\n");
+    buffer = bytesDestroy(buffer);
     return false;
   }
-  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
   
-  Bytes response = wcGet("http://127.0.0.1:8999", "/", 500);
-  if (response == NULL) {
-    printLog(ERR, "No response from web server for request to get \"/\".\n");
-    webServer = webServerDestroy(webServer);
+  Dictionary *httpParams = wsHttpRequestGetParams(&httpRequest);
+  Bytes host = (Bytes) dictionaryGetValue(httpParams, "Host");
+  if ((host == NULL) || (strcmp(str(host), "127.0.0.1:8999") != 0)
+    || (wsHttpRequestGetParams(&httpRequest) != httpParams)
+  ) {
+    printLog(ERR, "httpParams not built correctly.\n");
+    buffer = bytesDestroy(buffer);
+    wsHttpRequestReset(&httpRequest);
     return false;
   }
-  if (strcmp(str(response), indexHtmlContent) != 0) {
-    printLog(ERR, "Expected \"%s\" from web server, got \"%s\".\n",
-      indexHtmlContent, str(response));
-    response = bytesDestroy(response);
-    webServer = webServerDestroy(webServer);
+  
+  wsHttpRequestReset(&httpRequest);
+  buffer = bytesDestroy(buffer);
+  return true;
+}
+
+bool wsUnitTestSendRequest(const char *request, char *response,
+  int responseSize
+) {
+  Socket *clientSocket
+     = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+      /*certificate=*/ NULL, /*key=*/ NULL, 500);
+  if (clientSocket == NULL) {
+    printLog(ERR, "Could not connect to http://127.0.0.1:8999.\n");
     return false;
   }
-  response = bytesDestroy(response);
+  memset(response, 0, responseSize);
+  if (socketSend(clientSocket, request, strlen(request)) < 0) {
+    printLog(ERR, "Could not send \"%s\" to http://127.0.0.1:8999.\n",
+      request);
+    clientSocket = socketDestroy(clientSocket);
+    return false;
+  }
+  // The requests all close the connection, so read until the server does.
+  int responseLength = 0;
+  int numBytesReceived = 0;
+  do {
+    numBytesReceived = socketReceive(clientSocket,
+      &response[responseLength], responseSize - 1 - responseLength, 500);
+    if (numBytesReceived > 0) {
+      responseLength += numBytesReceived;
+    }
+  } while ((numBytesReceived > 0) && (responseLength < responseSize - 1));
+  clientSocket = socketDestroy(clientSocket);
   
-  response = wcGet("http://127.0.0.1:8999", "/index.html", 500);
-  if (response == NULL) {
-    printLog(ERR,
-      "No response from web server for request to get \"/index.html\".\n");
-    webServer = webServerDestroy(webServer);
+  return (responseLength > 0);
+}
+
+bool wsConditionalGetUnitTest(const char *indexHtmlContent) {
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  if (!wsUnitTestSendRequest(
+    "GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n",
+    response, sizeof(response))
+  ) {
+    printLog(ERR, "Could not get /index.html.\n");
     return false;
   }
-  if (strcmp(str(response), indexHtmlContent) != 0) {
-    printLog(ERR, "Expected \"%s\" from web server, got \"%s\".\n",
-      indexHtmlContent, str(response));
-    response = bytesDestroy(response);
-    webServer = webServerDestroy(webServer);
+  Bytes eTag = getBytesBetween(response, "ETag: ", "\r\n");
+  Bytes lastModified = getBytesBetween(response, "Last-Modified: ", "\r\n");
+  if ((eTag == NULL) || (lastModified == NULL)) {
+    printLog(ERR, "Validators missing from response:\n%s\n", response);
+    eTag = bytesDestroy(eTag);
+    lastModified = bytesDestroy(lastModified);
     return false;
   }
-  response = bytesDestroy(response);
   
-  response = wcGet("http://127.0.0.1:8999", "/marklar", 500);
-  if (response != NULL) {
-    printLog(ERR,
-      "Expected NULL response for request to get \"/marklar\". Got \"%s\"\n",
-      str(response));
-    response = bytesDestroy(response);
-    webServer = webServerDestroy(webServer);
+  // Both validators on their own should get a 304 with no body.
+  const char *conditionalHeaders[] = { "If-None-Match", "If-Modified-Since" };
+  Bytes validators[] = { eTag, lastModified };
+  for (int i = 0; i < 2; i++) {
+    Bytes request = NULL;
+    bytesAddStr(&request, "GET /index.html HTTP/1.1\r\nConnection: close\r\n");
+    bytesAddStr(&request, conditionalHeaders[i]);
+    bytesAddStr(&request, ": ");
+    bytesAddBytes(&request, validators[i]);
+    bytesAddStr(&request, "\r\n\r\n");
+    bool received = wsUnitTestSendRequest(str(request),
+      response, sizeof(response));
+    request = bytesDestroy(request);
+    if ((!received) || (strncmp(response, "HTTP/1.1 304", 12) != 0)
+      || (strstr(response, indexHtmlContent) != NULL)
+    ) {
+      printLog(ERR, "Expected 304 for %s, got:\n%s\n",
+        conditionalHeaders[i], response);
+      eTag = bytesDestroy(eTag);
+      lastModified = bytesDestroy(lastModified);
+      return false;
+    }
+  }
+  
+  // Changing the file has to invalidate both the cached content and the
+  // client's ETag.
+  const char *newContent = "Hello again, world!";
+  putFileContent("/tmp/index.html", newContent, strlen(newContent));
+  Bytes request = NULL;
+  bytesAddStr(&request,
+    "GET /index.html HTTP/1.1\r\nConnection: close\r\nIf-None-Match: ");
+  bytesAddBytes(&request, eTag);
+  bytesAddStr(&request, "\r\n\r\n");
+  bool received = wsUnitTestSendRequest(str(request),
+    response, sizeof(response));
+  request = bytesDestroy(request);
+  putFileContent("/tmp/index.html", indexHtmlContent, strlen(indexHtmlContent));
+  eTag = bytesDestroy(eTag);
+  lastModified = bytesDestroy(lastModified);
+  if ((!received) || (strncmp(response, "HTTP/1.1 200", 12) != 0)
+    || (strstr(response, newContent) == NULL)
+  ) {
+    printLog(ERR, "Expected new content after modification, got:\n%s\n",
+      response);
     return false;
   }
   
-  Socket *clientSocket
-     = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
-      /*certificate=*/ NULL, /*key=*/ NULL, 500);
-  const char *sendBuffer = "GET /index.html\r\n\r\n\n";
-  if (socketSend(clientSocket, sendBuffer, strlen(sendBuffer)) < 0) {
-    printLog(ERR, "Could not send \"%s\" to http://127.0.0.1:8999.\n",
-      sendBuffer);
-    clientSocket = socketDestroy(clientSocket);
-    webServer = webServerDestroy(webServer);
+  return true;
+}
+
+bool wsCompressionUnitTest(void) {
+  // Repetitive text well over the default minimum size that still fits in one
+  // response buffer uncompressed.
+  Bytes content = NULL;
+  for (int i = 0; i < 100; i++) {
+    bytesAddStr(&content, "All work and no play makes Jack a dull boy.\n");
+  }
+  putFileContent("/tmp/wsCompression.txt", content, bytesLength(content));
+  
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  bool received = wsUnitTestSendRequest("GET /wsCompression.txt HTTP/1.1\r\n"
+    "Accept-Encoding: deflate;q=0.5, gzip\r\nConnection: close\r\n\r\n",
+    response, sizeof(response));
+  Bytes contentLength = getBytesBetween(response, "Content-Length: ", "\r\n");
+  char *body = strstr(response, "\r\n\r\n");
+  if ((!received) || (strncmp(response, "HTTP/1.1 200", 12) != 0)
+    || (strstr(response, "Content-Encoding: gzip\r\n") == NULL)
+    || (contentLength == NULL) || (body == NULL)
+  ) {
+    printLog(ERR, "Expected gzip response, got:\n%s\n", response);
+    contentLength = bytesDestroy(contentLength);
+    content = bytesDestroy(content);
     return false;
   }
-  ZEROINIT(char responseBuffer[JUMBO_FRAME_SIZE]);
-  if (socketReceive(clientSocket, responseBuffer, JUMBO_FRAME_SIZE, 500) < 0) {
-    printLog(ERR, "Could not receive index.html from http://127.0.0.1:8999.\n");
-    clientSocket = socketDestroy(clientSocket);
-    webServer = webServerDestroy(webServer);
+  body += 4;
+  size_t bodyLength = (size_t) strtoull(str(contentLength), NULL, 10);
+  contentLength = bytesDestroy(contentLength);
+  
+  // Skip the 10-byte gzip header and 8-byte trailer to get the raw deflate
+  // stream.
+  size_t decompressedLength = 0;
+  void *decompressed = NULL;
+  if ((bodyLength > 18) && ((unsigned char) body[0] == 0x1f)
+    && ((unsigned char) body[1] == 0x8b)
+  ) {
+    decompressed = tinfl_decompress_mem_to_heap(&body[10], bodyLength - 18,
+      &decompressedLength, 0);
+  }
+  bool matches = ((decompressed != NULL)
+    && (decompressedLength == bytesLength(content))
+    && (memcmp(decompressed, content, decompressedLength) == 0));
+  mz_free(decompressed);
+  if (!matches) {
+    printLog(ERR, "gzip body did not decompress to the original file.\n");
+    content = bytesDestroy(content);
     return false;
   }
-  responseBuffer[strlen(indexHtmlContent)] = '\0';
-  const char *expectedResponse = "HTTP/1.1 200";
-  if (strncmp(str(responseBuffer),
-    expectedResponse, strlen(expectedResponse)) != 0
+  
+  // Elements without a coding name must be skipped, not spun on.
+  received = wsUnitTestSendRequest("GET /wsCompression.txt HTTP/1.1\r\n"
+    "Accept-Encoding: ;q=0.5, gzip, ;q=1\r\nConnection: close\r\n\r\n",
+    response, sizeof(response));
+  if ((!received) || (strncmp(response, "HTTP/1.1 200", 12) != 0)
+    || (strstr(response, "Content-Encoding: gzip\r\n") == NULL)
   ) {
-    printLog(ERR, "Expected \"%s\" from web server, got \"%s\".\n",
-      indexHtmlContent, str(responseBuffer));
-    clientSocket = socketDestroy(clientSocket);
+    printLog(ERR, "Expected gzip response for empty codings, got:\n%s\n",
+      response);
+    content = bytesDestroy(content);
+    return false;
+  }
+  
+  // Clients that don't ask for compression must get the file as-is.
+  received = wsUnitTestSendRequest("GET /wsCompression.txt HTTP/1.1\r\n"
+    "Connection: close\r\n\r\n", response, sizeof(response));
+  body = strstr(response, "\r\n\r\n");
+  if ((!received) || (strstr(response, "Content-Encoding") != NULL)
+    || (body == NULL) || (strcmp(body + 4, str(content)) != 0)
+  ) {
+    printLog(ERR, "Expected identity response, got:\n%s\n", response);
+    content = bytesDestroy(content);
+    return false;
+  }
+  
+  content = bytesDestroy(content);
+  return true;
+}
+
+bool wsStreamingUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.webService = &unitTestWebService;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  int responseSize = 128 * 1024;
+  char *response = (char*) malloc(responseSize);
+  if (response == NULL) {
+    LOG_MALLOC_FAILURE();
     webServer = webServerDestroy(webServer);
     return false;
   }
-  clientSocket = socketDestroy(clientSocket);
+  bool received = wsUnitTestSendRequest(
+    "GET /webService/streamUnitTestFunction HTTP/1.1\r\n"
+    "Connection: close\r\n\r\n", response, responseSize);
+  webServer = webServerDestroy(webServer);
+  char *chunk = strstr(response, "\r\n\r\n");
+  if ((!received) || (strncmp(response, "HTTP/1.1 200", 12) != 0)
+    || (strstr(response, "Transfer-Encoding: chunked\r\n") == NULL)
+    || (chunk == NULL)
+  ) {
+    printLog(ERR, "Expected chunked response, got:\n%s\n", response);
+    response = (char*) pointerDestroy(response);
+    return false;
+  }
+  
+  // Reassemble the body from its chunks.
+  Bytes body = NULL;
+  int numChunks = 0;
+  chunk += 4;
+  while (true) {
+    char *chunkData = NULL;
+    unsigned long long chunkLength = strtoull(chunk, &chunkData, 16);
+    if ((chunkData == chunk) || (strncmp(chunkData, "\r\n", 2) != 0)) {
+      printLog(ERR, "Malformed chunk at \"%.20s\".\n", chunk);
+      body = bytesDestroy(body);
+      response = (char*) pointerDestroy(response);
+      return false;
+    }
+    chunkData += 2;
+    if (chunkLength == 0) {
+      break;
+    }
+    bytesAddData(&body, chunkData, chunkLength);
+    numChunks++;
+    chunk = chunkData + chunkLength + 2;
+  }
+  response = (char*) pointerDestroy(response);
+  
+  Bytes expected = NULL;
+  bytesAddStr(&expected, "[");
+  for (int i = 0; i < 3000; i++) {
+    char row[32];
+    snprintf(row, sizeof(row), "%s{\"row\": %d}", (i > 0) ? "," : "", i);
+    bytesAddStr(&expected, row);
+  }
+  bytesAddStr(&expected, "]");
+  bool matches = ((numChunks > 1) && (body != NULL)
+    && (strcmp(str(body), str(expected)) == 0));
+  if (!matches) {
+    printLog(ERR, "Streamed body in %d chunks did not match.\n", numChunks);
+  }
+  body = bytesDestroy(body);
+  expected = bytesDestroy(expected);
+  
+  return matches;
+}
+
+bool wsRequestBodyUnitTestCase(const char *request, const char *expected) {
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  if (!wsUnitTestSendRequest(request, response, sizeof(response))) {
+    printLog(ERR, "Could not send request body.\n");
+    return false;
+  } else if (strstr(response, expected) == NULL) {
+    printLog(ERR, "Expected \"%s\" in response, got:\n%s\n", expected,
+      response);
+    return false;
+  }
+  
+  return true;
+}
+
+bool wsRequestBodyUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.webService = &unitTestWebService;
+  webServerCreateOptions.maxRequestBodyBytes = 8192;
+  webServerCreateOptions.requestBodyMemoryBytes = 1024;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  // Chunked body with a chunk extension and a trailer.
+  bool passed = wsRequestBodyUnitTestCase(
+    "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+    "5\r\nhello\r\n6;name=value\r\n world\r\n0\r\n"
+    "X-Trailer: ignored\r\n\r\n",
+    "11 11 1116");
+  
+  // Body larger than requestBodyMemoryBytes, which is spooled to disk.
+  Bytes request = NULL;
+  bytesAddStr(&request, "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 4000\r\nConnection: close\r\n\r\n");
+  for (int i = 0; i < 4000; i++) {
+    bytesAddData(&request, "a", 1);
+  }
+  passed = passed
+    && wsRequestBodyUnitTestCase(str(request), "4000 4000 388000");
+  request = bytesDestroy(request);
+  
+  // Bodies larger than maxRequestBodyBytes are rejected without being read.
+  passed = passed && wsRequestBodyUnitTestCase(
+    "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 100000\r\nConnection: close\r\n\r\n",
+    "HTTP/1.1 413 Content Too Large");
+  passed = passed && wsRequestBodyUnitTestCase(
+    "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+    "100000\r\n",
+    "HTTP/1.1 413 Content Too Large");
+  
+  // Malformed chunk size.
+  passed = passed && wsRequestBodyUnitTestCase(
+    "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+    "zz\r\n",
+    "HTTP/1.1 400 Bad Request");
   
   webServer = webServerDestroy(webServer);
+  return passed;
+}
+
+// Size of the route lookup microbenchmark.
+#define ROUTE_BENCHMARK_NAMESPACES 16
+#define ROUTE_BENCHMARK_FUNCTIONS 32
+#define ROUTE_BENCHMARK_LOOKUPS 1000000
+
+double wsRouteBenchmarkNow(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (((double) now.tv_sec) * 1000000000.0) + ((double) now.tv_nsec);
+}
+
+// Dispatch the way requests were dispatched before the route table:  Copy the
+// namespace and function name out of the path and look each one up in a
+// HashTable.
+WsFunction wsRouteBenchmarkHashTableLookup(HashTable *functions,
+  const char *path
+) {
+  const char *firstSlashAt = strchr(path, '/');
+  const char *lastSlashAt = strrchr(path, '/');
+  if ((firstSlashAt == NULL) || (lastSlashAt - firstSlashAt <= 1)) {
+    return NULL;
+  }
+  
+  Bytes wsNamespace = NULL;
+  bytesAddData(&wsNamespace, firstSlashAt + 1, lastSlashAt - firstSlashAt - 1);
+  Bytes functionName = NULL;
+  bytesAddStr(&functionName, lastSlashAt + 1);
+  WsFunction wsFunction = NULL;
+  HashTable *namespaceFunctions
+    = (HashTable*) htGetValue(functions, (char*) wsNamespace);
+  if (namespaceFunctions != NULL) {
+    wsFunction = (WsFunction) htGetValue(namespaceFunctions,
+      (char*) functionName);
+  }
+  functionName = bytesDestroy(functionName);
+  wsNamespace = bytesDestroy(wsNamespace);
+  
+  return wsFunction;
+}
+
+bool wsRouteTableUnitTest(void) {
+  WsFunction functions[] = {
+    soapUnitTestFunction, restUnitTestFunction,
+    streamUnitTestFunction, bodyUnitTestFunction,
+  };
+  static char namespaceNames[ROUTE_BENCHMARK_NAMESPACES][16];
+  static char functionNames[ROUTE_BENCHMARK_FUNCTIONS][16];
+  static WsFunctionDescriptor
+    descriptors[ROUTE_BENCHMARK_NAMESPACES][ROUTE_BENCHMARK_FUNCTIONS + 1];
+  static WsFunctionDescriptor *descriptorLists[ROUTE_BENCHMARK_NAMESPACES][2];
+  static WsNamespace namespaces[ROUTE_BENCHMARK_NAMESPACES + 1];
+  for (int i = 0; i < ROUTE_BENCHMARK_FUNCTIONS; i++) {
+    snprintf(functionNames[i], sizeof(functionNames[i]), "function%d", i);
+  }
+  for (int i = 0; i < ROUTE_BENCHMARK_NAMESPACES; i++) {
+    snprintf(namespaceNames[i], sizeof(namespaceNames[i]), "namespace%d", i);
+    for (int j = 0; j < ROUTE_BENCHMARK_FUNCTIONS; j++) {
+      descriptors[i][j].name = functionNames[j];
+      descriptors[i][j].pointer = functions[(i + j) % 4];
+    }
+    descriptors[i][ROUTE_BENCHMARK_FUNCTIONS].name = NULL;
+    descriptors[i][ROUTE_BENCHMARK_FUNCTIONS].pointer = NULL;
+    descriptorLists[i][0] = descriptors[i];
+    descriptorLists[i][1] = NULL;
+    namespaces[i].name = namespaceNames[i];
+    namespaces[i].functionDescriptors = descriptorLists[i];
+  }
+  namespaces[ROUTE_BENCHMARK_NAMESPACES].name = NULL;
+  namespaces[ROUTE_BENCHMARK_NAMESPACES].functionDescriptors = NULL;
+  
+  WsRouteTable *routeTable = wsRouteTableCreate(namespaces);
+  if (routeTable == NULL) {
+    printLog(ERR, "wsRouteTableCreate returned NULL.\n");
+    return false;
+  }
+  
+  // Every function has to be found in place, including when the key is
+  // followed by more of the request.
+  bool passed = true;
+  char key[64];
+  for (int i = 0; i < ROUTE_BENCHMARK_NAMESPACES; i++) {
+    for (int j = 0; j < ROUTE_BENCHMARK_FUNCTIONS; j++) {
+      int keyLength = snprintf(key, sizeof(key), "%s/%s?a=b",
+        namespaceNames[i], functionNames[j]) - 4;
+      if (wsRouteTableGetFunction(routeTable, key, keyLength)
+        != functions[(i + j) % 4]
+      ) {
+        printLog(ERR, "Wrong function for \"%.*s\".\n", keyLength, key);
+        passed = false;
+      }
+    }
+  }
+  const char *misses[] = {
+    "", "namespace0", "namespace0/", "/function0", "namespace0/function",
+    "namespace0/function00", "namespace16/function0", "css/site.css",
+  };
+  for (size_t i = 0; i < sizeof(misses) / sizeof(misses[0]); i++) {
+    if (wsRouteTableGetFunction(routeTable, misses[i], strlen(misses[i]))
+      != NULL
+    ) {
+      printLog(ERR, "Unexpected function for \"%s\".\n", misses[i]);
+      passed = false;
+    }
+  }
+  
+  // Microbenchmark:  Half the requests call functions and half are for static
+  // files, which used to pay for a failed lookup too.
+  HashTable *hashTable = htCreate(typeString);
+  for (int i = 0; i < ROUTE_BENCHMARK_NAMESPACES; i++) {
+    HashTable *namespaceFunctions = htCreate(typeString);
+    for (int j = 0; j < ROUTE_BENCHMARK_FUNCTIONS; j++) {
+      htAddEntry(namespaceFunctions, functionNames[j],
+        (void*) descriptors[i][j].pointer, typePointerNoCopy);
+    }
+    htAddEntry(hashTable, namespaceNames[i], namespaceFunctions,
+      typeHashTableNoCopy)->type = typeHashTable;
+  }
+  static char paths[64][64];
+  for (int i = 0; i < 64; i++) {
+    if ((i & 1) == 0) {
+      snprintf(paths[i], sizeof(paths[i]), "/%s/%s",
+        namespaceNames[(i * 7) % ROUTE_BENCHMARK_NAMESPACES],
+        functionNames[(i * 13) % ROUTE_BENCHMARK_FUNCTIONS]);
+    } else {
+      snprintf(paths[i], sizeof(paths[i]), "/static/css/file%d.css", i);
+    }
+  }
+  
+  int numFound = 0;
+  double startTime = wsRouteBenchmarkNow();
+  for (int i = 0; i < ROUTE_BENCHMARK_LOOKUPS; i++) {
+    const char *path = paths[i & 63] + 1;
+    numFound
+      += (wsRouteTableGetFunction(routeTable, path, strlen(path)) != NULL);
+  }
+  double routeTableNs
+    = (wsRouteBenchmarkNow() - startTime) / ROUTE_BENCHMARK_LOOKUPS;
+  startTime = wsRouteBenchmarkNow();
+  for (int i = 0; i < ROUTE_BENCHMARK_LOOKUPS; i++) {
+    numFound
+      -= (wsRouteBenchmarkHashTableLookup(hashTable, paths[i & 63]) != NULL);
+  }
+  double hashTableNs
+    = (wsRouteBenchmarkNow() - startTime) / ROUTE_BENCHMARK_LOOKUPS;
+  printLog(INFO, "Route lookup:  %.1f ns with the route table, %.1f ns with "
+    "nested HashTables.\n", routeTableNs, hashTableNs);
+  if (numFound != 0) {
+    printLog(ERR, "Route table and HashTables found different functions.\n");
+    passed = false;
+  }
+  
+  hashTable = htDestroy(hashTable);
+  routeTable = wsRouteTableDestroy(routeTable);
+  return passed;
+}
+
+bool wsArenaUnitTest(void) {
+  WsArena *arena = wsArenaCreate();
+  if (arena == NULL) {
+    printLog(ERR, "wsArenaCreate returned NULL.\n");
+    return false;
+  }
+  
+  bool passed = true;
+  char *first = (char*) wsArenaAlloc(arena, 3);
+  char *second = (char*) wsArenaAlloc(arena, 5);
+  if ((first == NULL) || (second == NULL)
+    || ((((uintptr_t) first) & 15) != 0) || ((((uintptr_t) second) & 15) != 0)
+  ) {
+    printLog(ERR, "Arena allocations are not aligned.\n");
+    passed = false;
+  }
+  
+  // A string that's the most recent allocation grows in place.
+  char *header = wsArenaPrintf(arena, "Content-Length: %d\r\n", 12);
+  char *headerStart = header;
+  wsArenaAddStr(arena, &header, "Server: ");
+  wsArenaAddStr(arena, &header, "UnitTestServer");
+  wsArenaAddStr(arena, &header, "\r\n");
+  if ((header != headerStart) || (strcmp(header,
+    "Content-Length: 12\r\nServer: UnitTestServer\r\n") != 0)
+  ) {
+    printLog(ERR, "Unexpected header \"%s\".\n", strOrNull(header));
+    passed = false;
+  }
+  
+  // One that isn't is copied.
+  char *copy = wsArenaStrdup(arena, "abc");
+  wsArenaAlloc(arena, 1);
+  wsArenaAddStr(arena, &copy, "def");
+  if ((copy == NULL) || (strcmp(copy, "abc" "def") != 0)) {
+    printLog(ERR, "Unexpected copy \"%s\".\n", strOrNull(copy));
+    passed = false;
+  }
+  
+  // Neither is a string written into memory that wasn't allocated for it.
+  char *raw = (char*) wsArenaAlloc(arena, 16);
+  strcpy(raw, "abc");
+  wsArenaAddStr(arena, &raw, "def");
+  if ((raw == NULL) || (strcmp(raw, "abc" "def") != 0)) {
+    printLog(ERR, "Unexpected raw string \"%s\".\n", strOrNull(raw));
+    passed = false;
+  }
+  
+  // Strings larger than a chunk are built up without losing anything.
+  char *large = NULL;
+  for (int i = 0; i < 4096; i++) {
+    wsArenaAddStr(arena, &large, "0123456789");
+  }
+  if ((large == NULL) || (strlen(large) != 40960)
+    || (strncmp(large + 40950, "0123456789", 10) != 0)
+  ) {
+    printLog(ERR, "Large arena string is wrong.\n");
+    passed = false;
+  }
+  if (wsArenaAlloc(arena, 100000) == NULL) {
+    printLog(ERR, "Could not allocate a block larger than a chunk.\n");
+    passed = false;
+  }
+  
+  // Released chunks are reused by the next request on the same thread.
+  wsArenaReset(arena);
+  char *reused = (char*) wsArenaAlloc(arena, 3);
+  wsArenaReset(arena);
+  if (wsArenaAlloc(arena, 3) != reused) {
+    printLog(ERR, "Arena chunk was not reused after a reset.\n");
+    passed = false;
+  }
+  
+  // The arena serializer has to produce exactly what listToJson does.
+  RedBlackTree *responseObject = rbTreeCreate(typeString);
+  i64 i64Value = -1234567890123LL;
+  u32 u32Value = 4000000000U;
+  bool boolValue = true;
+  rbTreeAddEntry(responseObject, "type", "arena \"test\" (100%)", typeString);
+  rbTreeAddEntry(responseObject, "count", &i64Value, typeI64);
+  rbTreeAddEntry(responseObject, "size", &u32Value, typeU32);
+  rbTreeAddEntry(responseObject, "valid", &boolValue, typeBool);
+  rbTreeAddEntry(responseObject, "nothing", NULL, typePointerNoCopy);
+  Bytes expected = listToJson((List*) responseObject);
+  char *json = wsSerializeToJsonInArena(arena, responseObject);
+  if ((json == NULL) || (strcmp(json, str(expected)) != 0)) {
+    printLog(ERR, "Expected \"%s\" from the arena serializer, got \"%s\".\n",
+      str(expected), strOrNull(json));
+    passed = false;
+  }
+  expected = bytesDestroy(expected);
+  
+  // Nested objects are left to the regular serializer.
+  RedBlackTree *nested = rbTreeCreate(typeString);
+  rbTreeAddEntry(nested, "inner", "value", typeString);
+  rbTreeAddEntry(responseObject, "nested", nested, typeRedBlackTreeNoCopy);
+  if (wsSerializeToJsonInArena(arena, responseObject) != NULL) {
+    printLog(ERR, "Arena serializer did not decline a nested object.\n");
+    passed = false;
+  }
+  responseObject = rbTreeDestroy(responseObject);
+  nested = rbTreeDestroy(nested);
+  
+  arena = wsArenaDestroy(arena);
+  return passed;
+}
+
+bool wsListenersUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.numListeners = 4;
+  webServerCreateOptions.pinListeners = true;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+#ifdef __linux__
+  if (webServer->numListeners != 4) {
+    printLog(ERR, "Expected 4 listeners, got %d.\n", webServer->numListeners);
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+#endif // __linux__
+  
+  // New connections are spread across the listeners, so every one of them
+  // has to serve requests.
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  for (int i = 0; i < 32; i++) {
+    if ((!wsUnitTestSendRequest(
+        "GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n",
+        response, sizeof(response)))
+      || (strncmp(response, "HTTP/1.1 200", 12) != 0)
+    ) {
+      printLog(ERR, "Expected 200 for connection %d, got:\n%s\n", i,
+        response);
+      webServer = webServerDestroy(webServer);
+      return false;
+    }
+  }
+  
+  webServer = webServerDestroy(webServer);
+  return true;
+}
+
+bool wsMetricsUnitTestCase(const char *path, const char **expected,
+  size_t numExpected, bool present
+) {
+  int responseSize = 128 * 1024;
+  char *response = (char*) malloc(responseSize);
+  if (response == NULL) {
+    LOG_MALLOC_FAILURE();
+    return false;
+  }
+  
+  char request[128];
+  snprintf(request, sizeof(request),
+    "GET %s HTTP/1.1\r\nConnection: close\r\n\r\n", path);
+  bool passed = wsUnitTestSendRequest(request, response, responseSize);
+  for (size_t i = 0; passed && (i < numExpected); i++) {
+    if ((strstr(response, expected[i]) != NULL) != present) {
+      printLog(ERR, "Expected %s\"%s\" from %s, got:\n%s\n",
+        present ? "" : "no ", expected[i], path, response);
+      passed = false;
+    }
+  }
+  
+  response = (char*) pointerDestroy(response);
+  return passed;
+}
+
+bool wsMetricsUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.webService = &unitTestWebService;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  // One function call with a body and one static file.
+  bool passed = wsRequestBodyUnitTestCase(
+    "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 5\r\nConnection: close\r\n\r\nhello",
+    "5 5 532");
+  const char *ok[] = { "HTTP/1.1 200" };
+  const char *notFound[] = { "HTTP/1.1 404" };
+  passed = passed && wsMetricsUnitTestCase("/index.html", ok, 1, true);
+  
+  // A scrape isn't counted until it has been sent, so check everything
+  // against a single one.
+  const char *expected[] = {
+    "HTTP/1.1 200 OK",
+    "Content-Type: text/plain; version=0.0.4",
+    "ws_responses_total{code=\"200\"} 2\n",
+    "# TYPE ws_request_phase_seconds histogram\n",
+    "ws_request_phase_seconds_count{namespace=\"webService\","
+      "function=\"bodyUnitTestFunction\",phase=\"body_receive\"} 1\n",
+    "ws_request_phase_seconds_count{namespace=\"webService\","
+      "function=\"bodyUnitTestFunction\",phase=\"call\"} 1\n",
+    "ws_request_phase_seconds_bucket{namespace=\"webService\","
+      "function=\"bodyUnitTestFunction\",phase=\"call\",le=\"+Inf\"} 1\n",
+    "ws_request_phase_seconds_count{namespace=\"\","
+      "function=\"\",phase=\"send\"} 1\n",
+  };
+  passed = passed && wsMetricsUnitTestCase("/_metrics", expected,
+    sizeof(expected) / sizeof(expected[0]), true);
+  // Functions that haven't been called are left out.
+  const char *uncalled[] = { "function=\"soapUnitTestFunction\"" };
+  passed = passed && wsMetricsUnitTestCase("/_metrics", uncalled, 1, false);
+  webServer = webServerDestroy(webServer);
+  
+  // The endpoint can be moved and disabled.
+  webServerCreateOptions.metricsPath = "/stats";
+  webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  const char *active[] = { "ws_active_connections 1\n" };
+  passed = passed
+    && wsMetricsUnitTestCase("/stats?x=1", active, 1, true)
+    && wsMetricsUnitTestCase("/_metrics", notFound, 1, true);
+  webServer = webServerDestroy(webServer);
+  
+  webServerCreateOptions.metricsPath = "";
+  webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  passed = passed && wsMetricsUnitTestCase("/_metrics", notFound, 1, true);
+  webServer = webServerDestroy(webServer);
+  
+  return passed;
+}
+
+// Start a server, stall a request in the middle of its body, and time how long
+// it takes to destroy the server.
+bool wsDrainUnitTestCase(WebServerCreateOptions webServerCreateOptions,
+  double maxSeconds
+) {
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  Socket *clientSocket
+     = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+      /*certificate=*/ NULL, /*key=*/ NULL, 500);
+  const char *request = "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 100\r\n\r\nhello";
+  if ((clientSocket == NULL)
+    || (socketSend(clientSocket, request, strlen(request)) < 0)
+  ) {
+    printLog(ERR, "Could not send stalled request.\n");
+    clientSocket = socketDestroy(clientSocket);
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  // Give a worker time to start receiving the body.
+  msleep(250);
+  
+  struct timespec startTime, endTime;
+  timespec_get(&startTime, TIME_UTC);
+  webServer = webServerDestroy(webServer);
+  timespec_get(&endTime, TIME_UTC);
+  double elapsedSeconds = ((double) (endTime.tv_sec - startTime.tv_sec))
+    + (((double) (endTime.tv_nsec - startTime.tv_nsec)) / 1000000000.0);
+  
+  // The connection must have been closed without a response.
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  int numBytesReceived = socketReceive(clientSocket, response,
+    sizeof(response) - 1, 500);
+  clientSocket = socketDestroy(clientSocket);
+  if (elapsedSeconds > maxSeconds) {
+    printLog(ERR, "Server took %.3f seconds to drain.  Expected at most %.3f.\n",
+      elapsedSeconds, maxSeconds);
+    return false;
+  } else if (numBytesReceived > 0) {
+    printLog(ERR, "Expected no response to stalled request, got:\n%s\n",
+      response);
+    return false;
+  }
+  
+  return true;
+}
+
+bool wsDrainUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.webService = &unitTestWebService;
+  
+  // The stalled request holds a worker until the drain deadline, which is
+  // shorter than the time the server would wait for the rest of the body.
+  webServerCreateOptions.drainTimeoutSeconds = 1;
+  if (wsDrainUnitTestCase(webServerCreateOptions, 2.0) == false) {
+    return false;
+  }
+  
+  // Without a drain, it's closed right away.
+  webServerCreateOptions.drainTimeoutSeconds = -1;
+  if (wsDrainUnitTestCase(webServerCreateOptions, 0.75) == false) {
+    return false;
+  }
+  
+  return true;
+}
+
+bool wsClientLimitsUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  WsRateLimit rateLimits[] = {
+    { "webService", 1.0, 2 },
+    { NULL, 0.0, 0 },
+  };
+  webServerCreateOptions.webService = &unitTestWebService;
+  webServerCreateOptions.maxConnectionsPerClient = 2;
+  webServerCreateOptions.rateLimits = rateLimits;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  // A third connection while two are open is turned away.
+  Socket *clientSockets[2] = { NULL, NULL };
+  for (int i = 0; i < 2; i++) {
+    clientSockets[i] = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+      /*certificate=*/ NULL, /*key=*/ NULL, 500);
+  }
+  const char *request = "GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n";
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  bool passed = (clientSockets[0] != NULL) && (clientSockets[1] != NULL)
+    && wsUnitTestSendRequest(request, response, sizeof(response));
+  if ((passed == false)
+    || (strstr(response, "HTTP/1.1 429 Too Many Requests") == NULL)
+  ) {
+    printLog(ERR, "Expected 429 for third connection, got:\n%s\n", response);
+    passed = false;
+  }
+  
+  // Once they're closed, connections are accepted again.
+  for (int i = 0; i < 2; i++) {
+    clientSockets[i] = socketDestroy(clientSockets[i]);
+  }
+  msleep(500);
+  passed = passed && wsRequestBodyUnitTestCase(request, "HTTP/1.1 200 OK");
+  
+  // The burst of the namespace's limit is used up by the first two calls.
+  const char *callRequest
+    = "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 5\r\nConnection: close\r\n\r\nhello";
+  passed = passed
+    && wsRequestBodyUnitTestCase(callRequest, "5 5 532")
+    && wsRequestBodyUnitTestCase(callRequest, "5 5 532")
+    && wsRequestBodyUnitTestCase(callRequest,
+      "HTTP/1.1 429 Too Many Requests")
+    && wsRequestBodyUnitTestCase(callRequest, "Retry-After: 1\r\n");
+  
+  // Static files aren't in the namespace, so they aren't limited.
+  passed = passed && wsRequestBodyUnitTestCase(request, "HTTP/1.1 200 OK");
+  
+  // The bucket refills at one request per second.
+  sleep(1);
+  passed = passed && wsRequestBodyUnitTestCase(callRequest, "5 5 532");
+  
+  // The limit follows the function that's actually called, so naming it in
+  // the SOAPAction doesn't get a call out from under its namespace's limit.
+  const char *soapRequest
+    = "POST /other/function HTTP/1.1\r\nHost: 127.0.0.1:8999\r\n"
+    "SOAPAction: \"127.0.0.1:8999/webService/bodyUnitTestFunction\"\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 5\r\nConnection: close\r\n\r\nhello";
+  passed = passed && wsRequestBodyUnitTestCase(soapRequest,
+    "HTTP/1.1 429 Too Many Requests");
+  
+  webServer = webServerDestroy(webServer);
+  return passed;
+}
+
+bool wsResponseCacheUnitTestCase(const char *location, const char *expected) {
+  char request[256];
+  snprintf(request, sizeof(request),
+    "GET /webService/%s HTTP/1.1\r\nConnection: close\r\n\r\n", location);
+  return wsRequestBodyUnitTestCase(request, expected);
+}
+
+bool wsResponseCacheUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.webService = &unitTestWebService;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  cachedUnitTestFunctionCalls = 0;
+  
+  // Repeated calls are answered from the cache.  Parameters that aren't in the
+  // policy's keys don't matter.
+  bool passed
+    = wsResponseCacheUnitTestCase("cachedUnitTestFunction?id=1", "\"1-1\"")
+    && wsResponseCacheUnitTestCase("cachedUnitTestFunction?id=1", "\"1-1\"")
+    && wsResponseCacheUnitTestCase(
+      "cachedUnitTestFunction?other=2&id=1", "\"1-1\"")
+    && wsResponseCacheUnitTestCase("cachedUnitTestFunction?id=2", "\"2-2\"");
+  
+  // Invalidating one response leaves the others.
+  passed = passed
+    && wsResponseCacheUnitTestCase("invalidateUnitTestFunction?id=1",
+      "\"removed-1\"")
+    && wsResponseCacheUnitTestCase("cachedUnitTestFunction?id=1", "\"1-3\"")
+    && wsResponseCacheUnitTestCase("cachedUnitTestFunction?id=2", "\"2-2\"");
+  
+  // The cache holds two responses, so the least-recently used one is evicted.
+  passed = passed
+    && wsResponseCacheUnitTestCase("cachedUnitTestFunction?id=3", "\"3-4\"")
+    && wsResponseCacheUnitTestCase("cachedUnitTestFunction?id=1", "\"1-5\"");
+  
+  // Invalidating without parameters removes everything.
+  passed = passed
+    && wsResponseCacheUnitTestCase("invalidateUnitTestFunction?all=1",
+      "\"removed-2\"")
+    && wsResponseCacheUnitTestCase("cachedUnitTestFunction?id=3", "\"3-6\"");
+  
+  const char *expected[] = {
+    "ws_response_cache_lookups_total{namespace=\"webService\","
+      "function=\"cachedUnitTestFunction\",result=\"hit\"} 3\n",
+    "ws_response_cache_lookups_total{namespace=\"webService\","
+      "function=\"cachedUnitTestFunction\",result=\"miss\"} 6\n",
+  };
+  passed = passed && wsMetricsUnitTestCase(WS_DEFAULT_METRICS_PATH,
+    expected, sizeof(expected) / sizeof(expected[0]), true);
+  
+  webServer = webServerDestroy(webServer);
+  return passed;
+}
+
+// Send a request over a new TLS connection to port 8999, resuming *session if
+// there is one, and replace *session with the connection's session.  Returns 1
+// if the session was resumed, 0 if it wasn't, and -1 on failure.
+int wsTlsSessionUnitTestRequest(SSL_CTX *sslContext, SSL_SESSION **session,
+  const char *request, char *response, int responseSize
+) {
+  BIO *bio = BIO_new_ssl_connect(sslContext);
+  SSL *ssl = NULL;
+  if ((bio == NULL) || (BIO_get_ssl(bio, &ssl) <= 0)) {
+    BIO_free_all(bio);
+    return -1;
+  }
+  if (*session != NULL) {
+    SSL_set_session(ssl, *session);
+  }
+  BIO_set_conn_hostname(bio, "127.0.0.1:8999");
+  
+  int returnValue = -1;
+  if ((BIO_do_handshake(bio) > 0) && (BIO_puts(bio, request) > 0)) {
+    // Read to the end so that the tickets sent after the handshake are seen.
+    int length = 0;
+    int numBytes = 0;
+    while ((length < responseSize - 1)
+      && ((numBytes = BIO_read(bio, &response[length],
+        responseSize - 1 - length)) > 0)
+    ) {
+      length += numBytes;
+    }
+    response[length] = '\0';
+    returnValue = SSL_session_reused(ssl);
+    if (*session != NULL) {
+      SSL_SESSION_free(*session);
+    }
+    *session = SSL_get1_session(ssl);
+  }
+  
+  BIO_free_all(bio);
+  return returnValue;
+}
+
+bool wsTlsSessionUnitTestCase(WebServerCreateOptions webServerCreateOptions,
+  bool resumable
+) {
+  webServerCreateOptions.socketMode = TLS;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  SSL_CTX *sslContext = SSL_CTX_new(TLS_client_method());
+  SSL_SESSION *session = NULL;
+  char response[JUMBO_FRAME_SIZE];
+  const char *request = "GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n";
+  
+  // The first connection does a full handshake.  The second one resumes it.
+  bool passed = true;
+  for (int i = 0; passed && (i < 2); i++) {
+    int expected = ((i == 1) && resumable) ? 1 : 0;
+    int resumed = wsTlsSessionUnitTestRequest(sslContext, &session,
+      request, response, sizeof(response));
+    if ((resumed != expected)
+      || (strstr(response, "HTTP/1.1 200 OK") == NULL)
+    ) {
+      printLog(ERR, "Expected resumed=%d for connection %d, got %d:\n%s\n",
+        expected, i, resumed, response);
+      passed = false;
+    }
+  }
+  
+  // The metrics request itself is a third, full, handshake.
+  char resumedLine[128];
+  snprintf(resumedLine, sizeof(resumedLine),
+    "ws_tls_handshakes_total{resumed=\"true\"} %d\n", resumable ? 1 : 0);
+  char fullLine[128];
+  snprintf(fullLine, sizeof(fullLine),
+    "ws_tls_handshakes_total{resumed=\"false\"} %d\n", resumable ? 2 : 3);
+  if (session != NULL) {
+    SSL_SESSION_free(session); session = NULL;
+  }
+  if (passed) {
+    wsTlsSessionUnitTestRequest(sslContext, &session,
+      "GET " WS_DEFAULT_METRICS_PATH " HTTP/1.1\r\nConnection: close\r\n\r\n",
+      response, sizeof(response));
+    if ((strstr(response, resumedLine) == NULL)
+      || (strstr(response, fullLine) == NULL)
+    ) {
+      printLog(ERR, "Expected \"%s\" and \"%s\" in metrics, got:\n%s\n",
+        resumedLine, fullLine, response);
+      passed = false;
+    }
+  }
+  
+  if (session != NULL) {
+    SSL_SESSION_free(session); session = NULL;
+  }
+  SSL_CTX_free(sslContext); sslContext = NULL;
+  webServer = webServerDestroy(webServer);
+  return passed;
+}
+
+bool wsTlsSessionUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  // Resumption with session tickets.
+  if (wsTlsSessionUnitTestCase(webServerCreateOptions, true) == false) {
+    return false;
+  }
+  
+  // Without tickets, sessions are resumed from the server's cache.
+  webServerCreateOptions.tlsTicketKeyLifetimeSeconds = -1;
+  if (wsTlsSessionUnitTestCase(webServerCreateOptions, true) == false) {
+    return false;
+  }
+  
+  // With neither, every handshake is a full one.
+  webServerCreateOptions.tlsSessionCacheSize = -1;
+  if (wsTlsSessionUnitTestCase(webServerCreateOptions, false) == false) {
+    return false;
+  }
+  
+#ifdef __linux__
+  // The event loop's reactors run the handshakes themselves.
+  webServerCreateOptions.tlsTicketKeyLifetimeSeconds = 0;
+  webServerCreateOptions.tlsSessionCacheSize = 0;
+  webServerCreateOptions.serverMode = WS_EVENT_LOOP;
+  if (wsTlsSessionUnitTestCase(webServerCreateOptions, true) == false) {
+    return false;
+  }
+#endif // __linux__
+  
+  return true;
+}
+
+bool wsCoroutinesUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.webService = &unitTestWebService;
+  webServerCreateOptions.serverMode = WS_COROUTINES;
+  webServerCreateOptions.numSchedulerThreads = 2;
+  webServerCreateOptions.maxCoroutinesPerThread = 4;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  // Compression runs on the coroutine's stack, both for a file and for a
+  // streamed body.  The streamed body must make it to the final chunk.
+  bool passed = wsRequestBodyUnitTestCase(
+    "GET /wsCompression.txt HTTP/1.1\r\nAccept-Encoding: gzip\r\n"
+    "Connection: close\r\n\r\n", "Content-Encoding: gzip\r\n");
+  int streamedSize = 128 * 1024;
+  char *streamed = (char*) malloc(streamedSize);
+  if ((passed) && ((streamed == NULL)
+    || (!wsUnitTestSendRequest(
+      "GET /webService/streamUnitTestFunction HTTP/1.1\r\n"
+      "Accept-Encoding: gzip\r\nConnection: close\r\n\r\n",
+      streamed, streamedSize)))
+  ) {
+    printLog(ERR, "No gzip stream from coroutine.\n");
+    passed = false;
+  } else if (passed) {
+    // The body may contain NUL bytes, so find its end from the back.
+    int streamedLength = streamedSize - 1;
+    while ((streamedLength > 0) && (streamed[streamedLength - 1] == '\0')) {
+      streamedLength--;
+    }
+    const char *lastChunk = "\r\n0\r\n\r\n";
+    int lastChunkLength = (int) strlen(lastChunk);
+    if ((strstr(streamed, "Content-Encoding: gzip\r\n") == NULL)
+      || (streamedLength < lastChunkLength)
+      || (memcmp(&streamed[streamedLength - lastChunkLength], lastChunk,
+        lastChunkLength) != 0)
+    ) {
+      printLog(ERR, "Expected complete gzip stream, got %d bytes.\n",
+        streamedLength);
+      passed = false;
+    }
+  }
+  streamed = (char*) pointerDestroy(streamed);
+  
+  // Let those connections' coroutines finish before filling the schedulers.
+  msleep(250);
+  
+  // More persistent connections than scheduler threads, each with a request
+  // in flight at the same time.  Every one is served twice.
+  Socket *clientSockets[8] = { NULL };
+  const char *request = "GET /index.html HTTP/1.1\r\n\r\n";
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  for (int i = 0; i < 8; i++) {
+    clientSockets[i] = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+      /*certificate=*/ NULL, /*key=*/ NULL, 500);
+  }
+  for (int round = 0; passed && (round < 2); round++) {
+    for (int i = 0; passed && (i < 8); i++) {
+      passed = (clientSockets[i] != NULL)
+        && (socketSend(clientSockets[i], request, strlen(request)) > 0);
+    }
+    for (int i = 0; passed && (i < 8); i++) {
+      memset(response, 0, sizeof(response));
+      socketReceive(clientSockets[i], response, sizeof(response) - 1, 1000);
+      if ((strncmp(response, "HTTP/1.1 200 OK", 15) != 0)
+        || (strstr(response, "Hello world!") == NULL)
+      ) {
+        printLog(ERR, "Expected 200 for connection %d, got:\n%s\n", i,
+          response);
+        passed = false;
+      }
+    }
+  }
+  
+  // The schedulers are full, so the next connection is turned away.
+  const char *callRequest
+    = "POST /webService/bodyUnitTestFunction HTTP/1.1\r\n"
+    "Content-Type: application/octet-stream\r\n"
+    "Content-Length: 5\r\nConnection: close\r\n\r\nhello";
+  passed = passed && wsRequestBodyUnitTestCase(callRequest,
+    "HTTP/1.1 503 Service Unavailable");
+  
+  // Once one closes, web service calls go through again.
+  clientSockets[0] = socketDestroy(clientSockets[0]);
+  msleep(250);
+  passed = passed && wsRequestBodyUnitTestCase(callRequest, "5 5 532");
+  
+  // The idle connections don't hold up shutting down.
+  struct timespec startTime, endTime;
+  timespec_get(&startTime, TIME_UTC);
+  webServer = webServerDestroy(webServer);
+  timespec_get(&endTime, TIME_UTC);
+  double elapsedSeconds = ((double) (endTime.tv_sec - startTime.tv_sec))
+    + (((double) (endTime.tv_nsec - startTime.tv_nsec)) / 1000000000.0);
+  if (elapsedSeconds > 1.5) {
+    printLog(ERR, "Server took %.3f seconds to shut down.\n", elapsedSeconds);
+    passed = false;
+  }
+  for (int i = 0; i < 8; i++) {
+    clientSockets[i] = socketDestroy(clientSockets[i]);
+  }
+  
+  // TLS handshakes yield to the scheduler too.
+  passed = passed && wsTlsSessionUnitTestCase(webServerCreateOptions, true);
+  
+  return passed;
+}
+
+bool wsDeferredResponseUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.webService = &unitTestWebService;
+  // A single scheduler thread has to wait on all of the responses at once in
+  // WS_COROUTINES mode.
+  webServerCreateOptions.numSchedulerThreads = 1;
+  webServerCreateOptions.drainTimeoutSeconds = -1;
+  WsServerMode serverModes[] = { WS_THREADED, WS_COROUTINES };
+  bool passed = true;
+  
+  for (int mode = 0; passed && (mode < 2); mode++) {
+    webServerCreateOptions.serverMode = serverModes[mode];
+    WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+    if (webServer == NULL) {
+      printLog(ERR, "webServerCreate returned NULL.\n");
+      return false;
+    }
+    for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+    
+    // Eight calls in flight at once, each completed 300 milliseconds later
+    // from another thread.
+    struct timespec startTime, endTime;
+    timespec_get(&startTime, TIME_UTC);
+    Socket *clientSockets[8] = { NULL };
+    char request[128];
+    for (int i = 0; passed && (i < 8); i++) {
+      snprintf(request, sizeof(request),
+        "GET /webService/deferredUnitTestFunction?id=%d&delayMs=300 "
+        "HTTP/1.1\r\nConnection: close\r\n\r\n", i);
+      clientSockets[i] = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+        /*certificate=*/ NULL, /*key=*/ NULL, 500);
+      passed = (clientSockets[i] != NULL)
+        && (socketSend(clientSockets[i], request, strlen(request)) > 0);
+    }
+    ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+    char expected[32];
+    for (int i = 0; passed && (i < 8); i++) {
+      memset(response, 0, sizeof(response));
+      socketReceive(clientSockets[i], response, sizeof(response) - 1, 2000);
+      snprintf(expected, sizeof(expected), "deferred-%d", i);
+      if ((strncmp(response, "HTTP/1.1 200 OK", 15) != 0)
+        || (strstr(response, expected) == NULL)
+      ) {
+        printLog(ERR, "Expected \"%s\" for call %d, got:\n%s\n", expected, i,
+          response);
+        passed = false;
+      }
+    }
+    timespec_get(&endTime, TIME_UTC);
+    double elapsedSeconds = ((double) (endTime.tv_sec - startTime.tv_sec))
+      + (((double) (endTime.tv_nsec - startTime.tv_nsec)) / 1000000000.0);
+    if (elapsedSeconds > 1.5) {
+      printLog(ERR, "Deferred calls took %.3f seconds.\n", elapsedSeconds);
+      passed = false;
+    }
+    for (int i = 0; i < 8; i++) {
+      clientSockets[i] = socketDestroy(clientSockets[i]);
+    }
+    
+    // A response that isn't completed in time is answered with a 504 and
+    // completing it afterward fails.
+    deferredUnitTestLateCompletions = 0;
+    strcpy(request, "GET /webService/deferredUnitTestFunction?id=late"
+      "&delayMs=1500&timeout=1 HTTP/1.1\r\nConnection: close\r\n\r\n");
+    Socket *clientSocket = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+      /*certificate=*/ NULL, /*key=*/ NULL, 500);
+    memset(response, 0, sizeof(response));
+    if ((clientSocket != NULL)
+      && (socketSend(clientSocket, request, strlen(request)) > 0)
+    ) {
+      socketReceive(clientSocket, response, sizeof(response) - 1, 2000);
+    }
+    clientSocket = socketDestroy(clientSocket);
+    if (passed
+      && (strncmp(response, "HTTP/1.1 504 Gateway Timeout", 28) != 0)
+    ) {
+      printLog(ERR, "Expected 504 for the late call, got:\n%s\n", response);
+      passed = false;
+    }
+    sleep(1);
+    if (passed && (deferredUnitTestLateCompletions != 1)) {
+      printLog(ERR, "Expected the late completion to fail.\n");
+      passed = false;
+    }
+    
+    // Shutting down cancels a response that would be waited on indefinitely.
+    strcpy(request, "GET /webService/deferredUnitTestFunction?id=forever"
+      "&delayMs=1000&timeout=-1 HTTP/1.1\r\n\r\n");
+    clientSocket = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+      /*certificate=*/ NULL, /*key=*/ NULL, 500);
+    passed = passed && (clientSocket != NULL)
+      && (socketSend(clientSocket, request, strlen(request)) > 0);
+    msleep(200);
+    timespec_get(&startTime, TIME_UTC);
+    webServer = webServerDestroy(webServer);
+    timespec_get(&endTime, TIME_UTC);
+    elapsedSeconds = ((double) (endTime.tv_sec - startTime.tv_sec))
+      + (((double) (endTime.tv_nsec - startTime.tv_nsec)) / 1000000000.0);
+    if (elapsedSeconds > 0.5) {
+      printLog(ERR, "Server took %.3f seconds to shut down.\n",
+        elapsedSeconds);
+      passed = false;
+    }
+    clientSocket = socketDestroy(clientSocket);
+    sleep(1);
+    if (passed && (deferredUnitTestLateCompletions != 2)) {
+      printLog(ERR, "Expected the cancelled completion to fail.\n");
+      passed = false;
+    }
+  }
+  
+  return passed;
+}
+
+bool wsBatchUnitTestCase(const char *body, const char **expected) {
+  char request[1024];
+  snprintf(request, sizeof(request), "POST /_batch HTTP/1.1\r\n"
+    "Content-Type: application/json\r\nContent-Length: %d\r\n"
+    "Connection: close\r\n\r\n%s", (int) strlen(body), body);
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  Socket *clientSocket = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+    /*certificate=*/ NULL, /*key=*/ NULL, 500);
+  if ((clientSocket != NULL)
+    && (socketSend(clientSocket, request, strlen(request)) > 0)
+  ) {
+    // Made one after another, the calls take longer than the usual timeout.
+    socketReceive(clientSocket, response, sizeof(response) - 1, 3000);
+  }
+  clientSocket = socketDestroy(clientSocket);
+  
+  // The expected strings have to appear in order.
+  const char *searchFrom = response;
+  for (int i = 0; expected[i] != NULL; i++) {
+    const char *found = strstr(searchFrom, expected[i]);
+    if (found == NULL) {
+      printLog(ERR, "Expected \"%s\" in order in response to \"%s\", got:\n"
+        "%s\n", expected[i], body, response);
+      return false;
+    }
+    searchFrom = found + strlen(expected[i]);
+  }
+  
+  return true;
+}
+
+bool wsBatchUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  webServerCreateOptions.webService = &unitTestWebService;
+  webServerCreateOptions.maxBatchCalls = 8;
+  webServerCreateOptions.parallelBatchCalls = true;
+  // Shutting down doesn't wait for deferred calls to be completed.
+  webServerCreateOptions.drainTimeoutSeconds = -1;
+  // Calls are always made one after another in WS_COROUTINES mode.
+  WsServerMode serverModes[] = { WS_THREADED, WS_COROUTINES };
+  bool passed = true;
+  
+  for (int mode = 0; passed && (mode < 2); mode++) {
+    webServerCreateOptions.serverMode = serverModes[mode];
+    WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+    if (webServer == NULL) {
+      printLog(ERR, "webServerCreate returned NULL.\n");
+      return false;
+    }
+    for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+    
+    // Four 200-millisecond calls, a deferred response, a streamed response
+    // that can't be batched, and calls that can't be made at all.
+    const char *body = "["
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"batchUnitTestFunction\", "
+      "\"params\": {\"id\": \"0\", \"delayMs\": \"200\"}}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"batchUnitTestFunction\", "
+      "\"params\": {\"id\": \"1\", \"delayMs\": \"200\"}}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"noSuchFunction\"}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"batchUnitTestFunction\", "
+      "\"params\": {\"id\": \"2\", \"delayMs\": \"200\"}}, "
+      "{\"namespace\": \"webService\"}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"deferredUnitTestFunction\"}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"streamUnitTestFunction\"}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"batchUnitTestFunction\", "
+      "\"params\": {\"id\": \"3\", \"delayMs\": \"200\"}}"
+      "]";
+    const char *expected[] = {
+      "HTTP/1.1 200 OK",
+      "{\"status\": 200", "batch-0",
+      "{\"status\": 200", "batch-1",
+      "{\"status\": 404}",
+      "{\"status\": 200", "batch-2",
+      "{\"status\": 400}",
+      "{\"status\": 200", "deferred-none",
+      "{\"status\": 500}",
+      "{\"status\": 200", "batch-3",
+      NULL
+    };
+    struct timespec startTime, endTime;
+    timespec_get(&startTime, TIME_UTC);
+    passed = wsBatchUnitTestCase(body, expected);
+    timespec_get(&endTime, TIME_UTC);
+    double elapsedSeconds = ((double) (endTime.tv_sec - startTime.tv_sec))
+      + (((double) (endTime.tv_nsec - startTime.tv_nsec)) / 1000000000.0);
+    if (passed && (serverModes[mode] == WS_THREADED)
+      && (elapsedSeconds > 0.6)
+    ) {
+      printLog(ERR, "Parallel batch took %.3f seconds.\n", elapsedSeconds);
+      passed = false;
+    }
+    
+    const char *emptyExpected[] = { "HTTP/1.1 200 OK", "\r\n\r\n[]", NULL };
+    passed = passed && wsBatchUnitTestCase(" [ ] ", emptyExpected);
+    const char *malformedExpected[] = { "HTTP/1.1 400 Bad Request", NULL };
+    passed = passed && wsBatchUnitTestCase("[{}, ", malformedExpected);
+    passed = passed && wsBatchUnitTestCase("{}", malformedExpected);
+    
+    // Calls with values of the wrong types are rejected one by one without
+    // being made.
+    const char *typesBody = "["
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"batchUnitTestFunction\", \"params\": 7}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"batchUnitTestFunction\", \"params\": \"abc\"}, "
+      "{\"namespace\": 7, \"function\": \"batchUnitTestFunction\"}, "
+      "{\"namespace\": \"webService\", \"function\": {\"id\": \"4\"}}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"batchUnitTestFunction\", \"params\": {\"id\": \"4\"}}"
+      "]";
+    const char *typesExpected[] = {
+      "HTTP/1.1 200 OK",
+      "{\"status\": 400}", "{\"status\": 400}",
+      "{\"status\": 400}", "{\"status\": 400}",
+      "{\"status\": 200", "batch-4",
+      NULL
+    };
+    passed = passed && wsBatchUnitTestCase(typesBody, typesExpected);
+    const char *tooLargeExpected[] = { "HTTP/1.1 413 Content Too Large", NULL };
+    passed = passed && wsBatchUnitTestCase(
+      "[{}, {}, {}, {}, {}, {}, {}, {}, {}]", tooLargeExpected);
+    
+    // Shutting down cancels the responses deferred by every call of a batch,
+    // including calls being made on worker threads.
+    const char *deferredBody = "["
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"deferredUnitTestFunction\", "
+      "\"params\": {\"id\": \"0\", \"delayMs\": \"3000\"}}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"deferredUnitTestFunction\", "
+      "\"params\": {\"id\": \"1\", \"delayMs\": \"3000\"}}, "
+      "{\"namespace\": \"webService\", "
+      "\"function\": \"deferredUnitTestFunction\", "
+      "\"params\": {\"id\": \"2\", \"delayMs\": \"3000\"}}"
+      "]";
+    char request[1024];
+    snprintf(request, sizeof(request), "POST /_batch HTTP/1.1\r\n"
+      "Content-Type: application/json\r\nContent-Length: %d\r\n\r\n%s",
+      (int) strlen(deferredBody), deferredBody);
+    Socket *clientSocket = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+      /*certificate=*/ NULL, /*key=*/ NULL, 500);
+    passed = passed && (clientSocket != NULL)
+      && (socketSend(clientSocket, request, strlen(request)) > 0);
+    msleep(200);
+    timespec_get(&startTime, TIME_UTC);
+    webServer = webServerDestroy(webServer);
+    timespec_get(&endTime, TIME_UTC);
+    elapsedSeconds = ((double) (endTime.tv_sec - startTime.tv_sec))
+      + (((double) (endTime.tv_nsec - startTime.tv_nsec)) / 1000000000.0);
+    if (passed && (elapsedSeconds > 0.5)) {
+      printLog(ERR, "Server took %.3f seconds to shut down with a deferred "
+        "batch.\n", elapsedSeconds);
+      passed = false;
+    }
+    clientSocket = socketDestroy(clientSocket);
+  }
+  
+  return passed;
+}
+
+bool wsRangeUnitTestCase(const char *headers, const char **expected) {
+  char request[1024];
+  snprintf(request, sizeof(request), "GET /wsRange.txt HTTP/1.1\r\n"
+    "%sConnection: close\r\n\r\n", headers);
+  ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+  if (!wsUnitTestSendRequest(request, response, sizeof(response))) {
+    printLog(ERR, "No response to \"%s\".\n", headers);
+    return false;
+  }
+  
+  // The expected strings have to appear in order.
+  const char *searchFrom = response;
+  for (int i = 0; expected[i] != NULL; i++) {
+    const char *found = strstr(searchFrom, expected[i]);
+    if (found == NULL) {
+      printLog(ERR, "Expected \"%s\" in order in response to \"%s\", got:\n"
+        "%s\n", expected[i], headers, response);
+      return false;
+    }
+    searchFrom = found + strlen(expected[i]);
+  }
+  
+  return true;
+}
+
+bool wsRangeUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  const char *content = "abcdefghijklmnopqrstuvwxyz";
+  putFileContent("/tmp/wsRange.txt", content, strlen(content));
+  // Ranges of cached files are cut from memory and ranges of files that
+  // aren't cached are read from disk.
+  i64 fileCacheMaxBytes[] = { 0, -1 };
+  bool passed = true;
+  
+  for (int cache = 0; passed && (cache < 2); cache++) {
+    webServerCreateOptions.fileCacheMaxBytes = fileCacheMaxBytes[cache];
+    WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+    if (webServer == NULL) {
+      printLog(ERR, "webServerCreate returned NULL.\n");
+      remove("/tmp/wsRange.txt");
+      return false;
+    }
+    for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+    
+    const char *single[] = { "HTTP/1.1 206 Partial Content",
+      "Content-Range: bytes 2-5/26", "Content-Length: 4", "\r\n\r\ncdef",
+      NULL };
+    passed = wsRangeUnitTestCase("Range: bytes=2-5\r\n", single);
+    const char *suffix[] = { "HTTP/1.1 206 Partial Content",
+      "Content-Range: bytes 23-25/26", "\r\n\r\nxyz", NULL };
+    passed = passed && wsRangeUnitTestCase("Range: bytes=-3\r\n", suffix);
+    const char *multiple[] = { "HTTP/1.1 206 Partial Content",
+      "Content-type: multipart/byteranges; boundary=",
+      "\r\n\r\n--", "Content-Range: bytes 0-1/26\r\n\r\nab\r\n--",
+      "Content-Range: bytes 24-25/26\r\n\r\nyz\r\n--", "--\r\n", NULL };
+    passed = passed
+      && wsRangeUnitTestCase("Range: bytes=0-1, 24-\r\n", multiple);
+    const char *unsatisfiable[] = { "HTTP/1.1 416 Range Not Satisfiable",
+      "Content-Range: bytes */26", NULL };
+    passed = passed
+      && wsRangeUnitTestCase("Range: bytes=30-40\r\n", unsatisfiable);
+    
+    // A stale If-Range or a Range that can't be parsed gets the whole file.
+    const char *whole[] = { "HTTP/1.1 200 OK", "Accept-Ranges: bytes",
+      "\r\n\r\nabcdefghijklmnopqrstuvwxyz", NULL };
+    passed = passed && wsRangeUnitTestCase(
+      "Range: bytes=2-5\r\nIf-Range: \"stale\"\r\n", whole);
+    passed = passed && wsRangeUnitTestCase(
+      "Range: bytes=2-5\r\nIf-Range: Thu, 01 Jan 1970 00:00:00 GMT\r\n",
+      whole);
+    passed = passed && wsRangeUnitTestCase("Range: lines=2-5\r\n", whole);
+    passed = passed && wsRangeUnitTestCase("Range: bytes=5-2\r\n", whole);
+    
+    webServer = webServerDestroy(webServer);
+  }
+  
+  remove("/tmp/wsRange.txt");
+  return passed;
+}
+
+bool wsTraceUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  remove("/tmp/wsTrace.log");
+  webServerCreateOptions.traceFilePath = "/tmp/wsTrace.log";
+  // Only trace the requests that were sampled upstream.
+  webServerCreateOptions.traceSampleRate = -1;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  const char *traceparents[] = {
+    "traceparent: 00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01\r\n",
+    "traceparent: 00-11111111111111111111111111111111-2222222222222222-00\r\n",
+    "",
+  };
+  bool passed = true;
+  for (int i = 0; passed && (i < 3); i++) {
+    char request[1024];
+    snprintf(request, sizeof(request), "GET /index.html HTTP/1.1\r\n"
+      "%sConnection: close\r\n\r\n", traceparents[i]);
+    ZEROINIT(char response[JUMBO_FRAME_SIZE]);
+    passed = wsUnitTestSendRequest(request, response, sizeof(response))
+      && (strstr(response, "HTTP/1.1 200 OK") != NULL);
+  }
+  // Destroying the server writes out the spans that are left.
+  webServer = webServerDestroy(webServer);
+  if (passed == false) {
+    printLog(ERR, "Could not get /index.html.\n");
+    remove("/tmp/wsTrace.log");
+    return false;
+  }
+  
+  Bytes trace = getFileContent("/tmp/wsTrace.log");
+  const char *expected[] = {
+    "\"name\": \"header_receive\"",
+    "\"name\": \"send\"",
+    "\"parentSpanId\": \"b7ad6b7169203331\", \"name\": \"request\"",
+    "\"detail\": \"GET /index.html 200\"",
+    NULL
+  };
+  for (int i = 0; passed && (expected[i] != NULL); i++) {
+    if ((trace == NULL) || (strstr((char*) trace, expected[i]) == NULL)) {
+      printLog(ERR, "Expected %s in trace, got:\n%s\n", expected[i],
+        (trace != NULL) ? (char*) trace : "(nothing)");
+      passed = false;
+    }
+  }
+  
+  // Every span is part of the one sampled request.
+  int numSpans = 0;
+  int numSampledSpans = 0;
+  for (const char *found = (const char*) trace; passed
+    && ((found = strstr(found, "\"traceId\": \"")) != NULL); found++
+  ) {
+    numSpans++;
+    if (strncmp(found + 12, "0af7651916cd43dd8448eb211c80319c\"", 33) == 0) {
+      numSampledSpans++;
+    }
+  }
+  if (passed && ((numSpans < 3) || (numSampledSpans != numSpans))) {
+    printLog(ERR, "Expected only spans of the sampled request, got:\n%s\n",
+      (char*) trace);
+    passed = false;
+  }
+  
+  trace = bytesDestroy(trace);
+  remove("/tmp/wsTrace.log");
+  return passed;
+}
+
+bool wsAccessLogUnitTest(WebServerCreateOptions webServerCreateOptions) {
+  remove("/tmp/wsAccess.log");
+  webServerCreateOptions.webService = &unitTestWebService;
+  webServerCreateOptions.accessLogPath = "/tmp/wsAccess.log";
+  webServerCreateOptions.accessLogRotateSeconds = -1;
+  WebServer *webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  int responseSize = 128 * 1024;
+  char *response = (char*) malloc(responseSize);
+  if (response == NULL) {
+    LOG_MALLOC_FAILURE();
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  bool passed = wsUnitTestSendRequest(
+    "GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n",
+    response, responseSize);
+  passed = passed && wsUnitTestSendRequest(
+    "GET /webService/streamUnitTestFunction HTTP/1.1\r\n"
+    "Connection: close\r\n\r\n", response, responseSize);
+  response = (char*) pointerDestroy(response);
+  // Destroying the server writes out the records that are left.
+  webServer = webServerDestroy(webServer);
+  if (passed == false) {
+    printLog(ERR, "Could not send requests.\n");
+    remove("/tmp/wsAccess.log");
+    return false;
+  }
+  
+  FILE *input = fopen("/tmp/wsAccess.log", "rb");
+  FILE *output = fopen("/tmp/wsAccess.csv", "w");
+  i64 numRecords = -1;
+  if ((input != NULL) && (output != NULL)) {
+    numRecords = accessLogDecode(input, output, true, true);
+  }
+  if (input != NULL) {
+    fclose(input);
+  }
+  if (output != NULL) {
+    fclose(output);
+  }
+  Bytes csv = getFileContent("/tmp/wsAccess.csv");
+  remove("/tmp/wsAccess.log");
+  remove("/tmp/wsAccess.csv");
+  
+  // Each thread's records are in order, but different threads' aren't.
+  const char *expected[] = {
+    "timestamp,clientAddress,clientPort,method,route,status,bytesIn,bytesOut,"
+      "header_receiveUs,body_receiveUs,deserializeUs,callUs,serializeUs,"
+      "sendUs\n",
+    ",127.0.0.1,", ",GET,\"\",200,",
+    ",GET,\"webService/streamUnitTestFunction\",200,",
+    NULL
+  };
+  for (int i = 0; passed && (expected[i] != NULL); i++) {
+    if ((csv == NULL) || (strstr((char*) csv, expected[i]) == NULL)) {
+      printLog(ERR, "Expected \"%s\" in access log, got:\n%s\n",
+        expected[i], (csv != NULL) ? (char*) csv : "(nothing)");
+      passed = false;
+    }
+  }
+  if (passed && (numRecords != 2)) {
+    printLog(ERR, "Expected 2 records, got %lld.\n", lld(numRecords));
+    passed = false;
+  }
+  
+  csv = bytesDestroy(csv);
+  return passed;
+}
+
+bool webServerUnitTest(void) {
+  if (wsHttpRequestParseUnitTest() == false) {
+    printLog(ERR, "wsHttpRequestParseUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsRouteTableUnitTest() == false) {
+    printLog(ERR, "wsRouteTableUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsArenaUnitTest() == false) {
+    printLog(ERR, "wsArenaUnitTest failed.\n");
+    return false;
+  }
+  
+  const char *indexHtmlContent = "Hello world!";
+  size_t indexHtmlSize = strlen(indexHtmlContent);
+  
+  putFileContent("/tmp/index.html", indexHtmlContent, indexHtmlSize);
+  WebServerCreateOptions webServerCreateOptions = {
+    .interfacePath = "/tmp",
+    .serverName = "UnitTestServer",
+    .timeout = 15,
+    .socketMode = PLAIN,
+    .certificate = NULL,
+    .key = NULL,
+    .redirectProtocol = NULL,
+    .redirectPort = 0,
+    .redirectFunction = 0,
+    .webService = 0,
+    .serverMode = WS_THREADED,
+    .numReactorThreads = 0,
+    .numWorkerThreads = 0,
+    .maxQueuedRequests = 0,
+    .overloadPolicy = WS_OVERLOAD_REJECT,
+    .retryAfterSeconds = 0,
+    .keepAliveTimeoutSeconds = 0,
+    .maxRequestsPerConnection = 0,
+    .fileCacheMaxBytes = 0,
+    .compressionLevel = 0,
+    .compressionMinBytes = 0,
+    .maxRequestBodyBytes = 0,
+    .requestBodyMemoryBytes = 0,
+    .numListeners = 0,
+    .pinListeners = false,
+    .metricsPath = NULL,
+    .drainTimeoutSeconds = 0,
+    .maxConnectionsPerClient = 0,
+    .rateLimits = NULL,
+    .tlsSessionCacheSize = 0,
+    .tlsSessionTimeoutSeconds = 0,
+    .tlsTicketKeyLifetimeSeconds = 0,
+    .numSchedulerThreads = 0,
+    .coroutineStackSize = 0,
+    .maxCoroutinesPerThread = 0,
+    .batchPath = NULL,
+    .maxBatchCalls = 0,
+    .parallelBatchCalls = false,
+    .traceFilePath = NULL,
+    .traceSampleRate = 0,
+    .accessLogPath = NULL,
+    .accessLogRotateSeconds = 0,
+  };
+  WebServer* webServer = webServerCreate(8999, &webServerCreateOptions);
+  if (webServer == NULL) {
+    printLog(ERR, "webServerCreate returned NULL.\n");
+    return false;
+  }
+  for (int i = 0; (i < 15) && (webServer->socket == NULL); i++) sleep(1);
+  
+  Bytes response = wcGet("http://127.0.0.1:8999", "/", 500);
+  if (response == NULL) {
+    printLog(ERR, "No response from web server for request to get \"/\".\n");
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  if (strcmp(str(response), indexHtmlContent) != 0) {
+    printLog(ERR, "Expected \"%s\" from web server, got \"%s\".\n",
+      indexHtmlContent, str(response));
+    response = bytesDestroy(response);
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  response = bytesDestroy(response);
+  
+  response = wcGet("http://127.0.0.1:8999", "/index.html", 500);
+  if (response == NULL) {
+    printLog(ERR,
+      "No response from web server for request to get \"/index.html\".\n");
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  if (strcmp(str(response), indexHtmlContent) != 0) {
+    printLog(ERR, "Expected \"%s\" from web server, got \"%s\".\n",
+      indexHtmlContent, str(response));
+    response = bytesDestroy(response);
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  response = bytesDestroy(response);
+  
+  response = wcGet("http://127.0.0.1:8999", "/marklar", 500);
+  if (response != NULL) {
+    printLog(ERR,
+      "Expected NULL response for request to get \"/marklar\". Got \"%s\"\n",
+      str(response));
+    response = bytesDestroy(response);
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  
+  Socket *clientSocket
+     = socketCreate(CLIENT, TCP, "127.0.0.1:8999", PLAIN,
+      /*certificate=*/ NULL, /*key=*/ NULL, 500);
+  const char *sendBuffer = "GET /index.html\r\n\r\n\n";
+  if (socketSend(clientSocket, sendBuffer, strlen(sendBuffer)) < 0) {
+    printLog(ERR, "Could not send \"%s\" to http://127.0.0.1:8999.\n",
+      sendBuffer);
+    clientSocket = socketDestroy(clientSocket);
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  ZEROINIT(char responseBuffer[JUMBO_FRAME_SIZE]);
+  if (socketReceive(clientSocket, responseBuffer, JUMBO_FRAME_SIZE, 500) < 0) {
+    printLog(ERR, "Could not receive index.html from http://127.0.0.1:8999.\n");
+    clientSocket = socketDestroy(clientSocket);
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  responseBuffer[strlen(indexHtmlContent)] = '\0';
+  const char *expectedResponse = "HTTP/1.1 200";
+  if (strncmp(str(responseBuffer),
+    expectedResponse, strlen(expectedResponse)) != 0
+  ) {
+    printLog(ERR, "Expected \"%s\" from web server, got \"%s\".\n",
+      indexHtmlContent, str(responseBuffer));
+    clientSocket = socketDestroy(clientSocket);
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  clientSocket = socketDestroy(clientSocket);
+  
+  if (wsConditionalGetUnitTest(indexHtmlContent) == false) {
+    printLog(ERR, "wsConditionalGetUnitTest failed.\n");
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  
+  if (wsCompressionUnitTest() == false) {
+    printLog(ERR, "wsCompressionUnitTest failed.\n");
+    webServer = webServerDestroy(webServer);
+    return false;
+  }
+  
+  webServer = webServerDestroy(webServer);
+  
+  if (wsStreamingUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsStreamingUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsRequestBodyUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsRequestBodyUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsListenersUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsListenersUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsMetricsUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsMetricsUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsDrainUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsDrainUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsClientLimitsUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsClientLimitsUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsResponseCacheUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsResponseCacheUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsTlsSessionUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsTlsSessionUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsCoroutinesUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsCoroutinesUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsDeferredResponseUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsDeferredResponseUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsBatchUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsBatchUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsRangeUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsRangeUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsTraceUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsTraceUnitTest failed.\n");
+    return false;
+  }
+  
+  if (wsAccessLogUnitTest(webServerCreateOptions) == false) {
+    printLog(ERR, "wsAccessLogUnitTest failed.\n");
+    return false;
+  }
   
   webServerCreateOptions.socketMode = TLS;
   webServer = webServerCreate(9000, &webServerCreateOptions);